@@ -0,0 +1,256 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "bench.h"
+#include "../src/log.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* every benchmark is run this many times and the fastest run is reported */
+#define BENCH_ROUNDS 5
+
+static const bench_t benchmarks[] =
+{
+    { "hash_add/10k", bench_hash_add, 10000, 10000 },
+    { "hash_add/100k", bench_hash_add, 100000, 100000 },
+    { "hash_get/10k", bench_hash_get, 1000000, 10000 },
+    { "hash_get/100k", bench_hash_get, 1000000, 100000 },
+    { "list_add_pop", bench_list_add_pop, 1000000, 64 },
+    { "stack_add", bench_stack_add, 1000000, 100 },
+    { "stack_satisfy", bench_stack_satisfy, 100000, 100 },
+    { "timestack_add", bench_timestack_add, 1000000, 20 },
+    { "timestack_flapping", bench_timestack_flapping, 1000000, 20 },
+    { "strbuf_append", bench_strbuf_append, 1000000, 0 },
+    { "strbuf_append_string", bench_strbuf_append_string, 1000000, 0 },
+    { "parse_command_string", bench_parse_command_string, 200000, 0 },
+    { "split_string", bench_split_string, 200000, 0 },
+    { "parse_config/1k", bench_parse_config, 5, 1000 },
+};
+
+/* allocations are counted while a benchmark is measured only */
+static bool counting = false;
+static uint64_t allocs = 0;
+static uint64_t alloc_bytes = 0;
+
+static volatile const void *sink;
+
+#ifdef __GLIBC__
+/* glibc permits replacing its allocator - the replacements count the
+ * allocations (including the ones of strdup and friends) and forward
+ * them to the original implementation */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static void
+count_alloc(size_t size)
+{
+    if (__atomic_load_n(&counting, __ATOMIC_RELAXED))
+    {
+        __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+    }
+}
+
+void *
+malloc(size_t size)
+{
+    count_alloc(size);
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t count, size_t size)
+{
+    count_alloc(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    count_alloc(size);
+    return __libc_realloc(ptr, size);
+}
+
+#define ALLOCS_COUNTED true
+#else
+#define ALLOCS_COUNTED false
+#endif
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Start (or resume) the measurement of the running benchmark
+ * @param state benchmark state
+ */
+void
+bench_start(bench_state_t *state)
+{
+    if (state->running)
+        return;
+
+    state->running = true;
+    state->allocs -= allocs;
+    state->bytes -= alloc_bytes;
+
+    __atomic_store_n(&counting, true, __ATOMIC_RELAXED);
+
+    state->started = now_ns();
+}
+
+/**
+ * @brief Pause the measurement of the running benchmark
+ * @param state benchmark state
+ */
+void
+bench_stop(bench_state_t *state)
+{
+    if (!state->running)
+        return;
+
+    state->elapsed += now_ns() - state->started;
+
+    __atomic_store_n(&counting, false, __ATOMIC_RELAXED);
+
+    state->running = false;
+    state->allocs += allocs;
+    state->bytes += alloc_bytes;
+}
+
+/**
+ * @brief Keep the compiler from optimizing the computation of the
+ *        given value away
+ * @param value result of the benchmarked operation
+ */
+void
+bench_keep(const void *value)
+{
+    sink = value;
+}
+
+static bench_state_t
+run(const bench_t *bench)
+{
+    bench_state_t best = {0};
+
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++)
+    {
+        bench_state_t state = { .ops = bench->ops, .arg = bench->arg };
+
+        bench_start(&state);
+        bench->func(&state);
+        bench_stop(&state);
+
+        if (round == 0 || state.elapsed < best.elapsed)
+            best = state;
+    }
+
+    return best;
+}
+
+static bool
+selected(const char *name, int argc, char **argv)
+{
+    bool filtered = false;
+
+    for (int32_t idx = 1; idx < argc; idx++)
+    {
+        if (*argv[idx] == '-')
+            continue;
+
+        filtered = true;
+
+        if (strstr(name, argv[idx]))
+            return true;
+    }
+
+    return !filtered;
+}
+
+/**
+ * Usage: nyx-bench [--json] [filter...]
+ *
+ * Runs the benchmarks whose names contain any of the given filters (all
+ * by default). With '--json' one JSON object per benchmark is written
+ * instead of the table so the results can be tracked over time.
+ */
+int
+main(int argc, char **argv)
+{
+    bool json = false;
+
+    /* the informational output of e.g. the config parser is not
+     * what is to be measured */
+    log_levels = NYX_LOG_ERROR | NYX_LOG_PERROR | NYX_LOG_CRITICAL;
+
+    for (int32_t idx = 1; idx < argc; idx++)
+    {
+        if (!strcmp(argv[idx], "--json"))
+            json = true;
+    }
+
+    if (!json)
+        printf("%-24s %10s %12s %12s %12s\n",
+                "benchmark", "ops", "ns/op", "allocs/op", "bytes/op");
+
+    for (uint32_t idx = 0; idx < LEN(benchmarks); idx++)
+    {
+        const bench_t *bench = &benchmarks[idx];
+
+        if (!selected(bench->name, argc, argv))
+            continue;
+
+        bench_state_t result = run(bench);
+
+        double ops = bench->ops;
+        double ns = result.elapsed / ops;
+        double allocs_op = ALLOCS_COUNTED ? result.allocs / ops : -1;
+        double bytes_op = ALLOCS_COUNTED ? result.bytes / ops : -1;
+
+        if (json)
+        {
+            printf("{\"name\":\"%s\",\"ops\":%" PRIu64 ",\"ns_per_op\":%.2f,"
+                    "\"allocs_per_op\":%.3f,\"bytes_per_op\":%.1f}\n",
+                    bench->name, bench->ops, ns, allocs_op, bytes_op);
+        }
+        else
+        {
+            printf("%-24s %10" PRIu64 " %12.1f %12.3f %12.1f\n",
+                    bench->name, bench->ops, ns, allocs_op, bytes_op);
+        }
+
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,108 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "../src/def.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * State of a running benchmark: the benchmark function performs 'ops'
+ * operations and may exclude its setup and teardown from the measurement
+ * by calling 'bench_stop' and 'bench_start' around them.
+ */
+typedef struct
+{
+    uint64_t ops;
+    /** benchmark specific parameter (e.g. the number of keys) */
+    uint64_t arg;
+    bool running;
+    uint64_t started;
+    uint64_t elapsed;
+    uint64_t allocs;
+    uint64_t bytes;
+} bench_state_t;
+
+typedef void (*bench_func_t)(bench_state_t *state);
+
+typedef struct
+{
+    const char *name;
+    bench_func_t func;
+    uint64_t ops;
+    uint64_t arg;
+} bench_t;
+
+void
+bench_start(bench_state_t *state);
+
+void
+bench_stop(bench_state_t *state);
+
+void
+bench_keep(const void *value);
+
+/* hash */
+
+void
+bench_hash_add(bench_state_t *state);
+
+void
+bench_hash_get(bench_state_t *state);
+
+/* list */
+
+void
+bench_list_add_pop(bench_state_t *state);
+
+/* stack/timestack */
+
+void
+bench_stack_add(bench_state_t *state);
+
+void
+bench_stack_satisfy(bench_state_t *state);
+
+void
+bench_timestack_add(bench_state_t *state);
+
+void
+bench_timestack_flapping(bench_state_t *state);
+
+/* strbuf */
+
+void
+bench_strbuf_append(bench_state_t *state);
+
+void
+bench_strbuf_append_string(bench_state_t *state);
+
+/* utils */
+
+void
+bench_parse_command_string(bench_state_t *state);
+
+void
+bench_split_string(bench_state_t *state);
+
+/* config */
+
+void
+bench_parse_config(bench_state_t *state);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,107 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "bench.h"
+#include "../src/config.h"
+#include "../src/hash.h"
+#include "../src/nyx.h"
+#include "../src/watch.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* the directories have to exist for the watches to be valid */
+static bool
+write_config(const char *path, const char *dir, uint64_t watches)
+{
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL)
+        return false;
+
+    fprintf(file, "watches:\n");
+
+    for (uint64_t idx = 0; idx < watches; idx++)
+    {
+        fprintf(file,
+                "  service-%" PRIu64 ":\n"
+                "    start: /usr/bin/server --port %" PRIu64 " --config /etc/server/%" PRIu64 ".conf\n"
+                "    dir: %s\n"
+                "    log_file: %s/%" PRIu64 ".log\n"
+                "    port_check: localhost:%" PRIu64 "\n"
+                "    max_memory: 512M\n"
+                "    env:\n"
+                "      INSTANCE: \"%" PRIu64 "\"\n"
+                "      MODE: production\n",
+                idx, 10000 + idx, idx, dir, dir, idx, 10000 + idx, idx);
+
+        if (idx > 0)
+            fprintf(file, "    depends_on: service-%" PRIu64 "\n", idx - 1);
+    }
+
+    return fclose(file) == 0;
+}
+
+static void
+free_watch(void *data)
+{
+    watch_destroy(data);
+}
+
+/* parse a config file of 'arg' watches from scratch */
+void
+bench_parse_config(bench_state_t *state)
+{
+    char dir[] = "/tmp/nyx-bench-XXXXXX";
+    char path[64];
+
+    bench_stop(state);
+
+    if (mkdtemp(dir) == NULL)
+        return;
+
+    snprintf(path, sizeof(path), "%s/nyx.yaml", dir);
+
+    if (write_config(path, dir, state->arg))
+    {
+        for (uint64_t idx = 0; idx < state->ops; idx++)
+        {
+            nyx_t *nyx = xcalloc1(sizeof(nyx_t));
+
+            nyx->watches = hash_new(free_watch);
+            nyx->options.config_file = path;
+
+            bench_start(state);
+
+            if (!parse_config(nyx, true) || hash_count(nyx->watches) != state->arg)
+                fprintf(stderr, "failed to parse the config of %" PRIu64 " watches\n", state->arg);
+
+            bench_stop(state);
+
+            destroy_options(nyx);
+            nyx_destroy(nyx);
+        }
+    }
+
+    unlink(path);
+    rmdir(dir);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,94 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "bench.h"
+#include "../src/hash.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char **
+make_keys(uint64_t count)
+{
+    char **keys = xcalloc(count, sizeof(char *));
+
+    for (uint64_t idx = 0; idx < count; idx++)
+    {
+        char buffer[64];
+
+        snprintf(buffer, sizeof(buffer), "watch-%" PRIu64 "@%" PRIu64, idx * 7919, idx % 16);
+        keys[idx] = strdup(buffer);
+    }
+
+    return keys;
+}
+
+static void
+free_keys(char **keys, uint64_t count)
+{
+    for (uint64_t idx = 0; idx < count; idx++)
+        free(keys[idx]);
+
+    free(keys);
+}
+
+/* insert 'arg' keys into an empty hash */
+void
+bench_hash_add(bench_state_t *state)
+{
+    bench_stop(state);
+
+    char **keys = make_keys(state->arg);
+    hash_t *hash = hash_new(NULL);
+
+    bench_start(state);
+
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+        hash_add(hash, keys[idx % state->arg], keys[idx % state->arg]);
+
+    bench_stop(state);
+
+    hash_destroy(hash);
+    free_keys(keys, state->arg);
+}
+
+/* look up existing keys in a hash of 'arg' keys */
+void
+bench_hash_get(bench_state_t *state)
+{
+    bench_stop(state);
+
+    char **keys = make_keys(state->arg);
+    hash_t *hash = hash_new(NULL);
+
+    for (uint64_t idx = 0; idx < state->arg; idx++)
+        hash_add(hash, keys[idx], keys[idx]);
+
+    bench_start(state);
+
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+        bench_keep(hash_get(hash, keys[(idx * 31) % state->arg]));
+
+    bench_stop(state);
+
+    hash_destroy(hash);
+    free_keys(keys, state->arg);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
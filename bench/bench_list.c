@@ -0,0 +1,48 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench.h"
+#include "../src/list.h"
+
+/* queue-like usage of the lists as in the engine: 'arg' elements are
+ * in the list while elements are added at the tail and popped from
+ * the head */
+void
+bench_list_add_pop(bench_state_t *state)
+{
+    void *data = NULL;
+
+    bench_stop(state);
+
+    list_t *list = list_new(NULL);
+
+    for (uintptr_t idx = 0; idx < state->arg; idx++)
+        list_add(list, (void *)idx);
+
+    bench_start(state);
+
+    for (uintptr_t idx = 0; idx < state->ops; idx++)
+    {
+        list_add(list, (void *)idx);
+        list_pop(list, &data);
+        bench_keep(data);
+    }
+
+    bench_stop(state);
+
+    list_destroy(list);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,118 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench.h"
+#include "../src/proc.h"
+#include "../src/timestack.h"
+
+#include <time.h>
+
+/* the resource usage history of a process */
+void
+bench_stack_add(bench_state_t *state)
+{
+    stack_long_t *stack = stack_long_new(state->arg);
+
+    stack_long_set_threshold(stack, 512);
+
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+        stack_long_add(stack, idx % 1024);
+
+    bench_keep(&stack->over);
+    bench_stop(state);
+
+    stack_long_destroy(stack);
+}
+
+static bool
+over_limit(uint64_t value, void *limit)
+{
+    return value > *(uint64_t *)limit;
+}
+
+void
+bench_stack_satisfy(bench_state_t *state)
+{
+    uint64_t limit = 512;
+    uint32_t matches = 0;
+
+    bench_stop(state);
+
+    stack_long_t *stack = stack_long_new(state->arg);
+
+    for (uint64_t idx = 0; idx < state->arg; idx++)
+        stack_long_add(stack, (idx * 37) % 1024);
+
+    bench_start(state);
+
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+        matches += stack_long_satisfy(stack, over_limit, &limit);
+
+    bench_keep(&matches);
+    bench_stop(state);
+
+    stack_long_destroy(stack);
+}
+
+/* the state history with a flapping window like the state threads use */
+void
+bench_timestack_add(bench_state_t *state)
+{
+    time_t now = time(NULL);
+    timestack_t *history = timestack_new(state->arg);
+
+    timestack_set_window(history, 60, 16);
+
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+        timestack_add_at(history, now + idx / 4, idx % 8);
+
+    bench_stop(state);
+
+    timestack_destroy(history);
+}
+
+/* the flapping detection queries the counts of two states */
+void
+bench_timestack_flapping(bench_state_t *state)
+{
+    uint32_t flapping = 0;
+
+    bench_stop(state);
+
+    time_t now = time(NULL);
+    timestack_t *history = timestack_new(state->arg);
+
+    timestack_set_window(history, 60, 16);
+
+    for (uint64_t idx = 0; idx < state->arg; idx++)
+        timestack_add_at(history, now, idx % 8);
+
+    bench_start(state);
+
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+    {
+        uint32_t started = timestack_count_within(history, idx % 8);
+        uint32_t stopped = timestack_count_within(history, (idx + 1) % 8);
+
+        flapping += started > 2 && stopped > 2;
+    }
+
+    bench_keep(&flapping);
+    bench_stop(state);
+
+    timestack_destroy(history);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,62 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench.h"
+#include "../src/strbuf.h"
+
+/* a line of the status output */
+void
+bench_strbuf_append(bench_state_t *state)
+{
+    strbuf_t *buf = strbuf_new_size(4096);
+
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+    {
+        if (buf->length > 3500)
+            strbuf_clear(buf);
+
+        strbuf_append(buf, "%s: %s (PID %d)\n", "watch", "running", (int32_t)idx);
+    }
+
+    bench_stop(state);
+
+    strbuf_free(buf);
+}
+
+/* the same line using the append functions without format parsing */
+void
+bench_strbuf_append_string(bench_state_t *state)
+{
+    strbuf_t *buf = strbuf_new_size(4096);
+
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+    {
+        if (buf->length > 3500)
+            strbuf_clear(buf);
+
+        strbuf_append_string(buf, "watch");
+        strbuf_append_string(buf, ": ");
+        strbuf_append_string(buf, "running");
+        strbuf_append_string(buf, " (PID ");
+        strbuf_append_int(buf, idx);
+        strbuf_append_string(buf, ")\n");
+    }
+
+    bench_stop(state);
+
+    strbuf_free(buf);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,44 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench.h"
+#include "../src/utils.h"
+
+void
+bench_parse_command_string(bench_state_t *state)
+{
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+    {
+        const char **args = parse_command_string(
+                "/usr/bin/server --port 8080 --config /etc/server/main.conf -v");
+
+        bench_keep(args);
+        strings_free((char **)args);
+    }
+}
+
+void
+bench_split_string(bench_state_t *state)
+{
+    for (uint64_t idx = 0; idx < state->ops; idx++)
+    {
+        const char **parts = split_string("/status/web/api/worker", "/");
+
+        bench_keep(parts);
+        strings_free((char **)parts);
+    }
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
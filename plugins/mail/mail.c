@@ -17,6 +17,8 @@
 #include "hash.h"
 #include "log.h"
 #include "plugins.h"
+#include "state.h"
+#include "strbuf.h"
 
 #include <curl/curl.h>
 #include <stdio.h>
@@ -32,8 +34,10 @@
     "To: <%s>" CRLF \
     "From: <%s>(nyx)" CRLF \
     "Subject: %s" CRLF \
-    CRLF \
-    "%s: %s" CRLF
+    CRLF
+
+/* default length of the digest window in seconds */
+#define MAIL_DIGEST_WINDOW 5
 
 typedef struct
 {
@@ -75,48 +79,29 @@ send_payload(void *ptr, size_t size, size_t nmemb, void *userdata)
 }
 
 static void
-handle_state(const char *name, int state, pid_t pid, void *userdata)
+send_mail(mail_ctx_t *ctx, const char *subject, const char *body)
 {
-    static const size_t length = 1024;
-    mail_ctx_t *ctx = userdata;
-
-    if (!ctx)
-        return;
-
     CURL *curl = curl_easy_init();
     CURLcode code = CURLE_OK;
 
     if (!curl)
         return;
 
-    mail_msg_t *msg = xcalloc1(sizeof(mail_msg_t));
-
-    msg->length = length;
-    msg->msg = xcalloc(length, sizeof(char));
-
     /* build message */
 
     char date[64] = {0};
-    char message[128] = {0};
 
     time_t now = time(NULL);
     struct tm *local = localtime(&now);
 
     strftime(date, LEN(date), "%d %b %Y %H:%M:%S %z", local);
 
-    if (pid)
-    {
-        snprintf(message, LEN(message),
-                "Watch '%s' [%d] changed state to %d", name, pid, state);
-    }
-    else
-    {
-        snprintf(message, LEN(message),
-                "Watch '%s' changed state to %d", name, state);
-    }
+    strbuf_t *buffer = strbuf_new();
 
-    msg->length = snprintf(msg->msg,
-            length, MAIL_TEMPLATE, date, ctx->to, ctx->from, message, date, message);
+    strbuf_append(buffer, MAIL_TEMPLATE, date, ctx->to, ctx->from, subject);
+    strbuf_append(buffer, "%s: %s", date, body);
+
+    mail_msg_t msg = { 0, buffer->length, buffer->buf };
 
     /* configure curl handle */
 
@@ -133,7 +118,7 @@ handle_state(const char *name, int state, pid_t pid, void *userdata)
     curl_easy_setopt(curl, CURLOPT_MAIL_RCPT, recipients);
 
     curl_easy_setopt(curl, CURLOPT_READFUNCTION, send_payload);
-    curl_easy_setopt(curl, CURLOPT_READDATA, msg);
+    curl_easy_setopt(curl, CURLOPT_READDATA, &msg);
     curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
 
     curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
@@ -148,8 +133,91 @@ handle_state(const char *name, int state, pid_t pid, void *userdata)
     curl_slist_free_all(recipients);
     curl_easy_cleanup(curl);
 
-    free(msg->msg);
-    free(msg);
+    strbuf_free(buffer);
+}
+
+static void
+handle_state(const char *name, int state, pid_t pid, void *userdata)
+{
+    mail_ctx_t *ctx = userdata;
+
+    if (!ctx)
+        return;
+
+    char message[128] = {0};
+
+    if (pid)
+    {
+        snprintf(message, LEN(message),
+                "Watch '%s' [%d] changed state to %d", name, pid, state);
+    }
+    else
+    {
+        snprintf(message, LEN(message),
+                "Watch '%s' changed state to %d", name, state);
+    }
+
+    char body[256] = {0};
+
+    snprintf(body, LEN(body), "%s" CRLF, message);
+
+    send_mail(ctx, message, body);
+}
+
+/**
+ * @brief Send one mail listing the final state of every watch that changed
+ *        its state during the digest window
+ */
+static void
+handle_digest(const plugin_digest_t *digest, void *userdata)
+{
+    mail_ctx_t *ctx = userdata;
+
+    if (!ctx || digest->count < 1)
+        return;
+
+    char subject[128] = {0};
+    strbuf_t *body = strbuf_new();
+
+    if (digest->count == 1)
+    {
+        snprintf(subject, LEN(subject), "Watch '%s' changed state to %s",
+                digest->entries[0]->name,
+                state_to_human_string(digest->entries[0]->state));
+    }
+    else
+    {
+        snprintf(subject, LEN(subject), "%u watches changed state",
+                digest->count);
+    }
+
+    strbuf_append(body, "%u state changes of %u watches" CRLF CRLF,
+            digest->changes, digest->count);
+
+    for (uint32_t i = 0; i < digest->count; i++)
+    {
+        plugin_digest_entry_t *entry = digest->entries[i];
+
+        strbuf_append(body, "Watch '%s'", entry->name);
+
+        if (entry->pid)
+            strbuf_append(body, " [%d]", entry->pid);
+
+        strbuf_append(body, " changed state to %s",
+                state_to_human_string(entry->state));
+
+        if (entry->changes > 1)
+        {
+            strbuf_append(body, " (%u state changes since %s)", entry->changes,
+                    state_to_human_string(entry->first_state));
+        }
+
+        strbuf_append(body, CRLF);
+    }
+
+    send_mail(ctx, subject, body->buf);
+
+    strbuf_free(body);
 }
 
 static void
@@ -195,7 +263,18 @@ plugin_init(plugin_manager_t *manager)
         return 0;
     }
 
-    plugin_register_state_callback(manager, handle_state, ctx);
+    /* the state changes are sent in digests unless the window is 0 */
+    const char *window = hash_get(cfg, "mail_digest_window");
+    int32_t seconds = window && *window ? atoi(window) : MAIL_DIGEST_WINDOW;
+
+    if (seconds > 0)
+        plugin_register_digest_callback(manager, handle_digest, ctx, seconds);
+    else
+    {
+        plugin_register_state_callback_overflow(manager, handle_state, ctx,
+                PLUGIN_OVERFLOW_COALESCE);
+    }
+
     plugin_register_destroy_callback(manager, handle_destroy, ctx);
 
     return 1;
@@ -203,5 +282,6 @@ plugin_init(plugin_manager_t *manager)
 
 #undef CRLF
 #undef MAIL_TEMPLATE
+#undef MAIL_DIGEST_WINDOW
 
 /* vim: set et sw=4 sts=4 tw=80: */
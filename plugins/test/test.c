@@ -15,6 +15,7 @@
 
 #include "plugins.h"
 
+#include <signal.h>
 #include <stdio.h>
 #include <sys/types.h>
 
@@ -25,10 +26,32 @@ handle_callback(const char *name, int state, pid_t pid, void *userdata)
     printf("test plugin: got event %d of watch '%s' [%d]\n", state, name, pid);
 }
 
+/* check 'alive' succeeds if the process exists */
+static bool
+handle_check(const char *name, pid_t pid, const char *argument, uint32_t timeout, void *userdata)
+{
+    return kill(pid, 0) == 0;
+}
+
+static void
+handle_metrics(const plugin_metrics_t *metrics, void *userdata)
+{
+    printf("test plugin: got %u samples\n", metrics->count);
+
+    for (uint32_t i = 0; i < metrics->count; i++)
+    {
+        printf("test plugin:   '%s' [%d] cpu %.2f%% memory %lu kB\n",
+                metrics->samples[i].name, metrics->samples[i].pid,
+                metrics->samples[i].cpu, (unsigned long)metrics->samples[i].memory);
+    }
+}
+
 int
 plugin_init(plugin_manager_t *manager)
 {
     plugin_register_state_callback(manager, handle_callback, NULL);
+    plugin_register_check(manager, "alive", handle_check, NULL);
+    plugin_register_metrics_sink(manager, handle_metrics, NULL);
 
     return 1;
 }
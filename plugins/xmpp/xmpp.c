@@ -18,6 +18,7 @@
 #include "log.h"
 #include "plugins.h"
 #include "state.h"
+#include "strbuf.h"
 #include "utils.h"
 
 #include <pthread.h>
@@ -26,6 +27,9 @@
 #include <strophe.h>
 #include <sys/types.h>
 
+/* default length of the digest window in seconds */
+#define XMPP_DIGEST_WINDOW 5
+
 typedef enum
 {
     NYX_XMPP_STARTUP,
@@ -122,6 +126,50 @@ handle_state_change(const char *name, int state, pid_t pid, void *userdata)
         send_groupchat(info, buffer);
 }
 
+/**
+ * @brief Send one message listing the final state of every watch that
+ *        changed its state during the digest window
+ */
+static void
+handle_digest(const plugin_digest_t *digest, void *userdata)
+{
+    xmpp_info_t *info = userdata;
+
+    if (info == NULL || info->state != NYX_XMPP_CONNECTED || digest->count < 1)
+        return;
+
+    strbuf_t *buffer = strbuf_new();
+
+    if (digest->count > 1)
+    {
+        strbuf_append(buffer, "%u watches changed state (%u state changes)",
+                digest->count, digest->changes);
+    }
+
+    for (uint32_t i = 0; i < digest->count; i++)
+    {
+        plugin_digest_entry_t *entry = digest->entries[i];
+
+        strbuf_append(buffer, "%sWatch '%s' changed state to %s [%d]",
+                digest->count > 1 ? "\n" : "",
+                entry->name, state_to_human_string(entry->state), entry->pid);
+
+        if (entry->changes > 1)
+        {
+            strbuf_append(buffer, " (%u state changes since %s)", entry->changes,
+                    state_to_human_string(entry->first_state));
+        }
+    }
+
+    if (info->recipient)
+        send_chat(info, buffer->buf);
+
+    if (info->groupchat)
+        send_groupchat(info, buffer->buf);
+
+    strbuf_free(buffer);
+}
+
 static void
 handle_destroy_callback(void *userdata)
 {
@@ -264,7 +312,7 @@ int
 plugin_init(plugin_manager_t *manager)
 {
     const char *jid = NULL, *pass = NULL, *recipient = NULL, *groupchat = NULL;
-    const char *reconnect = NULL, *debug = NULL;
+    const char *reconnect = NULL, *debug = NULL, *window = NULL;
 
     /* look for mandatory config values */
     jid = hash_get(manager->config, "xmpp_jid");
@@ -282,6 +330,7 @@ plugin_init(plugin_manager_t *manager)
 
     reconnect = hash_get(manager->config, "xmpp_reconnect_timeout");
     debug = hash_get(manager->config, "xmpp_debug");
+    window = hash_get(manager->config, "xmpp_digest_window");
 
     xmpp_info_t *info = xcalloc1(sizeof(xmpp_info_t));
 
@@ -326,11 +375,23 @@ plugin_init(plugin_manager_t *manager)
         return 0;
     }
 
-    /* register callback functions */
-    plugin_register_state_callback(manager, handle_state_change, info);
+    /* register callback functions - the state changes are sent in digests
+     * unless the window is 0 */
+    int seconds = window && *window != '\0' ? atoi(window) : XMPP_DIGEST_WINDOW;
+
+    if (seconds > 0)
+        plugin_register_digest_callback(manager, handle_digest, info, seconds);
+    else
+    {
+        plugin_register_state_callback_overflow(manager, handle_state_change, info,
+                PLUGIN_OVERFLOW_COALESCE);
+    }
+
     plugin_register_destroy_callback(manager, handle_destroy_callback, info);
 
     return 1;
 }
 
+#undef XMPP_DIGEST_WINDOW
+
 /* vim: set et sw=4 sts=4 tw=80: */
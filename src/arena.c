@@ -0,0 +1,151 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define NYX_MEM_TAG MEM_CONFIG
+
+#include "arena.h"
+#include "def.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN (sizeof(long double))
+
+/**
+ * @brief Create a new arena with a single reference
+ * @return new arena instance
+ */
+arena_t *
+arena_new(void)
+{
+    arena_t *arena = xcalloc1(sizeof(arena_t));
+
+    arena->refs = 1;
+
+    return arena;
+}
+
+static arena_chunk_t *
+chunk_new(size_t size)
+{
+    arena_chunk_t *chunk = xcalloc1(sizeof(arena_chunk_t) + size);
+
+    chunk->size = size;
+
+    return chunk;
+}
+
+/**
+ * @brief Allocate zeroed memory from the given arena
+ * @param arena arena instance
+ * @param size  number of bytes to allocate
+ * @return pointer to the allocated memory which is valid as long as
+ *         the arena is
+ */
+void *
+arena_alloc(arena_t *arena, size_t size)
+{
+    size = (MAX(size, 1) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    arena_chunk_t *chunk = arena->chunks;
+
+    if (chunk == NULL || chunk->size - chunk->used < size)
+    {
+        /* oversized objects get a chunk of their own behind the
+         * current one so its remaining space is still used */
+        if (size > ARENA_CHUNK_SIZE / 4 && chunk != NULL)
+        {
+            arena_chunk_t *large = chunk_new(size);
+
+            large->next = chunk->next;
+            chunk->next = large;
+            chunk = large;
+        }
+        else
+        {
+            chunk = chunk_new(MAX(size, (size_t)ARENA_CHUNK_SIZE));
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+        }
+    }
+
+    void *ptr = (char *)chunk->data + chunk->used;
+
+    chunk->used += size;
+    arena->allocated += size;
+
+    return ptr;
+}
+
+/**
+ * @brief Copy the given string into the arena
+ * @param arena arena instance
+ * @param str   string to copy (may be NULL)
+ * @return copied string or NULL
+ */
+char *
+arena_strdup(arena_t *arena, const char *str)
+{
+    if (str == NULL)
+        return NULL;
+
+    size_t length = strlen(str) + 1;
+    char *copy = arena_alloc(arena, length);
+
+    memcpy(copy, str, length);
+
+    return copy;
+}
+
+/**
+ * @brief Add a reference to the given arena
+ * @param arena arena instance
+ * @return the arena
+ */
+arena_t *
+arena_retain(arena_t *arena)
+{
+    if (arena)
+        __atomic_add_fetch(&arena->refs, 1, __ATOMIC_RELAXED);
+
+    return arena;
+}
+
+/**
+ * @brief Drop a reference to the given arena and free all of its memory
+ *        when it was the last one
+ * @param arena arena instance
+ */
+void
+arena_release(arena_t *arena)
+{
+    if (arena == NULL || __atomic_sub_fetch(&arena->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    arena_chunk_t *chunk = arena->chunks;
+
+    while (chunk)
+    {
+        arena_chunk_t *next = chunk->next;
+
+        xfree(chunk);
+        chunk = next;
+    }
+
+    xfree(arena);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
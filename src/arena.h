@@ -0,0 +1,65 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* size of the chunks an arena allocates from */
+#define ARENA_CHUNK_SIZE 4096
+
+typedef struct arena_chunk_t
+{
+    struct arena_chunk_t *next;
+    size_t size;
+    size_t used;
+    /* max_align_t alignment of the data */
+    long double data[];
+} arena_chunk_t;
+
+/**
+ * Bump allocator for objects sharing one lifetime, like the strings and
+ * argument lists of the watches parsed from one config file. Single
+ * objects are never freed - the whole arena is released at once when the
+ * last reference to it is dropped.
+ *
+ * Allocating is not thread-safe, retaining and releasing is.
+ */
+typedef struct
+{
+    uint32_t refs;
+    arena_chunk_t *chunks;
+    /** total number of bytes allocated from the arena */
+    size_t allocated;
+} arena_t;
+
+arena_t *
+arena_new(void);
+
+void *
+arena_alloc(arena_t *arena, size_t size);
+
+char *
+arena_strdup(arena_t *arena, const char *str);
+
+arena_t *
+arena_retain(arena_t *arena);
+
+void
+arena_release(arena_t *arena);
+
+/* vim: set et sw=4 sts=4 tw=80: */
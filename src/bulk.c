@@ -0,0 +1,448 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_STATE
+
+#include "bulk.h"
+#include "connector.h"
+#include "def.h"
+#include "log.h"
+#include "nyx.h"
+#include "state.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+
+/* size of the header of a session response frame */
+#define FRAME_HEADER_LEN 9
+
+static void
+bulk_entry_free(void *data)
+{
+    bulk_entry_t *entry = data;
+
+    xfree(entry->name);
+    xfree(entry);
+}
+
+/**
+ * @brief Create the registry of bulk state changes
+ * @param reactor reactor the timeouts are checked on
+ * @param nyx     nyx instance
+ * @return new registry
+ */
+bulk_ops_t *
+bulk_ops_new(reactor_t *reactor, void *nyx)
+{
+    bulk_ops_t *ops = xcalloc1(sizeof(bulk_ops_t));
+
+    pthread_mutex_init(&ops->lock, NULL);
+
+    ops->reactor = reactor;
+    ops->nyx = nyx;
+    ops->ops = list_new(NULL);
+    ops->timer = -1;
+
+    return ops;
+}
+
+/**
+ * @brief Create a new bulk state change
+ * @param command     requested state (stopping, starting or restarting)
+ * @param concurrency maximum number of watches in transition at the same
+ *                    time (0 meaning unlimited)
+ * @return new bulk state change
+ */
+bulk_t *
+bulk_new(int32_t command, uint32_t concurrency)
+{
+    bulk_t *bulk = xcalloc1(sizeof(bulk_t));
+
+    bulk->fd = -1;
+    bulk->command = command;
+    bulk->concurrency = concurrency;
+    bulk->pending = list_new(xfree_data);
+    bulk->active = list_new(bulk_entry_free);
+    bulk->output = strbuf_new();
+
+    return bulk;
+}
+
+/**
+ * @brief Add a watch (instance) to the bulk state change
+ * @param bulk bulk state change
+ * @param name name of the watch instance
+ */
+void
+bulk_add(bulk_t *bulk, const char *name)
+{
+    list_add(bulk->pending, xstrdup(name));
+    bulk->count++;
+}
+
+void
+bulk_free(bulk_t *bulk)
+{
+    if (bulk == NULL)
+        return;
+
+    list_destroy(bulk->pending);
+    list_destroy(bulk->active);
+    strbuf_free(bulk->output);
+
+    xfree(bulk);
+}
+
+static bool
+reached(int32_t command, int32_t state)
+{
+    if (command == STATE_STOPPING)
+        return state == STATE_STOPPED || state == STATE_UNMONITORED;
+
+    return state == STATE_RUNNING;
+}
+
+/* dispatch the state change of the given watch - returns false if
+ * there is nothing to wait for */
+static bool
+dispatch_one(bulk_ops_t *ops, bulk_t *bulk, char *name)
+{
+    nyx_t *nyx = ops->nyx;
+    state_t *state = nyx->state_map ? hash_get(nyx->state_map, name) : NULL;
+
+    if (state == NULL)
+    {
+        strbuf_append(bulk->output, "%s: unknown watch\n", name);
+        bulk->failed = true;
+        return false;
+    }
+
+    state_e current = state->state;
+    state_e value = bulk->command;
+
+    /* the watch is in the requested state already */
+    if (value != STATE_RESTARTING && reached(value, current))
+    {
+        strbuf_append(bulk->output, "%s: %s\n", name, state_to_human_string(current));
+        return false;
+    }
+
+    /* only running watches can be restarted - the others are started */
+    if (value == STATE_RESTARTING && current != STATE_RUNNING)
+        value = STATE_STARTING;
+
+    bulk_entry_t *entry = xcalloc1(sizeof(bulk_entry_t));
+
+    entry->name = name;
+    entry->deadline = time(NULL) + NYX_BULK_TIMEOUT;
+
+    list_add(bulk->active, entry);
+
+    set_state_command(state, value);
+
+    return true;
+}
+
+/* has to be called with the lock being held */
+static void
+dispatch(bulk_ops_t *ops, bulk_t *bulk)
+{
+    void *name = NULL;
+
+    while ((bulk->concurrency == 0 || list_size(bulk->active) < bulk->concurrency) &&
+           list_pop(bulk->pending, &name))
+    {
+        if (!dispatch_one(ops, bulk, name))
+            xfree(name);
+    }
+}
+
+static bool
+finished(bulk_t *bulk)
+{
+    return list_size(bulk->pending) < 1 && list_size(bulk->active) < 1;
+}
+
+/* has to be called with the lock being held */
+static bool
+unlink_op(bulk_ops_t *ops, bulk_t *bulk)
+{
+    for (list_node_t *node = ops->ops->head; node; node = node->next)
+    {
+        if (node->data == bulk)
+        {
+            list_remove(ops->ops, node);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Answer the client of a finished (and unlinked) bulk state change - the
+ * response is handed to the connector that sends it without blocking
+ * and closes the client socket afterwards.
+ */
+static void
+complete(bulk_t *bulk)
+{
+    strbuf_t *output = bulk->output;
+    strbuf_t *response = strbuf_new_size(FRAME_HEADER_LEN + output->length + 3);
+
+    log_info("Bulk %s of %u watches finished%s",
+            state_to_human_string(bulk->command), bulk->count,
+            bulk->failed ? " with failures" : "");
+
+    if (bulk->framed)
+    {
+        char header[FRAME_HEADER_LEN];
+        uint32_t value = htonl(output->length);
+
+        memcpy(header, &value, sizeof(uint32_t));
+
+        value = htonl(bulk->request_id);
+        memcpy(header + 4, &value, sizeof(uint32_t));
+
+        header[8] = bulk->failed ? 1 : 0;
+
+        strbuf_append_data(response, header, FRAME_HEADER_LEN);
+        strbuf_append_data(response, output->buf, output->length);
+    }
+    else
+    {
+        /* followed by the status as sent by send_status_safe() */
+        const char status[] = { 0, '1', 0 };
+
+        strbuf_append_data(response, output->buf, output->length);
+
+        if (bulk->failed)
+            strbuf_append_data(response, status, LEN(status));
+    }
+
+    connector_respond(bulk->owner->reactor, bulk->fd, response);
+    bulk_free(bulk);
+}
+
+/* has to be called with the lock being held */
+static void
+expire(bulk_ops_t *ops, bulk_t *bulk, time_t now)
+{
+    nyx_t *nyx = ops->nyx;
+    list_node_t *node = bulk->active->head;
+
+    while (node)
+    {
+        list_node_t *next = node->next;
+        bulk_entry_t *entry = node->data;
+
+        if (entry->deadline <= now)
+        {
+            state_t *state = nyx->state_map ? hash_get(nyx->state_map, entry->name) : NULL;
+
+            strbuf_append(bulk->output, "%s: timed out (%s)\n", entry->name,
+                    state ? state_to_human_string(state->state) : "unknown");
+
+            bulk->failed = true;
+            list_remove(bulk->active, node);
+        }
+
+        node = next;
+    }
+
+    dispatch(ops, bulk);
+}
+
+static void
+check_timeouts(reactor_t *reactor, void *data)
+{
+    bulk_ops_t *ops = data;
+    list_t *done = list_new(NULL);
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&ops->lock);
+
+    list_node_t *node = ops->ops->head;
+
+    while (node)
+    {
+        list_node_t *next = node->next;
+        bulk_t *bulk = node->data;
+
+        expire(ops, bulk, now);
+
+        if (finished(bulk))
+        {
+            list_add(done, bulk);
+            list_remove(ops->ops, node);
+        }
+
+        node = next;
+    }
+
+    /* nothing left to check */
+    if (list_size(ops->ops) < 1 && ops->timer >= 0)
+    {
+        reactor_remove_timer(reactor, ops->timer);
+        ops->timer = -1;
+    }
+
+    pthread_mutex_unlock(&ops->lock);
+
+    void *bulk = NULL;
+
+    while (list_pop(done, &bulk))
+        complete(bulk);
+
+    list_destroy(done);
+}
+
+/**
+ * @brief Start dispatching the state changes - the client socket is
+ *        owned by the bulk state change from now on
+ * @param ops        registry of bulk state changes
+ * @param bulk       bulk state change (owned by the registry from now)
+ * @param fd         client socket the response is sent to
+ * @param framed     send the response as a session response frame
+ * @param request_id request id of the session's request
+ */
+void
+bulk_start(bulk_ops_t *ops, bulk_t *bulk, int32_t fd, bool framed, uint32_t request_id)
+{
+    bool done = false;
+
+    bulk->owner = ops;
+    bulk->fd = fd;
+    bulk->framed = framed;
+    bulk->request_id = request_id;
+
+    log_info("Bulk %s of %u watches (%u at once)",
+            state_to_human_string(bulk->command), bulk->count,
+            bulk->concurrency ? bulk->concurrency : bulk->count);
+
+    pthread_mutex_lock(&ops->lock);
+
+    list_add(ops->ops, bulk);
+
+    dispatch(ops, bulk);
+
+    if (finished(bulk))
+        done = unlink_op(ops, bulk);
+    else if (ops->timer < 0)
+        ops->timer = reactor_add_timer(ops->reactor, 1000, true, check_timeouts, ops);
+
+    pthread_mutex_unlock(&ops->lock);
+
+    if (done)
+        complete(bulk);
+}
+
+/**
+ * @brief Notify the bulk state changes about a state transition
+ * @param ops   registry of bulk state changes
+ * @param name  name of the watch instance
+ * @param state new state of the watch
+ */
+void
+bulk_notify(bulk_ops_t *ops, const char *name, int32_t state)
+{
+    list_t *done = NULL;
+
+    pthread_mutex_lock(&ops->lock);
+
+    list_node_t *node = ops->ops->head;
+
+    while (node)
+    {
+        list_node_t *next = node->next;
+        bulk_t *bulk = node->data;
+
+        for (list_node_t *active = bulk->active->head; active; active = active->next)
+        {
+            bulk_entry_t *entry = active->data;
+
+            if (strcmp(entry->name, name))
+                continue;
+
+            /* a watch that gave up starting won't reach 'running' */
+            bool failed = bulk->command != STATE_STOPPING && state == STATE_UNMONITORED;
+
+            if (reached(bulk->command, state) || failed)
+            {
+                strbuf_append(bulk->output, "%s: %s\n", name, state_to_human_string(state));
+
+                bulk->failed |= failed;
+                list_remove(bulk->active, active);
+
+                dispatch(ops, bulk);
+            }
+
+            break;
+        }
+
+        if (finished(bulk))
+        {
+            if (done == NULL)
+                done = list_new(NULL);
+
+            list_add(done, bulk);
+            list_remove(ops->ops, node);
+        }
+
+        node = next;
+    }
+
+    pthread_mutex_unlock(&ops->lock);
+
+    if (done)
+    {
+        void *bulk = NULL;
+
+        while (list_pop(done, &bulk))
+            complete(bulk);
+
+        list_destroy(done);
+    }
+}
+
+void
+bulk_ops_destroy(bulk_ops_t *ops)
+{
+    void *data = NULL;
+
+    if (ops == NULL)
+        return;
+
+    while (list_pop(ops->ops, &data))
+    {
+        bulk_t *bulk = data;
+
+        close(bulk->fd);
+        bulk_free(bulk);
+    }
+
+    if (ops->timer >= 0)
+        reactor_remove_timer(ops->reactor, ops->timer);
+
+    list_destroy(ops->ops);
+    pthread_mutex_destroy(&ops->lock);
+
+    xfree(ops);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
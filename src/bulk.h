@@ -0,0 +1,97 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "list.h"
+#include "reactor.h"
+#include "strbuf.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* maximum time in seconds a watch may take to reach the requested state */
+#define NYX_BULK_TIMEOUT 60
+
+/** watch that was requested to change its state */
+typedef struct
+{
+    char *name;
+    time_t deadline;
+} bulk_entry_t;
+
+typedef struct bulk_ops_t bulk_ops_t;
+
+/**
+ * State change of multiple watches that answers the client as soon as
+ * all of them reached the requested state. At most 'concurrency' watches
+ * are changing their state at the same time.
+ */
+typedef struct
+{
+    bulk_ops_t *owner;
+    int32_t fd;
+    /** the response is sent as a session response frame */
+    bool framed;
+    uint32_t request_id;
+    /** requested state (stopping, starting or restarting) */
+    int32_t command;
+    /** maximum number of watches in transition (0 = unlimited) */
+    uint32_t concurrency;
+    uint32_t count;
+    /** names of the watches waiting to be dispatched */
+    list_t *pending;
+    /** watches that are changing their state */
+    list_t *active;
+    strbuf_t *output;
+    bool failed;
+} bulk_t;
+
+/** all bulk state changes in progress */
+struct bulk_ops_t
+{
+    pthread_mutex_t lock;
+    reactor_t *reactor;
+    /** nyx instance */
+    void *nyx;
+    list_t *ops;
+    /** timer checking the deadlines (-1 while no change is in progress) */
+    int32_t timer;
+};
+
+bulk_ops_t *
+bulk_ops_new(reactor_t *reactor, void *nyx);
+
+bulk_t *
+bulk_new(int32_t command, uint32_t concurrency);
+
+void
+bulk_add(bulk_t *bulk, const char *name);
+
+void
+bulk_start(bulk_ops_t *ops, bulk_t *bulk, int32_t fd, bool framed, uint32_t request_id);
+
+void
+bulk_notify(bulk_ops_t *ops, const char *name, int32_t state);
+
+void
+bulk_free(bulk_t *bulk);
+
+void
+bulk_ops_destroy(bulk_ops_t *ops);
+
+/* vim: set et sw=4 sts=4 tw=80: */
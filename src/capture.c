@@ -0,0 +1,599 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#define NYX_LOG_CATEGORY NYX_LOG_FORKER
+
+#include "capture.h"
+#include "def.h"
+#include "fs.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* bytes that are moved at most with a single call */
+#define CAPTURE_CHUNK (64 * 1024)
+
+/* chunks that are moved per pipe and wakeup so a chatty process
+ * cannot stall the spawning of the other ones */
+#define CAPTURE_BURST 16
+
+/* requested capacity of the pipes so the processes can write bursts
+ * without waiting for the forker */
+#define CAPTURE_PIPE_SIZE (1024 * 1024)
+
+#define CAPTURE_FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
+/**
+ * @brief Create a new output capture
+ * @return new capture instance
+ */
+capture_t *
+capture_new(void)
+{
+    capture_t *capture = xcalloc1(sizeof(capture_t));
+
+    capture->files = hash_new(NULL);
+    capture->pipes = list_new(xfree_data);
+    capture->buffer = xcalloc(CAPTURE_CHUNK, sizeof(char));
+
+    return capture;
+}
+
+static void
+file_configure(capture_file_t *file, const watch_t *watch)
+{
+    file->max_size = watch->log_max_size * 1024;
+    file->max_age = watch->log_max_age;
+    file->keep = watch->log_keep ? watch->log_keep : CAPTURE_DEFAULT_KEEP;
+    file->compress = watch->log_compress;
+}
+
+/* the segments are written at explicit offsets as 'splice' does not
+ * support files opened with O_APPEND */
+static bool
+file_open(capture_file_t *file)
+{
+    struct stat st;
+    const int32_t flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+
+    bool created = true;
+    int32_t fd = open(file->path, flags | O_EXCL, CAPTURE_FILE_MODE);
+
+    if (fd == -1 && errno == EEXIST)
+    {
+        created = false;
+        fd = open(file->path, flags, CAPTURE_FILE_MODE);
+    }
+
+    if (fd == -1)
+    {
+        log_perror("nyx: open %s", file->path);
+        return false;
+    }
+
+    /* the file belongs to the watch's user as if the process created it */
+    if (created && (file->uid || file->gid) &&
+            fchown(fd, file->uid ? file->uid : (uid_t)-1, file->gid ? file->gid : (gid_t)-1) == -1)
+        log_perror("nyx: fchown %s", file->path);
+
+    file->fd = fd;
+    file->size = fstat(fd, &st) == 0 ? st.st_size : 0;
+    file->opened = time(NULL);
+
+    return true;
+}
+
+static capture_file_t *
+file_new(const char *path, const watch_t *watch)
+{
+    capture_file_t *file = xcalloc1(sizeof(capture_file_t));
+
+    file->path = xstrdup(path);
+    file->fd = -1;
+
+    if (watch->uid)
+        get_user(watch->uid, &file->uid, &file->gid);
+
+    if (watch->gid)
+        get_group(watch->gid, &file->gid);
+
+    file_configure(file, watch);
+
+    return file;
+}
+
+static void
+file_free(capture_file_t *file)
+{
+    if (file->fd != -1)
+        close(file->fd);
+
+    xfree(file->path);
+    xfree(file);
+}
+
+static char *
+segment_path(const char *path, uint32_t index, bool compressed)
+{
+    char *segment = NULL;
+
+    if (asprintf(&segment, "%s.%u%s", path, index, compressed ? ".gz" : "") == -1)
+        log_critical_perror("nyx: asprintf");
+
+    return segment;
+}
+
+/**
+ * Compress the finished segment into 'target' in the background: the
+ * 'gzip' process is double-forked so the forker does not have to reap it
+ * and the segment is unlinked right away as it keeps the file open.
+ */
+static bool
+compress_segment(const char *path, const char *target)
+{
+    bool success = false;
+    int32_t input = open(path, O_RDONLY | O_CLOEXEC);
+    int32_t output = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, CAPTURE_FILE_MODE);
+
+    if (input != -1 && output != -1)
+    {
+        pid_t pid = fork();
+
+        if (pid == 0)
+        {
+            if (fork() == 0)
+            {
+                if (dup2(input, STDIN_FILENO) != -1 && dup2(output, STDOUT_FILENO) != -1)
+                    execlp("gzip", "gzip", "-c", NULL);
+
+                _exit(EXIT_FAILURE);
+            }
+
+            _exit(EXIT_SUCCESS);
+        }
+
+        if (pid == -1)
+            log_perror("nyx: fork");
+        else
+        {
+            waitpid(pid, NULL, 0);
+            success = unlink(path) == 0;
+        }
+    }
+    else
+        log_perror("nyx: open %s", input == -1 ? path : target);
+
+    if (input != -1)
+        close(input);
+
+    if (output != -1)
+    {
+        close(output);
+
+        if (!success)
+            unlink(target);
+    }
+
+    return success;
+}
+
+/**
+ * Rotate the log file: the segments 'path.N' are shifted to 'path.N+1'
+ * (dropping the ones beyond 'keep') and the current file becomes
+ * 'path.1' (or 'path.1.gz').
+ */
+static void
+file_rotate(capture_file_t *file)
+{
+    log_info("Rotating log file '%s' (%lld bytes)", file->path, (long long)file->size);
+
+    char *oldest = segment_path(file->path, file->keep, file->compress);
+
+    if (unlink(oldest) == -1 && errno != ENOENT)
+        log_perror("nyx: unlink %s", oldest);
+
+    free(oldest);
+
+    for (uint32_t idx = file->keep - 1; idx > 0; idx--)
+    {
+        char *from = segment_path(file->path, idx, file->compress);
+        char *to = segment_path(file->path, idx + 1, file->compress);
+
+        if (rename(from, to) == -1 && errno != ENOENT)
+            log_perror("nyx: rename %s", from);
+
+        free(from);
+        free(to);
+    }
+
+    char *first = segment_path(file->path, 1, file->compress);
+
+    if (!file->compress || !compress_segment(file->path, first))
+    {
+        char *plain = segment_path(file->path, 1, false);
+
+        if (rename(file->path, plain) == -1)
+            log_perror("nyx: rename %s", file->path);
+
+        free(plain);
+    }
+
+    free(first);
+
+    close(file->fd);
+    file->fd = -1;
+
+    file_open(file);
+}
+
+static bool
+file_expired(capture_file_t *file)
+{
+    if (file->size < 1)
+        return false;
+
+    if (file->max_size && (uint64_t)file->size >= file->max_size)
+        return true;
+
+    return file->max_age && time(NULL) - file->opened >= file->max_age;
+}
+
+static bool
+is_pipe(int32_t fd)
+{
+    struct stat st;
+
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+/**
+ * @brief Create a pipe whose output is captured into the given file
+ * @param capture capture instance
+ * @param watch   watch the process is started of
+ * @param path    log file to write into
+ * @param proxy   descriptor the output is duplicated to (-1 for none)
+ * @return write end of the pipe for the process' stdout/stderr or -1
+ *         on failure (the caller has to close it after spawning)
+ */
+int32_t
+capture_open(capture_t *capture, const watch_t *watch, const char *path, int32_t proxy)
+{
+    int32_t pipes[2] = { -1, -1 };
+
+#ifndef OSX
+    if (pipe2(pipes, O_CLOEXEC) == -1)
+#else
+    if (pipe(pipes) == -1 ||
+        fcntl(pipes[0], F_SETFD, FD_CLOEXEC) == -1 ||
+        fcntl(pipes[1], F_SETFD, FD_CLOEXEC) == -1)
+#endif
+    {
+        log_perror("nyx: pipe");
+        return -1;
+    }
+
+    capture_file_t *file = hash_get(capture->files, path);
+
+    if (file == NULL)
+    {
+        file = file_new(path, watch);
+
+        if (!file_open(file))
+        {
+            file_free(file);
+            close(pipes[0]);
+            close(pipes[1]);
+            return -1;
+        }
+
+        hash_add(capture->files, path, file);
+    }
+    else
+        file_configure(file, watch);
+
+    if (fcntl(pipes[0], F_SETFL, O_NONBLOCK) == -1)
+        log_perror("nyx: fcntl");
+
+#ifdef F_SETPIPE_SZ
+    /* best effort - the size is limited by /proc/sys/fs/pipe-max-size */
+    fcntl(pipes[0], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+#endif
+
+    capture_pipe_t *pipe = xcalloc1(sizeof(capture_pipe_t));
+
+    pipe->fd = pipes[0];
+    pipe->file = file;
+    pipe->proxy = proxy;
+
+#ifndef OSX
+    /* 'tee' requires both ends to be pipes */
+    pipe->zero_copy = proxy < 0 || is_pipe(proxy);
+#endif
+
+    file->refs++;
+    list_add(capture->pipes, pipe);
+
+    return pipes[1];
+}
+
+/**
+ * @brief Number of pipes that are captured
+ * @param capture capture instance
+ * @return number of pipes
+ */
+uint32_t
+capture_count(capture_t *capture)
+{
+    return capture ? list_size(capture->pipes) : 0;
+}
+
+/**
+ * @brief Fill the poll descriptors of all captured pipes
+ * @param capture capture instance
+ * @param fds     array of at least 'capture_count' descriptors
+ * @return number of filled descriptors
+ */
+uint32_t
+capture_poll_fds(capture_t *capture, struct pollfd *fds)
+{
+    uint32_t count = 0;
+
+    if (capture == NULL)
+        return 0;
+
+    for (list_node_t *node = capture->pipes->head; node; node = node->next)
+    {
+        capture_pipe_t *pipe = node->data;
+
+        fds[count].fd = pipe->fd;
+        fds[count].events = POLLIN;
+        fds[count].revents = 0;
+        count++;
+    }
+
+    return count;
+}
+
+#ifndef OSX
+/* duplicate the pending data to the proxy and move the same amount into
+ * the file - both without copying it through userspace */
+static ssize_t
+move_spliced(capture_pipe_t *pipe, size_t length)
+{
+    capture_file_t *file = pipe->file;
+    loff_t offset = file->size;
+
+    if (pipe->proxy >= 0)
+    {
+        ssize_t copied = tee(pipe->fd, pipe->proxy, length, SPLICE_F_NONBLOCK);
+
+        if (copied > 0)
+            length = copied;
+        /* a proxy that does not keep up does not hold back the file */
+        else if (copied == -1 && errno != EAGAIN)
+            return -1;
+    }
+
+    ssize_t moved = splice(pipe->fd, NULL, file->fd, &offset, length,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+    if (moved > 0)
+        file->size = offset;
+
+    return moved;
+}
+#endif
+
+static ssize_t
+move_copied(capture_t *capture, capture_pipe_t *pipe, size_t length)
+{
+    capture_file_t *file = pipe->file;
+    ssize_t bytes = read(pipe->fd, capture->buffer, MIN(length, CAPTURE_CHUNK));
+
+    if (bytes <= 0)
+        return bytes;
+
+    /* the output is dropped if the file could not be reopened */
+    if (file->fd != -1)
+    {
+        ssize_t written = 0;
+
+        while (written < bytes)
+        {
+            ssize_t result = pwrite(file->fd, capture->buffer + written,
+                    bytes - written, file->size + written);
+
+            if (result == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                log_perror("nyx: write %s", file->path);
+                break;
+            }
+
+            written += result;
+        }
+
+        file->size += written;
+    }
+
+    if (pipe->proxy >= 0 && write(pipe->proxy, capture->buffer, bytes) == -1)
+    {
+        /* the proxy is best effort only */
+    }
+
+    return bytes;
+}
+
+/* returns false as soon as the process closed its end of the pipe */
+static bool
+pipe_drain(capture_t *capture, capture_pipe_t *pipe, uint32_t burst)
+{
+    capture_file_t *file = pipe->file;
+
+    for (uint32_t round = 0; round < burst; round++)
+    {
+        ssize_t moved = 0;
+
+        /* the files are rotated between the chunks which mostly
+         * correspond to whole writes of the process */
+        if (file->fd == -1 || file_expired(file))
+        {
+            if (file->fd == -1)
+                file_open(file);
+            else
+                file_rotate(file);
+        }
+
+#ifndef OSX
+        if (pipe->zero_copy && file->fd != -1)
+            moved = move_spliced(pipe, CAPTURE_CHUNK);
+        else
+#endif
+            moved = move_copied(capture, pipe, CAPTURE_CHUNK);
+
+        if (moved > 0)
+            continue;
+
+        if (moved == 0)
+            return false;
+
+        if (errno == EAGAIN)
+            return true;
+
+        if (errno == EINTR)
+            continue;
+
+        /* the file system does not support splicing */
+        if (pipe->zero_copy && (errno == EINVAL || errno == ENOSYS))
+        {
+            log_debug("Falling back to copying the output into '%s'", file->path);
+
+            pipe->zero_copy = false;
+            continue;
+        }
+
+        log_perror("nyx: capture %s", file->path);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+pipe_close(capture_t *capture, list_node_t *node)
+{
+    capture_pipe_t *pipe = node->data;
+    capture_file_t *file = pipe->file;
+
+    close(pipe->fd);
+
+    if (--file->refs < 1)
+    {
+        hash_remove(capture->files, file->path);
+        file_free(file);
+    }
+
+    list_remove(capture->pipes, node);
+}
+
+/**
+ * @brief Move the output of all pipes that are ready into their files
+ * @param capture capture instance
+ * @param fds     poll descriptors as filled by 'capture_poll_fds'
+ * @param count   number of poll descriptors
+ */
+void
+capture_process(capture_t *capture, const struct pollfd *fds, uint32_t count)
+{
+    uint32_t idx = 0;
+    list_node_t *node = capture ? capture->pipes->head : NULL;
+
+    while (node && idx < count)
+    {
+        list_node_t *next = node->next;
+
+        if (fds[idx].revents && !pipe_drain(capture, node->data, CAPTURE_BURST))
+            pipe_close(capture, node);
+
+        node = next;
+        idx++;
+    }
+}
+
+/**
+ * @brief Apply the (reloaded) rotation settings of the watches to the
+ *        log files that are captured already
+ * @param capture capture instance
+ * @param watches hash of all watches
+ */
+void
+capture_configure(capture_t *capture, hash_t *watches)
+{
+    const char *key = NULL;
+    void *data = NULL;
+
+    if (capture == NULL || watches == NULL)
+        return;
+
+    hash_iter_t *iter = hash_iter_start(watches);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        watch_t *watch = data;
+        capture_file_t *file = NULL;
+
+        if (watch->log_file && (file = hash_get(capture->files, watch->log_file)))
+            file_configure(file, watch);
+
+        if (watch->error_file && (file = hash_get(capture->files, watch->error_file)))
+            file_configure(file, watch);
+    }
+
+    hash_iter_free(iter);
+}
+
+void
+capture_destroy(capture_t *capture)
+{
+    if (capture == NULL)
+        return;
+
+    /* write out what is still pending */
+    while (capture->pipes->head)
+    {
+        pipe_drain(capture, capture->pipes->head->data, CAPTURE_BURST);
+        pipe_close(capture, capture->pipes->head);
+    }
+
+    hash_destroy(capture->files);
+    list_destroy(capture->pipes);
+
+    xfree(capture->buffer);
+    xfree(capture);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
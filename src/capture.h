@@ -0,0 +1,101 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "hash.h"
+#include "list.h"
+#include "watch.h"
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* number of rotated segments that are kept by default */
+#define CAPTURE_DEFAULT_KEEP 5
+
+/** log file the captured output is written into */
+typedef struct
+{
+    char *path;
+    int32_t fd;
+    /** size of the current segment (the next write offset) */
+    off_t size;
+    /** time the current segment was opened */
+    time_t opened;
+    /** maximum size in bytes (0 meaning unlimited) */
+    uint64_t max_size;
+    /** maximum age in seconds (0 meaning unlimited) */
+    uint32_t max_age;
+    uint32_t keep;
+    bool compress;
+    /** owner of newly created segments (0 meaning unchanged) */
+    uid_t uid;
+    gid_t gid;
+    /** number of pipes writing into the file */
+    uint32_t refs;
+} capture_file_t;
+
+/** read end of the stdout/stderr pipe of a process */
+typedef struct
+{
+    int32_t fd;
+    capture_file_t *file;
+    /** descriptor the output is duplicated to (-1 for none) */
+    int32_t proxy;
+    /** the data is moved via 'splice'/'tee' */
+    bool zero_copy;
+} capture_pipe_t;
+
+/**
+ * Output of the spawned processes that is captured by the forker: the
+ * processes write into pipes whose data is moved into the log files
+ * (rotated by size and/or age) and optionally duplicated to nyx's own
+ * stdout/stderr without copying it through userspace.
+ */
+typedef struct
+{
+    /** log files by path */
+    hash_t *files;
+    list_t *pipes;
+    /** buffer of the fallback if the data cannot be spliced */
+    char *buffer;
+} capture_t;
+
+capture_t *
+capture_new(void);
+
+int32_t
+capture_open(capture_t *capture, const watch_t *watch, const char *path, int32_t proxy);
+
+uint32_t
+capture_count(capture_t *capture);
+
+uint32_t
+capture_poll_fds(capture_t *capture, struct pollfd *fds);
+
+void
+capture_process(capture_t *capture, const struct pollfd *fds, uint32_t count);
+
+void
+capture_configure(capture_t *capture, hash_t *watches);
+
+void
+capture_destroy(capture_t *capture);
+
+/* vim: set et sw=4 sts=4 tw=80: */
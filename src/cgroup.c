@@ -0,0 +1,313 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_PROC
+
+#include "cgroup.h"
+#include "def.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* period of the cpu.max bandwidth limit (in usec) */
+#define CGROUP_CPU_PERIOD 100000
+
+#define CGROUP_CONTROLLERS "+cpu +memory"
+
+/**
+ * @brief Build the path of the cgroup of the given watch
+ * @param root cgroup all watches are placed below (relative to the
+ *             cgroup v2 mount unless absolute)
+ * @param name watch name
+ * @return new path string (has to be freed)
+ */
+char *
+cgroup_watch_path(const char *root, const char *name)
+{
+    char *path = NULL;
+    int32_t length;
+
+    if (*root == '/')
+        length = asprintf(&path, "%s/%s", root, name);
+    else
+        length = asprintf(&path, CGROUP_MOUNT "/%s/%s", root, name);
+
+    if (length < 0)
+        log_critical_perror("nyx: asprintf");
+
+    return path;
+}
+
+static bool
+write_value(const char *dir, const char *file, const char *value)
+{
+    char path[512] = {0};
+
+    snprintf(path, LEN(path)-1, "%s/%s", dir, file);
+
+    int32_t fd = open(path, O_WRONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    size_t length = strlen(value);
+    bool success = write(fd, value, length) == (ssize_t)length;
+
+    close(fd);
+
+    return success;
+}
+
+static bool
+read_value(const char *dir, const char *file, char *buffer, size_t size)
+{
+    char path[512] = {0};
+
+    snprintf(path, LEN(path)-1, "%s/%s", dir, file);
+
+    int32_t fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    ssize_t length = read(fd, buffer, size - 1);
+
+    close(fd);
+
+    if (length < 0)
+        return false;
+
+    buffer[length] = '\0';
+
+    return true;
+}
+
+/* find the value of the given key in a flat keyed file
+ * like cpu.stat or memory.events */
+static bool
+keyed_value(const char *content, const char *key, uint64_t *value)
+{
+    size_t length = strlen(key);
+    const char *line = content;
+
+    while (line && *line)
+    {
+        if (strncmp(line, key, length) == 0 && line[length] == ' ')
+            return sscanf(line + length + 1, "%" SCNu64, value) == 1;
+
+        if ((line = strchr(line, '\n')) != NULL)
+            line++;
+    }
+
+    return false;
+}
+
+static bool
+make_dir(const char *path)
+{
+    if (mkdir(path, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) == -1 && errno != EEXIST)
+    {
+        log_perror("nyx: mkdir %s", path);
+        return false;
+    }
+
+    return true;
+}
+
+/* the cpu_affinity and membind numa_node of the watch are mirrored into
+ * the cpuset of its cgroup so forked children are confined as well -
+ * the cpuset controller is only enabled if a watch asks for it */
+static void
+prepare_cpuset(const char *parent, const char *path, const watch_t *watch)
+{
+    bool cpus = watch->cgroup_limits && watch->cpu_affinity;
+    bool mems = watch->cgroup_limits && watch->numa_node &&
+        watch->numa_policy == NUMA_POLICY_BIND;
+
+    if ((cpus || mems) && !write_value(parent, "cgroup.subtree_control", "+cpuset"))
+    {
+        log_warn("Failed to enable the cpuset controller of cgroup '%s'", parent);
+        return;
+    }
+
+    /* an empty cpuset inherits the parent's one */
+    if (!write_value(path, "cpuset.cpus", cpus ? watch->cpu_affinity : "\n") && cpus)
+        log_warn("Failed to set cpuset.cpus of cgroup '%s'", path);
+
+    if (!write_value(path, "cpuset.mems", mems ? watch->numa_node : "\n") && mems)
+        log_warn("Failed to set cpuset.mems of cgroup '%s'", path);
+}
+
+/**
+ * @brief Create the cgroup of the given watch (and its parent) and
+ *        apply the watch's resource limits if requested
+ * @param path  cgroup path as built by cgroup_watch_path
+ * @param watch watch the cgroup belongs to
+ * @return true on success; false otherwise
+ */
+bool
+cgroup_prepare(const char *path, const watch_t *watch)
+{
+    char parent[512] = {0};
+    char value[64] = {0};
+
+    snprintf(parent, LEN(parent)-1, "%s", path);
+
+    char *slash = strrchr(parent, '/');
+    if (slash == NULL || slash == parent)
+        return false;
+
+    *slash = '\0';
+
+    if (!make_dir(parent))
+        return false;
+
+    /* delegate the controllers down to the watch cgroups - the parent
+     * of the root may have enabled them already (or refuse to) */
+    char *grand_parent = strrchr(parent, '/');
+    if (grand_parent && grand_parent != parent)
+    {
+        *grand_parent = '\0';
+        write_value(parent, "cgroup.subtree_control", CGROUP_CONTROLLERS);
+        *grand_parent = '/';
+    }
+
+    if (!write_value(parent, "cgroup.subtree_control", CGROUP_CONTROLLERS))
+        log_warn("Failed to enable the cpu and memory controllers of cgroup '%s'", parent);
+
+    if (!make_dir(path))
+        return false;
+
+    /* without cgroup_limits the limits are reset so they do not
+     * persist after the configuration was changed */
+    if (watch->cgroup_limits && watch->max_memory)
+        snprintf(value, LEN(value)-1, "%" PRIu64, watch->max_memory * 1024);
+    else
+        snprintf(value, LEN(value)-1, "max");
+
+    if (!write_value(path, "memory.max", value) && watch->cgroup_limits)
+        log_warn("Failed to set memory.max of cgroup '%s'", path);
+
+    if (watch->cgroup_limits && watch->max_cpu)
+        snprintf(value, LEN(value)-1, "%u %u",
+                watch->max_cpu * (CGROUP_CPU_PERIOD / 100), CGROUP_CPU_PERIOD);
+    else
+        snprintf(value, LEN(value)-1, "max %u", CGROUP_CPU_PERIOD);
+
+    if (!write_value(path, "cpu.max", value) && watch->cgroup_limits)
+        log_warn("Failed to set cpu.max of cgroup '%s'", path);
+
+    prepare_cpuset(parent, path, watch);
+
+    return true;
+}
+
+/**
+ * @brief Move the given process into the cgroup
+ * @param path cgroup path
+ * @param pid  process to move (0 for the calling process)
+ * @return true on success; false otherwise
+ */
+bool
+cgroup_attach(const char *path, pid_t pid)
+{
+    char value[32] = {0};
+
+    snprintf(value, LEN(value)-1, "%d", pid);
+
+    if (!write_value(path, "cgroup.procs", value))
+    {
+        log_perror("nyx: failed to attach to cgroup '%s'", path);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Determine whether the given process is a member of the cgroup
+ * @param path cgroup path
+ * @param pid  process to look up
+ * @return true if the process belongs to the cgroup
+ */
+bool
+cgroup_contains(const char *path, pid_t pid)
+{
+    char dir[64] = {0};
+    char buffer[1024] = {0};
+
+    snprintf(dir, LEN(dir)-1, "/proc/%d", pid);
+
+    if (!read_value(dir, "cgroup", buffer, sizeof(buffer)))
+        return false;
+
+    /* the unified hierarchy is listed as '0::<path below the mount>' */
+    char *line = strncmp(buffer, "0::", 3) == 0 ? buffer : strstr(buffer, "\n0::");
+
+    if (line == NULL)
+        return false;
+
+    line += *line == '\n' ? 4 : 3;
+
+    char *end = strchr(line, '\n');
+    if (end)
+        *end = '\0';
+
+    size_t length = strlen(line);
+    size_t path_length = strlen(path);
+
+    return length > 1 && path_length >= length &&
+        strcmp(path + path_length - length, line) == 0;
+}
+
+/**
+ * @brief Read the accumulated statistics of all processes of the cgroup
+ * @param path  cgroup path
+ * @param stats statistics to fill
+ * @return true on success; false otherwise
+ */
+bool
+cgroup_read_stats(const char *path, cgroup_stats_t *stats)
+{
+    char buffer[1024] = {0};
+
+    if (!read_value(path, "memory.current", buffer, sizeof(buffer)) ||
+            sscanf(buffer, "%" SCNu64, &stats->memory) != 1)
+        return false;
+
+    stats->memory /= 1024;
+
+    if (!read_value(path, "cpu.stat", buffer, sizeof(buffer)) ||
+            !keyed_value(buffer, "usage_usec", &stats->usage_usec))
+        return false;
+
+    /* memory.events is available with the memory controller only */
+    stats->oom_kills = 0;
+
+    if (read_value(path, "memory.events", buffer, sizeof(buffer)))
+        keyed_value(buffer, "oom_kill", &stats->oom_kills);
+
+    return true;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
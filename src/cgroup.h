@@ -0,0 +1,52 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "watch.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* relative cgroup roots are located below the cgroup v2 mount */
+#define CGROUP_MOUNT "/sys/fs/cgroup"
+
+typedef struct
+{
+    /** memory usage of all processes (in kB) */
+    uint64_t memory;
+    /** CPU time consumed by all processes (in usec) */
+    uint64_t usage_usec;
+    /** number of processes killed by the OOM killer */
+    uint64_t oom_kills;
+} cgroup_stats_t;
+
+char *
+cgroup_watch_path(const char *root, const char *name);
+
+bool
+cgroup_prepare(const char *path, const watch_t *watch);
+
+bool
+cgroup_attach(const char *path, pid_t pid);
+
+bool
+cgroup_contains(const char *path, pid_t pid);
+
+bool
+cgroup_read_stats(const char *path, cgroup_stats_t *stats);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,1004 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_PROC
+
+#include "check.h"
+#include "def.h"
+#include "log.h"
+#include "stats.h"
+
+#ifdef USE_SSL
+#include "ssl.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* deadline of a port check including all connection attempts */
+#define NYX_CHECK_PORT_TIMEOUT_MSECS 3000
+/* deadline of a HTTP check including connect, request and response */
+#define NYX_CHECK_HTTP_TIMEOUT_MSECS 1000
+
+/* maximum length of a single HTTP response line */
+#define NYX_CHECK_BUFFER_SIZE 4096
+
+static void
+close_socket(check_t *check)
+{
+    if (check->fd < 0)
+        return;
+
+    reactor_remove_fd(check->reactor, check->fd);
+
+#ifdef USE_SSL
+    if (check->ssl)
+    {
+        SSL_free(check->ssl);
+        check->ssl = NULL;
+    }
+#endif
+
+    close(check->fd);
+
+    check->fd = -1;
+    check->connected = false;
+    check->handshaken = false;
+}
+
+static void
+check_free(check_t *check)
+{
+    close_socket(check);
+
+    if (check->timer >= 0)
+        reactor_remove_timer(check->reactor, check->timer);
+
+    xfree(check->server_name);
+    nyx_free(check->request, MEM_CONNECTOR);
+    xfree(check->buffer);
+    xfree(check);
+}
+
+#ifdef USE_SSL
+/**
+ * Keep the session of a complete response so the next check of the
+ * same owner resumes it instead of a full handshake
+ */
+static void
+save_session(check_t *check)
+{
+    if (check->tls == NULL)
+        return;
+
+    SSL_SESSION *session = SSL_get1_session(check->ssl);
+
+    if (session == NULL)
+        return;
+
+    if (check->tls->session)
+        SSL_SESSION_free(check->tls->session);
+
+    check->tls->session = session;
+}
+#endif
+
+static void
+finish(check_t *check, bool success)
+{
+    bool complete = check->fd >= 0 && check->state == CHECK_HTTP_DONE;
+
+#ifdef USE_SSL
+    if (complete && check->ssl)
+        save_session(check);
+#endif
+
+    /* hand a completely read keep-alive connection back to its owner */
+    if (complete && check->connection && check->reusable &&
+            check->pos == check->used && (!check->secure || check->tls))
+    {
+        reactor_remove_fd(check->reactor, check->fd);
+
+        *check->connection = check->fd;
+        check->fd = -1;
+
+#ifdef USE_SSL
+        if (check->secure)
+        {
+            check->tls->idle = check->ssl;
+            check->ssl = NULL;
+        }
+#endif
+    }
+
+#ifdef USE_SSL
+    /* a connection closed without shutdown invalidates its session */
+    if (complete && check->ssl)
+        SSL_shutdown(check->ssl);
+#endif
+
+    /* release all resources before the handler is invoked
+     * so a slow handler does not keep the socket open */
+    close_socket(check);
+
+    if (check->timer >= 0)
+    {
+        reactor_remove_timer(check->reactor, check->timer);
+        check->timer = -1;
+    }
+
+    check->handler(check, success, check->data);
+
+    check_free(check);
+}
+
+static void
+handle_socket(reactor_t *reactor, int32_t fd, uint32_t events, void *data);
+
+static bool
+connect_next(check_t *check)
+{
+    while (check->current < check->count)
+    {
+        struct sockaddr_in *addr = &check->addresses[check->current];
+
+        int32_t sock = socket(AF_INET, SOCK_STREAM, 0);
+
+        if (sock == -1)
+        {
+            log_perror("nyx: socket");
+            check->current++;
+            continue;
+        }
+
+        if (unblock_socket(sock) &&
+            (connect(sock, (struct sockaddr *)addr, sizeof(struct sockaddr_in)) == 0 ||
+             errno == EINPROGRESS) &&
+            reactor_add_fd_events(check->reactor, sock, REACTOR_WRITE, handle_socket, check))
+        {
+            check->fd = sock;
+            return true;
+        }
+
+        close(sock);
+        check->current++;
+    }
+
+    return false;
+}
+
+/**
+ * Adopt the idle keep-alive connection of the check's owner (if any).
+ * The connection is owned by the check until it is handed back in
+ * 'finish' after a complete response.
+ */
+static bool
+reuse_connection(check_t *check)
+{
+    if (check->connection == NULL || *check->connection < 0)
+        return false;
+
+    int32_t sock = *check->connection;
+    *check->connection = -1;
+
+    struct ssl_st *idle = NULL;
+
+    if (check->tls)
+    {
+        idle = check->tls->idle;
+        check->tls->idle = NULL;
+    }
+
+    /* a plain connection is no use for a HTTPS check and vice versa */
+    if (check->secure != (idle != NULL) ||
+            !reactor_add_fd_events(check->reactor, sock, REACTOR_WRITE, handle_socket, check))
+    {
+#ifdef USE_SSL
+        if (idle)
+            SSL_free(idle);
+#endif
+        close(sock);
+        return false;
+    }
+
+    check->fd = sock;
+    check->ssl = idle;
+    check->connected = true;
+    check->handshaken = idle != NULL;
+    check->reused = true;
+
+    return true;
+}
+
+#ifdef USE_SSL
+/**
+ * Map the result of a non-blocking TLS operation to the semantics of
+ * send/recv. If the operation has to wait for the socket the reactor
+ * is told the events to wait for and errno is set to EAGAIN.
+ */
+static ssize_t
+tls_result(check_t *check, int32_t res)
+{
+    if (res > 0)
+        return res;
+
+    int32_t error = SSL_get_error(check->ssl, res);
+
+    switch (error)
+    {
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = reactor_modify_fd(check->reactor, check->fd,
+                    error == SSL_ERROR_WANT_READ ? REACTOR_READ : REACTOR_WRITE)
+                ? EAGAIN
+                : EIO;
+            return -1;
+
+        case SSL_ERROR_SYSCALL:
+            ERR_clear_error();
+
+            /* unexpected EOF */
+            if (errno == 0)
+                return 0;
+            return -1;
+
+        default:
+            log_debug("TLS error of HTTPS check to '%s': %s",
+                    (check->url ? check->url : "/"),
+                    ERR_reason_error_string(ERR_peek_last_error()));
+
+            ERR_clear_error();
+            errno = EPROTO;
+            return -1;
+    }
+}
+
+static bool
+start_handshake(check_t *check)
+{
+    SSL_CTX *context = ssl_context();
+
+    if (context == NULL)
+        return false;
+
+    check->ssl = SSL_new(context);
+
+    if (check->ssl == NULL || !SSL_set_fd(check->ssl, check->fd))
+        return false;
+
+    if (check->server_name)
+        SSL_set_tlsext_host_name(check->ssl, check->server_name);
+
+    /* resume the session of the previous check */
+    if (check->tls && check->tls->session)
+        SSL_set_session(check->ssl, check->tls->session);
+
+    return true;
+}
+
+static void
+handle_send(check_t *check);
+
+static void
+handle_handshake(check_t *check)
+{
+    errno = 0;
+
+    ssize_t res = tls_result(check, SSL_connect(check->ssl));
+
+    if (res > 0)
+    {
+        check->handshaken = true;
+
+        stats_count(SSL_session_reused(check->ssl)
+                ? STATS_TLS_RESUMED
+                : STATS_TLS_HANDSHAKES, 1);
+
+        handle_send(check);
+        return;
+    }
+
+    if (res < 0 && errno == EAGAIN)
+        return;
+
+    log_warn("HTTPS check to '%s' failed: TLS handshake failed",
+            (check->url ? check->url : "/"));
+    finish(check, false);
+}
+#endif
+
+static ssize_t
+check_send(check_t *check, const char *buffer, size_t length)
+{
+#ifdef USE_SSL
+    if (check->ssl)
+    {
+        errno = 0;
+        return tls_result(check, SSL_write(check->ssl, buffer, length));
+    }
+#endif
+
+    return send_safe(check->fd, buffer, length);
+}
+
+static ssize_t
+check_recv(check_t *check, char *buffer, size_t length)
+{
+#ifdef USE_SSL
+    if (check->ssl)
+    {
+        errno = 0;
+        return tls_result(check, SSL_read(check->ssl, buffer, length));
+    }
+#endif
+
+    return recv(check->fd, buffer, length, 0);
+}
+
+/**
+ * The peer may close an idle keep-alive connection at any time which is
+ * noticed on the next request only. In that case the request is retried
+ * once on a fresh connection.
+ */
+static bool
+reconnect(check_t *check)
+{
+    if (!check->reused || check->used > 0)
+        return false;
+
+    log_debug("Keep-alive connection for HTTP check to '%s' was closed - reconnecting",
+            (check->url ? check->url : "/"));
+
+    close_socket(check);
+
+    check->reused = false;
+    check->sent = 0;
+    check->current = 0;
+
+    return connect_next(check);
+}
+
+static void
+handle_connect(check_t *check)
+{
+    int32_t so_error = 0;
+    socklen_t len = sizeof(int32_t);
+
+    if (getsockopt(check->fd, SOL_SOCKET, SO_ERROR, &so_error, &len) != 0 || so_error != 0)
+    {
+        /* try the next address if there is any */
+        close_socket(check);
+        check->current++;
+
+        if (!connect_next(check))
+            finish(check, false);
+        return;
+    }
+
+    if (check->type == CHECK_PORT)
+    {
+        finish(check, true);
+        return;
+    }
+
+    check->connected = true;
+
+#ifdef USE_SSL
+    if (check->secure && !start_handshake(check))
+    {
+        log_warn("HTTPS check to '%s' failed: TLS initialization failed",
+                (check->url ? check->url : "/"));
+        finish(check, false);
+    }
+#endif
+}
+
+static void
+handle_send(check_t *check)
+{
+    while (check->sent < check->length)
+    {
+        ssize_t res = check_send(check, check->request + check->sent, check->length - check->sent);
+
+        if (res <= 0)
+        {
+            if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+
+            if (reconnect(check))
+                return;
+
+            if (res < 0)
+                log_perror("nyx: send");
+
+            finish(check, false);
+            return;
+        }
+
+        check->sent += res;
+    }
+
+    /* the request is complete - wait for the response */
+    if (!reactor_modify_fd(check->reactor, check->fd, REACTOR_READ))
+        finish(check, false);
+}
+
+static bool
+parse_status_line(check_t *check, const char *line)
+{
+    /* HTTP/1.x xxx */
+    if (strncmp(line, "HTTP/1.", 7) != 0 || line[7] == '\0' || line[8] != ' ')
+        return false;
+
+    int32_t code = atoi(line + 9);
+
+    if (code < 100 || code > 599)
+        return false;
+
+    check->status = code;
+
+    /* HTTP/1.1 connections are persistent unless stated otherwise */
+    check->reusable = check->connection != NULL && line[7] == '1';
+
+    /* without keep-alive the status line is all we are interested in */
+    if (check->connection == NULL)
+        check->state = CHECK_HTTP_DONE;
+
+    return true;
+}
+
+static void
+parse_header(check_t *check, const char *line)
+{
+    const char *value = strchr(line, ':');
+
+    if (value == NULL)
+        return;
+
+    size_t length = value - line;
+
+    value++;
+    while (*value == ' ' || *value == '\t')
+        value++;
+
+    if (length == 14 && strncasecmp(line, "Content-Length", length) == 0)
+    {
+        check->remaining = strtoull(value, NULL, 10);
+        check->sized = true;
+    }
+    else if (length == 17 && strncasecmp(line, "Transfer-Encoding", length) == 0)
+    {
+        if (strcasestr(value, "chunked"))
+            check->chunked = true;
+    }
+    else if (length == 10 && strncasecmp(line, "Connection", length) == 0)
+    {
+        if (strcasestr(value, "close"))
+            check->reusable = false;
+        else if (check->connection && strcasestr(value, "keep-alive"))
+            check->reusable = true;
+    }
+}
+
+static void
+parse_headers_end(check_t *check)
+{
+    /* responses that never carry a body */
+    if (check->method == HTTP_HEAD ||
+            check->status < 200 || check->status == 204 || check->status == 304)
+    {
+        check->state = CHECK_HTTP_DONE;
+    }
+    else if (check->chunked)
+        check->state = CHECK_HTTP_CHUNK_SIZE;
+    else if (check->sized)
+        check->state = check->remaining ? CHECK_HTTP_BODY : CHECK_HTTP_DONE;
+    else
+    {
+        /* the body is terminated by closing the connection -
+         * there is no need to read it at all */
+        check->reusable = false;
+        check->state = CHECK_HTTP_DONE;
+    }
+}
+
+static bool
+parse_line(check_t *check, char *line)
+{
+    switch (check->state)
+    {
+        case CHECK_HTTP_HEADERS:
+            if (check->status == 0)
+                return parse_status_line(check, line);
+
+            if (*line == '\0')
+                parse_headers_end(check);
+            else
+                parse_header(check, line);
+            return true;
+
+        case CHECK_HTTP_CHUNK_SIZE:
+        {
+            /* line break after the previous chunk's data */
+            if (*line == '\0')
+                return true;
+
+            char *end = NULL;
+            uint64_t size = strtoull(line, &end, 16);
+
+            if (end == line)
+                return false;
+
+            if (size == 0)
+                check->state = CHECK_HTTP_TRAILERS;
+            else
+            {
+                check->remaining = size;
+                check->state = CHECK_HTTP_CHUNK_DATA;
+            }
+            return true;
+        }
+
+        case CHECK_HTTP_TRAILERS:
+            if (*line == '\0')
+                check->state = CHECK_HTTP_DONE;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * Process the buffered response data as far as possible. Body data is
+ * skipped without being copied, all other data is processed line by line.
+ */
+static bool
+parse_response(check_t *check)
+{
+    while (check->state != CHECK_HTTP_DONE)
+    {
+        char *start = check->buffer + check->pos;
+        size_t available = check->used - check->pos;
+
+        if (check->state == CHECK_HTTP_BODY || check->state == CHECK_HTTP_CHUNK_DATA)
+        {
+            size_t skip = MIN(available, check->remaining);
+
+            check->pos += skip;
+            check->remaining -= skip;
+
+            if (check->remaining > 0)
+                return true;
+
+            check->state = check->state == CHECK_HTTP_BODY
+                ? CHECK_HTTP_DONE
+                : CHECK_HTTP_CHUNK_SIZE;
+            continue;
+        }
+
+        char *eol = memchr(start, '\n', available);
+
+        if (eol == NULL)
+            return true;
+
+        *eol = '\0';
+        if (eol > start && *(eol - 1) == '\r')
+            *(eol - 1) = '\0';
+
+        check->pos += eol - start + 1;
+
+        if (!parse_line(check, start))
+            return false;
+    }
+
+    return true;
+}
+
+static void
+handle_receive(check_t *check)
+{
+    while (check->state != CHECK_HTTP_DONE)
+    {
+        /* move an incomplete line to the start of the buffer */
+        if (check->pos > 0)
+        {
+            memmove(check->buffer, check->buffer + check->pos, check->used - check->pos);
+            check->used -= check->pos;
+            check->pos = 0;
+        }
+
+        if (check->used >= NYX_CHECK_BUFFER_SIZE)
+        {
+            log_warn("HTTP check to '%s' failed: response line too long",
+                    (check->url ? check->url : "/"));
+            finish(check, false);
+            return;
+        }
+
+        ssize_t res = check_recv(check,
+                check->buffer + check->used,
+                NYX_CHECK_BUFFER_SIZE - check->used);
+
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        if (res <= 0)
+        {
+            if (reconnect(check))
+                return;
+
+            if (res < 0)
+                log_perror("nyx: recv");
+
+            finish(check, false);
+            return;
+        }
+
+        check->used += res;
+
+        if (!parse_response(check))
+        {
+            log_warn("HTTP check to '%s' failed: malformed response",
+                    (check->url ? check->url : "/"));
+            finish(check, false);
+            return;
+        }
+    }
+
+    bool success = http_status_matches(check->expected, check->status);
+
+    if (!success)
+    {
+        log_warn("HTTP check to '%s' failed with return code %u",
+                (check->url ? check->url : "/"), check->status);
+    }
+
+    finish(check, success);
+}
+
+static void
+handle_result(check_t *check)
+{
+    char result = 0;
+    ssize_t res = read(check->fd, &result, 1);
+
+    if (res < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+
+    /* the writing end is closed without a result on failure */
+    finish(check, res == 1 && result == 1);
+}
+
+static void
+handle_socket(UNUSED reactor_t *reactor, UNUSED int32_t fd, UNUSED uint32_t events, void *data)
+{
+    check_t *check = data;
+
+    if (check->type == CHECK_PLUGIN || check->type == CHECK_EXEC)
+    {
+        handle_result(check);
+        return;
+    }
+
+    if (!check->connected)
+    {
+        handle_connect(check);
+        return;
+    }
+
+#ifdef USE_SSL
+    if (check->secure && !check->handshaken)
+    {
+        handle_handshake(check);
+        return;
+    }
+#endif
+
+    if (check->sent < check->length)
+        handle_send(check);
+    else
+        handle_receive(check);
+}
+
+static void
+handle_deadline(UNUSED reactor_t *reactor, void *data)
+{
+    check_t *check = data;
+
+    /* one-shot timers are removed by the reactor already */
+    check->timer = -1;
+
+    finish(check, false);
+}
+
+static check_t *
+check_start(check_t *check, reactor_t *reactor, check_type_e type,
+        const struct sockaddr_in *addresses, int32_t count, uint16_t port,
+        uint32_t timeout, int32_t *connection, check_handler_t handler, void *data)
+{
+    check->type = type;
+    check->reactor = reactor;
+    check->fd = -1;
+    check->timer = -1;
+    check->connection = connection;
+    check->handler = handler;
+    check->data = data;
+
+    check->count = MIN(count, RESOLVER_MAX_ADDRESSES);
+    memcpy(check->addresses, addresses, check->count * sizeof(struct sockaddr_in));
+
+    /* overwrite ports */
+    for (int32_t i = 0; i < check->count; i++)
+        check->addresses[i].sin_port = htons(port);
+
+    check->timer = reactor_add_timer(reactor, timeout, false, handle_deadline, check);
+
+    if (check->timer < 0 || !(reuse_connection(check) || connect_next(check)))
+        goto error;
+
+    return check;
+
+error:
+    check_free(check);
+    return NULL;
+}
+
+/**
+ * @brief Start an asynchronous check whether a TCP connection to one
+ *        of the given addresses can be established
+ * @param reactor   reactor the check is driven by
+ * @param addresses addresses to try one after another
+ * @param count     number of addresses
+ * @param port      port to connect to
+ * @param handler   callback invoked with the result
+ * @param data      user data passed to the handler
+ * @return running check or NULL if the check could not be started
+ */
+check_t *
+check_port_start_resolved(reactor_t *reactor, const struct sockaddr_in *addresses,
+        int32_t count, uint16_t port, check_handler_t handler, void *data)
+{
+    return check_start(xcalloc1(sizeof(check_t)), reactor, CHECK_PORT, addresses, count,
+            port, NYX_CHECK_PORT_TIMEOUT_MSECS, NULL, handler, data);
+}
+
+/**
+ * @brief Start an asynchronous check whether a TCP connection to the
+ *        given endpoint can be established. The host is resolved
+ *        synchronously, use a resolver and 'check_port_start_resolved'
+ *        on latency sensitive paths.
+ * @param reactor reactor the check is driven by
+ * @param host    host to connect to (localhost if NULL)
+ * @param port    port to connect to
+ * @param handler callback invoked with the result
+ * @param data    user data passed to the handler
+ * @return running check or NULL if the check could not be started
+ */
+check_t *
+check_port_start(reactor_t *reactor, const char *host, uint16_t port,
+        check_handler_t handler, void *data)
+{
+    struct sockaddr_in addresses[RESOLVER_MAX_ADDRESSES];
+
+    int32_t count = resolve_host(host ? host : "127.0.0.1", addresses, RESOLVER_MAX_ADDRESSES);
+
+    if (count < 1)
+        return NULL;
+
+    return check_port_start_resolved(reactor, addresses, count, port, handler, data);
+}
+
+/**
+ * @brief Start an asynchronous HTTP check against localhost that
+ *        succeeds on one of the expected status codes
+ * @param reactor    reactor the check is driven by
+ * @param url        URL to request - either a path or an absolute URL
+ *                   whose scheme 'https' enables TLS
+ * @param port       port to connect to unless given in the URL (0 for the
+ *                   default port of the scheme)
+ * @param method     HTTP method to use
+ * @param expected   zero-terminated array of expected status codes
+ *                   (NULL for '200')
+ * @param connection storage of an idle HTTP/1.1 keep-alive connection
+ *                   (-1 if none) or NULL to use one HTTP/1.0 connection
+ *                   per check. The connection is reused if possible and
+ *                   stored back after a complete response, the caller
+ *                   has to close it eventually.
+ * @param tls        TLS state of the caller's HTTPS checks (released by
+ *                   'check_tls_release') or NULL to always perform a full
+ *                   handshake without keeping the connection
+ * @param handler    callback invoked with the result
+ * @param data       user data passed to the handler
+ * @return running check or NULL if the check could not be started
+ */
+check_t *
+check_http_start(reactor_t *reactor, const char *url, uint16_t port, http_method_e method,
+        const uint16_t *expected, int32_t *connection, check_tls_t *tls,
+        check_handler_t handler, void *data)
+{
+    http_url_t parsed;
+    struct sockaddr_in loopback;
+
+    if (!http_url_parse(url, &parsed))
+        return NULL;
+
+#ifndef USE_SSL
+    if (parsed.tls)
+        return NULL;
+#endif
+
+    memset(&loopback, 0, sizeof(struct sockaddr_in));
+    loopback.sin_family = AF_INET;
+    loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    check_t *check = xcalloc1(sizeof(check_t));
+
+    check->url = url;
+    check->secure = parsed.tls;
+    check->tls = tls;
+
+    if (parsed.tls && *parsed.host)
+        check->server_name = xstrdup(parsed.host);
+
+    if (!check_start(check, reactor, CHECK_HTTP, &loopback, 1, http_url_port(url, port),
+            NYX_CHECK_HTTP_TIMEOUT_MSECS, connection, handler, data))
+    {
+        return NULL;
+    }
+
+    check->method = method;
+    check->expected = expected;
+    check->request = http_build_request(parsed.path, method, connection != NULL);
+    check->length = strlen(check->request);
+    check->buffer = xcalloc(NYX_CHECK_BUFFER_SIZE, sizeof(char));
+
+    return check;
+}
+
+/**
+ * @brief Release the idle TLS connection and the session of the given
+ *        TLS state of HTTPS checks
+ * @param tls TLS state to release
+ */
+void
+check_tls_release(check_tls_t *tls)
+{
+#ifdef USE_SSL
+    if (tls->idle)
+    {
+        SSL_free(tls->idle);
+        tls->idle = NULL;
+    }
+
+    if (tls->session)
+    {
+        SSL_SESSION_free(tls->session);
+        tls->session = NULL;
+    }
+#else
+    (void)tls;
+#endif
+}
+
+/**
+ * @brief Start a check whose result is reported by another thread via
+ *        'check_async_complete' on the returned result descriptor
+ * @param reactor   reactor the check is driven by
+ * @param type      kind of the check
+ * @param timeout   deadline of the check in milliseconds
+ * @param result_fd storage of the descriptor the result is reported on.
+ *                  The caller owns the descriptor and has to pass it to
+ *                  'check_async_complete' exactly once - even if the
+ *                  check was cancelled or timed out in the meantime.
+ * @param handler   callback invoked with the result
+ * @param data      user data passed to the handler
+ * @return running check or NULL if the check could not be started
+ */
+check_t *
+check_async_start(reactor_t *reactor, check_type_e type, uint32_t timeout, int32_t *result_fd,
+        check_handler_t handler, void *data)
+{
+    int32_t fds[2];
+
+#ifndef OSX
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        log_perror("nyx: pipe2");
+        return NULL;
+    }
+#else
+    if (pipe(fds) == -1)
+    {
+        log_perror("nyx: pipe");
+        return NULL;
+    }
+
+    for (int32_t i = 0; i < 2; i++)
+    {
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[i], F_SETFL, O_NONBLOCK);
+    }
+#endif
+
+    check_t *check = xcalloc1(sizeof(check_t));
+
+    check->type = type;
+    check->reactor = reactor;
+    check->fd = -1;
+    check->handler = handler;
+    check->data = data;
+
+    check->timer = reactor_add_timer(reactor, timeout, false, handle_deadline, check);
+
+    if (check->timer < 0 ||
+        !reactor_add_fd_events(reactor, fds[0], REACTOR_READ, handle_socket, check))
+    {
+        close(fds[0]);
+        close(fds[1]);
+        check_free(check);
+        return NULL;
+    }
+
+    check->fd = fds[0];
+    *result_fd = fds[1];
+
+    return check;
+}
+
+/**
+ * @brief Report the result of an asynchronous check. This may be called
+ *        from any thread, the check's handler is invoked on the reactor
+ *        thread afterwards.
+ * @param result_fd result descriptor returned by 'check_async_start'
+ * @param success   whether the check succeeded
+ */
+void
+check_async_complete(int32_t result_fd, bool success)
+{
+    if (success)
+    {
+        const char result = 1;
+
+        /* a check that was cancelled already closed the reading end */
+        if (write(result_fd, &result, 1) == -1 && errno != EPIPE)
+            log_perror("nyx: write");
+    }
+
+    close(result_fd);
+}
+
+/**
+ * @brief Abort the given running check without invoking its handler
+ * @param check check to cancel
+ */
+void
+check_cancel(check_t *check)
+{
+    if (check)
+        check_free(check);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
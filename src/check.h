@@ -0,0 +1,154 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "reactor.h"
+#include "resolver.h"
+#include "socket.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct check_t check_t;
+
+typedef void (*check_handler_t)(check_t *check, bool success, void *data);
+
+typedef enum
+{
+    CHECK_PORT,
+    CHECK_HTTP,
+    /** check whose result is reported by a plugin */
+    CHECK_PLUGIN,
+    /** check command run by the forker */
+    CHECK_EXEC
+} check_type_e;
+
+/**
+ * TLS state of the HTTPS checks of one owner that is kept between the
+ * checks so the next check resumes the previous session (or reuses the
+ * idle keep-alive connection) instead of a full handshake
+ */
+typedef struct
+{
+    /** TLS connection of the idle keep-alive connection (or NULL) */
+    struct ssl_st *idle;
+    /** session of the latest handshake (or NULL) */
+    struct ssl_session_st *session;
+} check_tls_t;
+
+typedef enum
+{
+    CHECK_HTTP_HEADERS,
+    CHECK_HTTP_BODY,
+    CHECK_HTTP_CHUNK_SIZE,
+    CHECK_HTTP_CHUNK_DATA,
+    CHECK_HTTP_TRAILERS,
+    CHECK_HTTP_DONE
+} check_http_state_e;
+
+/**
+ * Single asynchronous health check driven by a reactor. The check
+ * connects non-blocking, optionally issues a HTTP request and reports
+ * its result exactly once via its handler unless it is cancelled.
+ */
+struct check_t
+{
+    check_type_e type;
+    reactor_t *reactor;
+    /** socket of the current connection attempt
+     *  (read end of the result pipe of an asynchronous check) */
+    int32_t fd;
+    /** deadline timer */
+    int32_t timer;
+    /** resolved addresses to try one after another */
+    struct sockaddr_in addresses[RESOLVER_MAX_ADDRESSES];
+    int32_t count;
+    /** index of the address of the current connection attempt */
+    int32_t current;
+    /** the current connection attempt succeeded */
+    bool connected;
+    /** the check connects via TLS */
+    bool secure;
+    /** TLS connection of a HTTPS check (or NULL) */
+    struct ssl_st *ssl;
+    /** the TLS handshake of the current connection completed */
+    bool handshaken;
+    /** TLS state of the check's owner or NULL */
+    check_tls_t *tls;
+    /** server name sent in the TLS handshake (or NULL) */
+    char *server_name;
+    /** HTTP request */
+    char *request;
+    size_t length;
+    size_t sent;
+    /** HTTP response buffer */
+    char *buffer;
+    size_t used;
+    size_t pos;
+    /** HTTP response parser state */
+    check_http_state_e state;
+    /** remaining body bytes of the current parser state */
+    size_t remaining;
+    /** received HTTP status code */
+    uint16_t status;
+    /** the response body is chunked encoded */
+    bool chunked;
+    /** the response carries a 'Content-Length' header */
+    bool sized;
+    /** expected status codes (zero-terminated) or NULL for '200' */
+    const uint16_t *expected;
+    /** idle keep-alive connection (-1 if none) that is reused and
+     *  handed back after a complete response or NULL */
+    int32_t *connection;
+    /** the connection was reused from a previous check */
+    bool reused;
+    /** the connection may be reused after the response */
+    bool reusable;
+    /** requested URL (for logging only) */
+    const char *url;
+    http_method_e method;
+    check_handler_t handler;
+    void *data;
+};
+
+check_t *
+check_port_start(reactor_t *reactor, const char *host, uint16_t port,
+        check_handler_t handler, void *data);
+
+check_t *
+check_port_start_resolved(reactor_t *reactor, const struct sockaddr_in *addresses,
+        int32_t count, uint16_t port, check_handler_t handler, void *data);
+
+check_t *
+check_http_start(reactor_t *reactor, const char *url, uint16_t port, http_method_e method,
+        const uint16_t *expected, int32_t *connection, check_tls_t *tls,
+        check_handler_t handler, void *data);
+
+void
+check_tls_release(check_tls_t *tls);
+
+check_t *
+check_async_start(reactor_t *reactor, check_type_e type, uint32_t timeout, int32_t *result_fd,
+        check_handler_t handler, void *data);
+
+void
+check_async_complete(int32_t result_fd, bool success);
+
+void
+check_cancel(check_t *check);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -13,17 +13,42 @@
  * limitations under the License.
  */
 
+#define NYX_MEM_TAG MEM_CONNECTOR
+
 #include "command.h"
 #include "def.h"
 #include "log.h"
+#include "matcher.h"
+#include "metrics.h"
 #include "state.h"
+#include "stats.h"
 #include "utils.h"
 #include "watch.h"
 
 #include <inttypes.h>
+#include <stdarg.h>
+
+#ifndef OSX
+#include <malloc.h>
+#endif
 
 typedef void (* status_handler_t)(sender_callback_t *, nyx_t *, state_t *);
 
+/* the results of multiple watches are an array in JSON format */
+static void
+result_list_start(sender_callback_t *cb)
+{
+    if (cb->json)
+        json_array_start(cb->json);
+}
+
+static void
+result_list_end(sender_callback_t *cb)
+{
+    if (cb->json)
+        json_array_end(cb->json);
+}
+
 static bool
 handle_all_by_handler(sender_callback_t *cb, nyx_t *nyx, status_handler_t handler)
 {
@@ -32,6 +57,8 @@ handle_all_by_handler(sender_callback_t *cb, nyx_t *nyx, status_handler_t handle
 
     list_node_t *node = nyx->states->head;
 
+    result_list_start(cb);
+
     while (node)
     {
         state_t *state = node->data;
@@ -41,54 +68,217 @@ handle_all_by_handler(sender_callback_t *cb, nyx_t *nyx, status_handler_t handle
         node = node->next;
     }
 
+    result_list_end(cb);
+
     return true;
 }
 
-static bool
-handle_status_change_all(sender_callback_t *cb, nyx_t *nyx, state_e new_state)
+/**
+ * Parse the selection of watches of a command: either a single name, 'all',
+ * a glob pattern or '--match <regex>'. Returns the number of arguments the
+ * selection consists of (0 on failure).
+ */
+static uint32_t
+parse_selection(sender_callback_t *cb, const char **input, matcher_t *matcher)
 {
-    if (!nyx->states)
-        return false;
+    const char *name = input[1];
+    bool regex = !strcmp(name, "--match");
 
-    list_node_t *node = nyx->states->head;
+    if (regex && input[2] == NULL)
+    {
+        cb->sender(cb, "missing regular expression");
+        return 0;
+    }
 
-    while (node)
+    if (!matcher_init(matcher, regex ? input[2] : name, regex))
+    {
+        cb->sender(cb, "invalid regular expression '%s'", input[2]);
+        return 0;
+    }
+
+    return regex ? 2 : 1;
+}
+
+/* find the states of all instances matching the bulk selection */
+static list_t *
+select_instances(nyx_t *nyx, matcher_t *matcher)
+{
+    list_t *instances = list_new(NULL);
+
+    if (!nyx->states)
+        return instances;
+
+    for (list_node_t *node = nyx->states->head; node; node = node->next)
     {
         state_t *state = node->data;
 
-        set_state_command(state, new_state);
-        cb->sender(cb, "requested %s for watch '%s'",
-                state_to_human_string(new_state),
-                state->watch->name);
+        if (matcher_match(matcher, state->name) ||
+            matcher_match(matcher, state->watch->name))
+            list_add(instances, state);
+    }
 
-        node = node->next;
+    return instances;
+}
+
+static void
+attach_bulk(sender_callback_t *cb, int32_t fd, bool framed, uint32_t id, nyx_t *nyx)
+{
+    bulk_start(nyx->bulk, cb->detach_data, fd, framed, id);
+}
+
+/**
+ * Request the state change of all selected watches. Clients that can
+ * wait are answered as soon as all watches reached the requested state -
+ * at most 'command_concurrency' of them are changing at the same time.
+ */
+static bool
+handle_status_change_bulk(sender_callback_t *cb, nyx_t *nyx, matcher_t *matcher,
+        state_e new_state)
+{
+    list_t *instances = select_instances(nyx, matcher);
+
+    if (list_size(instances) < 1)
+    {
+        cb->sender(cb, "no watch matching '%s'", matcher->pattern);
+        list_destroy(instances);
+        return false;
+    }
+
+    if (cb->detachable && nyx->bulk)
+    {
+        bulk_t *bulk = bulk_new(new_state, nyx->options.command_concurrency);
+
+        for (list_node_t *node = instances->head; node; node = node->next)
+        {
+            state_t *state = node->data;
+            bulk_add(bulk, state->name);
+        }
+
+        /* the connector hands the connection over to the bulk change */
+        cb->detach = attach_bulk;
+        cb->detach_data = bulk;
     }
+    else
+    {
+        for (list_node_t *node = instances->head; node; node = node->next)
+        {
+            state_t *state = node->data;
+
+            set_state_command(state, new_state);
+            cb->sender(cb, "requested %s for watch '%s'",
+                    state_to_human_string(new_state),
+                    state->name);
+        }
+    }
+
+    list_destroy(instances);
 
     return true;
 }
 
+/**
+ * Find the states the given name refers to: the name of a watch with
+ * multiple instances refers to all of its instances, an instance name
+ * to the single instance.
+ */
+static list_t *
+find_instances(nyx_t *nyx, const char *name)
+{
+    state_t *state = hash_get(nyx->state_map, name);
+
+    if (state == NULL)
+        return NULL;
+
+    list_t *instances = list_new(NULL);
+
+    if (state->watch->instances < 2 || strcmp(name, state->watch->name))
+    {
+        list_add(instances, state);
+        return instances;
+    }
+
+    for (list_node_t *node = nyx->states->head; node; node = node->next)
+    {
+        state_t *instance = node->data;
+
+        if (instance->watch == state->watch)
+            list_add(instances, instance);
+    }
+
+    return instances;
+}
+
+/* restart the running instances of a watch batch by batch */
+static bool
+handle_rolling_restart(sender_callback_t *cb, nyx_t *nyx, const char *name, list_t *instances)
+{
+    list_t *running = list_new(NULL);
+
+    for (list_node_t *node = instances->head; node; node = node->next)
+    {
+        state_t *state = node->data;
+
+        if (state->state == STATE_RUNNING)
+            list_add(running, state);
+        else
+            set_state_command(state, STATE_RESTARTING);
+    }
+
+    bool started = startup_rollout(nyx->startup, name, running);
+
+    if (started)
+        cb->sender(cb, "requested rolling restart for watch '%s'", name);
+    else
+        cb->sender(cb, "rolling restart of watch '%s' is in progress already", name);
+
+    list_destroy(running);
+
+    return started;
+}
+
 static bool
 handle_status_change(sender_callback_t *cb, const char **input, nyx_t *nyx, state_e new_state)
 {
     const char *name = input[1];
+    matcher_t matcher;
 
-    if (is_all(name))
-        return handle_status_change_all(cb, nyx, new_state);
+    if (!parse_selection(cb, input, &matcher))
+        return false;
 
-    state_t *state = hash_get(nyx->state_map, name);
+    if (matcher_is_bulk(&matcher))
+    {
+        bool success = handle_status_change_bulk(cb, nyx, &matcher, new_state);
 
-    if (state == NULL)
+        matcher_free(&matcher);
+        return success;
+    }
+
+    list_t *instances = find_instances(nyx, name);
+
+    if (instances == NULL)
     {
         cb->sender(cb, "unknown watch '%s'", name);
         return false;
     }
 
+    if (new_state == STATE_RESTARTING && list_size(instances) > 1 && nyx->startup)
+    {
+        bool success = handle_rolling_restart(cb, nyx, name, instances);
+
+        list_destroy(instances);
+        return success;
+    }
+
     /* request state change */
-    set_state_command(state, new_state);
+    for (list_node_t *node = instances->head; node; node = node->next)
+        set_state_command(node->data, new_state);
+
     cb->sender(cb, "requested %s for watch '%s'",
             state_to_human_string(new_state),
             name);
 
+    list_destroy(instances);
+
     return true;
 }
 
@@ -128,7 +318,196 @@ send_keys(sender_callback_t *cb, const char *name, hash_t *keys)
         cb->sender(cb, "  %s: %s", key, value);
     }
 
-    free(iter);
+    hash_iter_free(iter);
+}
+
+static void
+json_keys(json_t *json, hash_t *keys)
+{
+    const char *key = NULL;
+    void *data = NULL;
+
+    json_object_start(json);
+
+    if (keys)
+    {
+        hash_iter_t *iter = hash_iter_start(keys);
+
+        while (hash_iter(iter, &key, &data))
+        {
+            json_key(json, key);
+            json_string(json, data);
+        }
+
+        hash_iter_free(iter);
+    }
+
+    json_object_end(json);
+}
+
+/* all settings of the watch - unset ones are null */
+static void
+config_json(json_t *json, const char *name, watch_t *watch)
+{
+    json_object_start(json);
+
+    json_key(json, "name");
+    json_string(json, name);
+    json_key(json, "start");
+    json_strings(json, watch->start);
+    json_key(json, "stop");
+    json_strings(json, watch->stop);
+    json_key(json, "reload");
+    json_strings(json, watch->reload);
+    json_key(json, "reload_signal");
+    json_int(json, watch->reload_signal);
+    json_key(json, "depends_on");
+    json_strings(json, watch->depends_on);
+    json_key(json, "start_timeout");
+    json_uint(json, watch->start_timeout);
+    json_key(json, "stop_timeout");
+    json_uint(json, watch->stop_timeout);
+    json_key(json, "notify");
+    json_bool(json, watch->notify);
+    json_key(json, "watchdog");
+    json_uint(json, watch->watchdog);
+    json_key(json, "listen");
+    json_strings(json, watch->listen);
+    json_key(json, "listen_lazy");
+    json_bool(json, watch->listen_lazy);
+    json_key(json, "spare");
+    json_bool(json, watch->spare);
+    json_key(json, "flapping_count");
+    json_uint(json, watch->flapping_count);
+    json_key(json, "flapping_interval");
+    json_uint(json, watch->flapping_interval);
+    json_key(json, "flapping_delay");
+    json_uint(json, watch->flapping_delay);
+    json_key(json, "max_flapping_delay");
+    json_uint(json, watch->max_flapping_delay);
+    json_key(json, "dir");
+    json_string(json, watch->dir);
+    json_key(json, "uid");
+    json_string(json, watch->uid);
+    json_key(json, "gid");
+    json_string(json, watch->gid);
+    json_key(json, "pid_file");
+    json_string(json, watch->pid_file);
+    json_key(json, "log_file");
+    json_string(json, watch->log_file);
+    json_key(json, "error_file");
+    json_string(json, watch->error_file);
+    json_key(json, "max_memory");
+    json_uint(json, watch->max_memory);
+    json_key(json, "max_cpu");
+    json_uint(json, watch->max_cpu);
+    json_key(json, "memory_pressure");
+    json_string(json, watch->memory_pressure);
+    json_key(json, "cpu_affinity");
+    json_string(json, watch->cpu_affinity);
+    json_key(json, "numa_node");
+    json_string(json, watch->numa_node);
+    json_key(json, "numa_policy");
+    json_string(json, numa_policy_to_string(watch->numa_policy));
+    json_key(json, "nice");
+    json_int(json, watch->nice);
+    json_key(json, "sched_policy");
+    json_string(json, sched_policy_to_string(watch->sched_policy));
+    json_key(json, "sched_priority");
+    json_uint(json, watch->sched_priority);
+    json_key(json, "ionice");
+    json_string(json, watch->ionice);
+    json_key(json, "check_interval");
+    json_uint(json, watch->check_interval);
+    json_key(json, "max_check_interval");
+    json_uint(json, watch->max_check_interval);
+
+    json_key(json, "port_check");
+
+    if (watch->port_check)
+    {
+        json_object_start(json);
+        json_key(json, "host");
+        json_string(json, watch->port_check->host);
+        json_key(json, "port");
+        json_uint(json, watch->port_check->port);
+        json_key(json, "interval");
+        json_uint(json, watch->port_check_interval);
+        json_key(json, "owner");
+        json_bool(json, watch->port_check_owner);
+        json_object_end(json);
+    }
+    else
+        json_null(json);
+
+    json_key(json, "http_check");
+
+    if (watch->http_check)
+    {
+        json_object_start(json);
+        json_key(json, "path");
+        json_string(json, watch->http_check);
+        json_key(json, "method");
+        json_string(json, http_method_to_string(watch->http_check_method));
+        json_key(json, "port");
+        json_uint(json, http_url_port(watch->http_check, watch->http_check_port));
+        json_key(json, "interval");
+        json_uint(json, watch->http_check_interval);
+        json_key(json, "keep_alive");
+        json_bool(json, watch->http_check_keep_alive);
+        json_object_end(json);
+    }
+    else
+        json_null(json);
+
+    json_key(json, "plugin_check");
+
+    if (watch->plugin_check)
+    {
+        json_object_start(json);
+        json_key(json, "name");
+        json_string(json, watch->plugin_check);
+        json_key(json, "argument");
+        json_string(json, watch->plugin_check_argument);
+        json_key(json, "interval");
+        json_uint(json, watch->plugin_check_interval);
+        json_key(json, "timeout");
+        json_uint(json, watch->plugin_check_timeout);
+        json_object_end(json);
+    }
+    else
+        json_null(json);
+
+    json_key(json, "check_exec");
+
+    if (watch->check_exec)
+    {
+        json_object_start(json);
+        json_key(json, "command");
+        json_strings(json, watch->check_exec);
+        json_key(json, "interval");
+        json_uint(json, watch->check_exec_interval);
+        json_key(json, "timeout");
+        json_uint(json, watch->check_exec_timeout);
+        json_object_end(json);
+    }
+    else
+        json_null(json);
+
+    json_key(json, "startup_delay");
+    json_uint(json, watch->startup_delay);
+    json_key(json, "instances");
+    json_uint(json, MAX(watch->instances, 1));
+    json_key(json, "restart_batch");
+    json_uint(json, watch->restart_batch);
+    json_key(json, "restart_priority");
+    json_int(json, watch->restart_priority);
+    json_key(json, "rlimits");
+    json_keys(json, watch->rlimits);
+    json_key(json, "env");
+    json_keys(json, watch->env);
+
+    json_object_end(json);
 }
 
 static bool
@@ -145,14 +524,58 @@ handle_config(sender_callback_t *cb, const char **input, nyx_t *nyx)
 
     watch_t *watch = state->watch;
 
+    if (cb->json)
+    {
+        config_json(cb->json, name, watch);
+        return true;
+    }
+
     cb->sender(cb, "name: %s", name);
 
     send_strings(cb, "start", watch->start);
     send_strings(cb, "stop", watch->stop);
+    send_strings(cb, "reload", watch->reload);
+
+    if (watch->reload_signal > 0)
+        cb->sender(cb, "reload_signal: %d", watch->reload_signal);
+    send_strings(cb, "depends_on", watch->depends_on);
+
+    if (watch->start_timeout)
+        cb->sender(cb, "start_timeout: %u", watch->start_timeout);
 
     if (watch->stop_timeout)
         cb->sender(cb, "stop_timeout: %u", watch->stop_timeout);
 
+    if (watch->notify)
+        cb->sender(cb, "notify: true");
+
+    if (watch->watchdog)
+        cb->sender(cb, "watchdog: %ums", watch->watchdog);
+
+    if (watch->listen)
+    {
+        for (const char **address = watch->listen; *address; address++)
+            cb->sender(cb, "listen: %s", *address);
+
+        if (watch->listen_lazy)
+            cb->sender(cb, "listen_lazy: true");
+    }
+
+    if (watch->spare)
+        cb->sender(cb, "spare: true");
+
+    if (watch->flapping_count)
+        cb->sender(cb, "flapping_count: %u", watch->flapping_count);
+
+    if (watch->flapping_interval)
+        cb->sender(cb, "flapping_interval: %u", watch->flapping_interval);
+
+    if (watch->flapping_delay)
+        cb->sender(cb, "flapping_delay: %u", watch->flapping_delay);
+
+    if (watch->max_flapping_delay)
+        cb->sender(cb, "max_flapping_delay: %u", watch->max_flapping_delay);
+
     if (watch->dir)
         cb->sender(cb, "dir: %s", watch->dir);
 
@@ -174,6 +597,24 @@ handle_config(sender_callback_t *cb, const char **input, nyx_t *nyx)
     if (watch->max_cpu)
         cb->sender(cb, "max_cpu: %u", watch->max_cpu);
 
+    if (watch->cpu_affinity)
+        cb->sender(cb, "cpu_affinity: %s", watch->cpu_affinity);
+
+    if (watch->numa_node)
+    {
+        cb->sender(cb, "numa_node: %s (%s)", watch->numa_node,
+                numa_policy_to_string(watch->numa_policy));
+    }
+
+    if (watch->nice)
+        cb->sender(cb, "nice: %d", watch->nice);
+
+    if (watch->sched_policy != SCHED_POLICY_DEFAULT)
+        cb->sender(cb, "sched_policy: %s", sched_policy_to_string(watch->sched_policy));
+
+    if (watch->ionice)
+        cb->sender(cb, "ionice: %s", watch->ionice);
+
     if (watch->port_check)
     {
         if (watch->port_check->host)
@@ -193,48 +634,501 @@ handle_config(sender_callback_t *cb, const char **input, nyx_t *nyx)
         cb->sender(cb, "http_check_method: %s",
                 http_method_to_string(watch->http_check_method));
         cb->sender(cb, "http_check_port: %u",
-                watch->http_check_port ? watch->http_check_port : 80);
+                http_url_port(watch->http_check, watch->http_check_port));
     }
 
+    if (watch->plugin_check)
+    {
+        cb->sender(cb, "plugin_check: %s", watch->plugin_check);
+
+        if (watch->plugin_check_argument)
+            cb->sender(cb, "plugin_check_argument: %s", watch->plugin_check_argument);
+    }
+
+    if (watch->check_exec)
+        cb->sender(cb, "check_exec: %s", watch->check_exec[0]);
+
     cb->sender(cb, "startup_delay: %u", watch->startup_delay);
 
+    if (watch->instances > 1)
+    {
+        cb->sender(cb, "instances: %u", watch->instances);
+        cb->sender(cb, "restart_batch: %u", watch->restart_batch);
+    }
+
+    if (watch->restart_priority)
+        cb->sender(cb, "restart_priority: %d", watch->restart_priority);
+
+    send_keys(cb, "rlimits", watch->rlimits);
     send_keys(cb, "env", watch->env);
 
-    return true;
+    return true;
+}
+
+static bool
+handle_history(sender_callback_t *cb, const char **input, nyx_t *nyx)
+{
+    const char *name = input[1];
+    state_t *state = hash_get(nyx->state_map, name);
+
+    if (state == NULL)
+    {
+        cb->sender(cb, "unknown watch '%s'", name);
+        return false;
+    }
+
+    uint32_t i = state->history->count;
+
+    /* the events with their UNIX timestamps */
+    if (cb->json)
+    {
+        json_array_start(cb->json);
+
+        while (i-- > 0)
+        {
+            timestack_elem_t *elem = timestack_get(state->history, i);
+
+            json_object_start(cb->json);
+            json_key(cb->json, "time");
+            json_int(cb->json, elem->time);
+            json_key(cb->json, "state");
+            json_string(cb->json, state_to_human_string(elem->value));
+            json_object_end(cb->json);
+        }
+
+        json_array_end(cb->json);
+
+        return true;
+    }
+
+    while (i-- > 0)
+    {
+        timestack_elem_t *elem = timestack_get(state->history, i);
+        struct tm *ltime = localtime(&elem->time);
+
+        cb->sender(cb, "%04d-%02d-%02dT%02d:%02d:%02d: %s",
+            ltime->tm_year + 1900,
+            ltime->tm_mon + 1,
+            ltime->tm_mday,
+            ltime->tm_hour,
+            ltime->tm_min,
+            ltime->tm_sec,
+            state_to_human_string(elem->value));
+    }
+
+    return true;
+}
+
+static bool
+handle_metrics(sender_callback_t *cb, const char **input, nyx_t *nyx)
+{
+    const char *name = input[1];
+    state_t *state = hash_get(nyx->state_map, name);
+    metrics_resolution_e resolution = METRICS_MINUTE;
+
+    if (state == NULL)
+    {
+        cb->sender(cb, "unknown watch '%s'", name);
+        return false;
+    }
+
+    if (state->metrics == NULL)
+    {
+        cb->sender(cb, "metrics are disabled");
+        return false;
+    }
+
+    if (input[2] && !metrics_resolution_parse(input[2], &resolution))
+    {
+        cb->sender(cb, "unknown resolution '%s' (raw, minute or hour)", input[2]);
+        return false;
+    }
+
+    metrics_iter_t cpu_iter, mem_iter;
+    time_t time, mem_time;
+    double cpu, mem;
+
+    metrics_iter_start(&cpu_iter, state->metrics, METRICS_CPU, resolution);
+    metrics_iter_start(&mem_iter, state->metrics, METRICS_MEMORY, resolution);
+
+    result_list_start(cb);
+
+    /* both series are sampled at the same times */
+    while (metrics_iter_next(&cpu_iter, &time, &cpu) &&
+            metrics_iter_next(&mem_iter, &mem_time, &mem))
+    {
+        if (cb->json)
+        {
+            json_object_start(cb->json);
+            json_key(cb->json, "time");
+            json_int(cb->json, time);
+            json_key(cb->json, "cpu");
+            json_double(cb->json, cpu);
+            json_key(cb->json, "memory_kb");
+            json_double(cb->json, mem);
+            json_object_end(cb->json);
+            continue;
+        }
+
+        struct tm *ltime = localtime(&time);
+
+        cb->sender(cb, "%04d-%02d-%02dT%02d:%02d:%02d: cpu %.1f%% mem %.0f kB",
+            ltime->tm_year + 1900,
+            ltime->tm_mon + 1,
+            ltime->tm_mday,
+            ltime->tm_hour,
+            ltime->tm_min,
+            ltime->tm_sec,
+            cpu, mem);
+    }
+
+    result_list_end(cb);
+
+    return true;
+}
+
+/* human readable duration of the given microseconds */
+static const char *
+format_usecs(char *buffer, size_t size, uint64_t usecs)
+{
+    if (usecs < 1000)
+        snprintf(buffer, size, "%" PRIu64 "us", usecs);
+    else if (usecs < 1000000)
+        snprintf(buffer, size, "%.1fms", usecs / 1000.0);
+    else
+        snprintf(buffer, size, "%.2fs", usecs / 1000000.0);
+
+    return buffer;
+}
+
+static void
+send_histogram(sender_callback_t *cb, const stats_info_t *info, const stats_histogram_t *h)
+{
+    static const double percentiles[] = { 50.0, 90.0, 99.0 };
+    static const char *percentile_keys[] = { "p50_us", "p90_us", "p99_us" };
+
+    uint64_t values[LEN(percentiles)];
+    uint64_t avg = h->count ? h->sum / h->count : 0;
+
+    for (uint32_t i = 0; i < LEN(percentiles); i++)
+        values[i] = stats_percentile(h, percentiles[i]);
+
+    if (cb->json)
+    {
+        json_key(cb->json, info->name);
+        json_object_start(cb->json);
+        json_key(cb->json, "count");
+        json_uint(cb->json, h->count);
+        json_key(cb->json, "avg_us");
+        json_uint(cb->json, avg);
+
+        for (uint32_t i = 0; i < LEN(percentiles); i++)
+        {
+            json_key(cb->json, percentile_keys[i]);
+            json_uint(cb->json, values[i]);
+        }
+
+        json_key(cb->json, "max_us");
+        json_uint(cb->json, h->max);
+        json_object_end(cb->json);
+        return;
+    }
+
+    char b[5][32];
+
+    cb->sender(cb, "%-16s count %-8" PRIu64 " avg %-8s p50 %-8s p90 %-8s p99 %-8s max %s",
+            info->name, h->count,
+            format_usecs(b[0], sizeof(b[0]), avg),
+            format_usecs(b[1], sizeof(b[1]), values[0]),
+            format_usecs(b[2], sizeof(b[2]), values[1]),
+            format_usecs(b[3], sizeof(b[3]), values[2]),
+            format_usecs(b[4], sizeof(b[4]), h->max));
+}
+
+/* resident memory (in KB) and number of threads of nyx itself */
+static void
+read_self_status(uint64_t *rss, uint64_t *threads)
+{
+#ifndef OSX
+    char line[256];
+    FILE *status = fopen("/proc/self/status", "r");
+
+    if (status == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), status))
+    {
+        if (sscanf(line, "VmRSS: %" SCNu64, rss) == 1)
+            continue;
+
+        sscanf(line, "Threads: %" SCNu64, threads);
+    }
+
+    fclose(status);
+#else
+    (void)rss;
+    (void)threads;
+#endif
+}
+
+/* bytes (in KB) allocated from the heap and still in use */
+static uint64_t
+heap_in_use(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+
+    return (info.uordblks + info.hblkhd) / 1024;
+#else
+    return 0;
+#endif
+}
+
+static void
+send_memory(sender_callback_t *cb)
+{
+    uint64_t rss = 0, threads = 0, heap = heap_in_use(), value = 0;
+    uint64_t stack = thread_stack_size() / 1024;
+    mem_usage_t usage[MEM_TAGS];
+    char unit;
+
+    read_self_status(&rss, &threads);
+    mem_usage(usage);
+
+    if (cb->json)
+    {
+        json_key(cb->json, "memory");
+        json_object_start(cb->json);
+        json_key(cb->json, "rss_kb");
+        json_uint(cb->json, rss);
+        json_key(cb->json, "heap_kb");
+        json_uint(cb->json, heap);
+        json_key(cb->json, "threads");
+        json_uint(cb->json, threads);
+        json_key(cb->json, "thread_stack_kb");
+        json_uint(cb->json, stack);
+        json_key(cb->json, "allocated");
+        json_object_start(cb->json);
+
+        for (mem_tag_e tag = 0; tag < MEM_TAGS; tag++)
+        {
+            json_key(cb->json, mem_tag_name(tag));
+            json_object_start(cb->json);
+            json_key(cb->json, "allocations");
+            json_uint(cb->json, usage[tag].allocations);
+            json_key(cb->json, "live");
+            json_uint(cb->json, usage[tag].live);
+            json_key(cb->json, "bytes");
+            json_uint(cb->json, usage[tag].bytes);
+            json_object_end(cb->json);
+        }
+
+        json_object_end(cb->json);
+        json_object_end(cb->json);
+        return;
+    }
+
+    unit = get_size_unit(rss, &value);
+    cb->sender(cb, "%-16s %" PRIu64 "%c", "rss", value, unit);
+
+    unit = get_size_unit(heap, &value);
+    cb->sender(cb, "%-16s %" PRIu64 "%c in use", "heap", value, unit);
+
+    unit = get_size_unit(stack, &value);
+    cb->sender(cb, "%-16s %" PRIu64 " (stack size %" PRIu64 "%c)", "threads", threads, value, unit);
+
+    /* the live allocations (and their bytes) next to the ones
+     * accumulated since the start of nyx */
+    for (mem_tag_e tag = 0; tag < MEM_TAGS; tag++)
+    {
+        unit = get_size_unit(usage[tag].bytes / 1024, &value);
+
+        cb->sender(cb, "alloc %-10s %" PRIu64 " live, %" PRIu64 "%c (%" PRIu64 " allocations)",
+                mem_tag_name(tag), usage[tag].live, value, unit, usage[tag].allocations);
+    }
+}
+
+static bool
+handle_stats(sender_callback_t *cb, UNUSED const char **input, UNUSED nyx_t *nyx)
+{
+    stats_snapshot_t *stats = xcalloc1(sizeof(stats_snapshot_t));
+
+    stats_read(stats);
+
+    double seconds = stats->elapsed / 1000000.0;
+
+    if (cb->json)
+        json_object_start(cb->json);
+
+    for (stats_histogram_e i = 0; i < STATS_HISTOGRAMS; i++)
+        send_histogram(cb, stats_histogram_info(i), &stats->histograms[i]);
+
+    for (stats_counter_e i = 0; i < STATS_COUNTERS; i++)
+    {
+        const stats_info_t *info = stats_counter_info(i);
+        uint64_t value = stats->counters[i];
+        double rate = seconds > 0 ? value / seconds : 0.0;
+
+        if (cb->json)
+        {
+            json_key(cb->json, info->name);
+            json_object_start(cb->json);
+            json_key(cb->json, "total");
+            json_uint(cb->json, value);
+            json_key(cb->json, "per_second");
+            json_double(cb->json, rate);
+            json_object_end(cb->json);
+            continue;
+        }
+
+        cb->sender(cb, "%-16s %" PRIu64 " (%.2f/s)", info->name, value, rate);
+    }
+
+    send_memory(cb);
+
+    if (cb->json)
+        json_object_end(cb->json);
+
+    xfree(stats);
+
+    return true;
+}
+
+static void
+fleet_watch_json(json_t *json, const char *name, fleet_watch_t *watch)
+{
+    json_object_start(json);
+
+    json_key(json, "name");
+    json_string(json, name);
+    json_key(json, "state");
+    json_string(json, state_to_human_string(watch->state));
+    json_key(json, "pid");
+
+    if (watch->state == STATE_RUNNING && watch->pid)
+        json_int(json, watch->pid);
+    else
+        json_null(json);
+
+    json_key(json, "timestamp");
+    json_int(json, watch->timestamp);
+
+    if (watch->has_metrics)
+    {
+        json_key(json, "cpu");
+        json_double(json, watch->cpu);
+        json_key(json, "memory_kb");
+        json_int(json, watch->memory);
+    }
+
+    json_object_end(json);
+}
+
+static void
+send_fleet_node(sender_callback_t *cb, fleet_node_t *node)
+{
+    hash_iter_t *iter = hash_iter_start(node->watches);
+    fleet_watch_t *watch = NULL;
+    const char *name = NULL;
+
+    if (cb->json)
+    {
+        json_object_start(cb->json);
+        json_key(cb->json, "node");
+        json_string(cb->json, node->name);
+        json_key(cb->json, "connected");
+        json_bool(cb->json, node->peer != NULL);
+        json_key(cb->json, "synced");
+        json_bool(cb->json, node->synced);
+        json_key(cb->json, "sequence");
+        json_uint(cb->json, node->seq);
+        json_key(cb->json, "watches");
+        json_array_start(cb->json);
+    }
+    else
+    {
+        cb->sender(cb, "%s: %s (sequence %" PRIu64 ")", node->name,
+                node->peer ? "connected" : "disconnected", node->seq);
+    }
+
+    while (hash_iter(iter, &name, (void **)&watch))
+    {
+        if (cb->json)
+            fleet_watch_json(cb->json, name, watch);
+        else if (watch->state == STATE_RUNNING && watch->pid)
+        {
+            cb->sender(cb, "%s/%s: %s (PID %d)", node->name, name,
+                    state_to_human_string(watch->state), watch->pid);
+        }
+        else
+        {
+            cb->sender(cb, "%s/%s: %s", node->name, name,
+                    state_to_human_string(watch->state));
+        }
+    }
+
+    hash_iter_free(iter);
+
+    if (cb->json)
+    {
+        json_array_end(cb->json);
+        json_object_end(cb->json);
+    }
 }
 
 static bool
-handle_history(sender_callback_t *cb, const char **input, nyx_t *nyx)
+handle_fleet(sender_callback_t *cb, const char **input, nyx_t *nyx)
 {
-    const char *name = input[1];
-    state_t *state = hash_get(nyx->state_map, name);
+    fleet_t *fleet = nyx->fleet;
+    fleet_node_t *node = NULL;
+    const char *name = NULL;
 
-    if (state == NULL)
+    if (fleet == NULL)
     {
-        cb->sender(cb, "unknown watch '%s'", name);
+        cb->sender(cb, "no federation_port configured");
         return false;
     }
 
-    if (state->history->count < 1)
-        return true;
-
-    uint32_t i = state->history->count;
+    pthread_mutex_lock(&fleet->lock);
 
-    while (i-- > 0)
+    /* the given nodes only */
+    if (input[1])
     {
-        timestack_elem_t *elem = &state->history->elements[i];
-        struct tm *ltime = localtime(&elem->time);
+        for (const char **node_name = input + 1; *node_name; node_name++)
+        {
+            if (hash_get(fleet->nodes, *node_name) == NULL)
+            {
+                pthread_mutex_unlock(&fleet->lock);
 
-        cb->sender(cb, "%04d-%02d-%02dT%02d:%02d:%02d: %s",
-            ltime->tm_year + 1900,
-            ltime->tm_mon + 1,
-            ltime->tm_mday,
-            ltime->tm_hour,
-            ltime->tm_min,
-            ltime->tm_sec,
-            state_to_human_string(elem->value));
+                cb->sender(cb, "unknown node '%s'", *node_name);
+                return false;
+            }
+        }
+
+        result_list_start(cb);
+
+        for (const char **node_name = input + 1; *node_name; node_name++)
+            send_fleet_node(cb, hash_get(fleet->nodes, *node_name));
+
+        result_list_end(cb);
+
+        pthread_mutex_unlock(&fleet->lock);
+        return true;
     }
 
+    hash_iter_t *iter = hash_iter_start(fleet->nodes);
+
+    result_list_start(cb);
+
+    while (hash_iter(iter, &name, (void **)&node))
+        send_fleet_node(cb, node);
+
+    result_list_end(cb);
+
+    hash_iter_free(iter);
+
+    pthread_mutex_unlock(&fleet->lock);
+
     return true;
 }
 
@@ -253,12 +1147,9 @@ handle_version(sender_callback_t *cb, UNUSED const char **input, UNUSED nyx_t *n
 static bool
 handle_terminate(sender_callback_t *cb, UNUSED const char **input, nyx_t *nyx)
 {
-    /* trigger the eventfd */
-    signal_eventfd(4, nyx);
-
-    /* trigger the termination handler (if specified) */
-    if (nyx->terminate_handler)
-        nyx->terminate_handler(0);
+    /* leave the main loop after this request is answered */
+    if (nyx->reactor)
+        reactor_stop(nyx->reactor);
 
     return cb->sender(cb, "ok") > 0;
 }
@@ -303,32 +1194,62 @@ handle_start(sender_callback_t *cb, const char **input, nyx_t *nyx)
     return handle_status_change(cb, input, nyx, STATE_STARTING);
 }
 
+/* reload the running processes of the selected watches in place */
 static bool
-handle_watches(sender_callback_t *cb, UNUSED const char **input, nyx_t *nyx)
+handle_reload_watches(sender_callback_t *cb, const char **input, nyx_t *nyx)
 {
-    if (!nyx->states)
+    const char *name = input[1];
+    matcher_t matcher;
+    list_t *instances = NULL;
+    uint32_t reloaded = 0;
+
+    if (!parse_selection(cb, input, &matcher))
         return false;
 
-    list_node_t *node = nyx->states->head;
+    if (matcher_is_bulk(&matcher))
+        instances = select_instances(nyx, &matcher);
+    else
+        instances = find_instances(nyx, name);
 
-    while (node)
+    matcher_free(&matcher);
+
+    if (instances == NULL || list_size(instances) < 1)
     {
-        state_t *state = node->data;
+        cb->sender(cb, "unknown watch '%s'", name);
 
-        if (!state)
-            continue;
+        if (instances)
+            list_destroy(instances);
 
-        cb->sender(cb, "%s", state->watch->name);
+        return false;
+    }
 
-        node = node->next;
+    for (list_node_t *node = instances->head; node; node = node->next)
+    {
+        state_t *state = node->data;
+
+        if (!state->watch->reload && !state->watch->reload_signal)
+            cb->sender(cb, "watch '%s' has no reload_signal or reload command", state->name);
+        else if (!state_reload(state))
+            cb->sender(cb, "failed to reload watch '%s' (not running)", state->name);
+        else
+        {
+            cb->sender(cb, "requested reload for watch '%s'", state->name);
+            reloaded++;
+        }
     }
 
-    return true;
+    list_destroy(instances);
+
+    return reloaded > 0;
 }
 
 static bool
-handle_reload(sender_callback_t *cb, UNUSED const char **input, nyx_t *nyx)
+handle_reload(sender_callback_t *cb, const char **input, nyx_t *nyx)
 {
+    /* 'reload <watch>' reloads processes instead of the configuration */
+    if (input[1])
+        return handle_reload_watches(cb, input, nyx);
+
     if (!nyx->options.config_file)
     {
         cb->sender(cb, "no config file to reload");
@@ -345,40 +1266,344 @@ handle_reload(sender_callback_t *cb, UNUSED const char **input, nyx_t *nyx)
     return true;
 }
 
-static void
-print_status(sender_callback_t *cb, UNUSED nyx_t *nyx, state_t *state)
+static bool
+handle_loglevel(sender_callback_t *cb, const char **input, UNUSED nyx_t *nyx)
+{
+    char spec[256] = {0};
+    size_t length = 0;
+
+    /* the arguments form the level specification, e.g. 'info proc state' */
+    for (const char **arg = input + 1; *arg; arg++)
+    {
+        int32_t written = snprintf(spec + length, sizeof(spec) - length,
+                "%s%s", length ? " " : "", *arg);
+
+        if (written < 0 || (size_t)written >= sizeof(spec) - length)
+        {
+            cb->sender(cb, "log level too long");
+            return false;
+        }
+
+        length += written;
+    }
+
+    if (length > 0 && !log_set_level(spec))
+    {
+        cb->sender(cb, "invalid log level '%s' (expected debug, info, warn "
+                "or error and/or proc, event, state, forker, connector)", spec);
+        return false;
+    }
+
+    log_level_string(spec, sizeof(spec));
+
+    return cb->sender(cb, "%s", spec) > 0;
+}
+
+static int32_t
+format_status(char *buffer, size_t size, state_t *state)
 {
-    const char *name = state->watch->name;
+    const char *name = state->name;
 
     /* print pid if running */
     if (state->state == STATE_RUNNING && state->pid)
     {
-        cb->sender(cb, "%s: %s (PID %d)",
+        return snprintf(buffer, size, "%s: %s (PID %d)",
                 name,
                 state_to_human_string(state->state),
                 state->pid);
     }
+
+    return snprintf(buffer, size, "%s: %s", name, state_to_human_string(state->state));
+}
+
+/* the latest taskstats sample of the watch's process */
+static void
+taskstats_json(json_t *json, const taskstats_sample_t *stats)
+{
+    json_object_start(json);
+
+    json_key(json, "read_bytes");
+    json_uint(json, stats->read_bytes);
+    json_key(json, "write_bytes");
+    json_uint(json, stats->write_bytes);
+    json_key(json, "cpu_delay_ms");
+    json_uint(json, stats->cpu_delay / 1000000);
+    json_key(json, "blkio_delay_ms");
+    json_uint(json, stats->blkio_delay / 1000000);
+    json_key(json, "swapin_delay_ms");
+    json_uint(json, stats->swapin_delay / 1000000);
+    json_key(json, "peak_rss_kb");
+    json_uint(json, stats->hiwater_rss);
+
+    json_object_end(json);
+}
+
+/* the taskstats sample is given for the status of single watches only */
+static void
+status_json(json_t *json, state_t *state, const taskstats_sample_t *stats)
+{
+    json_object_start(json);
+
+    json_key(json, "name");
+    json_string(json, state->name);
+    json_key(json, "watch");
+    json_string(json, state->watch->name);
+    json_key(json, "instance");
+    json_uint(json, state->instance);
+    json_key(json, "state");
+    json_string(json, state_to_human_string(state->state));
+    json_key(json, "pid");
+
+    if (state->state == STATE_RUNNING && state->pid)
+        json_int(json, state->pid);
     else
-        cb->sender(cb, "%s: %s", name, state_to_human_string(state->state));
+        json_null(json);
+
+    json_key(json, "starts");
+    json_uint(json, state->starts);
+    json_key(json, "failures");
+    json_uint(json, state->failed_counter);
+
+    if (stats)
+    {
+        json_key(json, "taskstats");
+        taskstats_json(json, stats);
+    }
+
+    json_object_end(json);
+}
+
+/* the status of a single watch includes the I/O, delay accounting and
+ * peak memory of its process - those change with every sample and are
+ * not part of the cached status of all watches */
+static void
+print_status(sender_callback_t *cb, nyx_t *nyx, state_t *state)
+{
+    char buffer[512];
+    taskstats_sample_t stats;
+    bool sampled = state->state == STATE_RUNNING &&
+        nyx_proc_taskstats(nyx->proc, state->pid, &stats);
+
+    if (cb->json)
+    {
+        status_json(cb->json, state, sampled ? &stats : NULL);
+        return;
+    }
+
+    int32_t length = format_status(buffer, LEN(buffer), state);
+
+    if (sampled && length > 0 && (size_t)length < LEN(buffer))
+    {
+        snprintf(buffer + length, LEN(buffer) - length,
+                ", I/O read %" PRIu64 " kB write %" PRIu64 " kB,"
+                " delay CPU %" PRIu64 " ms block I/O %" PRIu64 " ms swap %" PRIu64 " ms,"
+                " peak RSS %" PRIu64 " kB",
+                stats.read_bytes / 1024, stats.write_bytes / 1024,
+                stats.cpu_delay / 1000000, stats.blkio_delay / 1000000,
+                stats.swapin_delay / 1000000, stats.hiwater_rss);
+    }
+
+    cb->sender(cb, "%s", buffer);
+}
+
+/**
+ * @brief Render the output of the commands covering all watches
+ *        (called by the snapshot cache on changes only)
+ * @param out    output buffer
+ * @param type   type of the output
+ * @param format format of the output
+ * @param data   nyx instance
+ */
+void
+render_snapshot(strbuf_t *out, snapshot_type_e type, snapshot_format_e format, void *data)
+{
+    nyx_t *nyx = data;
+    const char *prefix = format == SNAPSHOT_HTTP ? ">>> " : "";
+
+    if (!nyx->states)
+        return;
+
+    if (format == SNAPSHOT_JSON)
+    {
+        json_t json;
+
+        json_init(&json, out);
+        json_array_start(&json);
+
+        for (list_node_t *node = nyx->states->head; node; node = node->next)
+        {
+            state_t *state = node->data;
+
+            if (type == SNAPSHOT_STATUS)
+                status_json(&json, state, NULL);
+            else
+                json_string(&json, state->name);
+        }
+
+        json_array_end(&json);
+        return;
+    }
+
+    for (list_node_t *node = nyx->states->head; node; node = node->next)
+    {
+        state_t *state = node->data;
+
+        if (type == SNAPSHOT_STATUS)
+        {
+            char buffer[512];
+
+            format_status(buffer, LEN(buffer), state);
+            strbuf_append(out, "%s%s\n", prefix, buffer);
+        }
+        else
+            strbuf_append(out, "%s%s\n", prefix, state->name);
+    }
+}
+
+/* send the cached output if the client supports it */
+static bool
+send_snapshot(sender_callback_t *cb, nyx_t *nyx, snapshot_type_e type)
+{
+    if (cb->send_raw == NULL || nyx->snapshot == NULL)
+        return false;
+
+    snapshot_buffer_t *buffer = snapshot_get(nyx->snapshot, type, cb->format);
+
+    cb->send_raw(cb, buffer->data, buffer->length);
+    cb->generation = buffer->generation;
+
+    snapshot_release(buffer);
+
+    return true;
+}
+
+static bool
+handle_watches(sender_callback_t *cb, UNUSED const char **input, nyx_t *nyx)
+{
+    if (!nyx->states)
+        return false;
+
+    if (send_snapshot(cb, nyx, SNAPSHOT_WATCHES))
+        return true;
+
+    list_node_t *node = nyx->states->head;
+
+    result_list_start(cb);
+
+    while (node)
+    {
+        state_t *state = node->data;
+
+        if (!state)
+            continue;
+
+        if (cb->json)
+            json_string(cb->json, state->name);
+        else
+            cb->sender(cb, "%s", state->name);
+
+        node = node->next;
+    }
+
+    result_list_end(cb);
+
+    return true;
 }
 
 static bool
 handle_status(sender_callback_t *cb, const char **input, nyx_t *nyx)
 {
     const char *name = input[1];
+    matcher_t matcher;
 
     if (is_all(name))
+    {
+        if (nyx->states && send_snapshot(cb, nyx, SNAPSHOT_STATUS))
+            return true;
+
         return handle_all_by_handler(cb, nyx, print_status);
+    }
 
-    state_t *state = hash_get(nyx->state_map, name);
+    if (!parse_selection(cb, input, &matcher))
+        return false;
 
-    if (state == NULL)
+    if (matcher_is_bulk(&matcher))
+    {
+        list_t *instances = select_instances(nyx, &matcher);
+        bool found = list_size(instances) > 0;
+
+        result_list_start(cb);
+
+        for (list_node_t *node = instances->head; node; node = node->next)
+            print_status(cb, nyx, node->data);
+
+        result_list_end(cb);
+
+        if (!found)
+            cb->sender(cb, "no watch matching '%s'", matcher.pattern);
+
+        list_destroy(instances);
+        matcher_free(&matcher);
+
+        return found;
+    }
+
+    list_t *instances = find_instances(nyx, name);
+
+    if (instances == NULL)
     {
         cb->sender(cb, "unknown watch '%s'", name);
         return false;
     }
 
-    print_status(cb, nyx, state);
+    result_list_start(cb);
+
+    for (list_node_t *node = instances->head; node; node = node->next)
+        print_status(cb, nyx, node->data);
+
+    result_list_end(cb);
+
+    list_destroy(instances);
+
+    return true;
+}
+
+static void
+attach_subscriber(sender_callback_t *cb, int32_t fd, bool framed, uint32_t id, nyx_t *nyx)
+{
+    subscriber_format_e format = framed ? SUBSCRIBER_FRAMED : SUBSCRIBER_LINES;
+
+    if (!subscribers_add(nyx->subscribers, fd, cb->detach_data, format, id))
+        log_warn("Failed to add subscriber on socket %d", fd);
+}
+
+static bool
+handle_subscribe(sender_callback_t *cb, const char **input, nyx_t *nyx)
+{
+    const char **name = input + 1;
+
+    if (!cb->detachable || nyx->subscribers == NULL)
+    {
+        cb->sender(cb, "subscriptions are not supported on this connection");
+        return false;
+    }
+
+    while (*name)
+    {
+        /* the watches of federated nodes may be subscribed to as well */
+        if (hash_get(nyx->state_map, *name) == NULL &&
+                (nyx->fleet == NULL || !fleet_contains(nyx->fleet, *name)))
+        {
+            cb->sender(cb, "unknown watch '%s'", *name);
+            return false;
+        }
+
+        name++;
+    }
+
+    /* the connector hands the connection over to the subscribers */
+    cb->detach = attach_subscriber;
+    cb->detach_data = input + 1;
 
     return true;
 }
@@ -405,10 +1630,20 @@ static command_t commands[] =
             "request the watch's status"),
     CMD(CMD_HISTORY,    "history",    handle_history,    1,
             "get the latest events of the specified watch"),
+    CMD(CMD_SUBSCRIBE,  "subscribe",  handle_subscribe,  0,
+            "stream the state changes of all (or the given) watches"),
+    CMD(CMD_METRICS,    "metrics",    handle_metrics,    1,
+            "get the CPU/memory usage of the watch (raw, minute or hour)"),
     CMD(CMD_CONFIG,     "config",     handle_config,     1,
             "get the configuration of the specified watch"),
     CMD(CMD_RELOAD,     "reload",     handle_reload,     0,
-            "reload the nyx configuration"),
+            "reload the nyx configuration or the processes of the specified watch"),
+    CMD(CMD_LOGLEVEL,   "loglevel",   handle_loglevel,   0,
+            "get or set the log level and debug categories"),
+    CMD(CMD_STATS,      "stats",      handle_stats,      0,
+            "get the latency and memory statistics of nyx itself"),
+    CMD(CMD_FLEET,      "fleet",      handle_fleet,      0,
+            "get the watches of the federated nodes (or the given ones)"),
     CMD(CMD_TERMINATE,  "terminate",  handle_terminate,  0,
             "terminate the nyx server"),
     CMD(CMD_QUIT,       "quit",       handle_quit,       0,
@@ -490,4 +1725,131 @@ parse_command(const char **input)
     return NULL;
 }
 
+/**
+ * @brief Parse the output format option preceding a command ('--json')
+ * @param input  command arguments
+ * @param format format of the command's output (unchanged if not given)
+ * @return arguments of the command itself
+ */
+const char **
+parse_output_format(const char **input, snapshot_format_e *format)
+{
+    if (input && *input && !strcmp(*input, NYX_JSON_OPTION))
+    {
+        *format = SNAPSHOT_JSON;
+        return input + 1;
+    }
+
+    return input;
+}
+
+/* output of a command in JSON format */
+typedef struct
+{
+    json_t result;
+    json_t messages;
+} json_output_t;
+
+static uint32_t
+json_message(sender_callback_t *cb, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* the messages of a command are collected as an array of strings */
+static uint32_t
+json_message(sender_callback_t *cb, const char *format, ...)
+{
+    char buffer[512];
+    json_output_t *output = cb->data;
+
+    va_list vas;
+    va_start(vas, format);
+    int32_t length = vsnprintf(buffer, LEN(buffer), format, vas);
+    va_end(vas);
+
+    if (length < 0)
+        return 0;
+
+    json_string(&output->messages, buffer);
+
+    return length;
+}
+
+/* cached output is rendered in JSON format already */
+static uint32_t
+json_snapshot(sender_callback_t *cb, const char *data, size_t length)
+{
+    json_raw(cb->json, data, length);
+
+    return length;
+}
+
+/**
+ * @brief Process a command and send its output in the format the client
+ *        requested: a command requested in JSON format is answered with a
+ *        single object of its success, result and messages
+ * @param cmd   command to process
+ * @param cb    callback of the client
+ * @param input command arguments
+ * @param nyx   nyx instance
+ * @return true if the command succeeded
+ */
+bool
+command_run(command_t *cmd, sender_callback_t *cb, const char **input, nyx_t *nyx)
+{
+    if (cb->format != SNAPSHOT_JSON || cb->send_raw == NULL)
+        return cmd->handler(cb, input, nyx);
+
+    json_t json;
+    json_output_t output;
+    strbuf_t *result = strbuf_new();
+    strbuf_t *messages = strbuf_new();
+    sender_callback_t json_cb = *cb;
+
+    json_init(&output.result, result);
+    json_init(&output.messages, messages);
+
+    json_cb.sender = json_message;
+    json_cb.send_raw = json_snapshot;
+    json_cb.data = &output;
+    json_cb.json = &output.result;
+    /* streaming commands are not supported in JSON format */
+    json_cb.detachable = false;
+
+    bool success = cmd->handler(&json_cb, input, nyx);
+
+    cb->generation = json_cb.generation;
+
+    strbuf_t *out = strbuf_new_size(result->length + messages->length + 64);
+
+    json_init(&json, out);
+    json_object_start(&json);
+    json_key(&json, "success");
+    json_bool(&json, success);
+
+    if (result->length > 0)
+    {
+        json_key(&json, "result");
+        json_raw(&json, result->buf, result->length);
+    }
+
+    if (messages->length > 0)
+    {
+        json_key(&json, "messages");
+        json_array_start(&json);
+        json_raw(&json, messages->buf, messages->length);
+        json_array_end(&json);
+    }
+
+    json_object_end(&json);
+    strbuf_append_char(out, '\n');
+
+    cb->send_raw(cb, out->buf, out->length);
+
+    strbuf_free(out);
+    strbuf_free(messages);
+    strbuf_free(result);
+
+    return success;
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -15,7 +15,12 @@
 
 #pragma once
 
+#include "json.h"
 #include "nyx.h"
+#include "snapshot.h"
+
+/* option preceding a command whose output is requested in JSON format */
+#define NYX_JSON_OPTION "--json"
 
 typedef enum
 {
@@ -27,10 +32,15 @@ typedef enum
     CMD_RESTART,
     CMD_STATUS,
     CMD_HISTORY,
+    CMD_METRICS,
     CMD_CONFIG,
     CMD_WATCHES,
     CMD_RELOAD,
+    CMD_LOGLEVEL,
     CMD_QUIT,
+    CMD_SUBSCRIBE,
+    CMD_STATS,
+    CMD_FLEET,
     CMD_SIZE
 } connector_command_e;
 
@@ -41,6 +51,21 @@ typedef struct sender_callback_t
     uint32_t (*sender)(struct sender_callback_t *, const char *, ...)
         __attribute__((format(printf, 2, 3)));
     void *data;
+    /** sends pre-rendered output as it is (optional) */
+    uint32_t (*send_raw)(struct sender_callback_t *, const char *, size_t);
+    /** format of the pre-rendered output the client expects */
+    snapshot_format_e format;
+    /** writer of the command's result if its output is requested in
+     *  JSON format (set by command_run) */
+    json_t *json;
+    /** generation of the pre-rendered output that was sent (0 if none) */
+    uint64_t generation;
+    /** the connection may be taken over by a long-running command */
+    bool detachable;
+    /** set by a command that takes over the connection (see detachable):
+     *  called with the removed client socket after the command succeeded */
+    void (*detach)(struct sender_callback_t *, int32_t, bool, uint32_t, nyx_t *);
+    void *detach_data;
 } sender_callback_t;
 
 typedef bool (*command_handler)(sender_callback_t *, const char **, nyx_t *);
@@ -58,7 +83,16 @@ typedef struct
 void
 print_commands(FILE *out);
 
+void
+render_snapshot(strbuf_t *out, snapshot_type_e type, snapshot_format_e format, void *data);
+
 command_t *
 parse_command(const char **input);
 
+const char **
+parse_output_format(const char **input, snapshot_format_e *format);
+
+bool
+command_run(command_t *cmd, sender_callback_t *cb, const char **input, nyx_t *nyx);
+
 /* vim: set et sw=4 sts=4 tw=80: */
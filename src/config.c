@@ -15,17 +15,27 @@
 
 #define _GNU_SOURCE
 
+#define NYX_MEM_TAG MEM_CONFIG
+
+#include "arena.h"
 #include "config.h"
 #include "def.h"
 #include "fs.h"
 #include "log.h"
 #include "hash.h"
+#include "image.h"
 #include "nyx.h"
 #include "utils.h"
 #include "watch.h"
 
 #include <dirent.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <pthread.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define SCALAR_HANDLER(name_, func_) \
     { .key = name_, .handler = { func_, NULL, NULL } }
@@ -57,6 +67,40 @@ struct watch_info
     struct config_parser_map *map;
 };
 
+/* number of config files from which on they are parsed in parallel */
+#define CONFIG_PARALLEL_FILES 4
+
+/* maximum number of threads parsing config files */
+#define CONFIG_MAX_THREADS 8
+
+/** watches of an unchanged config file */
+typedef struct
+{
+    off_t size;
+    struct timespec mtime;
+    hash_t *watches;
+} config_cache_t;
+
+typedef struct
+{
+    char *path;
+    struct stat st;
+    parse_file_t parse;
+    bool stated;
+    bool parsed;
+    bool cached;
+    bool success;
+} config_file_t;
+
+typedef struct
+{
+    config_file_t *files;
+    uint32_t count;
+    uint32_t offset;
+    uint32_t step;
+    bool silent;
+} parse_worker_t;
+
 static parse_info_t *
 handle_mapping(parse_info_t *info, UNUSED yaml_event_t *event, UNUSED void *data);
 
@@ -85,7 +129,7 @@ static parse_info_t *
 handle_nyx_key(parse_info_t *info, yaml_event_t *event, UNUSED void *data);
 
 static parse_info_t *
-handle_watch_http_check_key(parse_info_t *info, yaml_event_t *event, void *data);
+handle_watch_check_key(parse_info_t *info, yaml_event_t *event, void *data);
 
 /* logging wrapper functions */
 
@@ -163,7 +207,7 @@ parser_up(parse_info_t *info, yaml_event_t *event, UNUSED void *data)
     }
 
     parse_info_t *parent = info->parent;
-    free(info);
+    xfree(info);
 
     return parent;
 }
@@ -332,6 +376,22 @@ uatoi(const char *str)
     return value;
 }
 
+/* comma and/or whitespace separated names */
+static const char **
+parse_names(const char *str)
+{
+    return split_string(str, ", \t");
+}
+
+static bool
+parse_bool(const char *str)
+{
+    return strcasecmp(str, "true") == 0 ||
+        strcasecmp(str, "yes") == 0 ||
+        strcasecmp(str, "on") == 0 ||
+        strcmp(str, "1") == 0;
+}
+
 #define DECLARE_WATCH_STR_FUNC(name_, func_) \
     static parse_info_t * \
     handle_watch_map_value_##name_(parse_info_t *info, yaml_event_t *event, void *data) \
@@ -345,7 +405,7 @@ uatoi(const char *str)
     }
 
 #define DECLARE_WATCH_STR_VALUE(name_) \
-    DECLARE_WATCH_STR_FUNC(name_, strdup)
+    DECLARE_WATCH_STR_FUNC(name_, xstrdup)
 
 #define DECLARE_WATCH_STR_LIST_VALUE(name_) \
     DECLARE_WATCH_STR_FUNC(name_, parse_command_string)
@@ -358,20 +418,52 @@ DECLARE_WATCH_STR_VALUE(pid_file)
 DECLARE_WATCH_STR_VALUE(log_file)
 DECLARE_WATCH_STR_VALUE(error_file)
 DECLARE_WATCH_STR_VALUE(http_check)
+DECLARE_WATCH_STR_VALUE(plugin_check)
+DECLARE_WATCH_STR_FUNC(log_max_size, parse_size_unit)
+DECLARE_WATCH_STR_FUNC(log_max_age, parse_time_unit)
+DECLARE_WATCH_STR_FUNC(log_keep, uatoi)
+DECLARE_WATCH_STR_FUNC(log_compress, parse_bool)
 DECLARE_WATCH_STR_LIST_VALUE(start)
 DECLARE_WATCH_STR_LIST_VALUE(stop)
+DECLARE_WATCH_STR_LIST_VALUE(reload)
+DECLARE_WATCH_STR_FUNC(reload_signal, parse_signal)
+DECLARE_WATCH_STR_LIST_VALUE(check_exec)
 DECLARE_WATCH_STR_FUNC(max_memory, parse_size_unit)
 DECLARE_WATCH_STR_FUNC(max_cpu, uatoi)
+DECLARE_WATCH_STR_FUNC(cgroup_limits, parse_bool)
+DECLARE_WATCH_STR_FUNC(memory_pressure, xstrdup)
+DECLARE_WATCH_STR_FUNC(start_timeout, uatoi)
 DECLARE_WATCH_STR_FUNC(stop_timeout, uatoi)
 DECLARE_WATCH_STR_FUNC(port_check, parse_endpoint)
+DECLARE_WATCH_STR_FUNC(port_check_owner, parse_bool)
+DECLARE_WATCH_STR_FUNC(port_check_interval, uatoi)
+DECLARE_WATCH_STR_FUNC(check_interval, uatoi)
+DECLARE_WATCH_STR_FUNC(max_check_interval, uatoi)
 DECLARE_WATCH_STR_FUNC(startup_delay, uatoi)
+DECLARE_WATCH_STR_FUNC(notify, parse_bool)
+DECLARE_WATCH_STR_FUNC(watchdog, parse_msecs_unit)
+DECLARE_WATCH_STR_FUNC(instances, uatoi)
+DECLARE_WATCH_STR_FUNC(restart_batch, uatoi)
+DECLARE_WATCH_STR_FUNC(restart_priority, atoi)
+DECLARE_WATCH_STR_FUNC(spare, parse_bool)
+DECLARE_WATCH_STR_FUNC(flapping_count, uatoi)
+DECLARE_WATCH_STR_FUNC(flapping_interval, uatoi)
+DECLARE_WATCH_STR_FUNC(flapping_delay, uatoi)
+DECLARE_WATCH_STR_FUNC(max_flapping_delay, uatoi)
+DECLARE_WATCH_STR_FUNC(depends_on, parse_names)
+DECLARE_WATCH_STR_VALUE(cpu_affinity)
+DECLARE_WATCH_STR_VALUE(numa_node)
+DECLARE_WATCH_STR_FUNC(nice, atoi)
+DECLARE_WATCH_STR_FUNC(sched_policy, sched_policy_from_string)
+DECLARE_WATCH_STR_FUNC(sched_priority, uatoi)
+DECLARE_WATCH_STR_VALUE(ionice)
+DECLARE_WATCH_STR_FUNC(listen, parse_names)
+DECLARE_WATCH_STR_FUNC(listen_lazy, parse_bool)
 
 #undef DECLARE_WATCH_STR_VALUE
 #undef DECLARE_WATCH_STR_LIST_VALUE
 #undef DECLARE_WATCH_STR_FUNC
 
-static const char *env_key = NULL;
-
 static parse_info_t *
 handle_watch_env_value(parse_info_t *info, yaml_event_t *event, void *data)
 {
@@ -380,6 +472,7 @@ handle_watch_env_value(parse_info_t *info, yaml_event_t *event, void *data)
     clog_debug(info, "Environment variable value: %s", env_value);
 
     watch_t *watch = data;
+    const char *env_key = info->file->pending_key;
 
     if (watch != NULL && watch->env && env_key)
     {
@@ -389,14 +482,14 @@ handle_watch_env_value(parse_info_t *info, yaml_event_t *event, void *data)
         if (!substitute_env_string(env_value, &parsed_env))
         {
             /* if substitution failed use the unparsed string instead */
-            parsed_env = strdup(env_value);
+            parsed_env = xstrdup(env_value);
         }
 
         hash_add(watch->env, env_key, parsed_env);
 
         /* dispose key */
-        free((void *)env_key);
-        env_key = NULL;
+        xfree((void *)env_key);
+        info->file->pending_key = NULL;
     }
 
     info->handler[YAML_SCALAR_EVENT] = handle_watch_env_key;
@@ -411,7 +504,8 @@ handle_watch_env_key(parse_info_t *info, yaml_event_t *event, UNUSED void *data)
 
     clog_debug(info, "Environment variable key: %s", new_env_key);
 
-    env_key = strdup(new_env_key);
+    xfree((void *)info->file->pending_key);
+    info->file->pending_key = xstrdup(new_env_key);
 
     info->handler[YAML_SCALAR_EVENT] = handle_watch_env_value;
 
@@ -437,7 +531,7 @@ handle_watch_env(parse_info_t *info, UNUSED yaml_event_t *event, void *data)
     watch_t *watch = data;
 
     if (!watch->env)
-        watch->env = hash_new(free);
+        watch->env = hash_new(xfree_data);
 
     new_info->handler[YAML_SCALAR_EVENT] = handle_watch_env_key;
     new_info->handler[YAML_MAPPING_END_EVENT] = handle_watch_env_end;
@@ -446,11 +540,69 @@ handle_watch_env(parse_info_t *info, UNUSED yaml_event_t *event, void *data)
 }
 
 static parse_info_t *
-handle_watch_http_check_key(parse_info_t *info, yaml_event_t *event, void *data)
+handle_watch_rlimits_key(parse_info_t *info, yaml_event_t *event, UNUSED void *data);
+
+static parse_info_t *
+handle_watch_rlimits_value(parse_info_t *info, yaml_event_t *event, void *data)
+{
+    const char *value = get_scalar_value(info, event);
+
+    clog_debug(info, "Resource limit value: %s", value);
+
+    watch_t *watch = data;
+    const char *key = info->file->pending_key;
+
+    if (watch != NULL && watch->rlimits && key && value)
+    {
+        hash_add(watch->rlimits, key, xstrdup(value));
+
+        xfree((void *)key);
+        info->file->pending_key = NULL;
+    }
+
+    info->handler[YAML_SCALAR_EVENT] = handle_watch_rlimits_key;
+
+    return info;
+}
+
+static parse_info_t *
+handle_watch_rlimits_key(parse_info_t *info, yaml_event_t *event, UNUSED void *data)
 {
     const char *key = get_scalar_value(info, event);
 
-    clog_debug(info, "handle_watch_http_check_key: '%s'", key);
+    clog_debug(info, "Resource limit key: %s", key);
+
+    xfree((void *)info->file->pending_key);
+    info->file->pending_key = xstrdup(key);
+
+    info->handler[YAML_SCALAR_EVENT] = handle_watch_rlimits_value;
+
+    return info;
+}
+
+static parse_info_t *
+handle_watch_rlimits(parse_info_t *info, UNUSED yaml_event_t *event, void *data)
+{
+    clog_debug(info, "handle_watch_rlimits");
+
+    parse_info_t *new_info = parse_info_new_child(info);
+    watch_t *watch = data;
+
+    if (!watch->rlimits)
+        watch->rlimits = hash_new(xfree_data);
+
+    new_info->handler[YAML_SCALAR_EVENT] = handle_watch_rlimits_key;
+    new_info->handler[YAML_MAPPING_END_EVENT] = handle_watch_env_end;
+
+    return new_info;
+}
+
+static parse_info_t *
+handle_watch_check_key(parse_info_t *info, yaml_event_t *event, void *data)
+{
+    const char *key = get_scalar_value(info, event);
+
+    clog_debug(info, "handle_watch_check_key: '%s'", key);
 
     struct watch_info *winfo = data;
 
@@ -465,16 +617,16 @@ handle_watch_http_check_key(parse_info_t *info, yaml_event_t *event, void *data)
 }
 
 static parse_info_t *
-handle_watch_http_check_end(parse_info_t *info, yaml_event_t *event, void *data)
+handle_watch_check_end(parse_info_t *info, yaml_event_t *event, void *data)
 {
-    clog_debug(info, "handle_watch_http_check_end");
+    clog_debug(info, "handle_watch_check_end");
 
     struct watch_info *winfo = data;
 
     if (winfo)
     {
         info->data = data = winfo->watch;
-        free(winfo);
+        xfree(winfo);
     }
 
     parse_info_t *end_info = handle_mapping_end(info, event, data);
@@ -493,13 +645,25 @@ handle_watch_http_check_end(parse_info_t *info, yaml_event_t *event, void *data)
         if (value == NULL) \
             return NULL; \
         winfo->watch->name_ = func_(value); \
-        info->handler[YAML_SCALAR_EVENT] = handle_watch_http_check_key; \
+        info->handler[YAML_SCALAR_EVENT] = handle_watch_check_key; \
         return info; \
     }
 
-DECLARE_WINFO_FUNC(http_check, strdup)
+DECLARE_WINFO_FUNC(http_check, xstrdup)
 DECLARE_WINFO_FUNC(http_check_port, uatoi)
 DECLARE_WINFO_FUNC(http_check_method, http_method_from_string)
+DECLARE_WINFO_FUNC(http_check_status, http_status_parse)
+DECLARE_WINFO_FUNC(http_check_keep_alive, parse_bool)
+DECLARE_WINFO_FUNC(http_check_interval, uatoi)
+DECLARE_WINFO_FUNC(plugin_check, xstrdup)
+DECLARE_WINFO_FUNC(plugin_check_argument, xstrdup)
+DECLARE_WINFO_FUNC(plugin_check_interval, uatoi)
+DECLARE_WINFO_FUNC(plugin_check_timeout, uatoi)
+DECLARE_WINFO_FUNC(check_exec, parse_command_string)
+DECLARE_WINFO_FUNC(check_exec_interval, uatoi)
+DECLARE_WINFO_FUNC(check_exec_timeout, uatoi)
+DECLARE_WINFO_FUNC(numa_node, xstrdup)
+DECLARE_WINFO_FUNC(numa_policy, numa_policy_from_string)
 
 #undef DECLARE_WINFO_FUNC
 
@@ -508,6 +672,9 @@ static struct config_parser_map http_check_map[] =
     SCALAR_HANDLER("url", handle_watch_http_check),
     SCALAR_HANDLER("port", handle_watch_http_check_port),
     SCALAR_HANDLER("method", handle_watch_http_check_method),
+    SCALAR_HANDLER("status", handle_watch_http_check_status),
+    SCALAR_HANDLER("keep_alive", handle_watch_http_check_keep_alive),
+    SCALAR_HANDLER("interval", handle_watch_http_check_interval),
     { NULL, {0}, NULL }
 };
 
@@ -518,14 +685,83 @@ handle_watch_http_check_map(parse_info_t *info, UNUSED yaml_event_t *event, void
 
     parse_info_t *new_info = parse_info_new_child(info);
 
-    new_info->handler[YAML_SCALAR_EVENT] = handle_watch_http_check_key;
-    new_info->handler[YAML_MAPPING_END_EVENT] = handle_watch_http_check_end;
+    new_info->handler[YAML_SCALAR_EVENT] = handle_watch_check_key;
+    new_info->handler[YAML_MAPPING_END_EVENT] = handle_watch_check_end;
 
     new_info->data = watch_info_new(data, http_check_map);
 
     return new_info;
 }
 
+static struct config_parser_map plugin_check_map[] =
+{
+    SCALAR_HANDLER("name", handle_watch_plugin_check),
+    SCALAR_HANDLER("argument", handle_watch_plugin_check_argument),
+    SCALAR_HANDLER("interval", handle_watch_plugin_check_interval),
+    SCALAR_HANDLER("timeout", handle_watch_plugin_check_timeout),
+    { NULL, {0}, NULL }
+};
+
+static parse_info_t *
+handle_watch_plugin_check_map(parse_info_t *info, UNUSED yaml_event_t *event, void *data)
+{
+    clog_debug(info, "handle_watch_plugin_check_map");
+
+    parse_info_t *new_info = parse_info_new_child(info);
+
+    new_info->handler[YAML_SCALAR_EVENT] = handle_watch_check_key;
+    new_info->handler[YAML_MAPPING_END_EVENT] = handle_watch_check_end;
+
+    new_info->data = watch_info_new(data, plugin_check_map);
+
+    return new_info;
+}
+
+static struct config_parser_map check_exec_map[] =
+{
+    SCALAR_HANDLER("command", handle_watch_check_exec),
+    SCALAR_HANDLER("interval", handle_watch_check_exec_interval),
+    SCALAR_HANDLER("timeout", handle_watch_check_exec_timeout),
+    { NULL, {0}, NULL }
+};
+
+static parse_info_t *
+handle_watch_check_exec_map(parse_info_t *info, UNUSED yaml_event_t *event, void *data)
+{
+    clog_debug(info, "handle_watch_check_exec_map");
+
+    parse_info_t *new_info = parse_info_new_child(info);
+
+    new_info->handler[YAML_SCALAR_EVENT] = handle_watch_check_key;
+    new_info->handler[YAML_MAPPING_END_EVENT] = handle_watch_check_end;
+
+    new_info->data = watch_info_new(data, check_exec_map);
+
+    return new_info;
+}
+
+static struct config_parser_map numa_node_map[] =
+{
+    SCALAR_HANDLER("nodes", handle_watch_numa_node),
+    SCALAR_HANDLER("policy", handle_watch_numa_policy),
+    { NULL, {0}, NULL }
+};
+
+static parse_info_t *
+handle_watch_numa_node_map(parse_info_t *info, UNUSED yaml_event_t *event, void *data)
+{
+    clog_debug(info, "handle_watch_numa_node_map");
+
+    parse_info_t *new_info = parse_info_new_child(info);
+
+    new_info->handler[YAML_SCALAR_EVENT] = handle_watch_check_key;
+    new_info->handler[YAML_MAPPING_END_EVENT] = handle_watch_check_end;
+
+    new_info->data = watch_info_new(data, numa_node_map);
+
+    return new_info;
+}
+
 static parse_info_t *
 handle_watch_string(parse_info_t *info, yaml_event_t *event, void *data)
 {
@@ -537,7 +773,7 @@ handle_watch_string(parse_info_t *info, yaml_event_t *event, void *data)
     if (list == NULL || value == NULL)
         return NULL;
 
-    list_add(list, strdup(value));
+    list_add(list, xstrdup(value));
 
     return info;
 }
@@ -568,6 +804,10 @@ handle_watch_string(parse_info_t *info, yaml_event_t *event, void *data)
 
 DECLARE_WATCH_STR_LIST(start)
 DECLARE_WATCH_STR_LIST(stop)
+DECLARE_WATCH_STR_LIST(reload)
+DECLARE_WATCH_STR_LIST(depends_on)
+DECLARE_WATCH_STR_LIST(check_exec)
+DECLARE_WATCH_STR_LIST(listen)
 
 #undef DECLARE_WATCH_STR_LIST
 
@@ -580,15 +820,52 @@ static struct config_parser_map watch_value_map[] =
     SCALAR_HANDLER("pid_file", handle_watch_map_value_pid_file),
     SCALAR_HANDLER("log_file", handle_watch_map_value_log_file),
     SCALAR_HANDLER("error_file", handle_watch_map_value_error_file),
+    SCALAR_HANDLER("log_max_size", handle_watch_map_value_log_max_size),
+    SCALAR_HANDLER("log_max_age", handle_watch_map_value_log_max_age),
+    SCALAR_HANDLER("log_keep", handle_watch_map_value_log_keep),
+    SCALAR_HANDLER("log_compress", handle_watch_map_value_log_compress),
     SCALAR_HANDLER("max_memory", handle_watch_map_value_max_memory),
     SCALAR_HANDLER("max_cpu", handle_watch_map_value_max_cpu),
+    SCALAR_HANDLER("cgroup_limits", handle_watch_map_value_cgroup_limits),
+    SCALAR_HANDLER("memory_pressure", handle_watch_map_value_memory_pressure),
+    SCALAR_HANDLER("start_timeout", handle_watch_map_value_start_timeout),
     SCALAR_HANDLER("stop_timeout", handle_watch_map_value_stop_timeout),
     SCALAR_HANDLER("port_check", handle_watch_map_value_port_check),
+    SCALAR_HANDLER("port_check_owner", handle_watch_map_value_port_check_owner),
+    SCALAR_HANDLER("port_check_interval", handle_watch_map_value_port_check_interval),
+    SCALAR_HANDLER("check_interval", handle_watch_map_value_check_interval),
+    SCALAR_HANDLER("max_check_interval", handle_watch_map_value_max_check_interval),
     SCALAR_HANDLER("startup_delay", handle_watch_map_value_startup_delay),
+    SCALAR_HANDLER("notify", handle_watch_map_value_notify),
+    SCALAR_HANDLER("watchdog", handle_watch_map_value_watchdog),
+    SCALAR_HANDLER("instances", handle_watch_map_value_instances),
+    SCALAR_HANDLER("restart_batch", handle_watch_map_value_restart_batch),
+    SCALAR_HANDLER("restart_priority", handle_watch_map_value_restart_priority),
+    SCALAR_HANDLER("spare", handle_watch_map_value_spare),
+    SCALAR_HANDLER("flapping_count", handle_watch_map_value_flapping_count),
+    SCALAR_HANDLER("flapping_interval", handle_watch_map_value_flapping_interval),
+    SCALAR_HANDLER("flapping_delay", handle_watch_map_value_flapping_delay),
+    SCALAR_HANDLER("max_flapping_delay", handle_watch_map_value_max_flapping_delay),
+    SCALAR_HANDLER("cpu_affinity", handle_watch_map_value_cpu_affinity),
+    SCALAR_HANDLER("nice", handle_watch_map_value_nice),
+    SCALAR_HANDLER("sched_policy", handle_watch_map_value_sched_policy),
+    SCALAR_HANDLER("sched_priority", handle_watch_map_value_sched_priority),
+    SCALAR_HANDLER("ionice", handle_watch_map_value_ionice),
+    HANDLERS("numa_node", handle_watch_map_value_numa_node, NULL, handle_watch_numa_node_map),
+    MAP_HANDLER("rlimits", handle_watch_rlimits),
+    HANDLERS("listen", handle_watch_map_value_listen, handle_watch_strings_listen, NULL),
+    SCALAR_HANDLER("listen_lazy", handle_watch_map_value_listen_lazy),
     MAP_HANDLER("env", handle_watch_env),
     HANDLERS("http_check", handle_watch_map_value_http_check, NULL, handle_watch_http_check_map),
+    HANDLERS("plugin_check", handle_watch_map_value_plugin_check, NULL,
+            handle_watch_plugin_check_map),
+    HANDLERS("check_exec", handle_watch_map_value_check_exec, handle_watch_strings_check_exec,
+            handle_watch_check_exec_map),
     HANDLERS("start", handle_watch_map_value_start, handle_watch_strings_start, NULL),
     HANDLERS("stop", handle_watch_map_value_stop, handle_watch_strings_stop, NULL),
+    HANDLERS("reload", handle_watch_map_value_reload, handle_watch_strings_reload, NULL),
+    SCALAR_HANDLER("reload_signal", handle_watch_map_value_reload_signal),
+    HANDLERS("depends_on", handle_watch_map_value_depends_on, handle_watch_strings_depends_on, NULL),
     { NULL, {0}, NULL }
 };
 
@@ -727,7 +1004,7 @@ handle_watch(parse_info_t *info, yaml_event_t *event, UNUSED void *data)
         return NULL;
 
     /* does this watch already exist? */
-    if (hash_get(info->nyx->watches, name) != NULL)
+    if (hash_get(info->file->watches, name) != NULL)
     {
         clog_warn(info, "Watch '%s' already exists", name);
 
@@ -739,10 +1016,10 @@ handle_watch(parse_info_t *info, yaml_event_t *event, UNUSED void *data)
         return info;
     }
 
-    const char *w_name = strdup(name);
+    const char *w_name = xstrdup(name);
     watch_t *watch = watch_new(w_name);
 
-    hash_add(info->nyx->watches, w_name, watch);
+    hash_add(info->file->watches, w_name, watch);
 
     reset_handlers(info);
     info->handler[YAML_MAPPING_START_EVENT] = handle_watch_map;
@@ -782,13 +1059,36 @@ handle_watches(parse_info_t *info, UNUSED yaml_event_t *event, UNUSED void *data
 
 DECLARE_NYX_FUNC_VALUE(uatoi, polling_interval)
 DECLARE_NYX_FUNC_VALUE(uatoi, check_interval)
+DECLARE_NYX_FUNC_VALUE(uatoi, check_jitter)
 DECLARE_NYX_FUNC_VALUE(uatoi, history_size)
 DECLARE_NYX_FUNC_VALUE(uatoi, http_port)
 DECLARE_NYX_FUNC_VALUE(uatoi, startup_delay)
-DECLARE_NYX_FUNC_VALUE(strdup, log_file)
+DECLARE_NYX_FUNC_VALUE(uatoi, state_threads)
+DECLARE_NYX_FUNC_VALUE(uatoi, proc_threads)
+DECLARE_NYX_FUNC_VALUE(uatoi, startup_concurrency)
+DECLARE_NYX_FUNC_VALUE(uatoi, command_concurrency)
+DECLARE_NYX_FUNC_VALUE(uatoi, check_exec_concurrency)
+DECLARE_NYX_FUNC_VALUE(uatoi, restart_rate)
+DECLARE_NYX_FUNC_VALUE(uatoi, restart_burst)
+DECLARE_NYX_FUNC_VALUE(uatoi, restart_concurrency)
+DECLARE_NYX_FUNC_VALUE(parse_size_unit, metrics_memory)
+DECLARE_NYX_FUNC_VALUE(parse_size_unit, journal_size)
+DECLARE_NYX_FUNC_VALUE(parse_size_unit, thread_stack_size)
+DECLARE_NYX_FUNC_VALUE(parse_bool, fast_spawn)
+DECLARE_NYX_FUNC_VALUE(parse_bool, taskstats)
+DECLARE_NYX_FUNC_VALUE(parse_bool, io_uring)
+DECLARE_NYX_FUNC_VALUE(parse_bool, log_milliseconds)
+DECLARE_NYX_FUNC_VALUE(xstrdup, log_file)
+DECLARE_NYX_FUNC_VALUE(xstrdup, log_level)
+DECLARE_NYX_FUNC_VALUE(xstrdup, cgroup)
+DECLARE_NYX_FUNC_VALUE(xstrdup, include_dir)
+DECLARE_NYX_FUNC_VALUE(parse_names, federation)
+DECLARE_NYX_FUNC_VALUE(xstrdup, federation_node)
+DECLARE_NYX_FUNC_VALUE(uatoi, federation_interval)
+DECLARE_NYX_FUNC_VALUE(uatoi, federation_port)
 
 #ifdef USE_PLUGINS
-DECLARE_NYX_FUNC_VALUE(strdup, plugins)
+DECLARE_NYX_FUNC_VALUE(xstrdup, plugins)
 #endif
 
 #undef DECLARE_NYX_FUNC_VALUE
@@ -797,10 +1097,33 @@ static struct config_parser_map nyx_value_map[] =
 {
     SCALAR_HANDLER("polling_interval", handle_nyx_value_polling_interval),
     SCALAR_HANDLER("check_interval", handle_nyx_value_check_interval),
+    SCALAR_HANDLER("check_jitter", handle_nyx_value_check_jitter),
     SCALAR_HANDLER("startup_delay", handle_nyx_value_startup_delay),
     SCALAR_HANDLER("history_size", handle_nyx_value_history_size),
     SCALAR_HANDLER("http_port", handle_nyx_value_http_port),
+    SCALAR_HANDLER("state_threads", handle_nyx_value_state_threads),
+    SCALAR_HANDLER("proc_threads", handle_nyx_value_proc_threads),
+    SCALAR_HANDLER("startup_concurrency", handle_nyx_value_startup_concurrency),
+    SCALAR_HANDLER("command_concurrency", handle_nyx_value_command_concurrency),
+    SCALAR_HANDLER("check_exec_concurrency", handle_nyx_value_check_exec_concurrency),
+    SCALAR_HANDLER("restart_rate", handle_nyx_value_restart_rate),
+    SCALAR_HANDLER("restart_burst", handle_nyx_value_restart_burst),
+    SCALAR_HANDLER("restart_concurrency", handle_nyx_value_restart_concurrency),
+    SCALAR_HANDLER("metrics_memory", handle_nyx_value_metrics_memory),
+    SCALAR_HANDLER("journal_size", handle_nyx_value_journal_size),
+    SCALAR_HANDLER("thread_stack_size", handle_nyx_value_thread_stack_size),
+    SCALAR_HANDLER("fast_spawn", handle_nyx_value_fast_spawn),
+    SCALAR_HANDLER("taskstats", handle_nyx_value_taskstats),
+    SCALAR_HANDLER("io_uring", handle_nyx_value_io_uring),
     SCALAR_HANDLER("log_file", handle_nyx_value_log_file),
+    SCALAR_HANDLER("log_milliseconds", handle_nyx_value_log_milliseconds),
+    SCALAR_HANDLER("log_level", handle_nyx_value_log_level),
+    SCALAR_HANDLER("cgroup", handle_nyx_value_cgroup),
+    SCALAR_HANDLER("include_dir", handle_nyx_value_include_dir),
+    SCALAR_HANDLER("federation", handle_nyx_value_federation),
+    SCALAR_HANDLER("federation_node", handle_nyx_value_federation_node),
+    SCALAR_HANDLER("federation_interval", handle_nyx_value_federation_interval),
+    SCALAR_HANDLER("federation_port", handle_nyx_value_federation_port),
 #ifdef USE_PLUGINS
     SCALAR_HANDLER("plugin_dir", handle_nyx_value_plugins),
 #endif
@@ -854,6 +1177,8 @@ handle_nyx(parse_info_t *info, UNUSED yaml_event_t *event, UNUSED void *data)
 {
     clog_debug(info, "handle_nyx");
 
+    info->file->globals = true;
+
     parse_info_t *new_info = parse_info_new_child(info);
 
     /* handle several (default) config values */
@@ -865,8 +1190,6 @@ handle_nyx(parse_info_t *info, UNUSED yaml_event_t *event, UNUSED void *data)
 
 #ifdef USE_PLUGINS
 
-static const char *plugin_key = NULL;
-
 static parse_info_t *
 handle_plugins_key(parse_info_t *info, yaml_event_t *event, UNUSED void *data);
 
@@ -879,14 +1202,16 @@ handle_plugins_value(parse_info_t *info, yaml_event_t *event, UNUSED void *data)
 
     value = get_scalar_value(info, event);
 
+    const char *plugin_key = info->file->pending_key;
+
     if (value && plugin_key)
     {
         hash_add(info->nyx->options.plugin_config,
-                plugin_key, strdup(value));
+                plugin_key, xstrdup(value));
 
         /* dispose key */
-        free((void *)plugin_key);
-        plugin_key = NULL;
+        xfree((void *)plugin_key);
+        info->file->pending_key = NULL;
     }
 
     info->handler[YAML_SCALAR_EVENT] = handle_plugins_key;
@@ -906,7 +1231,8 @@ handle_plugins_key(parse_info_t *info, yaml_event_t *event, UNUSED void *data)
     if (key == NULL)
         return NULL;
 
-    plugin_key = strdup(key);
+    xfree((void *)info->file->pending_key);
+    info->file->pending_key = xstrdup(key);
 
     info->handler[YAML_SCALAR_EVENT] = handle_plugins_value;
 
@@ -918,8 +1244,10 @@ handle_plugins(parse_info_t *info, UNUSED yaml_event_t *event, UNUSED void *data
 {
     clog_debug(info, "handle_plugins");
 
+    info->file->globals = true;
+
     if (info->nyx->options.plugin_config == NULL)
-        info->nyx->options.plugin_config = hash_new(free);
+        info->nyx->options.plugin_config = hash_new(xfree_data);
 
     parse_info_t *new_info = parse_info_new_child(info);
 
@@ -946,11 +1274,12 @@ static struct config_parser_map root_map[] =
 #undef HANDLERS
 
 parse_info_t *
-parse_info_new(nyx_t *nyx, bool silent)
+parse_info_new(nyx_t *nyx, parse_file_t *file, bool silent)
 {
     parse_info_t *info = xcalloc(1, sizeof(parse_info_t));
 
     info->nyx = nyx;
+    info->file = file;
     info->handler[YAML_STREAM_START_EVENT] = handle_stream;
     info->data = &root_map;
     info->silent = silent;
@@ -964,6 +1293,7 @@ parse_info_new_child(parse_info_t *parent)
     parse_info_t *info = xcalloc(1, sizeof(parse_info_t));
 
     info->nyx = parent->nyx;
+    info->file = parent->file;
     info->parent = parent;
     info->silent = parent->silent;
 
@@ -982,7 +1312,7 @@ parse_info_destroy(parse_info_t *info)
     {
         next = info->parent;
 
-        free(info);
+        xfree(info);
         info = next;
     }
 }
@@ -1020,7 +1350,8 @@ invalid_watch(void *watch)
 }
 
 static bool
-parse_config_file(nyx_t *nyx, FILE *cfg, const char *filename, bool silent)
+parse_config_file(nyx_t *nyx, parse_file_t *file, FILE *cfg,
+        const char *filename, bool silent)
 {
     bool success = true;
     yaml_parser_t parser;
@@ -1035,7 +1366,7 @@ parse_config_file(nyx_t *nyx, FILE *cfg, const char *filename, bool silent)
         return false;
     }
 
-    parse_info_t *info = parse_info_new(nyx, silent);
+    parse_info_t *info = parse_info_new(nyx, file, silent);
     parse_info_t *new_info = NULL;
 
     yaml_parser_set_input_file(&parser, cfg);
@@ -1076,6 +1407,12 @@ parse_config_file(nyx_t *nyx, FILE *cfg, const char *filename, bool silent)
     /* cleanup */
     yaml_parser_delete(&parser);
 
+    if (file->pending_key)
+    {
+        xfree((void *)file->pending_key);
+        file->pending_key = NULL;
+    }
+
     parse_info_destroy(info);
     return success;
 }
@@ -1121,7 +1458,7 @@ reindex_watches(hash_t *watches)
         ordered_watches[idx++] = watch;
     }
 
-    free(iter);
+    hash_iter_free(iter);
 
     /* sort watch array by watches' names */
     qsort(ordered_watches, num_watches, sizeof(watch_t *), compare_watch_name);
@@ -1133,94 +1470,540 @@ reindex_watches(hash_t *watches)
         ordered_watches[idx]->id = idx + 1;
     }
 
-    free(ordered_watches);
+    xfree(ordered_watches);
 }
 
-bool
-parse_config(nyx_t *nyx, bool silent)
+/**
+ * @brief Re-assign the IDs of freshly parsed watches based on the
+ *        previous configuration: existing watches keep their IDs and
+ *        new ones get IDs that were not in use before (ordered by name)
+ * @param watches  parsed watches
+ * @param previous previously configured watches
+ *
+ * nyx and the forker process derive the same IDs this way so requests
+ * referring to an unchanged watch stay valid across reloads.
+ */
+void
+reindex_watches_from(hash_t *watches, hash_t *previous)
 {
-    bool success = false;
-    FILE *cfg = NULL;
-    const char *config_file = nyx->options.config_file;
+    int32_t max_id = 0;
+    uint32_t num_added = 0;
+    const char *key = NULL;
+    void *data = NULL;
 
-    if (config_file == NULL)
+    hash_iter_t *iter = hash_iter_start(previous);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        watch_t *watch = data;
+        max_id = MAX(max_id, watch->id);
+    }
+
+    hash_iter_free(iter);
+
+    watch_t **added = xcalloc(MAX(hash_count(watches), 1), sizeof(watch_t *));
+
+    iter = hash_iter_start(watches);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        watch_t *watch = data;
+        watch_t *existing = hash_get(previous, key);
+
+        if (existing)
+            watch->id = existing->id;
+        else
+            added[num_added++] = watch;
+    }
+
+    hash_iter_free(iter);
+
+    qsort(added, num_added, sizeof(watch_t *), compare_watch_name);
+
+    for (uint32_t idx = 0; idx < num_added; idx++)
+        added[idx]->id = ++max_id;
+
+    xfree(added);
+}
+
+static void
+config_cache_free(void *data)
+{
+    config_cache_t *entry = data;
+
+    if (entry->watches)
+        hash_destroy(entry->watches);
+
+    xfree(entry);
+}
+
+/* files are identified by their inode so replacing a file (as
+ * configuration management tools tend to do) invalidates it as well */
+static void
+cache_key(const struct stat *st, char *key, size_t length)
+{
+    snprintf(key, length, "%ju:%ju", (uintmax_t)st->st_dev, (uintmax_t)st->st_ino);
+}
+
+static bool
+cache_matches(const config_cache_t *entry, const struct stat *st)
+{
+    struct timespec mtime = file_mtime(st);
+
+    return entry->size == st->st_size &&
+        entry->mtime.tv_sec == mtime.tv_sec &&
+        entry->mtime.tv_nsec == mtime.tv_nsec;
+}
+
+/* the watches of one file share an arena that is released as soon as
+ * neither the cache nor any reloaded instance refers to them anymore */
+static void
+seal_watches(hash_t *watches)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    arena_t *arena = arena_new();
+    hash_iter_t *iter = hash_iter_start(watches);
+
+    while (hash_iter(iter, &key, &data))
+        watch_seal(data, arena);
+
+    hash_iter_free(iter);
+    arena_release(arena);
+}
+
+static bool
+parse_file(nyx_t *nyx, config_file_t *file, bool silent)
+{
+    FILE *cfg = fopen(file->path, "r");
+
+    file->parsed = true;
+
+    if (cfg == NULL)
+    {
+        log_warn("Failed to load config file %s", file->path);
         return false;
+    }
 
-    /* let's determine if we got a single config file or
-     * a directory with multiple config files */
-    bool is_config_dir = is_directory(config_file);
+    file->parse.watches = hash_new(_watch_destroy);
+    file->success = parse_config_file(nyx, &file->parse, cfg, file->path, silent);
+
+    fclose(cfg);
+
+    if (file->success)
+        seal_watches(file->parse.watches);
+
+    return file->success;
+}
+
+static void
+reset_file(config_file_t *file)
+{
+    if (file->parse.watches)
+        hash_destroy(file->parse.watches);
 
-    if (is_config_dir)
+    file->parse.watches = NULL;
+    file->parse.globals = false;
+    file->success = false;
+    file->parsed = false;
+}
+
+static void *
+parse_worker(void *arg)
+{
+    parse_worker_t *worker = arg;
+
+    /* global options are parsed into a scratch instance - files that
+     * contain any are parsed again afterwards */
+    nyx_t *scratch = xcalloc1(sizeof(nyx_t));
+
+    for (uint32_t idx = worker->offset; idx < worker->count; idx += worker->step)
+    {
+        config_file_t *file = &worker->files[idx];
+
+        if (!file->cached)
+            parse_file(scratch, file, worker->silent);
+    }
+
+    destroy_options(scratch);
+#ifdef USE_PLUGINS
+    if (scratch->options.plugins)
+        xfree((void *)scratch->options.plugins);
+
+    if (scratch->options.plugin_config)
+        hash_destroy(scratch->options.plugin_config);
+#endif
+
+    xfree(scratch);
+
+    return NULL;
+}
+
+static uint32_t
+parse_threads(uint32_t pending)
+{
+    if (pending < CONFIG_PARALLEL_FILES)
+        return 1;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return MIN(MIN(pending, CONFIG_MAX_THREADS), (uint32_t)MAX(cpus, 1));
+}
+
+/* parse all pending files on multiple threads */
+static void
+parse_parallel(config_file_t *files, uint32_t count, uint32_t threads, bool silent)
+{
+    pthread_t *ids = xcalloc(threads, sizeof(pthread_t));
+    parse_worker_t *workers = xcalloc(threads, sizeof(parse_worker_t));
+    uint32_t started = 0;
+
+    for (uint32_t idx = 0; idx < threads; idx++)
     {
-        size_t path_len = strlen(config_file);
-        DIR *config_dir = opendir(config_file);
-        if (config_dir == NULL)
+        parse_worker_t *worker = &workers[idx];
+
+        worker->files = files;
+        worker->count = count;
+        worker->offset = idx;
+        worker->step = threads;
+        worker->silent = silent;
+
+        if (pthread_create(&ids[idx], NULL, parse_worker, worker) != 0)
         {
-            log_perror("nyx: opendir");
-            return false;
+            log_perror("nyx: pthread_create");
+            break;
         }
 
-        struct dirent *entry = NULL;
-        while ((entry = readdir(config_dir)) != NULL)
+        started++;
+    }
+
+    for (uint32_t idx = 0; idx < started; idx++)
+        pthread_join(ids[idx], NULL);
+
+    xfree(workers);
+    xfree(ids);
+}
+
+static void
+merge_watches(nyx_t *nyx, hash_t *watches, bool silent)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    hash_iter_t *iter = hash_iter_start(watches);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        if (hash_get(nyx->watches, key) != NULL)
         {
-            const char *file_name = entry->d_name;
+            if (!silent)
+                log_warn("Watch '%s' already exists", key);
+            continue;
+        }
 
-            /* skip un-regular files */
-            if (entry->d_type != DT_REG)
-                continue;
+        hash_add(nyx->watches, key, watch_clone(data));
+    }
 
-            /* skip non-yaml files */
-            if (!is_yaml_file(file_name))
-                continue;
+    hash_iter_free(iter);
+}
 
-            size_t full_path_len = path_len + strlen(file_name) + 2;
-            char *file_path = xcalloc(full_path_len, sizeof(char));
-            snprintf(file_path, full_path_len, "%s/%s", config_file, file_name);
+/**
+ * @brief Parse the given config files into the nyx instance
+ * @param nyx      nyx instance
+ * @param files    config files to parse
+ * @param count    number of files
+ * @param previous cache of the previous parse run (may be NULL)
+ * @param silent   toggle silent parsing
+ * @return true if at least one file was parsed successfully
+ *
+ * Files that did not change since the previous run (same inode, size
+ * and modification time) are not parsed again but their cached watches
+ * are used instead. Files configuring global options are never cached
+ * as the options are reset on every reload.
+ */
+static bool
+parse_files(nyx_t *nyx, config_file_t *files, uint32_t count,
+        hash_t *previous, bool silent)
+{
+    bool success = false;
+    uint32_t pending = 0;
+    char key[64];
 
-            cfg = fopen(file_path, "r");
-            if (cfg == NULL)
-            {
-                log_warn("failed to load config file %s", file_path);
-            }
-            else
-            {
-                success = parse_config_file(nyx, cfg, file_path, silent) || success;
-                fclose(cfg);
-            }
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        config_file_t *file = &files[idx];
 
-            free(file_path);
+        if (stat(file->path, &file->st) == -1)
+        {
+            pending++;
+            continue;
         }
 
-        closedir(config_dir);
+        file->stated = true;
+        cache_key(&file->st, key, sizeof(key));
+
+        config_cache_t *entry = previous ? hash_get(previous, key) : NULL;
+
+        if (entry && cache_matches(entry, &file->st))
+        {
+            hash_take(previous, key);
+            hash_add(nyx->config_cache, key, entry);
+
+            file->parse.watches = entry->watches;
+            file->cached = true;
+            file->success = true;
+            continue;
+        }
+
+        pending++;
     }
-    else
+
+    uint32_t threads = parse_threads(pending);
+
+    if (threads > 1)
+        parse_parallel(files, count, threads, silent);
+
+    for (uint32_t idx = 0; idx < count; idx++)
     {
-        /* read input file */
-        cfg = fopen(config_file, "r");
-        if (cfg == NULL)
+        config_file_t *file = &files[idx];
+
+        if (file->cached)
+            continue;
+
+        if (!file->parsed)
+            parse_file(nyx, file, silent);
+        else if (file->parse.globals)
         {
-            log_perror("nyx: fopen");
-            return false;
+            /* apply the global options to the actual instance - the
+             * output was emitted by the parallel run already */
+            reset_file(file);
+            parse_file(nyx, file, true);
         }
+    }
 
-        success = parse_config_file(nyx, cfg, config_file, silent);
-        fclose(cfg);
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        config_file_t *file = &files[idx];
+
+        success |= file->success;
+
+        if (file->parse.watches)
+            merge_watches(nyx, file->parse.watches, silent);
+
+        if (file->cached)
+            continue;
+
+        if (file->success && file->stated && !file->parse.globals)
+        {
+            config_cache_t *entry = xcalloc1(sizeof(config_cache_t));
+
+            entry->size = file->st.st_size;
+            entry->mtime = file_mtime(&file->st);
+            entry->watches = file->parse.watches;
+
+            cache_key(&file->st, key, sizeof(key));
+
+            if (hash_add(nyx->config_cache, key, entry))
+                file->parse.watches = NULL;
+            else
+                xfree(entry);
+        }
+
+        reset_file(file);
     }
 
-    if (env_key)
+    return success;
+}
+
+static int32_t
+compare_file_path(const void *p1, const void *p2)
+{
+    const config_file_t *file1 = p1;
+    const config_file_t *file2 = p2;
+
+    return strcmp(file1->path, file2->path);
+}
+
+/* collect the YAML files of the given directory (ordered by name) */
+static config_file_t *
+collect_files(const char *directory, uint32_t *count)
+{
+    uint32_t size = 16;
+    config_file_t *files = xcalloc(size, sizeof(config_file_t));
+    DIR *dir = opendir(directory);
+
+    *count = 0;
+
+    if (dir == NULL)
     {
-        free((void *)env_key);
-        env_key = NULL;
+        log_perror("nyx: opendir");
+        return files;
     }
 
-#ifdef USE_PLUGINS
-    if (plugin_key)
+    struct dirent *entry = NULL;
+    while ((entry = readdir(dir)) != NULL)
     {
-        free((void *)plugin_key);
-        plugin_key = NULL;
+        const char *file_name = entry->d_name;
+
+        /* skip un-regular files */
+        if (entry->d_type != DT_REG)
+            continue;
+
+        /* skip non-yaml files */
+        if (!is_yaml_file(file_name))
+            continue;
+
+        if (*count >= size)
+        {
+            size *= 2;
+            files = xrealloc(files, size * sizeof(config_file_t));
+        }
+
+        size_t full_path_len = strlen(directory) + strlen(file_name) + 2;
+        config_file_t *file = &files[(*count)++];
+
+        memset(file, 0, sizeof(config_file_t));
+        file->path = xcalloc(full_path_len, sizeof(char));
+        snprintf(file->path, full_path_len, "%s/%s", directory, file_name);
     }
-#endif
 
+    closedir(dir);
+
+    qsort(files, *count, sizeof(config_file_t), compare_file_path);
+
+    return files;
+}
+
+static bool
+parse_path(nyx_t *nyx, const char *path, hash_t *previous, bool silent)
+{
+    uint32_t count = 0;
+    config_file_t *files = NULL;
+
+    /* let's determine if we got a single config file or
+     * a directory with multiple config files */
+    if (is_directory(path))
+        files = collect_files(path, &count);
+    else
+    {
+        files = xcalloc1(sizeof(config_file_t));
+        files->path = xstrdup(path);
+        count = 1;
+    }
+
+    bool success = parse_files(nyx, files, count, previous, silent);
+
+    for (uint32_t idx = 0; idx < count; idx++)
+        xfree(files[idx].path);
+
+    xfree(files);
+
+    return success;
+}
+
+/* relative include directories are relative to the config file */
+static char *
+include_path(const char *config_file, const char *include_dir)
+{
+    if (*include_dir == '/' || *include_dir == '~' || is_directory(config_file))
+        return xstrdup(include_dir);
+
+    char *copy = xstrdup(config_file);
+    const char *base = dirname(copy);
+    size_t length = strlen(base) + strlen(include_dir) + 2;
+    char *path = xcalloc(length, sizeof(char));
+
+    snprintf(path, length, "%s/%s", base, include_dir);
+    xfree(copy);
+
+    return path;
+}
+
+static void
+add_sources(list_t *sources, const char *path)
+{
+    list_add(sources, xstrdup(path));
+
+    if (!is_directory(path))
+        return;
+
+    uint32_t count = 0;
+    config_file_t *files = collect_files(path, &count);
+
+    for (uint32_t idx = 0; idx < count; idx++)
+        list_add(sources, files[idx].path);
+
+    xfree(files);
+}
+
+/**
+ * @brief Determine the files and directories the configuration of the
+ *        given nyx instance is read from
+ * @param nyx nyx instance (with parsed options)
+ * @return list of paths
+ */
+list_t *
+config_sources(nyx_t *nyx)
+{
+    list_t *sources = list_new(xfree_data);
+    const char *config_file = nyx->options.config_file;
+
+    add_sources(sources, config_file);
+
+    if (nyx->options.include_dir)
+    {
+        char *include_dir = include_path(config_file, nyx->options.include_dir);
+
+        if (is_directory(include_dir))
+            add_sources(sources, include_dir);
+
+        xfree(include_dir);
+    }
+
+    return sources;
+}
+
+bool
+parse_config(nyx_t *nyx, bool silent)
+{
+    const char *config_file = nyx->options.config_file;
+
+    if (config_file == NULL)
+        return false;
+
+    /* use the compiled image if it is up to date */
+    if (!nyx->options.compile_config)
+    {
+        char *image = image_path(config_file);
+        bool loaded = image_load(nyx, image, silent);
+
+        xfree(image);
+
+        if (loaded)
+            return true;
+    }
+
+    hash_t *previous = nyx->config_cache;
+    nyx->config_cache = hash_new(config_cache_free);
+
+    bool success = parse_path(nyx, config_file, previous, silent);
+
+    /* the files of the include directory are optional
+     * and do not determine the parse result */
+    if (success && nyx->options.include_dir)
+    {
+        char *include_dir = include_path(config_file, nyx->options.include_dir);
+
+        if (is_directory(include_dir))
+            parse_path(nyx, include_dir, previous, silent);
+        else if (!silent)
+            log_warn("include_dir '%s' is not a directory", include_dir);
+
+        xfree(include_dir);
+    }
+
+    /* drop the cached files that were removed or changed */
+    if (previous)
+        hash_destroy(previous);
 
     /* validate watches */
     uint32_t filtered = 0;
@@ -1256,8 +2039,22 @@ parse_config(nyx_t *nyx, bool silent)
             if (watch->startup_delay < 1)
                 watch->startup_delay = nyx->options.startup_delay;
 
+            /* run a single instance and restart one by one by default */
+            watch->instances = MAX(watch->instances, 1);
+            watch->restart_batch = MIN(MAX(watch->restart_batch, 1), watch->instances);
+
             dump_watch(watch);
 
+            const char **dep = watch->depends_on;
+
+            while (!silent && dep && *dep)
+            {
+                if (hash_get(nyx->watches, *dep) == NULL)
+                    log_warn("%s: ignoring dependency on unknown watch '%s'",
+                             watch->name, *dep);
+                dep++;
+            }
+
             /* let's emit a warning in case a relative directory is specified
              * in non-local mode */
             if (!silent && watch->dir && *watch->dir != '/' && !nyx->options.local_mode)
@@ -1268,7 +2065,7 @@ parse_config(nyx_t *nyx, bool silent)
             }
         }
 
-        free(iter);
+        hash_iter_free(iter);
     }
 
     return success;
@@ -24,6 +24,19 @@
 
 #define PARSE_HANDLER_SIZE (YAML_MAPPING_END_EVENT+1)
 
+/** state of parsing a single config file */
+typedef struct
+{
+    /** watches defined in the file */
+    hash_t *watches;
+
+    /** the file configures global options ('nyx' or 'plugins') */
+    bool globals;
+
+    /** key of the environment variable/plugin option being parsed */
+    const char *pending_key;
+} parse_file_t;
+
 typedef struct parse_info_t parse_info_t;
 typedef parse_info_t* (*handler_func_t)(parse_info_t*, yaml_event_t*, void*);
 
@@ -38,6 +51,9 @@ struct parse_info_t
     /** main application data */
     nyx_t *nyx;
 
+    /** file that is parsed */
+    parse_file_t *file;
+
     /** optional parent parsing information */
     parse_info_t *parent;
 
@@ -64,7 +80,7 @@ struct config_parser_map
 };
 
 parse_info_t *
-parse_info_new(nyx_t *nyx, bool silent);
+parse_info_new(nyx_t *nyx, parse_file_t *file, bool silent);
 
 parse_info_t *
 parse_info_new_child(parse_info_t *parent);
@@ -72,4 +88,10 @@ parse_info_new_child(parse_info_t *parent);
 bool
 parse_config(nyx_t *nyx, bool silent);
 
+void
+reindex_watches_from(hash_t *watches, hash_t *previous);
+
+list_t *
+config_sources(nyx_t *nyx);
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -15,27 +15,31 @@
 
 #define _GNU_SOURCE
 
+#define NYX_LOG_CATEGORY NYX_LOG_CONNECTOR
+#define NYX_MEM_TAG MEM_CONNECTOR
+
 #include "connector.h"
 #include "command.h"
 #include "def.h"
 #include "http.h"
 #include "log.h"
 #include "nyx.h"
+#include "reactor.h"
 #include "socket.h"
 #include "state.h"
+#include "stats.h"
+#include "trace.h"
+#include "strbuf.h"
+#include "subscribe.h"
 #include "utils.h"
 
+#include <arpa/inet.h>
+#include <ctype.h>
 #include <errno.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <string.h>
 
-/* epoll or kqueue */
-#ifndef OSX
-#include <sys/epoll.h>
-#else
-#include <sys/event.h>
-#endif
-
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -45,7 +49,29 @@
 #define NYX_MAX_MSG_LEN 128
 #define NYX_CONNECTOR_MAX_CONN 16
 
-static volatile bool need_exit = false;
+/*
+ * Persistent sessions (protocol version 2):
+ *
+ * The client opens a session by sending the preamble "NYX" followed by
+ * the protocol version (1 byte) which is confirmed by nyx the same way.
+ * Afterwards any number of requests may be sent without waiting for the
+ * responses:
+ *
+ *   request:  u32 length | u32 request id | command
+ *   response: u32 length | u32 request id | u8 status | output
+ *
+ * All integers are in network byte order, the length is the one of the
+ * command/output only. The legacy header (two ASCII digits) never starts
+ * with the preamble.
+ */
+#define NYX_PROTOCOL_PREAMBLE "NYX"
+#define NYX_PROTOCOL_PREAMBLE_LEN 4
+#define NYX_PROTOCOL_VERSION 2
+#define NYX_PROTOCOL_HANDSHAKE UINT32_MAX
+#define NYX_RESPONSE_HEADER_LEN 9
+
+/* listening socket of the connector */
+static int32_t connector_socket = -1;
 
 static uint32_t
 send_format(sender_callback_t *cb, const char *format, ...)
@@ -98,6 +124,37 @@ send_format(sender_callback_t *cb, const char *format, ...)
     return sent;
 }
 
+/* send pre-rendered output with a single call */
+static uint32_t
+send_raw(sender_callback_t *cb, const char *data, size_t length)
+{
+    ssize_t sent = send_safe(cb->client, data, length);
+
+    if (sent < 0)
+    {
+        log_perror("nyx: send");
+        return 0;
+    }
+
+    return sent;
+}
+
+static void
+put_u32(char *buffer, uint32_t value)
+{
+    value = htonl(value);
+    memcpy(buffer, &value, sizeof(uint32_t));
+}
+
+static uint32_t
+get_u32(const char *buffer)
+{
+    uint32_t value = 0;
+
+    memcpy(&value, buffer, sizeof(uint32_t));
+
+    return ntohl(value);
+}
 
 static size_t
 get_message_length(const char **strings, uint32_t count)
@@ -166,7 +223,7 @@ send_command(int32_t sock, const char **commands, bool quiet)
     if (sent == -1)
         log_perror("nyx: send");
 
-    free((void *)message);
+    xfree((void *)message);
 
     return sent;
 }
@@ -209,17 +266,77 @@ handle_response(char *buffer, size_t len, bool quiet)
     return success;
 }
 
-nyx_error_e
-connector_call(const char *socket_path, const char **commands, bool quiet)
+/**
+ * Print the lines of a streaming response (subscribe) as soon as they
+ * arrive until the connection is closed.
+ */
+static bool
+stream_response(int32_t sock, bool quiet)
+{
+    char buffer[1024];
+    size_t pos = 0;
+    ssize_t received = 0;
+
+    while ((received = recv(sock, buffer + pos, LEN(buffer) - 1 - pos, 0)) != 0)
+    {
+        char *start = buffer, *newline = NULL;
+
+        if (received < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_perror("nyx: recv");
+            return false;
+        }
+
+        pos += received;
+
+        while ((newline = memchr(start, '\n', buffer + pos - start)) != NULL)
+        {
+            *newline = '\0';
+            printf(quiet ? "%s\n" : ">>> %s\n", start);
+            start = newline + 1;
+        }
+
+        fflush(stdout);
+
+        pos -= start - buffer;
+        memmove(buffer, start, pos);
+
+        /* overlong line */
+        if (pos >= LEN(buffer) - 1)
+        {
+            buffer[pos] = '\0';
+            printf(quiet ? "%s\n" : ">>> %s\n", buffer);
+            pos = 0;
+        }
+    }
+
+    /* trailing status code <0, status, 0> of a failed request */
+    if (pos == 3 && buffer[0] == '\0')
+        return buffer[1] == '0';
+
+    return true;
+}
+
+/**
+ * Connect to the control socket of the daemon
+ * Returns the connected socket or -1 on failure (see 'error').
+ */
+static int32_t
+connect_daemon(const char *socket_path, nyx_error_e *error)
 {
-    nyx_error_e retcode = NYX_COMMAND_FAILED;
     int32_t sock = 0, res = 0;
-    char *response = NULL;
-    size_t total = 0;
     struct sockaddr_un addr;
 
+    *error = NYX_COMMAND_FAILED;
+
     if (socket_path == NULL)
-        return NYX_NO_DAEMON_FOUND;
+    {
+        *error = NYX_NO_DAEMON_FOUND;
+        return -1;
+    }
 
     /* create a UNIX domain, connection based socket */
     sock = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -227,7 +344,7 @@ connector_call(const char *socket_path, const char **commands, bool quiet)
     if (sock == -1)
     {
         log_perror("nyx: socket");
-        return NYX_COMMAND_FAILED;
+        return -1;
     }
 
     memset(&addr, 0, sizeof(struct sockaddr_un));
@@ -245,18 +362,65 @@ connector_call(const char *socket_path, const char **commands, bool quiet)
             log_error("Failed to connect to nyx - the daemon is probably not running");
             log_error("In local-mode make sure you are in the base directory or one of its sub directories");
 
-            return NYX_NO_DAEMON_FOUND;
+            *error = NYX_NO_DAEMON_FOUND;
         }
         else
             log_perror("nyx: connect");
 
-        return NYX_COMMAND_FAILED;
+        close(sock);
+        return -1;
     }
 
-    if (send_command(sock, commands, quiet) == -1)
+    return sock;
+}
+
+/**
+ * @brief Send a command to the daemon and print its response
+ * @param socket_path path to the control socket of the daemon
+ * @param commands    command and its arguments
+ * @param quiet       print the output of the command only
+ * @param json        request the output in JSON format (printed as it is)
+ * @return NYX_SUCCESS if the command succeeded
+ */
+nyx_error_e
+connector_call(const char *socket_path, const char **commands, bool quiet, bool json)
+{
+    nyx_error_e retcode = NYX_COMMAND_FAILED;
+    int32_t sock = 0, res = 0;
+    char *response = NULL;
+    const char **request = commands;
+    size_t total = 0;
+
+    if ((sock = connect_daemon(socket_path, &retcode)) == -1)
+        return retcode;
+
+    /* the output format precedes the command */
+    if (json)
+    {
+        uint32_t count = count_args(commands);
+
+        request = xcalloc(count + 2, sizeof(char *));
+        request[0] = NYX_JSON_OPTION;
+        memcpy(request + 1, commands, count * sizeof(char *));
+
+        quiet = true;
+    }
+
+    if (send_command(sock, request, quiet) == -1)
     {
         log_perror("nyx: send");
     }
+    else if (!strcmp(commands[0], "subscribe"))
+    {
+        if (stream_response(sock, quiet))
+            retcode = NYX_SUCCESS;
+
+        if (request != commands)
+            xfree(request);
+
+        close(sock);
+        return retcode;
+    }
     else
     {
         bool done = false;
@@ -273,7 +437,7 @@ connector_call(const char *socket_path, const char **commands, bool quiet)
                 if (response != NULL)
                 {
                     memcpy(updated, response, total);
-                    free(response);
+                    xfree(response);
                 }
 
                 /* copy new buffer contents after that */
@@ -298,6 +462,9 @@ connector_call(const char *socket_path, const char **commands, bool quiet)
 
     close(sock);
 
+    if (request != commands)
+        xfree(request);
+
     if (retcode == NYX_SUCCESS)
     {
         if (!handle_response(response, total, quiet))
@@ -305,450 +472,1062 @@ connector_call(const char *socket_path, const char **commands, bool quiet)
     }
 
     if (response != NULL)
-        free(response);
+        xfree(response);
 
     return retcode;
 }
 
+/* open a session on the given (blocking) socket */
 static bool
-handle_command(command_t *cmd, int32_t client, const char **input, nyx_t *nyx)
+open_session(int32_t sock)
 {
-    if (cmd->handler == NULL)
+    char preamble[NYX_PROTOCOL_PREAMBLE_LEN] = NYX_PROTOCOL_PREAMBLE;
+    size_t received = 0;
+
+    preamble[3] = NYX_PROTOCOL_VERSION;
+
+    if (send_safe(sock, preamble, NYX_PROTOCOL_PREAMBLE_LEN) != NYX_PROTOCOL_PREAMBLE_LEN)
+    {
+        log_perror("nyx: send");
         return false;
+    }
 
-    sender_callback_t *callback = xcalloc1(sizeof(sender_callback_t));
+    while (received < NYX_PROTOCOL_PREAMBLE_LEN)
+    {
+        ssize_t res = recv(sock, preamble + received,
+                NYX_PROTOCOL_PREAMBLE_LEN - received, 0);
 
-    callback->command = cmd->type;
-    callback->client = client;
-    callback->sender = send_format;
+        if (res > 0)
+        {
+            received += res;
+            continue;
+        }
+
+        if (res == -1 && errno == EINTR)
+            continue;
 
-    bool retval = cmd->handler(callback, input, nyx);
+        if (res == -1)
+            log_perror("nyx: recv");
 
-    free(callback);
-    return retval;
+        return false;
+    }
+
+    if (memcmp(preamble, NYX_PROTOCOL_PREAMBLE, 3) ||
+            preamble[3] != NYX_PROTOCOL_VERSION)
+    {
+        log_error("The nyx daemon does not support the control protocol version %u",
+                NYX_PROTOCOL_VERSION);
+        return false;
+    }
+
+    return true;
 }
 
-static void
-init_nyx_addr(const char *socket_path, struct sockaddr_un *addr)
+typedef struct
 {
-    memset(addr, 0, sizeof(struct sockaddr_un));
-    addr->sun_family = AF_UNIX;
-    strncpy(addr->sun_path, socket_path, sizeof(addr->sun_path)-1);
-}
+    const char **commands;
+    uint32_t count;
+    /** index of the first request that was not answered yet */
+    uint32_t answered;
+    bool quiet;
+    /** the commands are requested in JSON format */
+    bool json;
+    bool failed;
+    /** the last answered request streams its output (subscribe) */
+    bool streaming;
+} batch_t;
 
 static bool
-handle_request(NYX_EV_TYPE *event, nyx_t *nyx)
+is_subscribe(const char *command)
 {
-    bool success = false;
-    ssize_t received = 0;
+    size_t length = strlen("subscribe");
 
-    epoll_extra_data_t *extra = NYX_EV_GET(event);
-    int32_t fd = extra->fd;
+    return !strncmp(command, "subscribe", length) &&
+        (command[length] == '\0' || isspace(command[length]));
+}
 
-    /* start of new request? */
-    if (extra->length == 0)
+static void
+print_frame(batch_t *batch, uint32_t id, uint8_t status, const char *data, size_t length)
+{
+    const char *end = data + length;
+
+    if (id >= batch->count)
     {
-        /* initialize message buffer */
-        extra->buffer = xcalloc(NYX_MAX_MSG_LEN + 1, sizeof(char));
+        log_warn("Received a response to unknown request %u", id);
+        return;
+    }
 
-        /* read message length header */
-        received = recv(fd, extra->buffer, 2, 0);
+    /* the first response of a request - subscribe sends further frames
+     * of the same request */
+    if (id >= batch->answered)
+    {
+        if (!batch->quiet)
+            printf("<<< %s\n", batch->commands[id]);
 
-        if (received != 2)
-        {
-            if (received == -1)
-                log_perror("nyx: recv");
+        if (status != 0)
+            batch->failed = true;
 
-            goto close;
-        }
+        batch->answered = id + 1;
+        batch->streaming = !batch->json && is_subscribe(batch->commands[id]);
+    }
 
-        int32_t parsed = sscanf(extra->buffer, "%2u", &extra->length);
+    while (data < end)
+    {
+        const char *newline = memchr(data, '\n', end - data);
+        const char *eol = newline ? newline : end;
 
-        if (parsed != 1 || extra->length < 1)
-            goto close;
+        printf(batch->quiet ? "%.*s\n" : ">>> %.*s\n", (int32_t)(eol - data), data);
 
-        extra->length = MIN(NYX_MAX_MSG_LEN, extra->length);
+        data = eol + 1;
     }
 
-    received = recv(fd, extra->buffer + extra->pos, extra->length - extra->pos, 0);
+    fflush(stdout);
+}
 
-    if (received < 1)
+static char *
+build_requests(batch_t *batch, size_t *length)
+{
+    const char json[] = NYX_JSON_OPTION " ";
+    size_t total = 0, prefix = batch->json ? LEN(json) - 1 : 0;
+
+    for (uint32_t idx = batch->answered; idx < batch->count; idx++)
+        total += NYX_REQUEST_HEADER_LEN + prefix + strlen(batch->commands[idx]);
+
+    char *requests = xcalloc(total, sizeof(char));
+    char *ptr = requests;
+
+    for (uint32_t idx = batch->answered; idx < batch->count; idx++)
     {
-        if (received < 0)
-        {
-            if (errno == EAGAIN)
-                return true;
-            else
-            {
-                log_perror("nyx: recv");
-                goto close;
-            }
-        }
+        size_t command_length = strlen(batch->commands[idx]);
+
+        put_u32(ptr, prefix + command_length);
+        put_u32(ptr + 4, idx);
+        memcpy(ptr + NYX_REQUEST_HEADER_LEN, json, prefix);
+        memcpy(ptr + NYX_REQUEST_HEADER_LEN + prefix, batch->commands[idx], command_length);
+
+        ptr += NYX_REQUEST_HEADER_LEN + prefix + command_length;
     }
 
-    extra->pos += received;
+    *length = total;
 
-    if (extra->pos < extra->length)
-        return true;
+    return requests;
+}
 
-    /* parse input buffer */
-    command_t *cmd = NULL;
-    const char **commands = split_string_whitespace(extra->buffer);
+/**
+ * Send all unanswered requests of the batch on the (non-blocking) session
+ * socket and print the responses as they arrive. Returns on end of
+ * the connection or as soon as all requests were answered.
+ */
+static void
+batch_session(int32_t sock, batch_t *batch)
+{
+    size_t length = 0, sent = 0, pos = 0, size = NYX_MAX_FRAME_LEN;
+    char *requests = build_requests(batch, &length);
+    char *buffer = xcalloc(size, sizeof(char));
 
-    if ((cmd = parse_command(commands)) != NULL)
+    while (batch->answered < batch->count || batch->streaming)
     {
-        log_debug("Handling command '%s' (%d)",
-                cmd->name, cmd->type);
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+
+        /* the requests are written while reading the responses
+         * so neither side blocks on a full socket buffer */
+        if (sent < length)
+            pfd.events |= POLLOUT;
 
-        if (!handle_command(cmd, fd, commands, nyx))
+        if (poll(&pfd, 1, -1) == -1)
         {
-            log_warn("Failed to process command '%s' (%d)",
-                    cmd->name, cmd->type);
+            if (errno == EINTR)
+                continue;
 
-            send_status_safe(fd, 1);
+            log_perror("nyx: poll");
+            break;
         }
-    }
-    else
-    {
-        const char error[] = "unknown command\n";
-        send_safe(fd, error, LEN(error));
-        send_status_safe(fd, 1);
-    }
 
-    strings_free((char **)commands);
-    success = true;
+        if (pfd.revents & POLLOUT)
+        {
+            ssize_t res = send_safe(sock, requests + sent, length - sent);
 
-close:
-    extra->pos = 0;
-    extra->length = 0;
+            if (res > 0)
+                sent += res;
+            /* the remaining responses are read nevertheless */
+            else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+                sent = length;
+        }
 
-    if (extra->buffer)
-    {
-        free(extra->buffer);
-        extra->buffer = NULL;
-    }
+        if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
 
-    close(fd);
+        if (pos >= size)
+        {
+            size *= 2;
 
-    free(extra);
+            buffer = xrealloc(buffer, size);
+        }
 
-    NYX_EV_GET(event) = NULL;
+        ssize_t received = recv(sock, buffer + pos, size - pos, 0);
 
-    return success;
-}
+        if (received == 0)
+            break;
 
-static void
-handle_eventfd(NYX_EV_TYPE *event)
-{
-    epoll_extra_data_t *extra = NYX_EV_GET(event);
-    int32_t fd = extra->fd;
+        if (received < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+
+            log_perror("nyx: recv");
+            break;
+        }
+
+        size_t offset = 0;
+        pos += received;
+
+        while (pos - offset >= NYX_RESPONSE_HEADER_LEN)
+        {
+            uint32_t frame = get_u32(buffer + offset);
+
+            if (pos - offset - NYX_RESPONSE_HEADER_LEN < frame)
+                break;
 
-    log_debug("Received notification on event interface (%d)", fd);
+            print_frame(batch, get_u32(buffer + offset + 4), buffer[offset + 8],
+                    buffer + offset + NYX_RESPONSE_HEADER_LEN, frame);
 
-    uint64_t value = 0;
-    ssize_t retval = read(fd, &value, sizeof(value));
+            offset += NYX_RESPONSE_HEADER_LEN + frame;
+        }
 
-    if (retval == -1)
-        log_perror("nyx: read");
+        memmove(buffer, buffer + offset, pos - offset);
+        pos -= offset;
+    }
 
-    need_exit = true;
+    xfree(requests);
+    xfree(buffer);
 }
 
-static bool
-connector_run(nyx_t *nyx)
+/**
+ * @brief Send multiple commands over a single session and print their
+ *        responses as they complete
+ * @param socket_path path to the control socket of the daemon
+ * @param commands    NULL-terminated list of commands (one command string each)
+ * @param quiet       print the output of the commands only
+ * @param json        request the output in JSON format (one line per command)
+ * @return NYX_SUCCESS if all commands succeeded
+ */
+nyx_error_e
+connector_batch(const char *socket_path, const char **commands, bool quiet, bool json)
 {
-    bool restart = false;
-    int32_t error = 0, epfd = 0, http_sock = 0;
+    nyx_error_e retcode = NYX_SUCCESS;
+    batch_t batch =
+    {
+        .commands = commands,
+        .count = commands ? count_args(commands) : 0,
+        .quiet = quiet || json,
+        .json = json
+    };
+
+    for (uint32_t idx = 0; idx < batch.count; idx++)
+    {
+        if (strlen(commands[idx]) + (json ? LEN(NYX_JSON_OPTION) : 0) > NYX_MAX_FRAME_LEN)
+        {
+            log_error("Command %u exceeds the maximum length of %u bytes",
+                    idx + 1, NYX_MAX_FRAME_LEN);
+            return NYX_INVALID_COMMAND;
+        }
+    }
 
-    NYX_EV_TYPE base_ev, fd_ev, http_ev, ev;
-    NYX_EV_TYPE *events = NULL;
+    while (batch.answered < batch.count)
+    {
+        uint32_t answered = batch.answered;
+        int32_t sock = connect_daemon(socket_path, &retcode);
 
-    log_debug("Starting connector");
+        if (sock == -1)
+            return retcode;
 
-    struct sockaddr_un addr;
+        bool connected = open_session(sock) && unblock_socket(sock);
 
-    init_nyx_addr(nyx->socket_path, &addr);
+        if (connected)
+            batch_session(sock, &batch);
 
-    /* set umask before socket creation */
-    mode_t old_mask = umask(0);
+        close(sock);
 
-    /* create a UNIX domain, connection based socket */
-    int32_t sock =
-#if defined(SOCK_CLOEXEC)
-        socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
-#else
-        socket(AF_UNIX, SOCK_STREAM, 0);
-#endif
+        if (!connected)
+            return NYX_COMMAND_FAILED;
 
-    if (sock == -1)
-    {
-        log_perror("nyx: socket");
+        if (batch.streaming)
+            break;
 
-        umask(old_mask);
-        return 0;
+        /* nyx does not process the requests following a command that
+         * ends the session (e.g. a bulk restart) - these are sent again
+         * on a new session */
+        if (batch.answered == answered)
+        {
+            log_error("The connection to nyx was closed unexpectedly");
+            return NYX_COMMAND_FAILED;
+        }
     }
 
-    /* ignore SIGPIPE signals (on OSX) */
-#if defined(SO_NOSIGPIPE)
-    bool on = true;
-    if (setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on)) != 0)
-        log_perror("nyx: setsockopt");
-#endif
+    return batch.failed ? NYX_COMMAND_FAILED : NYX_SUCCESS;
+}
 
-    /* remove any existing nyx sockets */
-    unlink(nyx->socket_path);
+/**
+ * Hand the client connection over to the command that took it over
+ * (e.g. subscribe): the connection is removed from the connector but
+ * not closed.
+ */
+static void
+detach_client(epoll_extra_data_t *extra, sender_callback_t *cb, bool framed,
+        uint32_t id, nyx_t *nyx)
+{
+    reactor_remove_fd(nyx->reactor, extra->fd);
+    extra->detached = true;
 
-    /* bind to specified socket location */
-    error = bind(sock, (struct sockaddr *)&addr, sizeof(struct sockaddr_un));
+    cb->detach(cb, extra->fd, framed, id, nyx);
+}
 
-    /* restore old umask */
-    umask(old_mask);
+static bool
+handle_command(command_t *cmd, epoll_extra_data_t *extra, const char **input,
+        snapshot_format_e format, nyx_t *nyx)
+{
+    if (cmd->handler == NULL)
+        return false;
 
-    if (error)
+    sender_callback_t *callback = xcalloc1(sizeof(sender_callback_t));
+
+    callback->command = cmd->type;
+    callback->client = extra->fd;
+    callback->sender = send_format;
+    callback->send_raw = send_raw;
+    callback->format = format;
+    callback->detachable = true;
+
+    bool retval = command_run(cmd, callback, input, nyx);
+
+    if (retval && callback->detach)
+        detach_client(extra, callback, false, 0, nyx);
+
+    xfree(callback);
+    return retval;
+}
+
+static uint32_t
+append_format(sender_callback_t *cb, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* collect the output of a session command */
+static uint32_t
+append_format(sender_callback_t *cb, const char *format, ...)
+{
+    strbuf_t *str = cb->data;
+
+    va_list vas;
+    va_start(vas, format);
+    uint64_t length = strbuf_append_va(str, format, vas);
+    va_end(vas);
+
+    return length + strbuf_append_char(str, '\n');
+}
+
+static uint32_t
+append_raw(sender_callback_t *cb, const char *data, size_t length)
+{
+    return strbuf_append_data(cb->data, data, length);
+}
+
+/**
+ * Process one request of a session and queue its response - the output
+ * is rendered right behind the response header that is filled in
+ * afterwards. The session's output is empty when a request is processed.
+ */
+static void
+handle_session_command(epoll_extra_data_t *extra, uint32_t id, const char *input,
+        uint32_t length, nyx_t *nyx)
+{
+    int32_t fd = extra->fd;
+    char *message = xcalloc(length + 1, sizeof(char));
+    strbuf_t *output = extra->output;
+    const char **commands = NULL, **args = NULL;
+    command_t *cmd = NULL;
+    bool success = false;
+    uint64_t started = stats_now();
+    char header[NYX_RESPONSE_HEADER_LEN] = {0};
+
+    sender_callback_t callback =
     {
-        log_perror("nyx: bind");
-        return 0;
-    }
+        .client = fd,
+        .sender = append_format,
+        .send_raw = append_raw,
+        .data = output,
+        .detachable = true
+    };
 
-    if (!unblock_socket(sock))
-        return 0;
+    strbuf_append_data(output, header, NYX_RESPONSE_HEADER_LEN);
 
-    /* listen on requests */
-    error = listen(sock, NYX_CONNECTOR_MAX_CONN);
+    memcpy(message, input, length);
+    commands = split_string_whitespace(message);
+    args = parse_output_format(commands, &callback.format);
 
-    if (error)
+    if ((cmd = parse_command(args)) != NULL && cmd->handler)
     {
-        log_perror("nyx: listen");
-        goto teardown;
+        log_debug("Handling command '%s' (%d) of request %u", cmd->name, cmd->type, id);
+
+        callback.command = cmd->type;
+
+        NYX_TRACE2(connector__command, cmd->name, fd);
+
+        if (!(success = command_run(cmd, &callback, args, nyx)))
+        {
+            log_warn("Failed to process command '%s' (%d)",
+                    cmd->name, cmd->type);
+        }
     }
+    else
+        strbuf_append_string(output, "unknown command\n");
 
-    /* initialize epoll/kqueue */
-#ifndef OSX
-    epfd = epoll_create(NYX_CONNECTOR_MAX_CONN);
-    if (epfd == -1)
+    /* the command answers the request itself */
+    if (success && callback.detach)
     {
-        log_perror("nyx: epoll_create");
-        goto teardown;
+        strbuf_clear(output);
+        detach_client(extra, &callback, true, id, nyx);
+
+        strings_free((char **)commands);
+        xfree(message);
+
+        return;
     }
-#else
-    epfd = kqueue();
-    if (epfd == -1)
+
+    put_u32(output->buf, output->length - NYX_RESPONSE_HEADER_LEN);
+    put_u32(output->buf + 4, id);
+    output->buf[8] = success ? 0 : 1;
+
+    stats_record_since(STATS_REQUEST, started);
+
+    if (cmd && cmd->handler)
+        NYX_TRACE4(connector__command__done, cmd->name, fd, success, stats_now() - started);
+
+    strings_free((char **)commands);
+    xfree(message);
+}
+
+/**
+ * Send as much of the queued responses as the socket takes right now -
+ * the rest is sent when the reactor reports the socket to be writable.
+ * Returns false if the client is gone.
+ */
+static bool
+session_flush(epoll_extra_data_t *extra, reactor_t *reactor)
+{
+    strbuf_t *output = extra->output;
+
+    while (extra->output_sent < output->length)
     {
-        log_perror("nyx: kqueue");
-        goto teardown;
+        ssize_t sent = send_safe(extra->fd, output->buf + extra->output_sent,
+                output->length - extra->output_sent);
+
+        if (sent > 0)
+        {
+            extra->output_sent += sent;
+            continue;
+        }
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            /* no further requests are read until the output is sent */
+            if (!extra->writing)
+            {
+                extra->writing = true;
+                reactor_modify_fd(reactor, extra->fd, REACTOR_WRITE);
+            }
+
+            return true;
+        }
+
+        return false;
     }
-#endif
 
-    /* add new listening socket to epoll instance */
-    if (!add_epoll_socket(sock, &base_ev, epfd, sock))
-        goto teardown;
+    extra->output_sent = 0;
+    strbuf_clear(output);
 
-    /* add eventfd socket to epoll as well */
-    int32_t event_interface = nyx->event > 0 ? nyx->event : nyx->event_pipe[0];
+    if (extra->writing)
+    {
+        extra->writing = false;
+        reactor_modify_fd(reactor, extra->fd, REACTOR_READ);
+    }
 
-    if (!unblock_socket(event_interface))
-        goto teardown;
+    return true;
+}
 
-    if (!add_epoll_socket(event_interface, &fd_ev, epfd, sock))
-        goto teardown;
+/**
+ * @brief Parse the next request of a session
+ * @param buffer buffer holding the received data
+ * @param length number of bytes received
+ * @param frame  parsed request (pointing into the buffer)
+ * @return FRAME_PARSE_INCOMPLETE if more data is needed and
+ *         FRAME_PARSE_INVALID if the request exceeds NYX_MAX_FRAME_LEN
+ */
+frame_parse_e
+connector_parse_frame(const char *buffer, uint32_t length, frame_t *frame)
+{
+    if (length < NYX_REQUEST_HEADER_LEN)
+        return FRAME_PARSE_INCOMPLETE;
 
-    /* add http socket to epoll as well (if configured) */
-    if (nyx->options.http_port)
+    frame->length = get_u32(buffer);
+    frame->id = get_u32(buffer + 4);
+    frame->command = buffer + NYX_REQUEST_HEADER_LEN;
+
+    if (frame->length > NYX_MAX_FRAME_LEN)
+        return FRAME_PARSE_INVALID;
+
+    if (length - NYX_REQUEST_HEADER_LEN < frame->length)
+        return FRAME_PARSE_INCOMPLETE;
+
+    return FRAME_PARSE_OK;
+}
+
+/**
+ * Send the queued responses and process the requests of a session that
+ * are received completely - a request is processed only after the
+ * responses of the previous ones were sent.
+ * Returns false if the session is to be closed.
+ */
+static bool
+process_session(epoll_extra_data_t *extra, nyx_t *nyx)
+{
+    char *buffer = extra->buffer;
+    uint32_t offset = 0;
+
+    if (!session_flush(extra, nyx->reactor))
+        return false;
+
+    /* the session is closed once the last response was sent */
+    if (extra->closing)
+        return extra->output->length > 0;
+
+    if (extra->version == NYX_PROTOCOL_HANDSHAKE)
     {
-        http_sock = http_init(nyx->options.http_port);
+        if (extra->pos < NYX_PROTOCOL_PREAMBLE_LEN)
+            return true;
+
+        uint8_t version = buffer[3];
+        char preamble[NYX_PROTOCOL_PREAMBLE_LEN] = NYX_PROTOCOL_PREAMBLE;
+
+        /* the client learns about the supported version either way */
+        preamble[3] = NYX_PROTOCOL_VERSION;
+
+        strbuf_append_data(extra->output, preamble, NYX_PROTOCOL_PREAMBLE_LEN);
 
-        if (http_sock)
+        if (memcmp(buffer, NYX_PROTOCOL_PREAMBLE, 3) || version != NYX_PROTOCOL_VERSION)
         {
-            log_debug("Initialized HTTP connector interface at port %u",
-                    nyx->options.http_port);
+            log_warn("Unsupported control protocol version %u", version);
+
+            extra->closing = true;
+
+            return session_flush(extra, nyx->reactor) && extra->output->length > 0;
+        }
+
+        extra->version = version;
+        offset = NYX_PROTOCOL_PREAMBLE_LEN;
+
+        if (!session_flush(extra, nyx->reactor))
+            return false;
+    }
+
+    while (extra->output->length == 0)
+    {
+        frame_t frame;
+        frame_parse_e result = connector_parse_frame(buffer + offset,
+                extra->pos - offset, &frame);
 
-            if (!unblock_socket(http_sock))
-                goto teardown;
+        if (result == FRAME_PARSE_INCOMPLETE)
+            break;
 
-            if (!add_epoll_socket(http_sock, &http_ev, epfd, http_sock))
-                goto teardown;
+        if (result == FRAME_PARSE_INVALID)
+        {
+            log_warn("Request %u exceeds the maximum length of %u bytes",
+                    frame.id, NYX_MAX_FRAME_LEN);
+            return false;
         }
+
+        handle_session_command(extra, frame.id, frame.command, frame.length, nyx);
+
+        /* the session ends with a detaching command */
+        if (extra->detached)
+            return true;
+
+        offset += NYX_REQUEST_HEADER_LEN + frame.length;
+
+        if (!session_flush(extra, nyx->reactor))
+            return false;
     }
 
-    events = xcalloc(NYX_CONNECTOR_MAX_CONN, sizeof(NYX_EV_TYPE));
+    /* keep the incomplete (or not yet processed) requests */
+    memmove(buffer, buffer + offset, extra->pos - offset);
+    extra->pos -= offset;
 
-    while (!need_exit && !restart)
+    return true;
+}
+
+/**
+ * Read the pending data of a session (if any) and process it
+ * Returns false if the session is to be closed.
+ */
+static bool
+handle_session(epoll_extra_data_t *extra, uint32_t events, nyx_t *nyx)
+{
+    if (events & REACTOR_READ)
     {
-        int32_t i = 0, n = 0;
-        NYX_EV_TYPE *event = NULL;
+        ssize_t received = recv(extra->fd, extra->buffer + extra->pos,
+                extra->length - extra->pos, 0);
 
-        log_debug("Connector: waiting for connections");
+        if (received == 0)
+            return false;
 
-#ifndef OSX
-        n = epoll_wait(epfd, events, NYX_CONNECTOR_MAX_CONN, -1);
-#else
-        n = kevent(epfd, NULL, 0, events, NYX_CONNECTOR_MAX_CONN, NULL);
-#endif
+        if (received < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return true;
 
-        /* epoll listening failed for some reason */
-        if (n < 1)
+            log_perror("nyx: recv");
+            return false;
+        }
+
+        extra->pos += received;
+    }
+
+    return process_session(extra, nyx);
+}
+
+static void
+init_nyx_addr(const char *socket_path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, socket_path, sizeof(addr->sun_path)-1);
+}
+
+static void
+free_extra(epoll_extra_data_t *extra)
+{
+    if (extra->buffer)
+        xfree(extra->buffer);
+
+    strbuf_free(extra->output);
+    xfree(extra);
+}
+
+static bool
+handle_request(epoll_extra_data_t *extra, uint32_t events, nyx_t *nyx)
+{
+    bool success = false;
+    ssize_t received = 0;
+
+    int32_t fd = extra->fd;
+
+    if (extra->version)
+    {
+        if (!handle_session(extra, events, nyx))
+            goto close;
+
+        if (extra->detached)
+            goto detach;
+
+        return true;
+    }
+
+    /* start of new request? */
+    if (extra->length == 0)
+    {
+        /* initialize message buffer */
+        extra->buffer = xcalloc(NYX_MAX_MSG_LEN + 1, sizeof(char));
+
+        /* read message length header */
+        received = recv(fd, extra->buffer, 2, 0);
+
+        if (received != 2)
         {
-            if (errno == EINTR)
-            {
-                log_debug("Connector: caught interrupt");
-                restart = true;
-                continue;
-            }
+            if (received == -1)
+                log_perror("nyx: recv");
 
-            log_perror("nyx: accept");
-            continue;
+            goto close;
         }
 
-        /* process all received events */
-        for (i = 0, event = events; i < n; event++, i++)
+        /* start of a persistent session */
+        if (memcmp(extra->buffer, NYX_PROTOCOL_PREAMBLE, 2) == 0)
         {
-            epoll_extra_data_t *extra = NYX_EV_GET(event);
-
-            /* error on the socket */
-#ifndef OSX
-            if ((event->events & EPOLLERR) ||
-                (event->events & EPOLLHUP) ||
-                (event->events & EPOLLRDHUP) ||
-                !(event->events & EPOLLIN))
-#else
-            if (event->flags & EV_EOF)
-#endif
-            {
-                close(extra->fd);
+            xfree(extra->buffer);
 
-                if (extra->buffer)
-                    free(extra->buffer);
+            extra->buffer = xcalloc(NYX_REQUEST_HEADER_LEN + NYX_MAX_FRAME_LEN, sizeof(char));
+            memcpy(extra->buffer, NYX_PROTOCOL_PREAMBLE, 2);
 
-                free(extra);
-                continue;
-            }
+            extra->pos = 2;
+            extra->length = NYX_REQUEST_HEADER_LEN + NYX_MAX_FRAME_LEN;
+            extra->version = NYX_PROTOCOL_HANDSHAKE;
+            extra->output = strbuf_new_size(256);
 
-            /* check for events on listening socket
-             * -> accept a new connection */
-            if (extra->fd == sock || (http_sock && http_sock == extra->fd))
-            {
-                int32_t client = 0;
-                struct sockaddr_un caddr;
-                socklen_t client_len = sizeof(struct sockaddr_un);
+            return true;
+        }
 
-                client = accept(extra->fd, (struct sockaddr *)&caddr, &client_len);
+        int32_t parsed = sscanf(extra->buffer, "%2u", &extra->length);
 
-                if (client == -1)
-                {
-                    if (errno != EAGAIN && errno != EWOULDBLOCK)
-                        log_perror("nyx: accept");
-                    continue;
-                }
+        if (parsed != 1 || extra->length < 1)
+            goto close;
 
-                if (!unblock_socket(client))
-                {
-                    close(client);
-                    continue;
-                }
+        extra->length = MIN(NYX_MAX_MSG_LEN, extra->length);
+    }
 
-                if (!add_epoll_socket(client, &ev, epfd, extra->fd))
-                {
-                    /* TODO: free extra data? */
+    received = recv(fd, extra->buffer + extra->pos, extra->length - extra->pos, 0);
 
-                    close(client);
-                    continue;
-                }
-            }
-            else if (extra->fd == event_interface)
-            {
-                handle_eventfd(event);
-            }
-            /* incoming data from one of the client sockets */
+    if (received < 1)
+    {
+        if (received < 0)
+        {
+            if (errno == EAGAIN)
+                return true;
             else
             {
-                if (http_sock && extra->remote_socket == http_sock)
-                {
-                    if (!http_handle_request(event, nyx))
-                        restart = true;
-                }
-                else
-                {
-                    if (!handle_request(event, nyx))
-                        restart = true;
-                }
+                log_perror("nyx: recv");
+                goto close;
             }
         }
     }
 
-teardown:
-    close(sock);
+    extra->pos += received;
 
-    if (epfd > 0)
-        close(epfd);
+    if (extra->pos < extra->length)
+        return true;
 
-    unlink(nyx->socket_path);
+    /* parse input buffer */
+    uint64_t started = stats_now();
+    command_t *cmd = NULL;
+    snapshot_format_e format = SNAPSHOT_TEXT;
+    const char **commands = split_string_whitespace(extra->buffer);
+    const char **args = parse_output_format(commands, &format);
 
-    if (events)
+    if ((cmd = parse_command(args)) != NULL)
     {
-        free(events);
-        events = NULL;
+        log_debug("Handling command '%s' (%d)",
+                cmd->name, cmd->type);
+
+        NYX_TRACE2(connector__command, cmd->name, fd);
+
+        bool handled = handle_command(cmd, extra, args, format, nyx);
+
+        if (!handled)
+        {
+            log_warn("Failed to process command '%s' (%d)",
+                    cmd->name, cmd->type);
+
+            send_status_safe(fd, 1);
+        }
+
+        NYX_TRACE4(connector__command__done, cmd->name, fd, handled, stats_now() - started);
     }
+    else
+    {
+        const char error[] = "unknown command\n";
+        send_safe(fd, error, LEN(error));
+        send_status_safe(fd, 1);
+    }
+
+    stats_record_since(STATS_REQUEST, started);
+
+    strings_free((char **)commands);
+    success = true;
+
+    if (extra->detached)
+        goto detach;
+
+close:
+    reactor_remove_fd(nyx->reactor, fd);
+    close(fd);
+
+    free_extra(extra);
+
+    return success;
+
+detach:
+    /* the connection is owned by the subscribers now */
+    free_extra(extra);
+
+    return true;
+}
+
+static void
+close_client(reactor_t *reactor, epoll_extra_data_t *extra)
+{
+    reactor_remove_fd(reactor, extra->fd);
+    close(extra->fd);
+
+    free_extra(extra);
+}
+
+/* determine whether the client opens a session (without consuming
+ * any of its data) */
+static bool
+starts_session(epoll_extra_data_t *extra)
+{
+    char header[2] = {0};
+
+    if (extra->length > 0)
+        return false;
 
-#ifndef OSX
-    if (base_ev.data.ptr)
+    return recv(extra->fd, header, 2, MSG_PEEK) == 2 &&
+        memcmp(header, NYX_PROTOCOL_PREAMBLE, 2) == 0;
+}
+
+/**
+ * Incoming data from one of the client sockets
+ */
+static void
+handle_client(reactor_t *reactor, UNUSED int32_t fd, uint32_t events, void *data)
+{
+    epoll_extra_data_t *extra = data;
+    nyx_t *nyx = extra->context;
+
+    /* sessions process their pending requests before the hangup
+     * is noticed by receiving the end of the stream - while responses
+     * are pending only the socket's writability is watched for */
+    if (((events & REACTOR_READ) && (extra->version || starts_session(extra))) ||
+            ((events & REACTOR_WRITE) && !(events & REACTOR_HANGUP)))
     {
-        free(base_ev.data.ptr);
-        base_ev.data.ptr = NULL;
+        handle_request(extra, events, nyx);
+        return;
     }
 
-    if (nyx->event > 0 && fd_ev.data.ptr)
+    /* error on the socket */
+    if ((events & REACTOR_HANGUP) || !(events & REACTOR_READ))
     {
-        free(fd_ev.data.ptr);
-        fd_ev.data.ptr = NULL;
+        close_client(reactor, extra);
+        return;
     }
-#else
-    if (base_ev.udata)
+
+    handle_request(extra, events, nyx);
+}
+
+/* send the final response of a client that was detached */
+static void
+handle_final_response(reactor_t *reactor, UNUSED int32_t fd, uint32_t events, void *data)
+{
+    epoll_extra_data_t *extra = data;
+
+    /* the client is gone or the response was sent completely */
+    if ((events & REACTOR_HANGUP) || !session_flush(extra, reactor) ||
+            extra->output->length == 0)
+        close_client(reactor, extra);
+}
+
+/**
+ * @brief Send the final response to a client that was detached from the
+ *        connector and close its socket afterwards - the response is
+ *        sent without blocking on the reactor thread (may be called
+ *        from any thread)
+ * @param reactor reactor the connector runs on
+ * @param fd      client socket (owned by the connector from now on)
+ * @param output  response (owned by the connector from now on)
+ */
+void
+connector_respond(reactor_t *reactor, int32_t fd, strbuf_t *output)
+{
+    epoll_extra_data_t *extra = epoll_extra_data_new(fd, -1);
+
+    extra->output = output;
+    extra->writing = true;
+    extra->closing = true;
+
+    if (!reactor_add_fd_events(reactor, fd, REACTOR_WRITE, handle_final_response, extra))
+    {
+        close(fd);
+        free_extra(extra);
+    }
+}
+
+/**
+ * Accept a new connection on one of the listening sockets
+ */
+static void
+handle_accept(reactor_t *reactor, int32_t fd, UNUSED uint32_t events, void *data)
+{
+    struct sockaddr_un caddr;
+    socklen_t client_len = sizeof(struct sockaddr_un);
+
+    int32_t client = accept(fd, (struct sockaddr *)&caddr, &client_len);
+
+    if (client == -1)
     {
-        free(base_ev.udata);
-        base_ev.udata = NULL;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            log_perror("nyx: accept");
+        return;
     }
 
-    if (nyx->event > 0 && fd_ev.udata)
+    if (!unblock_socket(client))
+    {
+        close(client);
+        return;
+    }
+
+    epoll_extra_data_t *extra = epoll_extra_data_new(client, fd);
+    extra->context = data;
+
+    if (!reactor_add_fd(reactor, client, handle_client, extra))
     {
-        free(fd_ev.udata);
-        fd_ev.udata = NULL;
+        close(client);
+        xfree(extra);
     }
+}
+
+/**
+ * @brief Start listening on the nyx socket (and the HTTP and federation
+ *        ports if configured) on the nyx reactor
+ * @param nyx nyx instance
+ * @return true on success, false otherwise
+ */
+bool
+connector_init(nyx_t *nyx)
+{
+    int32_t error = 0;
+
+    log_debug("Starting connector");
+
+    nyx->subscribers = subscribers_new(nyx->reactor);
+    nyx->snapshot = snapshot_new(render_snapshot, nyx);
+    nyx->bulk = bulk_ops_new(nyx->reactor, nyx);
+
+    struct sockaddr_un addr;
+
+    init_nyx_addr(nyx->socket_path, &addr);
+
+    /* set umask before socket creation */
+    mode_t old_mask = umask(0);
+
+    /* create a UNIX domain, connection based socket */
+    int32_t sock =
+#if defined(SOCK_CLOEXEC)
+        socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+        socket(AF_UNIX, SOCK_STREAM, 0);
 #endif
 
-    if (http_sock)
+    if (sock == -1)
     {
-        close(http_sock);
+        log_perror("nyx: socket");
+
+        umask(old_mask);
+        return false;
+    }
+
+    /* ignore SIGPIPE signals (on OSX) */
+#if defined(SO_NOSIGPIPE)
+    bool on = true;
+    if (setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on)) != 0)
+        log_perror("nyx: setsockopt");
+#endif
 
-#ifndef OSX
-        if (http_ev.data.ptr)
+    /* remove any existing nyx sockets */
+    unlink(nyx->socket_path);
+
+    /* bind to specified socket location */
+    error = bind(sock, (struct sockaddr *)&addr, sizeof(struct sockaddr_un));
+
+    /* restore old umask */
+    umask(old_mask);
+
+    if (error)
+    {
+        log_perror("nyx: bind");
+        goto teardown;
+    }
+
+    if (!unblock_socket(sock))
+        goto teardown;
+
+    /* listen on requests */
+    error = listen(sock, NYX_CONNECTOR_MAX_CONN);
+
+    if (error)
+    {
+        log_perror("nyx: listen");
+        goto teardown;
+    }
+
+    if (!reactor_add_fd(nyx->reactor, sock, handle_accept, nyx))
+        goto teardown;
+
+    connector_socket = sock;
+
+    /* add http socket as well (if configured) */
+    if (nyx->options.http_port)
+    {
+        nyx->http = http_server_new(nyx->reactor, nyx->options.http_port, nyx);
+
+        if (nyx->http)
         {
-            free(http_ev.data.ptr);
-            http_ev.data.ptr = NULL;
+            log_debug("Initialized HTTP connector interface at port %u",
+                    nyx->options.http_port);
         }
-#else
-        if (http_ev.udata)
+    }
+
+    /* accept the state changes of federated nodes (if configured) */
+    if (nyx->options.federation_port)
+    {
+        nyx->fleet = fleet_new(nyx->reactor, nyx->subscribers);
+
+        if (fleet_listen(nyx->fleet, nyx->options.federation_port))
         {
-            free(http_ev.udata);
-            http_ev.udata = NULL;
+            log_info("Accepting federated nodes at port %u",
+                    nyx->options.federation_port);
+        }
+        else
+        {
+            log_error("Failed to listen for federated nodes at port %u",
+                    nyx->options.federation_port);
         }
-#endif
     }
 
-    log_debug("Connector: terminated");
+    /* push the state changes to the aggregators (if configured) */
+    if (nyx->options.federation)
+    {
+        nyx->federation = federation_new(nyx->reactor, nyx->options.federation,
+                nyx->options.federation_node, nyx->options.federation_interval, nyx);
+    }
 
-    return restart;
+    return true;
+
+teardown:
+    close(sock);
+    unlink(nyx->socket_path);
+
+    return false;
 }
 
-void *
-connector_start(void *state)
+/**
+ * @brief Stop listening on the nyx socket and the HTTP port
+ * @param nyx nyx instance
+ */
+void
+connector_shutdown(nyx_t *nyx)
 {
-    while (!need_exit)
+    if (connector_socket >= 0)
     {
-        if (!connector_run((nyx_t *)state))
-            break;
+        reactor_remove_fd(nyx->reactor, connector_socket);
+        close(connector_socket);
+        connector_socket = -1;
+
+        unlink(nyx->socket_path);
+    }
+
+    if (nyx->http)
+    {
+        http_server_destroy(nyx->http);
+        nyx->http = NULL;
+    }
+
+    if (nyx->fleet)
+    {
+        fleet_destroy(nyx->fleet);
+        nyx->fleet = NULL;
     }
 
-    return NULL;
+    log_debug("Connector: terminated");
 }
 
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -16,13 +16,48 @@
 #pragma once
 
 #include "nyx.h"
+#include "reactor.h"
+#include "strbuf.h"
 
 #define NYX_SOCKET_ADDR "/tmp/nyx.sock"
 
+/* maximum length of a session request's command */
+#define NYX_MAX_FRAME_LEN 4096
+/* length and request id that precede the command */
+#define NYX_REQUEST_HEADER_LEN 8
+
+typedef enum
+{
+    FRAME_PARSE_OK,
+    FRAME_PARSE_INCOMPLETE,
+    FRAME_PARSE_INVALID
+} frame_parse_e;
+
+/** request of a session as received from the client */
+typedef struct
+{
+    uint32_t id;
+    /** command (not NUL-terminated) */
+    const char *command;
+    uint32_t length;
+} frame_t;
+
+nyx_error_e
+connector_call(const char *socket_path, const char **commands, bool quiet, bool json);
+
 nyx_error_e
-connector_call(const char *socket_path, const char **commands, bool quiet);
+connector_batch(const char *socket_path, const char **commands, bool quiet, bool json);
+
+frame_parse_e
+connector_parse_frame(const char *buffer, uint32_t length, frame_t *frame);
+
+bool
+connector_init(nyx_t *nyx);
+
+void
+connector_respond(reactor_t *reactor, int32_t fd, strbuf_t *output);
 
-void *
-connector_start(void *nyx);
+void
+connector_shutdown(nyx_t *nyx);
 
 /* vim: set et sw=4 sts=4 tw=80: */
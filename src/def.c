@@ -13,24 +13,165 @@
  * limitations under the License.
  */
 
+
+#define _GNU_SOURCE
+
 #include "def.h"
 #include "log.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef OSX
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+typedef struct
+{
+    uint64_t allocations;
+    /* the memory of a subsystem may be released by another one, so
+     * these may drop below zero temporarily */
+    int64_t live;
+    int64_t bytes;
+} mem_counter_t;
+
+static mem_counter_t usages[MEM_TAGS];
+
+static const char *tag_names[] =
+{
+    "other",
+    "config",
+    "state",
+    "history",
+    "hash",
+    "proc",
+    "metrics",
+    "connector",
+    "plugins"
+};
+
+static size_t
+usable_size(void *ptr)
+{
+#ifdef OSX
+    return malloc_size(ptr);
+#else
+    return malloc_usable_size(ptr);
+#endif
+}
+
+static void
+account(mem_tag_e tag, void *ptr)
+{
+    __atomic_add_fetch(&usages[tag].allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&usages[tag].live, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&usages[tag].bytes, usable_size(ptr), __ATOMIC_RELAXED);
+}
+
+static void
+release(mem_tag_e tag, void *ptr)
+{
+    __atomic_sub_fetch(&usages[tag].live, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&usages[tag].bytes, usable_size(ptr), __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Allocate zeroed memory accounted to the given subsystem -
+ *        terminates nyx if the allocation fails (use xcalloc/xcalloc1)
+ */
 void *
-xcalloc(size_t count, size_t size)
+nyx_calloc(size_t count, size_t size, mem_tag_e tag)
 {
     void *ptr = calloc(count, size);
 
     if (ptr == NULL)
         log_critical_perror("nyx: calloc");
 
+    account(tag, ptr);
+
     return ptr;
 }
 
+/**
+ * @brief Duplicate the string accounted to the given subsystem -
+ *        terminates nyx if the allocation fails (use xstrdup)
+ */
+char *
+nyx_strdup(const char *str, mem_tag_e tag)
+{
+    char *copy = strdup(str);
+
+    if (copy == NULL)
+        log_critical_perror("nyx: strdup");
+
+    account(tag, copy);
+
+    return copy;
+}
+
+/**
+ * @brief Resize memory that was allocated for the given subsystem (or a
+ *        new allocation if ptr is NULL) - terminates nyx if the
+ *        allocation fails (use xrealloc)
+ */
 void *
-xcalloc1(size_t size)
+nyx_realloc(void *ptr, size_t size, mem_tag_e tag)
+{
+    size_t previous = ptr ? usable_size(ptr) : 0;
+    void *resized = realloc(ptr, size);
+
+    if (resized == NULL)
+        log_critical_perror("nyx: realloc");
+
+    if (ptr == NULL)
+        account(tag, resized);
+    else
+    {
+        __atomic_add_fetch(&usages[tag].bytes,
+                (int64_t)usable_size(resized) - (int64_t)previous, __ATOMIC_RELAXED);
+    }
+
+    return resized;
+}
+
+/**
+ * @brief Release memory that was allocated for the given subsystem
+ *        (use xfree)
+ */
+void
+nyx_free(void *ptr, mem_tag_e tag)
+{
+    if (ptr == NULL)
+        return;
+
+    release(tag, ptr);
+    free(ptr);
+}
+
+/**
+ * @brief Get the allocations of all subsystems
+ * @param usage array of MEM_TAGS entries to fill
+ */
+void
+mem_usage(mem_usage_t *usage)
+{
+    for (uint32_t i = 0; i < MEM_TAGS; i++)
+    {
+        int64_t live = __atomic_load_n(&usages[i].live, __ATOMIC_RELAXED);
+        int64_t bytes = __atomic_load_n(&usages[i].bytes, __ATOMIC_RELAXED);
+
+        usage[i].allocations = __atomic_load_n(&usages[i].allocations, __ATOMIC_RELAXED);
+        usage[i].live = MAX(live, 0);
+        usage[i].bytes = MAX(bytes, 0);
+    }
+}
+
+const char *
+mem_tag_name(mem_tag_e tag)
 {
-    return xcalloc(1, size);
+    return tag_names[tag];
 }
 
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -35,10 +35,76 @@
 #define MIN(a, b) ((a) > (b) ? (b) : (a))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
+#include <stdint.h>
+
+/** subsystems the heap allocations are accounted to */
+typedef enum
+{
+    MEM_OTHER,
+    MEM_CONFIG,
+    MEM_STATE,
+    MEM_HISTORY,
+    MEM_HASH,
+    MEM_PROC,
+    MEM_METRICS,
+    MEM_CONNECTOR,
+    MEM_PLUGINS,
+    MEM_TAGS
+} mem_tag_e;
+
+typedef struct
+{
+    /** allocations since the start */
+    uint64_t allocations;
+    /** allocations that were not freed yet */
+    uint64_t live;
+    /** usable size of the live allocations */
+    uint64_t bytes;
+} mem_usage_t;
+
+/*
+ * The allocations of a source file are accounted to the subsystem that is
+ * defined before any include, e.g.:
+ *
+ *   #define NYX_MEM_TAG MEM_PROC
+ *
+ * Memory that is released via xfree is subtracted from the same subsystem,
+ * so memory of another subsystem has to be released via nyx_free with the
+ * subsystem it was allocated for.
+ */
+#ifndef NYX_MEM_TAG
+#define NYX_MEM_TAG MEM_OTHER
+#endif
+
+#define xcalloc(count, size) nyx_calloc((count), (size), NYX_MEM_TAG)
+#define xcalloc1(size) nyx_calloc(1, (size), NYX_MEM_TAG)
+#define xstrdup(str) nyx_strdup((str), NYX_MEM_TAG)
+#define xrealloc(ptr, size) nyx_realloc((ptr), (size), NYX_MEM_TAG)
+#define xfree(ptr) nyx_free((ptr), NYX_MEM_TAG)
+
 void *
-xcalloc(size_t count, size_t size);
+nyx_calloc(size_t count, size_t size, mem_tag_e tag);
+
+char *
+nyx_strdup(const char *str, mem_tag_e tag);
 
 void *
-xcalloc1(size_t size);
+nyx_realloc(void *ptr, size_t size, mem_tag_e tag);
+
+void
+nyx_free(void *ptr, mem_tag_e tag);
+
+/* release callback (e.g. of hash values) of this file's subsystem */
+static inline void
+xfree_data(void *ptr)
+{
+    nyx_free(ptr, NYX_MEM_TAG);
+}
+
+void
+mem_usage(mem_usage_t *usage);
+
+const char *
+mem_tag_name(mem_tag_e tag);
 
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,709 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_LOG_CATEGORY NYX_LOG_STATE
+#define NYX_MEM_TAG MEM_STATE
+
+#include "def.h"
+#include "engine.h"
+#include "log.h"
+#include "process.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifndef OSX
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#endif
+
+static void
+timespec_now(struct timespec *now)
+{
+    clock_gettime(CLOCK_REALTIME, now);
+}
+
+static bool
+timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    if (a->tv_sec != b->tv_sec)
+        return a->tv_sec < b->tv_sec;
+
+    return a->tv_nsec < b->tv_nsec;
+}
+
+void
+engine_task_delay(engine_task_t *task, uint32_t msecs)
+{
+    struct timespec *deadline = &task->deadline;
+
+    timespec_now(deadline);
+
+    deadline->tv_sec += msecs / 1000;
+    deadline->tv_nsec += (msecs % 1000) * 1000000L;
+
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+bool
+engine_task_expired(engine_task_t *task)
+{
+    struct timespec now;
+
+    timespec_now(&now);
+
+    return !timespec_before(&now, &task->deadline);
+}
+
+/* has to be called with the engine lock being held */
+static void
+push_runnable(engine_t *engine, engine_task_t *task)
+{
+    if (task->queued)
+        return;
+
+    task->queued = true;
+    list_push(engine->runnable, &task->queue_node, task);
+
+    pthread_cond_signal(&engine->wakeup);
+}
+
+/* move all tasks whose deadline is elapsed into the run queue
+ * and return the nearest deadline of the remaining ones
+ *
+ * has to be called with the engine lock being held */
+static struct timespec *
+expire_waiting(engine_t *engine)
+{
+    struct timespec now;
+    struct timespec *nearest = NULL;
+    list_node_t *node = engine->waiting->head;
+
+    timespec_now(&now);
+
+    while (node)
+    {
+        list_node_t *next = node->next;
+        engine_task_t *task = node->data;
+
+        if (!timespec_before(&now, &task->deadline))
+        {
+            task->waiting = false;
+            list_remove(engine->waiting, node);
+            push_runnable(engine, task);
+        }
+        else if (nearest == NULL || timespec_before(&task->deadline, nearest))
+            nearest = &task->deadline;
+
+        node = next;
+    }
+
+    return nearest;
+}
+
+static void *
+engine_worker(void *data)
+{
+    engine_t *engine = data;
+
+    pthread_mutex_lock(&engine->lock);
+
+    while (!engine->stopping)
+    {
+        engine_task_t *task = NULL;
+        struct timespec *nearest = expire_waiting(engine);
+
+        if (!list_pop(engine->runnable, (void **)&task))
+        {
+            if (nearest)
+            {
+                struct timespec until = *nearest;
+                pthread_cond_timedwait(&engine->wakeup, &engine->lock, &until);
+            }
+            else
+                pthread_cond_wait(&engine->wakeup, &engine->lock);
+
+            continue;
+        }
+
+        task->queued = false;
+        task->running = true;
+
+        /* the step itself is executed without holding the lock
+         * so other tasks may be scheduled in the meantime */
+        pthread_mutex_unlock(&engine->lock);
+
+        engine_step_e result = engine->step(task);
+
+        pthread_mutex_lock(&engine->lock);
+
+        task->running = false;
+
+        switch (result)
+        {
+            case ENGINE_DONE:
+                task->finished = true;
+                pthread_cond_broadcast(&engine->idle);
+                break;
+            case ENGINE_WAIT:
+                if (task->rerun)
+                    push_runnable(engine, task);
+                else
+                {
+                    task->waiting = true;
+                    list_push(engine->waiting, &task->queue_node, task);
+                }
+                break;
+            case ENGINE_AGAIN:
+                push_runnable(engine, task);
+                break;
+            case ENGINE_IDLE:
+            default:
+                if (task->rerun)
+                    push_runnable(engine, task);
+                break;
+        }
+
+        task->rerun = false;
+    }
+
+    pthread_mutex_unlock(&engine->lock);
+
+    return NULL;
+}
+
+/* has to be called with the engine lock being held */
+static void
+schedule_locked(engine_t *engine, engine_task_t *task)
+{
+    if (!task->finished)
+    {
+        /* the running worker will pick the task up again
+         * as soon as the current step is done */
+        if (task->running)
+            task->rerun = true;
+        else
+        {
+            if (task->waiting)
+            {
+                task->waiting = false;
+                list_remove(engine->waiting, &task->queue_node);
+            }
+
+            push_runnable(engine, task);
+        }
+    }
+}
+
+/**
+ * @brief Mark the given task as runnable
+ * @param engine engine instance
+ * @param task   task to schedule
+ */
+void
+engine_schedule(engine_t *engine, engine_task_t *task)
+{
+    pthread_mutex_lock(&engine->lock);
+    schedule_locked(engine, task);
+    pthread_mutex_unlock(&engine->lock);
+}
+
+/* has to be called with the engine lock being held */
+static void
+unwatch_locked(engine_t *engine, engine_task_t *task)
+{
+    if (!task->watched)
+        return;
+
+    list_remove(engine->watches, &task->watch_node);
+
+#ifndef OSX
+    /* closing an owned pidfd removes it from the epoll set as well */
+    if (task->watch_exit)
+        close(task->watch_fd);
+    else
+        epoll_ctl(engine->poll_fd, EPOLL_CTL_DEL, task->watch_fd, NULL);
+#else
+    struct kevent change;
+
+    if (task->watch_exit)
+        EV_SET(&change, task->watch_pid, EVFILT_PROC, EV_DELETE, 0, 0, NULL);
+    else
+        EV_SET(&change, task->watch_fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+
+    /* one-shot events are removed already */
+    kevent(engine->poll_fd, &change, 1, NULL, 0, NULL);
+#endif
+
+    task->watch_fd = -1;
+    task->watched = false;
+}
+
+/* the poller receives the events by fd or pid only so we look the
+ * task up in the currently watched ones instead of carrying a task
+ * pointer that might be detached meanwhile
+ *
+ * has to be called with the engine lock being held */
+static void
+watch_signaled(engine_t *engine, int64_t key, bool is_exit)
+{
+    list_node_t *node = engine->watches->head;
+
+    while (node)
+    {
+        engine_task_t *task = node->data;
+
+#ifndef OSX
+        /* pidfds are signaled as readable descriptors as well */
+        bool matches = !is_exit && task->watch_fd == key;
+#else
+        bool matches = task->watch_exit == is_exit &&
+            (is_exit ? task->watch_pid == key : task->watch_fd == key);
+#endif
+
+        if (matches)
+        {
+            task->signaled = true;
+            schedule_locked(engine, task);
+            return;
+        }
+
+        node = node->next;
+    }
+}
+
+static void *
+engine_poller(void *data)
+{
+    engine_t *engine = data;
+
+#ifndef OSX
+    struct epoll_event events[16];
+#else
+    struct kevent events[16];
+#endif
+
+    while (true)
+    {
+#ifndef OSX
+        int32_t n = epoll_wait(engine->poll_fd, events, LEN(events), -1);
+#else
+        int32_t n = kevent(engine->poll_fd, NULL, 0, events, LEN(events), NULL);
+#endif
+
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_perror("nyx: epoll_wait");
+            break;
+        }
+
+        pthread_mutex_lock(&engine->lock);
+
+        if (engine->stopping)
+        {
+            pthread_mutex_unlock(&engine->lock);
+            break;
+        }
+
+        for (int32_t i = 0; i < n; i++)
+        {
+#ifndef OSX
+            watch_signaled(engine, events[i].data.fd, false);
+#else
+            if (events[i].ident != (uintptr_t)engine->poll_pipe[0])
+            {
+                watch_signaled(engine, events[i].ident,
+                        events[i].filter == EVFILT_PROC);
+            }
+#endif
+        }
+
+        pthread_mutex_unlock(&engine->lock);
+    }
+
+    return NULL;
+}
+
+static void
+init_poller(engine_t *engine)
+{
+    engine->poll_fd = -1;
+
+    if (pipe(engine->poll_pipe) == -1)
+    {
+        log_perror("nyx: pipe");
+        return;
+    }
+
+#ifndef OSX
+    engine->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (engine->poll_fd < 0)
+    {
+        log_perror("nyx: epoll_create1");
+        return;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = engine->poll_pipe[0] };
+
+    if (epoll_ctl(engine->poll_fd, EPOLL_CTL_ADD, engine->poll_pipe[0], &ev) == -1)
+        log_perror("nyx: epoll_ctl");
+#else
+    engine->poll_fd = kqueue();
+
+    if (engine->poll_fd < 0)
+    {
+        log_perror("nyx: kqueue");
+        return;
+    }
+
+    struct kevent change;
+
+    EV_SET(&change, engine->poll_pipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+
+    if (kevent(engine->poll_fd, &change, 1, NULL, 0, NULL) == -1)
+        log_perror("nyx: kevent");
+#endif
+
+    engine->poller = xcalloc1(sizeof(pthread_t));
+
+    int32_t err = thread_create(engine->poller, engine_poller, engine);
+
+    if (err)
+    {
+        errno = err;
+        log_perror("nyx: pthread_create");
+
+        xfree(engine->poller);
+        engine->poller = NULL;
+    }
+}
+
+/* has to be called with the engine lock being held */
+static void
+watch_added(engine_t *engine, engine_task_t *task, bool watched)
+{
+    if (watched)
+    {
+        task->watched = true;
+        list_push(engine->watches, &task->watch_node, task);
+    }
+    /* the process is gone already */
+    else if (task->signaled)
+        schedule_locked(engine, task);
+}
+
+/**
+ * @brief Schedule the given task as soon as the process with the
+ *        given pid terminates
+ * @param engine engine instance
+ * @param task   task to schedule
+ * @param pid    process to watch
+ * @return true if the process' termination is watched, false if
+ *         the caller has to poll for the termination instead
+ */
+bool
+engine_watch_exit(engine_t *engine, engine_task_t *task, pid_t pid)
+{
+    bool watched = false;
+
+    if (engine->poller == NULL)
+        return false;
+
+    pthread_mutex_lock(&engine->lock);
+
+    unwatch_locked(engine, task);
+
+    task->signaled = false;
+    task->watch_exit = true;
+    task->watch_pid = pid;
+
+#ifndef OSX
+    int32_t fd = process_exit_fd(pid);
+
+    if (fd >= 0)
+    {
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.fd = fd };
+
+        if (epoll_ctl(engine->poll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            log_perror("nyx: epoll_ctl");
+            close(fd);
+        }
+        else
+        {
+            task->watch_fd = fd;
+            watched = true;
+        }
+    }
+    else if (errno == ESRCH)
+        task->signaled = true;
+#else
+    struct kevent change;
+
+    EV_SET(&change, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, NULL);
+
+    if (kevent(engine->poll_fd, &change, 1, NULL, 0, NULL) == 0)
+        watched = true;
+    else if (errno == ESRCH)
+        task->signaled = true;
+#endif
+
+    watch_added(engine, task, watched);
+
+    pthread_mutex_unlock(&engine->lock);
+
+    return watched || task->signaled;
+}
+
+/**
+ * @brief Schedule the given task as soon as the file descriptor
+ *        becomes readable
+ * @param engine engine instance
+ * @param task   task to schedule
+ * @param fd     file descriptor to watch (owned by the caller)
+ * @return true if the descriptor is watched, false otherwise
+ */
+bool
+engine_watch_fd(engine_t *engine, engine_task_t *task, int32_t fd)
+{
+    bool watched = false;
+
+    if (engine->poller == NULL)
+        return false;
+
+    pthread_mutex_lock(&engine->lock);
+
+    unwatch_locked(engine, task);
+
+    task->signaled = false;
+    task->watch_exit = false;
+    task->watch_fd = fd;
+
+#ifndef OSX
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.fd = fd };
+
+    if (epoll_ctl(engine->poll_fd, EPOLL_CTL_ADD, fd, &ev) == 0)
+        watched = true;
+    else
+        log_perror("nyx: epoll_ctl");
+#else
+    struct kevent change;
+
+    EV_SET(&change, fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, NULL);
+
+    if (kevent(engine->poll_fd, &change, 1, NULL, 0, NULL) == 0)
+        watched = true;
+    else
+        log_perror("nyx: kevent");
+#endif
+
+    watch_added(engine, task, watched);
+
+    pthread_mutex_unlock(&engine->lock);
+
+    return watched;
+}
+
+/**
+ * @brief Stop watching the process or file descriptor of the given task
+ * @param engine engine instance
+ * @param task   task to unwatch
+ */
+void
+engine_unwatch(engine_t *engine, engine_task_t *task)
+{
+    pthread_mutex_lock(&engine->lock);
+    unwatch_locked(engine, task);
+    pthread_mutex_unlock(&engine->lock);
+}
+
+/**
+ * @brief Determine whether the watched process of the given task
+ *        terminated or its file descriptor became readable
+ * @param engine engine instance
+ * @param task   task to check
+ * @return true if the watch was signaled, false otherwise
+ */
+bool
+engine_task_signaled(engine_t *engine, engine_task_t *task)
+{
+    pthread_mutex_lock(&engine->lock);
+    bool signaled = task->signaled;
+    pthread_mutex_unlock(&engine->lock);
+
+    return signaled;
+}
+
+/**
+ * @brief Create a new engine that drives its tasks with a fixed
+ *        number of worker threads
+ * @param num_threads number of worker threads
+ * @param step        step function that is called for runnable tasks
+ * @return new engine instance or NULL if no worker could be started
+ */
+engine_t *
+engine_new(uint32_t num_threads, engine_step_t step)
+{
+    engine_t *engine = xcalloc1(sizeof(engine_t));
+
+    engine->step = step;
+    /* the tasks embed their list nodes so queueing never allocates */
+    engine->runnable = list_new_intrusive(NULL);
+    engine->waiting = list_new_intrusive(NULL);
+    engine->watches = list_new_intrusive(NULL);
+    engine->threads = xcalloc(num_threads, sizeof(pthread_t));
+
+    pthread_mutex_init(&engine->lock, NULL);
+    pthread_cond_init(&engine->wakeup, NULL);
+    pthread_cond_init(&engine->idle, NULL);
+
+    init_poller(engine);
+
+    for (uint32_t i = 0; i < num_threads; i++)
+    {
+        int32_t err = thread_create(&engine->threads[i], engine_worker, engine);
+
+        if (err)
+        {
+            errno = err;
+            log_perror("nyx: pthread_create");
+            break;
+        }
+
+        engine->num_threads++;
+    }
+
+    if (engine->num_threads < 1)
+    {
+        engine_destroy(engine);
+        return NULL;
+    }
+
+    log_debug("Started state engine with %u threads", engine->num_threads);
+
+    return engine;
+}
+
+/**
+ * @brief Wait for the given task to finish and remove it from the engine
+ * @param engine  engine instance
+ * @param task    task to detach
+ * @param timeout maximum number of seconds to wait for
+ * @return true if the task is not referenced by the engine anymore,
+ *         false if it is still running
+ */
+bool
+engine_detach(engine_t *engine, engine_task_t *task, uint32_t timeout)
+{
+    bool detached = false;
+    struct timespec until;
+
+    timespec_now(&until);
+    until.tv_sec += timeout;
+
+    pthread_mutex_lock(&engine->lock);
+
+    while (!task->finished)
+    {
+        if (pthread_cond_timedwait(&engine->idle, &engine->lock, &until) == ETIMEDOUT)
+            break;
+    }
+
+    if (!task->running)
+    {
+        unwatch_locked(engine, task);
+
+        if (task->queued)
+            list_remove(engine->runnable, &task->queue_node);
+
+        if (task->waiting)
+            list_remove(engine->waiting, &task->queue_node);
+
+        task->queued = false;
+        task->waiting = false;
+        task->finished = true;
+
+        detached = true;
+    }
+
+    pthread_mutex_unlock(&engine->lock);
+
+    return detached;
+}
+
+/**
+ * @brief Stop all worker threads and destroy the engine
+ * @param engine engine instance
+ */
+void
+engine_destroy(engine_t *engine)
+{
+    if (engine == NULL)
+        return;
+
+    pthread_mutex_lock(&engine->lock);
+    engine->stopping = true;
+    pthread_cond_broadcast(&engine->wakeup);
+    pthread_mutex_unlock(&engine->lock);
+
+    for (uint32_t i = 0; i < engine->num_threads; i++)
+        pthread_join(engine->threads[i], NULL);
+
+    if (engine->poller)
+    {
+        uint64_t signum = 1;
+
+        if (write(engine->poll_pipe[1], &signum, sizeof(signum)) == -1)
+            log_perror("nyx: write");
+
+        pthread_join(*engine->poller, NULL);
+        xfree(engine->poller);
+    }
+
+    if (engine->poll_fd >= 0)
+        close(engine->poll_fd);
+
+    if (engine->poll_pipe[0] > 0)
+    {
+        close(engine->poll_pipe[0]);
+        close(engine->poll_pipe[1]);
+    }
+
+    pthread_cond_destroy(&engine->idle);
+    pthread_cond_destroy(&engine->wakeup);
+    pthread_mutex_destroy(&engine->lock);
+
+    list_destroy(engine->runnable);
+    list_destroy(engine->waiting);
+    list_destroy(engine->watches);
+
+    xfree(engine->threads);
+    xfree(engine);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
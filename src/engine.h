@@ -0,0 +1,107 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "list.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef enum
+{
+    /* nothing left to do until the task is scheduled again */
+    ENGINE_IDLE,
+    /* the task wants to be run again immediately */
+    ENGINE_AGAIN,
+    /* the task waits for its deadline (or the next schedule) */
+    ENGINE_WAIT,
+    /* the task is finished and must not be run anymore */
+    ENGINE_DONE
+} engine_step_e;
+
+typedef struct engine_task_t
+{
+    bool queued;
+    bool waiting;
+    bool running;
+    bool rerun;
+    bool finished;
+    bool watched;
+    bool watch_exit;
+    bool signaled;
+    int32_t watch_fd;
+    pid_t watch_pid;
+    struct timespec deadline;
+    void *data;
+    /** link in either the run or the wait queue */
+    list_node_t queue_node;
+    /** link in the watched tasks */
+    list_node_t watch_node;
+} engine_task_t;
+
+typedef engine_step_e (*engine_step_t)(engine_task_t *task);
+
+typedef struct
+{
+    bool stopping;
+    uint32_t num_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_cond_t idle;
+    list_t *runnable;
+    list_t *waiting;
+    list_t *watches;
+    engine_step_t step;
+    int32_t poll_fd;
+    int32_t poll_pipe[2];
+    pthread_t *poller;
+} engine_t;
+
+engine_t *
+engine_new(uint32_t num_threads, engine_step_t step);
+
+void
+engine_schedule(engine_t *engine, engine_task_t *task);
+
+bool
+engine_detach(engine_t *engine, engine_task_t *task, uint32_t timeout);
+
+bool
+engine_watch_exit(engine_t *engine, engine_task_t *task, pid_t pid);
+
+bool
+engine_watch_fd(engine_t *engine, engine_task_t *task, int32_t fd);
+
+void
+engine_unwatch(engine_t *engine, engine_task_t *task);
+
+bool
+engine_task_signaled(engine_t *engine, engine_task_t *task);
+
+void
+engine_task_delay(engine_task_t *task, uint32_t msecs);
+
+bool
+engine_task_expired(engine_task_t *task);
+
+void
+engine_destroy(engine_t *engine);
+
+/* vim: set et sw=4 sts=4 tw=80: */
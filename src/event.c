@@ -13,19 +13,34 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+
+#define NYX_LOG_CATEGORY NYX_LOG_EVENT
+#define NYX_MEM_TAG MEM_PROC
+
 #include "def.h"
 #include "event.h"
 #include "log.h"
+#include "pidmap.h"
+#include "reactor.h"
 #include "socket.h"
+#include "stats.h"
+#include "trace.h"
 
 /* we want to include sys/socket.h before linux/netlink.h
  * to avoid some compilation problems with some 2.6 kernels */
 #include <sys/socket.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
 #include <linux/cn_proc.h>
 #include <linux/connector.h>
+#include <linux/filter.h>
 #include <linux/netlink.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,7 +48,46 @@
 
 #define NYX_MAX_EVENTS 16
 
-static volatile bool need_exit = false;
+/* number of datagrams received by one recvmmsg call */
+#define NYX_NETLINK_BATCH 16
+
+/* size of each datagram buffer - a page is what the kernel
+ * will send at most */
+#define NYX_NETLINK_BUFFER_SIZE 4096
+
+/* requested socket receive buffer to absorb fork storms */
+#define NYX_NETLINK_RCVBUF (1024 * 1024)
+
+/* up to this number of pids is filtered by the kernel (two instructions
+ * per pid and BPF_MAXINSNS = 4096) - more pids pass all exit events */
+#define NYX_MAX_FILTER_PIDS 2000
+
+/* state of the event manager running on the nyx reactor */
+typedef struct
+{
+    nyx_t *nyx;
+    int32_t sock;
+    bool subscribed;
+    process_handler_t handler;
+    process_event_data_t *event_data;
+    char *buffers;
+    struct iovec *iovs;
+    struct mmsghdr *msgs;
+} event_manager_t;
+
+static event_manager_t *manager = NULL;
+
+/* the netlink socket's filter is regenerated by whatever thread
+ * modifies the watched pids */
+static pthread_mutex_t filter_lock = PTHREAD_MUTEX_INITIALIZER;
+static int32_t filter_socket = -1;
+static pidmap_t *filtered = NULL;
+
+/* pids that terminated before they were filtered are handed over to
+ * the event loop which is woken up via the wakeup pipe */
+static int32_t filter_wakeup[2] = { -1, -1 };
+static pid_t *pending = NULL;
+static uint32_t num_pending = 0;
 
 /**
  * Open netlink socket connection
@@ -73,6 +127,23 @@ netlink_connect(void)
     return netlink_socket;
 }
 
+/**
+ * Enlarge the socket's receive buffer so bursts of process events
+ * don't overflow it that easily. SO_RCVBUFFORCE ignores the rmem_max
+ * limit but requires CAP_NET_ADMIN.
+ */
+static void
+set_receive_buffer(int32_t sock)
+{
+    int32_t size = NYX_NETLINK_RCVBUF;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) == 0)
+        return;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1)
+        log_perror("nyx: setsockopt");
+}
+
 /**
  * Subscribe on process events
  */
@@ -128,6 +199,333 @@ unsubscribe_event_listen(int32_t sock)
     return set_process_event_listen(sock, false);
 }
 
+/* offsets into a received netlink connector message */
+#define NL_TYPE_OFFSET offsetof(struct nlmsghdr, nlmsg_type)
+#define NL_DATA_OFFSET NLMSG_LENGTH(0)
+#define CN_IDX_OFFSET (NL_DATA_OFFSET + offsetof(struct cn_msg, id.idx))
+#define CN_VAL_OFFSET (NL_DATA_OFFSET + offsetof(struct cn_msg, id.val))
+#define EV_OFFSET (NL_DATA_OFFSET + sizeof(struct cn_msg))
+#define EV_WHAT_OFFSET (EV_OFFSET + offsetof(struct proc_event, what))
+#define EV_PID_OFFSET (EV_OFFSET + offsetof(struct proc_event, event_data.exit.process_pid))
+#define EV_TGID_OFFSET (EV_OFFSET + offsetof(struct proc_event, event_data.exit.process_tgid))
+#define EV_CHILD_PID_OFFSET (EV_OFFSET + offsetof(struct proc_event, event_data.fork.child_pid))
+#define EV_CHILD_TGID_OFFSET (EV_OFFSET + offsetof(struct proc_event, event_data.fork.child_tgid))
+
+#define BPF_ACCEPT BPF_STMT(BPF_RET | BPF_K, 0xffffffff)
+#define BPF_DROP BPF_STMT(BPF_RET | BPF_K, 0)
+
+/* pass the event if the pid at the given offset equals the thread
+ * group id at the other offset (processes, no threads) */
+static struct sock_filter *
+add_process_filter(struct sock_filter *ins, uint32_t pid_offset, uint32_t tgid_offset)
+{
+    *ins++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, tgid_offset);
+    *ins++ = (struct sock_filter)BPF_STMT(BPF_ST, 0);
+    *ins++ = (struct sock_filter)BPF_STMT(BPF_LDX | BPF_W | BPF_MEM, 0);
+    *ins++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, pid_offset);
+    *ins++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 0, 1);
+    *ins++ = (struct sock_filter)BPF_ACCEPT;
+    *ins++ = (struct sock_filter)BPF_DROP;
+
+    return ins;
+}
+
+/**
+ * Build a classic BPF program that passes process exit events of the
+ * given pids only. Messages that are no process connector events at all
+ * are passed as well. If process trees are tracked the fork and exit
+ * events of all processes (but not threads) are passed instead.
+ * BPF loads words in network byte order so all constants are compared
+ * in network byte order, too.
+ */
+static struct sock_filter *
+build_filter(pid_t *pids, uint32_t count, bool trees, uint16_t *length)
+{
+    bool filter_pids = !trees && count <= NYX_MAX_FILTER_PIDS;
+    uint32_t size = 28 + (filter_pids ? count * 2 : 0);
+
+    struct sock_filter *code = xcalloc(size, sizeof(struct sock_filter));
+    struct sock_filter *ins = code;
+
+    /* pass everything that is no process connector message */
+    *ins++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H | BPF_ABS, NL_TYPE_OFFSET);
+    *ins++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htons(NLMSG_DONE), 1, 0);
+    *ins++ = (struct sock_filter)BPF_ACCEPT;
+
+    *ins++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, CN_IDX_OFFSET);
+    *ins++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(CN_IDX_PROC), 1, 0);
+    *ins++ = (struct sock_filter)BPF_ACCEPT;
+
+    *ins++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, CN_VAL_OFFSET);
+    *ins++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(CN_VAL_PROC), 1, 0);
+    *ins++ = (struct sock_filter)BPF_ACCEPT;
+
+    *ins++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, EV_WHAT_OFFSET);
+
+    if (trees)
+    {
+        /* pass the forks of new processes - the jump skips the
+         * following process filter for any other event */
+        *ins++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(PROC_EVENT_FORK), 0, 7);
+        ins = add_process_filter(ins, EV_CHILD_PID_OFFSET, EV_CHILD_TGID_OFFSET);
+    }
+
+    /* drop everything but exit events */
+    *ins++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(PROC_EVENT_EXIT), 1, 0);
+    *ins++ = (struct sock_filter)BPF_DROP;
+
+    if (trees)
+    {
+        /* pass the exit events of all processes */
+        ins = add_process_filter(ins, EV_PID_OFFSET, EV_TGID_OFFSET);
+    }
+    else if (filter_pids)
+    {
+        /* pass exit events of the watched pids only */
+        *ins++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, EV_PID_OFFSET);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            *ins++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(pids[i]), 0, 1);
+            *ins++ = (struct sock_filter)BPF_ACCEPT;
+        }
+
+        *ins++ = (struct sock_filter)BPF_DROP;
+    }
+    else
+        *ins++ = (struct sock_filter)BPF_ACCEPT;
+
+    *length = ins - code;
+
+    return code;
+}
+
+/* the descendants of watches with resource limits are tracked unless
+ * the processes are accounted by their cgroups */
+static bool
+tracks_process_trees(nyx_t *nyx)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    bool trees = false;
+
+    if (nyx->watches == NULL || nyx->options.cgroup)
+        return false;
+
+    hash_iter_t *iter = hash_iter_start(nyx->watches);
+
+    while (!trees && hash_iter(iter, &key, &data))
+        trees = watch_has_limits(data);
+
+    hash_iter_free(iter);
+
+    return trees;
+}
+
+/**
+ * @brief Regenerate the kernel-side filter of the netlink socket
+ *        so it passes the exit events of all watched pids
+ * @param nyx nyx instance
+ */
+void
+event_filter_update(nyx_t *nyx)
+{
+    uint32_t count = 0, capacity = 0;
+    pid_t *pids = NULL;
+
+    if (nyx->pids == NULL)
+        return;
+
+    pthread_mutex_lock(&filter_lock);
+
+    if (filter_socket < 0)
+    {
+        pthread_mutex_unlock(&filter_lock);
+        return;
+    }
+
+    /* the pids might change in the meantime so we retry until
+     * the array is big enough */
+    do
+    {
+        xfree(pids);
+
+        capacity = pidmap_count(nyx->pids) + 16;
+        pids = xcalloc(capacity, sizeof(pid_t));
+        count = pidmap_pids(nyx->pids, pids, capacity);
+    }
+    while (count > capacity);
+
+    uint16_t length = 0;
+    struct sock_filter *code = build_filter(pids, count, tracks_process_trees(nyx), &length);
+    struct sock_fprog program = { .len = length, .filter = code };
+
+    if (setsockopt(filter_socket, SOL_SOCKET, SO_ATTACH_FILTER,
+                &program, sizeof(program)) == -1)
+        log_perror("nyx: setsockopt");
+
+    /* processes that terminated before their pid was added to the
+     * filter won't be reported so we check the new pids right now */
+    pidmap_t *previous = filtered;
+    bool wakeup = false;
+
+    filtered = pidmap_new();
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pidmap_add(filtered, pids[i], filtered);
+
+        if (previous && pidmap_get(previous, pids[i]))
+            continue;
+
+        if (kill(pids[i], 0) == -1 && errno == ESRCH)
+        {
+            pending = xrealloc(pending, (num_pending + 1) * sizeof(pid_t));
+            pending[num_pending++] = pids[i];
+            wakeup = true;
+        }
+    }
+
+    if (previous)
+        pidmap_destroy(previous);
+
+    /* the exit is dispatched by the event loop as the caller
+     * might hold the lock of the very state in question */
+    if (wakeup && write(filter_wakeup[1], "x", 1) == -1 && errno != EAGAIN)
+        log_perror("nyx: write");
+
+    pthread_mutex_unlock(&filter_lock);
+
+    xfree(code);
+    xfree(pids);
+}
+
+static bool
+set_filter_socket(int32_t sock)
+{
+    bool success = true;
+
+    pthread_mutex_lock(&filter_lock);
+
+    filter_socket = sock;
+
+    if (sock >= 0)
+    {
+        if (pipe2(filter_wakeup, O_CLOEXEC | O_NONBLOCK) == -1)
+        {
+            log_perror("nyx: pipe2");
+            filter_socket = -1;
+            success = false;
+        }
+    }
+    else
+    {
+        if (filter_wakeup[0] >= 0)
+        {
+            close(filter_wakeup[0]);
+            close(filter_wakeup[1]);
+            filter_wakeup[0] = filter_wakeup[1] = -1;
+        }
+
+        if (filtered)
+        {
+            pidmap_destroy(filtered);
+            filtered = NULL;
+        }
+
+        xfree(pending);
+        pending = NULL;
+        num_pending = 0;
+    }
+
+    pthread_mutex_unlock(&filter_lock);
+
+    return success;
+}
+
+static void
+dispatch_exit(pid_t pid, nyx_t *nyx, process_handler_t handler,
+        process_event_data_t *event_data)
+{
+    memset(event_data, 0, sizeof(process_event_data_t));
+    event_data->type = EVENT_EXIT;
+    event_data->data.exit.pid = pid;
+    event_data->data.exit.thread_group_id = pid;
+
+    handler(pid, event_data, nyx);
+}
+
+/**
+ * Dispatch the exits of all pids that terminated before
+ * they were added to the socket filter
+ */
+static void
+handle_filter_wakeup(int32_t fd, nyx_t *nyx, process_handler_t handler,
+        process_event_data_t *event_data)
+{
+    char buffer[64];
+
+    while (read(fd, buffer, sizeof(buffer)) > 0)
+        ;
+
+    pthread_mutex_lock(&filter_lock);
+
+    pid_t *pids = pending;
+    uint32_t count = num_pending;
+
+    pending = NULL;
+    num_pending = 0;
+
+    pthread_mutex_unlock(&filter_lock);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        log_debug("Process %d terminated before being filtered", pids[i]);
+
+        dispatch_exit(pids[i], nyx, handler, event_data);
+    }
+
+    xfree(pids);
+}
+
+/**
+ * Check every watched pid for being still alive. This is necessary
+ * whenever the socket's receive buffer overflowed (ENOBUFS) and an
+ * unknown number of process events got lost.
+ */
+static void
+resync_pids(nyx_t *nyx, process_handler_t handler,
+        process_event_data_t *event_data)
+{
+    uint32_t count = 0, capacity = 0;
+    pid_t *pids = NULL;
+
+    if (nyx->pids == NULL)
+        return;
+
+    do
+    {
+        xfree(pids);
+
+        capacity = pidmap_count(nyx->pids) + 16;
+        pids = xcalloc(capacity, sizeof(pid_t));
+        count = pidmap_pids(nyx->pids, pids, capacity);
+    }
+    while (count > capacity);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (kill(pids[i], 0) == -1 && errno == ESRCH)
+        {
+            log_debug("Process %d terminated while events were lost", pids[i]);
+
+            dispatch_exit(pids[i], nyx, handler, event_data);
+        }
+    }
+
+    xfree(pids);
+}
+
 static process_event_data_t *
 new_event_data(void)
 {
@@ -184,193 +582,219 @@ set_event_data(process_event_data_t *data, struct proc_event *event)
     return 0;
 }
 
-static void handle_eventfd(struct epoll_event *event, nyx_t *nyx)
+/**
+ * Dispatch all process events contained in one received datagram
+ */
+static void
+handle_messages(char *buffer, int32_t length, nyx_t *nyx,
+        process_handler_t handler, process_event_data_t *event_data)
 {
-    epoll_extra_data_t *extra = event->data.ptr;
+    struct nlmsghdr *header = (struct nlmsghdr *)(void *)buffer;
 
-    log_debug("Received epoll event on eventfd interface (%d)", nyx->event);
+    for (; NLMSG_OK(header, length); header = NLMSG_NEXT(header, length))
+    {
+        /* the process connector sends single-part messages only */
+        if (header->nlmsg_type != NLMSG_DONE)
+            continue;
+
+        if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(struct proc_event)))
+            continue;
 
-    uint64_t value = 0;
-    int32_t err = read(extra->fd, &value, sizeof(value));
+        struct cn_msg *msg = NLMSG_DATA(header);
 
-    if (err == -1)
-        log_perror("nyx: read");
+        if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC)
+            continue;
 
-    need_exit = true;
+        int32_t pid = set_event_data(event_data,
+                (struct proc_event *)(void *)msg->data);
+
+        if (pid > 0)
+        {
+            NYX_TRACE2(proc__event, pid, event_data->type);
+
+            stats_count(STATS_PROC_EVENTS, 1);
+            handler(pid, event_data, nyx);
+        }
+    }
 }
 
 /**
- * Handle a single process event
+ * Receive all pending datagrams of the netlink socket in batches
+ * of up to NYX_NETLINK_BATCH messages
+ * @return false on socket shutdown or an unrecoverable error
  */
 static bool
-handle_process_event(int32_t nl_sock, nyx_t *nyx, process_handler_t handler)
+receive_events(int32_t sock, struct mmsghdr *msgs, nyx_t *nyx,
+        process_handler_t handler, process_event_data_t *event_data)
 {
-    bool success = false;
+    while (true)
+    {
+        int32_t count = recvmmsg(sock, msgs, NYX_NETLINK_BATCH, MSG_DONTWAIT, NULL);
 
-    struct epoll_event base_ev, fd_ev;
-    struct epoll_event *events = NULL;
+        if (count == -1)
+        {
+            /* everything received or interrupted by a signal */
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return true;
 
-    process_event_data_t *event_data = new_event_data();
+            /* the receive buffer overflowed - we have no idea what
+             * got lost so check all watched processes explicitly */
+            if (errno == ENOBUFS)
+            {
+                log_warn("Process events got lost - resynchronizing watched processes");
+                stats_count(STATS_PROC_EVENTS_LOST, 1);
+                resync_pids(nyx, handler, event_data);
+                continue;
+            }
 
-    struct __attribute__ ((aligned(NLMSG_ALIGNTO)))
-    {
-        struct nlmsghdr nl_hdr;
-        struct __attribute__ ((__packed__))
+            log_perror("nyx: recvmmsg");
+            return false;
+        }
+
+        /* socket shutdown */
+        if (count == 0)
+            return false;
+
+        for (int32_t i = 0; i < count; i++)
         {
-            struct cn_msg cn_msg;
-            struct proc_event proc_ev;
-        } data;
-    } nlcn_msg;
+            handle_messages(msgs[i].msg_hdr.msg_iov->iov_base, msgs[i].msg_len,
+                    nyx, handler, event_data);
+        }
+
+        if (count < NYX_NETLINK_BATCH)
+            break;
+    }
+
+    return true;
+}
 
-    log_debug("Starting event manager loop");
+static void
+handle_netlink(reactor_t *reactor, int32_t fd, UNUSED uint32_t events, void *data)
+{
+    event_manager_t *m = data;
 
-    /* initialize epoll */
-    int32_t epfd = epoll_create(NYX_MAX_EVENTS);
-    if (epfd == -1)
+    if (!receive_events(fd, m->msgs, m->nyx, m->handler, m->event_data))
     {
-        log_perror("nyx: epoll_create");
-        goto teardown;
+        log_error("Event manager: failed to receive process events");
+        reactor_remove_fd(reactor, fd);
     }
+}
+
+static void
+handle_wakeup(UNUSED reactor_t *reactor, int32_t fd, UNUSED uint32_t events, void *data)
+{
+    event_manager_t *m = data;
+
+    handle_filter_wakeup(fd, m->nyx, m->handler, m->event_data);
+}
+
+static event_manager_t *
+event_manager_new(nyx_t *nyx, int32_t sock, process_handler_t handler)
+{
+    event_manager_t *m = xcalloc1(sizeof(event_manager_t));
 
-    if (!unblock_socket(nl_sock))
-        goto teardown;
+    m->nyx = nyx;
+    m->sock = sock;
+    m->handler = handler;
+    m->event_data = new_event_data();
 
-    if (!add_epoll_socket(nl_sock, &base_ev, epfd, 0))
-        goto teardown;
+    /* receive buffers for recvmmsg */
+    m->buffers = xcalloc(NYX_NETLINK_BATCH, NYX_NETLINK_BUFFER_SIZE);
+    m->iovs = xcalloc(NYX_NETLINK_BATCH, sizeof(struct iovec));
+    m->msgs = xcalloc(NYX_NETLINK_BATCH, sizeof(struct mmsghdr));
 
-    /* add eventfd socket to epoll as well */
-    if (nyx->event > 0)
+    for (uint32_t i = 0; i < NYX_NETLINK_BATCH; i++)
     {
-        if (!unblock_socket(nyx->event))
-            goto teardown;
+        m->iovs[i].iov_base = m->buffers + i * NYX_NETLINK_BUFFER_SIZE;
+        m->iovs[i].iov_len = NYX_NETLINK_BUFFER_SIZE;
 
-        if (!add_epoll_socket(nyx->event, &fd_ev, epfd, 0))
-            goto teardown;
+        m->msgs[i].msg_hdr.msg_iov = &m->iovs[i];
+        m->msgs[i].msg_hdr.msg_iovlen = 1;
     }
 
-    events = xcalloc(NYX_MAX_EVENTS, sizeof(struct epoll_event));
+    return m;
+}
 
-    while (!need_exit)
-    {
-        int32_t i = 0;
-        struct epoll_event *event = NULL;
+/**
+ * @brief Start receiving process events of the netlink process
+ *        connector on the nyx reactor
+ * @param nyx     nyx instance
+ * @param handler process event handler
+ * @return true on success, false otherwise
+ */
+bool
+event_init(nyx_t *nyx, process_handler_t handler)
+{
+    /* subscribing to the process connector requires CAP_NET_ADMIN -
+     * without it the subscription succeeds but no event is received */
+    if (geteuid() != 0)
+        return false;
 
-        int32_t n = epoll_wait(epfd, events, NYX_MAX_EVENTS, -1);
+    int32_t sock = netlink_connect();
+    if (sock == -1)
+        return false;
 
-        for (i = 0, event = events; i < n; event++, i++)
-        {
-            epoll_extra_data_t *extra = event->data.ptr;
-            int32_t fd = extra->fd;
+    set_receive_buffer(sock);
 
-            /* handle eventfd */
-            if (fd == nyx->event)
-            {
-                handle_eventfd(event, nyx);
-                success = true;
-            }
-            else
-            {
-                success = true;
-                int32_t rc = recv(fd, &nlcn_msg, sizeof(nlcn_msg), 0);
-
-                /* socket shutdown */
-                if (rc == 0)
-                {
-                    success = true;
-                    break;
-                }
-                else if (rc == -1)
-                {
-                    /* interrupted by a signal */
-                    if (errno == EINTR)
-                    {
-                        success = true;
-                        continue;
-                    }
-
-                    log_perror("nyx: recv");
-                    break;
-                }
-
-                int32_t pid = set_event_data(event_data,
-                        (struct proc_event *)(void *)&(nlcn_msg.data.proc_ev));
-
-                if (pid > 0)
-                    handler(pid, event_data, nyx);
-            }
-        }
-    }
+    manager = event_manager_new(nyx, sock, handler);
 
-teardown:
-    if (event_data != NULL)
-    {
-        free(event_data);
-        event_data = NULL;
-    }
+    /* let the kernel drop all events we are not interested in */
+    if (!set_filter_socket(sock))
+        goto error;
 
-    if (events != NULL)
-    {
-        free(events);
-        events = NULL;
-    }
+    event_filter_update(nyx);
 
-    if (base_ev.data.ptr)
-    {
-        free(base_ev.data.ptr);
-        base_ev.data.ptr = NULL;
-    }
+    if (!unblock_socket(sock))
+        goto error;
 
-    if (nyx->event > 0 && fd_ev.data.ptr)
-    {
-        free(fd_ev.data.ptr);
-        fd_ev.data.ptr = NULL;
-    }
+    if (!reactor_add_fd(nyx->reactor, sock, handle_netlink, manager))
+        goto error;
 
-    if (epfd > 0)
-        close(epfd);
+    if (!reactor_add_fd(nyx->reactor, filter_wakeup[0], handle_wakeup, manager))
+        goto error;
 
-    return success;
-}
+    if (!(manager->subscribed = subscribe_event_listen(sock)))
+        goto error;
 
-static void
-on_terminate(UNUSED int signum)
-{
-    log_debug("Caught termination signal - exiting event manager loop");
+    log_debug("Started event manager");
 
-    /* setting this one won't do the trick until the
-     * blocking receive returns */
-    need_exit = true;
+    return true;
+
+error:
+    event_shutdown(nyx);
+    return false;
 }
 
-bool
-event_loop(nyx_t *nyx, process_handler_t handler)
+/**
+ * @brief Stop receiving process events
+ * @param nyx nyx instance
+ */
+void
+event_shutdown(nyx_t *nyx)
 {
-    /* reset exit state in case this is a restart */
-    need_exit = false;
+    if (manager == NULL)
+        return;
 
-    int32_t sock = netlink_connect();
-    if (sock == -1)
-        return false;
+    reactor_remove_fd(nyx->reactor, manager->sock);
 
-    bool success = subscribe_event_listen(sock);
-    if (!success)
-        goto out;
+    if (filter_wakeup[0] >= 0)
+        reactor_remove_fd(nyx->reactor, filter_wakeup[0]);
 
-    /* register termination handler */
-    setup_signals(nyx, on_terminate);
+    if (manager->subscribed)
+        unsubscribe_event_listen(manager->sock);
 
-    /* start listening on process events */
-    success = handle_process_event(sock, nyx, handler);
-    if (!success)
-        goto out;
+    set_filter_socket(-1);
+    close(manager->sock);
 
-    unsubscribe_event_listen(sock);
+    xfree(manager->msgs);
+    xfree(manager->iovs);
+    xfree(manager->buffers);
+    xfree(manager->event_data);
+    xfree(manager);
 
-out:
-    close(sock);
+    manager = NULL;
 
     log_debug("Event manager: terminated");
-    return success;
 }
 
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -53,6 +53,12 @@ typedef struct process_event_data_t
 typedef bool (*process_handler_t)(pid_t pid, process_event_data_t *event_data, nyx_t *nyx);
 
 bool
-event_loop(nyx_t *nyx, process_handler_t handler);
+event_init(nyx_t *nyx, process_handler_t handler);
+
+void
+event_shutdown(nyx_t *nyx);
+
+void
+event_filter_update(nyx_t *nyx);
 
 /* vim: set et sw=4 sts=4 tw=80: */
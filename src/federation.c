@@ -0,0 +1,707 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_LOG_CATEGORY NYX_LOG_CONNECTOR
+#define NYX_MEM_TAG MEM_CONNECTOR
+
+#include "def.h"
+#include "federation.h"
+#include "log.h"
+#include "state.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* seconds resolved addresses of the upstreams are reused */
+#define FEDERATION_RESOLVE_TTL 60
+
+static int64_t
+timestamp_msecs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void
+drop_oldest(federation_upstream_t *upstream)
+{
+    xfree(upstream->deltas[upstream->head].name);
+    upstream->deltas[upstream->head].name = NULL;
+
+    upstream->head = (upstream->head + 1) % FEDERATION_QUEUE;
+    upstream->count--;
+
+    if (upstream->sent > 0)
+        upstream->sent--;
+}
+
+static void
+clear_deltas(federation_upstream_t *upstream)
+{
+    while (upstream->count > 0)
+        drop_oldest(upstream);
+
+    upstream->sent = 0;
+}
+
+/* has to be called with the lock being held */
+static void
+request_write(federation_upstream_t *upstream)
+{
+    if (!upstream->connected || upstream->writing)
+        return;
+
+    upstream->writing = true;
+    reactor_modify_fd(upstream->owner->reactor, upstream->fd, REACTOR_READ | REACTOR_WRITE);
+}
+
+static void
+upstream_close(federation_upstream_t *upstream)
+{
+    if (upstream->fd < 0)
+        return;
+
+    if (upstream->connected)
+    {
+        log_warn("Lost connection to aggregator '%s:%u'",
+                upstream->endpoint->host, upstream->endpoint->port);
+    }
+
+    reactor_remove_fd(upstream->owner->reactor, upstream->fd);
+    close(upstream->fd);
+
+    upstream->fd = -1;
+    upstream->connecting = false;
+    upstream->connected = false;
+    upstream->writing = false;
+
+    /* the unacknowledged changes are sent again after the next hello */
+    upstream->sent = 0;
+    upstream->output_sent = 0;
+    upstream->input_length = 0;
+    strbuf_clear(upstream->output);
+}
+
+/* format the queued changes that were not sent yet */
+static void
+format_deltas(federation_upstream_t *upstream)
+{
+    while (upstream->sent < upstream->count)
+    {
+        federation_delta_t *delta =
+            &upstream->deltas[(upstream->head + upstream->sent) % FEDERATION_QUEUE];
+
+        strbuf_append(upstream->output, "delta %llu %d %d %lld %s\n",
+                (unsigned long long)delta->seq, delta->state, delta->pid,
+                (long long)delta->timestamp, delta->name);
+
+        upstream->sent++;
+    }
+}
+
+/**
+ * The aggregator continues with the given sequence number if it knows
+ * this node's epoch and did not miss anything before - otherwise it
+ * requests a snapshot.
+ */
+static void
+send_hello(federation_upstream_t *upstream)
+{
+    federation_t *federation = upstream->owner;
+    uint64_t seq = upstream->count > 0
+        ? upstream->deltas[upstream->head].seq
+        : federation->seq + 1;
+
+    strbuf_append(upstream->output, "hello %d %lld %llu %s\n",
+            FEDERATION_VERSION, (long long)federation->epoch,
+            (unsigned long long)seq, federation->node);
+
+    format_deltas(upstream);
+
+    /* the aggregator's metrics might be outdated */
+    federation->metrics_full = true;
+}
+
+/* the queued changes are covered by the snapshot */
+static void
+send_snapshot(federation_upstream_t *upstream)
+{
+    federation_t *federation = upstream->owner;
+    hash_iter_t *iter = hash_iter_start(federation->watches);
+    federation_watch_t *watch = NULL;
+    const char *name = NULL;
+
+    log_debug("Sending snapshot of %u watches to aggregator '%s:%u'",
+            hash_count(federation->watches),
+            upstream->endpoint->host, upstream->endpoint->port);
+
+    clear_deltas(upstream);
+
+    strbuf_append(upstream->output, "snapshot %llu\n",
+            (unsigned long long)federation->seq);
+
+    while (hash_iter(iter, &name, (void **)&watch))
+    {
+        strbuf_append(upstream->output, "watch %d %d %lld %s\n",
+                watch->state, watch->pid, (long long)watch->timestamp, name);
+    }
+
+    strbuf_append(upstream->output, "end\n");
+
+    hash_iter_free(iter);
+
+    federation->metrics_full = true;
+}
+
+static void
+handle_line(federation_upstream_t *upstream, const char *line)
+{
+    unsigned long long seq = 0;
+
+    if (sscanf(line, "ack %llu", &seq) == 1)
+    {
+        while (upstream->count > 0 && upstream->deltas[upstream->head].seq <= seq)
+            drop_oldest(upstream);
+    }
+    else if (!strcmp(line, "resync"))
+    {
+        send_snapshot(upstream);
+        request_write(upstream);
+    }
+    else
+        log_warn("Unknown message of aggregator '%s:%u': %s",
+                upstream->endpoint->host, upstream->endpoint->port, line);
+}
+
+/**
+ * Process the complete lines received from the aggregator.
+ * Returns false if the connection is gone.
+ */
+static bool
+upstream_receive(federation_upstream_t *upstream)
+{
+    while (true)
+    {
+        size_t available = FEDERATION_LINE_MAX - upstream->input_length - 1;
+
+        if (available < 1)
+        {
+            log_warn("Invalid message of aggregator '%s:%u'",
+                    upstream->endpoint->host, upstream->endpoint->port);
+            return false;
+        }
+
+        ssize_t received = recv(upstream->fd,
+                upstream->input + upstream->input_length, available, 0);
+
+        if (received == 0)
+            return false;
+
+        if (received < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        upstream->input_length += received;
+        upstream->input[upstream->input_length] = '\0';
+
+        char *line = upstream->input, *end = NULL;
+
+        while ((end = strchr(line, '\n')) != NULL)
+        {
+            *end = '\0';
+            handle_line(upstream, line);
+            line = end + 1;
+        }
+
+        upstream->input_length -= line - upstream->input;
+        memmove(upstream->input, line, upstream->input_length);
+    }
+}
+
+/**
+ * Send as much of the pending output as the socket accepts.
+ * Returns false if the connection is gone.
+ */
+static bool
+upstream_flush(federation_upstream_t *upstream)
+{
+    strbuf_t *output = upstream->output;
+
+    while (true)
+    {
+        if (upstream->output_sent >= output->length)
+        {
+            upstream->output_sent = 0;
+            strbuf_clear(output);
+
+            format_deltas(upstream);
+
+            if (output->length < 1)
+                break;
+        }
+
+        ssize_t sent = send_safe(upstream->fd, output->buf + upstream->output_sent,
+                output->length - upstream->output_sent);
+
+        if (sent > 0)
+        {
+            upstream->output_sent += sent;
+            continue;
+        }
+
+        if (sent == -1 && errno == EINTR)
+            continue;
+
+        /* the reactor reports when the socket is writable again */
+        if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        return false;
+    }
+
+    /* everything was sent */
+    if (upstream->writing)
+    {
+        upstream->writing = false;
+        reactor_modify_fd(upstream->owner->reactor, upstream->fd, REACTOR_READ);
+    }
+
+    return true;
+}
+
+static bool
+handle_connect(federation_upstream_t *upstream)
+{
+    int32_t so_error = 0;
+    socklen_t len = sizeof(int32_t);
+
+    if (getsockopt(upstream->fd, SOL_SOCKET, SO_ERROR, &so_error, &len) != 0 || so_error != 0)
+    {
+        log_debug("Failed to connect to aggregator '%s:%u': %s",
+                upstream->endpoint->host, upstream->endpoint->port,
+                strerror(so_error));
+
+        /* try the next address on the next attempt */
+        upstream->address++;
+        return false;
+    }
+
+    log_info("Connected to aggregator '%s:%u'",
+            upstream->endpoint->host, upstream->endpoint->port);
+
+    upstream->connecting = false;
+    upstream->connected = true;
+    upstream->writing = true;
+
+    send_hello(upstream);
+
+    reactor_modify_fd(upstream->owner->reactor, upstream->fd, REACTOR_READ | REACTOR_WRITE);
+
+    return true;
+}
+
+static void
+handle_upstream(UNUSED reactor_t *reactor, UNUSED int32_t fd, uint32_t events, void *data)
+{
+    federation_upstream_t *upstream = data;
+    federation_t *federation = upstream->owner;
+    bool alive = true;
+
+    pthread_mutex_lock(&federation->lock);
+
+    if (upstream->connecting)
+        alive = handle_connect(upstream);
+    else
+    {
+        if (alive && (events & REACTOR_READ))
+            alive = upstream_receive(upstream);
+
+        if (alive && (events & REACTOR_HANGUP))
+            alive = false;
+
+        if (alive && upstream->writing)
+            alive = upstream_flush(upstream);
+    }
+
+    if (!alive)
+        upstream_close(upstream);
+
+    pthread_mutex_unlock(&federation->lock);
+}
+
+static void
+upstream_connect(federation_upstream_t *upstream)
+{
+    struct sockaddr_in addresses[RESOLVER_MAX_ADDRESSES];
+    const char *host = upstream->endpoint->host;
+
+    int32_t count = resolver_lookup(upstream->owner->resolver, host,
+            addresses, RESOLVER_MAX_ADDRESSES);
+
+    /* try again on the next attempt */
+    if (count < 1)
+        return;
+
+    if (upstream->address >= count)
+        upstream->address = 0;
+
+    struct sockaddr_in *addr = &addresses[upstream->address];
+    addr->sin_port = htons(upstream->endpoint->port);
+
+    int32_t sock = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (sock == -1)
+    {
+        log_perror("nyx: socket");
+        return;
+    }
+
+    if (unblock_socket(sock) &&
+        (connect(sock, (struct sockaddr *)addr, sizeof(struct sockaddr_in)) == 0 ||
+         errno == EINPROGRESS) &&
+        reactor_add_fd_events(upstream->owner->reactor, sock, REACTOR_WRITE,
+            handle_upstream, upstream))
+    {
+        upstream->fd = sock;
+        upstream->connecting = true;
+        return;
+    }
+
+    close(sock);
+    upstream->address++;
+}
+
+static proc_stat_t *
+find_proc(nyx_proc_t *sys, pid_t pid)
+{
+    list_node_t *node = pid > 0 ? pidmap_get(sys->index, pid) : NULL;
+
+    return node ? node->data : NULL;
+}
+
+/* has to be called with both the lock and the proc system being locked */
+static void
+format_metrics(federation_t *federation, strbuf_t *out)
+{
+    nyx_t *nyx = federation->nyx;
+    bool full = federation->metrics_full;
+
+    for (list_node_t *node = nyx->states->head; node; node = node->next)
+    {
+        state_t *state = node->data;
+        proc_stat_t *proc = find_proc(nyx->proc, state->pid);
+        federation_watch_t *watch = hash_get(federation->watches, state->name);
+
+        /* processes that are not sampled have no summary */
+        if (watch == NULL || proc == NULL || proc->cpu_usage->count < 1)
+            continue;
+
+        int64_t cpu = llround(stack_double_newest(proc->cpu_usage) * 10);
+        int64_t memory = proc->mem_usage->count > 0 ? stack_long_newest(proc->mem_usage) : 0;
+
+        /* only the changed summaries are sent */
+        if (!full && watch->cpu == cpu && watch->memory == memory)
+            continue;
+
+        watch->cpu = cpu;
+        watch->memory = memory;
+
+        strbuf_append(out, "metrics %lld.%lld %lld %s\n",
+                (long long)(cpu / 10), (long long)(cpu % 10),
+                (long long)memory, state->name);
+    }
+}
+
+/* has to be called with the lock being held */
+static void
+send_metrics(federation_t *federation)
+{
+    nyx_t *nyx = federation->nyx;
+    bool connected = false;
+
+    for (uint32_t idx = 0; idx < federation->upstream_count; idx++)
+        connected = connected || federation->upstreams[idx]->connected;
+
+    if (!connected || nyx == NULL || nyx->proc == NULL || nyx->states == NULL)
+        return;
+
+    strbuf_t *out = strbuf_new();
+
+    pthread_mutex_lock(&nyx->proc->lock);
+    format_metrics(federation, out);
+    pthread_mutex_unlock(&nyx->proc->lock);
+
+    federation->metrics_full = false;
+
+    for (uint32_t idx = 0; idx < federation->upstream_count && out->length > 0; idx++)
+    {
+        federation_upstream_t *upstream = federation->upstreams[idx];
+
+        if (!upstream->connected)
+            continue;
+
+        strbuf_append_data(upstream->output, out->buf, out->length);
+        request_write(upstream);
+    }
+
+    strbuf_free(out);
+}
+
+static void
+handle_timer(UNUSED reactor_t *reactor, void *data)
+{
+    federation_t *federation = data;
+
+    pthread_mutex_lock(&federation->lock);
+
+    for (uint32_t idx = 0; idx < federation->upstream_count; idx++)
+    {
+        federation_upstream_t *upstream = federation->upstreams[idx];
+
+        if (upstream->fd < 0 && federation->ticks % FEDERATION_RECONNECT == 0)
+            upstream_connect(upstream);
+    }
+
+    if (++federation->ticks % federation->interval == 0)
+        send_metrics(federation);
+
+    pthread_mutex_unlock(&federation->lock);
+}
+
+static void
+upstream_free(federation_upstream_t *upstream)
+{
+    if (upstream->fd >= 0)
+    {
+        reactor_remove_fd(upstream->owner->reactor, upstream->fd);
+        close(upstream->fd);
+    }
+
+    clear_deltas(upstream);
+    endpoint_free(upstream->endpoint);
+    strbuf_free(upstream->output);
+    xfree(upstream);
+}
+
+/**
+ * @brief Create a new federation pushing the state changes to the
+ *        given aggregators
+ * @param reactor   reactor the connections are processed on
+ * @param upstreams list of aggregators ('host:port')
+ * @param node      name of this node (the hostname if NULL)
+ * @param interval  seconds between the metric summaries
+ * @param nyx       nyx instance the metrics are read from (may be NULL)
+ * @return new federation instance or NULL if there is no valid aggregator
+ */
+federation_t *
+federation_new(reactor_t *reactor, const char **upstreams, const char *node,
+        uint32_t interval, void *nyx)
+{
+    uint32_t count = upstreams ? count_args(upstreams) : 0;
+
+    if (count < 1)
+        return NULL;
+
+    federation_t *federation = xcalloc1(sizeof(federation_t));
+
+    pthread_mutex_init(&federation->lock, NULL);
+
+    federation->reactor = reactor;
+    federation->nyx = nyx;
+    federation->epoch = timestamp_msecs();
+    federation->timer = -1;
+    federation->interval = MAX(interval, 1);
+    federation->watches = hash_new(xfree_data);
+    federation->upstreams = xcalloc(count, sizeof(federation_upstream_t *));
+
+    if (node && *node)
+        federation->node = xstrdup(node);
+    else
+    {
+        char hostname[256] = {0};
+
+        if (gethostname(hostname, sizeof(hostname) - 1) != 0)
+        {
+            log_perror("nyx: gethostname");
+            strcpy(hostname, "localhost");
+        }
+
+        federation->node = xstrdup(hostname);
+    }
+
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        endpoint_t *endpoint = parse_endpoint(upstreams[idx]);
+
+        if (endpoint == NULL)
+        {
+            log_warn("Invalid federation upstream '%s' - expecting 'host:port'",
+                    upstreams[idx]);
+            continue;
+        }
+
+        if (endpoint->host == NULL)
+            endpoint->host = xstrdup("localhost");
+
+        federation_upstream_t *upstream = xcalloc1(sizeof(federation_upstream_t));
+
+        upstream->owner = federation;
+        upstream->endpoint = endpoint;
+        upstream->fd = -1;
+        upstream->output = strbuf_new();
+
+        federation->upstreams[federation->upstream_count++] = upstream;
+    }
+
+    if (federation->upstream_count < 1)
+    {
+        federation_destroy(federation);
+        return NULL;
+    }
+
+    federation->resolver = resolver_new(FEDERATION_RESOLVE_TTL);
+
+    if (reactor)
+    {
+        federation->timer = reactor_add_timer(reactor, 1000, true, handle_timer, federation);
+
+        if (federation->timer < 0)
+        {
+            federation_destroy(federation);
+            return NULL;
+        }
+
+        /* the timer retries the connections that do not succeed right away */
+        for (uint32_t idx = 0; idx < federation->upstream_count; idx++)
+            upstream_connect(federation->upstreams[idx]);
+    }
+
+    log_info("Federating watches of node '%s' to %u aggregator(s)",
+            federation->node, federation->upstream_count);
+
+    return federation;
+}
+
+/**
+ * @brief Push the state change of a watch instance to all aggregators
+ * @param federation federation instance
+ * @param name       name of the watch instance
+ * @param state      new state (STATE_QUIT for a removed watch)
+ * @param pid        pid of the watch's process
+ */
+void
+federation_publish(federation_t *federation, const char *name, int32_t state, pid_t pid)
+{
+    int64_t timestamp = timestamp_msecs();
+
+    pthread_mutex_lock(&federation->lock);
+
+    uint64_t seq = ++federation->seq;
+
+    if (state == STATE_QUIT)
+        hash_remove(federation->watches, name);
+    else
+    {
+        federation_watch_t *watch = hash_get(federation->watches, name);
+
+        if (watch == NULL)
+        {
+            watch = xcalloc1(sizeof(federation_watch_t));
+            hash_add(federation->watches, name, watch);
+        }
+
+        watch->state = state;
+        watch->pid = pid;
+        watch->timestamp = timestamp;
+    }
+
+    for (uint32_t idx = 0; idx < federation->upstream_count; idx++)
+    {
+        federation_upstream_t *upstream = federation->upstreams[idx];
+
+        /* the aggregator notices the gap and requests a snapshot */
+        if (upstream->count >= FEDERATION_QUEUE)
+            drop_oldest(upstream);
+
+        federation_delta_t *delta =
+            &upstream->deltas[(upstream->head + upstream->count) % FEDERATION_QUEUE];
+
+        delta->seq = seq;
+        delta->name = xstrdup(name);
+        delta->state = state;
+        delta->pid = pid;
+        delta->timestamp = timestamp;
+
+        upstream->count++;
+
+        request_write(upstream);
+    }
+
+    pthread_mutex_unlock(&federation->lock);
+}
+
+/**
+ * @brief Tell the aggregators that the given watch instance was removed
+ * @param federation federation instance
+ * @param name       name of the removed watch instance
+ */
+void
+federation_remove(federation_t *federation, const char *name)
+{
+    federation_publish(federation, name, STATE_QUIT, 0);
+}
+
+/**
+ * @brief Close all connections and destroy the federation
+ * @param federation federation instance to destroy
+ */
+void
+federation_destroy(federation_t *federation)
+{
+    if (federation == NULL)
+        return;
+
+    if (federation->reactor && federation->timer >= 0)
+        reactor_remove_timer(federation->reactor, federation->timer);
+
+    for (uint32_t idx = 0; idx < federation->upstream_count; idx++)
+        upstream_free(federation->upstreams[idx]);
+
+    if (federation->resolver)
+        resolver_destroy(federation->resolver);
+
+    hash_destroy(federation->watches);
+    pthread_mutex_destroy(&federation->lock);
+
+    xfree(federation->upstreams);
+    xfree(federation->node);
+    xfree(federation);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,137 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "hash.h"
+#include "reactor.h"
+#include "resolver.h"
+#include "socket.h"
+#include "strbuf.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* version of the line protocol between nodes and aggregators */
+#define FEDERATION_VERSION 1
+
+/* maximum number of unacknowledged state changes per upstream */
+#define FEDERATION_QUEUE 1024
+
+/* maximum length of a single protocol line */
+#define FEDERATION_LINE_MAX 1024
+
+/* seconds between two connection attempts to an upstream */
+#define FEDERATION_RECONNECT 2
+
+/** state change of a watch instance */
+typedef struct
+{
+    uint64_t seq;
+    char *name;
+    int32_t state;
+    pid_t pid;
+    int64_t timestamp;
+} federation_delta_t;
+
+/** latest known state of a watch instance */
+typedef struct
+{
+    int32_t state;
+    pid_t pid;
+    int64_t timestamp;
+    /* metric summary that was sent last (cpu in tenths of a percent) */
+    int64_t cpu;
+    int64_t memory;
+} federation_watch_t;
+
+typedef struct federation_t federation_t;
+
+/** aggregator the state changes are pushed to */
+typedef struct
+{
+    federation_t *owner;
+    endpoint_t *endpoint;
+    int32_t fd;
+    /** index of the resolved address that is tried next */
+    int32_t address;
+    bool connecting;
+    bool connected;
+    /** the reactor waits for the socket to become writable */
+    bool writing;
+
+    /* ring buffer of the state changes that were not acknowledged yet */
+    federation_delta_t deltas[FEDERATION_QUEUE];
+    uint32_t head;
+    uint32_t count;
+    /** number of the queued changes (from the head) that were sent */
+    uint32_t sent;
+
+    /* formatted output that was not sent completely */
+    strbuf_t *output;
+    size_t output_sent;
+
+    /* incomplete line received from the aggregator */
+    char input[FEDERATION_LINE_MAX];
+    size_t input_length;
+} federation_upstream_t;
+
+/**
+ * Push of the watches' state changes and periodic metric summaries to
+ * upstream aggregators. Every change is numbered and kept until the
+ * aggregator acknowledged it so a reconnect only resends the missing
+ * changes - the full state is sent only if the aggregator asks for it
+ * after a gap.
+ */
+struct federation_t
+{
+    pthread_mutex_t lock;
+    reactor_t *reactor;
+    /** nyx instance the metrics are read from */
+    void *nyx;
+    char *node;
+    /** start time (in msec) that tells restarts of this node apart */
+    int64_t epoch;
+    /** sequence number of the latest state change */
+    uint64_t seq;
+    /** latest state of every watch instance */
+    hash_t *watches;
+    federation_upstream_t **upstreams;
+    uint32_t upstream_count;
+    resolver_t *resolver;
+    int32_t timer;
+    /** seconds between the metric summaries */
+    uint32_t interval;
+    uint32_t ticks;
+    /** the next summary contains all metrics (not only the changed ones) */
+    bool metrics_full;
+};
+
+federation_t *
+federation_new(reactor_t *reactor, const char **upstreams, const char *node,
+        uint32_t interval, void *nyx);
+
+void
+federation_publish(federation_t *federation, const char *name, int32_t state, pid_t pid);
+
+void
+federation_remove(federation_t *federation, const char *name);
+
+void
+federation_destroy(federation_t *federation);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,648 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_LOG_CATEGORY NYX_LOG_CONNECTOR
+#define NYX_MEM_TAG MEM_CONNECTOR
+
+#include "def.h"
+#include "fleet.h"
+#include "http.h"
+#include "log.h"
+#include "socket.h"
+#include "state.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void
+node_free(void *data)
+{
+    fleet_node_t *node = data;
+
+    hash_destroy(node->watches);
+    xfree(node->name);
+    xfree(node);
+}
+
+/**
+ * @brief Create a new (empty) fleet
+ * @param reactor     reactor the nodes' connections are processed on
+ * @param subscribers subscribers the state changes are published to
+ *                    (may be NULL)
+ * @return new fleet instance
+ */
+fleet_t *
+fleet_new(reactor_t *reactor, subscribers_t *subscribers)
+{
+    fleet_t *fleet = xcalloc1(sizeof(fleet_t));
+
+    pthread_mutex_init(&fleet->lock, NULL);
+
+    fleet->reactor = reactor;
+    fleet->fd = -1;
+    fleet->subscribers = subscribers;
+    fleet->nodes = hash_new(node_free);
+    fleet->peers = list_new(NULL);
+
+    return fleet;
+}
+
+static void
+publish(fleet_t *fleet, fleet_node_t *node, const char *watch,
+        int32_t from, int32_t to, pid_t pid)
+{
+    if (fleet->subscribers == NULL)
+        return;
+
+    char name[FEDERATION_LINE_MAX];
+
+    /* the watches of a node are subscribed to by the node's name */
+    snprintf(name, sizeof(name), "%s/%s", node->name, watch);
+
+    subscribers_publish(fleet->subscribers, name, node->name, from, to, pid);
+}
+
+static void
+update_watch(fleet_t *fleet, fleet_node_t *node, const char *name,
+        int32_t state, pid_t pid, int64_t timestamp)
+{
+    fleet_watch_t *watch = hash_get(node->watches, name);
+
+    /* the watch was removed from the node */
+    if (state == STATE_QUIT)
+    {
+        if (watch != NULL)
+        {
+            publish(fleet, node, name, watch->state, STATE_QUIT, 0);
+            hash_remove(node->watches, name);
+        }
+        return;
+    }
+
+    if (state < 0 || state >= STATE_SIZE)
+        return;
+
+    int32_t from = STATE_INIT;
+
+    if (watch == NULL)
+    {
+        watch = xcalloc1(sizeof(fleet_watch_t));
+        hash_add(node->watches, name, watch);
+    }
+    else
+        from = watch->state;
+
+    watch->state = state;
+    watch->pid = pid;
+    watch->timestamp = timestamp;
+    watch->stale = false;
+
+    if (from != state)
+        publish(fleet, node, name, from, state, pid);
+}
+
+static void
+request_resync(fleet_node_t *node, fleet_peer_t *peer)
+{
+    node->synced = false;
+    node->receiving = false;
+
+    strbuf_append(peer->output, "resync\n");
+}
+
+static fleet_node_t *
+handle_hello(fleet_t *fleet, fleet_peer_t *peer, const char *line)
+{
+    int32_t version = 0, offset = 0;
+    long long epoch = 0;
+    unsigned long long seq = 0;
+
+    if (sscanf(line, "hello %d %lld %llu %n", &version, &epoch, &seq, &offset) != 3 ||
+            offset < 1 || line[offset] == '\0' || strchr(line + offset, '/'))
+    {
+        log_warn("Invalid federation hello: %s", line);
+        return NULL;
+    }
+
+    if (version != FEDERATION_VERSION)
+    {
+        log_warn("Unsupported federation protocol version %d", version);
+        return NULL;
+    }
+
+    const char *name = line + offset;
+    fleet_node_t *node = hash_get(fleet->nodes, name);
+
+    if (node == NULL)
+    {
+        node = xcalloc1(sizeof(fleet_node_t));
+        node->name = xstrdup(name);
+        node->watches = hash_new(xfree_data);
+
+        hash_add(fleet->nodes, name, node);
+    }
+
+    /* a reconnected node replaces its previous connection */
+    if (node->peer && node->peer != peer)
+        node->peer->node = NULL;
+
+    node->peer = peer;
+    peer->node = node;
+    peer->acked = UINT64_MAX;
+
+    log_info("Node '%s' connected (sequence %llu)", name, seq);
+
+    /* continue where the node left off unless anything is missing */
+    if (node->synced && node->epoch == epoch && seq <= node->seq + 1)
+        return node;
+
+    node->epoch = epoch;
+    request_resync(node, peer);
+
+    return node;
+}
+
+static void
+handle_delta(fleet_t *fleet, fleet_node_t *node, fleet_peer_t *peer, const char *line)
+{
+    int32_t state = 0, pid = 0, offset = 0;
+    long long timestamp = 0;
+    unsigned long long seq = 0;
+
+    if (sscanf(line, "delta %llu %d %d %lld %n", &seq, &state, &pid, &timestamp, &offset) != 4 ||
+            offset < 1 || line[offset] == '\0')
+    {
+        log_warn("Invalid federation delta of node '%s': %s", node->name, line);
+        return;
+    }
+
+    /* the changes are covered by the snapshot that was requested */
+    if (!node->synced || node->receiving)
+        return;
+
+    /* resent after a reconnect */
+    if (seq <= node->seq)
+        return;
+
+    if (seq > node->seq + 1)
+    {
+        log_warn("Missed %llu state changes of node '%s' - requesting a snapshot",
+                seq - node->seq - 1, node->name);
+
+        request_resync(node, peer);
+        return;
+    }
+
+    node->seq = seq;
+    update_watch(fleet, node, line + offset, state, pid, timestamp);
+}
+
+static void
+handle_watch(fleet_t *fleet, fleet_node_t *node, const char *line)
+{
+    int32_t state = 0, pid = 0, offset = 0;
+    long long timestamp = 0;
+
+    if (!node->receiving)
+        return;
+
+    if (sscanf(line, "watch %d %d %lld %n", &state, &pid, &timestamp, &offset) != 3 ||
+            offset < 1 || line[offset] == '\0')
+    {
+        log_warn("Invalid federation watch of node '%s': %s", node->name, line);
+        return;
+    }
+
+    update_watch(fleet, node, line + offset, state, pid, timestamp);
+}
+
+static void
+start_snapshot(fleet_node_t *node, uint64_t seq)
+{
+    hash_iter_t *iter = hash_iter_start(node->watches);
+    fleet_watch_t *watch = NULL;
+    const char *name = NULL;
+
+    while (hash_iter(iter, &name, (void **)&watch))
+        watch->stale = true;
+
+    hash_iter_free(iter);
+
+    node->receiving = true;
+    node->snapshot_seq = seq;
+}
+
+/* the watches that are not part of the snapshot are gone */
+static void
+finish_snapshot(fleet_t *fleet, fleet_node_t *node)
+{
+    fleet_watch_t *watch = NULL;
+    const char *name = NULL;
+
+    if (!node->receiving)
+        return;
+
+    hash_iter_t *iter = hash_iter_start(node->watches);
+
+    while (hash_iter(iter, &name, (void **)&watch))
+    {
+        if (watch->stale)
+            update_watch(fleet, node, name, STATE_QUIT, 0, 0);
+    }
+
+    hash_iter_free(iter);
+
+    node->receiving = false;
+    node->synced = true;
+    node->seq = node->snapshot_seq;
+
+    log_debug("Received snapshot of %u watches of node '%s' (sequence %llu)",
+            hash_count(node->watches), node->name, (unsigned long long)node->seq);
+}
+
+static void
+handle_metrics(fleet_node_t *node, const char *line)
+{
+    int32_t offset = 0;
+    double cpu = 0.0;
+    long long memory = 0;
+
+    if (sscanf(line, "metrics %lf %lld %n", &cpu, &memory, &offset) != 2 ||
+            offset < 1 || line[offset] == '\0')
+    {
+        log_warn("Invalid federation metrics of node '%s': %s", node->name, line);
+        return;
+    }
+
+    fleet_watch_t *watch = hash_get(node->watches, line + offset);
+
+    if (watch == NULL)
+        return;
+
+    watch->cpu = cpu;
+    watch->memory = memory;
+    watch->has_metrics = true;
+}
+
+/* returns false if the connection should be closed */
+static bool
+handle_line(fleet_t *fleet, fleet_peer_t *peer, const char *line)
+{
+    unsigned long long seq = 0;
+    fleet_node_t *node = peer->node;
+
+    if (!strncmp(line, "hello ", 6))
+        return handle_hello(fleet, peer, line) != NULL;
+
+    /* everything else requires the node to introduce itself first */
+    if (node == NULL)
+    {
+        log_warn("Federation message without hello: %s", line);
+        return false;
+    }
+
+    node->last_seen = time(NULL);
+
+    if (!strncmp(line, "delta ", 6))
+        handle_delta(fleet, node, peer, line);
+    else if (!strncmp(line, "metrics ", 8))
+        handle_metrics(node, line);
+    else if (!strncmp(line, "watch ", 6))
+        handle_watch(fleet, node, line);
+    else if (sscanf(line, "snapshot %llu", &seq) == 1)
+        start_snapshot(node, seq);
+    else if (!strcmp(line, "end"))
+        finish_snapshot(fleet, node);
+    else
+        log_warn("Unknown federation message of node '%s': %s", node->name, line);
+
+    return true;
+}
+
+/**
+ * @brief Process the data received from a node and queue the replies
+ *        in the peer's output
+ * @param fleet  fleet instance
+ * @param peer   connection the data was received on
+ * @param data   received data (any number of lines, the last one may be
+ *               incomplete)
+ * @param length length of the data
+ * @return false if the connection should be closed, true otherwise
+ */
+bool
+fleet_receive(fleet_t *fleet, fleet_peer_t *peer, const char *data, size_t length)
+{
+    bool alive = true;
+
+    pthread_mutex_lock(&fleet->lock);
+
+    while (alive && length > 0)
+    {
+        size_t chunk = MIN(length, FEDERATION_LINE_MAX - peer->input_length - 1);
+
+        if (chunk < 1)
+        {
+            log_warn("Federation message exceeds %d bytes", FEDERATION_LINE_MAX);
+            alive = false;
+            break;
+        }
+
+        memcpy(peer->input + peer->input_length, data, chunk);
+        peer->input_length += chunk;
+        peer->input[peer->input_length] = '\0';
+
+        data += chunk;
+        length -= chunk;
+
+        char *line = peer->input, *end = NULL;
+
+        while (alive && (end = strchr(line, '\n')) != NULL)
+        {
+            *end = '\0';
+            alive = handle_line(fleet, peer, line);
+            line = end + 1;
+        }
+
+        peer->input_length -= line - peer->input;
+        memmove(peer->input, line, peer->input_length);
+    }
+
+    /* one acknowledgement covers all changes applied so far */
+    fleet_node_t *node = peer->node;
+
+    if (alive && node && node->synced && !node->receiving &&
+            peer->acked != node->seq)
+    {
+        strbuf_append(peer->output, "ack %llu\n", (unsigned long long)node->seq);
+        peer->acked = node->seq;
+    }
+
+    pthread_mutex_unlock(&fleet->lock);
+
+    return alive;
+}
+
+/* has to be called with the lock being held */
+static void
+peer_remove(fleet_peer_t *peer)
+{
+    fleet_t *fleet = peer->owner;
+    list_node_t *node = fleet->peers->head;
+
+    while (node)
+    {
+        if (node->data == peer)
+        {
+            list_remove(fleet->peers, node);
+            break;
+        }
+
+        node = node->next;
+    }
+
+    if (peer->node)
+    {
+        log_info("Node '%s' disconnected", peer->node->name);
+        peer->node->peer = NULL;
+    }
+
+    reactor_remove_fd(fleet->reactor, peer->fd);
+    close(peer->fd);
+
+    strbuf_free(peer->output);
+    xfree(peer);
+}
+
+/**
+ * Send as much of the replies as the socket accepts.
+ * Returns false if the peer is gone.
+ */
+static bool
+peer_flush(fleet_peer_t *peer)
+{
+    strbuf_t *output = peer->output;
+
+    while (peer->output_sent < output->length)
+    {
+        ssize_t sent = send_safe(peer->fd, output->buf + peer->output_sent,
+                output->length - peer->output_sent);
+
+        if (sent > 0)
+        {
+            peer->output_sent += sent;
+            continue;
+        }
+
+        if (sent == -1 && errno == EINTR)
+            continue;
+
+        if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (!peer->writing)
+            {
+                peer->writing = true;
+                reactor_modify_fd(peer->owner->reactor, peer->fd, REACTOR_READ | REACTOR_WRITE);
+            }
+            return true;
+        }
+
+        return false;
+    }
+
+    peer->output_sent = 0;
+    strbuf_clear(output);
+
+    if (peer->writing)
+    {
+        peer->writing = false;
+        reactor_modify_fd(peer->owner->reactor, peer->fd, REACTOR_READ);
+    }
+
+    return true;
+}
+
+static void
+handle_peer(UNUSED reactor_t *reactor, UNUSED int32_t fd, uint32_t events, void *data)
+{
+    fleet_peer_t *peer = data;
+    fleet_t *fleet = peer->owner;
+    bool alive = true;
+
+    while (alive && (events & REACTOR_READ))
+    {
+        char buffer[4096];
+        ssize_t received = recv(peer->fd, buffer, sizeof(buffer), 0);
+
+        if (received > 0)
+            alive = fleet_receive(fleet, peer, buffer, received);
+        else if (received == -1 && errno == EINTR)
+            continue;
+        else
+        {
+            alive = received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            break;
+        }
+    }
+
+    if (alive && (events & REACTOR_HANGUP) && !(events & REACTOR_READ))
+        alive = false;
+
+    pthread_mutex_lock(&fleet->lock);
+
+    if (alive)
+        alive = peer_flush(peer);
+
+    if (!alive)
+        peer_remove(peer);
+
+    pthread_mutex_unlock(&fleet->lock);
+}
+
+static void
+handle_accept(reactor_t *reactor, int32_t fd, UNUSED uint32_t events, void *data)
+{
+    fleet_t *fleet = data;
+    int32_t client = accept(fd, NULL, NULL);
+
+    if (client == -1)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            log_perror("nyx: accept");
+        return;
+    }
+
+    if (!unblock_socket(client))
+    {
+        close(client);
+        return;
+    }
+
+    fleet_peer_t *peer = xcalloc1(sizeof(fleet_peer_t));
+
+    peer->fd = client;
+    peer->owner = fleet;
+    peer->output = strbuf_new_size(256);
+
+    pthread_mutex_lock(&fleet->lock);
+
+    if (!reactor_add_fd(reactor, client, handle_peer, peer))
+    {
+        pthread_mutex_unlock(&fleet->lock);
+
+        close(client);
+        strbuf_free(peer->output);
+        xfree(peer);
+        return;
+    }
+
+    list_add(fleet->peers, peer);
+
+    pthread_mutex_unlock(&fleet->lock);
+}
+
+/**
+ * @brief Accept the connections of federated nodes on the given port
+ * @param fleet fleet instance
+ * @param port  TCP port to listen on
+ * @return true on success, false otherwise
+ */
+bool
+fleet_listen(fleet_t *fleet, uint32_t port)
+{
+    int32_t sock = http_init(port);
+
+    if (!sock)
+        return false;
+
+    if (!unblock_socket(sock) || !reactor_add_fd(fleet->reactor, sock, handle_accept, fleet))
+    {
+        close(sock);
+        return false;
+    }
+
+    fleet->fd = sock;
+
+    return true;
+}
+
+/**
+ * @brief Determine whether the given name is a node or a watch instance
+ *        of a node ('node/watch')
+ * @param fleet fleet instance
+ * @param name  name to look up
+ * @return true if the node or watch is known
+ */
+bool
+fleet_contains(fleet_t *fleet, const char *name)
+{
+    bool found = false;
+    const char *separator = strchr(name, '/');
+
+    pthread_mutex_lock(&fleet->lock);
+
+    if (separator == NULL)
+        found = hash_get(fleet->nodes, name) != NULL;
+    else
+    {
+        char *node_name = strndup(name, separator - name);
+        fleet_node_t *node = node_name ? hash_get(fleet->nodes, node_name) : NULL;
+
+        found = node && hash_get(node->watches, separator + 1) != NULL;
+
+        free(node_name);
+    }
+
+    pthread_mutex_unlock(&fleet->lock);
+
+    return found;
+}
+
+/**
+ * @brief Close all connections and destroy the fleet
+ * @param fleet fleet instance to destroy
+ */
+void
+fleet_destroy(fleet_t *fleet)
+{
+    if (fleet == NULL)
+        return;
+
+    pthread_mutex_lock(&fleet->lock);
+
+    while (fleet->peers->head)
+        peer_remove(fleet->peers->head->data);
+
+    pthread_mutex_unlock(&fleet->lock);
+
+    if (fleet->fd >= 0)
+    {
+        reactor_remove_fd(fleet->reactor, fleet->fd);
+        close(fleet->fd);
+    }
+
+    list_destroy(fleet->peers);
+    hash_destroy(fleet->nodes);
+    pthread_mutex_destroy(&fleet->lock);
+
+    xfree(fleet);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
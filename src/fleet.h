@@ -0,0 +1,122 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "federation.h"
+#include "hash.h"
+#include "list.h"
+#include "reactor.h"
+#include "strbuf.h"
+#include "subscribe.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+/** latest state of a watch instance of a node */
+typedef struct
+{
+    int32_t state;
+    pid_t pid;
+    int64_t timestamp;
+    double cpu;
+    /** resident memory (in KB) */
+    int64_t memory;
+    bool has_metrics;
+    /** not contained in the snapshot that is being received */
+    bool stale;
+} fleet_watch_t;
+
+typedef struct fleet_peer_t fleet_peer_t;
+
+/** node that federates its watches to this aggregator */
+typedef struct
+{
+    char *name;
+    /** start time of the node (a new one requires a snapshot) */
+    int64_t epoch;
+    /** sequence number of the latest applied state change */
+    uint64_t seq;
+    /** all state changes up to 'seq' were applied */
+    bool synced;
+    /** a snapshot is being received */
+    bool receiving;
+    uint64_t snapshot_seq;
+    /** connection of the node (NULL if disconnected) */
+    fleet_peer_t *peer;
+    /** time the node sent anything last */
+    time_t last_seen;
+    hash_t *watches;
+} fleet_node_t;
+
+typedef struct fleet_t fleet_t;
+
+/** connection of a node */
+struct fleet_peer_t
+{
+    int32_t fd;
+    fleet_t *owner;
+    /** node the peer introduced itself as (NULL before its hello) */
+    fleet_node_t *node;
+    /** sequence number that was acknowledged last (UINT64_MAX if none) */
+    uint64_t acked;
+
+    /* incomplete line received from the node */
+    char input[FEDERATION_LINE_MAX];
+    size_t input_length;
+
+    /* replies that were not sent completely */
+    strbuf_t *output;
+    size_t output_sent;
+    bool writing;
+};
+
+/**
+ * Aggregator of the watches of federated nodes. The merged state is kept
+ * in memory only and rebuilt from a snapshot of a node whenever the
+ * sequence of its state changes has a gap (i.e. after a restart of either
+ * side or a dropped change).
+ */
+struct fleet_t
+{
+    pthread_mutex_t lock;
+    reactor_t *reactor;
+    int32_t fd;
+    /** clients the state changes of the nodes' watches are published to */
+    subscribers_t *subscribers;
+    /** nodes by name */
+    hash_t *nodes;
+    list_t *peers;
+};
+
+fleet_t *
+fleet_new(reactor_t *reactor, subscribers_t *subscribers);
+
+bool
+fleet_listen(fleet_t *fleet, uint32_t port);
+
+bool
+fleet_receive(fleet_t *fleet, fleet_peer_t *peer, const char *data, size_t length);
+
+bool
+fleet_contains(fleet_t *fleet, const char *name);
+
+void
+fleet_destroy(fleet_t *fleet);
+
+/* vim: set et sw=4 sts=4 tw=80: */
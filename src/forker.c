@@ -15,28 +15,94 @@
 
 #define _GNU_SOURCE
 
+#define NYX_LOG_CATEGORY NYX_LOG_FORKER
+
+#include "capture.h"
+#include "cgroup.h"
+#include "check.h"
 #include "config.h"
 #include "def.h"
 #include "forker.h"
 #include "fs.h"
+#include "listen.h"
 #include "log.h"
 #include "process.h"
+#include "state.h"
+#include "stats.h"
+#include "trace.h"
+#include "utils.h"
 #include "watch.h"
 
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifndef OSX
+#include <sys/syscall.h>
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+#endif
+
+/* posix_spawn supports all required file actions as of glibc 2.34 */
+#if !defined(OSX) && defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 34)
+#define HAS_FAST_SPAWN
+#include <spawn.h>
+#endif
+#endif
+
+extern char **environ;
+
+/* output of the spawned processes that is captured by the forker */
+static capture_t *capture = NULL;
+
+/** check command running in the forker */
+typedef struct
+{
+    pid_t pid;
+    int32_t id;
+    uint32_t instance;
+    uint32_t seq;
+    /** monotonic deadline in milliseconds */
+    uint64_t deadline;
+    bool killed;
+} exec_check_t;
+
+/* check commands of the forker that did not exit yet */
+static exec_check_t *exec_checks = NULL;
+static uint32_t exec_checks_count = 0;
+static uint32_t exec_checks_size = 0;
+
+/** check waiting for its result from the forker */
+typedef struct
+{
+    uint32_t seq;
+    int32_t result_fd;
+} pending_check_t;
+
+/* checks of the nyx process whose result was not received yet */
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static pending_check_t *pending_checks = NULL;
+static uint32_t pending_count = 0;
+static uint32_t pending_size = 0;
+
 static watch_t *
 find_watch(nyx_t *nyx, int32_t id)
 {
@@ -54,50 +120,101 @@ find_watch(nyx_t *nyx, int32_t id)
 
         if (watch && watch->id == id)
         {
-            free(iter);
+            hash_iter_free(iter);
             return watch;
         }
     }
 
-    free(iter);
+    hash_iter_free(iter);
     return NULL;
 }
 
+static bool
+close_fd_range(uint32_t first, uint32_t last, uint32_t flags)
+{
+#if !defined(OSX) && defined(SYS_close_range)
+    return syscall(SYS_close_range, first, last, flags) == 0;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+static bool
+pipe_cloexec(int32_t *pipes)
+{
+#ifndef OSX
+    return pipe2(pipes, O_CLOEXEC) == 0;
+#else
+    if (pipe(pipes) == -1)
+        return false;
+
+    if (fcntl(pipes[0], F_SETFD, FD_CLOEXEC) == -1 ||
+        fcntl(pipes[1], F_SETFD, FD_CLOEXEC) == -1)
+        log_perror("nyx: fcntl");
+
+    return true;
+#endif
+}
+
+/**
+ * Mark all descriptors the forker inherited from nyx close-on-exec so
+ * the spawned processes won't leak any of them.
+ */
 static void
-set_environment(const watch_t *watch)
+mark_fds_cloexec(void)
 {
-    const char *key = NULL;
-    void *data = NULL;
+    /* linux >= 5.11 */
+    if (close_fd_range(3, ~0U, CLOSE_RANGE_CLOEXEC))
+        return;
 
-    if (watch->env == NULL || hash_count(watch->env) < 1)
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == NULL)
         return;
 
-    hash_iter_t *iter = hash_iter_start(watch->env);
+    int32_t dir_fd = dirfd(dir);
 
-    while (hash_iter(iter, &key, &data))
+    struct dirent *entry = NULL;
+    while ((entry = readdir(dir)) != NULL)
     {
-        char *value = data;
+        int32_t fd = atoi(entry->d_name);
 
-        setenv(key, value, 1);
+        if (fd >= 3 && fd != dir_fd)
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
     }
 
-    free(iter);
+    closedir(dir);
 }
 
-static void
-set_magic_pid(pid_t pid)
+static bool
+close_fds_fast(int32_t first_fd, int32_t keep_fd)
 {
-    char str[32] = {0};
-    snprintf(str, LEN(str)-1, "%d", pid);
+    /* the descriptor to keep is close-on-exec already so we can mark
+     * all the other ones close-on-exec as well (linux >= 5.11) */
+    if (close_fd_range(first_fd, ~0U, CLOSE_RANGE_CLOEXEC))
+        return true;
+
+    /* otherwise close everything around it (linux >= 5.9) */
+    if (keep_fd < first_fd)
+        return close_fd_range(first_fd, ~0U, 0);
 
-    setenv("NYX_PID", str, 1);
+    if (keep_fd > first_fd && !close_fd_range(first_fd, keep_fd - 1, 0))
+        return false;
+
+    return close_fd_range(keep_fd + 1, ~0U, 0);
 }
 
+/* close all descriptors starting at 'first_fd' apart from 'keep_fd' (the
+ * ones below are stdin/stdout/stderr and the passed sockets) */
 static void
-close_fds(pid_t pid)
+close_fds(pid_t pid, int32_t first_fd, int32_t keep_fd)
 {
     char path[256] = {0};
 
+    /* a single syscall if supported by the kernel */
+    if (close_fds_fast(first_fd, keep_fd))
+        return;
+
     /* first we try to search in /proc/{pid}/fd */
     snprintf(path, LEN(path)-1, "/proc/%d/fd", pid);
 
@@ -111,7 +228,7 @@ close_fds(pid_t pid)
         {
             int32_t fd = atoi(entry->d_name);
 
-            if (fd >= 3 && fd != dir_fd)
+            if (fd >= first_fd && fd != dir_fd && fd != keep_fd)
                 close(fd);
         }
 
@@ -125,8 +242,11 @@ close_fds(pid_t pid)
     if ((max = getdtablesize()) == -1)
         max = 256;
 
-    for (int32_t fd = 3 /* stderr + 1 */; fd < max; fd++)
-        close(fd);
+    for (int32_t fd = first_fd; fd < max; fd++)
+    {
+        if (fd != keep_fd)
+            close(fd);
+    }
 }
 
 static bool
@@ -162,8 +282,34 @@ read_pipe(int32_t fd)
     return value;
 }
 
+/* the error pipe reports the errno of a failed 'execvp' back to
+ * the forker - both ends are closed on a successful 'execvp' */
+static void
+open_error_pipe(int32_t *pipes)
+{
+    if (!pipe_cloexec(pipes))
+        log_critical_perror("nyx: pipe");
+}
+
+static int32_t
+read_error_pipe(int32_t *pipes)
+{
+    int32_t error = 0;
+
+    /* close the write end before */
+    close(pipes[1]);
+
+    /* end-of-file means the 'execvp' succeeded */
+    if (read(pipes[0], &error, sizeof(int32_t)) != sizeof(int32_t))
+        error = 0;
+
+    close(pipes[0]);
+
+    return error;
+}
+
 static const char *
-get_exec_directory(watch_t *watch, nyx_t *nyx)
+get_exec_directory(const watch_t *watch, nyx_t *nyx)
 {
     /* no watch specific directory given */
     if (watch->dir == NULL || *watch->dir == '\0')
@@ -177,372 +323,1722 @@ get_exec_directory(watch_t *watch, nyx_t *nyx)
     return watch->dir;
 }
 
-static void
-spawn_exec(watch_t *watch, const char *dir, bool start, bool proxy_output, pid_t stop_pid)
+/**
+ * Everything about spawning the processes of a watch that does not change
+ * between its spawns - resolved once per config generation so restarts
+ * (and crash loops) neither rebuild the environment nor query NSS.
+ */
+typedef struct
 {
-    uid_t uid = 0;
-    gid_t gid = 0;
+    /** environment (the forker's merged with the watch's one) */
+    char **env;
+    uint32_t env_count;
+    /** trailing entries of 'env' that apply after switching the user only */
+    uint32_t user_entries;
+    /** working directory */
+    char *dir;
+    /** the user/group names were resolved */
+    bool resolved;
+    uid_t uid;
+    gid_t gid;
+    gid_t *groups;
+    int32_t num_groups;
+    /** placement and scheduling of the started process */
+    spawnattr_t attr;
+} spawn_plan_t;
+
+/* spawn plans by watch name (of the current config generation) */
+static hash_t *plans = NULL;
 
-    const char **args = start ? watch->start : watch->stop;
-    const char *executable = *args;
+static bool
+env_key_is(const char *entry, const char *key)
+{
+    size_t length = strlen(key);
 
-    /* determine user and group */
-    if (watch->uid)
-        get_user(watch->uid, &uid, &gid);
+    return strncmp(entry, key, length) == 0 && entry[length] == '=';
+}
 
-    if (watch->gid)
-        get_group(watch->gid, &gid);
+static bool
+env_overridden(const char *entry, const watch_t *watch)
+{
+    char key[256] = {0};
+    const char *end = strchr(entry, '=');
 
-    /* TODO: configurable mask */
-    umask(0);
+    if (end == NULL || (size_t)(end - entry) >= LEN(key))
+        return false;
 
-    /* create session */
-    setsid();
+    memcpy(key, entry, end - entry);
 
-    /* set user/group */
-    if (gid)
-    {
-        gid_t groups[] = { gid };
+    return watch->env && hash_get(watch->env, key);
+}
 
-        setgroups(1, groups);
+static char *
+env_entry(const char *key, const char *value)
+{
+    size_t size = strlen(key) + strlen(value) + 2;
+    char *entry = xcalloc(size, sizeof(char));
 
-        if (setgid(gid) == -1)
-            log_perror("nyx: setgid");
-    }
+    snprintf(entry, size, "%s=%s", key, value);
 
-    if (uid && gid)
-        initgroups(watch->uid, gid);
+    return entry;
+}
+
+static void
+resolve_groups(spawn_plan_t *plan, const watch_t *watch)
+{
+    free(plan->groups);
+    plan->groups = NULL;
+    plan->num_groups = 0;
 
-    if (uid)
+    if (plan->gid == 0)
+        return;
+
+    if (plan->uid && watch->uid)
     {
-        /* in case the uid was modified we adjust the $USER and $HOME
-         * environment variables appropriately */
-        if (setuid(uid) != -1)
+        int32_t count = 32;
+
+        while (true)
         {
-            if (!watch->env)
-                watch->env = hash_new(free);
+            int32_t size = count;
 
-            if (!hash_get(watch->env, "USER"))
-            {
-                hash_add(watch->env, "USER", strdup(watch->uid));
-            }
+            gid_t *groups = realloc(plan->groups, size * sizeof(gid_t));
 
-            if (!hash_get(watch->env, "HOME"))
-            {
-                struct passwd *pw = getpwuid(uid);
+            if (groups == NULL)
+                log_critical_perror("nyx: realloc");
 
-                if (pw && pw->pw_dir)
-                    hash_add(watch->env, "HOME", strdup(pw->pw_dir));
-            }
+            plan->groups = groups;
+#ifdef OSX
+            if (getgrouplist(watch->uid, (int)plan->gid, (int *)plan->groups, &count) != -1)
+#else
+            if (getgrouplist(watch->uid, plan->gid, plan->groups, &count) != -1)
+#endif
+                break;
+
+            /* 'count' holds the required size on linux only */
+            count = MAX(count, size * 2);
         }
+
+        plan->num_groups = count;
+        return;
     }
 
-    if (chdir(dir) == -1)
-        log_critical_perror("nyx: chdir");
+    plan->groups = xcalloc(1, sizeof(gid_t));
+    plan->groups[0] = plan->gid;
+    plan->num_groups = 1;
+}
 
-    /* stdin */
-    close(STDIN_FILENO);
+/* the environment depends on the user's home directory */
+static void
+build_plan_environment(spawn_plan_t *plan, const watch_t *watch, const char *home)
+{
+    size_t count = 0, idx = 0;
 
-    if (open("/dev/null", O_RDONLY) == -1)
-    {
-        fprintf(stderr, "Failed to open /dev/null");
-        exit(EXIT_FAILURE);
-    };
+    while (environ[count])
+        count++;
 
-    /* STDOUT */
+    if (watch->env)
+        count += hash_count(watch->env);
 
-    if (start && watch->log_file)
-    {
-        close(STDOUT_FILENO);
+    /* USER + HOME + NULL */
+    plan->env = xcalloc(count + 3, sizeof(char *));
 
-        if (open(watch->log_file,
-                    O_RDWR | O_APPEND | O_CREAT,
-                    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1)
-        {
-            fprintf(stderr, "Failed to open log file '%s'",
-                    watch->log_file);
-            exit(EXIT_FAILURE);
-        }
-    }
-    else if (start && proxy_output)
+    for (char **entry = environ; *entry; entry++)
     {
-        /* in this case we want to keep stdout open as it is */
+        if (!env_overridden(*entry, watch))
+            plan->env[idx++] = xstrdup(*entry);
     }
-    else
+
+    if (watch->env && hash_count(watch->env) > 0)
     {
-        close(STDOUT_FILENO);
+        const char *key = NULL;
+        void *data = NULL;
 
-        if (open("/dev/null", O_WRONLY) == -1)
-        {
-            fprintf(stderr, "Failed to open /dev/null");
-            exit(EXIT_FAILURE);
-        }
+        hash_iter_t *iter = hash_iter_start(watch->env);
+
+        while (hash_iter(iter, &key, &data))
+            plan->env[idx++] = env_entry(key, data);
+
+        hash_iter_free(iter);
     }
 
-    /* STDERR */
+    plan->env_count = idx;
 
-    if (start && watch->error_file)
+    /* in case the uid is switched we adjust the $USER and $HOME
+     * environment variables appropriately */
+    if (plan->uid)
     {
-        close(STDERR_FILENO);
+        if (!watch->env || !hash_get(watch->env, "USER"))
+            plan->env[plan->env_count++] = env_entry("USER", watch->uid);
 
-        if (open(watch->error_file,
-                    O_RDWR | O_APPEND | O_CREAT,
-                    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1)
-        {
-            fprintf(stdout, "Failed to open error file '%s'",
-                    watch->error_file);
-            exit(EXIT_FAILURE);
-        }
-    }
-    else if (start && proxy_output)
-    {
-        /* in this case we want to keep stderr open as it is */
-    }
-    else
-    {
-        close(STDERR_FILENO);
+        if (home && (!watch->env || !hash_get(watch->env, "HOME")))
+            plan->env[plan->env_count++] = env_entry("HOME", home);
 
-        if (open("/dev/null", O_RDWR) == -1)
-        {
-            fprintf(stdout, "Failed to open /dev/null");
-            exit(EXIT_FAILURE);
-        }
+        plan->user_entries = plan->env_count - idx;
     }
+}
 
-    /* set user defined environment variables */
-    set_environment(watch);
+/* user and group names are resolved until they are known */
+static void
+resolve_credentials(spawn_plan_t *plan, const watch_t *watch)
+{
+    uid_t uid = 0;
+    gid_t gid = 0;
+    bool resolved = true;
 
-    /* set the 'magic' environment NYX_PID for custom stop-commands */
-    if (stop_pid)
-    {
-        set_magic_pid(stop_pid);
-    }
+    if (watch->uid)
+        resolved &= get_user(watch->uid, &uid, &gid);
 
-    close_fds(getpid());
+    if (watch->gid)
+        resolved &= get_group(watch->gid, &gid);
 
-    /* on success this call won't return */
-    execvp(executable, (char * const *)args);
+    plan->uid = uid;
+    plan->gid = gid;
+    plan->resolved = resolved;
 
-    if (errno == ENOENT)
-        exit(EXIT_SUCCESS);
+    resolve_groups(plan, watch);
+}
 
-    log_critical_perror("nyx: execvp %s", executable);
+static void
+spawn_plan_destroy(void *data)
+{
+    spawn_plan_t *plan = data;
+
+    for (uint32_t i = 0; i < plan->env_count; i++)
+        free(plan->env[i]);
+
+    free(plan->env);
+    free(plan->dir);
+    free(plan->groups);
+    spawnattr_free(&plan->attr);
+    free(plan);
 }
 
-static pid_t
-spawn_stop(nyx_t *nyx, watch_t *watch, pid_t stop_pid)
+static spawn_plan_t *
+spawn_plan_new(nyx_t *nyx, const watch_t *watch)
 {
-    pid_t pid = fork();
+    spawn_plan_t *plan = xcalloc1(sizeof(spawn_plan_t));
+    const char *home = NULL;
 
-    if (pid == -1)
-        log_critical_perror("nyx: fork");
+    resolve_credentials(plan, watch);
 
-    if (pid == 0)
+    if (plan->uid)
     {
-        const char *dir = get_exec_directory(watch, nyx);
-        spawn_exec(watch, dir, false, false, stop_pid);
+        struct passwd *pw = getpwuid(plan->uid);
+
+        if (pw && pw->pw_dir)
+            home = pw->pw_dir;
     }
 
-    /* the return value will be written into the process' pid file
-     * that's why the actual 'stop-process-pid' is not of interest here */
-    return 0;
-}
+    build_plan_environment(plan, watch, home);
 
-static void
-reset_nyx(nyx_t *nyx)
-{
-    clear_watches(nyx);
-    destroy_options(nyx);
+    plan->dir = xstrdup(get_exec_directory(watch, nyx));
+
+    /* invalid attributes were reported by the config validation already */
+    if (watch_has_spawn_attributes(watch))
+        spawnattr_resolve(&plan->attr, watch);
+
+    return plan;
 }
 
-static void
-destroy_nyx(nyx_t *nyx)
+/* the spawn plan of the watch - NSS is only queried again if the
+ * user/group could not be resolved before */
+static spawn_plan_t *
+get_spawn_plan(nyx_t *nyx, const watch_t *watch)
 {
-    reset_nyx(nyx);
+    if (plans == NULL)
+        plans = hash_new(spawn_plan_destroy);
 
-    if (nyx->pid_dir)
-    {
-        free((void *)nyx->pid_dir);
-        nyx->pid_dir = NULL;
-    }
+    spawn_plan_t *plan = hash_get(plans, watch->name);
 
-    if (nyx->nyx_dir)
+    if (plan && !plan->resolved)
     {
-        free((void *)nyx->nyx_dir);
-        nyx->nyx_dir = NULL;
+        hash_remove(plans, watch->name);
+        plan = NULL;
     }
 
-    if (nyx->socket_path)
+    if (plan == NULL)
     {
-        free((void *)nyx->socket_path);
-        nyx->socket_path = NULL;
+        plan = spawn_plan_new(nyx, watch);
+        hash_add(plans, watch->name, plan);
     }
 
-    free(nyx);
+    return plan;
 }
 
-static pid_t
-spawn_start(nyx_t *nyx, watch_t *watch)
+/**
+ * Resolve the spawn plans of all watches of the current config
+ * generation - called whenever the forker (re)loaded its config
+ */
+static void
+build_spawn_plans(nyx_t *nyx)
 {
-    int32_t pipes[2] = {0};
-    bool double_fork = !nyx->is_init;
+    const char *key = NULL;
+    void *data = NULL;
 
-    /* In 'init-mode' and quiet output we will probably proxy
-     * the service's stdout/stderr instead.
-     * This will be the desired effect if using nyx as the
-     * docker entrypoint for example */
-    bool proxy_output = nyx->is_init && nyx->options.quiet;
+    if (plans)
+        hash_destroy(plans);
 
-    /* in case of a 'double-fork' we need some way to retrieve the
-     * resulting process' pid */
-    if (double_fork)
+    plans = hash_new(spawn_plan_destroy);
+
+    if (nyx->watches == NULL)
+        return;
+
+    hash_iter_t *iter = hash_iter_start(nyx->watches);
+
+    while (hash_iter(iter, &key, &data))
     {
-        if (pipe(pipes) == -1)
-            log_critical_perror("nyx: pipe");
+        watch_t *watch = data;
+        hash_add(plans, watch->name, spawn_plan_new(nyx, watch));
     }
 
-    pid_t pid = fork();
-    pid_t outer_pid = pid;
+    hash_iter_free(iter);
+}
 
-    /* fork failed */
-    if (pid == -1)
-        log_critical_perror("nyx: fork");
+/**
+ * Listening sockets of a watch - bound by the forker once and kept open
+ * across restarts and reloads that do not change the addresses
+ */
+typedef struct
+{
+    int32_t id;
+    const char **addresses;
+    int32_t fds[LISTEN_MAX_SOCKETS];
+    uint32_t count;
+    /** waiting for the first connection to start the watch */
+    bool armed;
+} listener_t;
 
-    /* child process */
-    if (pid == 0)
-    {
-        const char *dir = get_exec_directory(watch, nyx);
+/* listeners by watch name */
+static hash_t *listeners = NULL;
 
-        /* in 'init mode' we have to fork only once */
-        if (!double_fork)
-        {
-            /* this call won't return */
-            spawn_exec(watch, dir, true, proxy_output, 0);
-        }
-        /* otherwise we want to 'double fork' */
-        else
-        {
-            pid_t inner_pid = fork();
+static void
+listener_destroy(void *data)
+{
+    listener_t *listener = data;
 
-            if (inner_pid == -1)
-                log_critical_perror("nyx: fork");
+    for (uint32_t i = 0; i < listener->count; i++)
+        listen_socket_close(listener->fds[i], listener->addresses[i]);
 
-            if (inner_pid == 0)
-            {
-                /* this call won't return */
-                spawn_exec(watch, dir, true, proxy_output, 0);
-            }
+    strings_free((char **)listener->addresses);
+    free(listener);
+}
 
-            /* close the read end before */
-            close(pipes[0]);
+static listener_t *
+listener_new(const watch_t *watch)
+{
+    uint32_t count = MIN(count_args(watch->listen), LISTEN_MAX_SOCKETS);
+    listener_t *listener = xcalloc1(sizeof(listener_t));
 
-            /* now we write the child pid into the pipe */
-            write_pipe(pipes[1], inner_pid);
+    listener->addresses = xcalloc(count + 1, sizeof(char *));
 
-            /* this process will be terminated just now but it's
-             * good practice to clean up after ourselves anyways */
-            destroy_nyx(nyx);
+    for (uint32_t i = 0; i < count; i++)
+        listener->addresses[i] = xstrdup(watch->listen[i]);
+
+    while (listener->count < count)
+    {
+        int32_t fd = listen_socket_open(listener->addresses[listener->count]);
+
+        if (fd < 0)
+        {
+            log_error("Failed to listen on '%s' for watch '%s'",
+                    listener->addresses[listener->count], watch->name);
+
+            listener_destroy(listener);
+            return NULL;
+        }
+
+        listener->fds[listener->count++] = fd;
+    }
+
+    log_debug("forker: listening on %u socket(s) for watch '%s'", count, watch->name);
+
+    return listener;
+}
+
+static bool
+addresses_equal(const char **a, const char **b)
+{
+    while (*a && *b)
+    {
+        if (strcmp(*a++, *b++) != 0)
+            return false;
+    }
+
+    return *a == *b;
+}
+
+/**
+ * Bind the listening sockets of the watches of the current config
+ * generation - sockets of unchanged watches are kept open so connections
+ * are queued across restarts, the ones of removed watches are closed
+ */
+static void
+configure_listeners(nyx_t *nyx)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    hash_t *previous = listeners;
+
+    listeners = hash_new(listener_destroy);
+
+    if (nyx->watches)
+    {
+        hash_iter_t *iter = hash_iter_start(nyx->watches);
+
+        while (hash_iter(iter, &key, &data))
+        {
+            watch_t *watch = data;
+
+            if (watch->listen == NULL)
+                continue;
+
+            listener_t *listener = previous ? hash_take(previous, watch->name) : NULL;
+
+            if (listener && !addresses_equal(listener->addresses, watch->listen))
+            {
+                listener_destroy(listener);
+                listener = NULL;
+            }
+
+            if (listener == NULL)
+            {
+                if ((listener = listener_new(watch)) == NULL)
+                    continue;
+
+                listener->armed = watch->listen_lazy;
+            }
+            else if (!watch->listen_lazy)
+                listener->armed = false;
+
+            listener->id = watch->id;
+
+            hash_add(listeners, watch->name, listener);
+        }
+
+        hash_iter_free(iter);
+    }
+
+    if (previous)
+        hash_destroy(previous);
+}
+
+static listener_t *
+find_listener(const watch_t *watch)
+{
+    return listeners && watch->listen ? hash_get(listeners, watch->name) : NULL;
+}
+
+/* the watch is started so its sockets are accepted on from now on */
+static void
+disarm_listener(const watch_t *watch)
+{
+    listener_t *listener = find_listener(watch);
+
+    if (listener)
+        listener->armed = false;
+}
+
+/* number of sockets the forker waits for the first connection on */
+static uint32_t
+armed_listener_fds(void)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    uint32_t count = 0;
+
+    if (listeners == NULL)
+        return 0;
+
+    hash_iter_t *iter = hash_iter_start(listeners);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        listener_t *listener = data;
+
+        if (listener->armed)
+            count += listener->count;
+    }
+
+    hash_iter_free(iter);
+
+    return count;
+}
+
+static void
+listener_poll_fds(struct pollfd *fds)
+{
+    const char *key = NULL;
+    void *data = NULL;
+
+    if (listeners == NULL)
+        return;
+
+    hash_iter_t *iter = hash_iter_start(listeners);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        listener_t *listener = data;
+
+        if (!listener->armed)
+            continue;
+
+        for (uint32_t i = 0; i < listener->count; i++)
+            *fds++ = (struct pollfd) { .fd = listener->fds[i], .events = POLLIN };
+    }
+
+    hash_iter_free(iter);
+}
+
+/**
+ * Move the listening sockets of the watch to the descriptors starting at
+ * 3 where the service expects them (see sd_listen_fds(3)).
+ * Returns the first descriptor after the passed sockets.
+ */
+static int32_t
+pass_listen_fds(const watch_t *watch, int32_t *error_fd)
+{
+    const listener_t *listener = find_listener(watch);
+    int32_t fds[LISTEN_MAX_SOCKETS];
+
+    if (listener == NULL)
+        return LISTEN_FDS_START;
+
+    int32_t first = LISTEN_FDS_START + listener->count;
+
+    /* move all involved descriptors out of the way first */
+    if (*error_fd < first)
+        *error_fd = fcntl(*error_fd, F_DUPFD_CLOEXEC, first);
+
+    for (uint32_t i = 0; i < listener->count; i++)
+        fds[i] = fcntl(listener->fds[i], F_DUPFD_CLOEXEC, first);
+
+    /* the duplicated descriptors are inherited (no close-on-exec) */
+    for (uint32_t i = 0; i < listener->count; i++)
+    {
+        if (fds[i] < 0 || dup2(fds[i], LISTEN_FDS_START + i) == -1)
+            log_perror("nyx: dup2");
+    }
+
+    return first;
+}
+
+/**
+ * Build the environment of one spawn: the plan's environment plus the
+ * entries that differ per spawn (NYX_PID, NYX_INSTANCE, NOTIFY_SOCKET,
+ * NYX_WATCHDOG and LISTEN_FDS). The first 'borrowed' entries belong to the
+ * plan.
+ */
+static char **
+build_environment(nyx_t *nyx, const spawn_plan_t *plan, const watch_t *watch,
+        uint32_t instance, bool start, pid_t stop_pid, bool user, uint32_t *borrowed)
+{
+    uint32_t idx = 0;
+    uint32_t count = plan->env_count - (user ? 0 : plan->user_entries);
+    bool instances = watch->instances > 1;
+    bool notify = start && watch->notify;
+    bool watchdog = start && watch->watchdog;
+    const listener_t *listener = start ? find_listener(watch) : NULL;
+
+    /* NYX_PID + NYX_INSTANCE + NOTIFY_SOCKET + NYX_WATCHDOG(_USEC) +
+     * LISTEN_FDS/PID/FDNAMES + NULL */
+    char **env = xcalloc(count + 9, sizeof(char *));
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const char *entry = plan->env[i];
+
+        if ((stop_pid && env_key_is(entry, "NYX_PID")) ||
+            (instances && env_key_is(entry, "NYX_INSTANCE")) ||
+            (notify && env_key_is(entry, "NOTIFY_SOCKET")) ||
+            (watchdog && (env_key_is(entry, "NYX_WATCHDOG") ||
+                          env_key_is(entry, "NYX_WATCHDOG_USEC"))) ||
+            (listener && (env_key_is(entry, "LISTEN_FDS") ||
+                          env_key_is(entry, "LISTEN_PID") ||
+                          env_key_is(entry, "LISTEN_FDNAMES"))))
+            continue;
+
+        env[idx++] = plan->env[i];
+    }
+
+    *borrowed = idx;
+
+    if (stop_pid)
+    {
+        char str[32] = {0};
+        snprintf(str, LEN(str)-1, "%d", stop_pid);
+
+        env[idx++] = env_entry("NYX_PID", str);
+    }
+
+    /* tell the instances of a watch apart */
+    if (instances)
+    {
+        char str[32] = {0};
+        snprintf(str, LEN(str)-1, "%u", instance);
+
+        env[idx++] = env_entry("NYX_INSTANCE", str);
+    }
+
+    /* point the service to its readiness notification socket */
+    if (notify)
+    {
+        char *name = watch_instance_name(watch, instance);
+        char *path = get_notify_socket_path(nyx->pid_dir, name);
+
+        env[idx++] = env_entry("NOTIFY_SOCKET", path);
+
+        free(path);
+        nyx_free(name, MEM_CONFIG);
+    }
+
+    /* point the service to the socket its heartbeats are sent to */
+    if (watchdog)
+    {
+        char str[32] = {0};
+        char *path = get_watchdog_socket_path(nyx->pid_dir);
+
+        snprintf(str, LEN(str)-1, "%" PRIu64, (uint64_t)watch->watchdog * 1000);
+
+        env[idx++] = env_entry("NYX_WATCHDOG", path);
+        env[idx++] = env_entry("NYX_WATCHDOG_USEC", str);
+
+        free(path);
+    }
+
+    /* the passed sockets - the environment is built in the spawned
+     * child already so its own pid is known */
+    if (listener)
+    {
+        char str[32] = {0};
+        size_t length = strlen(watch->name) + 1;
+        char *names = xcalloc(listener->count, length);
+
+        for (uint32_t i = 0; i < listener->count; i++)
+        {
+            if (i > 0)
+                strcat(names, ":");
+            strcat(names, watch->name);
+        }
+
+        snprintf(str, LEN(str)-1, "%u", listener->count);
+        env[idx++] = env_entry("LISTEN_FDS", str);
+
+        snprintf(str, LEN(str)-1, "%d", getpid());
+        env[idx++] = env_entry("LISTEN_PID", str);
+
+        env[idx++] = env_entry("LISTEN_FDNAMES", names);
+
+        free(names);
+    }
+
+    return env;
+}
+
+static void
+free_environment(char **env, uint32_t borrowed)
+{
+    for (char **entry = env + borrowed; *entry; entry++)
+        free(*entry);
+
+    free(env);
+}
+
+static void
+spawn_exec(nyx_t *nyx, watch_t *watch, const spawn_plan_t *plan, uint32_t instance,
+        bool start, const char **args, bool proxy_output, const int32_t *outputs,
+        pid_t stop_pid, int32_t error_fd)
+{
+    const char *executable = *args;
+
+    /* TODO: configurable mask */
+    umask(0);
+
+    /* create session */
+    setsid();
+
+    /* the forker ignores SIGHUP (meant for the nyx daemon) */
+    signal(SIGHUP, SIG_DFL);
+
+    /* CPU/NUMA placement, scheduling and rlimits of the started process
+     * (before dropping privileges that may be required to raise them) */
+    if (start)
+        spawnattr_apply(&plan->attr);
+
+    /* set user/group (resolved by the spawn plan) */
+    if (plan->gid)
+    {
+        setgroups(plan->num_groups, plan->groups);
+
+        if (setgid(plan->gid) == -1)
+            log_perror("nyx: setgid");
+    }
+
+    bool user = plan->uid && setuid(plan->uid) != -1;
+
+    if (chdir(plan->dir) == -1)
+        log_critical_perror("nyx: chdir");
+
+    /* stdin */
+    close(STDIN_FILENO);
+
+    if (open("/dev/null", O_RDONLY) == -1)
+    {
+        fprintf(stderr, "Failed to open /dev/null");
+        exit(EXIT_FAILURE);
+    };
+
+    /* STDOUT */
+
+    if (outputs && outputs[0] >= 0)
+    {
+        /* the output is captured by the forker */
+        if (dup2(outputs[0], STDOUT_FILENO) == -1)
+        {
+            fprintf(stderr, "Failed to redirect stdout");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (start && watch->log_file)
+    {
+        close(STDOUT_FILENO);
+
+        if (open(watch->log_file,
+                    O_RDWR | O_APPEND | O_CREAT,
+                    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1)
+        {
+            fprintf(stderr, "Failed to open log file '%s'",
+                    watch->log_file);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (start && proxy_output)
+    {
+        /* in this case we want to keep stdout open as it is */
+    }
+    else
+    {
+        close(STDOUT_FILENO);
+
+        if (open("/dev/null", O_WRONLY) == -1)
+        {
+            fprintf(stderr, "Failed to open /dev/null");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* STDERR */
+
+    if (outputs && outputs[1] >= 0)
+    {
+        if (dup2(outputs[1], STDERR_FILENO) == -1)
+        {
+            fprintf(stdout, "Failed to redirect stderr");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (start && watch->error_file)
+    {
+        close(STDERR_FILENO);
+
+        if (open(watch->error_file,
+                    O_RDWR | O_APPEND | O_CREAT,
+                    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1)
+        {
+            fprintf(stdout, "Failed to open error file '%s'",
+                    watch->error_file);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (start && proxy_output)
+    {
+        /* in this case we want to keep stderr open as it is */
+    }
+    else
+    {
+        close(STDERR_FILENO);
+
+        if (open("/dev/null", O_RDWR) == -1)
+        {
+            fprintf(stdout, "Failed to open /dev/null");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* the plan's environment plus the 'magic' NYX_PID for custom
+     * stop-commands, NYX_INSTANCE and the notification sockets */
+    uint32_t borrowed = 0;
+    environ = build_environment(nyx, plan, watch, instance, start, stop_pid, user, &borrowed);
+
+    int32_t first_fd = start ? pass_listen_fds(watch, &error_fd) : LISTEN_FDS_START;
+
+    close_fds(getpid(), first_fd, error_fd);
+
+    /* on success this call won't return */
+    execvp(executable, (char * const *)args);
+
+    int32_t error = errno;
+
+    if (write(error_fd, &error, sizeof(int32_t)) == -1)
+        log_perror("nyx: write");
+
+    errno = error;
+
+    if (errno == ENOENT)
+        exit(EXIT_SUCCESS);
+
+    log_critical_perror("nyx: execvp %s", executable);
+}
+
+#ifdef HAS_FAST_SPAWN
+/**
+ * Spawn the process via 'posix_spawn' which avoids copying the forker's
+ * page tables (glibc uses 'clone(CLONE_VM | CLONE_VFORK)'). Everything
+ * 'spawn_exec' does is expressed as spawn attributes and file actions.
+ *
+ * Returns false if the watch cannot be spawned this way.
+ */
+static bool
+spawn_fast(nyx_t *nyx, watch_t *watch, uint32_t instance, bool start, const char **args,
+        bool proxy_output, const int32_t *outputs, pid_t stop_pid, pid_t *pid, int32_t *error)
+{
+    /* the user/group switch is not expressible as spawn attributes */
+    if (!nyx->options.fast_spawn || watch->uid || watch->gid)
+        return false;
+
+    /* the started process has to join its cgroup before exec */
+    if (start && nyx->options.cgroup)
+        return false;
+
+    /* most placement and scheduling attributes have no spawn attribute */
+    if (start && watch_has_spawn_attributes(watch))
+        return false;
+
+    /* LISTEN_PID has to name the spawned process itself */
+    if (start && watch->listen)
+        return false;
+
+    const spawn_plan_t *plan = get_spawn_plan(nyx, watch);
+    const int32_t flags = O_RDWR | O_APPEND | O_CREAT;
+    const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t mask, defaults;
+
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+
+    /* create session and reset the signals the forker ignores */
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGHUP);
+
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr,
+            POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    posix_spawn_file_actions_addchdir_np(&actions, plan->dir);
+
+    /* stdin */
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+    /* stdout */
+    if (outputs && outputs[0] >= 0)
+        posix_spawn_file_actions_adddup2(&actions, outputs[0], STDOUT_FILENO);
+    else if (start && watch->log_file)
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, watch->log_file, flags, mode);
+    else if (!start || !proxy_output)
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    /* stderr */
+    if (outputs && outputs[1] >= 0)
+        posix_spawn_file_actions_adddup2(&actions, outputs[1], STDERR_FILENO);
+    else if (start && watch->error_file)
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, watch->error_file, flags, mode);
+    else if (!start || !proxy_output)
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_RDWR, 0);
+
+    posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+
+    uint32_t borrowed = 0;
+    char **env = build_environment(nyx, plan, watch, instance, start, stop_pid, false, &borrowed);
+
+    /* TODO: configurable mask */
+    mode_t old_mask = umask(0);
+
+    *error = posix_spawnp(pid, *args, &actions, &attr, (char * const *)args, env);
+
+    umask(old_mask);
+
+    if (*error)
+    {
+        errno = *error;
+        log_perror("nyx: posix_spawnp %s", *args);
+        *pid = 0;
+    }
+
+    free_environment(env, borrowed);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    return true;
+}
+#endif
+
+/**
+ * Spawn a command of the watch (its stop or reload command or health check)
+ * that is passed the PID of the watch's process as NYX_PID
+ */
+static pid_t
+spawn_command(nyx_t *nyx, watch_t *watch, uint32_t instance, const char **args,
+        pid_t stop_pid, int32_t *error)
+{
+    int32_t errors[2] = {0};
+
+#ifdef HAS_FAST_SPAWN
+    pid_t process = 0;
+
+    if (spawn_fast(nyx, watch, instance, false, args, false, NULL, stop_pid, &process, error))
+        return process;
+#endif
+
+    const spawn_plan_t *plan = get_spawn_plan(nyx, watch);
+
+    open_error_pipe(errors);
+
+    pid_t pid = fork();
+
+    if (pid == -1)
+        log_critical_perror("nyx: fork");
+
+    if (pid == 0)
+        spawn_exec(nyx, watch, plan, instance, false, args, false, NULL, stop_pid, errors[1]);
+
+    *error = read_error_pipe(errors);
+
+    return pid;
+}
+
+static void
+reset_nyx(nyx_t *nyx)
+{
+    clear_watches(nyx);
+    destroy_options(nyx);
+}
+
+static void
+destroy_nyx(nyx_t *nyx)
+{
+    reset_nyx(nyx);
+
+    if (nyx->pid_dir)
+    {
+        free((void *)nyx->pid_dir);
+        nyx->pid_dir = NULL;
+    }
+
+    if (nyx->nyx_dir)
+    {
+        free((void *)nyx->nyx_dir);
+        nyx->nyx_dir = NULL;
+    }
+
+    if (nyx->socket_path)
+    {
+        free((void *)nyx->socket_path);
+        nyx->socket_path = NULL;
+    }
+
+    free(nyx);
+}
+
+#ifndef OSX
+/**
+ * Create the watch's cgroup the started process is placed in.
+ * Returns NULL if cgroups are not configured or not available.
+ */
+static char *
+prepare_cgroup(nyx_t *nyx, watch_t *watch, uint32_t instance)
+{
+    if (nyx->options.cgroup == NULL)
+        return NULL;
+
+    char *name = watch_instance_name(watch, instance);
+    char *path = cgroup_watch_path(nyx->options.cgroup, name);
+
+    if (!cgroup_prepare(path, watch))
+    {
+        log_warn("Failed to create cgroup '%s' of watch '%s'", path, name);
+
+        free(path);
+        path = NULL;
+    }
+
+    nyx_free(name, MEM_CONFIG);
+
+    return path;
+}
+#endif
+
+/**
+ * The output of the started process is passed through pipes the forker
+ * captures whenever more is to be done than appending to the log files:
+ * the files are rotated or the output is duplicated to the proxied
+ * stdout/stderr in 'init-mode'.
+ */
+static void
+open_captures(watch_t *watch, bool proxy_output, int32_t *outputs)
+{
+    bool rotate = watch_rotates_output(watch);
+
+    outputs[0] = -1;
+    outputs[1] = -1;
+
+    if (capture == NULL)
+        return;
+
+    if (watch->log_file && (rotate || proxy_output))
+        outputs[0] = capture_open(capture, watch, watch->log_file,
+                proxy_output ? STDOUT_FILENO : -1);
+
+    if (watch->error_file && (rotate || proxy_output))
+        outputs[1] = capture_open(capture, watch, watch->error_file,
+                proxy_output ? STDERR_FILENO : -1);
+}
+
+/* the write ends belong to the spawned process only */
+static void
+close_captures(int32_t *outputs)
+{
+    for (uint32_t idx = 0; idx < 2; idx++)
+    {
+        if (outputs[idx] >= 0)
+            close(outputs[idx]);
+    }
+}
+
+static pid_t
+spawn_start(nyx_t *nyx, watch_t *watch, uint32_t instance, int32_t *error)
+{
+    int32_t pipes[2] = {0};
+    int32_t errors[2] = {0};
+    bool double_fork = !nyx->is_init;
+
+    /* In 'init-mode' and quiet output we will probably proxy
+     * the service's stdout/stderr instead.
+     * This will be the desired effect if using nyx as the
+     * docker entrypoint for example */
+    bool proxy_output = nyx->is_init && nyx->options.quiet;
+
+    int32_t outputs[2];
+    open_captures(watch, proxy_output, outputs);
+
+#ifdef HAS_FAST_SPAWN
+    pid_t spawned = 0;
+
+    /* the spawned process is a direct child of the forker
+     * that is reaped by the SIGCHLD handler */
+    if (spawn_fast(nyx, watch, instance, true, watch->start, proxy_output, outputs, 0,
+                &spawned, error))
+    {
+        close_captures(outputs);
+        return spawned;
+    }
+#endif
+
+    /* in case of a 'double-fork' we need some way to retrieve the
+     * resulting process' pid */
+    if (double_fork)
+    {
+        if (!pipe_cloexec(pipes))
+            log_critical_perror("nyx: pipe");
+    }
+
+    const spawn_plan_t *plan = get_spawn_plan(nyx, watch);
+
+    open_error_pipe(errors);
+
+#ifndef OSX
+    char *cgroup = prepare_cgroup(nyx, watch, instance);
+#endif
+
+    pid_t pid = fork();
+    pid_t outer_pid = pid;
+
+    /* fork failed */
+    if (pid == -1)
+        log_critical_perror("nyx: fork");
+
+    /* child process */
+    if (pid == 0)
+    {
+#ifndef OSX
+        /* join the cgroup before anything is executed so all
+         * processes of the service are accounted for */
+        if (cgroup)
+            cgroup_attach(cgroup, 0);
+#endif
+
+        /* in 'init mode' we have to fork only once */
+        if (!double_fork)
+        {
+            /* this call won't return */
+            spawn_exec(nyx, watch, plan, instance, true, watch->start, proxy_output, outputs,
+                    0, errors[1]);
+        }
+        /* otherwise we want to 'double fork' */
+        else
+        {
+            pid_t inner_pid = fork();
+
+            if (inner_pid == -1)
+                log_critical_perror("nyx: fork");
+
+            if (inner_pid == 0)
+            {
+                /* this call won't return */
+                spawn_exec(nyx, watch, plan, instance, true, watch->start, proxy_output,
+                        outputs, 0, errors[1]);
+            }
+
+            /* close the read end before */
+            close(pipes[0]);
+            close(errors[0]);
+            close(errors[1]);
+
+            /* now we write the child pid into the pipe */
+            write_pipe(pipes[1], inner_pid);
+
+            /* this process will be terminated just now but it's
+             * good practice to clean up after ourselves anyways */
+            destroy_nyx(nyx);
 
             exit(EXIT_SUCCESS);
         }
     }
 
-    /* in case of a 'double-fork' we have to read the actual
-     * process' pid from the read end of the pipe */
-    if (double_fork)
+#ifndef OSX
+    free(cgroup);
+#endif
+
+    close_captures(outputs);
+
+    /* in case of a 'double-fork' we have to read the actual
+     * process' pid from the read end of the pipe */
+    if (double_fork)
+    {
+        /* close the write end before */
+        close(pipes[1]);
+
+        pid = read_pipe(pipes[0]);
+
+        /* wait for the intermediate forked process
+         * to terminate */
+        waitpid(outer_pid, NULL, 0);
+    }
+
+    *error = read_error_pipe(errors);
+
+    /* the process did not start at all */
+    if (*error)
+        pid = 0;
+
+    return pid;
+}
+
+/* self-pipe the child termination signals wake the forker loop with */
+static int32_t child_pipe[2] = { -1, -1 };
+
+/**
+ * @brief Callback to receive child termination signals
+ * @param signum signal number
+ */
+static void
+handle_child_stop(UNUSED int32_t signum)
+{
+    int32_t last_errno = errno;
+
+    /* the children are reaped in the forker loop so their
+     * exit status can be reported to nyx */
+    if (write(child_pipe[1], "", 1) == -1)
+    {
+        /* the pipe is full - there is a wakeup pending already */
+    }
+
+    errno = last_errno;
+}
+
+/* check commands are direct children of the forker */
+static bool
+has_exec_checks(nyx_t *nyx)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    bool found = false;
+
+    if (nyx->watches == NULL)
+        return false;
+
+    hash_iter_t *iter = hash_iter_start(nyx->watches);
+
+    while (!found && hash_iter(iter, &key, &data))
+    {
+        watch_t *watch = data;
+        found = watch->check_exec != NULL;
+    }
+
+    hash_iter_free(iter);
+
+    return found;
+}
+
+static void
+register_child_handler(nyx_t *nyx)
+{
+    static bool registered = false;
+
+    /* processes spawned via 'posix_spawn' are not double-forked */
+    bool fast_spawn = false;
+
+#ifdef HAS_FAST_SPAWN
+    fast_spawn = nyx->options.fast_spawn;
+#endif
+
+    if (registered || (!nyx->is_init && !fast_spawn && !has_exec_checks(nyx)))
+        return;
+
+    if (nyx->is_init)
+    {
+        log_debug("Running in init-mode - listening for child termination");
+    }
+
+    if (!pipe_cloexec(child_pipe))
+        return;
+
+    fcntl(child_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(child_pipe[1], F_SETFL, O_NONBLOCK);
+
+    struct sigaction action =
+    {
+        .sa_flags = SA_NOCLDSTOP | SA_RESTART,
+        .sa_handler = handle_child_stop
+    };
+
+    sigfillset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, NULL);
+
+    registered = true;
+}
+
+static int64_t
+timestamp_msecs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Read as many pending requests as available (up to NYX_FORKER_BATCH)
+ * with a single 'read' and complete a partially received record.
+ */
+static size_t
+read_requests(int32_t pipe_fd, fork_info_t *requests)
+{
+    char *buffer = (char *)requests;
+    ssize_t bytes = 0;
+    size_t received = 0;
+
+    do
+    {
+        bytes = read(pipe_fd, buffer + received,
+                sizeof(fork_info_t) * NYX_FORKER_BATCH - received);
+
+        if (bytes == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_perror("nyx: read");
+            return 0;
+        }
+
+        received += bytes;
+    }
+    while (bytes != 0 && received % sizeof(fork_info_t) != 0);
+
+    return received / sizeof(fork_info_t);
+}
+
+static void
+write_replies(int32_t reply_fd, fork_reply_t *replies, size_t count)
+{
+    if (count < 1)
+        return;
+
+    if (write(reply_fd, replies, sizeof(fork_reply_t) * count) == -1)
+        log_perror("nyx: write");
+}
+
+/* turn the exit of a check command into the check's reply */
+static void
+finish_check(fork_reply_t *reply)
+{
+    for (uint32_t i = 0; i < exec_checks_count; i++)
+    {
+        exec_check_t *check = &exec_checks[i];
+
+        if (check->pid != reply->pid)
+            continue;
+
+        reply->id = check->id;
+        reply->instance = check->instance;
+        reply->seq = check->seq;
+        reply->exited = false;
+        reply->check = true;
+
+        exec_checks[i] = exec_checks[--exec_checks_count];
+        return;
+    }
+}
+
+/**
+ * Kill the check commands that exceeded their deadline (including the
+ * processes they spawned) - they are reaped and reported as failed.
+ * Returns the time until the nearest deadline in milliseconds (-1 if none).
+ */
+static int32_t
+kill_overdue_checks(void)
+{
+    int64_t nearest = -1;
+    uint64_t now = stats_now() / 1000;
+
+    for (uint32_t i = 0; i < exec_checks_count; i++)
+    {
+        exec_check_t *check = &exec_checks[i];
+
+        if (check->killed)
+            continue;
+
+        if (check->deadline <= now)
+        {
+            log_debug("forker: check process %d exceeded its deadline", check->pid);
+
+            /* the check runs in a session (and process group) of its own */
+            if (kill(-check->pid, SIGKILL) == -1)
+                kill(check->pid, SIGKILL);
+
+            check->killed = true;
+            continue;
+        }
+
+        if (nearest < 0 || (int64_t)(check->deadline - now) < nearest)
+            nearest = check->deadline - now;
+    }
+
+    return (int32_t)nearest;
+}
+
+/* reap all terminated children and report their exit status to nyx */
+static void
+reap_children(int32_t reply_fd)
+{
+    char buffer[64];
+    pid_t pid = 0;
+    int32_t status = 0;
+    size_t count = 0;
+    struct rusage usage;
+    fork_reply_t replies[NYX_FORKER_BATCH];
+
+    /* drain the wakeups before reaping so no exit is missed */
+    while (read(child_pipe[0], buffer, sizeof(buffer)) > 0)
+        ;
+
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0)
     {
-        /* close the write end before */
-        close(pipes[1]);
+        fork_reply_t *reply = &replies[count++];
 
-        pid = read_pipe(pipes[0]);
+        log_debug("forker: process %d exited with status %d "
+                  "(user %ld ms, system %ld ms, max RSS %ld kB)",
+                pid, status,
+                (long)(usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000),
+                (long)(usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000),
+                (long)usage.ru_maxrss);
 
-        /* wait for the intermediate forked process
-         * to terminate */
-        waitpid(outer_pid, NULL, 0);
+        NYX_TRACE4(forker__exit, pid, status,
+                (long)(usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000),
+                (long)(usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000));
+
+        memset(reply, 0, sizeof(fork_reply_t));
+
+        reply->id = -1;
+        reply->exited = true;
+        reply->pid = pid;
+        reply->status = status;
+        reply->timestamp = timestamp_msecs();
+
+        finish_check(reply);
+
+        if (count == NYX_FORKER_BATCH)
+        {
+            write_replies(reply_fd, replies, count);
+            count = 0;
+        }
     }
 
-    return pid;
+    write_replies(reply_fd, replies, count);
 }
 
+/* poll descriptors of the forker loop: requests, child wakeups and
+ * the captured pipes */
+static struct pollfd *poll_fds = NULL;
+static uint32_t poll_size = 0;
+
 /**
- * @brief Callback to receive child termination signals
- * @param signum signal number
+ * Ask nyx to start the lazy watches a connection arrived for. The
+ * connections are not accepted but queued until the service accepts them.
  */
 static void
-handle_child_stop(UNUSED int32_t signum)
+activate_listeners(const struct pollfd *fds, int32_t reply_fd)
 {
-    int32_t last_errno = errno;
+    const char *key = NULL;
+    void *data = NULL;
+
+    if (listeners == NULL)
+        return;
 
-    log_debug("Received child stop signal - waiting for termination");
+    hash_iter_t *iter = hash_iter_start(listeners);
 
-    /* wait for all child processes */
-    while (waitpid(-1, NULL, WNOHANG) > 0)
+    while (hash_iter(iter, &key, &data))
     {
-        /* do nothing */
+        listener_t *listener = data;
+        bool activated = false;
+
+        if (!listener->armed)
+            continue;
+
+        for (uint32_t i = 0; i < listener->count; i++)
+            activated |= (fds++)->revents != 0;
+
+        if (activated)
+        {
+            fork_reply_t reply =
+            {
+                .id = listener->id,
+                .activate = true,
+                .timestamp = timestamp_msecs()
+            };
+
+            log_debug("forker: activating watch '%s' on its first connection", key);
+
+            listener->armed = false;
+            write_replies(reply_fd, &reply, 1);
+        }
     }
 
-    errno = last_errno;
+    hash_iter_free(iter);
+}
+
+static struct pollfd *
+prepare_poll_fds(int32_t pipe_fd, uint32_t count)
+{
+    if (count > poll_size)
+    {
+        struct pollfd *resized = realloc(poll_fds, count * sizeof(struct pollfd));
+
+        if (resized == NULL)
+            log_critical_perror("nyx: realloc");
+
+        poll_fds = resized;
+        poll_size = count;
+    }
+
+    /* poll ignores the negative descriptor without a child handler */
+    poll_fds[0] = (struct pollfd) { .fd = pipe_fd, .events = POLLIN };
+    poll_fds[1] = (struct pollfd) { .fd = child_pipe[0], .events = POLLIN };
+
+    capture_poll_fds(capture, poll_fds + 2);
+    listener_poll_fds(poll_fds + 2 + capture_count(capture));
+
+    return poll_fds;
+}
+
+/**
+ * Wait for incoming requests while reaping the terminated children and
+ * moving the captured output into the log files.
+ * Returns false if waiting failed.
+ */
+static bool
+wait_requests(int32_t pipe_fd, int32_t reply_fd)
+{
+    while (true)
+    {
+        uint32_t captured = capture_count(capture);
+        uint32_t armed = armed_listener_fds();
+        struct pollfd *fds = prepare_poll_fds(pipe_fd, captured + armed + 2);
+        int32_t timeout = kill_overdue_checks();
+
+        if (poll(fds, captured + armed + 2, timeout) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_perror("nyx: poll");
+            return false;
+        }
+
+        if (fds[1].revents)
+            reap_children(reply_fd);
+
+        capture_process(capture, fds + 2, captured);
+
+        if (armed)
+            activate_listeners(fds + 2 + captured, reply_fd);
+
+        if (fds[0].revents)
+            return true;
+    }
 }
 
 static void
-forker(nyx_t *nyx, int32_t pipe_fd)
+forker_reload_config(nyx_t *nyx)
 {
-    fork_info_t info = {0, 0, 0};
+    log_debug("forker: received reload command");
 
-    /* register SIGCHLD handler */
-    if (nyx->is_init)
+    /* the previous watches determine the IDs of the new ones */
+    hash_t *previous = nyx->watches;
+    nyx->watches = NULL;
+
+    reset_nyx(nyx);
+    nyx->watches = hash_new(_watch_destroy);
+
+    if (parse_config(nyx, true))
     {
-        log_debug("Running in init-mode - listening for child termination");
+        if (previous)
+            reindex_watches_from(nyx->watches, previous);
+
+        log_debug("forker: successfully reloaded config");
+
+        capture_configure(capture, nyx->watches);
+
+        register_child_handler(nyx);
+
+        configure_listeners(nyx);
+        build_spawn_plans(nyx);
+    }
+    else if (previous)
+    {
+        log_warn("forker: failed to reload config - keeping the previous watches");
+
+        hash_destroy(nyx->watches);
+        nyx->watches = previous;
+        return;
+    }
+    else
+    {
+        log_warn("forker: failed to reload config");
+    }
+
+    if (previous)
+        hash_destroy(previous);
+}
+
+/**
+ * Spawn the check command of the given watch. The check is replied to when
+ * its process exits - or right away if it could not be spawned.
+ */
+static bool
+spawn_check(nyx_t *nyx, watch_t *watch, fork_info_t *info, fork_reply_t *reply)
+{
+    int32_t error = 0;
+    pid_t pid = 0;
+
+    if (watch->check_exec)
+        pid = spawn_command(nyx, watch, info->instance, watch->check_exec, info->pid, &error);
+    else
+        error = EINVAL;
+
+    NYX_TRACE6(forker__spawn, watch->name, info->instance, false, pid, error, 0);
+
+    if (error == 0 && pid > 0)
+    {
+        if (exec_checks_count >= exec_checks_size)
+        {
+            uint32_t size = exec_checks_size ? exec_checks_size * 2 : 16;
+            exec_check_t *resized = realloc(exec_checks, size * sizeof(exec_check_t));
+
+            if (resized == NULL)
+                log_critical_perror("nyx: realloc");
+
+            exec_checks = resized;
+            exec_checks_size = size;
+        }
 
-        struct sigaction action =
+        exec_checks[exec_checks_count++] = (exec_check_t)
         {
-            .sa_flags = SA_NOCLDSTOP | SA_RESTART,
-            .sa_handler = handle_child_stop
+            .pid = pid,
+            .id = info->id,
+            .instance = info->instance,
+            .seq = info->seq,
+            .deadline = stats_now() / 1000 + info->timeout,
+            .killed = false
         };
 
-        sigfillset(&action.sa_mask);
-        sigaction(SIGCHLD, &action, NULL);
+        return false;
     }
 
-    while (read(pipe_fd, &info, sizeof(fork_info_t)) != 0)
+    memset(reply, 0, sizeof(fork_reply_t));
+
+    reply->id = info->id;
+    reply->instance = info->instance;
+    reply->seq = info->seq;
+    reply->check = true;
+    reply->error = error ? error : ECHILD;
+    reply->status = -1;
+    reply->timestamp = timestamp_msecs();
+
+    return true;
+}
+
+static bool
+handle_request(nyx_t *nyx, fork_info_t *info, fork_reply_t *reply)
+{
+    log_debug("forker: received watch id %d (instance %u)", info->id, info->instance);
+
+    watch_t *watch = find_watch(nyx, info->id);
+
+    if (watch == NULL)
     {
-        if (info.id == NYX_FORKER_RELOAD)
-        {
-            log_debug("forker: received reload command");
+        log_warn("forker: no watch with id %d found!", info->id);
+        return false;
+    }
 
-            reset_nyx(nyx);
-            nyx->watches = hash_new(_watch_destroy);
+    if (info->check)
+        return spawn_check(nyx, watch, info, reply);
 
-            if (parse_config(nyx, true))
-            {
-                log_debug("forker: successfully reloaded config");
-            }
-            else
+    int32_t error = 0;
+    pid_t pid = 0;
+    uint64_t started = NYX_TRACE_TIME();
+
+    if (info->start || info->spare)
+        disarm_listener(watch);
+
+    if (info->spare)
+    {
+        /* the standby must not report its readiness as the primary
+         * process - the forker owns its copy of the watches and runs
+         * single-threaded so the flag can be toggled temporarily */
+        bool notify = watch->notify;
+
+        watch->notify = false;
+        pid = spawn_start(nyx, watch, info->instance, &error);
+        watch->notify = notify;
+    }
+    else if (info->reload)
+    {
+        pid = spawn_command(nyx, watch, info->instance, watch->reload, info->pid, &error);
+    }
+    else
+    {
+        pid = (info->start)
+            ? spawn_start(nyx, watch, info->instance, &error)
+            : spawn_command(nyx, watch, info->instance, watch->stop, info->pid, &error);
+
+        char *name = watch_instance_name(watch, info->instance);
+
+        /* the actual 'stop-process-pid' is not of interest for the pid file */
+        write_pid(info->start ? pid : 0, name, nyx);
+
+        nyx_free(name, MEM_CONFIG);
+    }
+
+    NYX_TRACE6(forker__spawn, watch->name, info->instance, info->start, pid, error,
+            NYX_TRACE_TIME() - started);
+
+    memset(reply, 0, sizeof(fork_reply_t));
+
+    reply->id = info->id;
+    reply->instance = info->instance;
+    reply->seq = info->seq;
+    reply->start = info->start;
+    reply->spare = info->spare;
+    reply->reload = info->reload;
+    reply->pid = pid;
+    reply->error = error;
+    reply->timestamp = timestamp_msecs();
+
+    return true;
+}
+
+static void
+forker(nyx_t *nyx, int32_t pipe_fd, int32_t reply_fd)
+{
+    size_t count = 0;
+    fork_info_t requests[NYX_FORKER_BATCH];
+    fork_reply_t replies[NYX_FORKER_BATCH];
+
+    /* register SIGCHLD handler */
+    register_child_handler(nyx);
+
+    /* nothing the forker holds must leak into the spawned processes */
+    mark_fds_cloexec();
+
+    capture = capture_new();
+
+    configure_listeners(nyx);
+    build_spawn_plans(nyx);
+
+    while (wait_requests(pipe_fd, reply_fd) &&
+            (count = read_requests(pipe_fd, requests)) > 0)
+    {
+        size_t num_replies = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (requests[i].id == NYX_FORKER_RELOAD)
             {
-                log_warn("forker: failed to reload config");
+                forker_reload_config(nyx);
+                continue;
             }
 
-            continue;
+            if (handle_request(nyx, &requests[i], &replies[num_replies]))
+                num_replies++;
         }
 
-        log_debug("forker: received watch id %d", info.id);
+        /* report the spawned pids of the whole batch back to nyx
+         * directly so it does not have to wait for the pid files */
+        write_replies(reply_fd, replies, num_replies);
+    }
+
+    close(pipe_fd);
+    close(reply_fd);
 
-        watch_t *watch = find_watch(nyx, info.id);
+    capture_destroy(capture);
+    capture = NULL;
 
-        if (watch == NULL)
-        {
-            log_warn("forker: no watch with id %d found!", info.id);
-            continue;
-        }
+    free(poll_fds);
+    poll_fds = NULL;
 
-        pid_t pid = (info.start)
-            ? spawn_start(nyx, watch)
-            : spawn_stop(nyx, watch, info.pid);
+    free(exec_checks);
+    exec_checks = NULL;
 
-        write_pid(pid, watch->name, nyx);
+    if (plans)
+    {
+        hash_destroy(plans);
+        plans = NULL;
     }
 
-    close(pipe_fd);
+    if (listeners)
+    {
+        hash_destroy(listeners);
+        listeners = NULL;
+    }
 
     destroy_nyx(nyx);
 
@@ -550,43 +2046,240 @@ forker(nyx_t *nyx, int32_t pipe_fd)
 }
 
 static fork_info_t *
-forker_new(int32_t id, bool start, pid_t pid)
+forker_new(int32_t id, uint32_t instance, bool start, pid_t pid)
 {
+    static uint32_t sequence = 0;
+
     fork_info_t *info = xcalloc1(sizeof(fork_info_t));
 
     info->id = id;
+    info->instance = instance;
     info->start = start;
     info->pid = pid;
+    info->seq = __atomic_add_fetch(&sequence, 1, __ATOMIC_RELAXED);
+
+    return info;
+}
+
+fork_info_t *
+forker_stop(int32_t idx, uint32_t instance, pid_t pid)
+{
+    return forker_new(idx, instance, false, pid);
+}
+
+fork_info_t *
+forker_reload_process(int32_t idx, uint32_t instance, pid_t pid)
+{
+    fork_info_t *info = forker_new(idx, instance, false, pid);
+
+    info->reload = true;
 
     return info;
 }
 
 fork_info_t *
-forker_stop(int32_t idx, pid_t pid)
+forker_start(int32_t idx, uint32_t instance)
 {
-    return forker_new(idx, false, pid);
+    return forker_new(idx, instance, true, 0);
 }
 
 fork_info_t *
-forker_start(int32_t idx)
+forker_spare(int32_t idx, uint32_t instance)
 {
-    return forker_new(idx, true, 0);
+    fork_info_t *info = forker_new(idx, instance, true, 0);
+
+    info->spare = true;
+
+    return info;
 }
 
 fork_info_t *
 forker_reload(void)
 {
-    return forker_new(NYX_FORKER_RELOAD, true, 0);
+    return forker_new(NYX_FORKER_RELOAD, 0, true, 0);
+}
+
+/**
+ * @brief Run the 'check_exec' command of the given watch in the forker
+ * @param nyx       nyx instance
+ * @param id        ID of the watch
+ * @param instance  index of the watch's instance
+ * @param pid       PID of the checked process (passed as NYX_PID)
+ * @param timeout   deadline in milliseconds after which the command is killed
+ * @param result_fd descriptor of 'check_async_start' the result is reported
+ *                  on - owned by the forker's reply thread on success only
+ * @return true if the check was sent to the forker
+ */
+bool
+forker_check(nyx_t *nyx, int32_t id, uint32_t instance, pid_t pid, uint32_t timeout,
+        int32_t result_fd)
+{
+    fork_info_t *info = forker_new(id, instance, false, pid);
+
+    info->check = true;
+    info->timeout = timeout;
+
+    pthread_mutex_lock(&pending_lock);
+
+    if (pending_count >= pending_size)
+    {
+        uint32_t size = pending_size ? pending_size * 2 : 16;
+        pending_check_t *resized = realloc(pending_checks, size * sizeof(pending_check_t));
+
+        if (resized == NULL)
+            log_critical_perror("nyx: realloc");
+
+        pending_checks = resized;
+        pending_size = size;
+    }
+
+    pending_checks[pending_count++] = (pending_check_t) { info->seq, result_fd };
+
+    pthread_mutex_unlock(&pending_lock);
+
+    bool sent = write(nyx->forker_pipe, info, sizeof(fork_info_t)) != -1;
+
+    if (!sent)
+    {
+        log_perror("nyx: write");
+
+        pthread_mutex_lock(&pending_lock);
+
+        for (uint32_t i = 0; i < pending_count; i++)
+        {
+            if (pending_checks[i].seq == info->seq)
+            {
+                pending_checks[i] = pending_checks[--pending_count];
+                break;
+            }
+        }
+
+        pthread_mutex_unlock(&pending_lock);
+    }
+
+    free(info);
+
+    return sent;
+}
+
+/**
+ * @brief Number of checks running in the forker - checks that exceed their
+ *        deadline count until the forker killed them
+ */
+uint32_t
+forker_checks_running(void)
+{
+    pthread_mutex_lock(&pending_lock);
+    uint32_t count = pending_count;
+    pthread_mutex_unlock(&pending_lock);
+
+    return count;
+}
+
+/* report the result of a check of the forker */
+static void
+dispatch_check_result(const fork_reply_t *reply)
+{
+    int32_t result_fd = -1;
+
+    pthread_mutex_lock(&pending_lock);
+
+    for (uint32_t i = 0; i < pending_count; i++)
+    {
+        if (pending_checks[i].seq == reply->seq)
+        {
+            result_fd = pending_checks[i].result_fd;
+            pending_checks[i] = pending_checks[--pending_count];
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&pending_lock);
+
+    if (result_fd < 0)
+        return;
+
+    bool success = reply->error == 0 &&
+        WIFEXITED(reply->status) && WEXITSTATUS(reply->status) == 0;
+
+    log_debug("forker: check of watch id %d (instance %u) finished with status %d (errno %d)",
+            reply->id, reply->instance, reply->status, reply->error);
+
+    check_async_complete(result_fd, success);
+}
+
+/**
+ * @brief Thread dispatching the forker's replies to the
+ *        respective watch states
+ * @param nyx nyx instance
+ * @return NULL
+ */
+void *
+forker_reply_start(void *nyx)
+{
+    nyx_t *instance = nyx;
+    fork_reply_t replies[NYX_FORKER_BATCH];
+    ssize_t bytes = 0;
+
+    /* replies are written in whole batches that fit into PIPE_BUF
+     * so we never receive partial records */
+    while ((bytes = read(instance->forker_reply, replies, sizeof(replies))) > 0 ||
+            (bytes == -1 && errno == EINTR))
+    {
+        size_t count = bytes > 0 ? bytes / sizeof(fork_reply_t) : 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            fork_reply_t *reply = &replies[i];
+
+            if (reply->check)
+            {
+                dispatch_check_result(reply);
+                continue;
+            }
+
+            if (reply->activate)
+            {
+                dispatch_activation(reply, instance);
+                continue;
+            }
+
+            /* a child of the forker terminated */
+            if (reply->exited)
+            {
+                dispatch_exit(reply->pid, reply->status, instance);
+                continue;
+            }
+
+            log_debug("forker: watch id %d %s with pid %d (errno %d) at %lld",
+                    reply->id, reply->start ? "started" : "stopped",
+                    reply->pid, reply->error, (long long)reply->timestamp);
+
+            dispatch_spawn_result(reply, instance);
+        }
+    }
+
+    log_debug("forker: reply channel closed");
+
+    return NULL;
 }
 
 int32_t
 forker_init(nyx_t *nyx)
 {
     int32_t pipes[2] = {0};
+    int32_t replies[2] = {0};
 
     /* open pipes -> bail out if failed */
-    if (pipe(pipes) == -1)
+    if (!pipe_cloexec(pipes))
+        return 0;
+
+    if (!pipe_cloexec(replies))
+    {
+        close(pipes[0]);
+        close(pipes[1]);
         return 0;
+    }
 
     /* here we are still in the main nyx thread
      * we will fork now so both threads have access to both the read
@@ -603,21 +2296,30 @@ forker_init(nyx_t *nyx)
     {
         /* close the write end of the pipes first */
         close(pipes[1]);
+        close(replies[0]);
 
         /* ignore SIGINT - we are terminated by the main thread */
         signal(SIGINT, SIG_IGN);
 
+        /* a vanished reply reader must not kill the forker */
+        signal(SIGPIPE, SIG_IGN);
+
+        /* SIGHUP reopens the log of the daemon (e.g. 'killall -HUP nyx') */
+        signal(SIGHUP, SIG_IGN);
+
         /* enter the real fork processing logic now */
-        forker(nyx, pipes[0]);
+        forker(nyx, pipes[0], replies[1]);
         exit(EXIT_SUCCESS);
     }
 
     /* parent/main thread here:
      * close the read end of the pipes */
     close(pipes[0]);
+    close(replies[1]);
 
     /* set/refresh forker's pid */
     nyx->forker_pid = pid;
+    nyx->forker_reply = replies[0];
 
     /* return the write pipe descriptor */
     return pipes[1];
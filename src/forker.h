@@ -23,13 +23,53 @@
 /** magic number to trigger forker thread reload */
 #define NYX_FORKER_RELOAD -101
 
+/** maximum number of requests processed per read */
+#define NYX_FORKER_BATCH 32
+
+/** default deadline of the check commands (in seconds) */
+#define NYX_EXEC_CHECK_TIMEOUT 5
+
 typedef struct
 {
     int32_t id;
+    /** index of the watch's instance */
+    uint32_t instance;
     bool start;
+    /** start a standby process of a 'spare' watch */
+    bool spare;
+    /** run the watch's 'check_exec' command against 'pid' */
+    bool check;
+    /** run the watch's 'reload' command against 'pid' */
+    bool reload;
     pid_t pid;
+    uint32_t seq;
+    /** deadline of a check in milliseconds */
+    uint32_t timeout;
 } fork_info_t;
 
+/** reply of the forker process to a start/stop request or the exit
+ * of one of its children */
+typedef struct
+{
+    int32_t id;
+    uint32_t instance;
+    uint32_t seq;
+    bool start;
+    bool spare;
+    bool exited;
+    /** a check command finished (or could not be spawned) */
+    bool check;
+    /** a reload command was spawned (or could not be spawned) */
+    bool reload;
+    /** a socket of a lazily started watch received a connection */
+    bool activate;
+    pid_t pid;
+    int32_t error;
+    /** wait status of an exited child */
+    int32_t status;
+    int64_t timestamp;
+} fork_reply_t;
+
 int32_t
 forker_init(nyx_t *nyx);
 
@@ -37,9 +77,25 @@ fork_info_t *
 forker_reload(void);
 
 fork_info_t *
-forker_start(int32_t id);
+forker_start(int32_t id, uint32_t instance);
 
 fork_info_t *
-forker_stop(int32_t id, pid_t pid);
+forker_spare(int32_t id, uint32_t instance);
+
+fork_info_t *
+forker_stop(int32_t id, uint32_t instance, pid_t pid);
+
+fork_info_t *
+forker_reload_process(int32_t id, uint32_t instance, pid_t pid);
+
+bool
+forker_check(nyx_t *nyx, int32_t id, uint32_t instance, pid_t pid, uint32_t timeout,
+        int32_t result_fd);
+
+uint32_t
+forker_checks_running(void);
+
+void *
+forker_reply_start(void *nyx);
 
 /* vim: set et sw=4 sts=4 tw=80: */
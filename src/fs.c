@@ -68,7 +68,7 @@ get_current_dir(void)
             error = errno;
 
             size = size * 2;
-            free(buffer);
+            xfree(buffer);
             buffer = NULL;
         }
     } while (error == ERANGE);
@@ -78,7 +78,7 @@ get_current_dir(void)
      * path like '/some/where' */
     if (buffer && *buffer != '/')
     {
-        free(buffer);
+        xfree(buffer);
         return NULL;
     }
 
@@ -183,7 +183,7 @@ create_if_not_exists(const char *file)
     if (file == NULL || *file == '\0')
         return false;
 
-    char *prepared = strdup(prepare_dir(file));
+    char *prepared = xstrdup(prepare_dir(file));
 
     if (prepared == NULL)
         log_critical_perror("nyx: strdup");
@@ -192,14 +192,14 @@ create_if_not_exists(const char *file)
 
     if (dir && !empty_or_whitespace(dir))
     {
-        const char *check = strdup(dir);
+        const char *check = xstrdup(dir);
 
         if (check == NULL)
             log_critical_perror("nyx: strdup");
 
         success = dir_exists(check) || mkdir_p(check);
 
-        free((void *)check);
+        xfree((void *)check);
     }
     /* there is no directory at all (e.g. current directory) */
     else
@@ -208,7 +208,7 @@ create_if_not_exists(const char *file)
     }
 
     if (prepared)
-        free(prepared);
+        xfree(prepared);
 
     return success;
 }
@@ -225,7 +225,7 @@ local_pid_dir(const char *local_dir)
 
     if (snprintf(buffer, len-1, "%s%s", local_dir, pid_dir) < 0)
     {
-        free(buffer);
+        xfree(buffer);
         return NULL;
     }
 
@@ -248,7 +248,7 @@ local_socket_path(const char *local_dir)
 
     if (snprintf(buffer, len-1, "%s%s", pos, pid_dir) < 0)
     {
-        free(buffer);
+        xfree(buffer);
         return NULL;
     }
 
@@ -264,7 +264,7 @@ find_local_socket_path(const char *start_dir)
     /* max directory depth to walk up */
     int max_depth = 8;
 
-    const char *dir = strdup(start_dir);
+    const char *dir = xstrdup(start_dir);
     if (dir == NULL)
         log_critical_perror("nyx: strdup");
 
@@ -274,25 +274,25 @@ find_local_socket_path(const char *start_dir)
 
         if (file_exists(local_dir))
         {
-            free((void *)dir);
+            xfree((void *)dir);
             return local_dir;
         }
 
         /* directory does not exist */
         if (local_dir != NULL)
         {
-            free((void *)local_dir);
+            xfree((void *)local_dir);
         }
 
         /* walk up one directory */
         const char *parent = parent_dir(dir);
 
-        free((void *)dir);
+        xfree((void *)dir);
         dir = parent;
     }
 
     if (dir)
-        free((void *)dir);
+        xfree((void *)dir);
 
     return NULL;
 }
@@ -310,7 +310,7 @@ determine_socket_path(const char *local_dir, bool local_only)
         if (file_exists(local_socket))
             return local_socket;
 
-        free((void *)local_socket);
+        xfree((void *)local_socket);
         local_socket = NULL;
     }
 
@@ -319,7 +319,7 @@ determine_socket_path(const char *local_dir, bool local_only)
     if (local_only)
         return NULL;
 
-    return strdup(NYX_SOCKET_ADDR);
+    return xstrdup(NYX_SOCKET_ADDR);
 }
 
 static const char *
@@ -327,7 +327,7 @@ determine_pid_dir_from(const char **dir_candidates)
 {
     while (*dir_candidates)
     {
-        const char *prepared = strdup(prepare_dir(*dir_candidates));
+        const char *prepared = xstrdup(prepare_dir(*dir_candidates));
 
         if (prepared == NULL)
         {
@@ -347,7 +347,7 @@ determine_pid_dir_from(const char **dir_candidates)
             }
         }
 
-        free((void *)prepared);
+        xfree((void *)prepared);
 
         dir_candidates++;
     }
@@ -374,7 +374,7 @@ determine_local_pid_dir(const char *local_dir)
     const char *candidates[] = { dir, NULL };
     const char *result = determine_pid_dir_from(candidates);
 
-    free((char *)dir);
+    xfree((char *)dir);
     return result;
 }
 
@@ -397,7 +397,7 @@ open_pid_file(const char *pid_dir, const char *name, const char *mode)
     char *location = get_pid_file(pid_dir, name);
     FILE *pid_file = fopen(location, mode);
 
-    free(location);
+    xfree(location);
     return pid_file;
 }
 
@@ -410,10 +410,51 @@ remove_pid_file(const char *pid_dir, const char *name)
     char *location = get_pid_file(pid_dir, name);
     bool success = remove(location) == 0;
 
-    free(location);
+    xfree(location);
     return success;
 }
 
+char *
+get_notify_socket_path(const char *pid_dir, const char *name)
+{
+    char *buffer = xcalloc(512, sizeof(char));
+
+    snprintf(buffer, 511, "%s/%s.notify", pid_dir, name);
+
+    return buffer;
+}
+
+/**
+ * @brief Build the path of the socket all watchdog heartbeats are sent to
+ * @param pid_dir nyx pid directory
+ * @return newly allocated path
+ */
+char *
+get_watchdog_socket_path(const char *pid_dir)
+{
+    char *buffer = xcalloc(512, sizeof(char));
+
+    snprintf(buffer, 511, "%s/watchdog.sock", pid_dir);
+
+    return buffer;
+}
+
+/**
+ * @brief Determine the modification time of a file (in nanosecond
+ *        precision if supported)
+ * @param st file status
+ * @return modification time
+ */
+struct timespec
+file_mtime(const struct stat *st)
+{
+#ifdef OSX
+    return st->st_mtimespec;
+#else
+    return st->st_mtim;
+#endif
+}
+
 bool
 file_exists(const char *file)
 {
@@ -448,7 +489,7 @@ bool
 is_directory(const char *path)
 {
     bool is_dir = false;
-    char *copy = strdup(prepare_dir(path));
+    char *copy = xstrdup(prepare_dir(path));
 
     if (copy == NULL)
         log_critical_perror("nyx: strdup");
@@ -459,7 +500,7 @@ is_directory(const char *path)
         is_dir = S_ISDIR(path_stat.st_mode);
     }
 
-    free(copy);
+    xfree(copy);
     return is_dir;
 }
 
@@ -470,7 +511,7 @@ parent_dir(const char *directory)
     if (directory == NULL || *directory != '/' || strlen(directory) <= 1)
         return NULL;
 
-    char *input = strdup(directory);
+    char *input = xstrdup(directory);
     if (input == NULL)
         log_critical_perror("nyx: strdup");
 
@@ -479,12 +520,12 @@ parent_dir(const char *directory)
     /* GNU dirname might return an empty string */
     if (parent && *parent != '.' && !empty_or_whitespace(parent))
     {
-        const char *result = strdup(parent);
-        free(input);
+        const char *result = xstrdup(parent);
+        xfree(input);
         return result;
     }
 
-    free(input);
+    xfree(input);
     return NULL;
 }
 
@@ -492,7 +533,7 @@ bool
 dir_writable(const char *directory)
 {
     bool writable = false;
-    char *copy = strdup(prepare_dir(directory));
+    char *copy = xstrdup(prepare_dir(directory));
 
     if (copy == NULL)
         log_critical_perror("nyx: strdup");
@@ -510,7 +551,7 @@ dir_writable(const char *directory)
             writable = true;
     }
 
-    free(copy);
+    xfree(copy);
 
     return writable;
 }
@@ -17,7 +17,9 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 
 bool
 is_directory(const char *path);
@@ -25,6 +27,9 @@ is_directory(const char *path);
 bool
 dir_writable(const char *directory);
 
+struct timespec
+file_mtime(const struct stat *st);
+
 bool
 file_exists(const char *file);
 
@@ -58,6 +63,12 @@ open_pid_file(const char *pid_dir, const char *name, const char *mode);
 bool
 remove_pid_file(const char *pid_dir, const char *name);
 
+char *
+get_notify_socket_path(const char *pid_dir, const char *name);
+
+char *
+get_watchdog_socket_path(const char *pid_dir);
+
 const char *
 get_current_dir(void);
 
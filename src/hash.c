@@ -13,6 +13,8 @@
  * limitations under the License.
  */
 
+#define NYX_MEM_TAG MEM_HASH
+
 #include "def.h"
 #include "hash.h"
 #include "log.h"
@@ -21,112 +23,192 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define NYX_HASH_MAX_FACTOR 1.3
 #define NYX_HASH_INITIAL_SIZE 8
-#define NYX_HASH_KEY_MAXLEN 100
 
-static uint64_t
-hash_string(const char *str)
+/*
+ * wyhash (public domain, Wang Yi) - the keys are mostly short names for
+ * which it needs a handful of multiplications only
+ */
+
+static const uint64_t wyhash_secret[] =
 {
-    int32_t c;
-    uint64_t hash = 5381;
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
 
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c;
-    }
-    return hash;
+static inline void
+wy_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t result = *a;
+    result *= *b;
+
+    *a = (uint64_t)result;
+    *b = (uint64_t)(result >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+
+    c += lo < t;
+
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
 }
 
-hash_t *
-hash_new_initial(uint32_t initial_size, callback_t free_value)
+static inline uint64_t
+wy_mix(uint64_t a, uint64_t b)
 {
-    hash_t *hash = xcalloc1(sizeof(hash_t));
-
-    initial_size = initial_size > 0 ? initial_size : NYX_HASH_INITIAL_SIZE;
-
-    hash->bucket_count = initial_size;
-    hash->buckets = xcalloc(initial_size, sizeof(bucket_t));
-    hash->free_value = free_value;
+    wy_mum(&a, &b);
+    return a ^ b;
+}
 
-    return hash;
+static inline uint64_t
+wy_read64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
 }
 
-hash_t *
-hash_new(callback_t free_value)
+static inline uint64_t
+wy_read32(const uint8_t *p)
 {
-    return hash_new_initial(NYX_HASH_INITIAL_SIZE, free_value);
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
 }
 
-static pair_t *
-get_pair(bucket_t *bucket, const char *key, uint32_t *idx)
+static inline uint64_t
+wy_read3(const uint8_t *p, size_t length)
 {
-    *idx = 0;
-    uint32_t count = bucket->count;
-    pair_t *pair = NULL;
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+}
 
-    if (count < 1)
-        return NULL;
+/**
+ * @brief Hash the given string
+ * @param str    string to hash
+ * @param length length of the string
+ * @return 64-bit hash value
+ */
+uint64_t
+hash_string(const char *str, size_t length)
+{
+    const uint8_t *p = (const uint8_t *)str;
+    const uint64_t *secret = wyhash_secret;
+    uint64_t seed = wy_mix(secret[0], secret[1]);
+    uint64_t a = 0, b = 0;
 
-    pair = bucket->pairs;
+    if (length <= 16)
+    {
+        if (length >= 4)
+        {
+            size_t shift = (length >> 3) << 2;
 
-    while (*idx < count)
+            a = (wy_read32(p) << 32) | wy_read32(p + shift);
+            b = (wy_read32(p + length - 4) << 32) | wy_read32(p + length - 4 - shift);
+        }
+        else if (length > 0)
+            a = wy_read3(p, length);
+    }
+    else
     {
-        if (pair->key != NULL &&
-            strncmp(pair->key, key, NYX_HASH_KEY_MAXLEN) == 0)
-            return pair;
+        size_t left = length;
+
+        if (left > 48)
+        {
+            uint64_t see1 = seed, see2 = seed;
+
+            do
+            {
+                seed = wy_mix(wy_read64(p) ^ secret[1], wy_read64(p + 8) ^ seed);
+                see1 = wy_mix(wy_read64(p + 16) ^ secret[2], wy_read64(p + 24) ^ see1);
+                see2 = wy_mix(wy_read64(p + 32) ^ secret[3], wy_read64(p + 40) ^ see2);
+                p += 48;
+                left -= 48;
+            }
+            while (left > 48);
+
+            seed ^= see1 ^ see2;
+        }
+
+        while (left > 16)
+        {
+            seed = wy_mix(wy_read64(p) ^ secret[1], wy_read64(p + 8) ^ seed);
+            p += 16;
+            left -= 16;
+        }
 
-        pair++; (*idx)++;
+        a = wy_read64(p + left - 16);
+        b = wy_read64(p + left - 8);
     }
 
-    return NULL;
+    a ^= secret[1];
+    b ^= seed;
+
+    wy_mum(&a, &b);
+
+    return wy_mix(a ^ secret[0] ^ length, b ^ secret[1]);
 }
 
-static void
-bucket_destroy(bucket_t *bucket, callback_t free_func)
+static uint32_t
+round_capacity(uint32_t size)
 {
-    uint32_t i = 0;
-    uint32_t count = bucket->count;
-    pair_t *pair = NULL;
+    uint32_t capacity = NYX_HASH_INITIAL_SIZE;
 
-    if (count < 1)
-        return;
+    while (capacity < size)
+        capacity <<= 1;
 
-    pair = bucket->pairs;
+    return capacity;
+}
 
-    while (i < count)
-    {
-        free((void *)pair->key);
+hash_t *
+hash_new_initial(uint32_t initial_size, callback_t free_value)
+{
+    hash_t *hash = xcalloc1(sizeof(hash_t));
 
-        if (free_func != NULL && pair->data != NULL)
-            free_func(pair->data);
+    /* the pairs and slots are allocated with the first key */
+    hash->capacity = round_capacity(initial_size);
+    hash->free_value = free_value;
 
-        pair++; i++;
-    }
+    return hash;
+}
+
+hash_t *
+hash_new(callback_t free_value)
+{
+    return hash_new_initial(NYX_HASH_INITIAL_SIZE, free_value);
+}
+
+static void
+free_pair(hash_t *hash, pair_t *pair, bool free_value)
+{
+    xfree((void *)pair->key);
+
+    if (free_value && hash->free_value != NULL && pair->data != NULL)
+        hash->free_value(pair->data);
 
-    free(bucket->pairs);
+    pair->key = NULL;
+    pair->data = NULL;
 }
 
 void
 hash_destroy(hash_t *hash)
 {
-    uint32_t i = 0, count = 0;
-    bucket_t *bucket = NULL;
-
     if (hash == NULL)
         return;
 
-    bucket = hash->buckets;
-    count = hash->bucket_count;
-
-    while (i < count)
+    for (uint32_t idx = 0; idx < hash->used; idx++)
     {
-        bucket_destroy(bucket, hash->free_value);
-
-        bucket++; i++;
+        if (hash->pairs[idx].key)
+            free_pair(hash, &hash->pairs[idx], true);
     }
 
-    free(hash->buckets);
-    free(hash);
+    xfree(hash->pairs);
+    xfree(hash->slots);
+    xfree(hash);
 }
 
 uint32_t
@@ -138,62 +220,137 @@ hash_count(hash_t *hash)
     return hash->count;
 }
 
-static bucket_t *
-get_bucket(hash_t *hash, const char *key)
+/* distance of the slot's pair from its ideal position */
+static inline uint32_t
+probe_distance(const hash_slot_t *slot, uint32_t idx, uint32_t mask)
 {
-    uint64_t keyhash = hash_string(key);
-
-    return &(hash->buckets[keyhash % hash->bucket_count]);
+    return (idx - slot->hash) & mask;
 }
 
 static void
-rehash(hash_t* hash)
+insert_slot(hash_t *hash, uint32_t pair, uint64_t keyhash)
 {
-    uint32_t i = 0;
-    uint32_t old_bucket_count = hash->bucket_count;
-    hash->bucket_count = old_bucket_count * 2;
+    const uint32_t mask = hash->slot_mask;
+    hash_slot_t entry = { .pair = pair + 1, .hash = (uint32_t)keyhash };
+    uint32_t idx = entry.hash & mask;
+    uint32_t distance = 0;
+
+    while (true)
+    {
+        hash_slot_t *slot = &hash->slots[idx];
+
+        if (slot->pair == 0)
+        {
+            *slot = entry;
+            return;
+        }
+
+        /* Robin Hood: take the slot of a pair that is closer to its
+         * ideal position and continue with that one instead */
+        uint32_t existing = probe_distance(slot, idx, mask);
+
+        if (existing < distance)
+        {
+            hash_slot_t swap = *slot;
+
+            *slot = entry;
+            entry = swap;
+            distance = existing;
+        }
+
+        idx = (idx + 1) & mask;
+        distance++;
+    }
+}
 
-    bucket_t *old_bucket = hash->buckets;
-    bucket_t *old_buckets = hash->buckets;
+static bool
+find_slot(hash_t *hash, const char *key, size_t length, uint64_t keyhash, uint32_t *found)
+{
+    const uint32_t mask = hash->slot_mask;
+    uint32_t idx = (uint32_t)keyhash & mask;
 
-    hash->buckets = xcalloc(hash->bucket_count, sizeof(bucket_t));
+    if (hash->slots == NULL)
+        return false;
 
-    /* iterate old buckets */
-    while (i < old_bucket_count)
+    for (uint32_t distance = 0; ; distance++, idx = (idx + 1) & mask)
     {
-        uint32_t j = 0, pairs = old_bucket->count;
-        pair_t *pair = old_bucket->pairs;
+        const hash_slot_t *slot = &hash->slots[idx];
+
+        /* the key would have displaced a pair closer to its ideal slot */
+        if (slot->pair == 0 || probe_distance(slot, idx, mask) < distance)
+            return false;
+
+        if (slot->hash != (uint32_t)keyhash)
+            continue;
 
-        while (j < pairs)
+        const pair_t *pair = &hash->pairs[slot->pair - 1];
+
+        if (pair->hash == keyhash && pair->length == length &&
+                memcmp(pair->key, key, length) == 0)
         {
-            /* find new bucket */
-            bucket_t *new_bucket = get_bucket(hash, pair->key);
+            *found = idx;
+            return true;
+        }
+    }
+}
 
-            if (new_bucket->count < 1)
-            {
-                new_bucket->pairs = xcalloc1(sizeof(pair_t));
-            }
-            else
-            {
-                new_bucket->pairs = realloc(new_bucket->pairs,
-                        sizeof(pair_t) * (new_bucket->count + 1));
-            }
+/* rebuild the slots from the cached hashes */
+static void
+rebuild_slots(hash_t *hash)
+{
+    memset(hash->slots, 0, (hash->slot_mask + 1) * sizeof(hash_slot_t));
+
+    for (uint32_t idx = 0; idx < hash->used; idx++)
+    {
+        if (hash->pairs[idx].key)
+            insert_slot(hash, idx, hash->pairs[idx].hash);
+    }
+}
+
+/* make room for another pair: either the holes of removed pairs are
+ * closed or the pairs and slots double in size */
+static void
+reserve(hash_t *hash)
+{
+    if (hash->pairs == NULL)
+    {
+        hash->pairs = xcalloc(hash->capacity, sizeof(pair_t));
+        hash->slots = xcalloc(hash->capacity * 2, sizeof(hash_slot_t));
+        hash->slot_mask = hash->capacity * 2 - 1;
+        return;
+    }
 
-            memmove(&new_bucket->pairs[new_bucket->count],
-                    pair, sizeof(pair_t));
+    if (hash->used < hash->capacity)
+        return;
 
-            new_bucket->count++;
+    if (hash->count <= hash->capacity / 2)
+    {
+        uint32_t used = 0;
 
-            j++; pair++;
+        for (uint32_t idx = 0; idx < hash->used; idx++)
+        {
+            if (hash->pairs[idx].key)
+                hash->pairs[used++] = hash->pairs[idx];
         }
 
-        if (old_bucket->pairs)
-            free(old_bucket->pairs);
+        memset(hash->pairs + used, 0, (hash->used - used) * sizeof(pair_t));
+        hash->used = used;
+    }
+    else
+    {
+        uint32_t capacity = hash->capacity * 2;
+        pair_t *pairs = xrealloc(hash->pairs, capacity * sizeof(pair_t));
+        hash_slot_t *slots = xrealloc(hash->slots, capacity * 2 * sizeof(hash_slot_t));
+
+        memset(pairs + hash->capacity, 0, hash->capacity * sizeof(pair_t));
 
-        i++; old_bucket++;
+        hash->pairs = pairs;
+        hash->slots = slots;
+        hash->capacity = capacity;
+        hash->slot_mask = capacity * 2 - 1;
     }
 
-    free(old_buckets);
+    rebuild_slots(hash);
 }
 
 bool
@@ -201,52 +358,32 @@ hash_add(hash_t *hash, const char *key, void *data)
 {
     uint32_t idx = 0;
 
-    bucket_t *bucket = NULL;
-    pair_t *pair = NULL;
-
     if (hash == NULL || key == NULL)
         return false;
 
-    bucket = get_bucket(hash, key);
-    pair = get_pair(bucket, key, &idx);
+    size_t length = strlen(key);
+    uint64_t keyhash = hash_string(key, length);
 
-    /* there is already a matching pair in the current bucket */
-    if (pair != NULL)
+    /* there is already a pair with the same key */
+    if (find_slot(hash, key, length, keyhash, &idx))
         return false;
 
-    uint32_t bucket_count = bucket->count;
+    reserve(hash);
 
-    /* the bucket is empty */
-    if (bucket_count < 1)
-    {
-        bucket->pairs = xcalloc(1, sizeof(pair_t));
+    pair_t *pair = &hash->pairs[hash->used];
+    char *key_cpy = xcalloc(length + 1, sizeof(char));
 
-        pair = bucket->pairs;
-    }
-    /* reallocate the existing bucket */
-    else
-    {
-        bucket->pairs = realloc(bucket->pairs, sizeof(pair_t) * (bucket_count + 1));
-        pair = &(bucket->pairs[bucket_count]);
-    }
-
-    /* determine maximum key length */
-    size_t keylen = strlen(key);
-    size_t len = keylen > NYX_HASH_KEY_MAXLEN ? NYX_HASH_KEY_MAXLEN : keylen;
-
-    /* copy and assign key */
-    char *key_cpy = xcalloc(len+1, sizeof(char));
-    strncpy(key_cpy, key, len);
+    memcpy(key_cpy, key, length);
 
     pair->key = key_cpy;
     pair->data = data;
+    pair->hash = keyhash;
+    pair->length = length;
 
-    bucket->count++;
-    hash->count++;
+    insert_slot(hash, hash->used, keyhash);
 
-    double factor = (double)(hash->count) / hash->bucket_count;
-    if (factor >= NYX_HASH_MAX_FACTOR)
-        rehash(hash);
+    hash->used++;
+    hash->count++;
 
     return true;
 }
@@ -259,74 +396,77 @@ hash_get(hash_t *hash, const char* key)
     if (hash == NULL || key == NULL)
         return NULL;
 
-    bucket_t *bucket = get_bucket(hash, key);
-    pair_t *pair = get_pair(bucket, key, &idx);
+    size_t length = strlen(key);
 
-    if (pair == NULL)
+    if (!find_slot(hash, key, length, hash_string(key, length), &idx))
         return NULL;
 
-    return pair->data;
+    return hash->pairs[hash->slots[idx].pair - 1].data;
 }
 
-bool
-hash_remove(hash_t *hash, const char *key)
+static bool
+remove_pair(hash_t *hash, const char *key, void **data)
 {
+    uint32_t idx = 0;
+
     if (hash == NULL || key == NULL)
         return false;
 
-    bucket_t *bucket = get_bucket(hash, key);
+    size_t length = strlen(key);
 
-    if (bucket == NULL)
+    if (!find_slot(hash, key, length, hash_string(key, length), &idx))
         return false;
 
-    uint32_t idx = 0;
-    pair_t *pair = get_pair(bucket, key, &idx);
+    pair_t *pair = &hash->pairs[hash->slots[idx].pair - 1];
 
-    if (pair == NULL)
-        return false;
+    /* free key and value memory (unless the value is taken) */
+    if (data != NULL)
+        *data = pair->data;
 
-    /* free key and value memory */
-    free((char *)pair->key);
-    hash->free_value(pair->data);
+    free_pair(hash, pair, data == NULL);
 
-    hash->count--;
-    bucket->count--;
+    /* shift the following pairs back towards their ideal slots */
+    const uint32_t mask = hash->slot_mask;
+    uint32_t next = (idx + 1) & mask;
 
-    pair_t *new_pairs = bucket->count
-        ? xcalloc(bucket->count, sizeof(pair_t))
-        : NULL;
-
-    for (uint32_t i = 0; i<bucket->count+1; i++)
+    while (hash->slots[next].pair && probe_distance(&hash->slots[next], next, mask) > 0)
     {
-        if (i == idx)
-            continue;
-
-        pair = &bucket->pairs[i];
-
-        uint32_t j = i > idx ? i-1 : i;
-
-        new_pairs[j].key = pair->key;
-        new_pairs[j].data = pair->data;
+        hash->slots[idx] = hash->slots[next];
+        idx = next;
+        next = (next + 1) & mask;
     }
 
-    free(bucket->pairs);
-    bucket->pairs = new_pairs;
+    hash->slots[idx].pair = 0;
+    hash->count--;
+
+    /* the slots are all empty already */
+    if (hash->count < 1)
+        hash->used = 0;
 
     return true;
 }
 
-static void
-hash_iter_init(hash_iter_t *iter, hash_t *hash)
+bool
+hash_remove(hash_t *hash, const char *key)
 {
-    iter->_hash = hash;
-    iter->_pair = 0;
-    iter->_bucket = 0;
+    return remove_pair(hash, key, NULL);
+}
 
-    while (hash->bucket_count > iter->_bucket &&
-            hash->buckets[iter->_bucket].count == 0)
-    {
-        iter->_bucket += 1;
-    }
+/**
+ * @brief Remove the given key from the hash without freeing its value
+ * @param hash hash instance
+ * @param key  key to remove
+ * @return the removed value or NULL if the key does not exist
+ */
+void *
+hash_take(hash_t *hash, const char *key)
+{
+    void *data = NULL;
+
+    if (!remove_pair(hash, key, &data))
+        return NULL;
+
+    return data;
 }
 
 hash_iter_t *
@@ -334,15 +474,21 @@ hash_iter_start(hash_t *hash)
 {
     hash_iter_t *iter = xcalloc1(sizeof(hash_iter_t));
 
-    hash_iter_init(iter, hash);
+    iter->_hash = hash;
 
     return iter;
 }
 
+void
+hash_iter_free(hash_iter_t *iter)
+{
+    xfree(iter);
+}
+
 void
 hash_iter_rewind(hash_iter_t *iter)
 {
-    hash_iter_init(iter, iter->_hash);
+    iter->_pair = 0;
 }
 
 bool
@@ -353,34 +499,20 @@ hash_iter(hash_iter_t *iter, const char **key, void **data)
 
     const hash_t *hash = iter->_hash;
 
-    if (hash->bucket_count <= iter->_bucket)
-        return false;
-
-    const bucket_t *bucket = hash->buckets + iter->_bucket;
-
-    if (bucket == NULL ||
-            (bucket->count <= iter->_pair && hash->bucket_count <= iter->_bucket))
-        return false;
+    while (iter->_pair < hash->used)
+    {
+        const pair_t *pair = &hash->pairs[iter->_pair++];
 
-    *key = bucket->pairs[iter->_pair].key;
-    *data = bucket->pairs[iter->_pair].data;
+        if (pair->key == NULL)
+            continue;
 
-    /* proceed iterator */
-    if ((iter->_pair + 1) >= bucket->count)
-    {
-        do
-        {
-            iter->_bucket += 1;
-        }
-        while (hash->bucket_count > iter->_bucket &&
-                hash->buckets[iter->_bucket].count == 0);
+        *key = pair->key;
+        *data = pair->data;
 
-        iter->_pair = 0;
+        return true;
     }
-    else
-        iter->_pair += 1;
 
-    return true;
+    return false;
 }
 
 uint32_t
@@ -394,20 +526,15 @@ hash_filter(hash_t *hash, filter_callback_t filter_func)
     void *data = NULL;
     hash_iter_t *iter = hash_iter_start(hash);
 
+    /* removing the current key does not disturb the iteration */
     while (hash_iter(iter, &key, &data))
     {
         /* predicate matches -> remove */
-        if (filter_func(data))
-        {
-            if (hash_remove(hash, key))
-            {
-                hash_iter_rewind(iter);
-                filtered++;
-            }
-        }
+        if (filter_func(data) && hash_remove(hash, key))
+            filtered++;
     }
 
-    free(iter);
+    hash_iter_free(iter);
 
     return filtered;
 }
@@ -415,25 +542,12 @@ hash_filter(hash_t *hash, filter_callback_t filter_func)
 void
 hash_foreach(hash_t *hash, void (*func)(void *))
 {
-    uint32_t i = 0;
-    uint32_t bucket_count = hash->bucket_count;
-
-    bucket_t *bucket = hash->buckets;
-
-    while (i < bucket_count)
+    for (uint32_t idx = 0; idx < hash->used; idx++)
     {
-        uint32_t j = 0, pairs = bucket->count;
-        pair_t *pair = bucket->pairs;
-
-        while (j < pairs)
-        {
-            if (pair->data != NULL)
-                func(pair->data);
-
-            pair++; j++;
-        }
+        pair_t *pair = &hash->pairs[idx];
 
-        bucket++; i++;
+        if (pair->key != NULL && pair->data != NULL)
+            func(pair->data);
     }
 }
 
@@ -16,6 +16,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef void (*callback_t)(void *value);
@@ -26,21 +27,37 @@ typedef struct
 {
     const char *key;
     void *data;
+    /** cached hash of the key */
+    uint64_t hash;
+    uint32_t length;
 } pair_t;
 
+/** open-addressing slot referencing a pair */
 typedef struct
 {
-    uint32_t count;
-    pair_t *pairs;
-} bucket_t;
-
+    /** index of the pair + 1 (0 meaning an empty slot) */
+    uint32_t pair;
+    /** lower bits of the key's hash to skip most mismatches */
+    uint32_t hash;
+} hash_slot_t;
+
+/**
+ * String hash table using Robin Hood open addressing: the pairs are
+ * stored densely in insertion order (removed pairs are left as holes
+ * with a NULL key until the next compaction) and the slots index into
+ * them. Growing the table only rebuilds the slots from the cached hashes.
+ */
 typedef struct
 {
     uint32_t count;
-    uint32_t bucket_count;
-    bucket_t *buckets;
+    /** number of pairs in use (including the removed ones) */
+    uint32_t used;
+    uint32_t capacity;
+    pair_t *pairs;
+    /** number of slots minus one (twice the capacity) */
+    uint32_t slot_mask;
+    hash_slot_t *slots;
     callback_t free_value;
-
 } hash_t;
 
 typedef struct
@@ -49,13 +66,19 @@ typedef struct
     void *v;
 } key_value_t;
 
+/**
+ * Iterator in insertion order - the current key may be removed during
+ * the iteration without affecting the remaining ones.
+ */
 typedef struct
 {
     hash_t *_hash;
-    uint32_t _bucket;
     uint32_t _pair;
 } hash_iter_t;
 
+uint64_t
+hash_string(const char *str, size_t length);
+
 hash_t *
 hash_new(callback_t free_value);
 
@@ -74,6 +97,9 @@ hash_get(hash_t *hash, const char* key);
 hash_iter_t *
 hash_iter_start(hash_t *hash);
 
+void
+hash_iter_free(hash_iter_t *iter);
+
 void
 hash_iter_rewind(hash_iter_t *iter);
 
@@ -89,6 +115,9 @@ hash_count(hash_t *hash);
 bool
 hash_remove(hash_t *hash, const char *key);
 
+void *
+hash_take(hash_t *hash, const char *key);
+
 uint32_t
 hash_filter(hash_t *hash, filter_callback_t filter_func);
 
@@ -15,104 +15,247 @@
 
 #define _GNU_SOURCE
 
+#define NYX_LOG_CATEGORY NYX_LOG_CONNECTOR
+#define NYX_MEM_TAG MEM_CONNECTOR
+
 #include "command.h"
+#include "def.h"
 #include "http.h"
 #include "log.h"
 #include "nyx.h"
+#include "prometheus.h"
+#include "reactor.h"
 #include "socket.h"
 #include "strbuf.h"
+#include "subscribe.h"
 #include "utils.h"
 
 #include <errno.h>
 #include <inttypes.h>
 #include <netdb.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
-#define NYX_MAX_REQUEST_LEN 1024
-
 #define CRLF "\r\n"
 
-#define NYX_RESPONSE_HEADER \
-    "HTTP/1.0 200 OK" CRLF \
-    "Server: nyx" CRLF \
-    "Content-Type: text/plain" CRLF
+/* the response is queued in the connection's output and sent
+ * by conn_flush() as soon as the socket is writable */
+static void
+send_response_type(http_conn_t *conn, const char *status, bool keep_alive,
+        const char *headers, const char *content_type, const char *body, size_t length)
+{
+    strbuf_t *output = conn->output;
 
-static bool
-not_found(int32_t fd)
+    strbuf_append(output,
+            "HTTP/1.1 %s" CRLF
+            "Server: nyx" CRLF
+            "Connection: %s" CRLF
+            "%s",
+            status, keep_alive ? "keep-alive" : "close", headers ? headers : "");
+
+    /* a 304 response must not carry a body */
+    if (body)
+    {
+        strbuf_append_string(output, "Content-Type: ");
+        strbuf_append_string(output, content_type);
+        strbuf_append_string(output, CRLF "Content-Length: ");
+        strbuf_append_uint(output, length);
+        strbuf_append_string(output, CRLF CRLF);
+        strbuf_append_data(output, body, length);
+    }
+    else
+        strbuf_append_string(output, CRLF);
+}
+
+static void
+send_response(http_conn_t *conn, const char *status, bool keep_alive,
+        const char *headers, const char *body, size_t length)
 {
-    const char response[] = "HTTP/1.0 404 Not Found" CRLF
-        "Server: nyx" CRLF
-        "Content-Length: 10" CRLF
-        "Content-Type: text/plain" CRLF CRLF
-        "not found";
+    send_response_type(conn, status, keep_alive, headers, "text/plain", body, length);
+}
 
-    return send_safe(fd, response, LEN(response)) > 0;
+static void
+not_found(http_conn_t *conn, bool keep_alive)
+{
+    send_response(conn, "404 Not Found", keep_alive, NULL, "not found\n", 10);
+}
+
+static void
+not_modified(http_conn_t *conn, bool keep_alive, const char *etag)
+{
+    char header[128];
+
+    snprintf(header, LEN(header), "ETag: %s" CRLF, etag);
+
+    send_response(conn, "304 Not Modified", keep_alive, header, NULL, 0);
+}
+
+static void
+bad_request(http_conn_t *conn)
+{
+    send_response(conn, "400 Bad Request", false, NULL, "bad request\n", 12);
+}
+
+/* length of the line starting at 'line' (excluding its CRLF) */
+static size_t
+line_length(const char *line, const char *end)
+{
+    const char *eol = memmem(line, end - line, CRLF, 2);
+
+    return (eol ? eol : end) - line;
 }
 
 static bool
-bad_request(int32_t fd)
+header_is(const char *line, size_t length, const char *name)
 {
-    const char response[] = "HTTP/1.0 400 Bad Request" CRLF
-        "Server: nyx" CRLF
-        "Content-Length: 12" CRLF
-        "Content-Type: text/plain" CRLF CRLF
-        "bad request";
+    size_t name_length = strlen(name);
 
-    return send_safe(fd, response, LEN(response)) > 0;
+    return length > name_length && line[name_length] == ':' &&
+        !strncasecmp(line, name, name_length);
 }
 
-static uintptr_t
-parse_header(epoll_extra_data_t *extra)
+static bool
+value_contains(const char *value, size_t length, const char *token)
 {
-    char *buffer = extra->buffer;
-    char *hd_http, *hd_method, *hd_uri, *save_ptr;
+    size_t token_length = strlen(token);
 
-    /* minimum header length */
-    if (extra->pos < 4)
-        return 0;
+    for (size_t idx = 0; idx + token_length <= length; idx++)
+    {
+        if (!strncasecmp(value + idx, token, token_length))
+            return true;
+    }
 
-    /* parse method */
-    hd_method = strtok_r(buffer, " ", &save_ptr);
-    if (hd_method == NULL)
-        return 0;
+    return false;
+}
 
-    /* currently GET is supported only */
-    if (strncmp(hd_method, "GET", 3) != 0)
-        return 0;
+static bool
+parse_content_length(const char *value, size_t length, uint64_t *content_length)
+{
+    char *end = NULL;
 
-    /* parse uri */
-    hd_uri = strtok_r(NULL, " ", &save_ptr);
-    if (hd_uri == NULL || *hd_uri != '/')
-        return 0;
+    /* strtoull would accept signs and leading whitespace as well */
+    if (length < 1 || value[0] < '0' || value[0] > '9')
+        return false;
 
-    /* parse http version */
-    hd_http = strtok_r(NULL, " ", &save_ptr);
-    if (hd_http == NULL)
-        return 0;
+    errno = 0;
+    unsigned long long parsed = strtoull(value, &end, 10);
 
-    if (strncmp(hd_http, "HTTP/1.", 7) != 0)
-        return 0;
+    if (errno == ERANGE || end != value + length)
+        return false;
 
-    /* return length of the method part */
-    return hd_uri - buffer;
+    *content_length = parsed;
+    return true;
 }
 
-static const char *
-parse_request(epoll_extra_data_t *extra)
+/**
+ * @brief Parse the request at the start of the given buffer in place
+ * @param buffer  request buffer (NUL-terminated at 'length')
+ * @param length  number of bytes received so far
+ * @param request parsed request
+ * @return HTTP_PARSE_INCOMPLETE if the request was not received completely
+ */
+http_parse_e
+http_parse_request(char *buffer, uint32_t length, http_request_t *request)
 {
-    uintptr_t method_len = parse_header(extra);
+    const char *end = memmem(buffer, length, CRLF CRLF, 4);
 
-    if (!method_len)
-        return NULL;
+    memset(request, 0, sizeof(http_request_t));
+
+    if (end == NULL)
+        return length < NYX_HTTP_BUFFER_LEN ? HTTP_PARSE_INCOMPLETE : HTTP_PARSE_INVALID;
+
+    /* request line: <method> <uri> HTTP/1.<minor> */
+    size_t request_line = line_length(buffer, end);
+    char *uri = memchr(buffer, ' ', request_line);
+
+    /* currently GET is supported only */
+    if (uri == NULL || uri - buffer != 3 || strncmp(buffer, "GET", 3))
+        return HTTP_PARSE_INVALID;
+
+    uri++;
+
+    char *version = memchr(uri, ' ', buffer + request_line - uri);
+
+    if (*uri != '/' || version == NULL ||
+            buffer + request_line - version != 9 ||
+            strncmp(version + 1, "HTTP/1.", 7))
+        return HTTP_PARSE_INVALID;
+
+    /* HTTP/1.1 connections are persistent by default */
+    bool keep_alive = version[8] != '0';
+    bool json = false;
+    uint64_t content_length = 0;
+    const char *line = buffer + request_line + 2;
+
+    while (line < end)
+    {
+        size_t line_len = line_length(line, end);
+        const char *value = memchr(line, ':', line_len);
+
+        if (value == NULL)
+            return HTTP_PARSE_INVALID;
+
+        value++;
+        value += strspn(value, " \t");
+
+        size_t value_len = line + line_len - value;
+
+        if (header_is(line, line_len, "Connection"))
+        {
+            if (value_contains(value, value_len, "close"))
+                keep_alive = false;
+            else if (value_contains(value, value_len, "keep-alive"))
+                keep_alive = true;
+        }
+        else if (header_is(line, line_len, "If-None-Match"))
+        {
+            if (value_len < LEN(request->if_none_match))
+            {
+                memcpy(request->if_none_match, value, value_len);
+                request->if_none_match[value_len] = '\0';
+            }
+        }
+        else if (header_is(line, line_len, "Accept"))
+            json = value_contains(value, value_len, "application/json");
+        else if (header_is(line, line_len, "Content-Length"))
+        {
+            if (!parse_content_length(value, value_len, &content_length))
+                return HTTP_PARSE_INVALID;
+        }
+        /* request bodies of unknown length are not supported */
+        else if (header_is(line, line_len, "Transfer-Encoding"))
+            return HTTP_PARSE_INVALID;
+
+        line += line_len + 2;
+    }
+
+    /* checked before the addition that could overflow otherwise */
+    if (content_length > NYX_HTTP_BUFFER_LEN)
+        return HTTP_PARSE_INVALID;
+
+    /* the body (if any) is skipped */
+    uint64_t total = (end - buffer) + 4 + content_length;
 
-    /* skip method portion of request line */
-    const char *uri = extra->buffer + method_len;
+    if (total > NYX_HTTP_BUFFER_LEN)
+        return HTTP_PARSE_INVALID;
 
-    log_debug("Received HTTP request to '%s'", uri);
+    if (total > length)
+        return HTTP_PARSE_INCOMPLETE;
 
-    return uri;
+    *version = '\0';
+
+    request->length = total;
+    request->uri = uri;
+    request->keep_alive = keep_alive;
+    request->json = json;
+
+    return HTTP_PARSE_OK;
 }
 
 static uint32_t
@@ -122,121 +265,426 @@ send_format(sender_callback_t *cb, const char *format, ...)
 static uint32_t
 send_format(sender_callback_t *cb, const char *format, ...)
 {
-    char buffer[512] = {0};
     strbuf_t *str = cb->data;
 
+    strbuf_append_string(str, ">>> ");
+
     va_list vas;
     va_start(vas, format);
-    uint32_t len = vsnprintf(buffer, LEN(buffer), format, vas);
+    uint32_t len = strbuf_append_va(str, format, vas);
     va_end(vas);
 
-    strbuf_append(str, ">>> %s\n", buffer);
+    strbuf_append_char(str, '\n');
 
     return len;
 }
 
-static bool
-handle_command(command_t *cmd, const char **input, epoll_extra_data_t *extra, nyx_t *nyx)
+static uint32_t
+send_raw(sender_callback_t *cb, const char *data, size_t length)
 {
-    bool success = false;
-    int32_t fd = extra->fd;
+    return strbuf_append_data(cb->data, data, length);
+}
 
-    strbuf_t *str = strbuf_new();
-    strbuf_t *response = strbuf_new_size(32);
+/* process a command and queue its response */
+static void
+handle_command(command_t *cmd, const char **input, http_conn_t *conn,
+        http_request_t *request, nyx_t *nyx)
+{
+    char etag[64] = {0};
+
+    strbuf_t *str = conn->body;
     sender_callback_t *cb = xcalloc1(sizeof(sender_callback_t));
 
+    strbuf_clear(str);
+
+    cb->client = conn->fd;
     cb->command = cmd->type;
     cb->sender = send_format;
+    cb->send_raw = send_raw;
+    cb->format = request->json ? SNAPSHOT_JSON : SNAPSHOT_HTTP;
     cb->data = str;
 
-    success = cmd->handler(cb, input, nyx);
+    if (!command_run(cmd, cb, input, nyx))
+        log_warn("Failed to process command '%s' (%d)", cmd->name, cmd->type);
 
-    strbuf_append(response, NYX_RESPONSE_HEADER);
-    strbuf_append(response, "Content-Length: %" PRIu64 CRLF CRLF, str->length);
-    strbuf_append(response, "%s", str->buf);
+    /* cached output carries the generation it was rendered at */
+    if (cb->generation && nyx->snapshot)
+        snapshot_etag(nyx->snapshot, cb->generation, cb->format, etag, LEN(etag));
 
-    send_safe(fd, response->buf, response->length);
+    if (*etag && !strcmp(etag, request->if_none_match))
+        not_modified(conn, request->keep_alive, etag);
+    else
+    {
+        char header[160] = {0};
 
-    strbuf_free(str);
-    strbuf_free(response);
+        /* the representation depends on the Accept header */
+        int32_t length = snprintf(header, LEN(header), "Vary: Accept" CRLF);
+
+        if (*etag)
+            snprintf(header + length, LEN(header) - length, "ETag: %s" CRLF, etag);
+
+        send_response_type(conn, "200 OK", request->keep_alive, header,
+                request->json ? "application/json" : "text/plain",
+                str->buf, str->length);
+    }
 
-    free(cb);
+    xfree(cb);
+}
 
-    return success;
+static void
+conn_free(http_conn_t *conn)
+{
+    strbuf_free(conn->body);
+    strbuf_free(conn->output);
+    xfree(conn);
 }
 
-bool
-http_handle_request(NYX_EV_TYPE *event, nyx_t *nyx)
+/* remove the connection from the server without closing its socket */
+static void
+conn_release(http_conn_t *conn)
 {
-    bool success = false;
-    ssize_t received = 0;
+    http_server_t *server = conn->server;
 
-    epoll_extra_data_t *extra = NYX_EV_GET(event);
+    reactor_remove_fd(server->reactor, conn->fd);
+
+    if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        server->connections = conn->next;
 
-    /* start of new request? */
-    if (extra->length == 0)
+    if (conn->next)
+        conn->next->prev = conn->prev;
+
+    /* keep the context for the next connection */
+    if (server->pooled < NYX_HTTP_POOL_SIZE)
     {
-        /* initialize message buffer */
-        extra->buffer = xcalloc(NYX_MAX_REQUEST_LEN + 1, sizeof(char));
-        extra->length = NYX_MAX_REQUEST_LEN;
+        conn->next = server->pool;
+        server->pool = conn;
+        server->pooled++;
     }
+    else
+        conn_free(conn);
 
-    received = recv(extra->fd, extra->buffer + extra->pos, extra->length - extra->pos, 0);
+    if (server->connections == NULL && server->timer != -1)
+    {
+        reactor_remove_timer(server->reactor, server->timer);
+        server->timer = -1;
+    }
+}
+
+static void
+conn_close(http_conn_t *conn)
+{
+    close(conn->fd);
+    conn_release(conn);
+}
+
+/**
+ * Send as much of the queued output as the socket takes right now - the
+ * rest is sent when the reactor reports the socket to be writable again.
+ * Returns false if the client is gone.
+ */
+static bool
+conn_flush(http_conn_t *conn)
+{
+    strbuf_t *output = conn->output;
 
-    if (received < 1)
+    while (conn->output_sent < output->length)
     {
-        if (received < 0)
+        ssize_t sent = send_safe(conn->fd, output->buf + conn->output_sent,
+                output->length - conn->output_sent);
+
+        if (sent > 0)
         {
-            if (errno == EAGAIN)
-                return true;
-            else
+            /* a slow client is not closed as long as it takes data */
+            conn->output_sent += sent;
+            conn->last_active = time(NULL);
+            continue;
+        }
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            /* no further requests are read until the output is sent */
+            if (!conn->writing)
             {
-                log_perror("nyx: recv");
-                goto close;
+                conn->writing = true;
+                reactor_modify_fd(conn->server->reactor, conn->fd, REACTOR_WRITE);
             }
+
+            return true;
         }
+
+        return false;
     }
 
-    extra->pos += received;
+    conn->output_sent = 0;
+    strbuf_clear(output);
+
+    if (conn->writing)
+    {
+        conn->writing = false;
+        reactor_modify_fd(conn->server->reactor, conn->fd, REACTOR_READ);
+    }
 
+    return true;
+}
 
-    const char *uri = parse_request(extra);
-    if (uri == NULL)
-        bad_request(extra->fd);
-    else
+/**
+ * Hand the connection over to the subscribers that push the state
+ * transitions as server-sent events: '/events' subscribes to all
+ * watches, '/events/<watch>/...' to the given ones only. The response
+ * headers are sent by the subscribers along with the events.
+ * Returns false if the connection was not handed over.
+ */
+static bool
+send_events(http_conn_t *conn, http_request_t *request)
+{
+    nyx_t *nyx = conn->server->nyx;
+    const char **watches = split_string(request->uri, "/");
+    int32_t fd = conn->fd;
+
+    if (nyx->subscribers == NULL)
+    {
+        not_found(conn, false);
+        strings_free((char **)watches);
+        return false;
+    }
+
+    for (const char **name = watches + 1; *name; name++)
     {
-        command_t *cmd = NULL;
-        const char **commands = split_string(uri, "/");
+        if (hash_get(nyx->state_map, *name) == NULL &&
+                (nyx->fleet == NULL || !fleet_contains(nyx->fleet, *name)))
+        {
+            not_found(conn, false);
+            strings_free((char **)watches);
+            return false;
+        }
+    }
+
+    log_debug("HTTP connection on socket %d subscribed to the events", fd);
+
+    conn_release(conn);
+
+    if (!subscribers_add(nyx->subscribers, fd, watches + 1, SUBSCRIBER_SSE, 0))
+        log_warn("Failed to add subscriber on socket %d", fd);
+
+    strings_free((char **)watches);
+
+    return true;
+}
+
+/* the metrics are rendered into the server's buffer
+ * that is reused for every scrape */
+static void
+send_metrics(http_conn_t *conn, http_request_t *request)
+{
+    strbuf_t *metrics = conn->server->metrics;
 
-        if ((cmd = parse_command(commands)) != NULL && cmd->handler != NULL)
-            handle_command(cmd, commands, extra, nyx);
+    strbuf_clear(metrics);
+    prometheus_render(metrics, conn->server->nyx);
+
+    send_response_type(conn, "200 OK", request->keep_alive, NULL,
+            PROMETHEUS_CONTENT_TYPE, metrics->buf, metrics->length);
+}
+
+/**
+ * Send the pending output and process the requests that were received
+ * completely - a pipelined request is processed only after the response
+ * of the previous one was sent.
+ * Returns false if the connection is to be closed. The connection
+ * must not be used afterwards if it was handed over to the subscribers.
+ */
+static bool
+process_requests(http_conn_t *conn)
+{
+    nyx_t *nyx = conn->server->nyx;
+
+    if (!conn_flush(conn))
+        return false;
+
+    while (conn->pos > 0 && !conn->closing && conn->output->length == 0)
+    {
+        http_request_t request;
+        http_parse_e result = http_parse_request(conn->buffer, conn->pos, &request);
+
+        if (result == HTTP_PARSE_INCOMPLETE)
+            return true;
+
+        if (result == HTTP_PARSE_INVALID)
+        {
+            bad_request(conn);
+            conn->closing = true;
+        }
         else
-            not_found(extra->fd);
+        {
+            log_debug("Received HTTP request to '%s'", request.uri);
 
-        strings_free((char **)commands);
+            if (!strcmp(request.uri, "/metrics"))
+                send_metrics(conn, &request);
+            else if (!strcmp(request.uri, "/events") || !strncmp(request.uri, "/events/", 8))
+            {
+                /* the following requests (if any) are discarded */
+                if (send_events(conn, &request))
+                    return true;
+
+                request.keep_alive = false;
+            }
+            else
+            {
+                command_t *cmd = NULL;
+                const char **commands = split_string(request.uri, "/");
+
+                if ((cmd = parse_command(commands)) != NULL && cmd->handler != NULL)
+                    handle_command(cmd, commands, conn, &request, nyx);
+                else
+                    not_found(conn, request.keep_alive);
+
+                strings_free((char **)commands);
+            }
+
+            conn->closing = !request.keep_alive;
+
+            /* keep the following (pipelined) requests */
+            conn->pos -= request.length;
+            memmove(conn->buffer, conn->buffer + request.length, conn->pos);
+            conn->buffer[conn->pos] = '\0';
+            conn->last_active = time(NULL);
+        }
+
+        if (!conn_flush(conn))
+            return false;
     }
 
-    success = true;
+    /* the connection is closed once its last response was sent */
+    return !conn->closing || conn->output->length > 0;
+}
+
+static void
+handle_client(UNUSED reactor_t *reactor, UNUSED int32_t fd, uint32_t events, void *data)
+{
+    http_conn_t *conn = data;
 
-close:
-    extra->pos = 0;
-    extra->length = 0;
+    /* the client is gone - while output is pending the reactor
+     * watches for the socket's writability only */
+    if ((events & REACTOR_HANGUP) && !(events & REACTOR_READ))
+    {
+        conn_close(conn);
+        return;
+    }
 
-    if (extra->buffer)
+    if (events & REACTOR_READ)
     {
-        free(extra->buffer);
-        extra->buffer = NULL;
+        ssize_t received = recv(conn->fd, conn->buffer + conn->pos,
+                NYX_HTTP_BUFFER_LEN - conn->pos, 0);
+
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return;
+
+        if (received < 1)
+        {
+            if (received < 0)
+                log_perror("nyx: recv");
+
+            conn_close(conn);
+            return;
+        }
+
+        conn->pos += received;
+        conn->buffer[conn->pos] = '\0';
     }
 
-    close(extra->fd);
+    if (!process_requests(conn))
+        conn_close(conn);
+}
 
-    free(extra);
+/* close the connections that are idle for too long */
+static void
+handle_idle_timer(UNUSED reactor_t *reactor, void *data)
+{
+    http_server_t *server = data;
+    time_t now = time(NULL);
+    http_conn_t *conn = server->connections;
+
+    while (conn)
+    {
+        http_conn_t *next = conn->next;
 
-    NYX_EV_GET(event) = NULL;
+        if (now - conn->last_active >= NYX_HTTP_IDLE_TIMEOUT)
+        {
+            log_debug("Closing idle HTTP connection on socket %d", conn->fd);
+            conn_close(conn);
+        }
 
-    return success;
+        conn = next;
+    }
 }
 
+static void
+handle_accept(reactor_t *reactor, int32_t fd, UNUSED uint32_t events, void *data)
+{
+    http_server_t *server = data;
+    int32_t client = accept(fd, NULL, NULL);
+
+    if (client == -1)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            log_perror("nyx: accept");
+        return;
+    }
+
+    if (!unblock_socket(client))
+    {
+        close(client);
+        return;
+    }
+
+    http_conn_t *conn = server->pool;
+
+    if (conn)
+    {
+        server->pool = conn->next;
+        server->pooled--;
+    }
+    else
+    {
+        conn = xcalloc1(sizeof(http_conn_t));
+        conn->body = strbuf_new_size(256);
+        conn->output = strbuf_new_size(256);
+    }
+
+    conn->fd = client;
+    conn->server = server;
+    conn->last_active = time(NULL);
+    conn->pos = 0;
+    conn->buffer[0] = '\0';
+    conn->output_sent = 0;
+    conn->writing = false;
+    conn->closing = false;
+    conn->prev = NULL;
+
+    /* a pooled context may still hold the output of a dropped client */
+    strbuf_clear(conn->output);
+
+    if (!reactor_add_fd(reactor, client, handle_client, conn))
+    {
+        close(client);
+        conn_free(conn);
+        return;
+    }
+
+    conn->next = server->connections;
+
+    if (server->connections)
+        server->connections->prev = conn;
+
+    server->connections = conn;
+
+    if (server->timer == -1)
+        server->timer = reactor_add_timer(reactor, 1000, true, handle_idle_timer, server);
+}
 
 int32_t
 http_init(uint32_t port)
@@ -272,6 +720,10 @@ http_init(uint32_t port)
         if (sock_fd == -1)
             continue;
 
+        /* connections closed by nyx must not block a restart */
+        int32_t reuse = 1;
+        setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
         if (bind(sock_fd, addr->ai_addr, addr->ai_addrlen) == 0)
             break;
 
@@ -296,4 +748,78 @@ http_init(uint32_t port)
     return sock_fd;
 }
 
+/**
+ * @brief Start the HTTP interface on the given port
+ * @param reactor reactor the connections are processed on
+ * @param port    port to listen on
+ * @param nyx     nyx instance
+ * @return new server instance or NULL on failure
+ */
+http_server_t *
+http_server_new(reactor_t *reactor, uint32_t port, void *nyx)
+{
+    int32_t sock = http_init(port);
+
+    if (!sock)
+        return NULL;
+
+    http_server_t *server = xcalloc1(sizeof(http_server_t));
+
+    server->reactor = reactor;
+    server->nyx = nyx;
+    server->fd = sock;
+    server->timer = -1;
+    server->metrics = strbuf_new_size(4096);
+
+    if (!unblock_socket(sock) || !reactor_add_fd(reactor, sock, handle_accept, server))
+    {
+        close(sock);
+        strbuf_free(server->metrics);
+        xfree(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+/**
+ * @brief Determine the number of open connections
+ * @param server server instance
+ * @return number of connected clients
+ */
+uint32_t
+http_server_connections(http_server_t *server)
+{
+    uint32_t count = 0;
+
+    for (http_conn_t *conn = server->connections; conn; conn = conn->next)
+        count++;
+
+    return count;
+}
+
+void
+http_server_destroy(http_server_t *server)
+{
+    if (server == NULL)
+        return;
+
+    while (server->connections)
+        conn_close(server->connections);
+
+    while (server->pool)
+    {
+        http_conn_t *conn = server->pool;
+
+        server->pool = conn->next;
+        conn_free(conn);
+    }
+
+    reactor_remove_fd(server->reactor, server->fd);
+    close(server->fd);
+
+    strbuf_free(server->metrics);
+    xfree(server);
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
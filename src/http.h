@@ -13,17 +13,112 @@
  * limitations under the License.
  */
 
+
 #pragma once
 
-#include "def.h"
-#include "nyx.h"
-#include "socket.h"
+#include "reactor.h"
+#include "strbuf.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* maximum size of a request (including its headers) */
+#define NYX_HTTP_BUFFER_LEN 4096
+
+/* time in seconds an idle keep-alive connection is kept open */
+#define NYX_HTTP_IDLE_TIMEOUT 15
+
+/* maximum number of unused connection contexts kept for reuse */
+#define NYX_HTTP_POOL_SIZE 16
+
+typedef enum
+{
+    HTTP_PARSE_OK,
+    HTTP_PARSE_INCOMPLETE,
+    HTTP_PARSE_INVALID
+} http_parse_e;
+
+/** request parsed in place of the connection's buffer */
+typedef struct
+{
+    /** length of the whole request (headers and body) */
+    uint32_t length;
+    /** NUL-terminated request URI */
+    const char *uri;
+    bool keep_alive;
+    /** the client accepts JSON (Accept: application/json) */
+    bool json;
+    /** value of the 'If-None-Match' header (empty if not given) */
+    char if_none_match[64];
+} http_request_t;
+
+typedef struct http_server_t http_server_t;
+
+typedef struct http_conn_t http_conn_t;
+
+/** client connection of the HTTP interface */
+struct http_conn_t
+{
+    int32_t fd;
+    http_server_t *server;
+    /** time of the connect or the last request */
+    time_t last_active;
+    uint32_t pos;
+    char buffer[NYX_HTTP_BUFFER_LEN + 1];
+    /* command output of the current request and the queued responses
+     * (kept with the pooled context) */
+    strbuf_t *body;
+    strbuf_t *output;
+    /** number of bytes of the output that were sent already */
+    uint32_t output_sent;
+    /** the reactor waits for the socket to become writable */
+    bool writing;
+    /** the connection is closed as soon as the output was sent */
+    bool closing;
+    http_conn_t *prev;
+    http_conn_t *next;
+};
+
+/**
+ * HTTP/1.1 control interface: connections are kept open for further
+ * (pipelined) requests until the client closes them or they are idle
+ * for NYX_HTTP_IDLE_TIMEOUT seconds. The responses are queued and sent
+ * whenever the socket is writable - the next pipelined request is not
+ * processed before the previous response was sent. The connection
+ * contexts are reused via a free list. All of it is run on the reactor
+ * thread.
+ */
+struct http_server_t
+{
+    reactor_t *reactor;
+    /** nyx instance */
+    void *nyx;
+    /** listening socket */
+    int32_t fd;
+    /** timer closing idle connections (-1 while no connection is open) */
+    int32_t timer;
+    http_conn_t *connections;
+    /** unused connection contexts */
+    http_conn_t *pool;
+    uint32_t pooled;
+    /** output of the metrics endpoint (reused for every scrape) */
+    strbuf_t *metrics;
+};
 
 int32_t
 http_init(uint32_t port);
 
-bool
-http_handle_request(NYX_EV_TYPE *event, nyx_t *nyx);
+http_parse_e
+http_parse_request(char *buffer, uint32_t length, http_request_t *request);
 
-/* vim: set et sw=4 sts=4 tw=80: */
+http_server_t *
+http_server_new(reactor_t *reactor, uint32_t port, void *nyx);
+
+uint32_t
+http_server_connections(http_server_t *server);
 
+void
+http_server_destroy(http_server_t *server);
+
+/* vim: set et sw=4 sts=4 tw=80: */
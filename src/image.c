@@ -0,0 +1,929 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_CONFIG
+
+#include "arena.h"
+#include "config.h"
+#include "def.h"
+#include "fs.h"
+#include "image.h"
+#include "log.h"
+#include "utils.h"
+#include "watch.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct
+{
+    char *data;
+    uint64_t length;
+    uint64_t size;
+} image_buffer_t;
+
+typedef struct
+{
+    const char *data;
+    uint64_t size;
+} image_t;
+
+/**
+ * @brief Determine the path of the image belonging to the given
+ *        config file (or directory)
+ * @param config_file config file
+ * @return path of the image (has to be freed)
+ */
+char *
+image_path(const char *config_file)
+{
+    size_t length = strlen(config_file) + strlen(IMAGE_SUFFIX) + 1;
+    char *path = xcalloc(length, sizeof(char));
+
+    snprintf(path, length, "%s%s", config_file, IMAGE_SUFFIX);
+
+    return path;
+}
+
+/* append the data (8 byte aligned) and return its offset */
+static uint64_t
+put(image_buffer_t *buf, const void *data, uint64_t length)
+{
+    uint64_t offset = (buf->length + 7) & ~7ULL;
+    uint64_t end = offset + length;
+
+    if (end > buf->size)
+    {
+        uint64_t size = MAX(buf->size * 2, 4096);
+
+        while (size < end)
+            size *= 2;
+
+        buf->data = xrealloc(buf->data, size);
+
+        memset(buf->data + buf->size, 0, size - buf->size);
+        buf->size = size;
+    }
+
+    memcpy(buf->data + offset, data, length);
+    buf->length = end;
+
+    return offset;
+}
+
+static uint64_t
+put_string(image_buffer_t *buf, const char *str)
+{
+    if (str == NULL)
+        return 0;
+
+    return put(buf, str, strlen(str) + 1);
+}
+
+static uint64_t
+put_strings(image_buffer_t *buf, const char **strings)
+{
+    if (strings == NULL)
+        return 0;
+
+    uint64_t count = count_args(strings);
+    uint64_t *list = xcalloc(count + 1, sizeof(uint64_t));
+
+    list[0] = count;
+
+    for (uint64_t idx = 0; idx < count; idx++)
+        list[idx + 1] = put_string(buf, strings[idx]);
+
+    uint64_t offset = put(buf, list, (count + 1) * sizeof(uint64_t));
+
+    xfree(list);
+
+    return offset;
+}
+
+/* store the hash as string list of alternating keys and values */
+static uint64_t
+put_pairs(image_buffer_t *buf, hash_t *hash)
+{
+    if (hash == NULL)
+        return 0;
+
+    uint64_t count = 0;
+    const char *key = NULL;
+    void *data = NULL;
+    const char **pairs = xcalloc(hash_count(hash) * 2 + 1, sizeof(char *));
+    hash_iter_t *iter = hash_iter_start(hash);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        pairs[count++] = key;
+        pairs[count++] = data;
+    }
+
+    hash_iter_free(iter);
+
+    uint64_t offset = put_strings(buf, pairs);
+
+    xfree(pairs);
+
+    return offset;
+}
+
+static uint64_t
+put_status_codes(image_buffer_t *buf, const uint16_t *codes)
+{
+    if (codes == NULL)
+        return 0;
+
+    uint64_t count = 0;
+
+    while (codes[count])
+        count++;
+
+    return put(buf, codes, (count + 1) * sizeof(uint16_t));
+}
+
+static void
+encode_watch(image_buffer_t *buf, const watch_t *watch, image_watch_t *out)
+{
+    memset(out, 0, sizeof(image_watch_t));
+
+    out->id = watch->id;
+    out->name = put_string(buf, watch->name);
+    out->uid = put_string(buf, watch->uid);
+    out->gid = put_string(buf, watch->gid);
+    out->start = put_strings(buf, watch->start);
+    out->stop = put_strings(buf, watch->stop);
+    out->reload = put_strings(buf, watch->reload);
+    out->reload_signal = watch->reload_signal;
+    out->depends_on = put_strings(buf, watch->depends_on);
+    out->dir = put_string(buf, watch->dir);
+    out->pid_file = put_string(buf, watch->pid_file);
+    out->log_file = put_string(buf, watch->log_file);
+    out->error_file = put_string(buf, watch->error_file);
+    out->log_max_size = watch->log_max_size;
+    out->log_max_age = watch->log_max_age;
+    out->log_keep = watch->log_keep;
+    out->log_compress = watch->log_compress;
+    out->http_check = put_string(buf, watch->http_check);
+    out->http_check_port = watch->http_check_port;
+    out->http_check_method = watch->http_check_method;
+    out->http_check_status = put_status_codes(buf, watch->http_check_status);
+    out->http_check_interval = watch->http_check_interval;
+    out->http_check_keep_alive = watch->http_check_keep_alive;
+    out->plugin_check = put_string(buf, watch->plugin_check);
+    out->plugin_check_argument = put_string(buf, watch->plugin_check_argument);
+    out->plugin_check_interval = watch->plugin_check_interval;
+    out->plugin_check_timeout = watch->plugin_check_timeout;
+    out->check_exec = put_strings(buf, watch->check_exec);
+    out->check_exec_interval = watch->check_exec_interval;
+    out->check_exec_timeout = watch->check_exec_timeout;
+    out->port_check_owner = watch->port_check_owner;
+    out->cgroup_limits = watch->cgroup_limits;
+    out->notify = watch->notify;
+    out->watchdog = watch->watchdog;
+    out->listen = put_strings(buf, watch->listen);
+    out->listen_lazy = watch->listen_lazy;
+    out->spare = watch->spare;
+    out->instances = watch->instances;
+    out->restart_batch = watch->restart_batch;
+    out->restart_priority = watch->restart_priority;
+    out->flapping_count = watch->flapping_count;
+    out->flapping_interval = watch->flapping_interval;
+    out->flapping_delay = watch->flapping_delay;
+    out->max_flapping_delay = watch->max_flapping_delay;
+    out->port_check_interval = watch->port_check_interval;
+    out->check_interval = watch->check_interval;
+    out->max_check_interval = watch->max_check_interval;
+    out->start_timeout = watch->start_timeout;
+    out->stop_timeout = watch->stop_timeout;
+    out->max_cpu = watch->max_cpu;
+    out->startup_delay = watch->startup_delay;
+    out->max_memory = watch->max_memory;
+    out->memory_pressure = put_string(buf, watch->memory_pressure);
+    out->cpu_affinity = put_string(buf, watch->cpu_affinity);
+    out->numa_node = put_string(buf, watch->numa_node);
+    out->numa_policy = watch->numa_policy;
+    out->nice = watch->nice;
+    out->sched_policy = watch->sched_policy;
+    out->sched_priority = watch->sched_priority;
+    out->ionice = put_string(buf, watch->ionice);
+    out->rlimits = put_pairs(buf, watch->rlimits);
+    out->env = put_pairs(buf, watch->env);
+
+    if (watch->port_check)
+    {
+        out->has_port_check = 1;
+        out->port_check_port = watch->port_check->port;
+        out->port_check_host = put_string(buf, watch->port_check->host);
+    }
+}
+
+static void
+encode_options(image_buffer_t *buf, const nyx_options_t *options, image_options_t *out)
+{
+    memset(out, 0, sizeof(image_options_t));
+
+    out->polling_interval = options->polling_interval;
+    out->check_interval = options->check_interval;
+    out->check_jitter = options->check_jitter;
+    out->startup_delay = options->startup_delay;
+    out->history_size = options->history_size;
+    out->state_threads = options->state_threads;
+    out->proc_threads = options->proc_threads;
+    out->startup_concurrency = options->startup_concurrency;
+    out->command_concurrency = options->command_concurrency;
+    out->check_exec_concurrency = options->check_exec_concurrency;
+    out->restart_rate = options->restart_rate;
+    out->restart_burst = options->restart_burst;
+    out->restart_concurrency = options->restart_concurrency;
+    out->federation_interval = options->federation_interval;
+    out->federation_port = options->federation_port;
+    out->http_port = options->http_port;
+    out->metrics_memory = options->metrics_memory;
+    out->journal_size = options->journal_size;
+    out->thread_stack_size = options->thread_stack_size;
+    out->fast_spawn = options->fast_spawn;
+    out->taskstats = options->taskstats;
+    out->io_uring = options->io_uring;
+    out->log_milliseconds = options->log_milliseconds;
+    out->log_file = put_string(buf, options->log_file);
+    out->log_level = put_string(buf, options->log_level);
+    out->cgroup = put_string(buf, options->cgroup);
+    out->include_dir = put_string(buf, options->include_dir);
+    out->federation = put_strings(buf, options->federation);
+    out->federation_node = put_string(buf, options->federation_node);
+#ifdef USE_PLUGINS
+    out->plugins = put_string(buf, options->plugins);
+    out->plugin_config = put_pairs(buf, options->plugin_config);
+#endif
+}
+
+static bool
+encode_sources(image_buffer_t *buf, nyx_t *nyx, image_header_t *header)
+{
+    bool success = true;
+    list_t *sources = config_sources(nyx);
+    image_source_t *encoded = xcalloc(MAX(list_size(sources), 1), sizeof(image_source_t));
+    list_node_t *node = sources->head;
+
+    header->sources = 0;
+
+    while (node && success)
+    {
+        const char *path = node->data;
+        image_source_t *source = &encoded[header->sources++];
+        struct stat st;
+
+        if (stat(path, &st) == -1)
+        {
+            log_perror("nyx: stat");
+            success = false;
+            break;
+        }
+
+        struct timespec mtime = file_mtime(&st);
+
+        source->path = put_string(buf, path);
+        source->dev = st.st_dev;
+        source->ino = st.st_ino;
+        source->size = st.st_size;
+        source->mtime_sec = mtime.tv_sec;
+        source->mtime_nsec = mtime.tv_nsec;
+
+        node = node->next;
+    }
+
+    header->sources_offset = put(buf, encoded, header->sources * sizeof(image_source_t));
+
+    xfree(encoded);
+    list_destroy(sources);
+
+    return success;
+}
+
+static bool
+write_file(const char *path, const char *data, uint64_t length)
+{
+    bool success = false;
+    char *tmp = NULL;
+
+    if (asprintf(&tmp, "%s.tmp", path) < 0)
+        return false;
+
+    int32_t fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+    if (fd == -1)
+    {
+        log_perror("nyx: open");
+        free(tmp);
+        return false;
+    }
+
+    uint64_t written = 0;
+
+    while (written < length)
+    {
+        ssize_t bytes = write(fd, data + written, length - written);
+
+        if (bytes < 0)
+        {
+            log_perror("nyx: write");
+            break;
+        }
+
+        written += bytes;
+    }
+
+    close(fd);
+
+    /* replace the image atomically */
+    if (written == length)
+    {
+        if (rename(tmp, path) == -1)
+            log_perror("nyx: rename");
+        else
+            success = true;
+    }
+
+    if (!success)
+        unlink(tmp);
+
+    free(tmp);
+
+    return success;
+}
+
+/**
+ * @brief Write the parsed (and validated) configuration into an image
+ * @param nyx  nyx instance
+ * @param path path of the image
+ * @return true on success, false otherwise
+ */
+bool
+image_write(nyx_t *nyx, const char *path)
+{
+    image_buffer_t buf = { NULL, 0, 0 };
+    image_header_t header;
+    image_options_t options;
+
+    memset(&header, 0, sizeof(image_header_t));
+
+    /* reserve the header at offset 0 */
+    put(&buf, &header, sizeof(image_header_t));
+
+    if (!encode_sources(&buf, nyx, &header))
+    {
+        xfree(buf.data);
+        return false;
+    }
+
+    encode_options(&buf, &nyx->options, &options);
+    header.options_offset = put(&buf, &options, sizeof(image_options_t));
+
+    uint32_t count = 0;
+    const char *key = NULL;
+    void *data = NULL;
+    image_watch_t *watches = xcalloc(MAX(hash_count(nyx->watches), 1), sizeof(image_watch_t));
+    hash_iter_t *iter = hash_iter_start(nyx->watches);
+
+    while (hash_iter(iter, &key, &data))
+        encode_watch(&buf, data, &watches[count++]);
+
+    hash_iter_free(iter);
+
+    header.watches = count;
+    header.watches_offset = put(&buf, watches, count * sizeof(image_watch_t));
+
+    xfree(watches);
+
+    header.magic = IMAGE_MAGIC;
+    header.version = IMAGE_VERSION;
+    header.size = buf.length;
+
+    memcpy(buf.data, &header, sizeof(image_header_t));
+
+    bool success = write_file(path, buf.data, buf.length);
+
+    xfree(buf.data);
+
+    return success;
+}
+
+static bool
+in_bounds(const image_t *image, uint64_t offset, uint64_t length)
+{
+    return offset <= image->size && length <= image->size - offset;
+}
+
+/* read a string that is referenced by the image without copying it */
+static bool
+string_at(const image_t *image, uint64_t offset, const char **str)
+{
+    *str = NULL;
+
+    if (offset == 0)
+        return true;
+
+    if (offset >= image->size ||
+            memchr(image->data + offset, '\0', image->size - offset) == NULL)
+        return false;
+
+    *str = image->data + offset;
+
+    return true;
+}
+
+static bool
+get_string(const image_t *image, uint64_t offset, const char **str)
+{
+    const char *value = NULL;
+
+    if (!string_at(image, offset, &value))
+        return false;
+
+    *str = value ? xstrdup(value) : NULL;
+
+    return true;
+}
+
+/* validate the string list at the given offset and determine its size */
+static bool
+list_at(const image_t *image, uint64_t offset, uint64_t *count)
+{
+    *count = 0;
+
+    if (offset == 0)
+        return true;
+
+    if (!in_bounds(image, offset, sizeof(uint64_t)))
+        return false;
+
+    memcpy(count, image->data + offset, sizeof(uint64_t));
+
+    return *count < image->size / sizeof(uint64_t) &&
+        in_bounds(image, offset, (*count + 1) * sizeof(uint64_t));
+}
+
+static uint64_t
+list_item(const image_t *image, uint64_t offset, uint64_t idx)
+{
+    uint64_t item = 0;
+
+    memcpy(&item, image->data + offset + (idx + 1) * sizeof(uint64_t), sizeof(uint64_t));
+
+    return item;
+}
+
+static bool
+get_strings(const image_t *image, uint64_t offset, const char ***strings)
+{
+    uint64_t count = 0;
+
+    *strings = NULL;
+
+    if (offset == 0)
+        return true;
+
+    if (!list_at(image, offset, &count))
+        return false;
+
+    const char **values = xcalloc(count + 1, sizeof(char *));
+
+    for (uint64_t idx = 0; idx < count; idx++)
+    {
+        if (!get_string(image, list_item(image, offset, idx), &values[idx]) ||
+                values[idx] == NULL)
+        {
+            strings_free((char **)values);
+            return false;
+        }
+    }
+
+    *strings = values;
+
+    return true;
+}
+
+static bool
+get_pairs(const image_t *image, uint64_t offset, hash_t **hash)
+{
+    uint64_t count = 0;
+
+    *hash = NULL;
+
+    if (offset == 0)
+        return true;
+
+    if (!list_at(image, offset, &count) || count % 2)
+        return false;
+
+    hash_t *pairs = hash_new(xfree_data);
+
+    for (uint64_t idx = 0; idx < count; idx += 2)
+    {
+        const char *key = NULL, *value = NULL;
+
+        if (!string_at(image, list_item(image, offset, idx), &key) ||
+                !string_at(image, list_item(image, offset, idx + 1), &value) ||
+                key == NULL || value == NULL)
+        {
+            hash_destroy(pairs);
+            return false;
+        }
+
+        hash_add(pairs, key, xstrdup(value));
+    }
+
+    *hash = pairs;
+
+    return true;
+}
+
+static bool
+get_status_codes(const image_t *image, uint64_t offset, uint16_t **codes)
+{
+    uint64_t count = 0;
+    uint16_t code = 0;
+
+    *codes = NULL;
+
+    if (offset == 0)
+        return true;
+
+    do
+    {
+        if (!in_bounds(image, offset, (count + 1) * sizeof(uint16_t)))
+            return false;
+
+        memcpy(&code, image->data + offset + count * sizeof(uint16_t), sizeof(uint16_t));
+        count++;
+    }
+    while (code);
+
+    *codes = xcalloc(count, sizeof(uint16_t));
+    memcpy(*codes, image->data + offset, count * sizeof(uint16_t));
+
+    return true;
+}
+
+static watch_t *
+decode_watch(const image_t *image, const image_watch_t *in)
+{
+    watch_t *watch = xcalloc1(sizeof(watch_t));
+
+    bool valid =
+        get_string(image, in->name, &watch->name) && watch->name &&
+        get_string(image, in->uid, &watch->uid) &&
+        get_string(image, in->gid, &watch->gid) &&
+        get_strings(image, in->start, &watch->start) && watch->start &&
+        get_strings(image, in->stop, &watch->stop) &&
+        get_strings(image, in->reload, &watch->reload) &&
+        get_strings(image, in->depends_on, &watch->depends_on) &&
+        get_string(image, in->dir, &watch->dir) &&
+        get_string(image, in->pid_file, &watch->pid_file) &&
+        get_string(image, in->log_file, &watch->log_file) &&
+        get_string(image, in->error_file, &watch->error_file) &&
+        get_string(image, in->http_check, &watch->http_check) &&
+        get_status_codes(image, in->http_check_status, &watch->http_check_status) &&
+        get_string(image, in->plugin_check, &watch->plugin_check) &&
+        get_string(image, in->plugin_check_argument, &watch->plugin_check_argument) &&
+        get_strings(image, in->check_exec, &watch->check_exec) &&
+        get_strings(image, in->listen, &watch->listen) &&
+        get_string(image, in->memory_pressure, &watch->memory_pressure) &&
+        get_string(image, in->cpu_affinity, &watch->cpu_affinity) &&
+        get_string(image, in->numa_node, &watch->numa_node) &&
+        get_string(image, in->ionice, &watch->ionice) &&
+        get_pairs(image, in->rlimits, &watch->rlimits) &&
+        get_pairs(image, in->env, &watch->env);
+
+    if (valid && in->has_port_check)
+    {
+        const char *host = NULL;
+
+        valid = string_at(image, in->port_check_host, &host);
+
+        if (valid)
+            watch->port_check = endpoint_new(in->port_check_port, host);
+    }
+
+    if (!valid)
+    {
+        watch_destroy(watch);
+        return NULL;
+    }
+
+    watch->id = in->id;
+    watch->http_check_port = in->http_check_port;
+    watch->http_check_method = in->http_check_method;
+    watch->http_check_interval = in->http_check_interval;
+    watch->plugin_check_interval = in->plugin_check_interval;
+    watch->plugin_check_timeout = in->plugin_check_timeout;
+    watch->check_exec_interval = in->check_exec_interval;
+    watch->check_exec_timeout = in->check_exec_timeout;
+    watch->log_max_size = in->log_max_size;
+    watch->log_max_age = in->log_max_age;
+    watch->log_keep = in->log_keep;
+    watch->log_compress = in->log_compress;
+    watch->http_check_keep_alive = in->http_check_keep_alive;
+    watch->port_check_owner = in->port_check_owner;
+    watch->cgroup_limits = in->cgroup_limits;
+    watch->notify = in->notify;
+    watch->watchdog = in->watchdog;
+    watch->reload_signal = in->reload_signal;
+    watch->listen_lazy = in->listen_lazy;
+    watch->spare = in->spare;
+    watch->instances = in->instances;
+    watch->restart_batch = in->restart_batch;
+    watch->restart_priority = in->restart_priority;
+    watch->flapping_count = in->flapping_count;
+    watch->flapping_interval = in->flapping_interval;
+    watch->flapping_delay = in->flapping_delay;
+    watch->max_flapping_delay = in->max_flapping_delay;
+    watch->port_check_interval = in->port_check_interval;
+    watch->check_interval = in->check_interval;
+    watch->max_check_interval = in->max_check_interval;
+    watch->start_timeout = in->start_timeout;
+    watch->stop_timeout = in->stop_timeout;
+    watch->max_cpu = in->max_cpu;
+    watch->startup_delay = in->startup_delay;
+    watch->max_memory = in->max_memory;
+    watch->numa_policy = in->numa_policy;
+    watch->nice = in->nice;
+    watch->sched_policy = in->sched_policy;
+    watch->sched_priority = in->sched_priority;
+
+    return watch;
+}
+
+static void
+replace_string(const char **target, const char *value)
+{
+    if (*target)
+        xfree((void *)*target);
+
+    *target = value;
+}
+
+static bool
+decode_options(const image_t *image, uint64_t offset, nyx_options_t *options)
+{
+    image_options_t in;
+    const char *log_file = NULL, *log_level = NULL, *cgroup = NULL;
+    const char *include_dir = NULL, *federation_node = NULL;
+    const char **federation = NULL;
+
+    if (!in_bounds(image, offset, sizeof(image_options_t)))
+        return false;
+
+    memcpy(&in, image->data + offset, sizeof(image_options_t));
+
+    if (!get_string(image, in.log_file, &log_file) ||
+            !get_string(image, in.log_level, &log_level) ||
+            !get_string(image, in.cgroup, &cgroup) ||
+            !get_string(image, in.include_dir, &include_dir) ||
+            !get_string(image, in.federation_node, &federation_node) ||
+            !get_strings(image, in.federation, &federation))
+    {
+        xfree((void *)log_file);
+        xfree((void *)log_level);
+        xfree((void *)cgroup);
+        xfree((void *)include_dir);
+        xfree((void *)federation_node);
+        return false;
+    }
+
+#ifdef USE_PLUGINS
+    const char *plugins = NULL;
+    hash_t *plugin_config = NULL;
+
+    if (!get_string(image, in.plugins, &plugins) ||
+            !get_pairs(image, in.plugin_config, &plugin_config))
+    {
+        xfree((void *)log_file);
+        xfree((void *)log_level);
+        xfree((void *)cgroup);
+        xfree((void *)include_dir);
+        xfree((void *)federation_node);
+        strings_free((char **)federation);
+        xfree((void *)plugins);
+        return false;
+    }
+
+    replace_string(&options->plugins, plugins);
+
+    if (options->plugin_config)
+        hash_destroy(options->plugin_config);
+
+    options->plugin_config = plugin_config;
+#endif
+
+    options->polling_interval = in.polling_interval;
+    options->check_interval = in.check_interval;
+    options->check_jitter = in.check_jitter;
+    options->startup_delay = in.startup_delay;
+    options->history_size = in.history_size;
+    options->state_threads = in.state_threads;
+    options->proc_threads = in.proc_threads;
+    options->startup_concurrency = in.startup_concurrency;
+    options->command_concurrency = in.command_concurrency;
+    options->check_exec_concurrency = in.check_exec_concurrency;
+    options->restart_rate = in.restart_rate;
+    options->restart_burst = in.restart_burst;
+    options->restart_concurrency = in.restart_concurrency;
+    options->federation_interval = in.federation_interval;
+    options->federation_port = in.federation_port;
+    options->http_port = in.http_port;
+    options->metrics_memory = in.metrics_memory;
+    options->journal_size = in.journal_size;
+    options->thread_stack_size = in.thread_stack_size;
+    options->fast_spawn = in.fast_spawn;
+    options->taskstats = in.taskstats;
+    options->io_uring = in.io_uring;
+    options->log_milliseconds = in.log_milliseconds;
+
+    replace_string(&options->log_file, log_file);
+    replace_string(&options->log_level, log_level);
+    replace_string(&options->cgroup, cgroup);
+    replace_string(&options->include_dir, include_dir);
+    replace_string(&options->federation_node, federation_node);
+
+    strings_free((char **)options->federation);
+    options->federation = federation;
+
+    return true;
+}
+
+/* the image is outdated as soon as any of its sources was modified -
+ * directories change whenever files are added or removed */
+static bool
+sources_current(const image_t *image, const image_header_t *header)
+{
+    if (!in_bounds(image, header->sources_offset,
+                (uint64_t)header->sources * sizeof(image_source_t)))
+        return false;
+
+    for (uint32_t idx = 0; idx < header->sources; idx++)
+    {
+        image_source_t source;
+        const char *path = NULL;
+        struct stat st;
+
+        memcpy(&source, image->data + header->sources_offset +
+                idx * sizeof(image_source_t), sizeof(image_source_t));
+
+        if (!string_at(image, source.path, &path) || path == NULL)
+            return false;
+
+        if (stat(path, &st) == -1)
+            return false;
+
+        struct timespec mtime = file_mtime(&st);
+
+        if (source.dev != (uint64_t)st.st_dev ||
+                source.ino != (uint64_t)st.st_ino ||
+                source.size != st.st_size ||
+                source.mtime_sec != mtime.tv_sec ||
+                source.mtime_nsec != mtime.tv_nsec)
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+decode_watches(const image_t *image, const image_header_t *header, list_t *watches)
+{
+    if (!in_bounds(image, header->watches_offset,
+                (uint64_t)header->watches * sizeof(image_watch_t)))
+        return false;
+
+    for (uint32_t idx = 0; idx < header->watches; idx++)
+    {
+        image_watch_t in;
+
+        memcpy(&in, image->data + header->watches_offset +
+                idx * sizeof(image_watch_t), sizeof(image_watch_t));
+
+        watch_t *watch = decode_watch(image, &in);
+
+        if (watch == NULL)
+            return false;
+
+        list_add(watches, watch);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Load the watches and options of a compiled config image
+ * @param nyx    nyx instance
+ * @param path   path of the image
+ * @param silent toggle silent operation
+ * @return true if the image was loaded, false if it does not exist,
+ *         is invalid or outdated
+ *
+ * The image is mapped and its validated watches are used as they are -
+ * neither parsed nor validated again.
+ */
+bool
+image_load(nyx_t *nyx, const char *path, bool silent)
+{
+    struct stat st;
+    bool success = false;
+    int32_t fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+        return false;
+
+    if (fstat(fd, &st) == -1 || (uint64_t)st.st_size < sizeof(image_header_t))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        log_perror("nyx: mmap");
+        return false;
+    }
+
+    image_t image = { mapping, st.st_size };
+    image_header_t header;
+
+    memcpy(&header, image.data, sizeof(image_header_t));
+
+    if (header.magic != IMAGE_MAGIC || header.version != IMAGE_VERSION ||
+            header.size != image.size)
+    {
+        if (!silent)
+            log_warn("Ignoring invalid config image '%s'", path);
+    }
+    else if (!sources_current(&image, &header))
+    {
+        if (!silent)
+            log_info("Config image '%s' is outdated - parsing the configuration", path);
+    }
+    else
+    {
+        list_t *watches = list_new(_watch_destroy);
+
+        if (decode_watches(&image, &header, watches) &&
+                list_size(watches) > 0 &&
+                decode_options(&image, header.options_offset, &nyx->options))
+        {
+            void *data = NULL;
+            arena_t *arena = arena_new();
+
+            while (list_pop(watches, &data))
+            {
+                watch_t *watch = data;
+
+                watch_seal(watch, arena);
+
+                if (!hash_add(nyx->watches, watch->name, watch))
+                    watch_destroy(watch);
+            }
+
+            arena_release(arena);
+
+            success = true;
+
+            if (!silent)
+                log_info("Loaded %u watch definitions from config image '%s'",
+                        header.watches, path);
+        }
+        else if (!silent)
+            log_warn("Ignoring invalid config image '%s'", path);
+
+        list_destroy(watches);
+    }
+
+    munmap(mapping, st.st_size);
+
+    return success;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
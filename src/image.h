@@ -0,0 +1,176 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "nyx.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IMAGE_MAGIC 0x49585943
+#define IMAGE_VERSION 20
+
+/* suffix of the image file next to the config file/directory */
+#define IMAGE_SUFFIX ".img"
+
+/*
+ * All references inside the image are offsets relative to its start (0
+ * meaning NULL) so the image can be mapped at any address. Strings are
+ * NUL-terminated, string lists are stored as a count followed by the
+ * offsets of their strings.
+ */
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint32_t sources;
+    uint32_t watches;
+    uint64_t sources_offset;
+    uint64_t options_offset;
+    uint64_t watches_offset;
+} image_header_t;
+
+/** config file or directory the image was compiled from */
+typedef struct
+{
+    uint64_t path;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} image_source_t;
+
+typedef struct
+{
+    uint32_t polling_interval;
+    uint32_t check_interval;
+    uint32_t check_jitter;
+    uint32_t startup_delay;
+    uint32_t history_size;
+    uint32_t state_threads;
+    uint32_t proc_threads;
+    uint32_t startup_concurrency;
+    uint32_t command_concurrency;
+    uint32_t check_exec_concurrency;
+    uint32_t restart_rate;
+    uint32_t restart_burst;
+    uint32_t restart_concurrency;
+    uint32_t federation_interval;
+    uint32_t federation_port;
+    int32_t http_port;
+    uint64_t metrics_memory;
+    uint64_t journal_size;
+    uint64_t thread_stack_size;
+    uint8_t fast_spawn;
+    uint8_t taskstats;
+    uint8_t io_uring;
+    uint8_t log_milliseconds;
+    uint64_t log_file;
+    uint64_t log_level;
+    uint64_t cgroup;
+    uint64_t include_dir;
+    uint64_t federation;
+    uint64_t federation_node;
+    uint64_t plugins;
+    /** string list of alternating keys and values */
+    uint64_t plugin_config;
+} image_options_t;
+
+typedef struct
+{
+    int32_t id;
+    uint64_t name;
+    uint64_t uid;
+    uint64_t gid;
+    uint64_t start;
+    uint64_t stop;
+    uint64_t reload;
+    int32_t reload_signal;
+    uint64_t depends_on;
+    uint64_t dir;
+    uint64_t pid_file;
+    uint64_t log_file;
+    uint64_t error_file;
+    uint64_t log_max_size;
+    uint32_t log_max_age;
+    uint32_t log_keep;
+    uint8_t log_compress;
+    uint64_t http_check;
+    uint32_t http_check_port;
+    uint32_t http_check_method;
+    /** zero-terminated array of status codes */
+    uint64_t http_check_status;
+    uint32_t http_check_interval;
+    uint8_t http_check_keep_alive;
+    uint64_t plugin_check;
+    uint64_t plugin_check_argument;
+    uint32_t plugin_check_interval;
+    uint32_t plugin_check_timeout;
+    uint64_t check_exec;
+    uint32_t check_exec_interval;
+    uint32_t check_exec_timeout;
+    uint8_t port_check_owner;
+    uint8_t cgroup_limits;
+    uint8_t notify;
+    uint32_t watchdog;
+    uint64_t listen;
+    uint8_t listen_lazy;
+    uint8_t spare;
+    uint64_t port_check_host;
+    uint32_t port_check_port;
+    uint32_t port_check_interval;
+    uint32_t check_interval;
+    uint32_t max_check_interval;
+    uint32_t start_timeout;
+    uint32_t stop_timeout;
+    uint32_t max_cpu;
+    uint32_t startup_delay;
+    uint32_t instances;
+    uint32_t restart_batch;
+    int32_t restart_priority;
+    uint32_t flapping_count;
+    uint32_t flapping_interval;
+    uint32_t flapping_delay;
+    uint32_t max_flapping_delay;
+    uint64_t max_memory;
+    uint64_t memory_pressure;
+    uint64_t cpu_affinity;
+    uint64_t numa_node;
+    uint32_t numa_policy;
+    int32_t nice;
+    uint32_t sched_policy;
+    uint32_t sched_priority;
+    uint64_t ionice;
+    /** string list of alternating keys and values */
+    uint64_t rlimits;
+    /** string list of alternating keys and values */
+    uint64_t env;
+    uint8_t has_port_check;
+} image_watch_t;
+
+char *
+image_path(const char *config_file);
+
+bool
+image_write(nyx_t *nyx, const char *path);
+
+bool
+image_load(nyx_t *nyx, const char *path, bool silent);
+
+/* vim: set et sw=4 sts=4 tw=80: */
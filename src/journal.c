@@ -0,0 +1,804 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_HISTORY
+
+#include "def.h"
+#include "journal.h"
+#include "log.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOURNAL_PREVIOUS ".1"
+#define JOURNAL_INDEX ".idx"
+
+#define WATCH_BIT(id_) (1ULL << ((id_) % 64))
+
+typedef void (*index_callback_t)(const journal_index_t *entry, void *data);
+
+static char *
+journal_path(const char *pid_dir, const char *generation, const char *suffix)
+{
+    char *path = NULL;
+
+    if (asprintf(&path, "%s/" JOURNAL_FILE "%s%s", pid_dir, generation, suffix) == -1)
+        return NULL;
+
+    return path;
+}
+
+static int64_t
+realtime_usecs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+static bool
+valid_header(const journal_header_t *header, uint32_t magic, uint32_t record_size)
+{
+    return header->magic == magic &&
+        header->version == JOURNAL_VERSION &&
+        header->record_size == record_size &&
+        header->block == JOURNAL_BLOCK;
+}
+
+static void
+init_header(journal_header_t *header, uint32_t magic, uint32_t record_size)
+{
+    memset(header, 0, sizeof(journal_header_t));
+
+    header->magic = magic;
+    header->version = JOURNAL_VERSION;
+    header->record_size = record_size;
+    header->block = JOURNAL_BLOCK;
+}
+
+static void
+block_add(journal_index_t *block, const journal_record_t *record)
+{
+    if (block->data.block.watches == 0)
+        block->data.block.first = record->time;
+
+    block->data.block.last = record->time;
+    block->data.block.watches |= WATCH_BIT(record->watch);
+}
+
+/**
+ * Derive the index entries of the given records: the names of the
+ * watches and the summary of every complete block. The summary of the
+ * trailing incomplete block is returned in 'block'.
+ */
+static void
+scan_records(const journal_record_t *records, uint64_t count,
+        index_callback_t callback, void *data, journal_index_t *block)
+{
+    memset(block, 0, sizeof(journal_index_t));
+    block->type = JOURNAL_INDEX_BLOCK;
+
+    for (uint64_t idx = 0; idx < count; idx++)
+    {
+        const journal_record_t *record = &records[idx];
+
+        if (record->type == JOURNAL_WATCH)
+        {
+            journal_index_t entry = { .type = JOURNAL_INDEX_WATCH, .id = record->watch };
+
+            memcpy(entry.data.name, record->data.name, JOURNAL_NAME_SIZE);
+            entry.data.name[JOURNAL_NAME_SIZE - 1] = '\0';
+
+            callback(&entry, data);
+        }
+
+        block_add(block, record);
+
+        if ((idx + 1) % JOURNAL_BLOCK == 0)
+        {
+            block->id = idx / JOURNAL_BLOCK;
+            callback(block, data);
+
+            memset(block, 0, sizeof(journal_index_t));
+            block->type = JOURNAL_INDEX_BLOCK;
+        }
+    }
+
+    block->id = count / JOURNAL_BLOCK;
+}
+
+static bool
+write_all_at(int32_t fd, const void *buffer, size_t size, off_t offset)
+{
+    const char *ptr = buffer;
+
+    while (size > 0)
+    {
+        ssize_t written = offset < 0
+            ? write(fd, ptr, size)
+            : pwrite(fd, ptr, size, offset);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_perror("nyx: write");
+            return false;
+        }
+
+        ptr += written;
+        size -= written;
+
+        if (offset >= 0)
+            offset += written;
+    }
+
+    return true;
+}
+
+static void
+writer_index_entry(const journal_index_t *entry, void *data)
+{
+    journal_t *journal = data;
+
+    if (entry->type == JOURNAL_INDEX_WATCH)
+    {
+        hash_add(journal->ids, entry->data.name, (void *)(uintptr_t)(entry->id + 1));
+        journal->next_id = MAX(journal->next_id, entry->id + 1);
+    }
+
+    write_all_at(journal->index_fd, entry, sizeof(journal_index_t), -1);
+}
+
+/* the index is rebuilt from the journal on every start so it never
+ * gets out of sync with the records */
+static bool
+journal_load(journal_t *journal)
+{
+    struct stat st;
+    journal_header_t header;
+
+    if (fstat(journal->fd, &st) != 0)
+    {
+        log_perror("nyx: fstat");
+        return false;
+    }
+
+    if ((size_t)st.st_size < sizeof(journal_header_t) ||
+            pread(journal->fd, &header, sizeof(header), 0) != sizeof(header) ||
+            !valid_header(&header, JOURNAL_MAGIC, sizeof(journal_record_t)))
+    {
+        init_header(&header, JOURNAL_MAGIC, sizeof(journal_record_t));
+
+        if (ftruncate(journal->fd, 0) != 0 ||
+                !write_all_at(journal->fd, &header, sizeof(header), 0))
+        {
+            log_perror("nyx: ftruncate");
+            return false;
+        }
+
+        st.st_size = sizeof(header);
+    }
+
+    /* a record that was written partially is discarded */
+    journal->records = (st.st_size - sizeof(header)) / sizeof(journal_record_t);
+
+    if (ftruncate(journal->fd, sizeof(header) + journal->records * sizeof(journal_record_t)) != 0)
+    {
+        log_perror("nyx: ftruncate");
+        return false;
+    }
+
+    init_header(&header, JOURNAL_INDEX_MAGIC, sizeof(journal_index_t));
+
+    if (!write_all_at(journal->index_fd, &header, sizeof(header), -1))
+        return false;
+
+    memset(&journal->block, 0, sizeof(journal_index_t));
+
+    if (journal->records < 1)
+        return true;
+
+    size_t size = sizeof(header) + journal->records * sizeof(journal_record_t);
+    void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, journal->fd, 0);
+
+    if (addr == MAP_FAILED)
+    {
+        log_perror("nyx: mmap");
+        return false;
+    }
+
+    const journal_record_t *records = (const journal_record_t *)((char *)addr + sizeof(header));
+
+    scan_records(records, journal->records, writer_index_entry, journal, &journal->block);
+    journal->last_time = records[journal->records - 1].time;
+
+    munmap(addr, size);
+
+    return true;
+}
+
+static bool
+journal_open_files(journal_t *journal)
+{
+    journal->fd = open(journal->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+    if (journal->fd < 0)
+    {
+        log_perror("nyx: open");
+        return false;
+    }
+
+    journal->index_fd = open(journal->index_path,
+            O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+
+    if (journal->index_fd < 0)
+    {
+        log_perror("nyx: open");
+        return false;
+    }
+
+    return journal_load(journal);
+}
+
+static void
+journal_close_files(journal_t *journal)
+{
+    if (journal->fd >= 0)
+        close(journal->fd);
+
+    if (journal->index_fd >= 0)
+        close(journal->index_fd);
+
+    journal->fd = -1;
+    journal->index_fd = -1;
+
+    if (journal->ids)
+        hash_destroy(journal->ids);
+
+    journal->ids = hash_new(NULL);
+    journal->next_id = 0;
+    journal->records = 0;
+}
+
+/**
+ * @brief Open (or create) the journal in the given pid directory
+ * @param pid_dir  pid directory of the nyx instance
+ * @param max_size maximum size of the current and the previous journal
+ *                 (in bytes)
+ * @return journal instance or NULL on failure
+ */
+journal_t *
+journal_open(const char *pid_dir, uint64_t max_size)
+{
+    journal_t *journal = xcalloc1(sizeof(journal_t));
+
+    pthread_mutex_init(&journal->lock, NULL);
+
+    journal->fd = -1;
+    journal->index_fd = -1;
+    journal->ids = hash_new(NULL);
+    journal->max_size = max_size;
+    journal->path = journal_path(pid_dir, "", "");
+    journal->index_path = journal_path(pid_dir, "", JOURNAL_INDEX);
+
+    if (journal->path == NULL || journal->index_path == NULL ||
+            !journal_open_files(journal))
+    {
+        journal_close(journal);
+        return NULL;
+    }
+
+    log_debug("Opened journal '%s' with %llu records",
+            journal->path, (unsigned long long)journal->records);
+
+    return journal;
+}
+
+/* the current journal replaces the previous one as soon as it
+ * reached half of the size limit */
+static void
+journal_rotate(journal_t *journal)
+{
+    char *previous = NULL;
+    char *previous_index = NULL;
+
+    if (asprintf(&previous, "%s" JOURNAL_PREVIOUS, journal->path) == -1)
+        return;
+
+    if (asprintf(&previous_index, "%s" JOURNAL_PREVIOUS JOURNAL_INDEX, journal->path) == -1)
+    {
+        free(previous);
+        return;
+    }
+
+    journal_close_files(journal);
+
+    if (rename(journal->path, previous) != 0 ||
+            rename(journal->index_path, previous_index) != 0)
+    {
+        log_perror("nyx: rename");
+    }
+
+    if (!journal_open_files(journal))
+        log_warn("Failed to reopen journal '%s'", journal->path);
+
+    free(previous);
+    free(previous_index);
+}
+
+static bool
+journal_append(journal_t *journal, journal_record_t *record)
+{
+    off_t offset = sizeof(journal_header_t) + journal->records * sizeof(journal_record_t);
+
+    if (!write_all_at(journal->fd, record, sizeof(journal_record_t), offset))
+        return false;
+
+    journal->records++;
+    block_add(&journal->block, record);
+
+    if (journal->records % JOURNAL_BLOCK == 0)
+    {
+        journal->block.type = JOURNAL_INDEX_BLOCK;
+        journal->block.id = journal->records / JOURNAL_BLOCK - 1;
+
+        write_all_at(journal->index_fd, &journal->block, sizeof(journal_index_t), -1);
+
+        memset(&journal->block, 0, sizeof(journal_index_t));
+    }
+
+    return true;
+}
+
+static bool
+journal_watch_id(journal_t *journal, const char *name, int64_t time, uint32_t *id)
+{
+    uintptr_t known = (uintptr_t)hash_get(journal->ids, name);
+
+    if (known)
+    {
+        *id = known - 1;
+        return true;
+    }
+
+    journal_record_t record = { .time = time, .watch = journal->next_id, .type = JOURNAL_WATCH };
+    journal_index_t entry = { .type = JOURNAL_INDEX_WATCH, .id = journal->next_id };
+
+    strncpy(record.data.name, name, JOURNAL_NAME_SIZE - 1);
+    strncpy(entry.data.name, name, JOURNAL_NAME_SIZE - 1);
+
+    if (!journal_append(journal, &record))
+        return false;
+
+    write_all_at(journal->index_fd, &entry, sizeof(journal_index_t), -1);
+
+    hash_add(journal->ids, name, (void *)(uintptr_t)(journal->next_id + 1));
+    *id = journal->next_id++;
+
+    return true;
+}
+
+static void
+journal_record(journal_t *journal, const char *name, journal_record_t *record)
+{
+    if (journal == NULL)
+        return;
+
+    pthread_mutex_lock(&journal->lock);
+
+    uint64_t size = sizeof(journal_header_t) + journal->records * sizeof(journal_record_t);
+
+    if (journal->max_size && size >= journal->max_size / 2)
+        journal_rotate(journal);
+
+    /* the records are kept in order even if the clock steps back */
+    record->time = MAX(realtime_usecs(), journal->last_time);
+    journal->last_time = record->time;
+
+    if (journal->fd >= 0 && journal_watch_id(journal, name, record->time, &record->watch))
+        journal_append(journal, record);
+
+    pthread_mutex_unlock(&journal->lock);
+}
+
+/**
+ * @brief Journal the state transition of a watch
+ * @param journal journal instance (may be NULL)
+ * @param name    name of the watch (instance)
+ * @param from    previous state
+ * @param to      new state
+ * @param pid     pid of the watched process
+ */
+void
+journal_state(journal_t *journal, const char *name, int32_t from, int32_t to, pid_t pid)
+{
+    journal_record_t record =
+    {
+        .type = JOURNAL_STATE,
+        .data.state = { .from = from, .to = to, .pid = pid }
+    };
+
+    journal_record(journal, name, &record);
+}
+
+/**
+ * @brief Journal the exit of a watched process
+ * @param journal journal instance (may be NULL)
+ * @param name    name of the watch (instance)
+ * @param pid     pid of the exited process
+ * @param status  wait status of the process
+ */
+void
+journal_exit(journal_t *journal, const char *name, pid_t pid, int32_t status)
+{
+    journal_record_t record =
+    {
+        .type = JOURNAL_EXIT,
+        .data.exit = { .pid = pid, .status = status }
+    };
+
+    journal_record(journal, name, &record);
+}
+
+/**
+ * @brief Journal the result of a port/HTTP check
+ * @param journal journal instance (may be NULL)
+ * @param name    name of the watch (instance)
+ * @param pid     pid of the checked process
+ * @param check   type of the check (check_type_e)
+ * @param success whether the check succeeded
+ * @param latency duration of the check (in microseconds)
+ */
+void
+journal_check(journal_t *journal, const char *name, pid_t pid, int32_t check,
+        bool success, uint64_t latency)
+{
+    journal_record_t record =
+    {
+        .type = JOURNAL_CHECK,
+        .data.check =
+        {
+            .pid = pid,
+            .check = check,
+            .success = success,
+            .latency = MIN(latency, UINT32_MAX)
+        }
+    };
+
+    journal_record(journal, name, &record);
+}
+
+void
+journal_close(journal_t *journal)
+{
+    if (journal == NULL)
+        return;
+
+    journal_close_files(journal);
+
+    hash_destroy(journal->ids);
+    pthread_mutex_destroy(&journal->lock);
+
+    free(journal->path);
+    free(journal->index_path);
+    xfree(journal);
+}
+
+/** read-only view of a journal file and its index */
+typedef struct
+{
+    void *addr;
+    size_t size;
+    const journal_record_t *records;
+    uint64_t count;
+    /** watch names by id */
+    char **names;
+    uint32_t names_size;
+    /** summaries of the complete blocks by number */
+    journal_index_t *blocks;
+    uint64_t block_count;
+} journal_view_t;
+
+static void
+view_index_entry(const journal_index_t *entry, void *data)
+{
+    journal_view_t *view = data;
+
+    if (entry->type == JOURNAL_INDEX_WATCH)
+    {
+        if (entry->id >= view->names_size)
+        {
+            uint32_t size = MAX(entry->id + 1, view->names_size * 2);
+
+            view->names = realloc(view->names, size * sizeof(char *));
+            memset(view->names + view->names_size, 0,
+                    (size - view->names_size) * sizeof(char *));
+            view->names_size = size;
+        }
+
+        free(view->names[entry->id]);
+        view->names[entry->id] = strndup(entry->data.name, JOURNAL_NAME_SIZE);
+    }
+    else if (entry->type == JOURNAL_INDEX_BLOCK &&
+            entry->id < view->count / JOURNAL_BLOCK)
+    {
+        view->blocks[entry->id] = *entry;
+        view->block_count = MAX(view->block_count, entry->id + 1ULL);
+    }
+}
+
+/* the index is only trusted if it covers all complete blocks -
+ * otherwise it is derived from the records themselves */
+static bool
+view_read_index(journal_view_t *view, const char *path)
+{
+    journal_header_t header;
+    journal_index_t entry;
+    bool valid = false;
+    FILE *file = fopen(path, "re");
+
+    if (file == NULL)
+        return false;
+
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+            valid_header(&header, JOURNAL_INDEX_MAGIC, sizeof(journal_index_t)))
+    {
+        while (fread(&entry, sizeof(entry), 1, file) == 1)
+            view_index_entry(&entry, view);
+
+        valid = view->block_count == view->count / JOURNAL_BLOCK;
+    }
+
+    fclose(file);
+
+    return valid;
+}
+
+static void
+view_close(journal_view_t *view)
+{
+    if (view->addr)
+        munmap(view->addr, view->size);
+
+    for (uint32_t idx = 0; idx < view->names_size; idx++)
+        free(view->names[idx]);
+
+    free(view->names);
+    xfree(view->blocks);
+}
+
+static bool
+view_open(journal_view_t *view, const char *pid_dir, const char *generation)
+{
+    struct stat st;
+    bool success = false;
+    char *path = journal_path(pid_dir, generation, "");
+    char *index_path = journal_path(pid_dir, generation, JOURNAL_INDEX);
+    int32_t fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+
+    memset(view, 0, sizeof(journal_view_t));
+
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(journal_header_t))
+        goto out;
+
+    view->size = st.st_size;
+    view->addr = mmap(NULL, view->size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (view->addr == MAP_FAILED)
+    {
+        log_perror("nyx: mmap");
+        view->addr = NULL;
+        goto out;
+    }
+
+    if (!valid_header(view->addr, JOURNAL_MAGIC, sizeof(journal_record_t)))
+    {
+        log_warn("Journal '%s' is of an unknown format", path);
+        goto out;
+    }
+
+    view->records = (const journal_record_t *)((char *)view->addr + sizeof(journal_header_t));
+    view->count = (view->size - sizeof(journal_header_t)) / sizeof(journal_record_t);
+    view->blocks = xcalloc(view->count / JOURNAL_BLOCK + 1, sizeof(journal_index_t));
+
+    if (!view_read_index(view, index_path))
+    {
+        journal_index_t block;
+
+        log_debug("Rebuilding the index of journal '%s'", path);
+
+        view->block_count = 0;
+        scan_records(view->records, view->count, view_index_entry, view, &block);
+    }
+
+    success = true;
+
+out:
+    if (fd >= 0)
+        close(fd);
+
+    free(path);
+    free(index_path);
+
+    return success;
+}
+
+static void
+view_scan(journal_view_t *view, uint64_t start, uint64_t end, const bool *selected,
+        int64_t from, int64_t to, journal_callback_t callback, void *data)
+{
+    for (uint64_t idx = start; idx < end; idx++)
+    {
+        const journal_record_t *record = &view->records[idx];
+
+        if (record->type == JOURNAL_WATCH || record->time < from || record->time > to)
+            continue;
+
+        if (record->watch >= view->names_size || !selected[record->watch])
+            continue;
+
+        callback(record, view->names[record->watch], data);
+    }
+}
+
+static void
+view_query(journal_view_t *view, matcher_t *matcher, int64_t from, int64_t to,
+        journal_callback_t callback, void *data)
+{
+    uint64_t watches = 0;
+    bool *selected = xcalloc(view->names_size + 1, sizeof(bool));
+
+    for (uint32_t id = 0; id < view->names_size; id++)
+    {
+        const char *name = view->names[id];
+
+        if (name && (matcher == NULL || matcher_match(matcher, name)))
+        {
+            selected[id] = true;
+            watches |= WATCH_BIT(id);
+        }
+    }
+
+    /* the blocks that do not contain any of the watches in the
+     * requested time range are skipped without touching their records */
+    for (uint64_t block = 0; watches && block < view->block_count; block++)
+    {
+        const journal_index_t *entry = &view->blocks[block];
+
+        if (entry->data.block.last < from || entry->data.block.first > to ||
+                !(entry->data.block.watches & watches))
+            continue;
+
+        view_scan(view, block * JOURNAL_BLOCK, (block + 1) * JOURNAL_BLOCK,
+                selected, from, to, callback, data);
+    }
+
+    if (watches)
+    {
+        view_scan(view, view->block_count * JOURNAL_BLOCK, view->count,
+                selected, from, to, callback, data);
+    }
+
+    xfree(selected);
+}
+
+/**
+ * @brief Query the journal (and the previous one) of a nyx instance
+ * @param pid_dir  pid directory of the nyx instance
+ * @param matcher  selection of the watches (NULL for all)
+ * @param from     start of the time range (microseconds since the epoch)
+ * @param to       end of the time range (microseconds since the epoch)
+ * @param callback function called for every matching record in
+ *                 chronological order
+ * @param data     data passed to the callback
+ * @return false if there is no journal at all
+ */
+bool
+journal_query(const char *pid_dir, matcher_t *matcher, int64_t from, int64_t to,
+        journal_callback_t callback, void *data)
+{
+    bool found = false;
+    const char *generations[] = { JOURNAL_PREVIOUS, "" };
+
+    for (uint32_t idx = 0; idx < LEN(generations); idx++)
+    {
+        journal_view_t view;
+
+        if (view_open(&view, pid_dir, generations[idx]))
+        {
+            view_query(&view, matcher, from, to, callback, data);
+            found = true;
+        }
+
+        view_close(&view);
+    }
+
+    return found;
+}
+
+/**
+ * @brief Parse a point in time: 'now', relative to now ('30m', '2h' ago),
+ *        seconds since the epoch or a local date/time
+ *        ('2019-03-01T12:00:00' or '2019-03-01')
+ * @param input time to parse
+ * @param now   current time (microseconds since the epoch)
+ * @param time  parsed time (microseconds since the epoch)
+ * @return true on success; false otherwise
+ */
+bool
+journal_parse_time(const char *input, int64_t now, int64_t *time)
+{
+    struct tm tm;
+    const char *end = NULL;
+
+    if (!strcmp(input, "now"))
+    {
+        *time = now;
+        return true;
+    }
+
+    /* relative to now: a number followed by its unit */
+    size_t digits = strspn(input, "0123456789");
+
+    if (digits > 0 && input[digits] && strchr("smhSMH", input[digits]) &&
+            input[digits + 1] == '\0')
+    {
+        uint32_t seconds = parse_time_unit(input);
+
+        *time = now - seconds * 1000000LL;
+        return true;
+    }
+
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_isdst = -1;
+
+    if ((end = strptime(input, "%Y-%m-%dT%H:%M:%S", &tm)) == NULL)
+    {
+        memset(&tm, 0, sizeof(tm));
+        tm.tm_isdst = -1;
+        end = strptime(input, "%Y-%m-%d", &tm);
+    }
+
+    if (end && *end == '\0')
+    {
+        *time = mktime(&tm) * 1000000LL;
+        return true;
+    }
+
+    char *rest = NULL;
+    long long seconds = strtoll(input, &rest, 10);
+
+    if (rest == input || *rest != '\0' || seconds < 0)
+        return false;
+
+    *time = seconds * 1000000LL;
+    return true;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,173 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "hash.h"
+#include "matcher.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define JOURNAL_MAGIC 0x4e524a4e
+#define JOURNAL_INDEX_MAGIC 0x58444a4e
+#define JOURNAL_VERSION 1
+
+/* file name of the journal in the pid directory - the previous journal
+ * is kept with a '.1' suffix, the index next to it with '.idx' */
+#define JOURNAL_FILE "nyx.journal"
+
+/* number of records summarized by one index entry */
+#define JOURNAL_BLOCK 1024
+
+/* maximum length of a journaled watch name (including '\0') */
+#define JOURNAL_NAME_SIZE 48
+
+typedef enum
+{
+    /** assigns a name to a watch id */
+    JOURNAL_WATCH,
+    /** state transition */
+    JOURNAL_STATE,
+    /** exit of a watched process */
+    JOURNAL_EXIT,
+    /** result of a port/HTTP check */
+    JOURNAL_CHECK
+} journal_type_e;
+
+/**
+ * Fixed-size record of the journal. The file starts with a header of
+ * the same size followed by the records in chronological order so it
+ * can be memory-mapped and searched by time directly.
+ */
+typedef struct
+{
+    /** microseconds since the epoch */
+    int64_t time;
+    uint32_t watch;
+    uint32_t type;
+    union
+    {
+        struct
+        {
+            int32_t from;
+            int32_t to;
+            int32_t pid;
+        } state;
+        struct
+        {
+            int32_t pid;
+            /** wait status */
+            int32_t status;
+        } exit;
+        struct
+        {
+            int32_t pid;
+            /** check_type_e */
+            int32_t check;
+            int32_t success;
+            /** in microseconds */
+            uint32_t latency;
+        } check;
+        char name[JOURNAL_NAME_SIZE];
+    } data;
+} journal_record_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t block;
+    uint8_t padding[48];
+} journal_header_t;
+
+/**
+ * Entry of the sparse index: either the summary of a block of
+ * JOURNAL_BLOCK records or the name of a watch id.
+ */
+typedef struct
+{
+    uint32_t type;
+    /** block number or watch id */
+    uint32_t id;
+    union
+    {
+        struct
+        {
+            int64_t first;
+            int64_t last;
+            /** bit (id % 64) of every watch in the block */
+            uint64_t watches;
+        } block;
+        char name[JOURNAL_NAME_SIZE];
+    } data;
+} journal_index_t;
+
+typedef enum
+{
+    JOURNAL_INDEX_BLOCK,
+    JOURNAL_INDEX_WATCH
+} journal_index_type_e;
+
+/** append-only journal of the state transitions, exits and checks */
+typedef struct
+{
+    pthread_mutex_t lock;
+    int32_t fd;
+    int32_t index_fd;
+    char *path;
+    char *index_path;
+    /** size limit of the current and previous journal (in bytes) */
+    uint64_t max_size;
+    uint64_t records;
+    int64_t last_time;
+    /** watch name -> id + 1 */
+    hash_t *ids;
+    uint32_t next_id;
+    /** summary of the current (incomplete) block */
+    journal_index_t block;
+} journal_t;
+
+typedef void (*journal_callback_t)(const journal_record_t *record,
+        const char *name, void *data);
+
+journal_t *
+journal_open(const char *pid_dir, uint64_t max_size);
+
+void
+journal_state(journal_t *journal, const char *name, int32_t from, int32_t to, pid_t pid);
+
+void
+journal_exit(journal_t *journal, const char *name, pid_t pid, int32_t status);
+
+void
+journal_check(journal_t *journal, const char *name, pid_t pid, int32_t check,
+        bool success, uint64_t latency);
+
+void
+journal_close(journal_t *journal);
+
+bool
+journal_query(const char *pid_dir, matcher_t *matcher, int64_t from, int64_t to,
+        journal_callback_t callback, void *data);
+
+bool
+journal_parse_time(const char *input, int64_t now, int64_t *time);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,263 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define NYX_MEM_TAG MEM_CONNECTOR
+
+#include "json.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Initialize a JSON writer
+ * @param json JSON writer
+ * @param out  output buffer the values are appended to
+ */
+void
+json_init(json_t *json, strbuf_t *out)
+{
+    memset(json, 0, sizeof(json_t));
+
+    json->out = out;
+}
+
+/* write the separator preceding a new value */
+static void
+begin_value(json_t *json)
+{
+    if (json->after_key)
+    {
+        json->after_key = false;
+        return;
+    }
+
+    if (json->depth < NYX_JSON_MAX_DEPTH)
+    {
+        if (json->separate[json->depth])
+            strbuf_append_char(json->out, ',');
+
+        json->separate[json->depth] = true;
+    }
+}
+
+static void
+open_level(json_t *json, const char *bracket)
+{
+    begin_value(json);
+    strbuf_append_string(json->out, bracket);
+
+    json->depth++;
+
+    if (json->depth < NYX_JSON_MAX_DEPTH)
+        json->separate[json->depth] = false;
+}
+
+static void
+close_level(json_t *json, const char *bracket)
+{
+    if (json->depth > 0)
+        json->depth--;
+
+    strbuf_append_string(json->out, bracket);
+}
+
+void
+json_object_start(json_t *json)
+{
+    open_level(json, "{");
+}
+
+void
+json_object_end(json_t *json)
+{
+    close_level(json, "}");
+}
+
+void
+json_array_start(json_t *json)
+{
+    open_level(json, "[");
+}
+
+void
+json_array_end(json_t *json)
+{
+    close_level(json, "]");
+}
+
+/* append the escaped string including its quotes */
+static void
+append_escaped(strbuf_t *out, const char *value)
+{
+    const char *run = value;
+
+    strbuf_append_char(out, '"');
+
+    for (const char *chr = value; *chr; chr++)
+    {
+        unsigned char c = *chr;
+
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        /* the unescaped characters are appended at once */
+        if (chr > run)
+            strbuf_append_data(out, run, chr - run);
+
+        switch (c)
+        {
+            case '"':
+                strbuf_append_data(out, "\\\"", 2);
+                break;
+            case '\\':
+                strbuf_append_data(out, "\\\\", 2);
+                break;
+            case '\n':
+                strbuf_append_data(out, "\\n", 2);
+                break;
+            case '\r':
+                strbuf_append_data(out, "\\r", 2);
+                break;
+            case '\t':
+                strbuf_append_data(out, "\\t", 2);
+                break;
+            default:
+                strbuf_append(out, "\\u%04x", c);
+                break;
+        }
+
+        run = chr + 1;
+    }
+
+    strbuf_append_string(out, run);
+    strbuf_append_char(out, '"');
+}
+
+/**
+ * @brief Write the key of the next value of an object
+ * @param json JSON writer
+ * @param key  name of the key
+ */
+void
+json_key(json_t *json, const char *key)
+{
+    begin_value(json);
+    append_escaped(json->out, key);
+    strbuf_append_char(json->out, ':');
+
+    json->after_key = true;
+}
+
+/**
+ * @brief Write a string value
+ * @param json  JSON writer
+ * @param value string to write (NULL is written as null)
+ */
+void
+json_string(json_t *json, const char *value)
+{
+    if (value == NULL)
+    {
+        json_null(json);
+        return;
+    }
+
+    begin_value(json);
+    append_escaped(json->out, value);
+}
+
+/**
+ * @brief Write an array of strings
+ * @param json   JSON writer
+ * @param values NULL-terminated strings (NULL is written as null)
+ */
+void
+json_strings(json_t *json, const char **values)
+{
+    if (values == NULL)
+    {
+        json_null(json);
+        return;
+    }
+
+    json_array_start(json);
+
+    while (*values)
+        json_string(json, *values++);
+
+    json_array_end(json);
+}
+
+void
+json_int(json_t *json, int64_t value)
+{
+    begin_value(json);
+    strbuf_append_int(json->out, value);
+}
+
+void
+json_uint(json_t *json, uint64_t value)
+{
+    begin_value(json);
+    strbuf_append_uint(json->out, value);
+}
+
+/**
+ * @brief Write a number value
+ * @param json  JSON writer
+ * @param value number to write (NaN and infinity are written as null)
+ */
+void
+json_double(json_t *json, double value)
+{
+    if (!isfinite(value))
+    {
+        json_null(json);
+        return;
+    }
+
+    begin_value(json);
+    strbuf_append(json->out, "%.15g", value);
+}
+
+void
+json_bool(json_t *json, bool value)
+{
+    begin_value(json);
+    strbuf_append_string(json->out, value ? "true" : "false");
+}
+
+void
+json_null(json_t *json)
+{
+    begin_value(json);
+    strbuf_append_data(json->out, "null", 4);
+}
+
+/**
+ * @brief Write an already serialized value as it is
+ * @param json   JSON writer
+ * @param value  serialized JSON value
+ * @param length length of the value
+ */
+void
+json_raw(json_t *json, const char *value, size_t length)
+{
+    begin_value(json);
+    strbuf_append_data(json->out, value, length);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
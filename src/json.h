@@ -0,0 +1,84 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "strbuf.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NYX_JSON_MAX_DEPTH 16
+
+/**
+ * Streaming JSON writer: values are appended to the output buffer as
+ * they are written - the writer keeps track of the separators only.
+ * Values nested deeper than NYX_JSON_MAX_DEPTH are not separated.
+ */
+typedef struct
+{
+    strbuf_t *out;
+    uint32_t depth;
+    /** a value was written on the current level already */
+    bool separate[NYX_JSON_MAX_DEPTH];
+    /** the next value belongs to the last written key */
+    bool after_key;
+} json_t;
+
+void
+json_init(json_t *json, strbuf_t *out);
+
+void
+json_object_start(json_t *json);
+
+void
+json_object_end(json_t *json);
+
+void
+json_array_start(json_t *json);
+
+void
+json_array_end(json_t *json);
+
+void
+json_key(json_t *json, const char *key);
+
+void
+json_string(json_t *json, const char *value);
+
+void
+json_strings(json_t *json, const char **values);
+
+void
+json_int(json_t *json, int64_t value);
+
+void
+json_uint(json_t *json, uint64_t value);
+
+void
+json_double(json_t *json, double value);
+
+void
+json_bool(json_t *json, bool value);
+
+void
+json_null(json_t *json);
+
+void
+json_raw(json_t *json, const char *value, size_t length);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,402 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Process events of the watched processes via kqueue (EVFILT_PROC) on
+ * OSX - the counterpart of the netlink process connector (event.c) on
+ * linux. Every watched pid is registered on its own as the states learn
+ * them. The forks of processes with resource limits are followed as
+ * well so their descendants are accounted to the process tree.
+ */
+
+#define NYX_LOG_CATEGORY NYX_LOG_EVENT
+#define NYX_MEM_TAG MEM_PROC
+
+#include "def.h"
+#include "event.h"
+#include "log.h"
+#include "pidmap.h"
+#include "reactor.h"
+#include "state.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <libproc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/event.h>
+#include <unistd.h>
+
+#define NYX_MAX_EVENTS 16
+
+/* maximum number of children looked up on a fork of a process */
+#define NYX_MAX_CHILDREN 256
+
+/* state of the event manager running on the nyx reactor */
+typedef struct
+{
+    nyx_t *nyx;
+    int32_t kq;
+    process_handler_t handler;
+    process_event_data_t *event_data;
+} event_manager_t;
+
+static event_manager_t *manager = NULL;
+
+/* the registrations are updated by whatever thread modifies the
+ * watched pids */
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* registered pids of the watches (by the way they are followed) and
+ * of the descendants of processes with resource limits */
+static pidmap_t *registered = NULL;
+static pidmap_t *descendants = NULL;
+
+static char follow_exit;
+static char follow_tree;
+
+/* register the exit (and forks) of the given process
+ * @return 1 on success, 0 if the process terminated already, -1 on error */
+static int32_t
+register_pid(int32_t kq, pid_t pid, bool tree)
+{
+    struct kevent change;
+
+    EV_SET(&change, pid, EVFILT_PROC, EV_ADD, NOTE_EXIT | (tree ? NOTE_FORK : 0), 0, NULL);
+
+    if (kevent(kq, &change, 1, NULL, 0, NULL) == -1)
+    {
+        if (errno == ESRCH)
+            return 0;
+
+        log_perror("nyx: kevent");
+        return -1;
+    }
+
+    return 1;
+}
+
+static void
+unregister_pid(int32_t kq, pid_t pid)
+{
+    struct kevent change;
+
+    EV_SET(&change, pid, EVFILT_PROC, EV_DELETE, 0, 0, NULL);
+
+    /* the registration of a terminated process is removed already */
+    kevent(kq, &change, 1, NULL, 0, NULL);
+}
+
+static void
+emit_exit(event_manager_t *m, pid_t pid)
+{
+    process_event_data_t *event_data = m->event_data;
+
+    memset(event_data, 0, sizeof(process_event_data_t));
+    event_data->type = EVENT_EXIT;
+    event_data->data.exit.pid = pid;
+    event_data->data.exit.thread_group_id = pid;
+
+    NYX_TRACE2(proc__event, pid, event_data->type);
+
+    stats_count(STATS_PROC_EVENTS, 1);
+    m->handler(pid, event_data, m->nyx);
+}
+
+/* processes that terminated before they were registered are dispatched
+ * on the reactor as the caller might hold the lock of the state */
+static void
+handle_terminated(UNUSED reactor_t *reactor, void *data)
+{
+    pid_t pid = (pid_t)(intptr_t)data;
+
+    pthread_mutex_lock(&event_lock);
+    event_manager_t *m = manager;
+    pthread_mutex_unlock(&event_lock);
+
+    if (m)
+    {
+        log_debug("Process %d terminated before being registered", pid);
+
+        emit_exit(m, pid);
+    }
+}
+
+/**
+ * @brief Update the registrations of the kqueue so it reports the exits
+ *        of all watched pids
+ * @param nyx nyx instance
+ */
+void
+event_filter_update(nyx_t *nyx)
+{
+    uint32_t count = 0, capacity = 0;
+    pid_t *pids = NULL;
+
+    if (nyx->pids == NULL)
+        return;
+
+    pthread_mutex_lock(&event_lock);
+
+    if (manager == NULL)
+    {
+        pthread_mutex_unlock(&event_lock);
+        return;
+    }
+
+    /* the pids might change in the meantime so we retry until
+     * the array is big enough */
+    do
+    {
+        xfree(pids);
+
+        capacity = pidmap_count(nyx->pids) + 16;
+        pids = xcalloc(capacity, sizeof(pid_t));
+        count = pidmap_pids(nyx->pids, pids, capacity);
+    }
+    while (count > capacity);
+
+    pidmap_t *previous = registered;
+
+    registered = pidmap_new();
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        state_t *state = pidmap_get(nyx->pids, pids[i]);
+        bool tree = state && watch_has_limits(state->watch);
+        void *follow = tree ? &follow_tree : &follow_exit;
+
+        pidmap_add(registered, pids[i], follow);
+
+        /* what is left in the previous registrations is unregistered */
+        bool unchanged = pidmap_get(previous, pids[i]) == follow;
+
+        pidmap_remove(previous, pids[i], NULL);
+
+        if (unchanged)
+            continue;
+
+        if (register_pid(manager->kq, pids[i], tree) == 0)
+        {
+            reactor_add_timer(nyx->reactor, 0, false, handle_terminated,
+                    (void *)(intptr_t)pids[i]);
+        }
+    }
+
+    /* the pids that are not watched anymore */
+    uint32_t removed = pidmap_count(previous);
+    pid_t *unwatched = xcalloc(removed + 1, sizeof(pid_t));
+
+    removed = pidmap_pids(previous, unwatched, removed + 1);
+
+    for (uint32_t i = 0; i < removed; i++)
+        unregister_pid(manager->kq, unwatched[i]);
+
+    pidmap_destroy(previous);
+
+    pthread_mutex_unlock(&event_lock);
+
+    xfree(unwatched);
+    xfree(pids);
+}
+
+/**
+ * Register the new children of a process that forked - kqueue does not
+ * report the child's pid so the children are looked up instead
+ */
+static void
+handle_fork(event_manager_t *m, pid_t parent)
+{
+    pid_t children[NYX_MAX_CHILDREN];
+    int32_t bytes = proc_listpids(PROC_PPID_ONLY, parent, children, sizeof(children));
+
+    if (bytes <= 0)
+        return;
+
+    process_event_data_t *event_data = m->event_data;
+    uint32_t count = MIN((uint32_t)(bytes / sizeof(pid_t)), NYX_MAX_CHILDREN);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pid_t child = children[i];
+
+        if (child < 1)
+            continue;
+
+        pthread_mutex_lock(&event_lock);
+
+        bool known = pidmap_get(registered, child) || pidmap_get(descendants, child);
+        bool added = !known && register_pid(m->kq, child, true) > 0;
+
+        if (added)
+            pidmap_add(descendants, child, &follow_tree);
+
+        pthread_mutex_unlock(&event_lock);
+
+        if (!added)
+            continue;
+
+        memset(event_data, 0, sizeof(process_event_data_t));
+        event_data->type = EVENT_FORK;
+        event_data->data.fork.parent_pid = parent;
+        event_data->data.fork.parent_thread_group_id = parent;
+        event_data->data.fork.child_pid = child;
+        event_data->data.fork.child_thread_group_id = child;
+
+        NYX_TRACE2(proc__event, child, event_data->type);
+
+        stats_count(STATS_PROC_EVENTS, 1);
+        m->handler(child, event_data, m->nyx);
+    }
+}
+
+static void
+handle_exit(event_manager_t *m, pid_t pid)
+{
+    pthread_mutex_lock(&event_lock);
+    pidmap_remove(descendants, pid, &follow_tree);
+    pthread_mutex_unlock(&event_lock);
+
+    emit_exit(m, pid);
+}
+
+static void
+handle_kqueue(reactor_t *reactor, int32_t fd, UNUSED uint32_t events, void *data)
+{
+    event_manager_t *m = data;
+    struct kevent received[NYX_MAX_EVENTS];
+    struct timespec timeout = { 0, 0 };
+
+    while (true)
+    {
+        int32_t count = kevent(fd, NULL, 0, received, NYX_MAX_EVENTS, &timeout);
+
+        if (count == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_perror("nyx: kevent");
+            log_error("Event manager: failed to receive process events");
+            reactor_remove_fd(reactor, fd);
+            return;
+        }
+
+        for (int32_t i = 0; i < count; i++)
+        {
+            struct kevent *event = &received[i];
+            pid_t pid = event->ident;
+
+            if (event->filter != EVFILT_PROC || (event->flags & EV_ERROR))
+                continue;
+
+            /* the children are registered before a possible exit of
+             * their parent is dispatched */
+            if (event->fflags & NOTE_FORK)
+                handle_fork(m, pid);
+
+            if (event->fflags & NOTE_EXIT)
+                handle_exit(m, pid);
+        }
+
+        if (count < NYX_MAX_EVENTS)
+            break;
+    }
+}
+
+/**
+ * @brief Start receiving process events via kqueue on the nyx reactor
+ * @param nyx     nyx instance
+ * @param handler process event handler
+ * @return true on success, false otherwise
+ */
+bool
+event_init(nyx_t *nyx, process_handler_t handler)
+{
+    int32_t kq = kqueue();
+
+    if (kq == -1)
+    {
+        log_perror("nyx: kqueue");
+        return false;
+    }
+
+    event_manager_t *m = xcalloc1(sizeof(event_manager_t));
+
+    m->nyx = nyx;
+    m->kq = kq;
+    m->handler = handler;
+    m->event_data = xcalloc1(sizeof(process_event_data_t));
+
+    pthread_mutex_lock(&event_lock);
+
+    manager = m;
+    registered = pidmap_new();
+    descendants = pidmap_new();
+
+    pthread_mutex_unlock(&event_lock);
+
+    event_filter_update(nyx);
+
+    if (!reactor_add_fd(nyx->reactor, kq, handle_kqueue, m))
+    {
+        event_shutdown(nyx);
+        return false;
+    }
+
+    log_debug("Started event manager (kqueue)");
+
+    return true;
+}
+
+/**
+ * @brief Stop receiving process events
+ * @param nyx nyx instance
+ */
+void
+event_shutdown(nyx_t *nyx)
+{
+    pthread_mutex_lock(&event_lock);
+
+    event_manager_t *m = manager;
+
+    manager = NULL;
+
+    if (m)
+    {
+        pidmap_destroy(registered);
+        pidmap_destroy(descendants);
+        registered = descendants = NULL;
+    }
+
+    pthread_mutex_unlock(&event_lock);
+
+    if (m == NULL)
+        return;
+
+    reactor_remove_fd(nyx->reactor, m->kq);
+    close(m->kq);
+
+    xfree(m->event_data);
+    xfree(m);
+
+    log_debug("Event manager: terminated");
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
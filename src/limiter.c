@@ -0,0 +1,287 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_STATE
+
+#include "def.h"
+#include "limiter.h"
+#include "log.h"
+
+#include <math.h>
+#include <time.h>
+
+static uint64_t
+now_msecs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+limiter_t *
+limiter_new(limiter_wake_t wake)
+{
+    limiter_t *limiter = xcalloc1(sizeof(limiter_t));
+
+    pthread_mutex_init(&limiter->lock, NULL);
+
+    limiter->wake = wake;
+    limiter->refilled = now_msecs();
+
+    return limiter;
+}
+
+/* has to be called with the limiter lock being held */
+static void
+refill(limiter_t *limiter, uint64_t now)
+{
+    if (limiter->rate > 0 && now > limiter->refilled)
+    {
+        double tokens = limiter->tokens + (now - limiter->refilled) * limiter->rate / 1000.0;
+
+        limiter->tokens = MIN(tokens, (double)limiter->burst);
+    }
+
+    limiter->refilled = now;
+}
+
+/* has to be called with the limiter lock being held */
+static void
+unlink_ticket(limiter_t *limiter, limiter_ticket_t *ticket)
+{
+    if (ticket->prev)
+        ticket->prev->next = ticket->next;
+    else
+        limiter->head = ticket->next;
+
+    if (ticket->next)
+        ticket->next->prev = ticket->prev;
+    else
+        limiter->tail = ticket->prev;
+
+    ticket->prev = NULL;
+    ticket->next = NULL;
+    ticket->queued = false;
+    limiter->queued--;
+}
+
+/* insert the ticket behind all tickets of at least the same priority
+ * (has to be called with the limiter lock being held) */
+static void
+enqueue(limiter_t *limiter, limiter_ticket_t *ticket)
+{
+    limiter_ticket_t *before = limiter->tail;
+
+    while (before && before->priority < ticket->priority)
+        before = before->prev;
+
+    ticket->prev = before;
+    ticket->next = before ? before->next : limiter->head;
+
+    if (ticket->next)
+        ticket->next->prev = ticket;
+    else
+        limiter->tail = ticket;
+
+    if (before)
+        before->next = ticket;
+    else
+        limiter->head = ticket;
+
+    ticket->queued = true;
+    limiter->queued++;
+}
+
+/* admit the queued tickets in order as long as the budget allows - all
+ * but the 'current' one (whose owner is asking already) are woken up
+ * (has to be called with the limiter lock being held) */
+static void
+dispatch(limiter_t *limiter, limiter_ticket_t *current)
+{
+    refill(limiter, now_msecs());
+
+    while (limiter->head)
+    {
+        limiter_ticket_t *ticket = limiter->head;
+
+        if (limiter->concurrency && limiter->inflight >= limiter->concurrency)
+            break;
+
+        if (limiter->rate && limiter->tokens < 1.0)
+            break;
+
+        unlink_ticket(limiter, ticket);
+
+        if (limiter->rate)
+            limiter->tokens -= 1.0;
+
+        ticket->admitted = true;
+        limiter->inflight++;
+
+        if (limiter->wake && ticket != current)
+            limiter->wake(ticket->data);
+    }
+}
+
+/**
+ * @brief Configure the budget of the limiter (0 meaning unlimited)
+ * @param limiter     limiter instance
+ * @param rate        restarts per second
+ * @param burst       restarts that may happen at once (defaults to the rate)
+ * @param concurrency maximum number of restarts in progress
+ */
+void
+limiter_configure(limiter_t *limiter, uint32_t rate, uint32_t burst, uint32_t concurrency)
+{
+    pthread_mutex_lock(&limiter->lock);
+
+    refill(limiter, now_msecs());
+
+    /* a new bucket starts full */
+    if (limiter->rate == 0)
+        limiter->tokens = burst ? burst : rate;
+
+    limiter->rate = rate;
+    limiter->burst = burst ? burst : MAX(rate, 1);
+    limiter->concurrency = concurrency;
+    limiter->tokens = MIN(limiter->tokens, (double)limiter->burst);
+
+    dispatch(limiter, NULL);
+
+    pthread_mutex_unlock(&limiter->lock);
+}
+
+/**
+ * @brief Request the admission of a restart - the request is queued if
+ *        the budget is exhausted or other requests are waiting already
+ * @param limiter  limiter instance
+ * @param ticket   ticket of the restart
+ * @param priority priority of the restart (higher ones are admitted first)
+ * @param data     data passed to the wake callback on a later admission
+ * @return true if the restart is admitted right away
+ */
+bool
+limiter_acquire(limiter_t *limiter, limiter_ticket_t *ticket, int32_t priority, void *data)
+{
+    pthread_mutex_lock(&limiter->lock);
+
+    if (!ticket->admitted && !ticket->queued)
+    {
+        ticket->priority = priority;
+        ticket->seq = ++limiter->sequence;
+        ticket->data = data;
+
+        enqueue(limiter, ticket);
+        dispatch(limiter, ticket);
+    }
+
+    bool admitted = ticket->admitted;
+
+    pthread_mutex_unlock(&limiter->lock);
+
+    return admitted;
+}
+
+/**
+ * @brief Check the admission of a queued restart
+ * @param limiter limiter instance
+ * @param ticket  ticket of the restart
+ * @return 0 if the restart is admitted; otherwise the time (in
+ *         milliseconds) until the next check is worthwhile
+ */
+uint32_t
+limiter_poll(limiter_t *limiter, limiter_ticket_t *ticket)
+{
+    uint32_t wait = 0;
+
+    pthread_mutex_lock(&limiter->lock);
+
+    dispatch(limiter, ticket);
+
+    if (!ticket->admitted)
+    {
+        wait = LIMITER_RETRY_MSECS;
+
+        /* the next token is due earlier than a retry */
+        if (limiter->rate && limiter->tokens < 1.0)
+        {
+            double until = ceil((1.0 - limiter->tokens) * 1000.0 / limiter->rate);
+
+            wait = MAX(MIN(until, (double)LIMITER_RETRY_MSECS), 1.0);
+        }
+    }
+
+    pthread_mutex_unlock(&limiter->lock);
+
+    return wait;
+}
+
+/**
+ * @brief Release the concurrency slot of a finished restart or withdraw
+ *        a queued one
+ * @param limiter limiter instance
+ * @param ticket  ticket of the restart
+ */
+void
+limiter_release(limiter_t *limiter, limiter_ticket_t *ticket)
+{
+    pthread_mutex_lock(&limiter->lock);
+
+    if (ticket->queued)
+        unlink_ticket(limiter, ticket);
+
+    if (ticket->admitted)
+    {
+        ticket->admitted = false;
+        limiter->inflight--;
+
+        dispatch(limiter, NULL);
+    }
+
+    pthread_mutex_unlock(&limiter->lock);
+}
+
+/**
+ * @brief Get the number of restarts waiting for their admission
+ * @param limiter limiter instance
+ */
+uint32_t
+limiter_queued(limiter_t *limiter)
+{
+    pthread_mutex_lock(&limiter->lock);
+
+    uint32_t queued = limiter->queued;
+
+    pthread_mutex_unlock(&limiter->lock);
+
+    return queued;
+}
+
+void
+limiter_destroy(limiter_t *limiter)
+{
+    if (limiter == NULL)
+        return;
+
+    pthread_mutex_destroy(&limiter->lock);
+
+    xfree(limiter);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
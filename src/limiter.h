@@ -0,0 +1,91 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* a restart waiting for the release of a concurrency slot polls again
+ * after this time (in milliseconds) at the latest */
+#define LIMITER_RETRY_MSECS 1000
+
+/* called (with the limiter locked) as soon as a queued ticket is admitted
+ * on behalf of another caller */
+typedef void (*limiter_wake_t)(void *data);
+
+/** restart request of a single watch instance (embedded in its state) */
+typedef struct limiter_ticket_t
+{
+    int32_t priority;
+    /** order of the requests of the same priority */
+    uint64_t seq;
+    bool queued;
+    /** the restart may proceed and holds a concurrency slot */
+    bool admitted;
+    void *data;
+    struct limiter_ticket_t *prev;
+    struct limiter_ticket_t *next;
+} limiter_ticket_t;
+
+/**
+ * Host-wide limit of the restarts of all watches: a token bucket that is
+ * refilled with 'rate' restarts per second (holding up to 'burst' tokens)
+ * and at most 'concurrency' restarts in progress at the same time. The
+ * restarts exceeding the budget are queued by their priority (highest
+ * first) and in the order they were requested otherwise.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    limiter_wake_t wake;
+    /** restarts per second (0 = unlimited) */
+    uint32_t rate;
+    uint32_t burst;
+    /** maximum number of restarts in progress (0 = unlimited) */
+    uint32_t concurrency;
+    double tokens;
+    /** monotonic time (in msec) the tokens were refilled last */
+    uint64_t refilled;
+    uint32_t inflight;
+    uint32_t queued;
+    uint64_t sequence;
+    limiter_ticket_t *head;
+    limiter_ticket_t *tail;
+} limiter_t;
+
+limiter_t *
+limiter_new(limiter_wake_t wake);
+
+void
+limiter_configure(limiter_t *limiter, uint32_t rate, uint32_t burst, uint32_t concurrency);
+
+bool
+limiter_acquire(limiter_t *limiter, limiter_ticket_t *ticket, int32_t priority, void *data);
+
+uint32_t
+limiter_poll(limiter_t *limiter, limiter_ticket_t *ticket);
+
+void
+limiter_release(limiter_t *limiter, limiter_ticket_t *ticket);
+
+uint32_t
+limiter_queued(limiter_t *limiter);
+
+void
+limiter_destroy(limiter_t *limiter);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -13,10 +13,16 @@
  * limitations under the License.
  */
 
+#define NYX_MEM_TAG MEM_HASH
+
 #include "def.h"
 #include "list.h"
 #include "log.h"
 
+/* the slabs grow from LIST_SLAB_MIN up to LIST_SLAB_MAX nodes */
+#define LIST_SLAB_MIN 4
+#define LIST_SLAB_MAX 256
+
 list_t *
 list_new(void (*free_func)(void *))
 {
@@ -27,6 +33,87 @@ list_new(void (*free_func)(void *))
     return list;
 }
 
+/**
+ * @brief Create a new list of elements that embed their list node
+ * @param free_func function to free the elements with (or NULL)
+ * @return new list instance (elements are added via 'list_push')
+ */
+list_t *
+list_new_intrusive(void (*free_func)(void *))
+{
+    list_t *list = list_new(free_func);
+
+    list->intrusive = true;
+
+    return list;
+}
+
+static list_node_t *
+node_acquire(list_t *list)
+{
+    list_node_t *node = list->spare;
+
+    if (node == NULL)
+    {
+        uint32_t size = list->slabs
+            ? MIN(list->slabs->size * 2, LIST_SLAB_MAX)
+            : LIST_SLAB_MIN;
+
+        list_slab_t *slab = xcalloc1(sizeof(list_slab_t) + size * sizeof(list_node_t));
+
+        slab->size = size;
+        slab->next = list->slabs;
+        list->slabs = slab;
+
+        /* chain all nodes of the new slab but the first one */
+        for (uint32_t idx = 1; idx < size - 1; idx++)
+            slab->nodes[idx].next = &slab->nodes[idx + 1];
+
+        list->spare = &slab->nodes[1];
+
+        return &slab->nodes[0];
+    }
+
+    list->spare = node->next;
+    node->next = NULL;
+
+    return node;
+}
+
+static void
+node_release(list_t *list, list_node_t *node)
+{
+    node->prev = NULL;
+    node->data = NULL;
+
+    if (list->intrusive)
+    {
+        node->next = NULL;
+        return;
+    }
+
+    node->next = list->spare;
+    list->spare = node;
+}
+
+static void
+unlink_node(list_t *list, list_node_t *node)
+{
+    if (node->prev)
+        node->prev->next = node->next;
+
+    if (node->next)
+        node->next->prev = node->prev;
+
+    if (node == list->head)
+        list->head = node->next;
+
+    if (node == list->tail)
+        list->tail = node->prev;
+
+    list->count--;
+}
+
 void *
 list_find(list_t *list, bool (*predicate)(void *))
 {
@@ -56,17 +143,8 @@ list_pop(list_t *list, void **data)
 
     *data = head->data;
 
-    /* update list structure */
-    list->count = list->count - 1;
-    list->head = head->next;
-
-    if (list->head)
-        list->head->prev = NULL;
-
-    if (head == list->tail)
-        list->tail = NULL;
-
-    free(head);
+    unlink_node(list, head);
+    node_release(list, head);
 
     return true;
 }
@@ -74,49 +152,45 @@ list_pop(list_t *list, void **data)
 void
 list_remove(list_t *list, list_node_t *node)
 {
-    if (node->prev)
-        node->prev->next = node->next;
-
-    if (node->next)
-        node->next->prev = node->prev;
-
-    if (node == list->head)
-        list->head = node->next;
+    void *data = node->data;
 
-    if (node == list->tail)
-        list->tail = node->prev;
-
-    list->count--;
+    unlink_node(list, node);
+    node_release(list, node);
 
+    /* the element may contain the node itself */
     if (list->free_func)
-        list->free_func(node->data);
-
-    free(node);
+        list->free_func(data);
 }
 
+/**
+ * @brief Append an element to an intrusive list
+ * @param list list instance
+ * @param node node embedded in the element (not linked to any list)
+ * @param data element to append
+ */
 void
-list_add(list_t *list, void *data)
+list_push(list_t *list, list_node_t *node, void *data)
 {
-    list_node_t *node = xcalloc(1, sizeof(list_node_t));
-
     node->data = data;
+    node->next = NULL;
+    node->prev = list->tail;
 
     /* empty list */
     if (list->tail == NULL)
-    {
         list->head = node;
-        list->tail = node;
-    }
     else
-    {
         list->tail->next = node;
-        node->prev = list->tail;
-        list->tail = node;
-    }
 
+    list->tail = node;
     list->count++;
 }
 
+void
+list_add(list_t *list, void *data)
+{
+    list_push(list, node_acquire(list), data);
+}
+
 void
 list_destroy(list_t *list)
 {
@@ -132,11 +206,20 @@ list_destroy(list_t *list)
         if (free_func != NULL && node->data != NULL)
             free_func(node->data);
 
-        free(node);
         node = next;
     }
 
-    free(list);
+    list_slab_t *slab = list->slabs;
+
+    while (slab)
+    {
+        list_slab_t *next_slab = slab->next;
+
+        xfree(slab);
+        slab = next_slab;
+    }
+
+    xfree(list);
 }
 
 void
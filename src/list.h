@@ -20,24 +20,50 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+typedef struct list_node_t
+{
+    struct list_node_t *prev;
+    struct list_node_t *next;
+    void *data;
+} list_node_t;
+
+/** block of nodes the list's nodes are carved from */
+typedef struct list_slab_t
+{
+    struct list_slab_t *next;
+    uint32_t size;
+    list_node_t nodes[];
+} list_slab_t;
+
+/**
+ * Doubly linked list whose nodes are taken from slabs owned by the list
+ * and recycled on removal so adding and removing elements does not
+ * allocate in the steady state.
+ *
+ * Intrusive lists (see 'list_new_intrusive') link nodes that are
+ * embedded in the elements themselves instead.
+ */
 typedef struct list_t
 {
     uint64_t count;
     struct list_node_t *head;
     struct list_node_t *tail;
     void (*free_func)(void *);
+    bool intrusive;
+    /** removed nodes that are reused first */
+    struct list_node_t *spare;
+    struct list_slab_t *slabs;
 } list_t;
 
-typedef struct list_node_t
-{
-    struct list_node_t *prev;
-    struct list_node_t *next;
-    void *data;
-} list_node_t;
-
 list_t *
 list_new(void (*free_func)(void *));
 
+list_t *
+list_new_intrusive(void (*free_func)(void *));
+
+void
+list_push(list_t *list, list_node_t *node, void *data);
+
 void *
 list_find(list_t *list, bool (*predicate)(void *));
 
@@ -0,0 +1,228 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "def.h"
+#include "listen.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* path of a unix domain socket address (NULL for TCP addresses) */
+static const char *
+unix_path(const char *address)
+{
+    if (strncmp(address, LISTEN_UNIX_PREFIX, strlen(LISTEN_UNIX_PREFIX)) == 0)
+        return address + strlen(LISTEN_UNIX_PREFIX);
+
+    return *address == '/' ? address : NULL;
+}
+
+/* split a TCP address like '8080', 'localhost:8080' or '[::1]:8080'
+ * into host (empty for all IPv4 addresses) and port */
+static bool
+split_address(const char *address, char *host, size_t size, char *port)
+{
+    const char *colon = strrchr(address, ':');
+    const char *port_str = colon ? colon + 1 : address;
+    size_t length = colon ? (size_t)(colon - address) : 0;
+
+    if (*address == '[')
+    {
+        const char *end = strchr(address, ']');
+
+        if (end == NULL || end + 1 != colon)
+            return false;
+
+        address++;
+        length = end - address;
+    }
+
+    if (length >= size || *port_str == '\0' || strlen(port_str) > 5)
+        return false;
+
+    for (const char *chr = port_str; *chr; chr++)
+    {
+        if (*chr < '0' || *chr > '9')
+            return false;
+    }
+
+    int32_t value = atoi(port_str);
+
+    if (value < 1 || value > 65535)
+        return false;
+
+    memcpy(host, address, length);
+    host[length] = '\0';
+
+    snprintf(port, 6, "%d", value);
+
+    return true;
+}
+
+/**
+ * @brief Check the given listen address: a TCP port, '<host>:<port>',
+ *        '[<ipv6>]:<port>' or a unix socket path ('unix:<path>' or an
+ *        absolute path)
+ * @param address listen address
+ * @return true if the address is valid; false otherwise
+ */
+bool
+listen_address_valid(const char *address)
+{
+    char host[256] = {0};
+    char port[6] = {0};
+
+    if (address == NULL || *address == '\0')
+        return false;
+
+    const char *path = unix_path(address);
+
+    if (path)
+        return *path && strlen(path) < sizeof(((struct sockaddr_un *)0)->sun_path);
+
+    return split_address(address, host, sizeof(host), port);
+}
+
+static int32_t
+open_unix(const char *path)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int32_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+    {
+        log_perror("nyx: socket");
+        return -1;
+    }
+
+    /* remove a stale socket of a previous run */
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1)
+    {
+        log_perror("nyx: bind %s", path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int32_t
+open_tcp(const char *address)
+{
+    char host[256] = {0};
+    char port[6] = {0};
+    int32_t fd = -1, one = 1;
+    struct addrinfo hints, *addresses = NULL;
+
+    if (!split_address(address, host, sizeof(host), port))
+        return -1;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = *host ? AF_UNSPEC : AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    int32_t error = getaddrinfo(*host ? host : NULL, port, &hints, &addresses);
+
+    if (error)
+    {
+        log_error("Failed to resolve listen address '%s': %s", address, gai_strerror(error));
+        return -1;
+    }
+
+    for (struct addrinfo *addr = addresses; addr; addr = addr->ai_next)
+    {
+        if ((fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0)
+            continue;
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        if (bind(fd, addr->ai_addr, addr->ai_addrlen) == 0)
+            break;
+
+        close(fd);
+        fd = -1;
+    }
+
+    if (fd < 0)
+        log_perror("nyx: bind %s", address);
+
+    freeaddrinfo(addresses);
+
+    return fd;
+}
+
+/**
+ * @brief Bind a listening socket on the given address
+ * @param address listen address (see listen_address_valid)
+ * @return socket descriptor (close-on-exec) or -1 on error
+ */
+int32_t
+listen_socket_open(const char *address)
+{
+    const char *path = unix_path(address);
+    int32_t fd = path ? open_unix(path) : open_tcp(address);
+
+    if (fd < 0)
+        return -1;
+
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+        log_perror("nyx: fcntl");
+
+    if (listen(fd, SOMAXCONN) == -1)
+    {
+        log_perror("nyx: listen %s", address);
+        listen_socket_close(fd, address);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Close a socket opened by listen_socket_open
+ * @param fd      socket descriptor
+ * @param address listen address the socket was bound on
+ */
+void
+listen_socket_close(int32_t fd, const char *address)
+{
+    const char *path = unix_path(address);
+
+    if (fd >= 0)
+        close(fd);
+
+    if (path)
+        unlink(path);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
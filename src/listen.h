@@ -0,0 +1,39 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* first descriptor of the passed sockets (see sd_listen_fds(3)) */
+#define LISTEN_FDS_START 3
+
+/* maximum number of sockets a watch may listen on */
+#define LISTEN_MAX_SOCKETS 16
+
+/* prefix of unix domain socket addresses */
+#define LISTEN_UNIX_PREFIX "unix:"
+
+bool
+listen_address_valid(const char *address);
+
+int32_t
+listen_socket_open(const char *address);
+
+void
+listen_socket_close(int32_t fd, const char *address);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -19,25 +19,141 @@
 #define _GNU_SOURCE
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
+/* maximum length of a log line (longer messages are truncated) */
+#define NYX_LOG_LINE_LEN 512
+
+/* number of lines the asynchronous writer buffers (power of 2) */
+#define NYX_LOG_RING_SIZE 1024
+
+/* maximum number of lines written at once */
+#define NYX_LOG_BATCH 64
+
 static volatile bool use_syslog = false;
 static volatile bool quiet = false;
 static volatile bool use_color = false;
 static volatile bool initialized = false;
+static volatile bool milliseconds = false;
+
+#define NYX_LOG_ALL_LEVELS \
+    (NYX_LOG_DEBUG | NYX_LOG_INFO | NYX_LOG_WARN | NYX_LOG_ERROR | \
+     NYX_LOG_PERROR | NYX_LOG_CRITICAL)
+
+/* the given level and all more severe ones */
+#define LEVELS_FROM(level_) (NYX_LOG_ALL_LEVELS & ~((uint32_t)(level_) - 1))
+
+#ifndef NDEBUG
+#define NYX_LOG_DEFAULT_LEVEL NYX_LOG_DEBUG
+#else
+#define NYX_LOG_DEFAULT_LEVEL NYX_LOG_INFO
+#endif
+
+volatile uint32_t log_levels = LEVELS_FROM(NYX_LOG_DEFAULT_LEVEL);
+volatile uint32_t log_categories = 0;
+
+/* configured level and categories (the masks above are cleared if quiet) */
+static volatile uint32_t threshold = NYX_LOG_DEFAULT_LEVEL;
+static volatile uint32_t debug_categories = 0;
+
+typedef struct
+{
+    const char *name;
+    uint32_t value;
+} log_name_t;
+
+static const log_name_t level_names[] =
+{
+    { "debug", NYX_LOG_DEBUG },
+    { "info",  NYX_LOG_INFO },
+    { "warn",  NYX_LOG_WARN },
+    { "error", NYX_LOG_ERROR },
+    { NULL, 0 }
+};
+
+static const log_name_t category_names[] =
+{
+    { "proc",      NYX_LOG_PROC },
+    { "event",     NYX_LOG_EVENT },
+    { "state",     NYX_LOG_STATE },
+    { "forker",    NYX_LOG_FORKER },
+    { "connector", NYX_LOG_CONNECTOR },
+    { NULL, 0 }
+};
+
+/* formatted timestamp of the current second (per thread) */
+typedef struct
+{
+    time_t second;
+    uint32_t length;
+    char text[32];
+} log_timestamp_t;
+
+static __thread log_timestamp_t timestamp = { .second = -1 };
+
+typedef struct
+{
+    /** position the slot may be written (== position) or
+     *  read (== position + 1) at */
+    uint64_t sequence;
+    uint32_t length;
+    char line[NYX_LOG_LINE_LEN];
+} log_slot_t;
+
+/**
+ * Asynchronous writer of the daemon's log: the logging threads format
+ * their lines into a bounded lock-free ring that is written to STDOUT
+ * (the log file of a daemon) by a background thread in batches.
+ * Lines that do not fit into the ring are dropped (and counted) instead
+ * of blocking the logging thread.
+ */
+typedef struct
+{
+    log_slot_t *slots;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t dropped;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool sleeping;
+    bool stop;
+    bool reopen;
+    /** log file that is reopened on rotation (NULL if none) */
+    char *path;
+} log_writer_t;
+
+static log_writer_t writer;
+static volatile bool async = false;
+
+static void
+apply_level(uint32_t level, uint32_t categories)
+{
+    threshold = level;
+    debug_categories = categories;
+
+    log_categories = quiet ? 0 : categories;
+    log_levels = quiet ? 0 : LEVELS_FROM(level);
+}
 
 void
 log_init(nyx_t *nyx)
 {
     quiet = nyx->options.quiet;
 
+    apply_level(threshold, debug_categories);
+
     use_color = !nyx->options.no_color &&
         !nyx->options.syslog &&
         (nyx->options.no_daemon || !nyx->is_daemon);
@@ -49,15 +165,143 @@ log_init(nyx_t *nyx)
     if (use_syslog)
         openlog("nyx", LOG_NDELAY, LOG_USER);
 
+    /* lines that are still buffered on fork (daemonize, forker)
+     * would be written by both processes */
+    if (nyx->is_daemon)
+        setvbuf(stdout, NULL, _IOLBF, 0);
+
     initialized = true;
 }
 
+/**
+ * @brief Apply the logging settings of the (reloaded) configuration
+ * @param nyx nyx instance
+ */
+void
+log_configure(nyx_t *nyx)
+{
+    milliseconds = nyx->options.log_milliseconds;
+
+    if (!log_set_level(nyx->options.log_level))
+    {
+        log_warn("Invalid log level '%s' - using the default level",
+                nyx->options.log_level);
+        log_set_level(NULL);
+    }
+}
+
+static uint32_t
+find_name(const log_name_t *names, const char *name)
+{
+    for (; names->name; names++)
+    {
+        if (!strcmp(names->name, name))
+            return names->value;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parse a log level specification like 'info proc,state': a level
+ *        (debug, info, warn or error) and/or the categories whose debug
+ *        messages are logged regardless of the level
+ * @param spec       level specification (NULL for the default level)
+ * @param levels     parsed level threshold
+ * @param categories bitmask of the parsed debug categories
+ * @return true on success; false otherwise
+ */
+bool
+log_parse_level(const char *spec, uint32_t *levels, uint32_t *categories)
+{
+    *levels = NYX_LOG_DEFAULT_LEVEL;
+    *categories = 0;
+
+    if (spec == NULL)
+        return true;
+
+    char *copy = xstrdup(spec);
+    char *saveptr = NULL;
+    bool success = true;
+
+    for (char *token = strtok_r(copy, " ,", &saveptr); token;
+            token = strtok_r(NULL, " ,", &saveptr))
+    {
+        uint32_t value;
+
+        if ((value = find_name(level_names, token)) != 0)
+            *levels = value;
+        else if ((value = find_name(category_names, token)) != 0)
+            *categories |= value;
+        else
+        {
+            success = false;
+            break;
+        }
+    }
+
+    xfree(copy);
+
+    return success;
+}
+
+/**
+ * @brief Change the log level at runtime
+ * @param spec level specification (see log_parse_level)
+ * @return true on success; false if the specification is invalid
+ */
+bool
+log_set_level(const char *spec)
+{
+    uint32_t level = 0, categories = 0;
+
+    if (!log_parse_level(spec, &level, &categories))
+        return false;
+
+    apply_level(level, categories);
+
+    return true;
+}
+
+/**
+ * @brief Format the current log level in the syntax of log_parse_level
+ * @param buffer output buffer
+ * @param size   size of the output buffer
+ * @return length of the output
+ */
+size_t
+log_level_string(char *buffer, size_t size)
+{
+    const char *level = "info";
+    uint32_t categories = debug_categories;
+
+    for (const log_name_t *name = level_names; name->name; name++)
+    {
+        if (name->value == threshold)
+            level = name->name;
+    }
+
+    int32_t length = snprintf(buffer, size, "%s", level);
+
+    for (const log_name_t *name = category_names; name->name; name++)
+    {
+        if ((categories & name->value) && length >= 0 && (size_t)length < size)
+            length += snprintf(buffer + length, size - length, " %s", name->name);
+    }
+
+    return length > 0 ? MIN((size_t)length, size - 1) : 0;
+}
+
+static void log_writer_stop(void);
+
 void
 log_shutdown(void)
 {
     if (!initialized)
         return;
 
+    log_writer_stop();
+
     if (use_syslog)
         closelog();
 
@@ -131,98 +375,529 @@ get_log_prefix(log_level_e level)
     }
 }
 
-static void
-log_msg(FILE *stream, log_level_e level, const char *msg, size_t length)
+/* append to the line as far as it fits */
+static size_t
+line_append(char *line, size_t length, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static size_t
+line_append(char *line, size_t length, const char *format, ...)
 {
-    /* safe errno */
-    int32_t error = errno;
+    va_list vas;
+
+    if (length >= NYX_LOG_LINE_LEN - 1)
+        return length;
+
+    va_start(vas, format);
+    int32_t printed = vsnprintf(line + length, NYX_LOG_LINE_LEN - length, format, vas);
+    va_end(vas);
+
+    if (printed < 0)
+        return length;
+
+    return MIN(length + printed, NYX_LOG_LINE_LEN - 1);
+}
+
+/**
+ * Write the timestamp prefix of the log line: the date and time are
+ * formatted once per second and thread only (localtime is expensive).
+ * Returns the length of the prefix.
+ */
+static size_t
+format_timestamp(char *line)
+{
+    struct timespec now;
+
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+#else
+    clock_gettime(CLOCK_REALTIME, &now);
+#endif
+
+    if (now.tv_sec != timestamp.second)
+    {
+        struct tm ltime;
+
+        localtime_r(&now.tv_sec, &ltime);
+
+        timestamp.length = snprintf(timestamp.text, LEN(timestamp.text),
+                "%04d-%02d-%02dT%02d:%02d:%02d",
+                ltime.tm_year + 1900,
+                ltime.tm_mon + 1,
+                ltime.tm_mday,
+                ltime.tm_hour,
+                ltime.tm_min,
+                ltime.tm_sec);
+        timestamp.second = now.tv_sec;
+    }
+
+    size_t length = timestamp.length;
+
+    memcpy(line, timestamp.text, length);
+
+    if (milliseconds)
+    {
+        uint32_t msecs = now.tv_nsec / 1000000;
+
+        line[length++] = '.';
+        line[length++] = '0' + msecs / 100;
+        line[length++] = '0' + msecs / 10 % 10;
+        line[length++] = '0' + msecs % 10;
+    }
+
+    line[length++] = ' ';
 
-    time_t now = time(NULL);
-    struct tm *ltime = localtime(&now);
+    return length;
+}
+
+/**
+ * Format a complete log line (including its newline) into the given
+ * buffer of NYX_LOG_LINE_LEN bytes. Returns the length of the line.
+ */
+static size_t
+format_line(char *line, log_level_e level, int32_t error, const char *format, va_list values)
+{
+    size_t length = 0;
 
     if (use_color)
     {
-        size_t start_length;
-        const char *start_color = get_log_color(level, &start_length);
+        size_t color_length;
+        const char *color = get_log_color(level, &color_length);
 
-        fwrite(start_color, start_length, 1, stream);
+        memcpy(line, color, color_length);
+        length = color_length;
     }
 
-    fwrite(get_log_prefix(level), 4, 1, stream);
+    memcpy(line + length, get_log_prefix(level), 4);
+    length += 4;
+    length += format_timestamp(line + length);
 
-    fprintf(stream, "%04d-%02d-%02dT%02d:%02d:%02d ",
-                ltime->tm_year + 1900,
-                ltime->tm_mon + 1,
-                ltime->tm_mday,
-                ltime->tm_hour,
-                ltime->tm_min,
-                ltime->tm_sec);
+    /* the message itself */
+    if (length < NYX_LOG_LINE_LEN - 1)
+    {
+        int32_t printed = vsnprintf(line + length, NYX_LOG_LINE_LEN - length, format, values);
 
-    fwrite(msg, length, 1, stream);
+        if (printed > 0)
+            length = MIN(length + printed, NYX_LOG_LINE_LEN - 1);
+    }
 
     /* errno specific handling */
     if (level & NYX_LOG_PERROR)
-        fprintf(stream, ": error %d", error);
+        length = line_append(line, length, ": error %d", error);
 
+    /* write end of coloring */
     if (use_color)
+        length = line_append(line, length, "\033[0m");
+
+    /* the newline is kept even for truncated lines */
+    length = MIN(length, NYX_LOG_LINE_LEN - 2);
+    line[length++] = '\n';
+    line[length] = '\0';
+
+    return length;
+}
+
+static void
+write_all(const char *data, size_t length)
+{
+    while (length > 0)
     {
-        /* write end of coloring */
-        fwrite("\033[0m", 4, 1, stream);
+        ssize_t written = write(STDOUT_FILENO, data, length);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        data += written;
+        length -= written;
     }
+}
 
-    fputc('\n', stream);
+static void
+write_line(log_level_e level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
 
-    errno = error;
+/* write a log line directly (bypassing the writer thread) */
+static void
+write_line(log_level_e level, const char *format, ...)
+{
+    char line[NYX_LOG_LINE_LEN];
+    va_list vas;
+
+    va_start(vas, format);
+    size_t length = format_line(line, level, errno, format, vas);
+    va_end(vas);
+
+    write_all(line, length);
 }
 
 static void
-log_format_msg(FILE *stream, log_level_e level, const char *format, va_list values)
+writer_wakeup(void)
 {
-    char *msg = NULL;
+    if (!__atomic_load_n(&writer.sleeping, __ATOMIC_SEQ_CST))
+        return;
 
-    int32_t length = vasprintf(&msg, format, values);
+    pthread_mutex_lock(&writer.lock);
+    pthread_cond_signal(&writer.wakeup);
+    pthread_mutex_unlock(&writer.lock);
+}
 
-    if (length > 0)
+/**
+ * Queue a log line for the writer thread without blocking
+ * Returns false if the ring is full (the line is dropped).
+ */
+static bool
+writer_queue(log_level_e level, int32_t error, const char *format, va_list values)
+{
+    uint64_t pos = __atomic_load_n(&writer.head, __ATOMIC_RELAXED);
+    log_slot_t *slot = NULL;
+
+    while (true)
     {
-        log_msg(stream, level, msg, length);
-        free(msg);
+        slot = &writer.slots[pos & (NYX_LOG_RING_SIZE - 1)];
+
+        uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)sequence - (int64_t)pos;
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&writer.head, &pos, pos + 1, true,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+        {
+            __atomic_add_fetch(&writer.dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+        else
+            pos = __atomic_load_n(&writer.head, __ATOMIC_RELAXED);
     }
+
+    slot->length = format_line(slot->line, level, error, format, values);
+
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_SEQ_CST);
+
+    writer_wakeup();
+
+    return true;
 }
 
-void
-log_message(nyx_t *nyx, log_level_e level, const char *format, ...)
+/* write the ready lines of the ring in batches
+ * returns the number of written lines */
+static uint32_t
+writer_drain(void)
 {
-    if (!quiet)
+    uint32_t total = 0;
+
+    while (true)
     {
-        va_list vas;
-        va_start(vas, format);
+        struct iovec lines[NYX_LOG_BATCH];
+        uint32_t count = 0;
+        size_t length = 0;
 
-        if (use_syslog)
-            vsyslog(get_syslog_level(level), format, vas);
-        else
+        while (count < NYX_LOG_BATCH)
         {
-            FILE *stream = stdout;
+            uint64_t pos = writer.tail + count;
+            log_slot_t *slot = &writer.slots[pos & (NYX_LOG_RING_SIZE - 1)];
 
-            /* write to log file in case we are running as a daemon */
-            if (!nyx->options.no_daemon && !nyx->is_init)
-            {
-                const char *log_file = nyx->options.log_file
-                    ? nyx->options.log_file
-                    : NYX_DEFAULT_LOG_FILE;
+            if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1)
+                break;
+
+            lines[count].iov_base = slot->line;
+            lines[count].iov_len = slot->length;
+            length += slot->length;
+            count++;
+        }
 
-                stream = fopen(log_file, "ae");
+        if (count < 1)
+            break;
 
-                /* fallback to stdout */
-                if (stream == NULL)
-                    stream = stdout;
+        ssize_t written = writev(STDOUT_FILENO, lines, count);
+
+        /* write the remainder of a partial write line by line */
+        if (written >= 0 && (size_t)written < length)
+        {
+            for (uint32_t idx = 0; idx < count; idx++)
+            {
+                if ((size_t)written >= lines[idx].iov_len)
+                {
+                    written -= lines[idx].iov_len;
+                    continue;
+                }
+
+                write_all((char *)lines[idx].iov_base + written,
+                        lines[idx].iov_len - written);
+                written = 0;
             }
+        }
+
+        /* release the slots for the next round of the ring */
+        for (uint32_t idx = 0; idx < count; idx++)
+        {
+            log_slot_t *slot = &writer.slots[(writer.tail + idx) & (NYX_LOG_RING_SIZE - 1)];
+
+            __atomic_store_n(&slot->sequence, writer.tail + idx + NYX_LOG_RING_SIZE,
+                    __ATOMIC_RELEASE);
+        }
+
+        writer.tail += count;
+        total += count;
+    }
+
+    uint64_t dropped = __atomic_exchange_n(&writer.dropped, 0, __ATOMIC_RELAXED);
+
+    if (dropped > 0)
+        write_line(NYX_LOG_WARN, "%llu log messages were dropped", (unsigned long long)dropped);
+
+    return total;
+}
+
+/* reopen the log file if it was rotated (or a reopen was requested) */
+static void
+writer_rotate(bool force)
+{
+    struct stat current, file;
+
+    if (writer.path == NULL)
+        return;
+
+    if (!force && fstat(STDOUT_FILENO, &current) == 0 &&
+            stat(writer.path, &file) == 0 &&
+            current.st_dev == file.st_dev && current.st_ino == file.st_ino)
+        return;
 
-            log_format_msg(stream, level, format, vas);
+    int32_t fd = open(writer.path, O_WRONLY | O_APPEND | O_CREAT,
+            S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
 
-            if (stream != NULL && stream != stdout)
-                fclose(stream);
+    if (fd == -1)
+        return;
+
+    /* the log file is always written via STDOUT */
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+}
+
+static void *
+writer_loop(UNUSED void *data)
+{
+    time_t last_check = time(NULL);
+
+    pthread_mutex_lock(&writer.lock);
+
+    while (true)
+    {
+        bool stop = writer.stop, reopen = writer.reopen;
+
+        writer.reopen = false;
+
+        pthread_mutex_unlock(&writer.lock);
+
+        if (reopen)
+            writer_rotate(true);
+
+        uint32_t written = writer_drain();
+
+        /* the log file is checked for rotation once a second at most */
+        time_t now = time(NULL);
+
+        if (now != last_check)
+        {
+            writer_rotate(false);
+            last_check = now;
+        }
+
+        pthread_mutex_lock(&writer.lock);
+
+        if (stop)
+            break;
+
+        if (written > 0)
+            continue;
+
+        /* the producers wake the writer only if it is sleeping - check
+         * for new lines once more after announcing it */
+        __atomic_store_n(&writer.sleeping, true, __ATOMIC_SEQ_CST);
+
+        log_slot_t *next = &writer.slots[writer.tail & (NYX_LOG_RING_SIZE - 1)];
+
+        if (__atomic_load_n(&next->sequence, __ATOMIC_SEQ_CST) != writer.tail + 1 &&
+                !writer.stop && !writer.reopen)
+        {
+            struct timespec deadline;
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 1;
+
+            pthread_cond_timedwait(&writer.wakeup, &writer.lock, &deadline);
         }
 
+        __atomic_store_n(&writer.sleeping, false, __ATOMIC_SEQ_CST);
+    }
+
+    pthread_mutex_unlock(&writer.lock);
+
+    return NULL;
+}
+
+/* a forked child does not have the writer thread */
+static void
+writer_atfork_child(void)
+{
+    async = false;
+}
+
+/**
+ * @brief Write the log lines asynchronously by a background thread from
+ *        now on (the daemon's log file is kept open as its STDOUT)
+ * @param nyx nyx instance
+ * @return true if the writer was started
+ */
+bool
+log_writer_start(nyx_t *nyx)
+{
+    static bool atfork = false;
+
+    if (use_syslog || async)
+        return false;
+
+    writer.slots = calloc(NYX_LOG_RING_SIZE, sizeof(log_slot_t));
+
+    if (writer.slots == NULL)
+        return false;
+
+    for (uint64_t idx = 0; idx < NYX_LOG_RING_SIZE; idx++)
+        writer.slots[idx].sequence = idx;
+
+    writer.head = 0;
+    writer.tail = 0;
+    writer.dropped = 0;
+    writer.stop = false;
+    writer.reopen = false;
+    writer.sleeping = false;
+
+    /* a daemon logs into its log file that may be rotated */
+    if (!nyx->options.no_daemon && !nyx->is_init)
+    {
+        writer.path = xstrdup(nyx->options.log_file
+                ? nyx->options.log_file
+                : NYX_DEFAULT_LOG_FILE);
+    }
+
+    pthread_mutex_init(&writer.lock, NULL);
+    pthread_cond_init(&writer.wakeup, NULL);
+
+    /* lines logged via stdio so far go first */
+    fflush(stdout);
+
+    if (pthread_create(&writer.thread, NULL, writer_loop, NULL) != 0)
+    {
+        pthread_cond_destroy(&writer.wakeup);
+        pthread_mutex_destroy(&writer.lock);
+
+        xfree(writer.path);
+        free(writer.slots);
+
+        writer.path = NULL;
+        writer.slots = NULL;
+
+        return false;
+    }
+
+    if (!atfork)
+    {
+        pthread_atfork(NULL, NULL, writer_atfork_child);
+        atfork = true;
+    }
+
+    async = true;
+
+    return true;
+}
+
+/**
+ * @brief Let the writer reopen the log file (e.g. on SIGHUP after the
+ *        log file was rotated)
+ */
+void
+log_reopen(void)
+{
+    if (!async)
+        return;
+
+    pthread_mutex_lock(&writer.lock);
+    writer.reopen = true;
+    pthread_cond_signal(&writer.wakeup);
+    pthread_mutex_unlock(&writer.lock);
+}
+
+/* write all pending lines and stop the writer thread */
+static void
+log_writer_stop(void)
+{
+    if (!async)
+        return;
+
+    pthread_mutex_lock(&writer.lock);
+    writer.stop = true;
+    pthread_cond_signal(&writer.wakeup);
+    pthread_mutex_unlock(&writer.lock);
+
+    pthread_join(writer.thread, NULL);
+
+    async = false;
+
+    /* lines that were queued while stopping */
+    writer_drain();
+
+    pthread_cond_destroy(&writer.wakeup);
+    pthread_mutex_destroy(&writer.lock);
+
+    xfree(writer.path);
+    free(writer.slots);
+
+    writer.path = NULL;
+    writer.slots = NULL;
+}
+
+static void
+log_write(log_level_e level, const char *format, va_list values)
+{
+    /* safe errno */
+    int32_t error = errno;
+
+    if (use_syslog)
+        vsyslog(get_syslog_level(level), format, values);
+    /* critical lines are written right away as nyx aborts */
+    else if (async && !(level & NYX_LOG_CRITICAL))
+        writer_queue(level, error, format, values);
+    else
+    {
+        char line[NYX_LOG_LINE_LEN];
+        size_t length = format_line(line, level, error, format, values);
+
+        if (async)
+            write_all(line, length);
+        else
+            fwrite(line, length, 1, stdout);
+    }
+
+    errno = error;
+}
+
+void
+log_message(UNUSED nyx_t *nyx, log_level_e level, const char *format, ...)
+{
+    if (log_levels & level)
+    {
+        va_list vas;
+        va_start(vas, format);
+
+        log_write(level, format, vas);
+
         va_end(vas);
     }
 
@@ -232,24 +907,20 @@ log_message(nyx_t *nyx, log_level_e level, const char *format, ...)
 
 #define DECLARE_LOG_FUNC(fn_, level_) \
     void \
-    log_##fn_(const char *format, ...) \
+    (log_##fn_)(const char *format, ...) \
     { \
-        if (!quiet) \
+        if ((level_) == NYX_LOG_DEBUG || (log_levels & (level_))) \
         { \
             va_list vas; \
             va_start(vas, format); \
-            if (use_syslog) \
-                vsyslog(get_syslog_level(level_), format, vas); \
-            else \
-                log_format_msg(stdout, level_, format, vas); \
+            log_write(level_, format, vas); \
             va_end(vas); \
         } \
         if ((level_) & NYX_LOG_CRITICAL) abort(); \
     }
 
-#ifndef NDEBUG
+/* the debug messages are checked by the callers along with their category */
 DECLARE_LOG_FUNC (debug,           NYX_LOG_DEBUG)
-#endif
 
 DECLARE_LOG_FUNC (info,            NYX_LOG_INFO)
 DECLARE_LOG_FUNC (warn,            NYX_LOG_WARN)
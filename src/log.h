@@ -31,12 +31,61 @@ typedef enum
     NYX_LOG_CRITICAL = 1 << 5
 } log_level_e;
 
+/** subsystems whose debug messages can be enabled separately */
+typedef enum
+{
+    NYX_LOG_PROC      = 1 << 0,
+    NYX_LOG_EVENT     = 1 << 1,
+    NYX_LOG_STATE     = 1 << 2,
+    NYX_LOG_FORKER    = 1 << 3,
+    NYX_LOG_CONNECTOR = 1 << 4
+} log_category_e;
+
+/*
+ * The debug messages of a source file belong to the category it defines
+ * before its includes, e.g.:
+ *
+ *   #define NYX_LOG_CATEGORY NYX_LOG_STATE
+ */
+#ifndef NYX_LOG_CATEGORY
+#define NYX_LOG_CATEGORY 0
+#endif
+
+/* bitmasks of the enabled levels and debug categories - these are
+ * checked before the arguments of a message are even evaluated */
+extern volatile uint32_t log_levels;
+extern volatile uint32_t log_categories;
+
+#define log_enabled(level_) \
+    ((log_levels & (level_)) != 0)
+
+#define log_debug_enabled() \
+    ((log_levels & NYX_LOG_DEBUG) || (log_categories & (NYX_LOG_CATEGORY)))
+
 void
 log_init(nyx_t *nyx);
 
 void
 log_shutdown(void);
 
+void
+log_configure(nyx_t *nyx);
+
+bool
+log_writer_start(nyx_t *nyx);
+
+void
+log_reopen(void);
+
+bool
+log_parse_level(const char *spec, uint32_t *levels, uint32_t *categories);
+
+bool
+log_set_level(const char *spec);
+
+size_t
+log_level_string(char *buffer, size_t size);
+
 void
 log_message(nyx_t *nyx, log_level_e level, const char *format, ...)
     __attribute__((format(printf, 3, 4)));
@@ -46,12 +95,7 @@ log_message(nyx_t *nyx, log_level_e level, const char *format, ...)
         __attribute__((format(printf, 1, 2))) \
         __VA_ARGS__;
 
-#ifndef NDEBUG
 DECLARE_LOG_PROTO (debug, __attribute__(()))
-#else
-#define log_debug(...)
-#endif
-
 DECLARE_LOG_PROTO (info, __attribute__(()))
 DECLARE_LOG_PROTO (warn, __attribute__(()))
 DECLARE_LOG_PROTO (error, __attribute__(()))
@@ -61,4 +105,16 @@ DECLARE_LOG_PROTO (critical_perror, __attribute__((noreturn)))
 
 #undef DECLARE_LOG_PROTO
 
+/* disabled messages cost a single load and branch */
+#define log_debug(...) \
+    (log_debug_enabled() ? (log_debug)(__VA_ARGS__) : (void)0)
+#define log_info(...) \
+    (log_enabled(NYX_LOG_INFO) ? (log_info)(__VA_ARGS__) : (void)0)
+#define log_warn(...) \
+    (log_enabled(NYX_LOG_WARN) ? (log_warn)(__VA_ARGS__) : (void)0)
+#define log_error(...) \
+    (log_enabled(NYX_LOG_ERROR) ? (log_error)(__VA_ARGS__) : (void)0)
+#define log_perror(...) \
+    (log_enabled(NYX_LOG_PERROR) ? (log_perror)(__VA_ARGS__) : (void)0)
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -13,21 +13,35 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+
 #include "connector.h"
 #include "command.h"
 #include "event.h"
 #include "fs.h"
+#include "journal.h"
+#include "json.h"
 #include "log.h"
 #include "nyx.h"
 #include "poll.h"
 #include "state.h"
+#include "stats.h"
+#include "status.h"
 #include "utils.h"
 
+#include <ctype.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
 
 static nyx_error_e
 daemon_mode(nyx_t *nyx)
 {
+    /* the statistics cover the whole lifetime of the daemon */
+    stats_reset();
+
     if (!nyx_watches_init(nyx))
     {
         log_error("No valid watched configured - terminating now");
@@ -35,47 +49,523 @@ daemon_mode(nyx_t *nyx)
         return NYX_NO_VALID_WATCH;
     }
 
-    /* start the event handler loop (not supported on OSX)*/
-#ifndef OSX
-    if (!event_loop(nyx, dispatch_event))
+    setup_signals(nyx);
+
+    /* start the event manager (netlink process connector on linux,
+     * kqueue on OSX) */
+    if (nyx->options.poll_mode)
+        log_info("Using the polling mechanism as requested");
+
+    if (nyx->options.poll_mode || !event_init(nyx, dispatch_event))
     {
-        log_warn("Failed to initialize event manager "
-                  "- trying polling mechanism next");
+        if (!nyx->options.poll_mode)
+        {
+            log_warn("Failed to initialize event manager "
+                      "- trying polling mechanism next");
 
-        log_warn("Try enabling CONFIG_CONNECTOR in your kernel config "
-                 "and run nyx with root privileges");
+#ifndef OSX
+            log_warn("Try enabling CONFIG_CONNECTOR in your kernel config "
+                     "and run nyx with root privileges");
 #endif
+        }
 
-        if (!poll_loop(nyx, dispatch_poll_result))
+        if (!poll_init(nyx, dispatch_poll_result))
         {
             log_error("Failed to start loop manager as well - terminating");
             return NYX_FAILURE;
         }
-#ifndef OSX
     }
-#endif
+
+    /* run the main loop until termination */
+    bool success = reactor_run(nyx->reactor);
+
+    event_shutdown(nyx);
+    poll_shutdown(nyx);
+
+    if (!success)
+        return NYX_FAILURE;
 
     return NYX_SUCCESS;
 }
 
+/**
+ * Read the commands of a batch (one per line) from the given file
+ * (or STDIN). Empty lines and comments (starting with '#') are skipped.
+ */
+static bool
+read_batch(const char *path, const char ***batch)
+{
+    bool from_stdin = path == NULL || !strcmp(path, "-");
+    FILE *input = from_stdin ? stdin : fopen(path, "r");
+    list_t *commands = NULL;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t length = 0;
+
+    if (input == NULL)
+    {
+        log_perror("nyx: fopen");
+        return false;
+    }
+
+    commands = list_new(NULL);
+
+    while ((length = getline(&line, &size, input)) != -1)
+    {
+        char *start = line;
+
+        while (length > 0 && isspace(line[length-1]))
+            line[--length] = '\0';
+
+        while (isspace(*start))
+            start++;
+
+        if (*start == '\0' || *start == '#')
+            continue;
+
+        list_add(commands, xstrdup(start));
+    }
+
+    free(line);
+
+    if (!from_stdin)
+        fclose(input);
+
+    *batch = strings_to_null_terminated(commands);
+
+    return true;
+}
+
+static nyx_error_e
+batch_mode(nyx_t *nyx, const char *socket_path)
+{
+    nyx_error_e retcode = NYX_SUCCESS;
+    const char **commands = nyx->options.commands;
+
+    if (nyx->options.execute)
+    {
+        if (commands)
+        {
+            log_error("Commands must not be given both via '-e' and as arguments");
+            return NYX_INVALID_USAGE;
+        }
+
+        return connector_batch(socket_path, nyx->options.execute,
+                nyx->options.quiet, nyx->options.json);
+    }
+
+    if (count_args(commands) > 2)
+    {
+        log_error("Usage: nyx batch [<file>]");
+        return NYX_INVALID_USAGE;
+    }
+
+    const char **batch = NULL;
+
+    if (!read_batch(commands[1], &batch))
+        return NYX_FAILURE;
+
+    retcode = connector_batch(socket_path, batch, nyx->options.quiet, nyx->options.json);
+
+    if (batch)
+        strings_free((char **)batch);
+
+    return retcode;
+}
+
+typedef struct
+{
+    bool json;
+} journal_output_t;
+
+static const char *
+journal_state_name(int32_t state)
+{
+    return state >= 0 && state < STATE_SIZE
+        ? state_to_human_string(state)
+        : "unknown";
+}
+
+static const char *
+journal_check_name(int32_t check)
+{
+    switch (check)
+    {
+        case CHECK_HTTP:
+            return "HTTP";
+        case CHECK_PLUGIN:
+            return "plugin";
+        case CHECK_EXEC:
+            return "exec";
+        default:
+            return "port";
+    }
+}
+
+static void
+print_record_json(const journal_record_t *record, const char *name)
+{
+    json_t json;
+    strbuf_t *buffer = strbuf_new();
+
+    json_init(&json, buffer);
+    json_object_start(&json);
+
+    json_key(&json, "time");
+    json_double(&json, record->time / 1e6);
+    json_key(&json, "watch");
+    json_string(&json, name);
+
+    switch (record->type)
+    {
+        case JOURNAL_STATE:
+            json_key(&json, "event");
+            json_string(&json, "state");
+            json_key(&json, "from");
+            json_string(&json, journal_state_name(record->data.state.from));
+            json_key(&json, "to");
+            json_string(&json, journal_state_name(record->data.state.to));
+            json_key(&json, "pid");
+            json_int(&json, record->data.state.pid);
+            break;
+        case JOURNAL_EXIT:
+            json_key(&json, "event");
+            json_string(&json, "exit");
+            json_key(&json, "pid");
+            json_int(&json, record->data.exit.pid);
+            json_key(&json, "exit_code");
+            if (WIFEXITED(record->data.exit.status))
+                json_int(&json, WEXITSTATUS(record->data.exit.status));
+            else
+                json_null(&json);
+            json_key(&json, "signal");
+            if (WIFSIGNALED(record->data.exit.status))
+                json_int(&json, WTERMSIG(record->data.exit.status));
+            else
+                json_null(&json);
+            break;
+        case JOURNAL_CHECK:
+            json_key(&json, "event");
+            json_string(&json, "check");
+            json_key(&json, "check");
+            json_string(&json, journal_check_name(record->data.check.check));
+            json_key(&json, "success");
+            json_bool(&json, record->data.check.success);
+            json_key(&json, "latency_us");
+            json_uint(&json, record->data.check.latency);
+            json_key(&json, "pid");
+            json_int(&json, record->data.check.pid);
+            break;
+    }
+
+    json_object_end(&json);
+
+    printf("%s\n", buffer->buf);
+
+    strbuf_free(buffer);
+}
+
+static void
+print_record(const journal_record_t *record, const char *name, void *data)
+{
+    journal_output_t *output = data;
+    time_t seconds = record->time / 1000000;
+    struct tm ltime;
+    char timestamp[32];
+
+    if (output->json)
+    {
+        print_record_json(record, name);
+        return;
+    }
+
+    localtime_r(&seconds, &ltime);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &ltime);
+
+    printf("%s.%03d %s: ", timestamp, (int32_t)(record->time % 1000000 / 1000), name);
+
+    switch (record->type)
+    {
+        case JOURNAL_STATE:
+            printf("%s -> %s", journal_state_name(record->data.state.from),
+                    journal_state_name(record->data.state.to));
+
+            if (record->data.state.pid > 0)
+                printf(" (PID %d)", record->data.state.pid);
+            break;
+        case JOURNAL_EXIT:
+            if (WIFSIGNALED(record->data.exit.status))
+                printf("terminated by signal %d", WTERMSIG(record->data.exit.status));
+            else
+                printf("exited with code %d", WEXITSTATUS(record->data.exit.status));
+
+            printf(" (PID %d)", record->data.exit.pid);
+            break;
+        case JOURNAL_CHECK:
+            printf("%s check %s after %.1f ms",
+                    journal_check_name(record->data.check.check),
+                    record->data.check.success ? "succeeded" : "failed",
+                    record->data.check.latency / 1000.0);
+            break;
+    }
+
+    putchar('\n');
+}
+
+/**
+ * Print the events of the journal in the pid directory:
+ * journal [<watch>|all] [<from>] [<to>]
+ */
+static nyx_error_e
+journal_mode(nyx_t *nyx)
+{
+    /* the watches are selected via '--match' (which follows the
+     * command) or the first argument */
+    uint32_t times = nyx->options.match ? 0 : 1;
+    const char **args = nyx->options.commands + (nyx->options.match ? 3 : 1);
+    uint32_t count = count_args(args);
+    struct timespec now;
+    int64_t from = 0, to = INT64_MAX;
+    journal_output_t output = { .json = nyx->options.json };
+    matcher_t matcher;
+
+    if (count > times + 2)
+    {
+        log_error("Usage: nyx journal [<watch>|all] [<from>] [<to>]");
+        return NYX_INVALID_USAGE;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t usecs = now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+
+    if ((count > times && !journal_parse_time(args[times], usecs, &from)) ||
+            (count > times + 1 && !journal_parse_time(args[times + 1], usecs, &to)))
+    {
+        log_error("Invalid time - expected 'now', '<n>[s|m|h]' (ago), seconds since "
+                  "the epoch or 'YYYY-MM-DD[THH:MM:SS]'");
+        return NYX_INVALID_USAGE;
+    }
+
+    const char *pattern = nyx->options.match ? nyx->options.match
+        : count > 0 ? args[0] : "all";
+
+    if (!matcher_init(&matcher, pattern, nyx->options.match != NULL))
+        return NYX_INVALID_USAGE;
+
+    const char *pid_dir = nyx->options.local_mode
+        ? determine_local_pid_dir(nyx->nyx_dir)
+        : determine_pid_dir();
+
+    bool found = pid_dir &&
+        journal_query(pid_dir, &matcher, from, to, print_record, &output);
+
+    if (!found)
+        log_error("No journal found in '%s'", pid_dir ? pid_dir : "");
+
+    matcher_free(&matcher);
+    free((void *)pid_dir);
+
+    return found ? NYX_SUCCESS : NYX_FAILURE;
+}
+
+typedef struct
+{
+    json_t *json;
+} status_output_t;
+
+static void
+print_status_json(json_t *json, const nyx_status_record_t *record)
+{
+    json_object_start(json);
+
+    json_key(json, "name");
+    json_string(json, record->name);
+    json_key(json, "state");
+    json_string(json, journal_state_name(record->state));
+    json_key(json, "pid");
+
+    if (record->pid > 0)
+        json_int(json, record->pid);
+    else
+        json_null(json);
+
+    json_key(json, "restarts");
+    json_uint(json, record->restarts);
+    json_key(json, "failures");
+    json_uint(json, record->failures);
+    json_key(json, "changed");
+    json_int(json, record->changed);
+
+    if (record->sampled)
+    {
+        json_key(json, "cpu");
+        json_double(json, record->cpu);
+        json_key(json, "rss_kb");
+        json_uint(json, record->rss);
+        json_key(json, "sampled");
+        json_int(json, record->sampled);
+    }
+
+    if (record->check != NYX_STATUS_CHECK_NONE)
+    {
+        json_key(json, "check");
+        json_string(json, journal_check_name(record->check_type));
+        json_key(json, "check_passed");
+        json_bool(json, record->check == NYX_STATUS_CHECK_PASSED);
+        json_key(json, "checked");
+        json_int(json, record->checked);
+    }
+
+    json_object_end(json);
+}
+
+static void
+print_status(const nyx_status_record_t *record, void *data)
+{
+    status_output_t *output = data;
+
+    if (output->json)
+    {
+        print_status_json(output->json, record);
+        return;
+    }
+
+    printf("%s: %s", record->name, journal_state_name(record->state));
+
+    if (record->state == STATE_RUNNING && record->pid > 0)
+        printf(" (PID %d)", record->pid);
+
+    if (record->sampled)
+    {
+        uint64_t rss = 0;
+        char unit = get_size_unit(record->rss, &rss);
+
+        printf(" CPU %.1f%% MEM %" PRIu64 "%c", record->cpu, rss, unit);
+    }
+
+    if (record->check != NYX_STATUS_CHECK_NONE)
+    {
+        printf(" %s check %s", journal_check_name(record->check_type),
+                record->check == NYX_STATUS_CHECK_PASSED ? "passed" : "failed");
+    }
+
+    if (record->restarts)
+        printf(" restarts %u", record->restarts);
+
+    if (record->failures)
+        printf(" failures %u", record->failures);
+
+    putchar('\n');
+}
+
+/**
+ * Print the status of the watches from the status table in the pid
+ * directory (without connecting to the daemon):
+ * status --shm [<watch>|all]
+ */
+static nyx_error_e
+status_mode(nyx_t *nyx)
+{
+    const char **args = nyx->options.commands + (nyx->options.match ? 3 : 1);
+    uint32_t count = count_args(args);
+    status_output_t output = { .json = NULL };
+    strbuf_t *buffer = NULL;
+    json_t json;
+    matcher_t matcher;
+
+    if (count > (nyx->options.match ? 0 : 1))
+    {
+        log_error("Usage: nyx status --shm [<watch>|all]");
+        return NYX_INVALID_USAGE;
+    }
+
+    const char *pattern = nyx->options.match ? nyx->options.match
+        : count > 0 ? args[0] : "all";
+
+    if (!matcher_init(&matcher, pattern, nyx->options.match != NULL))
+        return NYX_INVALID_USAGE;
+
+    if (nyx->options.json)
+    {
+        buffer = strbuf_new();
+        json_init(&json, buffer);
+        json_array_start(&json);
+        output.json = &json;
+    }
+
+    const char *pid_dir = nyx->options.local_mode
+        ? determine_local_pid_dir(nyx->nyx_dir)
+        : determine_pid_dir();
+
+    bool found = pid_dir && status_query(pid_dir, &matcher, print_status, &output);
+
+    if (!found)
+        log_error("No status table found in '%s'", pid_dir ? pid_dir : "");
+    else if (buffer)
+    {
+        json_array_end(&json);
+        printf("%s\n", buffer->buf);
+    }
+
+    strbuf_free(buffer);
+    matcher_free(&matcher);
+    free((void *)pid_dir);
+
+    return found ? NYX_SUCCESS : NYX_FAILURE;
+}
+
+static bool
+is_status_shm(nyx_t *nyx)
+{
+    return nyx->options.shm && nyx->options.commands &&
+        !strcmp(nyx->options.commands[0], "status");
+}
+
+static bool
+is_journal(nyx_t *nyx)
+{
+    return nyx->options.commands && !strcmp(nyx->options.commands[0], "journal");
+}
+
+static bool
+is_batch(nyx_t *nyx)
+{
+    return nyx->options.execute ||
+        (nyx->options.commands && !strcmp(nyx->options.commands[0], "batch"));
+}
+
 static nyx_error_e
 command_mode(nyx_t *nyx)
 {
     nyx_error_e retcode = NYX_FAILURE;
 
-    if (!nyx->options.commands)
+    if (!nyx->options.commands && !nyx->options.execute)
     {
         log_error("no command specified at all");
         return NYX_NO_COMMAND;
     }
 
-    if (parse_command(nyx->options.commands) != NULL)
+    if (is_journal(nyx))
+        return journal_mode(nyx);
+
+    if (is_status_shm(nyx))
+        return status_mode(nyx);
+
+    if (nyx->options.shm)
+    {
+        log_error("'--shm' is supported by the 'status' command only");
+        return NYX_INVALID_USAGE;
+    }
+
+    if (is_batch(nyx) || parse_command(nyx->options.commands) != NULL)
     {
         bool local_only = nyx->options.local_mode;
         const char *socket_path = determine_socket_path(nyx->nyx_dir, local_only);
 
-        retcode = connector_call(socket_path, nyx->options.commands,
-                nyx->options.quiet);
+        retcode = is_batch(nyx)
+            ? batch_mode(nyx, socket_path)
+            : connector_call(socket_path, nyx->options.commands,
+                    nyx->options.quiet, nyx->options.json);
 
         if (retcode == NYX_NO_DAEMON_FOUND && local_only)
         {
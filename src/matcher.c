@@ -0,0 +1,102 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "log.h"
+#include "matcher.h"
+#include "watch.h"
+
+#include <fnmatch.h>
+#include <string.h>
+
+/**
+ * @brief Compile the given watch selection
+ * @param matcher matcher to initialize
+ * @param pattern name, glob pattern or 'all' (or a regular expression)
+ * @param regex   whether the pattern is an extended regular expression
+ * @return true on success, false if the regular expression is invalid
+ */
+bool
+matcher_init(matcher_t *matcher, const char *pattern, bool regex)
+{
+    matcher->pattern = pattern;
+
+    if (regex)
+    {
+        int32_t error = regcomp(&matcher->regex, pattern, REG_EXTENDED | REG_NOSUB);
+
+        if (error)
+        {
+            char message[128];
+
+            regerror(error, &matcher->regex, message, sizeof(message));
+            log_warn("Invalid regular expression '%s': %s", pattern, message);
+
+            return false;
+        }
+
+        matcher->type = MATCH_REGEX;
+    }
+    else if (is_all(pattern))
+        matcher->type = MATCH_ALL;
+    else if (strpbrk(pattern, "*?["))
+        matcher->type = MATCH_GLOB;
+    else
+        matcher->type = MATCH_NAME;
+
+    return true;
+}
+
+/**
+ * @brief Determine whether the matcher may select multiple watches
+ * @param matcher matcher instance
+ * @return true for 'all', globs and regular expressions
+ */
+bool
+matcher_is_bulk(matcher_t *matcher)
+{
+    return matcher->type != MATCH_NAME;
+}
+
+/**
+ * @brief Check whether the given watch name is selected
+ * @param matcher matcher instance
+ * @param name    name of a watch (or one of its instances)
+ * @return true if the name matches
+ */
+bool
+matcher_match(matcher_t *matcher, const char *name)
+{
+    switch (matcher->type)
+    {
+        case MATCH_ALL:
+            return true;
+        case MATCH_GLOB:
+            return fnmatch(matcher->pattern, name, 0) == 0;
+        case MATCH_REGEX:
+            return regexec(&matcher->regex, name, 0, NULL, 0) == 0;
+        case MATCH_NAME:
+        default:
+            return strcmp(matcher->pattern, name) == 0;
+    }
+}
+
+void
+matcher_free(matcher_t *matcher)
+{
+    if (matcher->type == MATCH_REGEX)
+        regfree(&matcher->regex);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,49 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <regex.h>
+#include <stdbool.h>
+
+typedef enum
+{
+    MATCH_ALL,
+    MATCH_NAME,
+    MATCH_GLOB,
+    MATCH_REGEX
+} matcher_type_e;
+
+/** precompiled selection of watches by name, glob or regular expression */
+typedef struct
+{
+    matcher_type_e type;
+    const char *pattern;
+    regex_t regex;
+} matcher_t;
+
+bool
+matcher_init(matcher_t *matcher, const char *pattern, bool regex);
+
+bool
+matcher_is_bulk(matcher_t *matcher);
+
+bool
+matcher_match(matcher_t *matcher, const char *name);
+
+void
+matcher_free(matcher_t *matcher);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,464 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define NYX_MEM_TAG MEM_METRICS
+
+#include "def.h"
+#include "metrics.h"
+
+#include <math.h>
+#include <string.h>
+
+/* maximum number of bits a single (non-first) sample is encoded in:
+ * 4 + 32 bits timestamp and 2 + 5 + 6 + 64 bits value */
+#define METRICS_MAX_SAMPLE_BITS 113
+
+/* the leading zeros of a value are encoded in 5 bits */
+#define METRICS_MAX_LEADING 31
+
+/* no XOR window was established in the block yet */
+#define METRICS_NO_WINDOW 0xff
+
+static const int64_t metrics_periods[METRICS_RESOLUTIONS] = { 0, 60, 3600 };
+
+static void
+series_init(metrics_series_t *series, uint32_t size)
+{
+    series->size = MAX(size, 1);
+    series->blocks = xcalloc(series->size, sizeof(metrics_block_t));
+}
+
+/**
+ * @brief Create a new metrics store
+ * @param budget memory (in bytes) the encoded samples may use - half of
+ *               it is used for every sample, a quarter each for the
+ *               minute and hour rollups
+ * @return new metrics instance
+ */
+metrics_t *
+metrics_new(uint64_t budget)
+{
+    metrics_t *metrics = xcalloc1(sizeof(metrics_t));
+    uint64_t blocks = budget / sizeof(metrics_block_t) / METRICS_SIZE;
+
+    for (uint32_t type = 0; type < METRICS_SIZE; type++)
+    {
+        series_init(&metrics->series[type][METRICS_RAW], blocks / 2);
+        series_init(&metrics->series[type][METRICS_MINUTE], blocks / 4);
+        series_init(&metrics->series[type][METRICS_HOUR], blocks / 4);
+    }
+
+    return metrics;
+}
+
+static void
+write_bits(metrics_block_t *block, uint64_t value, uint32_t bits)
+{
+    while (bits-- > 0)
+    {
+        if ((value >> bits) & 1)
+            block->data[block->bits / 8] |= 0x80 >> (block->bits % 8);
+
+        block->bits++;
+    }
+}
+
+static uint64_t
+read_bits(metrics_iter_t *iter, uint32_t bits)
+{
+    uint64_t value = 0;
+
+    while (bits-- > 0)
+    {
+        uint8_t bit = (iter->block->data[iter->pos / 8] >> (7 - iter->pos % 8)) & 1;
+
+        value = (value << 1) | bit;
+        iter->pos++;
+    }
+
+    return value;
+}
+
+static uint64_t
+double_bits(double value)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(uint64_t));
+
+    return bits;
+}
+
+static double
+bits_double(uint64_t bits)
+{
+    double value;
+
+    memcpy(&value, &bits, sizeof(double));
+
+    return value;
+}
+
+static uint8_t
+leading_zeros(uint64_t value)
+{
+    uint8_t count = 0;
+
+    while (count < 64 && !(value & (1ULL << (63 - count))))
+        count++;
+
+    return count;
+}
+
+static uint8_t
+trailing_zeros(uint64_t value)
+{
+    uint8_t count = 0;
+
+    while (count < 64 && !(value & (1ULL << count)))
+        count++;
+
+    return count;
+}
+
+/* delta-of-deltas of regular intervals are encoded in a single bit */
+static void
+encode_time(metrics_block_t *block, int64_t time)
+{
+    int64_t delta = time - block->time;
+    int64_t dod = delta - block->delta;
+
+    if (dod == 0)
+        write_bits(block, 0, 1);
+    else if (dod >= -63 && dod <= 64)
+    {
+        write_bits(block, 0x2, 2);
+        write_bits(block, dod + 63, 7);
+    }
+    else if (dod >= -255 && dod <= 256)
+    {
+        write_bits(block, 0x6, 3);
+        write_bits(block, dod + 255, 9);
+    }
+    else if (dod >= -2047 && dod <= 2048)
+    {
+        write_bits(block, 0xe, 4);
+        write_bits(block, dod + 2047, 12);
+    }
+    else
+    {
+        write_bits(block, 0xf, 4);
+        write_bits(block, (uint32_t)(int32_t)dod, 32);
+    }
+
+    block->time = time;
+    block->delta = delta;
+}
+
+/* unchanged values are encoded in a single bit, all others by the
+ * meaningful bits of the XOR with their predecessor */
+static void
+encode_value(metrics_block_t *block, uint64_t value)
+{
+    uint64_t xor = value ^ block->value;
+
+    block->value = value;
+
+    if (xor == 0)
+    {
+        write_bits(block, 0, 1);
+        return;
+    }
+
+    uint8_t leading = MIN(leading_zeros(xor), METRICS_MAX_LEADING);
+    uint8_t trailing = trailing_zeros(xor);
+
+    write_bits(block, 1, 1);
+
+    /* the meaningful bits fit into the previous window */
+    if (block->leading != METRICS_NO_WINDOW &&
+            leading >= block->leading && trailing >= block->trailing)
+    {
+        write_bits(block, 0, 1);
+        write_bits(block, xor >> block->trailing, 64 - block->leading - block->trailing);
+        return;
+    }
+
+    uint8_t meaningful = 64 - leading - trailing;
+
+    write_bits(block, 1, 1);
+    write_bits(block, leading, 5);
+    /* a length of 64 is stored as 0 */
+    write_bits(block, meaningful & 0x3f, 6);
+    write_bits(block, xor >> trailing, meaningful);
+
+    block->leading = leading;
+    block->trailing = trailing;
+}
+
+static void
+series_append(metrics_series_t *series, int64_t time, double value)
+{
+    metrics_block_t *block = &series->blocks[series->head];
+    uint64_t bits = double_bits(value);
+
+    /* start a new block (dropping the oldest one if necessary) */
+    if (series->count == 0 ||
+            block->bits + METRICS_MAX_SAMPLE_BITS > METRICS_BLOCK_SIZE * 8)
+    {
+        if (series->count > 0)
+            series->head = (series->head + 1) % series->size;
+
+        series->count = MIN(series->count + 1, series->size);
+
+        block = &series->blocks[series->head];
+        memset(block, 0, sizeof(metrics_block_t));
+
+        write_bits(block, (uint32_t)time, 32);
+        write_bits(block, bits, 64);
+
+        block->time = time;
+        block->value = bits;
+        block->leading = METRICS_NO_WINDOW;
+        block->count = 1;
+        return;
+    }
+
+    encode_time(block, time);
+    encode_value(block, bits);
+
+    block->count++;
+}
+
+/* aggregate the value into the average of its interval - finished
+ * minutes are rolled up into their hour as well */
+static void
+aggregate(metrics_t *metrics, metrics_type_e type, metrics_resolution_e resolution,
+        int64_t time, double value)
+{
+    metrics_rollup_t *rollup = &metrics->rollups[type][resolution];
+    int64_t period = metrics_periods[resolution];
+    int64_t bucket = time / period;
+
+    if (rollup->count && rollup->bucket != bucket)
+    {
+        int64_t start = rollup->bucket * period;
+        double average = rollup->sum / rollup->count;
+
+        series_append(&metrics->series[type][resolution], start, average);
+
+        if (resolution + 1 < METRICS_RESOLUTIONS)
+            aggregate(metrics, type, resolution + 1, start, average);
+
+        rollup->sum = 0;
+        rollup->count = 0;
+    }
+
+    rollup->bucket = bucket;
+    rollup->sum += value;
+    rollup->count++;
+}
+
+/**
+ * @brief Add a sample of the CPU and memory usage
+ * @param metrics metrics instance
+ * @param time    time of the sample
+ * @param cpu     CPU usage (in percent)
+ * @param memory  memory usage (in kB)
+ */
+void
+metrics_add(metrics_t *metrics, time_t time, double cpu, double memory)
+{
+    /* a precision of 0.1% is sufficient and keeps the XORs short */
+    double values[METRICS_SIZE] = { round(cpu * 10) / 10, memory };
+
+    for (uint32_t type = 0; type < METRICS_SIZE; type++)
+    {
+        series_append(&metrics->series[type][METRICS_RAW], time, values[type]);
+        aggregate(metrics, type, METRICS_MINUTE, time, values[type]);
+    }
+}
+
+/**
+ * @brief Determine the memory used by the metrics instance
+ * @param metrics metrics instance
+ * @return size in bytes
+ */
+size_t
+metrics_size(metrics_t *metrics)
+{
+    size_t size = sizeof(metrics_t);
+
+    for (uint32_t type = 0; type < METRICS_SIZE; type++)
+    {
+        for (uint32_t res = 0; res < METRICS_RESOLUTIONS; res++)
+            size += metrics->series[type][res].size * sizeof(metrics_block_t);
+    }
+
+    return size;
+}
+
+/**
+ * @brief Start iterating the samples of a series (oldest first)
+ * @param iter       iterator to initialize
+ * @param metrics    metrics instance
+ * @param type       metric to iterate
+ * @param resolution resolution to iterate
+ */
+void
+metrics_iter_start(metrics_iter_t *iter, metrics_t *metrics,
+        metrics_type_e type, metrics_resolution_e resolution)
+{
+    memset(iter, 0, sizeof(metrics_iter_t));
+
+    iter->series = &metrics->series[type][resolution];
+    iter->blocks = iter->series->count;
+}
+
+static int64_t
+decode_time(metrics_iter_t *iter)
+{
+    int64_t dod = 0;
+
+    if (read_bits(iter, 1) == 0)
+        dod = 0;
+    else if (read_bits(iter, 1) == 0)
+        dod = (int64_t)read_bits(iter, 7) - 63;
+    else if (read_bits(iter, 1) == 0)
+        dod = (int64_t)read_bits(iter, 9) - 255;
+    else if (read_bits(iter, 1) == 0)
+        dod = (int64_t)read_bits(iter, 12) - 2047;
+    else
+        dod = (int32_t)(uint32_t)read_bits(iter, 32);
+
+    iter->delta += dod;
+    iter->time += iter->delta;
+
+    return iter->time;
+}
+
+static uint64_t
+decode_value(metrics_iter_t *iter)
+{
+    if (read_bits(iter, 1) == 0)
+        return iter->value;
+
+    if (read_bits(iter, 1) == 1)
+    {
+        iter->leading = read_bits(iter, 5);
+
+        uint8_t meaningful = read_bits(iter, 6);
+
+        if (meaningful == 0)
+            meaningful = 64;
+
+        iter->trailing = 64 - iter->leading - meaningful;
+    }
+
+    uint8_t meaningful = 64 - iter->leading - iter->trailing;
+    uint64_t xor = read_bits(iter, meaningful) << iter->trailing;
+
+    iter->value ^= xor;
+
+    return iter->value;
+}
+
+/**
+ * @brief Read the next sample of the iterated series
+ * @param iter  iterator
+ * @param time  time of the sample
+ * @param value value of the sample
+ * @return true if a sample was read, false if the series is exhausted
+ */
+bool
+metrics_iter_next(metrics_iter_t *iter, time_t *time, double *value)
+{
+    const metrics_series_t *series = iter->series;
+
+    while (iter->block == NULL || iter->read >= iter->block->count)
+    {
+        if (iter->blocks == 0)
+            return false;
+
+        /* the oldest block follows the newest one in the ring */
+        uint32_t idx = (series->head + series->size - iter->blocks + 1) % series->size;
+
+        iter->block = &series->blocks[idx];
+        iter->blocks--;
+        iter->pos = 0;
+        iter->read = 0;
+    }
+
+    if (iter->read == 0)
+    {
+        iter->time = read_bits(iter, 32);
+        iter->value = read_bits(iter, 64);
+        iter->delta = 0;
+        iter->leading = 0;
+        iter->trailing = 0;
+    }
+    else
+    {
+        decode_time(iter);
+        decode_value(iter);
+    }
+
+    iter->read++;
+
+    *time = iter->time;
+    *value = bits_double(iter->value);
+
+    return true;
+}
+
+/**
+ * @brief Parse the name of a resolution ('raw', 'minute' or 'hour')
+ * @param name       name to parse
+ * @param resolution parsed resolution
+ * @return true on success, false otherwise
+ */
+bool
+metrics_resolution_parse(const char *name, metrics_resolution_e *resolution)
+{
+    static const char *names[METRICS_RESOLUTIONS] = { "raw", "minute", "hour" };
+
+    for (uint32_t res = 0; res < METRICS_RESOLUTIONS; res++)
+    {
+        if (strcmp(name, names[res]) == 0)
+        {
+            *resolution = res;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+metrics_destroy(metrics_t *metrics)
+{
+    if (metrics == NULL)
+        return;
+
+    for (uint32_t type = 0; type < METRICS_SIZE; type++)
+    {
+        for (uint32_t res = 0; res < METRICS_RESOLUTIONS; res++)
+            xfree(metrics->series[type][res].blocks);
+    }
+
+    xfree(metrics);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,126 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* size of the encoded data of a single block (in bytes) */
+#define METRICS_BLOCK_SIZE 256
+
+typedef enum
+{
+    METRICS_CPU,
+    METRICS_MEMORY,
+    METRICS_SIZE
+} metrics_type_e;
+
+typedef enum
+{
+    METRICS_RAW,
+    METRICS_MINUTE,
+    METRICS_HOUR,
+    METRICS_RESOLUTIONS
+} metrics_resolution_e;
+
+/**
+ * Block of samples encoded Gorilla-style: the timestamps are stored as
+ * delta-of-deltas and the values as XOR of their predecessor - both in
+ * variable length bit sequences.
+ */
+typedef struct
+{
+    uint8_t data[METRICS_BLOCK_SIZE];
+    /** number of bits written */
+    uint32_t bits;
+    uint32_t count;
+    /** encoder state of the last sample */
+    int64_t time;
+    int64_t delta;
+    uint64_t value;
+    uint8_t leading;
+    uint8_t trailing;
+} metrics_block_t;
+
+/** ring of blocks - the oldest block is dropped if the ring is full */
+typedef struct
+{
+    metrics_block_t *blocks;
+    uint32_t size;
+    /** index of the newest block */
+    uint32_t head;
+    uint32_t count;
+} metrics_series_t;
+
+/** samples of the current interval of a rollup */
+typedef struct
+{
+    int64_t bucket;
+    double sum;
+    uint32_t count;
+} metrics_rollup_t;
+
+/**
+ * Time series of the CPU and memory usage of a watch in three
+ * resolutions: every sample, averages per minute and per hour.
+ */
+typedef struct
+{
+    metrics_series_t series[METRICS_SIZE][METRICS_RESOLUTIONS];
+    metrics_rollup_t rollups[METRICS_SIZE][METRICS_RESOLUTIONS];
+} metrics_t;
+
+typedef struct
+{
+    const metrics_series_t *series;
+    /** number of blocks that are still to be read */
+    uint32_t blocks;
+    const metrics_block_t *block;
+    /** read position and decoder state of the current block */
+    uint32_t pos;
+    uint32_t read;
+    int64_t time;
+    int64_t delta;
+    uint64_t value;
+    uint8_t leading;
+    uint8_t trailing;
+} metrics_iter_t;
+
+metrics_t *
+metrics_new(uint64_t budget);
+
+void
+metrics_add(metrics_t *metrics, time_t time, double cpu, double memory);
+
+size_t
+metrics_size(metrics_t *metrics);
+
+void
+metrics_iter_start(metrics_iter_t *iter, metrics_t *metrics,
+        metrics_type_e type, metrics_resolution_e resolution);
+
+bool
+metrics_iter_next(metrics_iter_t *iter, time_t *time, double *value);
+
+bool
+metrics_resolution_parse(const char *name, metrics_resolution_e *resolution);
+
+void
+metrics_destroy(metrics_t *metrics);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -21,9 +21,11 @@
 #include "def.h"
 #include "forker.h"
 #include "fs.h"
+#include "image.h"
 #include "log.h"
 #include "nyx.h"
 #include "process.h"
+#include "reactor.h"
 #include "state.h"
 #include "watch.h"
 #include "utils.h"
@@ -32,6 +34,10 @@
 #include "plugins.h"
 #endif
 
+#ifdef USE_SSL
+#include "ssl.h"
+#endif
+
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
@@ -44,10 +50,6 @@
 #include <time.h>
 #include <unistd.h>
 
-#ifndef OSX
-#include <sys/eventfd.h>
-#endif
-
 /**
  * @brief State destroy callback function
  * @param state state to destroy
@@ -68,6 +70,9 @@ print_usage(FILE *out)
     fputs("Usage: nyx -c <file> [options]\n"
           "       nyx --run <executable>\n"
           "       nyx <command>\n"
+          "       nyx -e <command> [-e <command> ...]\n"
+          "       nyx batch [<file>]\n"
+          "       nyx journal [<watch>|all] [<from>] [<to>]\n"
           "\n"
           "Available commands:\n", out);
 
@@ -88,8 +93,16 @@ print_help(void)
          "       --run <executable> (specify an ad-hoc executable watch)\n"
          "       --local            (run in the current directory)\n"
          "   -p  --passive          (don't automatically start services)\n"
+         "       --poll             (poll the processes instead of using\n"
+         "                           the kernel's process events)\n"
+         "       --compile-config   (compile the config into a binary image)\n"
+         "       --match <regex>    (select the watches of a command by regex)\n"
+         "       --shm              (read the status from the status table\n"
+         "                           instead of asking the daemon)\n"
+         "   -e  --execute <cmd>    (send the command in a batch session)\n"
          "   -s  --syslog           (log into syslog)\n"
          "   -q  --quiet            (output error messages only)\n"
+         "   -j  --json             (output the command results as JSON)\n"
          "   -C  --no-color         (no terminal coloring)\n"
          "   -V  --version          (version information)\n"
          "   -h  --help             (print this help)\n"
@@ -117,9 +130,15 @@ static const struct option long_options[] =
     { .name = "no-color",  .has_arg = 0, .flag = NULL, .val = 'C'},
     { .name = "no-daemon", .has_arg = 0, .flag = NULL, .val = 'D'},
     { .name = "quiet",     .has_arg = 0, .flag = NULL, .val = 'q'},
+    { .name = "json",      .has_arg = 0, .flag = NULL, .val = 'j'},
     { .name = "syslog",    .has_arg = 0, .flag = NULL, .val = 's'},
     { .name = "local",     .has_arg = 0, .flag = NULL, .val = 'l'},
     { .name = "passive",   .has_arg = 0, .flag = NULL, .val = 'p'},
+    { .name = "poll",      .has_arg = 0, .flag = NULL, .val = 'P'},
+    { .name = "compile-config", .has_arg = 0, .flag = NULL, .val = 'k'},
+    { .name = "shm",       .has_arg = 0, .flag = NULL, .val = 'S'},
+    { .name = "match",     .has_arg = 1, .flag = NULL, .val = 'm'},
+    { .name = "execute",   .has_arg = 1, .flag = NULL, .val = 'e'},
     { .name = "version",   .has_arg = 0, .flag = NULL, .val = 'V'},
     { NULL, 0, NULL, 0 }
 };
@@ -131,60 +150,71 @@ handle_sigpipe(UNUSED int32_t signum)
 }
 
 /**
- * @brief Callback to receive child termination signals
- * @param signum signal number
+ * @brief Callback to receive child termination signals (in the main loop)
+ * @param reactor reactor instance
+ * @param signum  signal number
+ * @param data    nyx instance
  */
 static void
-handle_child_stop(UNUSED int32_t signum)
+handle_child_stop(UNUSED reactor_t *reactor, UNUSED int32_t signum, void *data)
 {
-    int32_t last_errno = errno;
+    pid_t pid = 0;
+    int32_t status = 0;
 
     log_debug("Received child stop signal - waiting for termination");
 
-    /* wait for all child processes */
-    while (waitpid(-1, NULL, WNOHANG) > 0)
-    {
-        /* do nothing */
-    }
+    /* wait for all child processes - watched processes that were
+     * reparented to us (e.g. daemonized ones) are stopped right away */
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        dispatch_exit(pid, status, data);
+}
 
-    errno = last_errno;
+static void
+handle_terminate(reactor_t *reactor, int32_t signum, UNUSED void *data)
+{
+    log_debug("Caught termination signal %d - exiting main loop", signum);
+
+    reactor_stop(reactor);
+}
+
+/* the log file was rotated (e.g. by logrotate) */
+static void
+handle_reopen_log(UNUSED reactor_t *reactor, UNUSED int32_t signum, UNUSED void *data)
+{
+    log_reopen();
 }
 
 /**
  * @brief Setup the main program signal handlers
- * @param nyx               nyx instance
- * @param terminate_handler program termination handler callback
+ * @param nyx nyx instance
  */
 void
-setup_signals(UNUSED nyx_t *nyx, void (*terminate_handler)(int32_t))
+setup_signals(nyx_t *nyx)
 {
     log_debug("Setting up signals");
 
     struct sigaction action =
     {
         .sa_flags = SA_NOCLDSTOP | SA_RESTART,
-        .sa_handler = terminate_handler
+        .sa_handler = handle_sigpipe
     };
 
     sigfillset(&action.sa_mask);
 
-    /* register handler for termination:
-     * SIGTERM and SIGINT */
-    sigaction(SIGTERM, &action, NULL);
-    sigaction(SIGINT, &action, NULL);
+    /* termination (SIGTERM and SIGINT) is handled by the
+     * main loop of the reactor */
+    reactor_add_signal(nyx->reactor, SIGTERM, handle_terminate, nyx);
+    reactor_add_signal(nyx->reactor, SIGINT, handle_terminate, nyx);
+
+    /* reopen the log file */
+    reactor_add_signal(nyx->reactor, SIGHUP, handle_reopen_log, nyx);
 
     /* register SIGPIPE handler */
-    action.sa_handler = handle_sigpipe;
     sigaction(SIGPIPE, &action, NULL);
 
     /* register SIGCHLD handler (if in init-mode) */
     if (nyx->is_init)
-    {
-        action.sa_handler = handle_child_stop;
-        sigaction(SIGCHLD, &action, NULL);
-    }
-
-    nyx->terminate_handler = terminate_handler;
+        reactor_add_signal(nyx->reactor, SIGCHLD, handle_child_stop, nyx);
 }
 
 /**
@@ -285,26 +315,54 @@ daemonize(nyx_t *nyx)
 }
 
 static void
-init_event_interface(nyx_t *nyx)
+set_default_options(nyx_t *nyx)
 {
-#ifndef OSX
-    nyx->event = eventfd(0, 0);
+    nyx->options.def_start_timeout = 5;
+    nyx->options.def_stop_timeout = 5;
+    nyx->options.polling_interval = 5;
+    nyx->options.check_interval = 30;
+    nyx->options.check_jitter = 10;
+    nyx->options.startup_delay = 30;
+    nyx->options.history_size = 20;
+    nyx->options.metrics_memory = 16;
+    nyx->options.journal_size = 16 * 1024;
+    nyx->options.http_port = 0;
+    nyx->options.check_exec_concurrency = 8;
+    nyx->options.federation_interval = 10;
+}
 
-    if (nyx->event > 0)
-        return;
+/**
+ * @brief Parse and validate the configuration and write it into a
+ *        binary image that is loaded on startup instead
+ * @param nyx nyx instance
+ * @return NYX_SUCCESS on success
+ */
+static nyx_error_e
+compile_config(nyx_t *nyx)
+{
+    if (nyx->options.config_file == NULL)
+    {
+        log_error("No config file specified to compile");
+        return NYX_INVALID_USAGE;
+    }
 
-    log_perror("nyx: eventfd");
-#endif
+    set_default_options(nyx);
+    nyx->watches = hash_new(_watch_destroy);
+
+    if (!parse_config(nyx, false))
+        return NYX_INVALID_CONFIG;
+
+    char *path = image_path(nyx->options.config_file);
+    bool success = image_write(nyx, path);
 
-    /* OSX does not support the eventfd interface
-     * that's why we are going to use pipes in that case */
-    if (pipe(nyx->event_pipe) == -1)
-        log_perror("nyx: pipe");
+    if (success)
+        log_info("Compiled %u watches into '%s'", hash_count(nyx->watches), path);
     else
-    {
-        log_debug("Opened event pipe on (read %d, write %d)",
-                nyx->event_pipe[0], nyx->event_pipe[1]);
-    }
+        log_error("Failed to write config image '%s'", path);
+
+    nyx_free(path, MEM_CONFIG);
+
+    return success ? NYX_SUCCESS : NYX_FAILURE;
 }
 
 /**
@@ -317,14 +375,7 @@ initialize_daemon(nyx_t *nyx)
 {
     pid_t pid = 0;
 
-    /* set default options */
-    nyx->options.def_start_timeout = 5;
-    nyx->options.def_stop_timeout = 5;
-    nyx->options.polling_interval = 5;
-    nyx->options.check_interval = 30;
-    nyx->options.startup_delay = 30;
-    nyx->options.history_size = 20;
-    nyx->options.http_port = 0;
+    set_default_options(nyx);
 
     nyx->pid_dir = nyx->options.local_mode
         ? determine_local_pid_dir(nyx->nyx_dir)
@@ -332,7 +383,7 @@ initialize_daemon(nyx_t *nyx)
 
     nyx->socket_path = nyx->options.local_mode
         ? local_socket_path(nyx->nyx_dir)
-        : strdup(NYX_SOCKET_ADDR);
+        : xstrdup(NYX_SOCKET_ADDR);
 
     if (nyx->pid_dir == NULL)
         return NYX_NO_PID_DIR;
@@ -353,11 +404,14 @@ initialize_daemon(nyx_t *nyx)
 
     nyx->states = list_new(_state_destroy);
     nyx->state_map = hash_new(NULL);
+    nyx->pids = pidmap_new();
 
     /* parse config (if specified) */
     if (nyx->options.config_file && !parse_config(nyx, false))
         return NYX_INVALID_CONFIG;
 
+    log_configure(nyx);
+
     /* print information about local-mode so the user won't
      * be surprised about what that implies */
     if (nyx->options.local_mode)
@@ -393,23 +447,43 @@ initialize_daemon(nyx_t *nyx)
         return NYX_FAILED_DAEMONIZE;
     }
 
-    /* initialize eventfd with an initial value of '0' */
-    init_event_interface(nyx);
-
-    /* start connector */
-    nyx->connector_thread = xcalloc1(sizeof(pthread_t));
+    /* from now on the log lines are written by a background thread
+     * (the forker process keeps writing them directly) */
+    if (!log_writer_start(nyx))
+    {
+        log_debug("Log lines are written synchronously");
+    }
 
-    int32_t err = pthread_create(nyx->connector_thread, NULL, connector_start, nyx);
+    /* receive the pids of started processes */
+    nyx->forker_reply_thread = xcalloc1(sizeof(pthread_t));
 
-    if (err)
+    if (pthread_create(nyx->forker_reply_thread, NULL, forker_reply_start, nyx))
     {
         log_perror("nyx: pthread_create");
-        log_error("Failed to initialize connector thread");
+        log_error("Failed to initialize forker reply thread");
 
-        free(nyx->connector_thread);
-        nyx->connector_thread = NULL;
+        xfree(nyx->forker_reply_thread);
+        nyx->forker_reply_thread = NULL;
     }
 
+    /* the main loop every subsystem registers its descriptors,
+     * timers and signals with */
+    nyx->reactor = reactor_new();
+    if (nyx->reactor == NULL)
+    {
+        log_error("Failed to initialize main loop");
+        return NYX_FAILED_DAEMONIZE;
+    }
+
+#ifdef USE_SSL
+    /* shared TLS context of the HTTPS checks */
+    ssl_init();
+#endif
+
+    /* start connector */
+    if (!connector_init(nyx))
+        log_error("Failed to initialize connector");
+
 #ifdef USE_PLUGINS
     /* load plugins if enabled */
     nyx->plugins = discover_plugins(nyx->options.plugins,
@@ -430,6 +504,7 @@ nyx_initialize(int32_t argc, char **args, nyx_error_e *error)
 {
     int32_t arg = 0;
     const char **adhoc_watch = NULL;
+    list_t *execute = NULL;
 
     nyx_t *nyx = calloc(1, sizeof(nyx_t));
 
@@ -439,14 +514,19 @@ nyx_initialize(int32_t argc, char **args, nyx_error_e *error)
         exit(EXIT_FAILURE);
     }
 
+    nyx->proc_timer = -1;
+
     /* parse command line arguments */
-    while ((arg = getopt_long(argc, args, "hqsCDVpc:", long_options, NULL)) != -1)
+    while ((arg = getopt_long(argc, args, "hqjsCDVpc:e:", long_options, NULL)) != -1)
     {
         switch (arg)
         {
             case 'q':
                 nyx->options.quiet = true;
                 break;
+            case 'j':
+                nyx->options.json = true;
+                break;
             case 's':
                 nyx->options.syslog = true;
                 break;
@@ -462,9 +542,27 @@ nyx_initialize(int32_t argc, char **args, nyx_error_e *error)
             case 'p':
                 nyx->options.passive_mode = true;
                 break;
+            case 'P':
+                nyx->options.poll_mode = true;
+                break;
+            case 'k':
+                nyx->options.compile_config = true;
+                break;
+            case 'S':
+                nyx->options.shm = true;
+                break;
             case 'c':
                 nyx->options.config_file = optarg;
                 break;
+            case 'm':
+                nyx->options.match = optarg;
+                break;
+            case 'e':
+                if (execute == NULL)
+                    execute = list_new(NULL);
+
+                list_add(execute, optarg);
+                break;
             case 'r':
                 adhoc_watch = split_string_whitespace(optarg);
                 break;
@@ -484,6 +582,9 @@ nyx_initialize(int32_t argc, char **args, nyx_error_e *error)
         }
     }
 
+    if (execute)
+        nyx->options.execute = strings_to_null_terminated(execute);
+
     /* if a config file is given this has to be a daemon */
     nyx->is_daemon = nyx->options.config_file && *nyx->options.config_file;
 
@@ -492,6 +593,13 @@ nyx_initialize(int32_t argc, char **args, nyx_error_e *error)
 
     nyx->nyx_dir = get_current_dir();
 
+    if (nyx->options.compile_config)
+    {
+        *error = compile_config(nyx);
+        nyx_destroy(nyx);
+        return NULL;
+    }
+
     /* either config file or adhoc watch, not both */
     if (adhoc_watch)
     {
@@ -524,7 +632,7 @@ nyx_initialize(int32_t argc, char **args, nyx_error_e *error)
         /* add adhoc watch if specified */
         if (adhoc_watch)
         {
-            const char *adhoc_name = strdup("__run__");
+            const char *adhoc_name = xstrdup("__run__");
             watch_t *adhoc = watch_new(adhoc_name);
             adhoc->start = adhoc_watch;
 
@@ -543,12 +651,21 @@ nyx_initialize(int32_t argc, char **args, nyx_error_e *error)
         /* parse remaining arguments in non-daemon mode only */
         if (optind < argc)
         {
-            nyx->options.commands = xcalloc(argc-optind+1, sizeof(char *));
+            /* the regular expression follows the command itself */
+            uint32_t match = nyx->options.match ? 2 : 0;
+            uint32_t j = 0;
 
-            for (int32_t j = 0, i = optind; i < argc; i++, j++)
+            nyx->options.commands = xcalloc(argc-optind+match+1, sizeof(char *));
+            nyx->options.commands[j++] = args[optind];
+
+            if (match)
             {
-                nyx->options.commands[j] = args[i];
+                nyx->options.commands[j++] = "--match";
+                nyx->options.commands[j++] = nyx->options.match;
             }
+
+            for (int32_t i = optind + 1; i < argc; i++)
+                nyx->options.commands[j++] = args[i];
         }
     }
 
@@ -574,15 +691,18 @@ handle_proc_event(proc_event_e event, proc_stat_t *proc, void *data)
 
     if (state != NULL)
     {
-        /* port and HTTP check should only be taken into account
-         * if the state is running at least for some time */
-        if (event == PROC_HTTP_CHECK_FAILED || event == PROC_PORT_NOT_OPEN)
+        /* port, HTTP, plugin and exec checks as well as the watchdog
+         * should only be taken into account if the state is running
+         * at least for some time */
+        if (event == PROC_HTTP_CHECK_FAILED || event == PROC_PORT_NOT_OPEN ||
+            event == PROC_PLUGIN_CHECK_FAILED || event == PROC_EXEC_CHECK_FAILED ||
+            event == PROC_WATCHDOG_MISSED)
         {
             if (state->history == NULL || state->history->count < 1)
                 return true;
 
             time_t now = time(NULL);
-            timestack_elem_t *newest = &state->history->elements[0];
+            timestack_elem_t *newest = timestack_get(state->history, 0);
             double last_state_ago = difftime(now, newest->time);
 
             uint32_t startup_delay = state->watch->startup_delay;
@@ -596,6 +716,16 @@ handle_proc_event(proc_event_e event, proc_stat_t *proc, void *data)
                 return true;
             }
 
+            /* the checks verify a reloaded process once it had the
+             * startup delay to come up again as well */
+            if (state->reload_time && difftime(now, state->reload_time) < startup_delay)
+            {
+                log_debug("Ignoring process event %d of process '%s' "
+                    "because it was just reloaded", event, proc->name);
+
+                return true;
+            }
+
             /* if the watch's state is STOPPED there is not need to
              * interfere with proc check reactions */
             if (newest->value == STATE_STOPPED)
@@ -615,6 +745,68 @@ handle_proc_event(proc_event_e event, proc_stat_t *proc, void *data)
     return true;
 }
 
+/**
+ * @brief Callback to every statistics sample of a process
+ * @param proc process that was sampled
+ * @param data nyx instance
+ */
+static void
+handle_proc_sample(proc_stat_t *proc, void *data)
+{
+    nyx_t *nyx = data;
+    state_t *state = hash_get(nyx->state_map, proc->name);
+
+#ifdef USE_PLUGINS
+    plugin_metrics_add(nyx->plugins, proc->name, proc->pid,
+            stack_double_newest(proc->cpu_usage),
+            stack_long_newest(proc->mem_usage));
+#endif
+
+    if (state == NULL)
+        return;
+
+    status_set_sample(nyx->status, state->status_slot,
+            stack_double_newest(proc->cpu_usage),
+            stack_long_newest(proc->mem_usage));
+
+    if (state->metrics == NULL)
+        return;
+
+    metrics_add(state->metrics, time(NULL),
+            stack_double_newest(proc->cpu_usage),
+            stack_long_newest(proc->mem_usage));
+}
+
+/**
+ * @brief Callback to every finished check of a process
+ * @param type    type of the check
+ * @param success whether the check passed
+ * @param proc    process that was checked
+ * @param data    nyx instance
+ */
+static void
+handle_proc_check(check_type_e type, bool success, proc_stat_t *proc, void *data)
+{
+    nyx_t *nyx = data;
+    state_t *state = hash_get(nyx->state_map, proc->name);
+
+    if (state != NULL)
+        status_set_check(nyx->status, state->status_slot, type, success);
+}
+
+static void
+handle_proc_timer(UNUSED reactor_t *reactor, void *data)
+{
+    nyx_t *nyx = data;
+
+    nyx_proc_check(nyx->proc);
+
+#ifdef USE_PLUGINS
+    /* the samples of the sweep are passed to the metrics sinks at once */
+    plugin_metrics_flush(nyx->plugins);
+#endif
+}
+
 /**
  * @brief Proc system initialization
  * @param nyx nyx instance
@@ -623,26 +815,54 @@ handle_proc_event(proc_event_e event, proc_stat_t *proc, void *data)
 static bool
 nyx_proc_initialize(nyx_t *nyx)
 {
-    /* try to initialize proc watch/thread */
-    nyx->proc = nyx_proc_init(nyx->pid);
+    /* try to initialize proc watch */
+    nyx->proc = nyx_proc_init(nyx->pid,
+            nyx->options.check_interval, nyx->options.check_jitter);
 
     if (nyx->proc != NULL)
     {
         nyx->proc->event_handler = handle_proc_event;
+        nyx->proc->sample_handler = handle_proc_sample;
+        nyx->proc->check_handler = handle_proc_check;
+        nyx->proc->data = nyx;
 
-        nyx->proc_thread = xcalloc1(sizeof(pthread_t));
+        if (nyx->options.taskstats)
+        {
+            if (nyx_proc_use_taskstats(nyx->proc, nyx->reactor))
+                log_debug("Sampling processes via taskstats");
+            else
+                log_warn("Taskstats are not available - reading /proc instead");
+        }
 
-        int32_t err = pthread_create(nyx->proc_thread, NULL, nyx_proc_start, nyx);
+        if (nyx->options.io_uring && !nyx->proc->taskstats)
+        {
+            if (nyx_proc_use_uring(nyx->proc))
+                log_debug("Reading /proc via io_uring");
+            else
+                log_warn("io_uring is not available - reading /proc per process");
+        }
 
-        if (err)
+        if (nyx->options.proc_threads)
         {
-            log_perror("nyx: pthread_create");
-            log_error("Failed to initialize proc watch - unable to monitor process' statistics");
+            if (nyx_proc_start_shards(nyx->proc, nyx->options.proc_threads))
+                log_debug("Sampling processes on %u threads", nyx->options.proc_threads);
+            else
+                log_warn("Failed to start proc threads - sampling processes serially");
+        }
+
+        log_debug("Starting proc watch - check interval %us (jitter %u%%)",
+                nyx->options.check_interval, nyx->options.check_jitter);
+
+        /* the processes are sampled and checked on their own
+         * schedules which are advanced on the main loop */
+        nyx->proc_timer = reactor_add_timer(nyx->reactor, NYX_PROC_TICK_MSECS, true,
+                handle_proc_timer, nyx);
 
-            free(nyx->proc_thread);
-            nyx->proc_thread = NULL;
+        if (nyx->proc_timer < 0)
+        {
+            log_error("Failed to initialize proc watch - unable to monitor process' statistics");
 
-            free(nyx->proc);
+            nyx_proc_destroy(nyx->proc);
             nyx->proc = NULL;
         }
     }
@@ -665,118 +885,295 @@ proc_required(nyx_t *nyx)
         if (watch->max_cpu > 0 ||
             watch->max_memory > 0 ||
             watch->port_check != NULL ||
-            watch->http_check != NULL)
+            watch->http_check != NULL ||
+            watch->plugin_check != NULL ||
+            watch->check_exec != NULL ||
+            watch->watchdog > 0)
         {
             required = true;
             break;
         }
     }
 
-    free(iter);
+    hash_iter_free(iter);
+
+#ifdef USE_PLUGINS
+    /* the metrics sinks are passed the samples of all processes */
+    required |= plugin_metrics_enabled(nyx->plugins);
+#endif
 
     return required;
 }
 
-/**
- * @brief Initialize watches
- * @param nyx nyx instance
- * @return 'true' on success, 'false' otherwise
- */
-bool
-nyx_watches_init(nyx_t *nyx)
+static bool
+watchdog_required(nyx_t *nyx)
 {
-    int32_t rc = 1, init = 0;
     const char *key = NULL;
     void *data = NULL;
+    bool required = false;
     hash_iter_t *iter = hash_iter_start(nyx->watches);
 
-    /* initialize proc system if necessary */
-    if (proc_required(nyx))
+    while (!required && hash_iter(iter, &key, &data))
     {
-        if (nyx_proc_initialize(nyx))
-        {
-            log_debug("Initialized proc system for at least one watch");
-        }
+        watch_t *watch = data;
+        required = watch->watchdog > 0;
     }
-    else
+
+    hash_iter_free(iter);
+
+    return required;
+}
+
+static bool
+startup_required(nyx_t *nyx)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    bool required = nyx->options.startup_concurrency > 0;
+    hash_iter_t *iter = hash_iter_start(nyx->watches);
+
+    while (!required && hash_iter(iter, &key, &data))
     {
-        log_debug("No watch requiring proc system - skip initialization");
+        watch_t *watch = data;
+
+        /* multiple instances are restarted by the scheduler as well */
+        if ((watch->depends_on && *watch->depends_on) || watch->instances > 1)
+            required = true;
     }
 
+    hash_iter_free(iter);
+
+    return required;
+}
+
+static void
+start_state(void *data)
+{
+    set_state(data, STATE_STARTING);
+}
+
+static void
+restart_state(void *data)
+{
+    set_state_command(data, STATE_RESTARTING);
+}
+
+/* a queued restart was admitted by the restart limiter */
+static void
+admit_state(void *data)
+{
+    state_t *state = data;
+
+    if (state->engine)
+        engine_schedule(state->engine, &state->task);
+}
+
+/* names of all instances of the configured watches */
+static hash_t *
+instance_names(hash_t *watches)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    hash_t *names = hash_new(NULL);
+    hash_iter_t *iter = hash_iter_start(watches);
+
     while (hash_iter(iter, &key, &data))
     {
-        state_t *state = NULL;
         watch_t *watch = data;
 
-        log_debug("Initialize watch '%s'", watch->name);
+        for (uint32_t instance = 0; instance < watch->instances; instance++)
+        {
+            char *name = watch_instance_name(watch, instance);
+
+            hash_add(names, name, watch);
+            nyx_free(name, MEM_CONFIG);
+        }
+    }
+
+    hash_iter_free(iter);
+
+    return names;
+}
+
+/* create the state of the given watch and start processing it */
+static void
+init_state(nyx_t *nyx, watch_t *watch, uint32_t instance, bool restart)
+{
+    /* create new state instance */
+    state_t *state = state_new(watch, nyx, instance);
+    state->restart_pending = restart;
+
+    log_debug("Initialize watch '%s'", state->name);
+
+    list_add(nyx->states, state);
+    hash_add(nyx->state_map, state->name, state);
 
-        /* create new state instance */
-        state = state_new(watch, nyx);
-        list_add(nyx->states, state);
-        hash_add(nyx->state_map, watch->name, state);
+    snapshot_invalidate(nyx->snapshot);
 
+    if (nyx->engine)
+    {
+        /* process the initial state on the engine */
+        engine_schedule(nyx->engine, &state->task);
+    }
+    else
+    {
         /* start a new thread for each state */
         state->thread = xcalloc(1, sizeof(pthread_t));
 
-        /* create with default thread attributes */
-        rc = pthread_create(state->thread, NULL, state_loop_start, state);
+        /* with the configured stack size */
+        int32_t rc = thread_create(state->thread, state_loop_start, state);
         if (rc != 0)
             log_critical_perror("Failed to create thread, error: %d", rc);
+    }
+}
+
+/* initialize all watches that have no state yet - the running
+ * processes of the watches in 'restarts' are restarted */
+static uint32_t
+init_watches(nyx_t *nyx, hash_t *restarts)
+{
+    uint32_t init = 0;
+    const char *key = NULL;
+    void *data = NULL;
+
+    /* applies to the threads that are started from now on */
+    thread_set_stack_size(nyx->options.thread_stack_size * 1024);
 
-        init++;
+    /* initialize proc system if necessary */
+    if (nyx->proc == NULL && proc_required(nyx))
+    {
+        if (nyx_proc_initialize(nyx))
+        {
+            log_debug("Initialized proc system for at least one watch");
+        }
+    }
+    else if (nyx->proc == NULL)
+    {
+        log_debug("No watch requiring proc system - skip initialization");
     }
 
-    free(iter);
+    /* the heartbeats of all watches are received on one socket */
+    if (nyx->proc && nyx->proc->watchdog_fd < 0 && watchdog_required(nyx))
+    {
+        char *path = get_watchdog_socket_path(nyx->pid_dir);
 
-    return init > 0;
-}
+        if (nyx_proc_use_watchdog(nyx->proc, nyx->reactor, path))
+            log_debug("Receiving watchdog heartbeats on '%s'", path);
+        else
+            log_warn("Failed to open the watchdog socket - heartbeats are not monitored");
 
-/**
- * @brief Fire a signal using the eventfd interface
- * @param signum signal to send
- * @param nyx    nyx instance
- * @return 'true' on success, 'false' otherwise
- */
-bool
-signal_eventfd(uint64_t signum, nyx_t *nyx)
-{
-    ssize_t rc = 0;
+        xfree(path);
+    }
 
-    /* no event interface -> use pipes instead */
-    if (nyx->event < 1)
+    /* drive all states by a fixed pool of engine threads
+     * instead of one thread per watch (if configured) */
+    if (nyx->engine == NULL && nyx->options.state_threads > 0)
     {
-        /* no pipes opened as well */
-        if (!nyx->event_pipe[1])
-            return false;
+        nyx->engine = engine_new(nyx->options.state_threads, state_step);
 
-        rc = write(nyx->event_pipe[1], &signum, sizeof(signum));
+        if (nyx->engine == NULL)
+            log_warn("Failed to start state engine - falling back to one thread per watch");
     }
-    else
+
+    /* the state table survives restarts of nyx - the slots are
+     * prepared before any new state refers to them */
+    if (nyx->persist == NULL)
+        nyx->persist = persist_open(nyx->pid_dir);
+
+    /* the status table is published for local readers */
+    if (nyx->status == NULL)
     {
-        rc = write(nyx->event, &signum, sizeof(signum));
+        nyx->status = status_open(nyx->pid_dir);
+
+        if (nyx->status == NULL)
+            log_warn("Failed to create the status table");
     }
 
-    if (rc == -1)
+    if (nyx->persist || nyx->status)
     {
-        log_perror("nyx: write");
-        return false;
+        hash_t *names = instance_names(nyx->watches);
+
+        if (nyx->persist && !persist_prepare(nyx->persist, names))
+            log_warn("Failed to prepare the persisted state table");
+
+        if (nyx->status && !status_prepare(nyx->status, names))
+            log_warn("Failed to prepare the status table");
+
+        hash_destroy(names);
     }
 
-    return true;
+    if (nyx->journal == NULL && nyx->options.journal_size > 0)
+    {
+        nyx->journal = journal_open(nyx->pid_dir, nyx->options.journal_size * 1024);
+
+        if (nyx->journal == NULL)
+            log_warn("Failed to open the event journal");
+    }
+
+    /* the initial start is scheduled along the dependencies only
+     * if there are any or the concurrency is limited */
+    if (nyx->startup == NULL && startup_required(nyx))
+        nyx->startup = startup_new(start_state, restart_state);
+
+    if (nyx->startup)
+        startup_prepare(nyx->startup, nyx->watches, nyx->options.startup_concurrency);
+
+    /* the restarts of all watches share a host-wide budget (if configured) */
+    if (nyx->limiter == NULL &&
+            (nyx->options.restart_rate || nyx->options.restart_concurrency))
+        nyx->limiter = limiter_new(admit_state);
+
+    if (nyx->limiter)
+    {
+        limiter_configure(nyx->limiter, nyx->options.restart_rate,
+                nyx->options.restart_burst, nyx->options.restart_concurrency);
+    }
+
+    hash_iter_t *iter = hash_iter_start(nyx->watches);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        watch_t *watch = data;
+
+        /* the instances of a watch are spawned in parallel */
+        for (uint32_t instance = 0; instance < watch->instances; instance++)
+        {
+            char *name = watch_instance_name(watch, instance);
+
+            if (hash_get(nyx->state_map, name) == NULL)
+            {
+                init_state(nyx, watch, instance, restarts && hash_get(restarts, key));
+                init++;
+            }
+
+            nyx_free(name, MEM_CONFIG);
+        }
+    }
+
+    hash_iter_free(iter);
+
+    return init;
+}
+
+/**
+ * @brief Initialize watches
+ * @param nyx nyx instance
+ * @return 'true' on success, 'false' otherwise
+ */
+bool
+nyx_watches_init(nyx_t *nyx)
+{
+    return init_watches(nyx, NULL) > 0;
 }
 
 static void
 shutdown_proc(nyx_t *nyx)
 {
     /* tear down proc watch (if running) */
-    if (nyx->proc_thread)
+    if (nyx->reactor && nyx->proc_timer >= 0)
     {
-        nyx_proc_terminate();
-        pthread_kill(*nyx->proc_thread, SIGUSR1);
-        pthread_join(*nyx->proc_thread, NULL);
-
-        free(nyx->proc_thread);
-        nyx->proc_thread = NULL;
+        reactor_remove_timer(nyx->reactor, nyx->proc_timer);
+        nyx->proc_timer = -1;
     }
 
     if (nyx->proc)
@@ -802,6 +1199,7 @@ clear_watches(nyx_t *nyx)
     hash_t *state_map = nyx->state_map;
     hash_t *watches = nyx->watches;
     list_t *states = nyx->states;
+    engine_t *engine = nyx->engine;
 
     /* nyx's internal structures are immediately reset
      * so that the poll or event loops don't work on
@@ -813,6 +1211,7 @@ clear_watches(nyx_t *nyx)
     nyx->state_map = NULL;
     nyx->watches = NULL;
     nyx->states = NULL;
+    nyx->engine = NULL;
 
     /* at first we will push the QUIT signal to all states
      * so all states can start shutdown procedure concurrently */
@@ -825,6 +1224,10 @@ clear_watches(nyx_t *nyx)
     if (states)
         list_destroy(states);
 
+    /* all states are detached from the engine by now */
+    if (engine)
+        engine_destroy(engine);
+
     if (watches)
         hash_destroy(watches);
 }
@@ -843,7 +1246,7 @@ destroy_plugins(nyx_t *nyx)
 
     if (nyx->options.plugins)
     {
-        free((void *)nyx->options.plugins);
+        nyx_free((void *)nyx->options.plugins, MEM_CONFIG);
         nyx->options.plugins = NULL;
     }
 
@@ -863,9 +1266,204 @@ destroy_options(nyx_t *nyx)
 {
     if (nyx->options.log_file)
     {
-        free((void *)nyx->options.log_file);
+        nyx_free((void *)nyx->options.log_file, MEM_CONFIG);
         nyx->options.log_file = NULL;
     }
+
+    if (nyx->options.log_level)
+    {
+        nyx_free((void *)nyx->options.log_level, MEM_CONFIG);
+        nyx->options.log_level = NULL;
+    }
+
+    if (nyx->options.cgroup)
+    {
+        nyx_free((void *)nyx->options.cgroup, MEM_CONFIG);
+        nyx->options.cgroup = NULL;
+    }
+
+    if (nyx->options.include_dir)
+    {
+        nyx_free((void *)nyx->options.include_dir, MEM_CONFIG);
+        nyx->options.include_dir = NULL;
+    }
+
+    if (nyx->options.federation)
+    {
+        strings_release((char **)nyx->options.federation, MEM_CONFIG);
+        nyx->options.federation = NULL;
+    }
+
+    if (nyx->options.federation_node)
+    {
+        nyx_free((void *)nyx->options.federation_node, MEM_CONFIG);
+        nyx->options.federation_node = NULL;
+    }
+}
+
+/* the options that are only applied when the watches are initialized
+ * from scratch (engine and proc system) */
+static bool
+options_require_restart(const nyx_options_t *previous, const nyx_options_t *options)
+{
+    return previous->state_threads != options->state_threads ||
+        previous->proc_threads != options->proc_threads ||
+        previous->taskstats != options->taskstats ||
+        previous->io_uring != options->io_uring ||
+        previous->check_interval != options->check_interval ||
+        previous->check_jitter != options->check_jitter;
+}
+
+static void
+notify_forker_reload(nyx_t *nyx)
+{
+    /* at this point we have to notify the forker thread
+     * to reload its config as well otherwise it will still
+     * launch the watches with its old run config */
+
+    fork_info_t *reload_info = forker_reload();
+
+    if (write(nyx->forker_pipe, reload_info, sizeof(fork_info_t)) == -1)
+        log_perror("nyx: write");
+
+    xfree(reload_info);
+}
+
+/**
+ * Apply the freshly parsed watches (in nyx->watches) by comparing them
+ * with the previous ones: unchanged watches keep their state, thread and
+ * process, removed watches are stopped and changed watches get a new state
+ * that adopts the running process (restarting it only if the way it is
+ * spawned changed).
+ */
+static bool
+reload_watches(nyx_t *nyx, hash_t *previous, bool restart_all)
+{
+    hash_t *watches = nyx->watches;
+    list_t *states = list_new(_state_destroy);
+    list_t *stale = list_new(NULL);
+    hash_t *state_map = hash_new(NULL);
+    hash_t *restarts = hash_new(NULL);
+    uint32_t kept = 0, changed = 0, removed = 0;
+
+    for (list_node_t *node = nyx->states->head; node; node = node->next)
+    {
+        state_t *state = node->data;
+        const char *name = state->watch->name;
+        watch_t *watch = hash_get(watches, name);
+
+        /* the watches are counted once - not per instance */
+        bool first = state->instance == 0;
+
+        if (watch == NULL)
+        {
+            log_info("Watch '%s' was removed - stopping", state->name);
+
+            set_state_command(state, STATE_STOPPING);
+            set_state_command(state, STATE_QUIT);
+
+            list_add(stale, state);
+            removed += first;
+        }
+        else if (state->instance >= watch->instances)
+        {
+            log_info("Instance '%s' was removed - stopping", state->name);
+
+            set_state_command(state, STATE_STOPPING);
+            set_state_command(state, STATE_QUIT);
+
+            list_add(stale, state);
+        }
+        else if (watch == state->watch)
+        {
+            /* another instance of the unchanged watch swapped it already */
+            list_add(states, state);
+            hash_add(state_map, state->name, state);
+            kept += first;
+        }
+        else if (!restart_all && watch_equal(watch, state->watch))
+        {
+            /* keep the watch instance the state refers to */
+            watch_destroy(hash_take(watches, name));
+            hash_add(watches, name, hash_take(previous, name));
+
+            list_add(states, state);
+            hash_add(state_map, state->name, state);
+            kept += first;
+        }
+        else
+        {
+            if (watch_needs_restart(state->watch, watch))
+                hash_add(restarts, name, watch);
+
+            log_info("Watch '%s' was changed%s", state->name,
+                    hash_get(restarts, name) ? " - restarting" : "");
+
+            set_state_command(state, STATE_QUIT);
+
+            list_add(stale, state);
+            changed += first;
+        }
+    }
+
+    uint32_t added = hash_count(watches) - kept - changed;
+
+    log_info("Reloaded watches: %u unchanged, %u changed, %u added, %u removed",
+            kept, changed, added, removed);
+
+    /* the unchanged states are available right away */
+    list_t *old_states = nyx->states;
+    hash_t *old_state_map = nyx->state_map;
+
+    nyx->states = states;
+    nyx->state_map = state_map;
+
+    snapshot_invalidate(nyx->snapshot);
+
+    /* wait for the removed and changed states to terminate - the
+     * stop requests of removed watches are sent to the forker by now */
+    for (list_node_t *node = stale->head; node; node = node->next)
+    {
+        state_t *state = node->data;
+
+        if (nyx->proc && state->pid > 0)
+            nyx_proc_remove(nyx->proc, state->pid);
+
+        /* the aggregators drop the watches that are gone */
+        if (nyx->federation && hash_get(state_map, state->name) == NULL)
+            federation_remove(nyx->federation, state->name);
+
+        state_destroy(state);
+    }
+
+    old_states->free_func = NULL;
+    list_destroy(old_states);
+    hash_destroy(old_state_map);
+    list_destroy(stale);
+
+    /* release the watches of the terminated states */
+    hash_destroy(previous);
+
+    if (restart_all)
+    {
+        shutdown_proc(nyx);
+
+        if (nyx->engine)
+        {
+            engine_destroy(nyx->engine);
+            nyx->engine = NULL;
+        }
+    }
+
+    /* only changes have to be picked up by the forker */
+    if (changed || added || removed)
+        notify_forker_reload(nyx);
+
+    init_watches(nyx, restarts);
+
+    hash_destroy(restarts);
+
+    return hash_count(nyx->watches) > 0;
 }
 
 /**
@@ -878,44 +1476,43 @@ nyx_reload(nyx_t *nyx)
 {
     log_info("Start reloading nyx");
 
+    hash_t *previous = nyx->watches;
+    nyx_options_t options = nyx->options;
+
     destroy_plugins(nyx);
-    shutdown_proc(nyx);
-    clear_watches(nyx);
     destroy_options(nyx);
 
     nyx->watches = hash_new(_watch_destroy);
-    nyx->states = list_new(_state_destroy);
-    nyx->state_map = hash_new(NULL);
-
-    if (parse_config(nyx, false))
-    {
-        /* at this point we have to notify the forker thread
-         * to reload its config as well otherwise it will still
-         * launch the watches with its old run config */
 
-        fork_info_t *reload_info = forker_reload();
+    bool success = parse_config(nyx, false);
 
-        if (write(nyx->forker_pipe, reload_info, sizeof(fork_info_t)) == -1)
-            log_perror("nyx: write");
+    if (success)
+    {
+        reindex_watches_from(nyx->watches, previous);
+        log_configure(nyx);
 
-        free(reload_info);
+        success = reload_watches(nyx, previous,
+                options_require_restart(&options, &nyx->options));
+    }
+    else
+    {
+        /* keep the previous watches running */
+        hash_destroy(nyx->watches);
+        nyx->watches = previous;
+    }
 
-        if (nyx_watches_init(nyx))
-        {
 #ifdef USE_PLUGINS
-            /* load plugins if enabled */
-            nyx->plugins = discover_plugins(nyx->options.plugins,
-                    nyx->options.plugin_config);
+    /* load plugins if enabled */
+    nyx->plugins = discover_plugins(nyx->options.plugins,
+            nyx->options.plugin_config);
 #endif
 
-            log_info("Successfully reloaded nyx");
-            return true;
-        }
-    }
-
-    log_warn("Failed to reload nyx");
+    if (success)
+        log_info("Successfully reloaded nyx");
+    else
+        log_warn("Failed to reload nyx");
 
-    return false;
+    return success;
 }
 
 /**
@@ -932,66 +1529,134 @@ nyx_destroy(nyx_t *nyx)
     if (nyx->forker_pipe)
         close(nyx->forker_pipe);
 
-    /* signal termination via eventfd (if existing) */
-    bool signal_sent = signal_eventfd(4, nyx);
+    /* the forker closes its reply end on termination */
+    if (nyx->forker_reply_thread)
+    {
+        pthread_join(*nyx->forker_reply_thread, NULL);
+
+        xfree(nyx->forker_reply_thread);
+        nyx->forker_reply_thread = NULL;
+    }
+
+    if (nyx->forker_reply)
+        close(nyx->forker_reply);
 
     /* tear down connector first */
-    if (nyx->connector_thread)
+    if (nyx->reactor)
+        connector_shutdown(nyx);
+
+    shutdown_proc(nyx);
+
+    clear_watches(nyx);
+
+    /* the subscribers are disconnected after the last transitions */
+    if (nyx->subscribers)
     {
-        pthread_t connector = *nyx->connector_thread;
+        subscribers_destroy(nyx->subscribers);
+        nyx->subscribers = NULL;
+    }
 
-        /* signal for termination failed
-         * -> we have to force exit */
-        if (!signal_sent)
-            pthread_cancel(connector);
+    if (nyx->federation)
+    {
+        federation_destroy(nyx->federation);
+        nyx->federation = NULL;
+    }
 
-        pthread_join(connector, NULL);
+    if (nyx->bulk)
+    {
+        bulk_ops_destroy(nyx->bulk);
+        nyx->bulk = NULL;
+    }
 
-        free(nyx->connector_thread);
-        nyx->connector_thread = NULL;
+    if (nyx->snapshot)
+    {
+        snapshot_destroy(nyx->snapshot);
+        nyx->snapshot = NULL;
     }
 
-    shutdown_proc(nyx);
+    if (nyx->config_cache)
+    {
+        hash_destroy(nyx->config_cache);
+        nyx->config_cache = NULL;
+    }
 
-    clear_watches(nyx);
+    if (nyx->persist)
+    {
+        persist_close(nyx->persist);
+        nyx->persist = NULL;
+    }
+
+    if (nyx->status)
+    {
+        status_close(nyx->status);
+        nyx->status = NULL;
+    }
+
+    if (nyx->journal)
+    {
+        journal_close(nyx->journal);
+        nyx->journal = NULL;
+    }
+
+    if (nyx->startup)
+    {
+        startup_destroy(nyx->startup);
+        nyx->startup = NULL;
+    }
+
+    if (nyx->limiter)
+    {
+        limiter_destroy(nyx->limiter);
+        nyx->limiter = NULL;
+    }
+
+    if (nyx->pids)
+    {
+        pidmap_destroy(nyx->pids);
+        nyx->pids = NULL;
+    }
 
     destroy_plugins(nyx);
 
     if (nyx->options.commands)
     {
-        free(nyx->options.commands);
+        xfree(nyx->options.commands);
         nyx->options.commands = NULL;
     }
 
-    destroy_options(nyx);
-
-    if (nyx->event > 0)
-        close(nyx->event);
-    else
+    if (nyx->options.execute)
     {
-        /* close pipes if no eventfd exists */
-        close(nyx->event_pipe[0]);
-        close(nyx->event_pipe[1]);
+        xfree(nyx->options.execute);
+        nyx->options.execute = NULL;
     }
 
+    destroy_options(nyx);
+
+    reactor_destroy(nyx->reactor);
+    nyx->reactor = NULL;
+
+#ifdef USE_SSL
+    ssl_free();
+#endif
+
     if (nyx->is_daemon)
         clear_pid("nyx", nyx);
 
     if (nyx->pid_dir)
     {
-        free((void *)nyx->pid_dir);
+        xfree((void *)nyx->pid_dir);
         nyx->pid_dir = NULL;
     }
 
     if (nyx->nyx_dir)
     {
-        free((void *)nyx->nyx_dir);
+        xfree((void *)nyx->nyx_dir);
         nyx->nyx_dir = NULL;
     }
 
     if (nyx->socket_path)
     {
-        free((void *)nyx->socket_path);
+        xfree((void *)nyx->socket_path);
         nyx->socket_path = NULL;
     }
 
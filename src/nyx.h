@@ -15,9 +15,22 @@
 
 #pragma once
 
+#include "bulk.h"
+#include "engine.h"
+#include "federation.h"
+#include "fleet.h"
 #include "hash.h"
+#include "http.h"
+#include "journal.h"
+#include "limiter.h"
 #include "list.h"
+#include "persist.h"
 #include "proc.h"
+#include "reactor.h"
+#include "snapshot.h"
+#include "startup.h"
+#include "status.h"
+#include "subscribe.h"
 
 #ifdef USE_PLUGINS
 #include "plugins.h"
@@ -31,21 +44,66 @@
 typedef struct
 {
     bool quiet;
+    /** request the output of commands in JSON format */
+    bool json;
     bool no_color;
     bool no_daemon;
     bool syslog;
     bool local_mode;
     bool passive_mode;
+    /** use the polling mode even if process events are available */
+    bool poll_mode;
+    bool compile_config;
+    /** read the status from the status table instead of the daemon */
+    bool shm;
+    bool fast_spawn;
+    /** log timestamps with milliseconds */
+    bool log_milliseconds;
+    bool taskstats;
+    /** read the /proc files of the due processes via io_uring */
+    bool io_uring;
     int32_t http_port;
     uint32_t def_start_timeout;
     uint32_t def_stop_timeout;
     uint32_t polling_interval;
     uint32_t check_interval;
+    uint32_t check_jitter;
     uint32_t startup_delay;
     uint32_t history_size;
+    uint32_t state_threads;
+    uint32_t proc_threads;
+    uint32_t startup_concurrency;
+    uint32_t command_concurrency;
+    /** maximum number of check_exec commands running at the same time */
+    uint32_t check_exec_concurrency;
+    /* host-wide limit of the restarts (0 meaning unlimited) */
+    uint32_t restart_rate;
+    uint32_t restart_burst;
+    uint32_t restart_concurrency;
+    uint64_t metrics_memory;
+    /** size limit of the event journal (in KB, 0 disables it) */
+    uint64_t journal_size;
+    /** stack size of the state and proc threads (in KB, 0 for the default) */
+    uint64_t thread_stack_size;
+    /** aggregators the state changes are pushed to ('host:port') */
+    const char **federation;
+    /** name of this node towards the aggregators (hostname by default) */
+    const char *federation_node;
+    /** seconds between the metric summaries sent to the aggregators */
+    uint32_t federation_interval;
+    /** port the federated nodes connect to (0 if not an aggregator) */
+    uint32_t federation_port;
     const char *config_file;
     const char *log_file;
+    /** log level and debug categories (see log_parse_level) */
+    const char *log_level;
+    const char *cgroup;
+    const char *include_dir;
     const char **commands;
+    /** regular expression selecting the watches of a command */
+    const char *match;
+    /** commands to send over a single session (-e) */
+    const char **execute;
 #ifdef USE_PLUGINS
     const char *plugins;
     hash_t *plugin_config;
@@ -60,18 +118,42 @@ typedef struct
     const char *pid_dir;
     const char *nyx_dir;
     const char *socket_path;
-    int32_t event;
-    int32_t event_pipe[2];
-    void (*terminate_handler)(int32_t);
-    pthread_t *connector_thread;
-    pthread_t *proc_thread;
+    reactor_t *reactor;
+    int32_t proc_timer;
+    pthread_t *forker_reply_thread;
     nyx_proc_t *proc;
+    engine_t *engine;
     nyx_options_t options;
     hash_t *watches;
+    /** parsed watches of the config files (by inode) */
+    hash_t *config_cache;
     list_t *states;
     hash_t *state_map;
+    pidmap_t *pids;
+    persist_t *persist;
+    /** status table read by local readers (may be NULL) */
+    status_t *status;
+    /** journal of the state transitions, exits and checks (may be NULL) */
+    journal_t *journal;
+    /** scheduler of the initial start of the watches (NULL if not needed) */
+    startup_t *startup;
+    /** host-wide limiter of the restarts (NULL if not configured) */
+    limiter_t *limiter;
+    /** clients subscribed to the state transitions */
+    subscribers_t *subscribers;
+    /** rendered output of the commands covering all watches */
+    snapshot_t *snapshot;
+    /** state changes of multiple watches the clients wait for */
+    bulk_ops_t *bulk;
+    /** HTTP control interface (NULL if not configured) */
+    http_server_t *http;
+    /** push of the state changes to the aggregators (NULL if not configured) */
+    federation_t *federation;
+    /** watches of the federated nodes (NULL if not an aggregator) */
+    fleet_t *fleet;
     pid_t forker_pid;
     int32_t forker_pipe;
+    int32_t forker_reply;
 #ifdef USE_PLUGINS
     plugin_repository_t *plugins;
 #endif
@@ -117,11 +199,8 @@ destroy_options(nyx_t *nyx);
 bool
 nyx_reload(nyx_t *nyx);
 
-bool
-signal_eventfd(uint64_t signum, nyx_t *nyx);
-
 void
-setup_signals(nyx_t *nyx, void (*terminate_handler)(int));
+setup_signals(nyx_t *nyx);
 
 void
 nyx_destroy(nyx_t *nyx);
@@ -0,0 +1,147 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+/*
+ * Layout of the status table a nyx daemon publishes in its pid directory
+ * (e.g. /var/run/nyx/nyx.status or .nyx/nyx.status in local mode). The
+ * file may be memory-mapped read-only by any number of local readers which
+ * get consistent records without talking to the daemon at all.
+ *
+ * Every record is protected by a sequence lock: the daemon increments the
+ * record's 'sequence' before and after every update so a reader has to
+ * retry while the sequence is odd or changed during the copy - see
+ * nyx_status_read(). Records with an empty name are unused.
+ *
+ * This header depends on the C standard library only so it may be copied
+ * into other projects.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NYX_STATUS_MAGIC 0x4154534e
+#define NYX_STATUS_VERSION 1
+
+/* file name of the status table inside the pid directory */
+#define NYX_STATUS_FILE "nyx.status"
+
+/* maximum length of a watch name (including '\0') */
+#define NYX_STATUS_NAME_SIZE 64
+
+/* values of 'state' (as the daemon's state machine) */
+enum
+{
+    NYX_STATUS_INIT,
+    NYX_STATUS_UNMONITORED,
+    NYX_STATUS_STARTING,
+    NYX_STATUS_RUNNING,
+    NYX_STATUS_STOPPING,
+    NYX_STATUS_STOPPED,
+    NYX_STATUS_RESTARTING,
+    NYX_STATUS_QUIT
+};
+
+/* values of 'check' */
+enum
+{
+    /** no check finished since the process was started */
+    NYX_STATUS_CHECK_NONE,
+    NYX_STATUS_CHECK_PASSED,
+    NYX_STATUS_CHECK_FAILED
+};
+
+/* values of 'check_type' */
+enum
+{
+    NYX_STATUS_CHECK_PORT,
+    NYX_STATUS_CHECK_HTTP,
+    NYX_STATUS_CHECK_PLUGIN,
+    NYX_STATUS_CHECK_EXEC
+};
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    /** number of records following the header (only ever grows) */
+    uint32_t records;
+    /** process ID of the publishing daemon */
+    int32_t pid;
+    uint32_t padding;
+    /** start time of the publishing daemon (seconds since the epoch) */
+    int64_t started;
+} nyx_status_header_t;
+
+typedef struct
+{
+    /** odd while the record is written */
+    uint32_t sequence;
+    int32_t state;
+    /** process ID (0 if there is none) */
+    int32_t pid;
+    uint32_t restarts;
+    /** consecutive failed starts */
+    uint32_t failures;
+    int32_t check;
+    int32_t check_type;
+    uint32_t padding;
+    /** CPU usage (in percent) of the latest sample */
+    double cpu;
+    /** resident memory (in KB) of the latest sample */
+    uint64_t rss;
+    /* times (in seconds since the epoch) of the latest state change,
+     * sample and check (0 if none) */
+    int64_t changed;
+    int64_t sampled;
+    int64_t checked;
+    char name[NYX_STATUS_NAME_SIZE];
+} nyx_status_record_t;
+
+/**
+ * @brief Take a consistent copy of the given (mapped) record
+ * @param record record inside the mapped status table
+ * @param copy   copy of the record
+ * @return true on success; false if the record was updated during every
+ *         attempt (very unlikely) or is unused
+ */
+static inline bool
+nyx_status_read(const nyx_status_record_t *record, nyx_status_record_t *copy)
+{
+    for (uint32_t attempt = 0; attempt < 1000; attempt++)
+    {
+        uint32_t before = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+
+        if (before & 1)
+            continue;
+
+        memcpy(copy, (const void *)record, sizeof(nyx_status_record_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&record->sequence, __ATOMIC_RELAXED) == before)
+        {
+            copy->name[NYX_STATUS_NAME_SIZE - 1] = '\0';
+            return *copy->name != '\0';
+        }
+    }
+
+    return false;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,173 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_STATE
+
+#include "def.h"
+#include "log.h"
+#include "persist.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const slotmap_layout_t layout =
+{
+    .description = "persisted state",
+    .header_size = sizeof(persist_header_t),
+    .count_offset = offsetof(persist_header_t, slots),
+    .slot_size = sizeof(persist_slot_t),
+    .name_offset = offsetof(persist_slot_t, name),
+    .name_size = PERSIST_NAME_SIZE,
+    .max_slots = PERSIST_MAX_SLOTS
+};
+
+static bool
+persist_map(persist_t *persist)
+{
+    if (!slotmap_map(&persist->map, &layout, persist->fd))
+        return false;
+
+    persist->header = persist->map.header;
+    persist->slots = (persist_slot_t *)persist->map.slots;
+
+    return true;
+}
+
+/* a file of an older layout (or a truncated one) is discarded */
+static bool
+persist_valid(persist_t *persist, size_t size)
+{
+    persist_header_t header;
+
+    if (size < sizeof(persist_header_t))
+        return false;
+
+    if (pread(persist->fd, &header, sizeof(persist_header_t), 0) != sizeof(persist_header_t))
+        return false;
+
+    return header.magic == PERSIST_MAGIC &&
+        header.version == PERSIST_VERSION &&
+        header.slot_size == sizeof(persist_slot_t) &&
+        header.slots <= PERSIST_MAX_SLOTS &&
+        slotmap_size(&layout, header.slots) == size;
+}
+
+/**
+ * @brief Open (or create) the persisted state table in the given
+ *        pid directory
+ * @param pid_dir pid directory of the nyx instance
+ * @return persist instance or NULL on failure
+ */
+persist_t *
+persist_open(const char *pid_dir)
+{
+    struct stat st;
+    persist_t *persist = xcalloc1(sizeof(persist_t));
+
+    persist->path = xcalloc(512, sizeof(char));
+    snprintf(persist->path, 511, "%s/nyx.state", pid_dir);
+
+    persist->fd = open(persist->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+    if (persist->fd < 0)
+    {
+        log_perror("nyx: open");
+        goto error;
+    }
+
+    if (fstat(persist->fd, &st) != 0)
+    {
+        log_perror("nyx: fstat");
+        goto error;
+    }
+
+    if (persist_valid(persist, st.st_size))
+    {
+        if (!persist_map(persist))
+            goto error;
+
+        log_debug("Loaded persisted state of %u watches from '%s'",
+                persist->header->slots, persist->path);
+
+        return persist;
+    }
+
+    /* start with an empty table */
+    if (ftruncate(persist->fd, 0) != 0 ||
+            ftruncate(persist->fd, slotmap_size(&layout, 0)) != 0)
+    {
+        log_perror("nyx: ftruncate");
+        goto error;
+    }
+
+    if (!persist_map(persist))
+        goto error;
+
+    persist->header->magic = PERSIST_MAGIC;
+    persist->header->version = PERSIST_VERSION;
+    persist->header->slot_size = sizeof(persist_slot_t);
+    persist->header->slots = 0;
+
+    return persist;
+
+error:
+    persist_close(persist);
+    return NULL;
+}
+
+/* see slotmap_prepare */
+bool
+persist_prepare(persist_t *persist, hash_t *watches)
+{
+    return slotmap_prepare(&persist->map, watches);
+}
+
+/* see slotmap_slot - returns -1 if the watch cannot be persisted */
+int32_t
+persist_slot(persist_t *persist, const char *name)
+{
+    return slotmap_slot(&persist->map, name);
+}
+
+persist_slot_t *
+persist_get(persist_t *persist, int32_t slot)
+{
+    if (persist == NULL)
+        return NULL;
+
+    return slotmap_get(&persist->map, slot);
+}
+
+void
+persist_close(persist_t *persist)
+{
+    if (persist == NULL)
+        return;
+
+    slotmap_unmap(&persist->map);
+
+    if (persist->fd >= 0)
+        close(persist->fd);
+
+    xfree(persist->path);
+    xfree(persist);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,99 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "hash.h"
+#include "slotmap.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define PERSIST_MAGIC 0x5453594e
+#define PERSIST_VERSION 1
+
+/* maximum length of a persisted watch name (including '\0') */
+#define PERSIST_NAME_SIZE 64
+
+/* number of the latest state changes that are persisted */
+#define PERSIST_HISTORY 32
+
+/* the mapping is reserved for this many slots up front so the table
+ * can grow without moving the slots the states are writing to */
+#define PERSIST_MAX_SLOTS 65536
+
+typedef struct
+{
+    int64_t time;
+    int32_t value;
+    int32_t padding;
+} persist_event_t;
+
+/**
+ * Fixed-layout record of a single watch. A slot is only ever written
+ * by the state of its watch (the pid and start time by whoever updates
+ * the state's pid).
+ */
+typedef struct
+{
+    char name[PERSIST_NAME_SIZE];
+    int32_t pid;
+    int32_t state;
+    /** start time of the process (see process_start_time) */
+    uint64_t start_time;
+    uint32_t failed_counter;
+    uint32_t history_count;
+    /** latest state changes - oldest first */
+    persist_event_t history[PERSIST_HISTORY];
+} persist_slot_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t slots;
+} persist_header_t;
+
+/**
+ * State table of all watches that is memory-mapped from a file in the
+ * pid directory so it survives restarts (and crashes) of nyx.
+ */
+typedef struct
+{
+    int32_t fd;
+    char *path;
+    slotmap_t map;
+    persist_header_t *header;
+    persist_slot_t *slots;
+} persist_t;
+
+persist_t *
+persist_open(const char *pid_dir);
+
+bool
+persist_prepare(persist_t *persist, hash_t *watches);
+
+int32_t
+persist_slot(persist_t *persist, const char *name);
+
+persist_slot_t *
+persist_get(persist_t *persist, int32_t slot);
+
+void
+persist_close(persist_t *persist);
+
+/* vim: set et sw=4 sts=4 tw=80: */
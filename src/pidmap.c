@@ -0,0 +1,245 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define NYX_MEM_TAG MEM_HASH
+
+#include "def.h"
+#include "pidmap.h"
+
+#include <stdlib.h>
+
+#define PIDMAP_INITIAL_SIZE 64
+
+/* marks a slot whose entry was removed (pids are positive) */
+#define PIDMAP_TOMBSTONE -1
+
+static uint32_t
+pidmap_hash(pid_t pid, uint32_t size)
+{
+    /* multiplicative hashing spreads consecutive pids */
+    return ((uint32_t)pid * 2654435761U) & (size - 1);
+}
+
+/* has to be called with the map lock being held */
+static pidmap_entry_t *
+find_slot(pidmap_t *map, pid_t pid)
+{
+    uint32_t idx = pidmap_hash(pid, map->size);
+
+    while (map->entries[idx].pid != 0)
+    {
+        if (map->entries[idx].pid == pid)
+            return &map->entries[idx];
+
+        idx = (idx + 1) & (map->size - 1);
+    }
+
+    return NULL;
+}
+
+/* has to be called with the map lock being held */
+static void
+insert_entry(pidmap_t *map, pid_t pid, void *data)
+{
+    uint32_t idx = pidmap_hash(pid, map->size);
+
+    while (map->entries[idx].pid > 0)
+        idx = (idx + 1) & (map->size - 1);
+
+    if (map->entries[idx].pid == 0)
+        map->used++;
+
+    map->entries[idx].pid = pid;
+    map->entries[idx].data = data;
+    map->count++;
+}
+
+/* has to be called with the map lock being held */
+static void
+rehash(pidmap_t *map, uint32_t size)
+{
+    pidmap_entry_t *entries = map->entries;
+    uint32_t old_size = map->size;
+
+    map->entries = xcalloc(size, sizeof(pidmap_entry_t));
+    map->size = size;
+    map->count = 0;
+    map->used = 0;
+
+    for (uint32_t i = 0; i < old_size; i++)
+    {
+        if (entries[i].pid > 0)
+            insert_entry(map, entries[i].pid, entries[i].data);
+    }
+
+    xfree(entries);
+}
+
+pidmap_t *
+pidmap_new(void)
+{
+    pidmap_t *map = xcalloc1(sizeof(pidmap_t));
+
+    map->size = PIDMAP_INITIAL_SIZE;
+    map->entries = xcalloc(map->size, sizeof(pidmap_entry_t));
+
+    pthread_mutex_init(&map->lock, NULL);
+
+    return map;
+}
+
+void
+pidmap_destroy(pidmap_t *map)
+{
+    pthread_mutex_destroy(&map->lock);
+
+    xfree(map->entries);
+    xfree(map);
+}
+
+/**
+ * @brief Add or replace the data associated with the given pid
+ * @param map  pid map
+ * @param pid  pid to index
+ * @param data associated data
+ * @return true on success, false for an invalid pid
+ */
+bool
+pidmap_add(pidmap_t *map, pid_t pid, void *data)
+{
+    if (pid < 1)
+        return false;
+
+    pthread_mutex_lock(&map->lock);
+
+    pidmap_entry_t *entry = find_slot(map, pid);
+
+    if (entry)
+        entry->data = data;
+    else
+    {
+        /* keep the load (including tombstones) below 50% */
+        if ((map->used + 1) * 2 > map->size)
+        {
+            uint32_t size = map->size;
+
+            while ((map->count + 1) * 4 > size)
+                size *= 2;
+
+            rehash(map, size);
+        }
+
+        insert_entry(map, pid, data);
+    }
+
+    pthread_mutex_unlock(&map->lock);
+
+    return true;
+}
+
+void *
+pidmap_get(pidmap_t *map, pid_t pid)
+{
+    void *data = NULL;
+
+    if (pid < 1)
+        return NULL;
+
+    pthread_mutex_lock(&map->lock);
+
+    pidmap_entry_t *entry = find_slot(map, pid);
+
+    if (entry)
+        data = entry->data;
+
+    pthread_mutex_unlock(&map->lock);
+
+    return data;
+}
+
+/**
+ * @brief Remove the given pid from the map
+ * @param map  pid map
+ * @param pid  pid to remove
+ * @param data remove only if associated with this data (NULL for any)
+ * @return true if the pid was removed, false otherwise
+ */
+bool
+pidmap_remove(pidmap_t *map, pid_t pid, void *data)
+{
+    bool removed = false;
+
+    if (pid < 1)
+        return false;
+
+    pthread_mutex_lock(&map->lock);
+
+    pidmap_entry_t *entry = find_slot(map, pid);
+
+    if (entry && (data == NULL || entry->data == data))
+    {
+        entry->pid = PIDMAP_TOMBSTONE;
+        entry->data = NULL;
+
+        map->count--;
+        removed = true;
+    }
+
+    pthread_mutex_unlock(&map->lock);
+
+    return removed;
+}
+
+uint32_t
+pidmap_count(pidmap_t *map)
+{
+    pthread_mutex_lock(&map->lock);
+    uint32_t count = map->count;
+    pthread_mutex_unlock(&map->lock);
+
+    return count;
+}
+
+/**
+ * @brief Copy the indexed pids into the given array
+ * @param map  pid map
+ * @param pids array to fill
+ * @param max  capacity of the array
+ * @return total number of indexed pids (may exceed max)
+ */
+uint32_t
+pidmap_pids(pidmap_t *map, pid_t *pids, uint32_t max)
+{
+    uint32_t idx = 0;
+
+    pthread_mutex_lock(&map->lock);
+
+    for (uint32_t i = 0; i < map->size; i++)
+    {
+        if (map->entries[i].pid < 1)
+            continue;
+
+        if (idx < max)
+            pids[idx] = map->entries[i].pid;
+
+        idx++;
+    }
+
+    pthread_mutex_unlock(&map->lock);
+
+    return idx;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,64 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct
+{
+    pid_t pid;
+    void *data;
+} pidmap_entry_t;
+
+/**
+ * Open-addressing (linear probing) index of pids. Lookups of unknown
+ * pids end on the first empty slot which is usually the very first
+ * probe as the table is kept at most half full.
+ */
+typedef struct
+{
+    uint32_t count;
+    uint32_t used;
+    uint32_t size;
+    pidmap_entry_t *entries;
+    pthread_mutex_t lock;
+} pidmap_t;
+
+pidmap_t *
+pidmap_new(void);
+
+void
+pidmap_destroy(pidmap_t *map);
+
+bool
+pidmap_add(pidmap_t *map, pid_t pid, void *data);
+
+void *
+pidmap_get(pidmap_t *map, pid_t pid);
+
+bool
+pidmap_remove(pidmap_t *map, pid_t pid, void *data);
+
+uint32_t
+pidmap_count(pidmap_t *map);
+
+uint32_t
+pidmap_pids(pidmap_t *map, pid_t *pids, uint32_t max);
+
+/* vim: set et sw=4 sts=4 tw=80: */
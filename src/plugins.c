@@ -13,14 +13,24 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_PLUGINS
+
+#include "check.h"
 #include "def.h"
 #include "log.h"
 #include "plugins.h"
+#include "stats.h"
+#include "utils.h"
 
 #include <dirent.h>
 #include <dlfcn.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 static const char *
 get_plugin(const char *name)
@@ -54,7 +64,7 @@ init_plugin(const char *path, const char *name, plugin_manager_t *manager)
     /* try to acquire dynamic handle */
     void *handle = dlopen(fullpath, RTLD_NOW);
 
-    free(fullpath);
+    xfree(fullpath);
 
     if (!handle)
     {
@@ -104,12 +114,395 @@ plugin_destroy(void *obj)
     if (plugin == NULL)
         return;
 
-    free((void *)plugin->name);
+    xfree((void *)plugin->name);
 
     if (plugin->handle)
         dlclose(plugin->handle);
 
-    free(plugin);
+    xfree(plugin);
+}
+
+static void
+plugin_state_callback_destroy(void *obj)
+{
+    plugin_state_callback_info_t *info = obj;
+
+    while (info->count > 0)
+    {
+        xfree(info->events[info->head].name);
+
+        info->head = (info->head + 1) % NYX_PLUGIN_QUEUE;
+        info->count--;
+    }
+
+    xfree(info);
+}
+
+static void
+plugin_digest_clear(plugin_digest_t *digest)
+{
+    for (uint32_t i = 0; i < digest->count; i++)
+    {
+        xfree((void *)digest->entries[i]->name);
+        xfree(digest->entries[i]);
+    }
+
+    xfree(digest->entries);
+}
+
+static void
+plugin_digest_callback_destroy(void *obj)
+{
+    plugin_digest_callback_info_t *info = obj;
+
+    plugin_digest_clear(&info->digest);
+    hash_destroy(info->index);
+
+    xfree(info);
+}
+
+static void
+plugin_check_callback_destroy(void *obj)
+{
+    plugin_check_callback_info_t *info = obj;
+
+    xfree((void *)info->name);
+    xfree(info);
+}
+
+static void
+plugin_metrics_clear(plugin_metrics_t *metrics)
+{
+    for (uint32_t i = 0; i < metrics->count; i++)
+        xfree((void *)metrics->samples[i].name);
+
+    xfree(metrics->samples);
+}
+
+/**
+ * @brief Pass the latest complete sweep to the metrics sinks
+ * @param manager plugin manager (locked)
+ * @return true if the metrics sinks were invoked
+ */
+static bool
+dispatch_metrics(plugin_manager_t *manager)
+{
+    plugin_metrics_t *metrics = manager->ready;
+
+    if (metrics == NULL)
+        return false;
+
+    manager->ready = NULL;
+
+    pthread_mutex_unlock(&manager->lock);
+
+    list_node_t *node = manager->metrics_sinks->head;
+
+    while (node)
+    {
+        plugin_metrics_callback_info_t *info = node->data;
+
+        info->metrics_callback(metrics, info->metrics_data);
+
+        node = node->next;
+    }
+
+    plugin_metrics_clear(metrics);
+    xfree(metrics);
+
+    pthread_mutex_lock(&manager->lock);
+
+    return true;
+}
+
+/**
+ * @brief Invoke the digest callbacks whose window elapsed (or all of them
+ *        with pending state changes on shutdown)
+ * @param manager plugin manager (locked)
+ * @param nearest end of the nearest pending window (0 if there is none)
+ * @return true if any digest callback was invoked
+ */
+static bool
+dispatch_digests(plugin_manager_t *manager, uint64_t *nearest)
+{
+    bool dispatched = false;
+    uint64_t now = stats_now();
+    list_node_t *node = manager->digest_callbacks->head;
+
+    *nearest = 0;
+
+    while (node)
+    {
+        plugin_digest_callback_info_t *info = node->data;
+
+        node = node->next;
+
+        if (info->digest.count < 1)
+            continue;
+
+        if (info->deadline > now && !manager->stopping)
+        {
+            if (!*nearest || info->deadline < *nearest)
+                *nearest = info->deadline;
+            continue;
+        }
+
+        plugin_digest_t digest = info->digest;
+
+        memset(&info->digest, 0, sizeof(plugin_digest_t));
+        info->size = 0;
+
+        hash_destroy(info->index);
+        info->index = hash_new(NULL);
+
+        pthread_mutex_unlock(&manager->lock);
+
+        info->digest_callback(&digest, info->digest_data);
+        stats_record_since(STATS_PLUGIN_CALLBACK, info->deadline -
+                info->window * UINT64_C(1000000));
+
+        plugin_digest_clear(&digest);
+
+        pthread_mutex_lock(&manager->lock);
+
+        dispatched = true;
+    }
+
+    return dispatched;
+}
+
+/**
+ * @brief Dispatch thread invoking the state callbacks with their queued
+ *        state changes
+ *
+ * The callbacks are served round-robin so a slow plugin delays the other
+ * plugins but never the state threads. The digest callbacks are invoked at
+ * the end of their windows. The queued state changes and pending digests are
+ * delivered before the thread exits on shutdown.
+ */
+static void *
+plugin_dispatch_thread(void *arg)
+{
+    plugin_manager_t *manager = arg;
+
+    pthread_mutex_lock(&manager->lock);
+
+    while (true)
+    {
+        bool dispatched = false;
+        list_node_t *node = manager->state_callbacks->head;
+
+        while (node)
+        {
+            plugin_state_callback_info_t *info = node->data;
+
+            node = node->next;
+
+            if (info->count < 1)
+                continue;
+
+            plugin_event_t event = info->events[info->head];
+
+            info->events[info->head].name = NULL;
+            info->head = (info->head + 1) % NYX_PLUGIN_QUEUE;
+            info->count--;
+
+            pthread_mutex_unlock(&manager->lock);
+
+            info->state_callback(event.name, event.state, event.pid, info->state_data);
+            stats_record_since(STATS_PLUGIN_CALLBACK, event.queued);
+
+            xfree(event.name);
+
+            pthread_mutex_lock(&manager->lock);
+
+            dispatched = true;
+        }
+
+        uint64_t nearest = 0;
+
+        if (dispatch_digests(manager, &nearest))
+            dispatched = true;
+
+        if (dispatch_metrics(manager))
+            dispatched = true;
+
+        if (dispatched)
+            continue;
+
+        if (manager->stopping)
+            break;
+
+        if (nearest)
+        {
+            uint64_t now = stats_now();
+            uint64_t wait = nearest > now ? nearest - now : 0;
+            struct timespec until;
+
+            clock_gettime(CLOCK_REALTIME, &until);
+
+            until.tv_sec += wait / 1000000;
+            until.tv_nsec += (wait % 1000000) * 1000;
+
+            if (until.tv_nsec >= 1000000000)
+            {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+
+            pthread_cond_timedwait(&manager->cond, &manager->lock, &until);
+        }
+        else
+            pthread_cond_wait(&manager->cond, &manager->lock);
+    }
+
+    pthread_mutex_unlock(&manager->lock);
+
+    return NULL;
+}
+
+static void
+plugin_dispatch_start(plugin_manager_t *manager)
+{
+    if (list_size(manager->state_callbacks) < 1 &&
+            list_size(manager->digest_callbacks) < 1 &&
+            list_size(manager->metrics_sinks) < 1)
+        return;
+
+    int32_t err = thread_create(&manager->dispatcher, plugin_dispatch_thread, manager);
+
+    if (err)
+    {
+        errno = err;
+        log_perror("nyx: pthread_create");
+        log_warn("Plugin state callbacks are invoked on the state threads");
+        return;
+    }
+
+    manager->dispatching = true;
+}
+
+static void
+plugin_dispatch_stop(plugin_manager_t *manager)
+{
+    if (!manager->dispatching)
+        return;
+
+    log_debug("Waiting for the plugin dispatch thread to finish");
+
+    pthread_mutex_lock(&manager->lock);
+    manager->stopping = true;
+    pthread_cond_signal(&manager->cond);
+    pthread_mutex_unlock(&manager->lock);
+
+    pthread_join(manager->dispatcher, NULL);
+
+    manager->dispatching = false;
+}
+
+/**
+ * @brief Plugin check thread running the queued checks one after another
+ *
+ * Checks whose deadline passed while they were queued are failed without
+ * being run - their result would be ignored anyways. On shutdown the
+ * remaining checks are failed as well.
+ */
+static void *
+plugin_check_thread(void *arg)
+{
+    plugin_manager_t *manager = arg;
+
+    pthread_mutex_lock(&manager->lock);
+
+    while (true)
+    {
+        if (manager->jobs == NULL)
+        {
+            if (manager->stopping)
+                break;
+
+            pthread_cond_wait(&manager->check_cond, &manager->lock);
+            continue;
+        }
+
+        plugin_check_job_t *job = manager->jobs;
+
+        manager->jobs = job->next;
+        if (manager->jobs == NULL)
+            manager->last_job = NULL;
+        manager->num_jobs--;
+
+        bool stopping = manager->stopping;
+
+        pthread_mutex_unlock(&manager->lock);
+
+        bool success = false;
+        uint64_t now = stats_now();
+
+        if (!stopping && now < job->deadline)
+        {
+            plugin_check_callback_info_t *info = job->check;
+            uint32_t remaining = (job->deadline - now) / 1000;
+
+            success = info->check_callback(job->watch, job->pid, job->argument,
+                    MAX(remaining, 1), info->check_data);
+        }
+
+        check_async_complete(job->result_fd, success);
+
+        xfree(job->watch);
+        xfree(job->argument);
+        xfree(job);
+
+        pthread_mutex_lock(&manager->lock);
+    }
+
+    pthread_mutex_unlock(&manager->lock);
+
+    return NULL;
+}
+
+static void
+plugin_checks_start(plugin_manager_t *manager)
+{
+    if (list_size(manager->check_callbacks) < 1)
+        return;
+
+    for (uint32_t i = 0; i < NYX_PLUGIN_CHECK_THREADS; i++)
+    {
+        int32_t err = thread_create(&manager->checkers[i], plugin_check_thread, manager);
+
+        if (err)
+        {
+            errno = err;
+            log_perror("nyx: pthread_create");
+            break;
+        }
+
+        manager->num_checkers++;
+    }
+
+    if (manager->num_checkers < 1)
+        log_warn("Failed to start the plugin check threads - plugin checks will fail");
+}
+
+static void
+plugin_checks_stop(plugin_manager_t *manager)
+{
+    if (manager->num_checkers < 1)
+        return;
+
+    log_debug("Waiting for the plugin check threads to finish");
+
+    pthread_mutex_lock(&manager->lock);
+    manager->stopping = true;
+    pthread_cond_broadcast(&manager->check_cond);
+    pthread_mutex_unlock(&manager->lock);
+
+    for (uint32_t i = 0; i < manager->num_checkers; i++)
+        pthread_join(manager->checkers[i], NULL);
+
+    manager->num_checkers = 0;
 }
 
 static void
@@ -118,12 +511,41 @@ plugin_manager_destroy(plugin_manager_t *manager)
     if (manager == NULL)
         return;
 
+    plugin_checks_stop(manager);
+    plugin_dispatch_stop(manager);
+
+    plugin_metrics_clear(&manager->metrics);
+
+    if (manager->ready)
+    {
+        plugin_metrics_clear(manager->ready);
+        xfree(manager->ready);
+    }
+
+    if (manager->check_callbacks)
+    {
+        list_destroy(manager->check_callbacks);
+        manager->check_callbacks = NULL;
+    }
+
+    if (manager->metrics_sinks)
+    {
+        list_destroy(manager->metrics_sinks);
+        manager->metrics_sinks = NULL;
+    }
+
     if (manager->state_callbacks)
     {
         list_destroy(manager->state_callbacks);
         manager->state_callbacks = NULL;
     }
 
+    if (manager->digest_callbacks)
+    {
+        list_destroy(manager->digest_callbacks);
+        manager->digest_callbacks = NULL;
+    }
+
     if (manager->destroy_callbacks)
     {
         list_node_t *node = manager->destroy_callbacks->head;
@@ -141,7 +563,11 @@ plugin_manager_destroy(plugin_manager_t *manager)
         manager->destroy_callbacks = NULL;
     }
 
-    free(manager);
+    pthread_cond_destroy(&manager->check_cond);
+    pthread_cond_destroy(&manager->cond);
+    pthread_mutex_destroy(&manager->lock);
+
+    xfree(manager);
 }
 
 static plugin_repository_t *
@@ -154,8 +580,15 @@ plugin_repository_new(hash_t *config)
     repo->manager = xcalloc1(sizeof(plugin_manager_t));
     repo->manager->version = NYX_VERSION;
     repo->manager->config = config;
-    repo->manager->state_callbacks = list_new(free);
-    repo->manager->destroy_callbacks = list_new(free);
+    repo->manager->state_callbacks = list_new(plugin_state_callback_destroy);
+    repo->manager->destroy_callbacks = list_new(xfree_data);
+    repo->manager->digest_callbacks = list_new(plugin_digest_callback_destroy);
+    repo->manager->check_callbacks = list_new(plugin_check_callback_destroy);
+    repo->manager->metrics_sinks = list_new(xfree_data);
+
+    pthread_mutex_init(&repo->manager->lock, NULL);
+    pthread_cond_init(&repo->manager->cond, NULL);
+    pthread_cond_init(&repo->manager->check_cond, NULL);
 
     return repo;
 }
@@ -169,13 +602,31 @@ plugin_repository_destroy(plugin_repository_t *repository)
     plugin_manager_destroy(repository->manager);
     list_destroy(repository->plugins);
 
-    free(repository);
+    xfree(repository);
 }
 
+/**
+ * @brief Register a state callback whose state changes are dropped if its
+ *        queue is full
+ */
 void
 plugin_register_state_callback(plugin_manager_t *manager,
         plugin_state_callback callback,
         void *userdata)
+{
+    plugin_register_state_callback_overflow(manager, callback, userdata,
+            PLUGIN_OVERFLOW_DROP);
+}
+
+/**
+ * @brief Register a state callback with the given overflow policy of its
+ *        queue of state changes
+ */
+void
+plugin_register_state_callback_overflow(plugin_manager_t *manager,
+        plugin_state_callback callback,
+        void *userdata,
+        plugin_overflow_e overflow)
 {
     if (manager == NULL || callback == NULL)
         return;
@@ -187,10 +638,43 @@ plugin_register_state_callback(plugin_manager_t *manager,
 
     info->state_callback = callback;
     info->state_data = userdata;
+    info->overflow = overflow;
 
     list_add(manager->state_callbacks, info);
 }
 
+/**
+ * @brief Register a callback that is passed the state changes of a window of
+ *        the given length coalesced per watch
+ *
+ * The window starts with the first state change after the previous digest.
+ * Every watch appears once in the digest with its final state so plugins may
+ * send one notification instead of one per state change.
+ *
+ * @param window length of the window in seconds
+ */
+void
+plugin_register_digest_callback(plugin_manager_t *manager,
+        plugin_digest_callback callback,
+        void *userdata,
+        uint32_t window)
+{
+    if (manager == NULL || callback == NULL)
+        return;
+
+    if (manager->digest_callbacks == NULL)
+        return;
+
+    plugin_digest_callback_info_t *info = xcalloc1(sizeof(plugin_digest_callback_info_t));
+
+    info->digest_callback = callback;
+    info->digest_data = userdata;
+    info->window = window;
+    info->index = hash_new(NULL);
+
+    list_add(manager->digest_callbacks, info);
+}
+
 void
 plugin_register_destroy_callback(plugin_manager_t *manager,
         plugin_destroy_callback callback,
@@ -210,22 +694,388 @@ plugin_register_destroy_callback(plugin_manager_t *manager,
     list_add(manager->destroy_callbacks, info);
 }
 
+/**
+ * @brief Register a health check that watches refer to by the given name
+ *        via 'plugin_check'
+ *
+ * The check is run on the check schedule of every watch that refers to it.
+ * The callback is invoked on one of the plugin check threads (possibly
+ * concurrently) and has to return within the passed deadline - a check that
+ * does not return in time is considered failed.
+ */
+void
+plugin_register_check(plugin_manager_t *manager,
+        const char *name,
+        plugin_check_callback callback,
+        void *userdata)
+{
+    if (manager == NULL || name == NULL || callback == NULL)
+        return;
+
+    if (manager->check_callbacks == NULL)
+        return;
+
+    plugin_check_callback_info_t *info = xcalloc1(sizeof(plugin_check_callback_info_t));
+
+    info->name = xstrdup(name);
+    info->check_callback = callback;
+    info->check_data = userdata;
+
+    list_add(manager->check_callbacks, info);
+}
+
+/**
+ * @brief Register a sink that is passed the samples of all processes of
+ *        every proc sweep at once
+ *
+ * The metrics are passed read-only on the plugin dispatch thread. If the
+ * sink does not keep up with the sweeps only the latest one is delivered.
+ */
+void
+plugin_register_metrics_sink(plugin_manager_t *manager,
+        plugin_metrics_callback callback,
+        void *userdata)
+{
+    if (manager == NULL || callback == NULL)
+        return;
+
+    if (manager->metrics_sinks == NULL)
+        return;
+
+    plugin_metrics_callback_info_t *info = xcalloc1(sizeof(plugin_metrics_callback_info_t));
+
+    info->metrics_callback = callback;
+    info->metrics_data = userdata;
+
+    list_add(manager->metrics_sinks, info);
+}
+
+static void
+enqueue_state_change(plugin_state_callback_info_t *info, const char *name,
+        pid_t pid, int32_t new_state, uint64_t now)
+{
+    plugin_event_t *event = NULL;
+
+    if (info->count < NYX_PLUGIN_QUEUE)
+    {
+        event = &info->events[(info->head + info->count) % NYX_PLUGIN_QUEUE];
+        info->count++;
+    }
+    else
+    {
+        info->dropped++;
+        stats_count(STATS_PLUGIN_DROPPED, 1);
+
+        if (info->overflow == PLUGIN_OVERFLOW_DROP)
+            return;
+
+        /* replace the latest queued state change of the same watch */
+        for (uint32_t i = info->count; i > 0; i--)
+        {
+            plugin_event_t *queued =
+                &info->events[(info->head + i - 1) % NYX_PLUGIN_QUEUE];
+
+            if (!strcmp(queued->name, name))
+            {
+                queued->state = new_state;
+                queued->pid = pid;
+                return;
+            }
+        }
+
+        /* otherwise the oldest state change makes room */
+        xfree(info->events[info->head].name);
+
+        info->head = (info->head + 1) % NYX_PLUGIN_QUEUE;
+        event = &info->events[(info->head + info->count - 1) % NYX_PLUGIN_QUEUE];
+    }
+
+    event->name = xstrdup(name);
+    event->state = new_state;
+    event->pid = pid;
+    event->queued = now;
+}
+
+static void
+digest_state_change(plugin_digest_callback_info_t *info, const char *name,
+        pid_t pid, int32_t new_state, uint64_t now)
+{
+    plugin_digest_t *digest = &info->digest;
+    plugin_digest_entry_t *entry = hash_get(info->index, name);
+
+    if (entry == NULL)
+    {
+        if (digest->count < 1)
+        {
+            info->deadline = now + info->window * UINT64_C(1000000);
+            digest->started = time(NULL);
+        }
+
+        if (digest->count >= info->size)
+        {
+            uint32_t size = info->size ? info->size * 2 : 16;
+            digest->entries = xrealloc(digest->entries,
+                    size * sizeof(plugin_digest_entry_t *));
+            info->size = size;
+        }
+
+        entry = xcalloc1(sizeof(plugin_digest_entry_t));
+        entry->name = xstrdup(name);
+        entry->first_state = new_state;
+
+        digest->entries[digest->count++] = entry;
+        hash_add(info->index, name, entry);
+    }
+
+    entry->state = new_state;
+    entry->pid = pid;
+    entry->changes++;
+
+    digest->changes++;
+}
+
+/**
+ * @brief Pass a state change to the state callbacks of the plugins
+ *
+ * The state change is queued for the plugin dispatch thread so slow plugins
+ * (i.e. talking to a remote server) do not delay the calling state thread.
+ */
 void
 notify_state_change(plugin_repository_t *repo, const char *name, pid_t pid, int32_t new_state)
 {
     if (!repo || !repo->manager || !repo->manager->state_callbacks)
         return;
 
-    list_node_t *node = repo->manager->state_callbacks->head;
+    plugin_manager_t *manager = repo->manager;
+    list_node_t *node = manager->state_callbacks->head;
+
+    if (!manager->dispatching)
+    {
+        while (node)
+        {
+            plugin_state_callback_info_t *info = node->data;
+
+            info->state_callback(name, new_state, pid, info->state_data);
+
+            node = node->next;
+        }
+
+        /* without dispatch thread every state change is a digest of its own */
+        plugin_digest_entry_t entry = { name, new_state, new_state, pid, 1 };
+        plugin_digest_entry_t *entries[] = { &entry };
+        plugin_digest_t digest = { entries, 1, 1, time(NULL) };
+
+        node = manager->digest_callbacks->head;
+
+        while (node)
+        {
+            plugin_digest_callback_info_t *info = node->data;
+
+            info->digest_callback(&digest, info->digest_data);
+
+            node = node->next;
+        }
+
+        return;
+    }
+
+    uint64_t now = stats_now();
+
+    pthread_mutex_lock(&manager->lock);
 
     while (node)
     {
-        plugin_state_callback_info_t *info = node->data;
+        enqueue_state_change(node->data, name, pid, new_state, now);
+        node = node->next;
+    }
 
-        info->state_callback(name, new_state, pid, info->state_data);
+    node = manager->digest_callbacks->head;
 
+    while (node)
+    {
+        digest_state_change(node->data, name, pid, new_state, now);
         node = node->next;
     }
+
+    pthread_cond_signal(&manager->cond);
+    pthread_mutex_unlock(&manager->lock);
+}
+
+/**
+ * @brief Queue the plugin check of the given name for one of the plugin check
+ *        threads that reports its result on the given descriptor
+ * @param repo      plugin repository
+ * @param check     name of the registered check
+ * @param watch     name of the checked watch
+ * @param pid       PID of the checked process
+ * @param argument  argument of the check (may be NULL)
+ * @param timeout   deadline of the check in milliseconds
+ * @param result_fd descriptor of 'check_async_start' the result is reported
+ *                  on - it is owned by the repository on success only
+ * @return true if the check was queued
+ */
+bool
+plugin_check_run(plugin_repository_t *repo, const char *check, const char *watch,
+        pid_t pid, const char *argument, uint32_t timeout, int32_t result_fd)
+{
+    if (!repo || !repo->manager || !repo->manager->check_callbacks)
+        return false;
+
+    plugin_manager_t *manager = repo->manager;
+    plugin_check_callback_info_t *info = NULL;
+    list_node_t *node = manager->check_callbacks->head;
+
+    while (node)
+    {
+        plugin_check_callback_info_t *callback = node->data;
+
+        if (!strcmp(callback->name, check))
+        {
+            info = callback;
+            break;
+        }
+
+        node = node->next;
+    }
+
+    if (info == NULL)
+    {
+        log_debug("No plugin registered the check '%s'", check);
+        return false;
+    }
+
+    if (manager->num_checkers < 1)
+        return false;
+
+    pthread_mutex_lock(&manager->lock);
+
+    if (manager->num_jobs >= NYX_PLUGIN_CHECK_QUEUE)
+    {
+        pthread_mutex_unlock(&manager->lock);
+
+        log_warn("Plugin check queue is full - failing check '%s' of '%s'", check, watch);
+        return false;
+    }
+
+    plugin_check_job_t *job = xcalloc1(sizeof(plugin_check_job_t));
+
+    job->check = info;
+    job->watch = xstrdup(watch);
+    job->pid = pid;
+    job->argument = argument ? xstrdup(argument) : NULL;
+    job->deadline = stats_now() + timeout * UINT64_C(1000);
+    job->result_fd = result_fd;
+
+    if (manager->last_job)
+        manager->last_job->next = job;
+    else
+        manager->jobs = job;
+
+    manager->last_job = job;
+    manager->num_jobs++;
+
+    pthread_cond_signal(&manager->check_cond);
+    pthread_mutex_unlock(&manager->lock);
+
+    return true;
+}
+
+/**
+ * @brief Whether any plugin registered a metrics sink
+ */
+bool
+plugin_metrics_enabled(plugin_repository_t *repo)
+{
+    return repo && repo->manager && list_size(repo->manager->metrics_sinks) > 0;
+}
+
+/**
+ * @brief Add the sample of a process to the metrics of the current sweep
+ *
+ * The samples are collected on the main loop (that evaluates the samples of
+ * the proc threads as well) so no locking is involved.
+ */
+void
+plugin_metrics_add(plugin_repository_t *repo, const char *name, pid_t pid,
+        double cpu, uint64_t memory)
+{
+    if (!plugin_metrics_enabled(repo))
+        return;
+
+    plugin_metrics_t *metrics = &repo->manager->metrics;
+
+    if (metrics->count >= repo->manager->metrics_size)
+    {
+        uint32_t size = repo->manager->metrics_size ? repo->manager->metrics_size * 2 : 64;
+
+        metrics->samples = xrealloc(metrics->samples, size * sizeof(plugin_sample_t));
+        repo->manager->metrics_size = size;
+    }
+
+    if (metrics->count < 1)
+        metrics->timestamp = time(NULL);
+
+    plugin_sample_t *sample = &metrics->samples[metrics->count++];
+
+    sample->name = xstrdup(name);
+    sample->pid = pid;
+    sample->cpu = cpu;
+    sample->memory = memory;
+}
+
+/**
+ * @brief Pass the metrics of the completed sweep to the metrics sinks
+ *
+ * The metrics are handed to the plugin dispatch thread. A previous sweep that
+ * was not delivered yet is replaced so slow sinks skip sweeps instead of
+ * piling them up.
+ */
+void
+plugin_metrics_flush(plugin_repository_t *repo)
+{
+    if (!plugin_metrics_enabled(repo) || repo->manager->metrics.count < 1)
+        return;
+
+    plugin_manager_t *manager = repo->manager;
+    plugin_metrics_t *metrics = xcalloc1(sizeof(plugin_metrics_t));
+
+    *metrics = manager->metrics;
+
+    memset(&manager->metrics, 0, sizeof(plugin_metrics_t));
+    manager->metrics_size = 0;
+
+    if (!manager->dispatching)
+    {
+        list_node_t *node = manager->metrics_sinks->head;
+
+        while (node)
+        {
+            plugin_metrics_callback_info_t *info = node->data;
+
+            info->metrics_callback(metrics, info->metrics_data);
+
+            node = node->next;
+        }
+
+        plugin_metrics_clear(metrics);
+        xfree(metrics);
+        return;
+    }
+
+    pthread_mutex_lock(&manager->lock);
+
+    if (manager->ready)
+    {
+        plugin_metrics_clear(manager->ready);
+        xfree(manager->ready);
+
+        stats_count(STATS_PLUGIN_DROPPED, 1);
+    }
+
+    manager->ready = metrics;
+
+    pthread_cond_signal(&manager->cond);
+    pthread_mutex_unlock(&manager->lock);
 }
 
 plugin_repository_t *
@@ -258,7 +1108,7 @@ discover_plugins(const char *directory, hash_t *config)
             if (plugin == NULL)
             {
                 log_warn("Failed to load plugin '%s'", plugin_name);
-                free((void *)plugin_name);
+                xfree((void *)plugin_name);
             }
             else
             {
@@ -276,6 +1126,11 @@ discover_plugins(const char *directory, hash_t *config)
             plugin_repository_destroy(repo);
             repo = NULL;
         }
+        else
+        {
+            plugin_dispatch_start(repo->manager);
+            plugin_checks_start(repo->manager);
+        }
     }
 
     return repo;
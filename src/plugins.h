@@ -18,17 +18,54 @@
 #include "hash.h"
 #include "list.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
 
 #define NYX_PLUGIN_INIT_FUNC "plugin_init"
 
+/* maximum number of state changes queued per state callback */
+#define NYX_PLUGIN_QUEUE 256
+
+/* number of threads running the plugin checks */
+#define NYX_PLUGIN_CHECK_THREADS 2
+
+/* maximum number of queued plugin checks */
+#define NYX_PLUGIN_CHECK_QUEUE 1024
+
+/* default deadline of a plugin check (in seconds) */
+#define NYX_PLUGIN_CHECK_TIMEOUT 5
+
 typedef struct
 {
     const char *name;
     void *handle;
 } plugin_t;
 
+/** statistics sample of one watched process */
+typedef struct
+{
+    const char *name;
+    pid_t pid;
+    /** CPU usage in percent */
+    double cpu;
+    /** resident memory in kB */
+    uint64_t memory;
+} plugin_sample_t;
+
+/** samples of all processes that were sampled in one proc sweep */
+typedef struct
+{
+    plugin_sample_t *samples;
+    uint32_t count;
+    /** wall clock time of the sweep */
+    time_t timestamp;
+} plugin_metrics_t;
+
+typedef struct plugin_check_job_t plugin_check_job_t;
+
 typedef struct
 {
     const char *version;
@@ -36,6 +73,31 @@ typedef struct
 
     list_t *state_callbacks;
     list_t *destroy_callbacks;
+    list_t *digest_callbacks;
+    list_t *check_callbacks;
+    list_t *metrics_sinks;
+
+    /* the state callbacks are invoked on a dedicated dispatch thread */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t dispatcher;
+    bool dispatching;
+    bool stopping;
+
+    /* metrics of the sweep that is sampled and the latest complete sweep
+     * that was not passed to the metrics sinks yet */
+    plugin_metrics_t metrics;
+    uint32_t metrics_size;
+    plugin_metrics_t *ready;
+
+    /* the checks are run on their own threads so a slow check does not
+     * delay the state callbacks */
+    pthread_cond_t check_cond;
+    pthread_t checkers[NYX_PLUGIN_CHECK_THREADS];
+    uint32_t num_checkers;
+    plugin_check_job_t *jobs;
+    plugin_check_job_t *last_job;
+    uint32_t num_jobs;
 } plugin_manager_t;
 
 typedef struct
@@ -48,18 +110,126 @@ typedef void (*plugin_state_callback)(const char *, int32_t, pid_t, void *);
 
 typedef void (*plugin_destroy_callback)(void *);
 
+/**
+ * Check of a watch's process that is passed the watch name, the PID, the
+ * configured argument and the deadline (in milliseconds) and returns whether
+ * the process is healthy. Checks are invoked concurrently on the plugin check
+ * threads and may block up to their deadline.
+ */
+typedef bool (*plugin_check_callback)(const char *, pid_t, const char *, uint32_t, void *);
+
+/** sink of the process samples of every proc sweep */
+typedef void (*plugin_metrics_callback)(const plugin_metrics_t *, void *);
+
+/** state changes of one watch within a digest window */
+typedef struct
+{
+    const char *name;
+    /** state of the first state change in the window */
+    int32_t first_state;
+    /** final state and PID of the watch */
+    int32_t state;
+    pid_t pid;
+    uint32_t changes;
+} plugin_digest_entry_t;
+
+/**
+ * State changes of a digest window coalesced per watch - the entries are
+ * ordered by the first state change of their watch
+ */
+typedef struct
+{
+    plugin_digest_entry_t **entries;
+    uint32_t count;
+    uint32_t changes;
+    /** wall clock time of the first state change in the window */
+    time_t started;
+} plugin_digest_t;
+
+typedef void (*plugin_digest_callback)(const plugin_digest_t *, void *);
+
+/**
+ * What happens to a state change that does not fit into the full queue of a
+ * state callback
+ */
+typedef enum
+{
+    /** the new state change is dropped */
+    PLUGIN_OVERFLOW_DROP,
+    /** the new state change replaces a queued one of the same watch or the
+     * oldest queued state change */
+    PLUGIN_OVERFLOW_COALESCE
+} plugin_overflow_e;
+
+typedef struct
+{
+    char *name;
+    int32_t state;
+    pid_t pid;
+    uint64_t queued;
+} plugin_event_t;
+
 typedef struct
 {
     void * state_data;
     plugin_state_callback state_callback;
+    plugin_overflow_e overflow;
+
+    /* ring buffer of the state changes that were not dispatched yet */
+    plugin_event_t events[NYX_PLUGIN_QUEUE];
+    uint32_t head;
+    uint32_t count;
+    /** state changes that were dropped because the callback did not keep up */
+    uint64_t dropped;
 } plugin_state_callback_info_t;
 
+typedef struct
+{
+    void * digest_data;
+    plugin_digest_callback digest_callback;
+    /** length of the digest window in seconds */
+    uint32_t window;
+
+    /* pending digest and its index by watch name */
+    plugin_digest_t digest;
+    uint32_t size;
+    hash_t *index;
+    /** end of the window (stats_now) */
+    uint64_t deadline;
+} plugin_digest_callback_info_t;
+
 typedef struct
 {
     void * destroy_data;
     plugin_destroy_callback destroy_callback;
 } plugin_destroy_callback_info_t;
 
+typedef struct
+{
+    const char *name;
+    void * check_data;
+    plugin_check_callback check_callback;
+} plugin_check_callback_info_t;
+
+typedef struct
+{
+    void * metrics_data;
+    plugin_metrics_callback metrics_callback;
+} plugin_metrics_callback_info_t;
+
+struct plugin_check_job_t
+{
+    plugin_check_callback_info_t *check;
+    char *watch;
+    pid_t pid;
+    char *argument;
+    /** end of the check's deadline (stats_now) */
+    uint64_t deadline;
+    /** descriptor the result is reported on */
+    int32_t result_fd;
+    plugin_check_job_t *next;
+};
+
 typedef bool (*plugin_init_func)(plugin_manager_t *manager);
 
 plugin_repository_t *
@@ -70,15 +240,52 @@ plugin_register_state_callback(plugin_manager_t *manager,
         plugin_state_callback callback,
         void *userdata);
 
+void
+plugin_register_state_callback_overflow(plugin_manager_t *manager,
+        plugin_state_callback callback,
+        void *userdata,
+        plugin_overflow_e overflow);
+
+void
+plugin_register_digest_callback(plugin_manager_t *manager,
+        plugin_digest_callback callback,
+        void *userdata,
+        uint32_t window);
+
 void
 plugin_register_destroy_callback(plugin_manager_t *manager,
         plugin_destroy_callback callback,
         void *userdata);
 
+void
+plugin_register_check(plugin_manager_t *manager,
+        const char *name,
+        plugin_check_callback callback,
+        void *userdata);
+
+void
+plugin_register_metrics_sink(plugin_manager_t *manager,
+        plugin_metrics_callback callback,
+        void *userdata);
+
 void
 plugin_repository_destroy(plugin_repository_t *repository);
 
 void
 notify_state_change(plugin_repository_t *repo, const char *name, pid_t pid, int32_t new_state);
 
+bool
+plugin_check_run(plugin_repository_t *repo, const char *check, const char *watch,
+        pid_t pid, const char *argument, uint32_t timeout, int32_t result_fd);
+
+bool
+plugin_metrics_enabled(plugin_repository_t *repo);
+
+void
+plugin_metrics_add(plugin_repository_t *repo, const char *name, pid_t pid,
+        double cpu, uint64_t memory);
+
+void
+plugin_metrics_flush(plugin_repository_t *repo);
+
 /* vim: set et sw=4 sts=4 tw=80: */
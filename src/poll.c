@@ -13,82 +13,255 @@
  * limitations under the License.
  */
 
+#define NYX_LOG_CATEGORY NYX_LOG_EVENT
+#define NYX_MEM_TAG MEM_PROC
+
 #include "def.h"
 #include "log.h"
+#include "pidmap.h"
 #include "poll.h"
 #include "process.h"
+#include "reactor.h"
 #include "state.h"
 #include "utils.h"
 
-#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/* number of polling intervals between two full sweeps over all watches
+ * as long as process exits are reported by pidfds (or kqueue) */
+#define NYX_POLL_SWEEP_INTERVALS 10
 
-static volatile bool need_exit = false;
+/* state of the polling manager running on the nyx reactor */
+typedef struct
+{
+    nyx_t *nyx;
+    poll_handler_t handler;
+    /** pids whose exit is tracked by the reactor */
+    pidmap_t *tracked;
+    /** process exits are reported by the reactor */
+    bool track_exits;
+    int32_t sweep_timer;
+} poll_manager_t;
+
+/* pids are tracked from whatever thread modifies a watch's pid */
+static pthread_mutex_t poll_lock = PTHREAD_MUTEX_INITIALIZER;
+static poll_manager_t *manager = NULL;
 
 static void
-on_terminate(UNUSED int signum)
+handle_exit(UNUSED reactor_t *reactor, pid_t pid, void *data)
 {
-    log_debug("Caught termination signal - exiting polling manager loop");
-    need_exit = true;
+    poll_manager_t *m = data;
+
+    pthread_mutex_lock(&poll_lock);
+    pidmap_remove(m->tracked, pid, NULL);
+    pthread_mutex_unlock(&poll_lock);
+
+    log_debug("Poll: process with PID %d terminated", pid);
+
+    m->handler(pid, false, m->nyx);
 }
 
-bool
-poll_loop(nyx_t *nyx, poll_handler_t handler)
+/* processes that terminated before being tracked are dispatched on the
+ * reactor as the caller might hold the lock of the state in question */
+static void
+handle_terminated(reactor_t *reactor, void *data)
 {
-    uint32_t interval = MAX(nyx->options.polling_interval, 1);
+    pid_t pid = (pid_t)(intptr_t)data;
 
-    /* reset exit state in case this is a restart */
-    need_exit = false;
+    pthread_mutex_lock(&poll_lock);
+    poll_manager_t *m = manager;
+    pthread_mutex_unlock(&poll_lock);
 
-    setup_signals(nyx, on_terminate);
+    if (m)
+        handle_exit(reactor, pid, m);
+}
 
-    log_debug("Starting polling manager loop (interval: %u sec)", interval);
+static void
+sweep_states(nyx_t *nyx, poll_handler_t handler)
+{
+    list_node_t *node = nyx->states ? nyx->states->head : NULL;
 
-    while (!need_exit)
+    while (node)
     {
-        list_t *states = nyx->states;
+        state_t *state = node->data;
+        pid_t pid = state->pid;
 
-        if (!states)
+        if (pid < 1)
         {
-            wait_interval_fd(nyx->event, interval);
-            continue;
+            pid = determine_pid(state->name, nyx);
+            state_set_pid(state, pid);
         }
 
-        list_node_t *node = states->head;
+        if (pid > 0)
+        {
+            bool running = check_process_running(pid);
 
-        while (node)
+            log_debug("Poll: watch '%s' process with PID %d is %srunning",
+                    state->name, pid,
+                    (running ? "" : "not "));
+
+            handler(pid, running, nyx);
+        }
+        else
         {
-            state_t *state = node->data;
-            pid_t pid = state->pid;
-
-            if (pid < 1)
-            {
-                pid = determine_pid(state->watch->name, nyx);
-                state->pid = pid;
-            }
-
-            if (pid > 0)
-            {
-                bool running = check_process_running(pid);
-
-                log_debug("Poll: watch '%s' process with PID %d is %srunning",
-                        state->watch->name, pid,
-                        (running ? "" : "not "));
-
-                handler(pid, running, nyx);
-            }
-            else
-            {
-                log_debug("Poll: watch '%s' has no PID (yet)",
-                        state->watch->name);
-            }
-
-            node = node->next;
+            log_debug("Poll: watch '%s' has no PID (yet)",
+                    state->name);
         }
 
-        wait_interval_fd(nyx->event, interval);
+        node = node->next;
+    }
+}
+
+static void
+handle_sweep(UNUSED reactor_t *reactor, void *data)
+{
+    poll_manager_t *m = data;
+
+    sweep_states(m->nyx, m->handler);
+}
+
+/* has to be called with the poll lock being held */
+static void
+start_sweep(poll_manager_t *m)
+{
+    uint32_t interval = MAX(m->nyx->options.polling_interval, 1);
+
+    if (m->track_exits)
+        interval *= NYX_POLL_SWEEP_INTERVALS;
+
+    if (m->sweep_timer >= 0)
+        reactor_remove_timer(m->nyx->reactor, m->sweep_timer);
+
+    m->sweep_timer = reactor_add_timer(m->nyx->reactor, interval * 1000, true,
+            handle_sweep, m);
+
+    log_debug("Poll: checking all watches every %u sec", interval);
+}
+
+/* has to be called with the poll lock being held */
+static void
+track_pid(poll_manager_t *m, pid_t pid)
+{
+    if (!m->track_exits || pid < 1 || pidmap_get(m->tracked, pid))
+        return;
+
+    reactor_t *reactor = m->nyx->reactor;
+    int32_t rc = reactor_add_exit(reactor, pid, handle_exit, m);
+
+    if (rc > 0)
+    {
+        pidmap_add(m->tracked, pid, m);
+
+        log_debug("Poll: tracking exit of process with PID %d", pid);
     }
+    /* the process is gone already */
+    else if (rc == 0)
+        reactor_add_timer(reactor, 0, false, handle_terminated, (void *)(intptr_t)pid);
+    else
+    {
+        log_warn("Process exits cannot be watched - falling back to polling only");
+
+        m->track_exits = false;
+        start_sweep(m);
+    }
+}
+
+/**
+ * @brief Track the exit of the given process if the polling
+ *        manager is running
+ * @param pid process to track
+ */
+void
+poll_track_pid(pid_t pid)
+{
+    pthread_mutex_lock(&poll_lock);
+
+    if (manager)
+        track_pid(manager, pid);
+
+    pthread_mutex_unlock(&poll_lock);
+}
+
+/**
+ * @brief Start the polling manager on the nyx reactor. Process exits
+ *        are reported immediately via pidfds (kqueue on OSX) if
+ *        supported - the periodic check of all watches is kept as
+ *        a safety net only then.
+ * @param nyx     nyx instance
+ * @param handler poll result handler
+ * @return true on success, false otherwise
+ */
+bool
+poll_init(nyx_t *nyx, poll_handler_t handler)
+{
+    poll_manager_t *m = xcalloc1(sizeof(poll_manager_t));
+
+    m->nyx = nyx;
+    m->handler = handler;
+    m->tracked = pidmap_new();
+    m->track_exits = true;
+    m->sweep_timer = -1;
+
+    log_debug("Starting polling manager (interval: %u sec)",
+            MAX(nyx->options.polling_interval, 1));
+
+    pthread_mutex_lock(&poll_lock);
+
+    manager = m;
+    start_sweep(m);
+
+    bool success = m->sweep_timer >= 0;
+
+    pthread_mutex_unlock(&poll_lock);
+
+    if (!success)
+    {
+        poll_shutdown(nyx);
+        return false;
+    }
+
+    /* initial check of all watches - this tracks
+     * all known pids as well */
+    sweep_states(nyx, handler);
 
     return true;
 }
 
+/**
+ * @brief Stop the polling manager
+ * @param nyx nyx instance
+ */
+void
+poll_shutdown(nyx_t *nyx)
+{
+    pthread_mutex_lock(&poll_lock);
+
+    poll_manager_t *m = manager;
+    manager = NULL;
+
+    pthread_mutex_unlock(&poll_lock);
+
+    if (m == NULL)
+        return;
+
+    if (m->sweep_timer >= 0)
+        reactor_remove_timer(nyx->reactor, m->sweep_timer);
+
+    uint32_t count = pidmap_count(m->tracked);
+    pid_t *pids = xcalloc(count + 1, sizeof(pid_t));
+
+    count = pidmap_pids(m->tracked, pids, count + 1);
+
+    for (uint32_t i = 0; i < count; i++)
+        reactor_remove_exit(nyx->reactor, pids[i]);
+
+    xfree(pids);
+
+    pidmap_destroy(m->tracked);
+    xfree(m);
+
+    log_debug("Polling manager: terminated");
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
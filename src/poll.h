@@ -20,6 +20,12 @@
 typedef bool (*poll_handler_t)(int pid, bool is_running, nyx_t *nyx);
 
 bool
-poll_loop(nyx_t *nyx, poll_handler_t handler);
+poll_init(nyx_t *nyx, poll_handler_t handler);
+
+void
+poll_shutdown(nyx_t *nyx);
+
+void
+poll_track_pid(pid_t pid);
 
 /* vim: set et sw=4 sts=4 tw=80: */
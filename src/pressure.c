@@ -0,0 +1,89 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_PROC
+
+#include "def.h"
+#include "log.h"
+#include "pressure.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* the kernel accepts windows of 500 ms up to 10 s */
+#define PRESSURE_MIN_WINDOW 500000
+#define PRESSURE_MAX_WINDOW 10000000
+
+/**
+ * @brief Validate a PSI trigger definition like 'some 150000 1000000'
+ *        (stall time and window in usec)
+ * @param trigger trigger definition
+ * @return true if the trigger is valid
+ */
+bool
+pressure_trigger_valid(const char *trigger)
+{
+    char type[8] = {0};
+    uint64_t stall = 0, window = 0;
+
+    if (sscanf(trigger, "%7s %" SCNu64 " %" SCNu64, type, &stall, &window) != 3)
+        return false;
+
+    if (strcmp(type, "some") != 0 && strcmp(type, "full") != 0)
+        return false;
+
+    return window >= PRESSURE_MIN_WINDOW && window <= PRESSURE_MAX_WINDOW &&
+        stall > 0 && stall <= window;
+}
+
+/**
+ * @brief Register a PSI trigger on the given pressure file. The returned
+ *        descriptor signals POLLPRI whenever the threshold is exceeded
+ *        (at most once per window).
+ * @param path    pressure file (i.e. /proc/pressure/memory or the
+ *                memory.pressure file of a cgroup)
+ * @param trigger trigger definition
+ * @return trigger descriptor or -1 on failure
+ */
+int32_t
+pressure_trigger_open(const char *path, const char *trigger)
+{
+    int32_t fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        log_perror("nyx: open %s", path);
+        return -1;
+    }
+
+    /* the trigger is registered by writing it including its terminator */
+    if (write(fd, trigger, strlen(trigger) + 1) < 0)
+    {
+        log_perror("nyx: failed to register pressure trigger '%s' on %s", trigger, path);
+
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
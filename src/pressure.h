@@ -0,0 +1,30 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* system-wide memory pressure (used if a watch has no cgroup) */
+#define PRESSURE_MEMORY "/proc/pressure/memory"
+
+bool
+pressure_trigger_valid(const char *trigger);
+
+int32_t
+pressure_trigger_open(const char *path, const char *trigger);
+
+/* vim: set et sw=4 sts=4 tw=80: */
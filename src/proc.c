@@ -15,21 +15,56 @@
 
 #define _GNU_SOURCE
 
+#define NYX_LOG_CATEGORY NYX_LOG_PROC
+#define NYX_MEM_TAG MEM_PROC
+
+#include "cgroup.h"
 #include "def.h"
+#include "forker.h"
 #include "log.h"
+#include "pressure.h"
 #include "proc.h"
 #include "socket.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #define PROC_STAT_STACK_SIZE 10
 #define PROC_STAT_STACK_LIMIT 8
+#define PROC_STAT_BUFFER_SIZE 1024
+
+/* adaptive sampling: processes using at least this share of their
+ * limits (in percent) are sampled at their minimum interval while
+ * processes below the lower share back off exponentially */
+#define PROC_ADAPTIVE_TIGHTEN 75
+#define PROC_ADAPTIVE_RELAX 50
+
+/* resolved port check hosts are reused for this number of seconds */
+#define PROC_RESOLVER_TTL 60
+
+static void
+schedule_process(nyx_proc_t *sys, proc_stat_t *stat);
+
+static void
+proc_child_destroy(void *obj)
+{
+    proc_child_t *child = obj;
 
-static volatile bool need_exit = false;
+    if (child->stat_fd >= 0)
+        close(child->stat_fd);
+
+    xfree(child);
+}
 
 static void
 proc_stat_destroy(void *obj)
@@ -48,7 +83,53 @@ proc_stat_destroy(void *obj)
         stat->cpu_usage = NULL;
     }
 
-    free(stat);
+    if (stat->stat_fd >= 0)
+        close(stat->stat_fd);
+
+    if (stat->children)
+    {
+        /* the children are not indexed anymore */
+        list_node_t *node = stat->children->head;
+
+        while (node)
+        {
+            proc_child_t *child = node->data;
+
+            pidmap_remove(stat->sys->children, child->pid, node);
+            node = node->next;
+        }
+
+        list_destroy(stat->children);
+    }
+
+    if (stat->pressure_fd >= 0)
+    {
+        nyx_t *nyx = stat->sys->data;
+
+        reactor_remove_fd(nyx->reactor, stat->pressure_fd);
+        close(stat->pressure_fd);
+    }
+
+    free(stat->cgroup);
+
+    wheel_remove(&stat->timer);
+    wheel_remove(&stat->port_check.timer);
+    wheel_remove(&stat->http_check.timer);
+    wheel_remove(&stat->plugin_check.timer);
+    wheel_remove(&stat->exec_check.timer);
+    wheel_remove(&stat->watchdog);
+
+    check_cancel(stat->port_check.running);
+    check_cancel(stat->http_check.running);
+    check_cancel(stat->plugin_check.running);
+    check_cancel(stat->exec_check.running);
+
+    if (stat->http_check.connection >= 0)
+        close(stat->http_check.connection);
+
+    check_tls_release(&stat->http_check.tls);
+
+    xfree(stat);
 }
 
 nyx_proc_t *
@@ -56,10 +137,30 @@ nyx_proc_new(void)
 {
     nyx_proc_t *proc = xcalloc1(sizeof(nyx_proc_t));
 
-    proc->processes = list_new(proc_stat_destroy);
+    proc->processes = list_new_intrusive(proc_stat_destroy);
+    proc->index = pidmap_new();
+    proc->children = pidmap_new();
+    proc->stat_fd = -1;
+    proc->buffer = xcalloc(PROC_STAT_BUFFER_SIZE, sizeof(char));
     proc->total_memory = total_memory_size();
     proc->page_size = get_page_size();
     proc->num_cpus = num_cpus();
+    proc->resolver = resolver_new(PROC_RESOLVER_TTL);
+    proc->wheel = wheel_new(NYX_PROC_TICK_MSECS);
+    proc->interval = 1;
+    proc->watchdog_fd = -1;
+    proc->watchdog_timer = -1;
+
+    pthread_mutex_init(&proc->lock, NULL);
+    pthread_mutex_init(&proc->shards_lock, NULL);
+    pthread_cond_init(&proc->shards_start, NULL);
+    pthread_cond_init(&proc->shards_done, NULL);
+
+    /* seed the jitter of the check schedules */
+    srandom(time(NULL) ^ getpid());
+#ifndef OSX
+    proc->sockdiag = sockdiag_new();
+#endif
 
     return proc;
 }
@@ -72,34 +173,204 @@ proc_stat_new(pid_t pid, const char *name, watch_t *watch)
     stat->pid = pid;
     stat->name = name;
     stat->watch = watch;
+    stat->stat_fd = -1;
+    stat->pressure_fd = -1;
+    stat->port_check.proc = stat;
+    stat->port_check.connection = -1;
+    stat->http_check.proc = stat;
+    stat->http_check.connection = -1;
+    stat->plugin_check.proc = stat;
+    stat->plugin_check.connection = -1;
+    stat->exec_check.proc = stat;
+    stat->exec_check.connection = -1;
 
     /* TODO: configurable stack size */
     stat->mem_usage = stack_long_new(PROC_STAT_STACK_SIZE);
     stat->cpu_usage = stack_double_new(PROC_STAT_STACK_SIZE);
 
+    /* the samples exceeding the watch's limits are counted on insert */
+    if (watch)
+    {
+        stack_long_set_threshold(stat->mem_usage, watch->max_memory);
+        stack_double_set_threshold(stat->cpu_usage, watch->max_cpu);
+    }
+
     return stat;
 }
 
+#ifndef OSX
+/**
+ * Read the content of a proc file into the reusable buffer. The file is
+ * opened on demand and kept open for subsequent reads which are done via
+ * 'pread' at offset 0. On failure (i.e. ESRCH for a terminated process)
+ * the descriptor is closed and reopened on the next read.
+ */
+static bool
+proc_file_read(int32_t *fd, const char *path, char *buffer)
+{
+    if (*fd < 0 && (*fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return false;
+
+    ssize_t length = pread(*fd, buffer, PROC_STAT_BUFFER_SIZE - 1, 0);
+
+    if (length < 1)
+    {
+        int32_t error = errno;
+
+        close(*fd);
+        *fd = -1;
+
+        errno = error;
+        return false;
+    }
+
+    buffer[length] = '\0';
+
+    return true;
+}
+
+/* the path is formatted on (re)open only */
+static bool
+proc_open_stat(int32_t *stat_fd, pid_t pid)
+{
+    if (*stat_fd >= 0)
+        return true;
+
+    char path[64] = {0};
+    snprintf(path, LEN(path), "/proc/%d/stat", pid);
+
+    return (*stat_fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0;
+}
+#endif
+
+static bool
+proc_read_sys(nyx_proc_t *sys, sys_proc_stat_t *stat)
+{
+#ifndef OSX
+    if (!proc_file_read(&sys->stat_fd, "/proc/stat", sys->buffer))
+    {
+        log_perror("nyx: read /proc/stat");
+        return false;
+    }
+
+    return sys_proc_parse(stat, sys->buffer);
+#else
+    return sys_proc_read(stat);
+#endif
+}
+
+static bool
+proc_read_info(nyx_proc_t *sys, char *buffer, pid_t pid, int32_t *stat_fd, sys_info_t *info)
+{
+#ifndef OSX
+    if (!proc_open_stat(stat_fd, pid))
+        return false;
+
+    if (!proc_file_read(stat_fd, NULL, buffer))
+        return false;
+
+    return sys_info_parse(info, buffer, sys->page_size);
+#else
+    (void)buffer;
+    (void)stat_fd;
+    return sys_info_read_proc(info, pid, sys->page_size);
+#endif
+}
+
+static void
+update_sys_total(nyx_proc_t *sys, sys_proc_stat_t *current)
+{
+    /* calculate diff */
+    current->period = current->total - sys->sys_proc.total;
+
+    memcpy(&sys->sys_proc, current, sizeof(sys_proc_stat_t));
+}
+
+/* the system statistics are read once per tick at most */
 static uint64_t
-calculate_sys_period(sys_proc_stat_t *stat)
+sample_sys_total(nyx_proc_t *sys)
 {
+    sys_proc_stat_t *stat = &sys->sys_proc;
+
+    if (sys->sys_sampled)
+        return stat->total;
+
+    /* failures are not retried before the next tick either */
+    sys->sys_sampled = true;
+
     /* read current statistics */
     sys_proc_stat_t current;
     memset(&current, 0, sizeof(sys_proc_stat_t));
 
-    if (!sys_proc_read(&current))
-        return 0;
+    if (!proc_read_sys(sys, &current))
+        return stat->total;
 
-    /* calculate diff */
-    current.period = current.total - stat->total;
+    update_sys_total(sys, &current);
+
+    return current.total;
+}
+
+static void
+remove_child(nyx_proc_t *sys, list_node_t *node)
+{
+    proc_child_t *child = node->data;
+
+    /* the shards may drop terminated children concurrently */
+    pthread_mutex_lock(&sys->shards_lock);
+
+    if (pidmap_remove(sys->children, child->pid, node))
+        list_remove(child->root->children, node);
+
+    pthread_mutex_unlock(&sys->shards_lock);
+}
+
+/* the CPU time before the first sample is not attributed
+ * to the current period */
+static uint64_t
+update_child_time(proc_child_t *child, sys_info_t *current)
+{
+    uint64_t diff = child->sampled ? current->total_time - child->total_time : 0;
+
+    child->total_time = current->total_time;
+    child->sampled = true;
+
+    return diff;
+}
+
+/* add the CPU time and memory of all descendants - terminated
+ * children that were not reported by an exit event are dropped */
+static uint64_t
+calculate_children_diff(proc_stat_t *proc, nyx_proc_t *sys, char *buffer, int64_t *memory)
+{
+    uint64_t diff = 0;
+    sys_info_t current;
+    list_node_t *node = proc->children->head;
+
+    while (node)
+    {
+        list_node_t *next = node->next;
+        proc_child_t *child = node->data;
+
+        memset(&current, 0, sizeof(sys_info_t));
+
+        if (!proc_read_info(sys, buffer, child->pid, &child->stat_fd, &current))
+        {
+            remove_child(sys, node);
+            node = next;
+            continue;
+        }
+
+        diff += update_child_time(child, &current);
+        *memory += current.resident_set_size;
 
-    memcpy(stat, &current, sizeof(sys_proc_stat_t));
+        node = next;
+    }
 
-    return current.period;
+    return diff;
 }
 
 static uint64_t
-calculate_proc_diff(proc_stat_t *proc, int64_t page_size)
+calculate_proc_diff(proc_stat_t *proc, nyx_proc_t *sys, char *buffer)
 {
     uint64_t diff = 0;
 
@@ -107,25 +378,85 @@ calculate_proc_diff(proc_stat_t *proc, int64_t page_size)
     sys_info_t current;
     memset(&current, 0, sizeof(sys_info_t));
 
-    if (!sys_info_read_proc(&current, proc->pid, page_size))
+    if (!proc_read_info(sys, buffer, proc->pid, &proc->stat_fd, &current))
         return 0;
 
-    if (current.resident_set_size)
-        stack_long_add(proc->mem_usage, current.resident_set_size);
+    int64_t memory = current.resident_set_size;
 
     /* calculate cpu diff/usage */
     diff = current.total_time - proc->info.total_time;
 
+    if (proc->children)
+        diff += calculate_children_diff(proc, sys, buffer, &memory);
+
+    if (memory)
+        stack_long_add(proc->mem_usage, memory);
+
     memcpy(&proc->info, &current, sizeof(sys_info_t));
 
     return diff;
 }
 
+static uint64_t
+monotonic_usecs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+#ifndef OSX
+
+/* the whole process tree of a watch is accounted by its cgroup */
+static bool
+calculate_cgroup_stats(proc_stat_t *stat, nyx_proc_t *sys)
+{
+    cgroup_stats_t current;
+    uint32_t max = sys->num_cpus * 100;
+
+    if (!cgroup_read_stats(stat->cgroup, &current))
+        return false;
+
+    uint64_t now = monotonic_usecs();
+
+    stack_long_add(stat->mem_usage, current.memory);
+
+    if (stat->cgroup_time && now > stat->cgroup_time)
+    {
+        uint64_t diff = current.usage_usec - stat->cgroup_usage;
+        double usage = ((double)diff) / (now - stat->cgroup_time) * 100;
+
+        stack_double_add(stat->cpu_usage, MAX(0, MIN(max, usage)));
+
+        if (current.oom_kills > stat->oom_kills)
+        {
+            log_warn("Watch '%s': %" PRIu64 " process(es) killed by the OOM killer",
+                    stat->name, current.oom_kills - stat->oom_kills);
+        }
+    }
+    else
+        stack_double_add(stat->cpu_usage, 0);
+
+    stat->cgroup_usage = current.usage_usec;
+    stat->cgroup_time = now;
+    stat->oom_kills = current.oom_kills;
+
+    return true;
+}
+#endif
+
+/* every process is sampled on its own schedule so the CPU usage
+ * relates to the system time since the process' last sample */
 static void
-calculate_proc_stats(proc_stat_t *stat, nyx_proc_t *sys, uint64_t period)
+add_cpu_usage(proc_stat_t *stat, nyx_proc_t *sys, uint64_t diff)
 {
     uint32_t max = sys->num_cpus * 100;
-    uint64_t diff = calculate_proc_diff(stat, sys->page_size);
+    uint64_t total = sample_sys_total(sys);
+    uint64_t period = stat->sys_total ? total - stat->sys_total : 0;
+
+    stat->sys_total = total;
 
     if (period > 0)
     {
@@ -136,11 +467,25 @@ calculate_proc_stats(proc_stat_t *stat, nyx_proc_t *sys, uint64_t period)
         stack_double_add(stat->cpu_usage, 0);
 }
 
+static void
+calculate_proc_stats(proc_stat_t *stat, nyx_proc_t *sys, char *buffer)
+{
+#ifndef OSX
+    if (stat->cgroup && calculate_cgroup_stats(stat, sys))
+        return;
+#endif
+
+    add_cpu_usage(stat, sys, calculate_proc_diff(stat, sys, buffer));
+}
+
 nyx_proc_t *
-nyx_proc_init(pid_t pid)
+nyx_proc_init(pid_t pid, uint32_t interval, uint32_t jitter)
 {
     nyx_proc_t *proc = nyx_proc_new();
 
+    proc->interval = MAX(interval, 1);
+    proc->jitter = MIN(jitter, 100);
+
     /* validate some basic values */
     if (proc->total_memory < 1)
     {
@@ -175,7 +520,7 @@ nyx_proc_init(pid_t pid)
         return NULL;
     }
 
-    bool success = sys_proc_read(&proc->sys_proc);
+    bool success = proc_read_sys(proc, &proc->sys_proc);
 
     if (!success)
     {
@@ -187,10 +532,12 @@ nyx_proc_init(pid_t pid)
 
     /* add myself to watched processes */
     proc_stat_t *me = proc_stat_new(pid, "nyx", NULL);
-    list_add(proc->processes, me);
+    list_push(proc->processes, &me->node, me);
+    pidmap_add(proc->index, pid, &me->node);
+    schedule_process(proc, me);
 
     /* get current nyx process statistics */
-    success = sys_info_read_proc(&me->info, me->pid, proc->page_size);
+    success = proc_read_info(proc, proc->buffer, me->pid, &me->stat_fd, &me->info);
 
     if (!success)
     {
@@ -209,248 +556,1704 @@ nyx_proc_init(pid_t pid)
 void
 nyx_proc_remove(nyx_proc_t *proc, pid_t pid)
 {
-    list_node_t *node = proc->processes->head;
+    pthread_mutex_lock(&proc->lock);
 
-    while (node)
-    {
-        proc_stat_t *stat = node->data;
+    list_node_t *node = pidmap_get(proc->index, pid);
 
-        if (stat->pid == pid)
-        {
-            list_remove(proc->processes, node);
-            break;
-        }
+    if (node && pidmap_remove(proc->index, pid, node))
+        list_remove(proc->processes, node);
+    else if ((node = pidmap_get(proc->children, pid)) != NULL)
+        remove_child(proc, node);
 
-        node = node->next;
-    }
+    pthread_mutex_unlock(&proc->lock);
 }
 
-static bool
-nyx_proc_exists(nyx_proc_t *proc, pid_t pid)
+/**
+ * @brief Get the latest taskstats sample of a watched process
+ * @param proc   nyx proc instance
+ * @param pid    PID of the process
+ * @param sample receives a copy of the sample
+ * @return true if a sample was received for the process
+ */
+bool
+nyx_proc_taskstats(nyx_proc_t *proc, pid_t pid, taskstats_sample_t *sample)
 {
-    if (!proc->processes)
+    bool valid = false;
+
+    if (proc == NULL || pid < 1)
         return false;
 
-    list_node_t *node = proc->processes->head;
+    pthread_mutex_lock(&proc->lock);
 
-    while (node)
+    list_node_t *node = pidmap_get(proc->index, pid);
+
+    if (node)
     {
         proc_stat_t *stat = node->data;
 
-        if (stat->pid == pid)
-            return true;
-
-        node = node->next;
+        if ((valid = stat->stats.valid))
+            *sample = stat->stats;
     }
 
-    return false;
+    pthread_mutex_unlock(&proc->lock);
+
+    return valid;
 }
 
+/**
+ * @brief Verify a process that was reloaded in place - its checks and its
+ *        next sample are run once the given delay passed
+ * @param proc  nyx proc instance
+ * @param pid   PID of the reloaded process
+ * @param delay delay in milliseconds
+ */
 void
-nyx_proc_add(nyx_proc_t *proc, pid_t pid, watch_t *watch)
+nyx_proc_reloaded(nyx_proc_t *proc, pid_t pid, uint64_t delay)
 {
-    if (!nyx_proc_exists(proc, pid))
+    pthread_mutex_lock(&proc->lock);
+
+    list_node_t *node = pidmap_get(proc->index, pid);
+
+    if (node)
     {
-        proc_stat_t *stat = proc_stat_new(pid, watch->name, watch);
+        proc_stat_t *stat = node->data;
+        watch_t *watch = stat->watch;
+
+        /* the sampling interval backs off from the minimum again */
+        stat->interval = 0;
+        wheel_add(proc->wheel, &stat->timer, delay);
+
+        if (watch && watch->port_check)
+            wheel_add(proc->wheel, &stat->port_check.timer, delay);
+
+        if (watch && watch->http_check)
+            wheel_add(proc->wheel, &stat->http_check.timer, delay);
 
-        list_add(proc->processes, stat);
+        if (watch && watch->plugin_check)
+            wheel_add(proc->wheel, &stat->plugin_check.timer, delay);
+
+        if (watch && watch->check_exec)
+            wheel_add(proc->wheel, &stat->exec_check.timer, delay);
     }
-}
 
-void
-nyx_proc_terminate(void)
-{
-    need_exit = true;
+    pthread_mutex_unlock(&proc->lock);
 }
 
+/* has to be called with the proc lock being held */
 static bool
-exceeds_cpu(double value, void *obj)
+add_child(nyx_proc_t *sys, proc_stat_t *root, pid_t pid)
 {
-    proc_stat_t *proc = obj;
+    if (pidmap_get(sys->children, pid) || pidmap_get(sys->index, pid))
+        return false;
 
-    return proc->watch && proc->watch->max_cpu && value >= proc->watch->max_cpu;
-}
+    proc_child_t *child = xcalloc1(sizeof(proc_child_t));
 
-static bool
-exceeds_mem(uint64_t value, void *obj)
-{
-    proc_stat_t *proc = obj;
+    child->pid = pid;
+    child->root = root;
+    child->stat_fd = -1;
 
-    return proc->watch && proc->watch->max_memory && value >= proc->watch->max_memory;
+    list_push(root->children, &child->node, child);
+    pidmap_add(sys->children, pid, &child->node);
+
+    return true;
 }
 
-static bool
-proc_port_check(proc_stat_t *proc, nyx_t *nyx)
+/* the process tree a fork belongs to (has to be called with the proc
+ * lock being held) */
+static proc_stat_t *
+find_tree(nyx_proc_t *sys, pid_t pid)
 {
-    watch_t *watch = proc->watch;
+    list_node_t *node = pidmap_get(sys->index, pid);
 
-    if (!watch->port_check)
-        return true;
-
-    if (watch->port_check->host)
+    if (node)
     {
-        if (!check_port(watch->port_check->host, watch->port_check->port))
-        {
-            log_warn("Process '%s': %s:%u is not available",
-                    proc->name, watch->port_check->host, watch->port_check->port);
-
-            return nyx->proc->event_handler(PROC_PORT_NOT_OPEN, proc, nyx);
-        }
+        proc_stat_t *stat = node->data;
+        return stat->children ? stat : NULL;
     }
-    else
-    {
-        if (!check_local_port(watch->port_check->port))
-        {
-            log_warn("Process '%s': port %u is not available",
-                    proc->name, watch->port_check->port);
 
-            return nyx->proc->event_handler(PROC_PORT_NOT_OPEN, proc, nyx);
-        }
+    if ((node = pidmap_get(sys->children, pid)) != NULL)
+    {
+        proc_child_t *child = node->data;
+        return child->root;
     }
 
-    return true;
+    return NULL;
 }
 
-static bool
-proc_http_check(proc_stat_t *proc, nyx_t *nyx)
+/**
+ * @brief Track a new process in the tree of its parent's watched process
+ *        (if any). Forks of unknown parents are remembered for a while
+ *        as the watched process might be added after it forked already.
+ * @param proc   proc system instance
+ * @param parent pid of the parent process
+ * @param child  pid of the new process
+ */
+void
+nyx_proc_fork(nyx_proc_t *proc, pid_t parent, pid_t child)
 {
-    watch_t *watch = proc->watch;
+    pthread_mutex_lock(&proc->lock);
 
-    if (watch->http_check == NULL)
-        return true;
+    proc_stat_t *root = find_tree(proc, parent);
 
-    if (!check_http(watch->http_check, watch->http_check_port, watch->http_check_method))
+    if (root)
+        add_child(proc, root, child);
+    else
     {
-        log_warn("Process '%s': HTTP check failed - %s %s",
-                proc->name,
-                http_method_to_string(watch->http_check_method),
-                watch->http_check);
+        proc_fork_t *recent = &proc->recent_forks[proc->recent_fork];
 
-        return nyx->proc->event_handler(PROC_HTTP_CHECK_FAILED, proc, nyx);
-    }
-
-    return true;
-}
+        recent->parent = parent;
+        recent->child = child;
 
-static void
-handle_sigusr1(UNUSED int signum)
-{
-    log_debug("proc: caught SIGUSR1");
+        proc->recent_fork = (proc->recent_fork + 1) % NYX_PROC_RECENT_FORKS;
+    }
 
-    nyx_proc_terminate();
+    pthread_mutex_unlock(&proc->lock);
 }
 
+/* adopt the children the process forked before it was added - the
+ * recent forks are visited oldest first so grandchildren follow their
+ * parents (has to be called with the proc lock being held) */
 static void
-setup_proc_signals(void)
+adopt_recent_forks(nyx_proc_t *sys, proc_stat_t *root)
 {
-    struct sigaction action =
+    for (uint32_t i = 0; i < NYX_PROC_RECENT_FORKS; i++)
     {
-        .sa_flags = SA_NOCLDSTOP | SA_RESTART,
-        .sa_handler = handle_sigusr1
-    };
+        uint32_t idx = (sys->recent_fork + i) % NYX_PROC_RECENT_FORKS;
+        proc_fork_t *recent = &sys->recent_forks[idx];
 
-    sigemptyset(&action.sa_mask);
+        if (recent->child < 1 || find_tree(sys, recent->parent) != root)
+            continue;
 
-    sigaction(SIGUSR1, &action, NULL);
+        if (add_child(sys, root, recent->child))
+            recent->child = 0;
+    }
 }
 
-void *
-nyx_proc_start(void *state)
+static bool
+nyx_proc_exists(nyx_proc_t *proc, pid_t pid)
 {
-    nyx_t *nyx = state;
-    nyx_proc_t *sys = nyx->proc;
+    if (!proc->processes)
+        return false;
 
-    setup_proc_signals();
+    return pidmap_get(proc->index, pid) != NULL;
+}
 
-    uint32_t interval = nyx->options.check_interval;
+#ifndef OSX
+static void
+handle_pressure(reactor_t *reactor, int32_t fd, uint32_t events, void *data)
+{
+    proc_stat_t *proc = data;
+    nyx_proc_t *sys = proc->sys;
 
-    log_debug("Starting proc watch - check interval %us", interval);
+    pthread_mutex_lock(&sys->lock);
 
-    /* reset need_exit in case of a restart */
-    need_exit = false;
+    if (events & REACTOR_PRIORITY)
+    {
+        log_warn("Process '%s' (%d) exceeds its memory pressure threshold of '%s'",
+                proc->name, proc->pid, proc->watch->memory_pressure);
 
-    while (!need_exit)
+        if (sys->event_handler)
+            sys->event_handler(PROC_MEMORY_PRESSURE, proc, sys->data);
+    }
+    else if (events & REACTOR_HANGUP)
     {
-        uint64_t period = calculate_sys_period(&sys->sys_proc);
-        list_node_t *node = sys->processes->head;
+        /* the monitored cgroup was removed */
+        log_debug("Pressure trigger of process '%s' (%d) hung up", proc->name, proc->pid);
 
-        while (node)
-        {
-            proc_stat_t *proc = node->data;
+        reactor_remove_fd(reactor, fd);
+        close(fd);
+        proc->pressure_fd = -1;
+    }
 
-            /* calculate process' statistics */
-            calculate_proc_stats(proc, sys, period);
+    pthread_mutex_unlock(&sys->lock);
+}
 
-#ifndef NDEBUG
-            uint64_t mem_usage = stack_long_newest(proc->mem_usage);
-            double cpu_usage = stack_double_newest(proc->cpu_usage);
+/* the kernel signals the trigger's descriptor as soon as the memory
+ * stall exceeds the threshold - no sampling involved at all (has to be
+ * called with the proc lock being held) */
+static void
+register_pressure_trigger(nyx_proc_t *sys, proc_stat_t *stat)
+{
+    char path[512] = {0};
+    nyx_t *nyx = sys->data;
 
-            uint64_t out_mem = 0;
-            char mem_unit = get_size_unit(mem_usage, &out_mem);
+    if (nyx == NULL || nyx->reactor == NULL)
+        return;
 
-            log_debug("Process '%s' (%d): CPU %4.1f%% MEM (%" PRIu64 "%c) %5.2f%%",
-                    proc->name, proc->pid, cpu_usage,
-                    out_mem, mem_unit,
-                    ((double)mem_usage / sys->total_memory * 100.0));
-#endif
+    /* without a cgroup the system-wide pressure is monitored */
+    if (stat->cgroup)
+        snprintf(path, LEN(path)-1, "%s/memory.pressure", stat->cgroup);
+    else
+        snprintf(path, LEN(path)-1, "%s", PRESSURE_MEMORY);
 
-            /* no event handler registered
-             * -> nothing to be done anyways */
-            bool handle_events = sys->event_handler != NULL && proc->watch != NULL;
+    int32_t fd = pressure_trigger_open(path, stat->watch->memory_pressure);
 
-            /* handle CPU events? */
-            if (handle_events &&
-                    proc->watch->max_cpu &&
-                    stack_double_satisfy(proc->cpu_usage, exceeds_cpu, proc) >= PROC_STAT_STACK_LIMIT)
-            {
-                log_warn("Process '%s' (%d) exceeds its CPU usage maximum of %u%%"
-                         " in at least %d of the last %d tests",
-                         proc->name, proc->pid, proc->watch->max_cpu,
-                         PROC_STAT_STACK_LIMIT, PROC_STAT_STACK_SIZE);
+    if (fd < 0)
+        return;
 
-                handle_events = sys->event_handler(PROC_MAX_CPU, proc, nyx);
+    if (!reactor_add_fd_events(nyx->reactor, fd, REACTOR_PRIORITY, handle_pressure, stat))
+    {
+        close(fd);
+        return;
+    }
+
+    stat->pressure_fd = fd;
+}
+#endif
+
+void
+nyx_proc_add(nyx_proc_t *proc, pid_t pid, const char *name, watch_t *watch)
+{
+    pthread_mutex_lock(&proc->lock);
+
+    if (!nyx_proc_exists(proc, pid))
+    {
+        proc_stat_t *stat = proc_stat_new(pid, name, watch);
+
+#ifndef OSX
+        nyx_t *nyx = proc->data;
+
+        /* processes that were started before the cgroups were
+         * configured are sampled individually */
+        if (nyx && nyx->options.cgroup)
+        {
+            stat->cgroup = cgroup_watch_path(nyx->options.cgroup, name);
+
+            if (!cgroup_contains(stat->cgroup, pid))
+            {
+                free(stat->cgroup);
+                stat->cgroup = NULL;
+            }
+        }
+#endif
+
+        /* the limits apply to the whole process tree which is tracked
+         * via fork and exit events unless the cgroup accounts for it */
+        if (stat->cgroup == NULL && watch_has_limits(watch))
+            stat->children = list_new_intrusive(proc_child_destroy);
+
+        /* the processes are distributed over the shards evenly */
+        if (proc->num_shards)
+            stat->shard = &proc->shards[proc->next_shard++ % proc->num_shards];
+
+        list_push(proc->processes, &stat->node, stat);
+        pidmap_add(proc->index, pid, &stat->node);
+        schedule_process(proc, stat);
+
+        if (stat->children)
+            adopt_recent_forks(proc, stat);
+
+#ifndef OSX
+        if (watch->memory_pressure)
+            register_pressure_trigger(proc, stat);
+#endif
+    }
+
+    pthread_mutex_unlock(&proc->lock);
+}
+
+/* latency histograms and trace names by check_type_e */
+static const stats_histogram_e check_histograms[] =
+{
+    STATS_PORT_CHECK, STATS_HTTP_CHECK, STATS_PLUGIN_CHECK, STATS_EXEC_CHECK
+};
+
+static const char *check_names[] = { "port", "http", "plugin", "exec" };
+
+static void
+handle_check_result(proc_check_t *pc, check_type_e type, proc_event_e event, bool success)
+{
+    proc_stat_t *proc = pc->proc;
+    nyx_t *nyx = pc->data;
+
+    pc->running = NULL;
+
+    pc->latency = monotonic_usecs() - pc->started;
+
+    stats_record(check_histograms[type], pc->latency);
+
+    NYX_TRACE5(check__done, proc->name, proc->pid, check_names[type], success, pc->latency);
+
+    /* failures and recoveries are journaled only */
+    if (!success || (pc->checked && !pc->success))
+        journal_check(nyx->journal, proc->name, proc->pid, type, success, pc->latency);
+
+    pc->success = success;
+    pc->checked = true;
+
+    if (nyx->proc->check_handler)
+        nyx->proc->check_handler(type, success, proc, nyx->proc->data);
+
+    if (success)
+        return;
+
+    if (!nyx->proc->event_handler(event, proc, nyx))
+    {
+        /* the process is dealt with already so the
+         * results of the other checks are of no interest */
+        proc_check_t *checks[] = {
+            &proc->port_check, &proc->http_check, &proc->plugin_check, &proc->exec_check
+        };
+
+        for (uint32_t i = 0; i < LEN(checks); i++)
+        {
+            if (checks[i] == pc)
+                continue;
+
+            check_cancel(checks[i]->running);
+            checks[i]->running = NULL;
+        }
+    }
+}
+
+static void
+handle_port_check(UNUSED check_t *check, bool success, void *data)
+{
+    proc_check_t *pc = data;
+    watch_t *watch = pc->proc->watch;
+
+    if (!success)
+    {
+        if (watch->port_check->host)
+            log_warn("Process '%s': %s:%u is not available",
+                    pc->proc->name, watch->port_check->host, watch->port_check->port);
+        else
+            log_warn("Process '%s': port %u is not available",
+                    pc->proc->name, watch->port_check->port);
+    }
+
+    handle_check_result(pc, CHECK_PORT, PROC_PORT_NOT_OPEN, success);
+}
+
+static void
+handle_http_check(UNUSED check_t *check, bool success, void *data)
+{
+    proc_check_t *pc = data;
+    watch_t *watch = pc->proc->watch;
+
+    if (!success)
+    {
+        log_warn("Process '%s': HTTP check failed - %s %s",
+                pc->proc->name,
+                http_method_to_string(watch->http_check_method),
+                watch->http_check);
+    }
+
+    handle_check_result(pc, CHECK_HTTP, PROC_HTTP_CHECK_FAILED, success);
+}
+
+static void
+handle_plugin_check(UNUSED check_t *check, bool success, void *data)
+{
+    proc_check_t *pc = data;
+
+    if (!success)
+    {
+        log_warn("Process '%s': plugin check '%s' failed",
+                pc->proc->name, pc->proc->watch->plugin_check);
+    }
+
+    handle_check_result(pc, CHECK_PLUGIN, PROC_PLUGIN_CHECK_FAILED, success);
+}
+
+static void
+handle_exec_check(UNUSED check_t *check, bool success, void *data)
+{
+    proc_check_t *pc = data;
+
+    if (!success)
+    {
+        log_warn("Process '%s': check command '%s' failed",
+                pc->proc->name, pc->proc->watch->check_exec[0]);
+    }
+
+    handle_check_result(pc, CHECK_EXEC, PROC_EXEC_CHECK_FAILED, success);
+}
+
+static void
+proc_port_check(proc_stat_t *proc)
+{
+    nyx_t *nyx = proc->sys->data;
+    watch_t *watch = proc->watch;
+    proc_check_t *pc = &proc->port_check;
+
+    /* the previous check is still running */
+    if (!watch->port_check || pc->running)
+        return;
+
+    pc->data = nyx;
+    pc->started = monotonic_usecs();
+
+    NYX_TRACE3(check__start, proc->name, proc->pid, "port");
+
+#ifndef OSX
+    /* local ports are looked up in the table of listening sockets
+     * instead of connecting to the service */
+    if (watch->port_check->host == NULL && nyx->proc->sockdiag)
+    {
+        bool listening = false;
+        pid_t owner = watch->port_check_owner ? proc->pid : 0;
+
+        if (sockdiag_listening(nyx->proc->sockdiag, watch->port_check->port, owner, &listening))
+        {
+            handle_port_check(NULL, listening, pc);
+            return;
+        }
+    }
+#endif
+
+    struct sockaddr_in addresses[RESOLVER_MAX_ADDRESSES];
+
+    int32_t count = resolver_lookup(nyx->proc->resolver,
+            watch->port_check->host ? watch->port_check->host : "127.0.0.1",
+            addresses, RESOLVER_MAX_ADDRESSES);
+
+    /* the host is not resolved yet - check on the next tick */
+    if (count == RESOLVER_PENDING)
+        return;
+
+    if (count > 0)
+    {
+        pc->running = check_port_start_resolved(nyx->reactor,
+                addresses, count, watch->port_check->port,
+                handle_port_check, pc);
+    }
+
+    if (pc->running == NULL)
+        handle_port_check(NULL, false, pc);
+}
+
+static void
+proc_http_check(proc_stat_t *proc)
+{
+    nyx_t *nyx = proc->sys->data;
+    watch_t *watch = proc->watch;
+    proc_check_t *pc = &proc->http_check;
+
+    if (watch->http_check == NULL || pc->running)
+        return;
+
+    pc->data = nyx;
+    pc->started = monotonic_usecs();
+
+    NYX_TRACE3(check__start, proc->name, proc->pid, "http");
+
+    pc->running = check_http_start(nyx->reactor,
+            watch->http_check, watch->http_check_port, watch->http_check_method,
+            watch->http_check_status,
+            watch->http_check_keep_alive ? &pc->connection : NULL, &pc->tls,
+            handle_http_check, pc);
+
+    if (pc->running == NULL)
+        handle_http_check(NULL, false, pc);
+}
+
+static void
+proc_plugin_check(proc_stat_t *proc)
+{
+    nyx_t *nyx = proc->sys->data;
+    watch_t *watch = proc->watch;
+    proc_check_t *pc = &proc->plugin_check;
+
+    if (watch->plugin_check == NULL || pc->running)
+        return;
+
+    pc->data = nyx;
+    pc->started = monotonic_usecs();
+
+    NYX_TRACE3(check__start, proc->name, proc->pid, "plugin");
+
+#ifdef USE_PLUGINS
+    uint32_t timeout = (watch->plugin_check_timeout
+            ? watch->plugin_check_timeout
+            : NYX_PLUGIN_CHECK_TIMEOUT) * 1000;
+    int32_t result_fd = -1;
+
+    /* the plugin reports its result on one of the plugin check threads */
+    pc->running = check_async_start(nyx->reactor, CHECK_PLUGIN, timeout, &result_fd,
+            handle_plugin_check, pc);
+
+    if (pc->running &&
+        !plugin_check_run(nyx->plugins, watch->plugin_check, proc->name, proc->pid,
+            watch->plugin_check_argument, timeout, result_fd))
+    {
+        /* fails on the next reactor iteration */
+        check_async_complete(result_fd, false);
+    }
+#endif
+
+    if (pc->running == NULL)
+        handle_plugin_check(NULL, false, pc);
+}
+
+/* index of the watch's instance the process belongs to */
+static uint32_t
+proc_instance(proc_stat_t *proc)
+{
+    if (proc->watch->instances <= 1)
+        return 0;
+
+    const char *separator = strrchr(proc->name, WATCH_INSTANCE_SEPARATOR);
+
+    return separator ? (uint32_t)strtoul(separator + 1, NULL, 10) : 0;
+}
+
+/*
+ * Returns false if the check was deferred because the maximum number of
+ * check commands are running already.
+ */
+static bool
+proc_exec_check(proc_stat_t *proc)
+{
+    nyx_t *nyx = proc->sys->data;
+    watch_t *watch = proc->watch;
+    proc_check_t *pc = &proc->exec_check;
+
+    if (watch->check_exec == NULL || pc->running)
+        return true;
+
+    if (nyx->options.check_exec_concurrency &&
+        forker_checks_running() >= nyx->options.check_exec_concurrency)
+        return false;
+
+    pc->data = nyx;
+    pc->started = monotonic_usecs();
+
+    NYX_TRACE3(check__start, proc->name, proc->pid, "exec");
+
+    uint32_t timeout = (watch->check_exec_timeout
+            ? watch->check_exec_timeout
+            : NYX_EXEC_CHECK_TIMEOUT) * 1000;
+    int32_t result_fd = -1;
+
+    /* the forker reports the exit status of the command */
+    pc->running = check_async_start(nyx->reactor, CHECK_EXEC, timeout, &result_fd,
+            handle_exec_check, pc);
+
+    if (pc->running &&
+        !forker_check(nyx, watch->id, proc_instance(proc), proc->pid, timeout, result_fd))
+    {
+        /* fails on the next reactor iteration */
+        check_async_complete(result_fd, false);
+    }
+
+    if (pc->running == NULL)
+        handle_exec_check(NULL, false, pc);
+
+    return true;
+}
+
+/* interval (in milliseconds) with a random deviation of up to the
+ * configured jitter so the checks of all watches drift apart */
+static uint64_t
+jittered_interval(nyx_proc_t *sys, uint32_t interval)
+{
+    uint64_t msecs = (interval ? interval : sys->interval) * 1000ULL;
+    uint64_t spread = msecs * sys->jitter / 100;
+
+    if (spread == 0)
+        return msecs;
+
+    return msecs - spread + random() % (2 * spread + 1);
+}
+
+/* highest usage of the watch's limits in the latest sample (in percent) */
+static uint32_t
+limits_usage(proc_stat_t *proc)
+{
+    watch_t *watch = proc->watch;
+    double usage = 0;
+
+    /* any sample over the limits requires close observation */
+    if (stack_double_over(proc->cpu_usage) || stack_long_over(proc->mem_usage))
+        return 100;
+
+    if (watch->max_cpu)
+        usage = stack_double_newest(proc->cpu_usage) * 100 / watch->max_cpu;
+
+    if (watch->max_memory)
+        usage = MAX(usage, (double)stack_long_newest(proc->mem_usage) * 100 / watch->max_memory);
+
+    return usage;
+}
+
+/* healthy processes back off towards the watch's maximum interval
+ * whereas processes approaching their limits (or just (re)started
+ * ones) are sampled at the minimum interval */
+static uint32_t
+sample_interval(nyx_proc_t *sys, proc_stat_t *proc)
+{
+    watch_t *watch = proc->watch;
+    uint32_t min = watch && watch->check_interval ? watch->check_interval : sys->interval;
+
+    if (watch == NULL || watch->max_check_interval <= min)
+        return min;
+
+    uint32_t usage = limits_usage(proc);
+    uint32_t interval = MAX(proc->interval, min);
+
+    if (usage >= PROC_ADAPTIVE_TIGHTEN)
+        interval = min;
+    else if (usage < PROC_ADAPTIVE_RELAX)
+        interval = MIN(interval * 2, watch->max_check_interval);
+    else
+        interval = MAX(interval / 2, min);
+
+    if (interval != proc->interval)
+    {
+        log_debug("Process '%s' (%d): sampling every %u seconds",
+                proc->name, proc->pid, interval);
+    }
+
+    proc->interval = interval;
+
+    return interval;
+}
+
+/* check the latest statistics sample against the watch's limits */
+static void
+evaluate_proc_stats(proc_stat_t *proc, nyx_proc_t *sys)
+{
+    wheel_add(sys->wheel, &proc->timer,
+            jittered_interval(sys, sample_interval(sys, proc)));
+
+#ifndef NDEBUG
+    uint64_t mem_usage = stack_long_newest(proc->mem_usage);
+    double cpu_usage = stack_double_newest(proc->cpu_usage);
+
+    uint64_t out_mem = 0;
+    char mem_unit = get_size_unit(mem_usage, &out_mem);
+
+    log_debug("Process '%s' (%d): CPU %4.1f%% MEM (%" PRIu64 "%c) %5.2f%%",
+            proc->name, proc->pid, cpu_usage,
+            out_mem, mem_unit,
+            ((double)mem_usage / sys->total_memory * 100.0));
+
+    if (proc->stats.valid)
+    {
+        log_debug("Process '%s' (%d): I/O read %" PRIu64 " kB write %" PRIu64 " kB,"
+                " delay CPU %" PRIu64 " ms block I/O %" PRIu64 " ms swap %" PRIu64 " ms,"
+                " peak RSS %" PRIu64 " kB",
+                proc->name, proc->pid,
+                proc->stats.read_bytes / 1024, proc->stats.write_bytes / 1024,
+                proc->stats.cpu_delay / 1000000, proc->stats.blkio_delay / 1000000,
+                proc->stats.swapin_delay / 1000000, proc->stats.hiwater_rss);
+    }
+#endif
+
+    NYX_TRACE4(proc__sample, proc->name, proc->pid,
+            (int64_t)(stack_double_newest(proc->cpu_usage) * 100.0),
+            stack_long_newest(proc->mem_usage));
+
+    if (sys->sample_handler != NULL)
+        sys->sample_handler(proc, sys->data);
+
+    /* no event handler registered
+     * -> nothing to be done anyways */
+    bool handle_events = sys->event_handler != NULL && proc->watch != NULL;
+
+    /* handle CPU events? */
+    if (handle_events &&
+            proc->watch->max_cpu &&
+            stack_double_over(proc->cpu_usage) >= PROC_STAT_STACK_LIMIT)
+    {
+        log_warn("Process '%s' (%d) exceeds its CPU usage maximum of %u%%"
+                 " in at least %d of the last %d tests",
+                 proc->name, proc->pid, proc->watch->max_cpu,
+                 PROC_STAT_STACK_LIMIT, PROC_STAT_STACK_SIZE);
+
+        handle_events = sys->event_handler(PROC_MAX_CPU, proc, sys->data);
+    }
+
+    /* handle memory events? */
+    if (handle_events &&
+            proc->watch->max_memory &&
+            stack_long_over(proc->mem_usage) >= PROC_STAT_STACK_LIMIT)
+    {
+        uint64_t bytes;
+        char unit = get_size_unit(proc->watch->max_memory, &bytes);
+
+        log_warn("Process '%s' (%d) exceeds its memory usage maximum of %" PRIu64 "%c"
+                 " in at least %d of the last %d tests",
+                 proc->name, proc->pid, bytes, unit,
+                 PROC_STAT_STACK_LIMIT, PROC_STAT_STACK_SIZE);
+
+        sys->event_handler(PROC_MAX_MEMORY, proc, sys->data);
+    }
+}
+
+/* the process is sampled together with all other processes that are
+ * due in the current tick (has to be called with the proc lock being
+ * held) */
+static void
+queue_sample(proc_queue_t *queue, proc_stat_t *proc)
+{
+    if (queue->count >= queue->size)
+    {
+        uint32_t size = MAX(queue->size * 2, 16);
+
+        queue->procs = xrealloc(queue->procs, size * sizeof(proc_stat_t *));
+        queue->size = size;
+    }
+
+    queue->procs[queue->count++] = proc;
+}
+
+static void
+handle_sample_timer(UNUSED wheel_timer_t *timer, void *data)
+{
+    proc_stat_t *proc = data;
+    nyx_proc_t *sys = proc->sys;
+
+#ifndef OSX
+    if ((sys->taskstats || sys->uring) && proc->cgroup == NULL)
+    {
+        queue_sample(&sys->pending, proc);
+        return;
+    }
+#endif
+
+    if (proc->shard)
+    {
+        queue_sample(&proc->shard->pending, proc);
+        return;
+    }
+
+    /* calculate process' statistics */
+    calculate_proc_stats(proc, sys, sys->buffer);
+    evaluate_proc_stats(proc, sys);
+}
+
+/* the port, HTTP and plugin checks run concurrently and
+ * report their results asynchronously */
+static void
+handle_port_timer(UNUSED wheel_timer_t *timer, void *data)
+{
+    proc_stat_t *proc = data;
+    nyx_proc_t *sys = proc->sys;
+
+    wheel_add(sys->wheel, &proc->port_check.timer,
+            jittered_interval(sys, proc->watch->port_check_interval));
+
+    if (sys->event_handler)
+        proc_port_check(proc);
+}
+
+static void
+handle_http_timer(UNUSED wheel_timer_t *timer, void *data)
+{
+    proc_stat_t *proc = data;
+    nyx_proc_t *sys = proc->sys;
+
+    wheel_add(sys->wheel, &proc->http_check.timer,
+            jittered_interval(sys, proc->watch->http_check_interval));
+
+    if (sys->event_handler)
+        proc_http_check(proc);
+}
+
+static void
+handle_plugin_timer(UNUSED wheel_timer_t *timer, void *data)
+{
+    proc_stat_t *proc = data;
+    nyx_proc_t *sys = proc->sys;
+
+    wheel_add(sys->wheel, &proc->plugin_check.timer,
+            jittered_interval(sys, proc->watch->plugin_check_interval));
+
+    if (sys->event_handler)
+        proc_plugin_check(proc);
+}
+
+static void
+handle_exec_timer(UNUSED wheel_timer_t *timer, void *data)
+{
+    proc_stat_t *proc = data;
+    nyx_proc_t *sys = proc->sys;
+
+    /* deferred checks are retried on the next tick */
+    if (sys->event_handler && !proc_exec_check(proc))
+    {
+        wheel_add(sys->wheel, &proc->exec_check.timer, NYX_PROC_TICK_MSECS);
+        return;
+    }
+
+    wheel_add(sys->wheel, &proc->exec_check.timer,
+            jittered_interval(sys, proc->watch->check_exec_interval));
+}
+
+/* the process did not send a heartbeat within its deadline */
+static void
+handle_watchdog_missed(wheel_timer_t *timer, void *data)
+{
+    proc_stat_t *proc = data;
+    nyx_proc_t *sys = proc->sys;
+
+    log_warn("Process '%s' (%d) missed its watchdog deadline of %u ms",
+            proc->name, proc->pid, proc->watch->watchdog);
+
+    /* missed deadlines are reported until the next heartbeat */
+    wheel_add(sys->watchdog_wheel, timer, proc->watch->watchdog);
+
+    if (sys->event_handler)
+        sys->event_handler(PROC_WATCHDOG_MISSED, proc, sys->data);
+}
+
+/* the first runs are spread evenly over one interval */
+static void
+schedule_first(nyx_proc_t *sys, wheel_timer_t *timer, uint32_t interval)
+{
+    uint64_t msecs = (interval ? interval : sys->interval) * 1000ULL;
+
+    wheel_add(sys->wheel, timer, random() % msecs);
+}
+
+/* has to be called with the proc lock being held */
+static void
+schedule_process(nyx_proc_t *sys, proc_stat_t *stat)
+{
+    watch_t *watch = stat->watch;
+
+    stat->sys = sys;
+
+    wheel_timer_init(&stat->timer, handle_sample_timer, stat);
+    schedule_first(sys, &stat->timer, watch ? watch->check_interval : 0);
+
+    if (watch == NULL)
+        return;
+
+    if (watch->port_check)
+    {
+        wheel_timer_init(&stat->port_check.timer, handle_port_timer, stat);
+        schedule_first(sys, &stat->port_check.timer, watch->port_check_interval);
+    }
+
+    if (watch->http_check)
+    {
+        wheel_timer_init(&stat->http_check.timer, handle_http_timer, stat);
+        schedule_first(sys, &stat->http_check.timer, watch->http_check_interval);
+    }
+
+    if (watch->plugin_check)
+    {
+        wheel_timer_init(&stat->plugin_check.timer, handle_plugin_timer, stat);
+        schedule_first(sys, &stat->plugin_check.timer, watch->plugin_check_interval);
+    }
+
+    if (watch->check_exec)
+    {
+        wheel_timer_init(&stat->exec_check.timer, handle_exec_timer, stat);
+        schedule_first(sys, &stat->exec_check.timer, watch->check_exec_interval);
+    }
+
+    /* the first heartbeat is awaited for one deadline as well */
+    if (watch->watchdog && sys->watchdog_wheel)
+    {
+        wheel_timer_init(&stat->watchdog, handle_watchdog_missed, stat);
+        wheel_add(sys->watchdog_wheel, &stat->watchdog, watch->watchdog);
+    }
+}
+
+#ifndef OSX
+static taskstats_sample_t *
+next_sample(nyx_proc_t *sys, uint32_t count, pid_t pid)
+{
+    if (count >= sys->samples_size)
+    {
+        uint32_t size = MAX(sys->samples_size * 2, 64);
+
+        sys->samples = xrealloc(sys->samples, size * sizeof(taskstats_sample_t));
+        sys->samples_size = size;
+    }
+
+    taskstats_sample_t *sample = &sys->samples[count];
+
+    memset(sample, 0, sizeof(taskstats_sample_t));
+    sample->tgid = pid;
+
+    return sample;
+}
+
+/* the resident set size is not part of the taskstats so it is read
+ * from /proc only if the watch limits the memory usage */
+static int64_t
+read_resident_size(nyx_proc_t *sys, pid_t pid, int32_t *stat_fd)
+{
+    sys_info_t info;
+    memset(&info, 0, sizeof(sys_info_t));
+
+    if (!proc_read_info(sys, sys->buffer, pid, stat_fd, &info))
+        return 0;
+
+    return info.resident_set_size;
+}
+
+/* apply the samples of the process and its descendants starting at
+ * the given index and return the index of the next process' sample */
+static uint32_t
+apply_taskstats(nyx_proc_t *sys, proc_stat_t *proc, uint32_t idx, uint64_t now)
+{
+    uint32_t max = sys->num_cpus * 100;
+    taskstats_sample_t *sample = &sys->samples[idx++];
+    bool read_memory = proc->watch && proc->watch->max_memory;
+    int64_t memory = 0;
+    uint64_t diff = proc->exited_time;
+
+    proc->exited_time = 0;
+
+    if (sample->valid)
+    {
+        if (proc->sample_time)
+            diff += sample->cpu_time - proc->stats.cpu_time;
+
+        proc->stats = *sample;
+
+        if (read_memory)
+            memory = read_resident_size(sys, proc->pid, &proc->stat_fd);
+    }
+
+    list_node_t *node = proc->children ? proc->children->head : NULL;
+
+    while (node)
+    {
+        list_node_t *next = node->next;
+        proc_child_t *child = node->data;
+
+        sample = &sys->samples[idx++];
+
+        if (!sample->valid)
+        {
+            remove_child(sys, node);
+            node = next;
+            continue;
+        }
+
+        if (child->sampled)
+            diff += sample->cpu_time - child->total_time;
+
+        child->total_time = sample->cpu_time;
+        child->sampled = true;
+
+        if (read_memory)
+            memory += read_resident_size(sys, child->pid, &child->stat_fd);
+
+        node = next;
+    }
+
+    if (memory)
+        stack_long_add(proc->mem_usage, memory);
+
+    /* the CPU times are reported in usec */
+    if (proc->sample_time && now > proc->sample_time)
+    {
+        double usage = ((double)diff) / (now - proc->sample_time) * 100;
+        stack_double_add(proc->cpu_usage, MAX(0, MIN(max, usage)));
+    }
+    else
+        stack_double_add(proc->cpu_usage, 0);
+
+    proc->sample_time = now;
+
+    return idx;
+}
+
+/* the statistics of all processes that are due in the current tick
+ * (including their descendants) are requested in one bulk exchange */
+static void
+sample_taskstats(nyx_proc_t *sys)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < sys->pending.count; i++)
+    {
+        proc_stat_t *proc = sys->pending.procs[i];
+
+        next_sample(sys, count++, proc->pid);
+
+        if (proc->children == NULL)
+            continue;
+
+        for (list_node_t *node = proc->children->head; node; node = node->next)
+        {
+            proc_child_t *child = node->data;
+            next_sample(sys, count++, child->pid);
+        }
+    }
+
+    taskstats_query(sys->taskstats, sys->samples, count);
+
+    uint64_t now = monotonic_usecs();
+    uint32_t idx = 0;
+
+    for (uint32_t i = 0; i < sys->pending.count; i++)
+    {
+        proc_stat_t *proc = sys->pending.procs[i];
+
+        idx = apply_taskstats(sys, proc, idx, now);
+        evaluate_proc_stats(proc, sys);
+    }
+
+    sys->pending.count = 0;
+}
+
+/* the final CPU time of exiting descendants is attributed to their
+ * watched process instead of getting lost between two samples */
+static void
+handle_task_exits(UNUSED reactor_t *reactor, UNUSED int32_t fd, UNUSED uint32_t events, void *data)
+{
+    nyx_proc_t *sys = data;
+    taskstats_sample_t sample;
+
+    pthread_mutex_lock(&sys->lock);
+
+    while (taskstats_read_exit(sys->taskstats, &sample))
+    {
+        list_node_t *node = pidmap_get(sys->children, sample.tgid);
+
+        if (node == NULL)
+            continue;
+
+        proc_child_t *child = node->data;
+        uint64_t previous = child->sampled ? child->total_time : 0;
+
+        /* short-lived children are accounted although they were
+         * never sampled at all */
+        if (sample.cpu_time > previous)
+            child->root->exited_time += sample.cpu_time - previous;
+
+        remove_child(sys, node);
+    }
+
+    pthread_mutex_unlock(&sys->lock);
+}
+
+static proc_read_t *
+next_read(nyx_proc_t *sys, uint32_t count, proc_stat_t *proc, list_node_t *child, int32_t *fd)
+{
+    if (count >= sys->reads_size)
+    {
+        uint32_t size = MAX(sys->reads_size * 2, 64);
+
+        sys->reads = xrealloc(sys->reads, size * sizeof(proc_read_t));
+        sys->reads_size = size;
+    }
+
+    proc_read_t *read = &sys->reads[count];
+
+    memset(read, 0, sizeof(proc_read_t));
+    read->proc = proc;
+    read->child = child;
+    read->fd = fd;
+
+    return read;
+}
+
+static bool
+open_read(proc_read_t *read)
+{
+    if (read->proc == NULL)
+    {
+        if (*read->fd < 0)
+            *read->fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+
+        return *read->fd >= 0;
+    }
+
+    proc_child_t *child = read->child ? read->child->data : NULL;
+
+    return proc_open_stat(read->fd, child ? child->pid : read->proc->pid);
+}
+
+static void
+parse_read(nyx_proc_t *sys, proc_read_t *read, const char *buffer)
+{
+    if (read->proc)
+    {
+        read->valid = sys_info_parse(&read->info, buffer, sys->page_size);
+        return;
+    }
+
+    sys_proc_stat_t current;
+    memset(&current, 0, sizeof(sys_proc_stat_t));
+
+    if (sys_proc_parse(&current, buffer))
+        update_sys_total(sys, &current);
+}
+
+/* the files are read with one submission per URING_BATCH_SIZE files -
+ * if io_uring fails the remaining files are read one by one */
+static void
+read_files(nyx_proc_t *sys, uint32_t count)
+{
+    int32_t fds[URING_BATCH_SIZE];
+    int32_t results[URING_BATCH_SIZE];
+    uint32_t batch[URING_BATCH_SIZE];
+    uint32_t idx = 0;
+
+    while (idx < count)
+    {
+        uint32_t size = 0;
+
+        /* files that cannot be opened (anymore) are not read at all */
+        for (; idx < count && size < URING_BATCH_SIZE; idx++)
+        {
+            proc_read_t *read = &sys->reads[idx];
+
+            if (!open_read(read))
+                continue;
+
+            batch[size] = idx;
+            fds[size++] = *read->fd;
+        }
+
+        bool submitted = sys->uring && uring_read(sys->uring, fds, results, size);
+
+        if (sys->uring && !submitted)
+        {
+            log_warn("Failed to read /proc via io_uring - reading per process instead");
+
+            uring_destroy(sys->uring);
+            sys->uring = NULL;
+        }
+
+        for (uint32_t i = 0; i < size; i++)
+        {
+            proc_read_t *read = &sys->reads[batch[i]];
+            char *buffer = sys->buffer;
+
+            if (!submitted)
+            {
+                if (!proc_file_read(read->fd, NULL, buffer))
+                    continue;
+            }
+            else if (results[i] < 1)
+            {
+                /* i.e. ESRCH for a terminated process */
+                close(*read->fd);
+                *read->fd = -1;
+                continue;
+            }
+            else
+            {
+                buffer = uring_buffer(sys->uring, i);
+                buffer[results[i]] = '\0';
             }
 
-            /* handle memory events? */
-            if (handle_events &&
-                    proc->watch->max_memory &&
-                    stack_long_satisfy(proc->mem_usage, exceeds_mem, proc) >= PROC_STAT_STACK_LIMIT)
-            {
-                uint64_t bytes;
-                char unit = get_size_unit(proc->watch->max_memory, &bytes);
+            parse_read(sys, read, buffer);
+        }
+    }
+}
+
+/* account the reads of the process (and its descendants) starting at
+ * the given index and return the index of the next process' read */
+static uint32_t
+apply_reads(nyx_proc_t *sys, proc_stat_t *proc, uint32_t idx, uint32_t count)
+{
+    proc_read_t *read = &sys->reads[idx++];
+    int64_t memory = read->info.resident_set_size;
+    uint64_t diff = 0;
+
+    if (read->valid)
+        diff = read->info.total_time - proc->info.total_time;
+
+    for (; idx < count && sys->reads[idx].child; idx++)
+    {
+        proc_read_t *child = &sys->reads[idx];
+
+        /* the descendants of a terminated process are not accounted */
+        if (!read->valid)
+            continue;
+
+        if (!child->valid)
+        {
+            remove_child(sys, child->child);
+            continue;
+        }
+
+        diff += update_child_time(child->child->data, &child->info);
+        memory += child->info.resident_set_size;
+    }
+
+    if (read->valid)
+    {
+        if (memory)
+            stack_long_add(proc->mem_usage, memory);
+
+        memcpy(&proc->info, &read->info, sizeof(sys_info_t));
+    }
+
+    add_cpu_usage(proc, sys, diff);
+
+    return idx;
+}
+
+/* the /proc files of all processes that are due in the current tick
+ * (including their descendants and /proc/stat) are read in bulk */
+static void
+sample_uring(nyx_proc_t *sys)
+{
+    uint32_t count = 0;
+
+    if (!sys->sys_sampled)
+    {
+        next_read(sys, count++, NULL, NULL, &sys->stat_fd);
+        sys->sys_sampled = true;
+    }
+
+    uint32_t first = count;
+
+    for (uint32_t i = 0; i < sys->pending.count; i++)
+    {
+        proc_stat_t *proc = sys->pending.procs[i];
+
+        next_read(sys, count++, proc, NULL, &proc->stat_fd);
+
+        if (proc->children == NULL)
+            continue;
+
+        for (list_node_t *node = proc->children->head; node; node = node->next)
+        {
+            proc_child_t *child = node->data;
+            next_read(sys, count++, proc, node, &child->stat_fd);
+        }
+    }
+
+    read_files(sys, count);
+
+    uint32_t idx = first;
+
+    for (uint32_t i = 0; i < sys->pending.count; i++)
+    {
+        proc_stat_t *proc = sys->pending.procs[i];
+
+        idx = apply_reads(sys, proc, idx, count);
+        evaluate_proc_stats(proc, sys);
+    }
+
+    sys->pending.count = 0;
+}
+#endif
+
+static void
+stop_shards(nyx_proc_t *sys);
+
+static void *
+shard_thread(void *data)
+{
+    proc_shard_t *shard = data;
+    nyx_proc_t *sys = shard->sys;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&sys->shards_lock);
+
+    while (true)
+    {
+        while (!sys->shards_stopping && sys->shards_generation == generation)
+            pthread_cond_wait(&sys->shards_start, &sys->shards_lock);
+
+        if (sys->shards_stopping)
+            break;
+
+        generation = sys->shards_generation;
+
+        pthread_mutex_unlock(&sys->shards_lock);
+
+        /* the shard's processes are not touched by any other thread
+         * while the main loop waits for the shards to finish */
+        for (uint32_t i = 0; i < shard->pending.count; i++)
+            calculate_proc_stats(shard->pending.procs[i], sys, shard->buffer);
+
+        pthread_mutex_lock(&sys->shards_lock);
+
+        if (--sys->shards_busy == 0)
+            pthread_cond_signal(&sys->shards_done);
+    }
 
-                log_warn("Process '%s' (%d) exceeds its memory usage maximum of %" PRIu64 "%c"
-                         " in at least %d of the last %d tests",
-                         proc->name, proc->pid, bytes, unit,
-                         PROC_STAT_STACK_LIMIT, PROC_STAT_STACK_SIZE);
+    pthread_mutex_unlock(&sys->shards_lock);
 
-                handle_events = sys->event_handler(PROC_MAX_MEMORY, proc, nyx);
-            }
+    return NULL;
+}
+
+/* every shard thread is pinned to its own CPU (if possible) so the
+ * shard's process statistics stay local to that CPU's caches */
+static void
+pin_shard(proc_shard_t *shard)
+{
+#ifndef OSX
+    cpu_set_t cpus;
 
-            /* check port if specified */
-            if (handle_events)
-                handle_events = proc_port_check(proc, nyx);
+    CPU_ZERO(&cpus);
+    CPU_SET(shard->id % shard->sys->num_cpus, &cpus);
 
-            /* check HTTP endpoint if specified */
-            if (handle_events)
-                proc_http_check(proc, nyx);
+    int32_t err = pthread_setaffinity_np(shard->thread, sizeof(cpu_set_t), &cpus);
 
-            node = node->next;
+    if (err)
+    {
+        log_debug("Failed to pin proc shard %u: %s", shard->id, strerror(err));
+    }
+#else
+    (void)shard;
+#endif
+}
+
+/**
+ * @brief Sample the watched processes on the given number of worker
+ *        threads. Every process is assigned to one shard while the
+ *        evaluation of the samples and the events stay on the main loop.
+ * @param sys   proc system instance
+ * @param count number of worker threads
+ * @return true if the threads were started, false otherwise
+ */
+bool
+nyx_proc_start_shards(nyx_proc_t *sys, uint32_t count)
+{
+    if (count < 1 || sys->shards)
+        return false;
+
+    proc_shard_t *shards = xcalloc(count, sizeof(proc_shard_t));
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        proc_shard_t *shard = &shards[i];
+
+        shard->sys = sys;
+        shard->id = i;
+        shard->buffer = xcalloc(PROC_STAT_BUFFER_SIZE, sizeof(char));
+
+        int32_t err = thread_create(&shard->thread, shard_thread, shard);
+
+        if (err)
+        {
+            errno = err;
+            log_perror("nyx: pthread_create");
+            break;
         }
 
-        wait_interval(interval);
+        shard->running = true;
+        pin_shard(shard);
     }
 
-    log_debug("Stopped proc watch");
+    pthread_mutex_lock(&sys->lock);
+    sys->shards = shards;
+    sys->num_shards = count;
+    pthread_mutex_unlock(&sys->lock);
 
-    return NULL;
+    if (!shards[count - 1].running)
+    {
+        stop_shards(sys);
+        return false;
+    }
+
+    return true;
+}
+
+/* sample the due processes of all shards in parallel and evaluate
+ * their samples on the calling thread afterwards */
+static void
+sample_shards(nyx_proc_t *sys)
+{
+    uint32_t pending = 0;
+
+    for (uint32_t i = 0; i < sys->num_shards; i++)
+        pending += sys->shards[i].pending.count;
+
+    if (pending == 0)
+        return;
+
+    /* all shards share the system statistics of this tick */
+    sample_sys_total(sys);
+
+    pthread_mutex_lock(&sys->shards_lock);
+
+    sys->shards_busy = sys->num_shards;
+    sys->shards_generation++;
+
+    pthread_cond_broadcast(&sys->shards_start);
+
+    while (sys->shards_busy)
+        pthread_cond_wait(&sys->shards_done, &sys->shards_lock);
+
+    pthread_mutex_unlock(&sys->shards_lock);
+
+    /* the events are raised on a single thread only */
+    for (uint32_t i = 0; i < sys->num_shards; i++)
+    {
+        proc_queue_t *queue = &sys->shards[i].pending;
+
+        for (uint32_t j = 0; j < queue->count; j++)
+            evaluate_proc_stats(queue->procs[j], sys);
+
+        queue->count = 0;
+    }
+}
+
+/**
+ * @brief Read the /proc files of all processes that are due in one tick
+ *        via io_uring - one submission per batch of files instead of
+ *        one read per process and descendant
+ * @param sys proc system instance
+ * @return true if io_uring is used, false otherwise
+ */
+bool
+nyx_proc_use_uring(nyx_proc_t *sys)
+{
+#ifndef OSX
+    /* the taskstats do not read /proc in the first place */
+    if (sys->taskstats)
+        return false;
+
+    uring_t *uring = uring_new(PROC_STAT_BUFFER_SIZE);
+
+    if (uring == NULL)
+        return false;
+
+    pthread_mutex_lock(&sys->lock);
+    sys->uring = uring;
+    pthread_mutex_unlock(&sys->lock);
+
+    return true;
+#else
+    (void)sys;
+    return false;
+#endif
+}
+
+/**
+ * @brief Sample the processes via the TASKSTATS netlink interface
+ *        instead of reading /proc/<pid>/stat of every process
+ * @param sys     proc system instance
+ * @param reactor reactor to receive the records of exiting tasks on
+ * @return true if taskstats are used, false otherwise
+ */
+bool
+nyx_proc_use_taskstats(nyx_proc_t *sys, reactor_t *reactor)
+{
+#ifndef OSX
+    taskstats_t *taskstats = taskstats_new();
+
+    if (taskstats == NULL)
+        return false;
+
+    int32_t fd = taskstats_listen_exits(taskstats, sys->num_cpus);
+
+    if (fd >= 0 && !reactor_add_fd(reactor, fd, handle_task_exits, sys))
+        log_warn("nyx: failed to receive taskstats of exiting tasks");
+
+    pthread_mutex_lock(&sys->lock);
+    sys->taskstats = taskstats;
+    pthread_mutex_unlock(&sys->lock);
+
+    return true;
+#else
+    (void)sys;
+    (void)reactor;
+    return false;
+#endif
+}
+
+#ifndef OSX
+static void
+handle_heartbeats(UNUSED reactor_t *reactor, int32_t fd, UNUSED uint32_t events, void *data)
+{
+    nyx_proc_t *sys = data;
+    pid_t sender = 0;
+    int32_t received = 0;
+
+    pthread_mutex_lock(&sys->lock);
+
+    while ((received = watchdog_socket_receive(fd, &sender)) >= 0)
+    {
+        list_node_t *node = received ? pidmap_get(sys->index, sender) : NULL;
+
+        if (node == NULL)
+            continue;
+
+        proc_stat_t *proc = node->data;
+
+        if (proc->watch && proc->watch->watchdog)
+            wheel_add(sys->watchdog_wheel, &proc->watchdog, proc->watch->watchdog);
+    }
+
+    pthread_mutex_unlock(&sys->lock);
+}
+
+static void
+handle_watchdog_tick(UNUSED reactor_t *reactor, void *data)
+{
+    nyx_proc_t *sys = data;
+
+    pthread_mutex_lock(&sys->lock);
+    wheel_advance(sys->watchdog_wheel);
+    pthread_mutex_unlock(&sys->lock);
+}
+#endif
+
+/**
+ * @brief Receive the heartbeats of the watches with a 'watchdog' on the
+ *        given datagram socket - their deadlines are tracked on a timer
+ *        wheel of NYX_WATCHDOG_TICK_MSECS resolution (linux only)
+ * @param sys     proc system instance
+ * @param reactor reactor the socket and the deadlines are processed on
+ * @param path    socket path that is passed to the services
+ * @return true if the socket was opened successfully
+ */
+bool
+nyx_proc_use_watchdog(nyx_proc_t *sys, reactor_t *reactor, const char *path)
+{
+#ifndef OSX
+    int32_t fd = watchdog_socket_open(path);
+
+    if (fd < 0)
+        return false;
+
+    pthread_mutex_lock(&sys->lock);
+
+    sys->watchdog_wheel = wheel_new(NYX_WATCHDOG_TICK_MSECS);
+    sys->watchdog_path = xstrdup(path);
+    sys->watchdog_fd = fd;
+
+    pthread_mutex_unlock(&sys->lock);
+
+    if (!reactor_add_fd(reactor, fd, handle_heartbeats, sys))
+        log_warn("nyx: failed to receive watchdog heartbeats");
+
+    sys->watchdog_timer = reactor_add_timer(reactor, NYX_WATCHDOG_TICK_MSECS, true,
+            handle_watchdog_tick, sys);
+
+    return true;
+#else
+    (void)sys;
+    (void)reactor;
+    (void)path;
+    return false;
+#endif
+}
+
+/**
+ * @brief Run all samples and checks of the watched processes that are
+ *        due - every process is sampled and checked on its own schedule
+ * @param sys proc system instance
+ */
+void
+nyx_proc_check(nyx_proc_t *sys)
+{
+    uint64_t started = stats_now();
+
+    pthread_mutex_lock(&sys->lock);
+
+    sys->sys_sampled = false;
+
+#ifndef OSX
+    /* the listening sockets are dumped once per tick at most */
+    sockdiag_invalidate(sys->sockdiag);
+#endif
+
+    wheel_advance(sys->wheel);
+
+    if (sys->shards)
+        sample_shards(sys);
+
+#ifndef OSX
+    if (sys->pending.count && sys->taskstats)
+        sample_taskstats(sys);
+    else if (sys->pending.count)
+        sample_uring(sys);
+#endif
+
+    pthread_mutex_unlock(&sys->lock);
+
+    stats_record_since(STATS_PROC_SWEEP, started);
+}
+
+static void
+stop_shards(nyx_proc_t *sys)
+{
+    if (sys->shards == NULL)
+        return;
+
+    pthread_mutex_lock(&sys->shards_lock);
+    sys->shards_stopping = true;
+    pthread_cond_broadcast(&sys->shards_start);
+    pthread_mutex_unlock(&sys->shards_lock);
+
+    for (uint32_t i = 0; i < sys->num_shards; i++)
+    {
+        proc_shard_t *shard = &sys->shards[i];
+
+        if (shard->running)
+            pthread_join(shard->thread, NULL);
+
+        xfree(shard->buffer);
+        xfree(shard->pending.procs);
+    }
+
+    /* the processes are sampled serially from now on */
+    for (list_node_t *node = sys->processes->head; node; node = node->next)
+    {
+        proc_stat_t *stat = node->data;
+        stat->shard = NULL;
+    }
+
+    xfree(sys->shards);
+    sys->shards = NULL;
+    sys->num_shards = 0;
 }
 
 void
 nyx_proc_destroy(nyx_proc_t *proc)
 {
+    stop_shards(proc);
+
     list_destroy(proc->processes);
-    free(proc);
+    pidmap_destroy(proc->index);
+    pidmap_destroy(proc->children);
+    resolver_destroy(proc->resolver);
+#ifndef OSX
+    sockdiag_destroy(proc->sockdiag);
+#endif
+
+    if (proc->stat_fd >= 0)
+        close(proc->stat_fd);
+
+#ifndef OSX
+    if (proc->taskstats && proc->taskstats->exit_sock >= 0 && proc->data)
+    {
+        nyx_t *nyx = proc->data;
+        reactor_remove_fd(nyx->reactor, proc->taskstats->exit_sock);
+    }
+
+    taskstats_destroy(proc->taskstats);
+    uring_destroy(proc->uring);
+
+    if (proc->watchdog_fd >= 0)
+    {
+        nyx_t *nyx = proc->data;
+
+        if (nyx && nyx->reactor)
+        {
+            reactor_remove_fd(nyx->reactor, proc->watchdog_fd);
+            reactor_remove_timer(nyx->reactor, proc->watchdog_timer);
+        }
+
+        close(proc->watchdog_fd);
+        unlink(proc->watchdog_path);
+    }
+#endif
+
+    wheel_destroy(proc->wheel);
+    wheel_destroy(proc->watchdog_wheel);
+    pthread_mutex_destroy(&proc->lock);
+    pthread_mutex_destroy(&proc->shards_lock);
+    pthread_cond_destroy(&proc->shards_start);
+    pthread_cond_destroy(&proc->shards_done);
+
+    xfree(proc->pending.procs);
+    xfree(proc->samples);
+    xfree(proc->reads);
+    xfree(proc->watchdog_path);
+
+    xfree(proc->buffer);
+    xfree(proc);
 }
 
 sys_proc_stat_t *
@@ -473,33 +2276,77 @@ sys_proc_dump(sys_proc_stat_t *stat)
     log_info("  Total time:   %" PRIu64, stat->total);
 }
 
-#ifndef OSX
-static bool
-sys_proc_read_proc(sys_proc_stat_t *stat)
+static const char *
+skip_field(const char *ptr)
 {
-    FILE *proc = fopen("/proc/stat", "r");
+    while (*ptr && *ptr != ' ')
+        ptr++;
 
-    if (proc == NULL)
-    {
-        log_perror("nyx: fopen");
-        return false;
-    }
+    while (*ptr == ' ')
+        ptr++;
+
+    return ptr;
+}
+
+static const char *
+scan_number(const char *ptr, int64_t *value)
+{
+    bool negative = *ptr == '-';
+    uint64_t number = 0;
+
+    if (negative)
+        ptr++;
+
+    if (*ptr < '0' || *ptr > '9')
+        return NULL;
+
+    while (*ptr >= '0' && *ptr <= '9')
+        number = number * 10 + (*ptr++ - '0');
+
+    *value = negative ? -(int64_t)number : (int64_t)number;
+
+    while (*ptr == ' ')
+        ptr++;
+
+    return ptr;
+}
+
+/**
+ * @brief Parse the overall CPU times of the first line of /proc/stat
+ * @param stat   statistics to fill
+ * @param buffer content of /proc/stat
+ * @return true on success, false otherwise
+ */
+bool
+sys_proc_parse(sys_proc_stat_t *stat, const char *buffer)
+{
+    int64_t values[5] = {0};
 
     /* right now we are interested in the first line (cpu ...)
      * only which represents the overall cpu usage */
-    if (fscanf(proc, "%*8s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "",
-                &stat->user_time,
-                &stat->nice_time,
-                &stat->system_time,
-                &stat->idle_time,
-                &stat->iowait_time) != 5)
+    if (strncmp(buffer, "cpu ", 4) != 0)
     {
         log_error("Failed to parse /proc/stat");
-        fclose(proc);
-
         return false;
     }
 
+    const char *ptr = skip_field(buffer);
+
+    for (uint32_t i = 0; i < LEN(values); i++)
+    {
+        if ((ptr = scan_number(ptr, &values[i])) == NULL)
+        {
+            log_error("Failed to parse /proc/stat");
+            return false;
+        }
+    }
+
+    stat->user_time = values[0];
+    stat->nice_time = values[1];
+    stat->system_time = values[2];
+    stat->idle_time = values[3];
+    stat->iowait_time = values[4];
+
     /* calculate sum */
     stat->total =
         stat->user_time +
@@ -508,9 +2355,76 @@ sys_proc_read_proc(sys_proc_stat_t *stat)
         stat->idle_time +
         stat->iowait_time;
 
-    fclose(proc);
     return true;
 }
+
+/**
+ * @brief Parse the content of /proc/<pid>/stat
+ * @param sys       process information to fill
+ * @param buffer    content of /proc/<pid>/stat
+ * @param page_size system page size (in bytes)
+ * @return true on success, false otherwise
+ */
+bool
+sys_info_parse(sys_info_t *sys, const char *buffer, int64_t page_size)
+{
+    /* the process name (field 2) may contain whitespace and parentheses
+     * itself so we continue after the last closing parenthesis */
+    const char *ptr = strrchr(buffer, ')');
+
+    if (ptr == NULL || ptr[1] != ' ')
+        return false;
+
+    /* skip the process state (field 3) */
+    ptr = skip_field(ptr + 2);
+
+    for (uint32_t field = 4; field <= 24; field++)
+    {
+        int64_t value = 0;
+
+        if ((ptr = scan_number(ptr, &value)) == NULL)
+            return false;
+
+        switch (field)
+        {
+            case 14: sys->user_time = value; break;
+            case 15: sys->system_time = value; break;
+            case 16: sys->child_user_time = value; break;
+            case 17: sys->child_system_time = value; break;
+            case 23: sys->virtual_size = value; break;
+            case 24: sys->resident_set_size = value; break;
+            default: break;
+        }
+    }
+
+    /* correct RSS from 'number of pages' to 'in kilobytes' unit */
+    sys->resident_set_size *= page_size / 1024;
+
+    sys->total_time = sys->user_time +
+        sys->system_time +
+        sys->child_user_time +
+        sys->child_system_time;
+
+    return true;
+}
+
+#ifndef OSX
+static bool
+sys_proc_read_proc(sys_proc_stat_t *stat)
+{
+    int32_t fd = -1;
+    char buffer[PROC_STAT_BUFFER_SIZE];
+
+    if (!proc_file_read(&fd, "/proc/stat", buffer))
+    {
+        log_perror("nyx: read /proc/stat");
+        return false;
+    }
+
+    close(fd);
+
+    return sys_proc_parse(stat, buffer);
+}
 #else
 #include <sys/resource.h>
 #include <sys/mman.h>
@@ -573,40 +2487,26 @@ sys_info_new(void)
 bool
 sys_info_read_proc(sys_info_t *sys, pid_t pid, int64_t page_size)
 {
-    char buffer[64] = {0};
-    sprintf(buffer, "/proc/%d/stat", pid);
-    FILE *proc = NULL;
+    int32_t fd = -1;
+    char path[64] = {0};
+    char buffer[PROC_STAT_BUFFER_SIZE];
+
+    snprintf(path, LEN(path), "/proc/%d/stat", pid);
 
-    if ((proc = fopen(buffer, "r")) == NULL)
+    if (!proc_file_read(&fd, path, buffer))
     {
-        log_perror("nyx: fopen");
+        log_perror("nyx: read %s", path);
         return false;
     }
 
-    if (fscanf(proc, "%*d %*256s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu"
-               "%lu %ld %ld %*d %*d %*d %*d %*u %lu %ld",
-               &sys->user_time,
-               &sys->system_time,
-               &sys->child_user_time,
-               &sys->child_system_time,
-               &sys->virtual_size,
-               &sys->resident_set_size) != 6)
-    {
-        log_error("Failed to parse %s", buffer);
-        fclose(proc);
+    close(fd);
 
+    if (!sys_info_parse(sys, buffer, page_size))
+    {
+        log_error("Failed to parse %s", path);
         return false;
     }
 
-    /* correct RSS from 'number of pages' to 'in kilobytes' unit */
-    sys->resident_set_size *= page_size / 1024;
-
-    sys->total_time = sys->user_time +
-        sys->system_time +
-        sys->child_user_time +
-        sys->child_system_time;
-
-    fclose(proc);
     return true;
 }
 #else
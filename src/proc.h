@@ -15,20 +15,42 @@
 
 #pragma once
 
+#include "check.h"
 #include "list.h"
+#include "pidmap.h"
+#include "resolver.h"
+#include "sockdiag.h"
 #include "stack.h"
+#include "taskstats.h"
+#include "uring.h"
 #include "watch.h"
+#include "wheel.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+/* resolution of the check scheduling (in milliseconds) */
+#define NYX_PROC_TICK_MSECS 1000
+
+/* resolution of the watchdog deadlines (in milliseconds) */
+#define NYX_WATCHDOG_TICK_MSECS 100
+
+/* forks of unknown parents that are remembered for processes
+ * that are added after they forked already */
+#define NYX_PROC_RECENT_FORKS 256
+
 typedef enum
 {
     PROC_MAX_CPU,
     PROC_MAX_MEMORY,
     PROC_PORT_NOT_OPEN,
-    PROC_HTTP_CHECK_FAILED
+    PROC_HTTP_CHECK_FAILED,
+    PROC_PLUGIN_CHECK_FAILED,
+    PROC_EXEC_CHECK_FAILED,
+    PROC_WATCHDOG_MISSED,
+    PROC_MEMORY_PRESSURE
 } proc_event_e;
 
 typedef struct
@@ -47,10 +69,97 @@ typedef struct
 DECLARE_STACK(uint64_t, long)
 DECLARE_STACK(double, double)
 
+typedef struct proc_stat_t proc_stat_t;
+
+typedef struct nyx_proc_t nyx_proc_t;
+
+typedef struct
+{
+    pid_t pid;
+    /** watched process the child descends from */
+    proc_stat_t *root;
+    /** persistent descriptor of /proc/<pid>/stat */
+    int32_t stat_fd;
+    /** CPU time at the last sample */
+    uint64_t total_time;
+    /** the child was sampled before */
+    bool sampled;
+    /** link in the children of the root process */
+    list_node_t node;
+} proc_child_t;
+
+typedef struct
+{
+    pid_t parent;
+    pid_t child;
+} proc_fork_t;
+
+typedef struct
+{
+    /** running health check or NULL */
+    check_t *running;
+    /** process the check belongs to */
+    proc_stat_t *proc;
+    /** user data passed to the event handler */
+    void *data;
+    /** idle HTTP keep-alive connection (-1 if none) */
+    int32_t connection;
+    /** TLS session (and connection) of the HTTPS checks */
+    check_tls_t tls;
+    /** schedule of the next check */
+    wheel_timer_t timer;
+    /** monotonic start time (in usec) of the running check */
+    uint64_t started;
+    /** duration (in usec) and result of the latest check */
+    uint64_t latency;
+    bool success;
+    /** a check completed at least once */
+    bool checked;
+} proc_check_t;
+
+/** processes whose sample is due in the current tick */
 typedef struct
+{
+    proc_stat_t **procs;
+    uint32_t count;
+    uint32_t size;
+} proc_queue_t;
+
+/** proc file that is read in bulk via io_uring */
+typedef struct
+{
+    /** watched process the file belongs to (NULL for /proc/stat) */
+    proc_stat_t *proc;
+    /** node of the descendant (NULL for the process itself) */
+    list_node_t *child;
+    /** persistent descriptor of the file */
+    int32_t *fd;
+    /** statistics parsed from the file */
+    sys_info_t info;
+    /** the file was read and parsed successfully */
+    bool valid;
+} proc_read_t;
+
+/** worker thread sampling a fixed share of the processes */
+typedef struct
+{
+    nyx_proc_t *sys;
+    uint32_t id;
+    pthread_t thread;
+    /** the thread was started successfully */
+    bool running;
+    /** reusable buffer for reading proc files */
+    char *buffer;
+    /** processes to sample in the current tick */
+    proc_queue_t pending;
+} proc_shard_t;
+
+struct proc_stat_t
 {
     /** process ID */
     pid_t pid;
+    /** link in the watched processes */
+    list_node_t node;
     /** process statistics */
     sys_info_t info;
     /** process CPU usage (in percent) */
@@ -61,7 +170,47 @@ typedef struct
     const char *name;
     /** associated watch */
     watch_t *watch;
-} proc_stat_t;
+    /** persistent descriptor of /proc/<pid>/stat */
+    int32_t stat_fd;
+    /** asynchronous port check */
+    proc_check_t port_check;
+    /** asynchronous HTTP check */
+    proc_check_t http_check;
+    /** check run by a plugin */
+    proc_check_t plugin_check;
+    /** check command run by the forker */
+    proc_check_t exec_check;
+    /** proc system the process is watched by */
+    nyx_proc_t *sys;
+    /** schedule of the next statistics sample */
+    wheel_timer_t timer;
+    /** current sampling interval (in seconds, 0 for the default) */
+    uint32_t interval;
+    /** shard the process is sampled by (NULL if sampled serially) */
+    proc_shard_t *shard;
+    /** total system time at the last sample */
+    uint64_t sys_total;
+    /** cgroup the watch's processes are accounted in (or NULL) */
+    char *cgroup;
+    /** cgroup CPU time (in usec) at the last sample */
+    uint64_t cgroup_usage;
+    /** monotonic time (in usec) of the last cgroup sample */
+    uint64_t cgroup_time;
+    /** OOM kills of the cgroup at the last sample */
+    uint64_t oom_kills;
+    /** descendants accounted to the process (NULL if not tracked) */
+    list_t *children;
+    /** PSI memory pressure trigger (-1 if none) */
+    int32_t pressure_fd;
+    /** latest taskstats of the process */
+    taskstats_sample_t stats;
+    /** monotonic time (in usec) of the last taskstats sample */
+    uint64_t sample_time;
+    /** CPU time (in usec) of descendants that exited since the last sample */
+    uint64_t exited_time;
+    /** deadline of the next watchdog heartbeat */
+    wheel_timer_t watchdog;
+};
 
 typedef struct
 {
@@ -75,7 +224,7 @@ typedef struct
     uint64_t period;
 } sys_proc_stat_t;
 
-typedef struct
+struct nyx_proc_t
 {
     /** total system memory (in kB) */
     uint64_t total_memory;
@@ -85,23 +234,95 @@ typedef struct
     int32_t num_cpus;
     /** current system statistics */
     sys_proc_stat_t sys_proc;
+    /** the system statistics were read in the current tick */
+    bool sys_sampled;
+    /** persistent descriptor of /proc/stat */
+    int32_t stat_fd;
+    /** reusable buffer for reading proc files */
+    char *buffer;
     /** list of watched processes */
     list_t *processes;
+    /** index of the watched processes' list nodes by pid */
+    pidmap_t *index;
+    /** index of the descendants' list nodes by pid */
+    pidmap_t *children;
+    /** ring of the latest forks of untracked parents */
+    proc_fork_t recent_forks[NYX_PROC_RECENT_FORKS];
+    uint32_t recent_fork;
+    /** listening sockets for local port checks (NULL if not available) */
+    sockdiag_t *sockdiag;
+    /** address cache for remote port checks */
+    resolver_t *resolver;
+    /** schedule of all samples and checks */
+    wheel_t *wheel;
+    /** bulk statistics collector (NULL if /proc is read per process) */
+    taskstats_t *taskstats;
+    /** io_uring the proc files are read with in bulk (NULL if not used) */
+    uring_t *uring;
+    /** processes whose bulk (taskstats or io_uring) sample is due in the
+     * current tick */
+    proc_queue_t pending;
+    /** taskstats samples of the pending processes and their descendants */
+    taskstats_sample_t *samples;
+    uint32_t samples_size;
+    /** proc files of the pending processes and their descendants */
+    proc_read_t *reads;
+    uint32_t reads_size;
+    /** worker threads the processes are sampled by (NULL if serial) */
+    proc_shard_t *shards;
+    uint32_t num_shards;
+    uint32_t next_shard;
+    /** number of shards still sampling the current tick */
+    uint32_t shards_busy;
+    /** incremented for every tick the shards are started for */
+    uint64_t shards_generation;
+    bool shards_stopping;
+    /** synchronizes the shards (and their updates of the children index) */
+    pthread_mutex_t shards_lock;
+    pthread_cond_t shards_start;
+    pthread_cond_t shards_done;
+    /** default interval of samples and checks (in seconds) */
+    uint32_t interval;
+    /** random deviation of the intervals (in percent) */
+    uint32_t jitter;
+    /** socket the watchdog heartbeats are received on (-1 if disabled) */
+    int32_t watchdog_fd;
+    char *watchdog_path;
+    /** deadlines of the watchdog heartbeats (finer grained than 'wheel') */
+    wheel_t *watchdog_wheel;
+    int32_t watchdog_timer;
+    /** guards the processes and the wheel against concurrent updates */
+    pthread_mutex_t lock;
     /** process event handler */
     bool (*event_handler)(proc_event_e, proc_stat_t *, void *);
-} nyx_proc_t;
+    /** invoked with every new statistics sample of a process */
+    void (*sample_handler)(proc_stat_t *, void *);
+    /** invoked with the result of every finished check of a process */
+    void (*check_handler)(check_type_e, bool, proc_stat_t *, void *);
+    /** user data passed to the event, sample and check handlers */
+    void *data;
+};
 
 nyx_proc_t *
 nyx_proc_new(void);
 
 nyx_proc_t *
-nyx_proc_init(pid_t pid);
+nyx_proc_init(pid_t pid, uint32_t interval, uint32_t jitter);
 
 void
-nyx_proc_terminate(void);
+nyx_proc_check(nyx_proc_t *sys);
+
+bool
+nyx_proc_use_taskstats(nyx_proc_t *sys, reactor_t *reactor);
 
-void *
-nyx_proc_start(void *state);
+bool
+nyx_proc_use_uring(nyx_proc_t *sys);
+
+bool
+nyx_proc_use_watchdog(nyx_proc_t *sys, reactor_t *reactor, const char *path);
+
+bool
+nyx_proc_start_shards(nyx_proc_t *sys, uint32_t count);
 
 proc_stat_t *
 proc_stat_new(pid_t pid, const char *name, watch_t *watch);
@@ -110,7 +331,16 @@ void
 nyx_proc_remove(nyx_proc_t *proc, pid_t pid);
 
 void
-nyx_proc_add(nyx_proc_t *proc, pid_t pid, watch_t *watch);
+nyx_proc_reloaded(nyx_proc_t *proc, pid_t pid, uint64_t delay);
+
+bool
+nyx_proc_taskstats(nyx_proc_t *proc, pid_t pid, taskstats_sample_t *sample);
+
+void
+nyx_proc_add(nyx_proc_t *proc, pid_t pid, const char *name, watch_t *watch);
+
+void
+nyx_proc_fork(nyx_proc_t *proc, pid_t parent, pid_t child);
 
 void
 nyx_proc_destroy(nyx_proc_t *proc);
@@ -124,6 +354,9 @@ sys_proc_dump(sys_proc_stat_t *stat);
 bool
 sys_proc_read(sys_proc_stat_t *stat);
 
+bool
+sys_proc_parse(sys_proc_stat_t *stat, const char *buffer);
+
 sys_info_t *
 sys_info_new(void);
 
@@ -133,6 +366,9 @@ sys_info_dump(sys_info_t *sys);
 bool
 sys_info_read_proc(sys_info_t *sys, pid_t pid, int64_t page_size);
 
+bool
+sys_info_parse(sys_info_t *sys, const char *buffer, int64_t page_size);
+
 uint64_t
 total_memory_size(void);
 
@@ -16,9 +16,22 @@
 #define _GNU_SOURCE
 
 #include "fs.h"
+#include "log.h"
 #include "process.h"
 
+#include <errno.h>
+#include <inttypes.h>
 #include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef OSX
+#include <poll.h>
+#include <sys/syscall.h>
+#else
+#include <sys/event.h>
+#endif
 
 bool
 clear_pid(const char *name, nyx_t *nyx)
@@ -70,6 +83,147 @@ check_process_running(pid_t pid)
     return false;
 }
 
+#ifndef OSX
+/* boot time in seconds since the epoch */
+static uint64_t
+boot_time(void)
+{
+    char line[256];
+    uint64_t btime = 0;
+    FILE *file = fopen("/proc/stat", "re");
+
+    if (file == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (sscanf(line, "btime %" SCNu64, &btime) == 1)
+            break;
+    }
+
+    fclose(file);
+
+    return btime;
+}
+#endif
+
+/**
+ * @brief Determine the start time of the given process - together with
+ *        the pid it identifies a process across pid reuse and reboots
+ * @param pid process to inspect
+ * @return start time in clock ticks since the epoch or 0 if unknown
+ */
+uint64_t
+process_start_time(pid_t pid)
+{
+#ifndef OSX
+    char path[64], buffer[1024];
+    uint64_t start = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+    FILE *file = fopen(path, "re");
+
+    if (file == NULL)
+        return 0;
+
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+
+    buffer[length] = '\0';
+
+    /* the command name may contain spaces and parentheses - the
+     * fields are counted from its closing parenthesis on */
+    char *pos = strrchr(buffer, ')');
+
+    if (pos == NULL)
+        return 0;
+
+    /* the start time is the 22nd field (the 20th after the name) */
+    for (uint32_t field = 0; field < 20 && pos; field++)
+        pos = strchr(pos + 1, ' ');
+
+    if (pos == NULL || sscanf(pos, " %" SCNu64, &start) != 1)
+        return 0;
+
+    return boot_time() * sysconf(_SC_CLK_TCK) + start;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Open a file descriptor that becomes readable as soon as
+ *        the given process terminates
+ * @param pid process to watch
+ * @return pidfd or -1 if not supported
+ */
+int32_t
+process_exit_fd(pid_t pid)
+{
+#if !defined(OSX) && defined(SYS_pidfd_open)
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Wait for the termination of the given process
+ * @param pid     process to wait for
+ * @param timeout maximum number of milliseconds to wait for
+ * @return 1 if the process terminated, 0 on timeout and -1 if
+ *         the kernel does not support waiting on arbitrary processes
+ */
+int32_t
+wait_for_exit(pid_t pid, uint32_t timeout)
+{
+    int32_t rc = 0;
+
+#ifndef OSX
+    int32_t fd = process_exit_fd(pid);
+
+    if (fd < 0)
+        return errno == ESRCH ? 1 : -1;
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    while ((rc = poll(&pfd, 1, timeout)) == -1 && errno == EINTR)
+    {
+        /* retry */
+    }
+
+    if (rc == -1)
+        log_perror("nyx: poll");
+
+    close(fd);
+#else
+    int32_t kq = kqueue();
+
+    if (kq < 0)
+        return -1;
+
+    struct kevent change, event;
+    struct timespec until =
+    {
+        .tv_sec = timeout / 1000,
+        .tv_nsec = (timeout % 1000) * 1000000L
+    };
+
+    EV_SET(&change, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, NULL);
+
+    rc = kevent(kq, &change, 1, &event, 1, &until);
+
+    if (rc == -1 && errno == ESRCH)
+        rc = 1;
+
+    close(kq);
+#endif
+
+    return rc < 0 ? -1 : (rc > 0);
+}
+
 bool
 write_pid(pid_t pid, const char *name, nyx_t *nyx)
 {
@@ -29,7 +29,16 @@ write_pid(pid_t pid, const char *name, nyx_t *nyx);
 bool
 check_process_running(pid_t pid);
 
+uint64_t
+process_start_time(pid_t pid);
+
 bool
 clear_pid(const char *name, nyx_t *nyx);
 
+int32_t
+process_exit_fd(pid_t pid);
+
+int32_t
+wait_for_exit(pid_t pid, uint32_t timeout);
+
 /* vim: set et sw=4 sts=4 tw=80: */
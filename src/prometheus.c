@@ -0,0 +1,498 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define NYX_MEM_TAG MEM_CONNECTOR
+
+#include "def.h"
+#include "prometheus.h"
+#include "state.h"
+#include "stats.h"
+#include "utils.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+static size_t
+escape_value(char *out, const char *value)
+{
+    size_t length = 0;
+
+    while (*value)
+    {
+        char c = *value++;
+
+        if (c == '\\' || c == '"' || c == '\n')
+        {
+            out[length++] = '\\';
+            c = c == '\n' ? 'n' : c;
+        }
+
+        out[length++] = c;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Build the labels of the metrics of a watch (instance)
+ * @param watch    name of the watch
+ * @param instance name of the instance
+ * @return new label string (without braces) - free after use
+ */
+char *
+prometheus_labels(const char *watch, const char *instance)
+{
+    /* every character is escaped at most */
+    char *labels = xcalloc(2 * (strlen(watch) + strlen(instance)) + 32, sizeof(char));
+    size_t length = 0;
+
+    memcpy(labels, "watch=\"", 7);
+    length = 7;
+    length += escape_value(labels + length, watch);
+
+    memcpy(labels + length, "\",instance=\"", 12);
+    length += 12;
+    length += escape_value(labels + length, instance);
+
+    labels[length] = '"';
+
+    return labels;
+}
+
+static bool
+state_is_running(int32_t value)
+{
+    return value == STATE_RUNNING;
+}
+
+typedef enum
+{
+    METRIC_UP,
+    METRIC_STATE,
+    METRIC_PID,
+    METRIC_RESTARTS,
+    METRIC_FAILED,
+    METRIC_UPTIME,
+    METRIC_CPU,
+    METRIC_MEMORY,
+    METRIC_CHECK_SUCCESS,
+    METRIC_CHECK_LATENCY,
+    METRIC_IO_READ,
+    METRIC_IO_WRITE,
+    METRIC_CPU_DELAY,
+    METRIC_BLKIO_DELAY,
+    METRIC_SWAPIN_DELAY,
+    METRIC_MEMORY_PEAK,
+    METRIC_SIZE
+} metric_e;
+
+/* the families of the watches' states precede the ones of their processes */
+#define METRIC_PROC_FIRST METRIC_CPU
+
+typedef struct
+{
+    const char *name;
+    const char *type;
+    const char *help;
+} metric_family_t;
+
+static const metric_family_t families[METRIC_SIZE] =
+{
+    { "nyx_watch_up", "gauge", "Whether the watch is running" },
+    { "nyx_watch_state", "gauge", "Current state of the watch" },
+    { "nyx_watch_pid", "gauge", "Process ID of the watch (0 if none)" },
+    { "nyx_watch_restarts_total", "counter", "Starts of the watch after the first one" },
+    { "nyx_watch_failed_counter", "gauge", "Consecutive failures of the watch (flapping)" },
+    { "nyx_watch_uptime_seconds", "gauge", "Time since the watch is running" },
+    { "nyx_watch_cpu_percent", "gauge", "CPU usage of the watch's process" },
+    { "nyx_watch_memory_bytes", "gauge", "Resident memory of the watch's process" },
+    { "nyx_watch_check_success", "gauge", "Result of the latest health check" },
+    { "nyx_watch_check_latency_seconds", "gauge", "Duration of the latest health check" },
+    { "nyx_watch_io_read_bytes_total", "counter", "Bytes read from storage by the watch's process" },
+    { "nyx_watch_io_write_bytes_total", "counter", "Bytes written to storage by the watch's process" },
+    { "nyx_watch_cpu_delay_seconds_total", "counter", "Time the watch's process waited for a CPU" },
+    { "nyx_watch_blkio_delay_seconds_total", "counter", "Time the watch's process waited for block I/O" },
+    { "nyx_watch_swapin_delay_seconds_total", "counter", "Time the watch's process waited for swap-in" },
+    { "nyx_watch_memory_peak_bytes", "gauge", "Peak resident memory of the watch's process" },
+};
+
+/* one sample of a watch's metric family */
+static void
+render_state(strbuf_t *out, metric_e metric, state_t *state, time_t now)
+{
+    const char *name = families[metric].name;
+    const char *labels = state->labels;
+    time_t since = 0;
+
+    switch (metric)
+    {
+        case METRIC_UP:
+            strbuf_append(out, "%s{%s} %d\n", name, labels, state->state == STATE_RUNNING);
+            break;
+        case METRIC_STATE:
+            strbuf_append(out, "%s{%s,state=\"%s\"} 1\n", name, labels,
+                    state_to_human_string(state->state));
+            break;
+        case METRIC_PID:
+            strbuf_append(out, "%s{%s} %d\n", name, labels, state->pid);
+            break;
+        case METRIC_RESTARTS:
+            strbuf_append(out, "%s{%s} %u\n", name, labels,
+                    state->starts > 0 ? state->starts - 1 : 0);
+            break;
+        case METRIC_FAILED:
+            strbuf_append(out, "%s{%s} %u\n", name, labels, state->failed_counter);
+            break;
+        case METRIC_UPTIME:
+            if (state->state == STATE_RUNNING)
+                since = timestack_find_latest(state->history, state_is_running);
+
+            strbuf_append(out, "%s{%s} %lld\n", name, labels,
+                    since > 0 ? (long long)(now - since) : 0LL);
+            break;
+        default:
+            break;
+    }
+}
+
+/* the metrics collected over taskstats (if enabled) */
+static void
+render_taskstats(strbuf_t *out, metric_e metric, const char *labels,
+        const taskstats_sample_t *stats)
+{
+    const char *name = families[metric].name;
+
+    if (!stats->valid)
+        return;
+
+    switch (metric)
+    {
+        case METRIC_IO_READ:
+            strbuf_append(out, "%s{%s} %" PRIu64 "\n", name, labels, stats->read_bytes);
+            break;
+        case METRIC_IO_WRITE:
+            strbuf_append(out, "%s{%s} %" PRIu64 "\n", name, labels, stats->write_bytes);
+            break;
+        case METRIC_CPU_DELAY:
+            strbuf_append(out, "%s{%s} %.6f\n", name, labels, stats->cpu_delay / 1e9);
+            break;
+        case METRIC_BLKIO_DELAY:
+            strbuf_append(out, "%s{%s} %.6f\n", name, labels, stats->blkio_delay / 1e9);
+            break;
+        case METRIC_SWAPIN_DELAY:
+            strbuf_append(out, "%s{%s} %.6f\n", name, labels, stats->swapin_delay / 1e9);
+            break;
+        case METRIC_MEMORY_PEAK:
+            strbuf_append(out, "%s{%s} %" PRIu64 "\n", name, labels, stats->hiwater_rss * 1024);
+            break;
+        default:
+            break;
+    }
+}
+
+/* one sample of a process' metric family */
+static void
+render_proc(strbuf_t *out, metric_e metric, const char *labels, proc_stat_t *proc)
+{
+    const char *name = families[metric].name;
+    proc_check_t *checks[] = {
+        &proc->port_check, &proc->http_check, &proc->plugin_check, &proc->exec_check
+    };
+    const char *types[] = { "port", "http", "plugin", "exec" };
+
+    switch (metric)
+    {
+        case METRIC_CPU:
+            if (proc->cpu_usage->count > 0)
+                strbuf_append(out, "%s{%s} %.2f\n", name, labels,
+                        stack_double_newest(proc->cpu_usage));
+            break;
+        case METRIC_MEMORY:
+            if (proc->mem_usage->count > 0)
+                strbuf_append(out, "%s{%s} %lld\n", name, labels,
+                        (long long)stack_long_newest(proc->mem_usage) * 1024);
+            break;
+        case METRIC_CHECK_SUCCESS:
+        case METRIC_CHECK_LATENCY:
+            for (uint32_t idx = 0; idx < LEN(checks); idx++)
+            {
+                if (!checks[idx]->checked)
+                    continue;
+
+                if (metric == METRIC_CHECK_SUCCESS)
+                    strbuf_append(out, "%s{%s,check=\"%s\"} %d\n", name, labels,
+                            types[idx], checks[idx]->success);
+                else
+                    strbuf_append(out, "%s{%s,check=\"%s\"} %.6f\n", name, labels,
+                            types[idx], checks[idx]->latency / 1e6);
+            }
+            break;
+        default:
+            render_taskstats(out, metric, labels, &proc->stats);
+            break;
+    }
+}
+
+static proc_stat_t *
+find_proc(nyx_proc_t *sys, pid_t pid)
+{
+    list_node_t *node = pid > 0 ? pidmap_get(sys->index, pid) : NULL;
+
+    return node ? node->data : NULL;
+}
+
+static void
+family(strbuf_t *out, const metric_family_t *family)
+{
+    strbuf_append(out, "# HELP %s %s\n# TYPE %s %s\n",
+            family->name, family->help, family->name, family->type);
+}
+
+/* has to be called with the proc system being locked */
+static void
+render_procs(strbuf_t *out, nyx_t *nyx)
+{
+    nyx_proc_t *sys = nyx->proc;
+    proc_stat_t *proc = NULL;
+
+    for (metric_e metric = METRIC_PROC_FIRST; metric < METRIC_SIZE; metric++)
+    {
+        family(out, &families[metric]);
+
+        for (list_node_t *node = nyx->states->head; node; node = node->next)
+        {
+            state_t *state = node->data;
+
+            if ((proc = find_proc(sys, state->pid)) != NULL)
+                render_proc(out, metric, state->labels, proc);
+        }
+    }
+
+    /* nyx itself */
+    if ((proc = find_proc(sys, nyx->pid)) != NULL && proc->cpu_usage->count > 0)
+    {
+        strbuf_append(out,
+                "# HELP nyx_cpu_percent CPU usage of nyx\n"
+                "# TYPE nyx_cpu_percent gauge\n"
+                "nyx_cpu_percent %.2f\n"
+                "# HELP nyx_memory_bytes Resident memory of nyx\n"
+                "# TYPE nyx_memory_bytes gauge\n"
+                "nyx_memory_bytes %lld\n",
+                stack_double_newest(proc->cpu_usage),
+                (long long)stack_long_newest(proc->mem_usage) * 1024);
+    }
+}
+
+/* node label followed by the (optional) watch label */
+static char *
+fleet_labels(const char *node, const char *watch)
+{
+    char *labels = xcalloc(2 * (strlen(node) + (watch ? strlen(watch) : 0)) + 32, sizeof(char));
+    size_t length = 0;
+
+    memcpy(labels, "node=\"", 6);
+    length = 6;
+    length += escape_value(labels + length, node);
+    labels[length++] = '"';
+
+    if (watch)
+    {
+        memcpy(labels + length, ",watch=\"", 8);
+        length += 8;
+        length += escape_value(labels + length, watch);
+        labels[length] = '"';
+    }
+
+    return labels;
+}
+
+/* the watches of the federated nodes */
+static void
+render_fleet(strbuf_t *out, fleet_t *fleet)
+{
+    static const metric_family_t node_families[] =
+    {
+        { "nyx_fleet_node_up", "gauge", "Whether the federated node is connected" },
+        { "nyx_fleet_node_sequence", "counter", "Latest state change applied of the node" },
+    };
+    static const metric_family_t watch_families[] =
+    {
+        { "nyx_fleet_watch_up", "gauge", "Whether the watch of the node is running" },
+        { "nyx_fleet_watch_pid", "gauge", "Process ID of the watch of the node (0 if none)" },
+        { "nyx_fleet_watch_cpu_percent", "gauge", "CPU usage of the watch of the node" },
+        { "nyx_fleet_watch_memory_bytes", "gauge", "Resident memory of the watch of the node" },
+    };
+
+    fleet_node_t *node = NULL;
+    fleet_watch_t *watch = NULL;
+    const char *name = NULL, *watch_name = NULL;
+
+    pthread_mutex_lock(&fleet->lock);
+
+    for (uint32_t idx = 0; idx < LEN(node_families); idx++)
+    {
+        hash_iter_t *iter = hash_iter_start(fleet->nodes);
+
+        family(out, &node_families[idx]);
+
+        while (hash_iter(iter, &name, (void **)&node))
+        {
+            char *labels = fleet_labels(name, NULL);
+
+            if (idx == 0)
+                strbuf_append(out, "%s{%s} %d\n", node_families[idx].name, labels,
+                        node->peer != NULL);
+            else
+                strbuf_append(out, "%s{%s} %llu\n", node_families[idx].name, labels,
+                        (unsigned long long)node->seq);
+
+            xfree(labels);
+        }
+
+        hash_iter_free(iter);
+    }
+
+    for (uint32_t idx = 0; idx < LEN(watch_families); idx++)
+    {
+        hash_iter_t *iter = hash_iter_start(fleet->nodes);
+
+        family(out, &watch_families[idx]);
+
+        while (hash_iter(iter, &name, (void **)&node))
+        {
+            hash_iter_t *watches = hash_iter_start(node->watches);
+
+            while (hash_iter(watches, &watch_name, (void **)&watch))
+            {
+                char *labels = fleet_labels(name, watch_name);
+                const char *metric = watch_families[idx].name;
+
+                switch (idx)
+                {
+                    case 0:
+                        strbuf_append(out, "%s{%s} %d\n", metric, labels,
+                                watch->state == STATE_RUNNING);
+                        break;
+                    case 1:
+                        strbuf_append(out, "%s{%s} %d\n", metric, labels, watch->pid);
+                        break;
+                    case 2:
+                        if (watch->has_metrics)
+                            strbuf_append(out, "%s{%s} %.2f\n", metric, labels, watch->cpu);
+                        break;
+                    default:
+                        if (watch->has_metrics)
+                            strbuf_append(out, "%s{%s} %lld\n", metric, labels,
+                                    (long long)watch->memory * 1024);
+                        break;
+                }
+
+                xfree(labels);
+            }
+
+            hash_iter_free(watches);
+        }
+
+        hash_iter_free(iter);
+    }
+
+    pthread_mutex_unlock(&fleet->lock);
+}
+
+/* latency statistics of nyx itself as summaries */
+static void
+render_stats(strbuf_t *out)
+{
+    static const double quantiles[] = { 0.5, 0.9, 0.99 };
+    stats_snapshot_t *stats = xcalloc1(sizeof(stats_snapshot_t));
+
+    stats_read(stats);
+
+    for (stats_histogram_e i = 0; i < STATS_HISTOGRAMS; i++)
+    {
+        const stats_info_t *info = stats_histogram_info(i);
+        const stats_histogram_t *h = &stats->histograms[i];
+
+        strbuf_append(out, "# HELP %s %s\n# TYPE %s summary\n",
+                info->metric, info->help, info->metric);
+
+        for (uint32_t q = 0; q < LEN(quantiles); q++)
+        {
+            strbuf_append(out, "%s{quantile=\"%g\"} %.6f\n", info->metric, quantiles[q],
+                    stats_percentile(h, quantiles[q] * 100.0) / 1000000.0);
+        }
+
+        strbuf_append(out, "%s_sum %.6f\n%s_count %llu\n",
+                info->metric, h->sum / 1000000.0,
+                info->metric, (unsigned long long)h->count);
+    }
+
+    for (stats_counter_e i = 0; i < STATS_COUNTERS; i++)
+    {
+        const stats_info_t *info = stats_counter_info(i);
+
+        strbuf_append(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                info->metric, info->help, info->metric,
+                info->metric, (unsigned long long)stats->counters[i]);
+    }
+
+    xfree(stats);
+}
+
+/**
+ * @brief Render the metrics of all watches in the Prometheus text format
+ * @param out output buffer
+ * @param nyx nyx instance
+ */
+void
+prometheus_render(strbuf_t *out, nyx_t *nyx)
+{
+    time_t now = time(NULL);
+
+    strbuf_append(out,
+            "# HELP nyx_watches Number of watched instances\n"
+            "# TYPE nyx_watches gauge\n"
+            "nyx_watches %lu\n",
+            nyx->states ? (unsigned long)list_size(nyx->states) : 0UL);
+
+    render_stats(out);
+
+    if (nyx->fleet)
+        render_fleet(out, nyx->fleet);
+
+    if (nyx->states == NULL)
+        return;
+
+    for (metric_e metric = 0; metric < METRIC_PROC_FIRST; metric++)
+    {
+        family(out, &families[metric]);
+
+        for (list_node_t *node = nyx->states->head; node; node = node->next)
+            render_state(out, metric, node->data, now);
+    }
+
+    /* the statistics are read in one go so the proc
+     * thread is not blocked for long */
+    if (nyx->proc)
+    {
+        pthread_mutex_lock(&nyx->proc->lock);
+        render_procs(out, nyx);
+        pthread_mutex_unlock(&nyx->proc->lock);
+    }
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,31 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "nyx.h"
+#include "strbuf.h"
+
+/* content type of the text exposition format */
+#define PROMETHEUS_CONTENT_TYPE "text/plain; version=0.0.4"
+
+char *
+prometheus_labels(const char *watch, const char *instance);
+
+void
+prometheus_render(strbuf_t *out, nyx_t *nyx);
+
+/* vim: set et sw=4 sts=4 tw=80: */
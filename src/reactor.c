@@ -0,0 +1,825 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "def.h"
+#include "log.h"
+#include "process.h"
+#include "reactor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef OSX
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#else
+#include <sys/event.h>
+#endif
+
+#define REACTOR_MAX_EVENTS 32
+
+/* signal handlers cannot be passed any context so the write end of
+ * the wakeup pipe of the reactor handling signals is stored globally */
+static volatile int32_t signal_fd = -1;
+
+static void
+handle_signal(int32_t signum)
+{
+    int32_t last_errno = errno;
+    uint8_t value = signum;
+
+    if (signal_fd >= 0 && write(signal_fd, &value, 1) == -1)
+    {
+        /* nothing we can do about it */
+    }
+
+    errno = last_errno;
+}
+
+static bool
+open_pipe(int32_t fds[2])
+{
+#ifndef OSX
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        log_perror("nyx: pipe2");
+        return false;
+    }
+#else
+    if (pipe(fds) == -1)
+    {
+        log_perror("nyx: pipe");
+        return false;
+    }
+
+    for (int32_t i = 0; i < 2; i++)
+    {
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[i], F_SETFL, O_NONBLOCK);
+    }
+#endif
+
+    return true;
+}
+
+static reactor_source_t *
+source_new(reactor_source_e type, void *data)
+{
+    reactor_source_t *source = xcalloc1(sizeof(reactor_source_t));
+
+    source->type = type;
+    source->fd = -1;
+    source->events = REACTOR_READ;
+    source->data = data;
+
+    return source;
+}
+
+#ifndef OSX
+static uint32_t
+poll_events(reactor_source_t *source)
+{
+    uint32_t events = EPOLLRDHUP;
+
+    if (source->events & REACTOR_READ)
+        events |= EPOLLIN;
+    if (source->events & REACTOR_WRITE)
+        events |= EPOLLOUT;
+    if (source->events & REACTOR_PRIORITY)
+        events |= EPOLLPRI;
+
+    return events;
+}
+#else
+static int16_t
+poll_filter(reactor_source_t *source)
+{
+    /* descriptors are watched for either reading or writing */
+    return (source->events & REACTOR_WRITE) ? EVFILT_WRITE : EVFILT_READ;
+}
+#endif
+
+/* has to be called with the reactor lock being held */
+static bool
+register_source(reactor_t *reactor, reactor_source_t *source)
+{
+#ifndef OSX
+    struct epoll_event ev =
+    {
+        .events = poll_events(source),
+        .data.ptr = source
+    };
+
+    if (epoll_ctl(reactor->poll_fd, EPOLL_CTL_ADD, source->fd, &ev) == -1)
+    {
+        log_perror("nyx: epoll_ctl");
+        return false;
+    }
+#else
+    struct kevent change;
+
+    switch (source->type)
+    {
+        case REACTOR_SOURCE_TIMER:
+            /* registered on creation already */
+            break;
+        case REACTOR_SOURCE_EXIT:
+            EV_SET(&change, source->pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, source);
+            break;
+        default:
+            EV_SET(&change, source->fd, poll_filter(source), EV_ADD, 0, 0, source);
+            break;
+    }
+
+    if (source->type != REACTOR_SOURCE_TIMER &&
+        kevent(reactor->poll_fd, &change, 1, NULL, 0, NULL) == -1)
+    {
+        if (errno != ESRCH)
+            log_perror("nyx: kevent");
+        return false;
+    }
+#endif
+
+    list_add(reactor->sources, source);
+
+    return true;
+}
+
+/* has to be called with the reactor lock being held */
+static void
+unregister_source(reactor_t *reactor, list_node_t *node)
+{
+    reactor_source_t *source = node->data;
+
+#ifndef OSX
+    /* closing an owned descriptor removes it from the epoll set as well */
+    if (source->owned)
+        close(source->fd);
+    else
+        epoll_ctl(reactor->poll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+#else
+    struct kevent change;
+
+    switch (source->type)
+    {
+        case REACTOR_SOURCE_TIMER:
+            EV_SET(&change, source->timer, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+            break;
+        case REACTOR_SOURCE_EXIT:
+            EV_SET(&change, source->pid, EVFILT_PROC, EV_DELETE, 0, 0, NULL);
+            break;
+        default:
+            EV_SET(&change, source->fd, poll_filter(source), EV_DELETE, 0, 0, NULL);
+            break;
+    }
+
+    /* one-shot events are removed already */
+    kevent(reactor->poll_fd, &change, 1, NULL, 0, NULL);
+#endif
+
+    source->removed = true;
+
+    /* the source is released after the current dispatch round
+     * as pending events might still refer to it */
+    list_remove(reactor->sources, node);
+    list_add(reactor->removed, source);
+}
+
+/* has to be called with the reactor lock being held */
+static void
+remove_source(reactor_t *reactor, reactor_source_e type, int32_t key)
+{
+    list_node_t *node = reactor->sources->head;
+
+    while (node)
+    {
+        reactor_source_t *source = node->data;
+        list_node_t *next = node->next;
+
+        bool matches = source->type == type &&
+            ((type == REACTOR_SOURCE_TIMER && source->timer == key) ||
+             (type == REACTOR_SOURCE_EXIT && source->pid == key) ||
+             (type == REACTOR_SOURCE_FD && source->fd == key));
+
+        if (matches)
+        {
+            unregister_source(reactor, node);
+            return;
+        }
+
+        node = next;
+    }
+}
+
+/**
+ * @brief Create a new reactor instance
+ * @return new reactor or NULL on failure
+ */
+reactor_t *
+reactor_new(void)
+{
+    reactor_t *reactor = xcalloc1(sizeof(reactor_t));
+
+    reactor->wakeup[0] = reactor->wakeup[1] = -1;
+    reactor->sources = list_new(NULL);
+    reactor->removed = list_new(xfree_data);
+
+    pthread_mutex_init(&reactor->lock, NULL);
+
+#ifndef OSX
+    reactor->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    reactor->poll_fd = kqueue();
+#endif
+
+    if (reactor->poll_fd < 0)
+    {
+        log_perror("nyx: epoll_create1");
+        goto error;
+    }
+
+    if (!open_pipe(reactor->wakeup))
+        goto error;
+
+    reactor_source_t *wakeup = source_new(REACTOR_SOURCE_WAKEUP, NULL);
+    wakeup->fd = reactor->wakeup[0];
+
+    if (!register_source(reactor, wakeup))
+    {
+        xfree(wakeup);
+        goto error;
+    }
+
+    return reactor;
+
+error:
+    reactor_destroy(reactor);
+    return NULL;
+}
+
+/**
+ * @brief Destroy the given reactor and all its sources. Owned
+ *        descriptors (timers and process exits) are closed.
+ * @param reactor reactor to destroy
+ */
+void
+reactor_destroy(reactor_t *reactor)
+{
+    if (reactor == NULL)
+        return;
+
+    if (signal_fd == reactor->wakeup[1])
+        signal_fd = -1;
+
+    pthread_mutex_lock(&reactor->lock);
+
+    while (reactor->sources->head)
+        unregister_source(reactor, reactor->sources->head);
+
+    pthread_mutex_unlock(&reactor->lock);
+
+    list_destroy(reactor->sources);
+    list_destroy(reactor->removed);
+
+    if (reactor->wakeup[0] >= 0)
+    {
+        close(reactor->wakeup[0]);
+        close(reactor->wakeup[1]);
+    }
+
+    if (reactor->poll_fd >= 0)
+        close(reactor->poll_fd);
+
+    pthread_mutex_destroy(&reactor->lock);
+
+    xfree(reactor);
+}
+
+/**
+ * @brief Watch the given descriptor for incoming data
+ * @param reactor reactor instance
+ * @param fd      descriptor to watch (not owned by the reactor)
+ * @param handler callback invoked whenever the descriptor is readable
+ * @param data    user data passed to the handler
+ * @return true on success, false otherwise
+ */
+bool
+reactor_add_fd(reactor_t *reactor, int32_t fd, reactor_fd_handler_t handler, void *data)
+{
+    return reactor_add_fd_events(reactor, fd, REACTOR_READ, handler, data);
+}
+
+/**
+ * @brief Watch the given descriptor for the specified events
+ * @param reactor reactor instance
+ * @param fd      descriptor to watch (not owned by the reactor)
+ * @param events  REACTOR_READ and/or REACTOR_WRITE (only one of
+ *                both is supported on OSX) or REACTOR_PRIORITY (linux)
+ * @param handler callback invoked whenever one of the events occurs
+ * @param data    user data passed to the handler
+ * @return true on success, false otherwise
+ */
+bool
+reactor_add_fd_events(reactor_t *reactor, int32_t fd, uint32_t events,
+        reactor_fd_handler_t handler, void *data)
+{
+    reactor_source_t *source = source_new(REACTOR_SOURCE_FD, data);
+
+    source->fd = fd;
+    source->events = events;
+    source->handler.fd = handler;
+
+    pthread_mutex_lock(&reactor->lock);
+    bool success = register_source(reactor, source);
+    pthread_mutex_unlock(&reactor->lock);
+
+    if (!success)
+        xfree(source);
+
+    return success;
+}
+
+/**
+ * @brief Change the events an already watched descriptor is watched for
+ * @param reactor reactor instance
+ * @param fd      watched descriptor
+ * @param events  REACTOR_READ and/or REACTOR_WRITE
+ * @return true on success, false otherwise
+ */
+bool
+reactor_modify_fd(reactor_t *reactor, int32_t fd, uint32_t events)
+{
+    bool success = false;
+
+    pthread_mutex_lock(&reactor->lock);
+
+    list_node_t *node = reactor->sources->head;
+
+    while (node)
+    {
+        reactor_source_t *source = node->data;
+
+        if (source->type == REACTOR_SOURCE_FD && source->fd == fd)
+        {
+#ifndef OSX
+            source->events = events;
+
+            struct epoll_event ev =
+            {
+                .events = poll_events(source),
+                .data.ptr = source
+            };
+
+            success = epoll_ctl(reactor->poll_fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+#else
+            struct kevent changes[2];
+
+            EV_SET(&changes[0], fd, poll_filter(source), EV_DELETE, 0, 0, NULL);
+            source->events = events;
+            EV_SET(&changes[1], fd, poll_filter(source), EV_ADD, 0, 0, source);
+
+            success = kevent(reactor->poll_fd, changes, 2, NULL, 0, NULL) == 0;
+#endif
+            if (!success)
+                log_perror("nyx: epoll_ctl");
+            break;
+        }
+
+        node = node->next;
+    }
+
+    pthread_mutex_unlock(&reactor->lock);
+
+    return success;
+}
+
+/**
+ * @brief Stop watching the given descriptor - the descriptor is
+ *        not closed by the reactor
+ * @param reactor reactor instance
+ * @param fd      descriptor to remove
+ */
+void
+reactor_remove_fd(reactor_t *reactor, int32_t fd)
+{
+    pthread_mutex_lock(&reactor->lock);
+    remove_source(reactor, REACTOR_SOURCE_FD, fd);
+    pthread_mutex_unlock(&reactor->lock);
+}
+
+/**
+ * @brief Add a timer that fires after the given number of milliseconds
+ * @param reactor reactor instance
+ * @param msecs   timeout in milliseconds
+ * @param repeat  whether the timer should fire periodically
+ * @param handler callback invoked on expiration
+ * @param data    user data passed to the handler
+ * @return timer identifier or -1 on failure
+ */
+int32_t
+reactor_add_timer(reactor_t *reactor, uint32_t msecs, bool repeat,
+        reactor_timer_handler_t handler, void *data)
+{
+    reactor_source_t *source = source_new(REACTOR_SOURCE_TIMER, data);
+
+    source->handler.timer = handler;
+    source->repeat = repeat;
+    source->owned = true;
+
+    /* zero would disarm the timer */
+    msecs = MAX(msecs, 1);
+
+    pthread_mutex_lock(&reactor->lock);
+
+#ifndef OSX
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(struct itimerspec));
+
+    spec.it_value.tv_sec = msecs / 1000;
+    spec.it_value.tv_nsec = (msecs % 1000) * 1000000L;
+
+    if (repeat)
+        spec.it_interval = spec.it_value;
+
+    source->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (source->fd < 0)
+    {
+        log_perror("nyx: timerfd_create");
+        goto error;
+    }
+
+    if (timerfd_settime(source->fd, 0, &spec, NULL) == -1)
+    {
+        log_perror("nyx: timerfd_settime");
+        close(source->fd);
+        goto error;
+    }
+
+    source->timer = source->fd;
+
+    if (!register_source(reactor, source))
+    {
+        close(source->fd);
+        goto error;
+    }
+#else
+    struct kevent change;
+
+    source->timer = ++reactor->next_timer;
+
+    EV_SET(&change, source->timer, EVFILT_TIMER,
+            EV_ADD | (repeat ? 0 : EV_ONESHOT), 0, msecs, source);
+
+    if (kevent(reactor->poll_fd, &change, 1, NULL, 0, NULL) == -1)
+    {
+        log_perror("nyx: kevent");
+        goto error;
+    }
+
+    register_source(reactor, source);
+#endif
+
+    pthread_mutex_unlock(&reactor->lock);
+
+    return source->timer;
+
+error:
+    pthread_mutex_unlock(&reactor->lock);
+    xfree(source);
+
+    return -1;
+}
+
+/**
+ * @brief Cancel the given timer
+ * @param reactor reactor instance
+ * @param timer   timer identifier as returned by reactor_add_timer
+ */
+void
+reactor_remove_timer(reactor_t *reactor, int32_t timer)
+{
+    pthread_mutex_lock(&reactor->lock);
+    remove_source(reactor, REACTOR_SOURCE_TIMER, timer);
+    pthread_mutex_unlock(&reactor->lock);
+}
+
+/**
+ * @brief Get notified on the termination of the given process
+ *        (via a pidfd on linux and EVFILT_PROC on OSX)
+ * @param reactor reactor instance
+ * @param pid     process to watch
+ * @param handler callback invoked once the process terminated
+ * @param data    user data passed to the handler
+ * @return 1 on success, 0 if the process terminated already and
+ *         -1 if process exits cannot be watched at all
+ */
+int32_t
+reactor_add_exit(reactor_t *reactor, pid_t pid, reactor_exit_handler_t handler, void *data)
+{
+    reactor_source_t *source = source_new(REACTOR_SOURCE_EXIT, data);
+
+    source->pid = pid;
+    source->handler.exit = handler;
+
+#ifndef OSX
+    source->fd = process_exit_fd(pid);
+    source->owned = true;
+
+    if (source->fd < 0)
+    {
+        int32_t error = errno;
+
+        xfree(source);
+        return error == ESRCH ? 0 : -1;
+    }
+#endif
+
+    pthread_mutex_lock(&reactor->lock);
+    bool success = register_source(reactor, source);
+    pthread_mutex_unlock(&reactor->lock);
+
+    if (!success)
+    {
+        int32_t error = errno;
+
+#ifndef OSX
+        close(source->fd);
+#endif
+        xfree(source);
+
+        return error == ESRCH ? 0 : -1;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Stop watching the termination of the given process
+ * @param reactor reactor instance
+ * @param pid     process to remove
+ */
+void
+reactor_remove_exit(reactor_t *reactor, pid_t pid)
+{
+    pthread_mutex_lock(&reactor->lock);
+    remove_source(reactor, REACTOR_SOURCE_EXIT, pid);
+    pthread_mutex_unlock(&reactor->lock);
+}
+
+/**
+ * @brief Handle the given signal on the reactor's thread. Only one
+ *        reactor per process is supposed to handle signals.
+ * @param reactor reactor instance
+ * @param signum  signal to handle
+ * @param handler callback invoked on every received signal
+ * @param data    user data passed to the handler
+ * @return true on success, false otherwise
+ */
+bool
+reactor_add_signal(reactor_t *reactor, int32_t signum,
+        reactor_signal_handler_t handler, void *data)
+{
+    reactor_source_t *source = source_new(REACTOR_SOURCE_SIGNAL, data);
+
+    source->signum = signum;
+    source->handler.signal = handler;
+
+    /* signals are forwarded via the wakeup pipe which is
+     * registered in the poller already */
+    pthread_mutex_lock(&reactor->lock);
+    list_add(reactor->sources, source);
+    pthread_mutex_unlock(&reactor->lock);
+
+    signal_fd = reactor->wakeup[1];
+
+    struct sigaction action =
+    {
+        .sa_flags = SA_NOCLDSTOP | SA_RESTART,
+        .sa_handler = handle_signal
+    };
+
+    sigfillset(&action.sa_mask);
+
+    if (sigaction(signum, &action, NULL) == -1)
+    {
+        log_perror("nyx: sigaction");
+        return false;
+    }
+
+    return true;
+}
+
+static void
+dispatch_signal(reactor_t *reactor, int32_t signum)
+{
+    pthread_mutex_lock(&reactor->lock);
+
+    list_node_t *node = reactor->sources->head;
+
+    while (node)
+    {
+        reactor_source_t *source = node->data;
+        node = node->next;
+
+        if (source->type != REACTOR_SOURCE_SIGNAL || source->signum != signum)
+            continue;
+
+        pthread_mutex_unlock(&reactor->lock);
+        source->handler.signal(reactor, signum, source->data);
+        pthread_mutex_lock(&reactor->lock);
+
+        /* the sources might have been modified meanwhile */
+        break;
+    }
+
+    pthread_mutex_unlock(&reactor->lock);
+}
+
+static void
+handle_wakeup(reactor_t *reactor)
+{
+    uint8_t buffer[64];
+    ssize_t bytes = 0;
+
+    while ((bytes = read(reactor->wakeup[0], buffer, sizeof(buffer))) > 0)
+    {
+        /* zero bytes are plain wakeups - everything else is a signal */
+        for (ssize_t i = 0; i < bytes; i++)
+        {
+            if (buffer[i])
+                dispatch_signal(reactor, buffer[i]);
+        }
+    }
+}
+
+static void
+dispatch(reactor_t *reactor, reactor_source_t *source, uint32_t events)
+{
+    pthread_mutex_lock(&reactor->lock);
+
+    bool removed = source->removed;
+
+    bool oneshot = source->type == REACTOR_SOURCE_EXIT ||
+        (source->type == REACTOR_SOURCE_TIMER && !source->repeat);
+
+    /* one-shot sources are removed before being dispatched */
+    if (!removed && oneshot)
+    {
+        list_node_t *node = reactor->sources->head;
+
+        while (node && node->data != source)
+            node = node->next;
+
+        if (node)
+            unregister_source(reactor, node);
+    }
+
+    pthread_mutex_unlock(&reactor->lock);
+
+    if (removed)
+        return;
+
+    switch (source->type)
+    {
+        case REACTOR_SOURCE_FD:
+            source->handler.fd(reactor, source->fd, events, source->data);
+            break;
+
+        case REACTOR_SOURCE_TIMER:
+        {
+#ifndef OSX
+            uint64_t expirations = 0;
+
+            /* one-shot timers are closed already */
+            if (source->repeat && read(source->fd, &expirations, sizeof(expirations)) < 1)
+                break;
+#endif
+            source->handler.timer(reactor, source->data);
+            break;
+        }
+
+        case REACTOR_SOURCE_EXIT:
+            source->handler.exit(reactor, source->pid, source->data);
+            break;
+
+        case REACTOR_SOURCE_WAKEUP:
+            handle_wakeup(reactor);
+            break;
+
+        case REACTOR_SOURCE_SIGNAL:
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Run the reactor's event loop until reactor_stop is called
+ * @param reactor reactor instance
+ * @return true on regular termination, false on failure
+ */
+bool
+reactor_run(reactor_t *reactor)
+{
+#ifndef OSX
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+#else
+    struct kevent events[REACTOR_MAX_EVENTS];
+#endif
+
+    log_debug("Starting reactor loop");
+
+    while (!reactor->stopping)
+    {
+#ifndef OSX
+        int32_t n = epoll_wait(reactor->poll_fd, events, REACTOR_MAX_EVENTS, -1);
+#else
+        int32_t n = kevent(reactor->poll_fd, NULL, 0, events, REACTOR_MAX_EVENTS, NULL);
+#endif
+
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_perror("nyx: epoll_wait");
+            return false;
+        }
+
+        for (int32_t i = 0; i < n; i++)
+        {
+#ifndef OSX
+            reactor_source_t *source = events[i].data.ptr;
+            uint32_t flags = 0;
+
+            if (events[i].events & EPOLLIN)
+                flags |= REACTOR_READ;
+            if (events[i].events & EPOLLOUT)
+                flags |= REACTOR_WRITE;
+            if (events[i].events & EPOLLPRI)
+                flags |= REACTOR_PRIORITY;
+            if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                flags |= REACTOR_HANGUP;
+#else
+            reactor_source_t *source = events[i].udata;
+            uint32_t flags = events[i].filter == EVFILT_WRITE ? REACTOR_WRITE : REACTOR_READ;
+
+            if (events[i].flags & (EV_EOF | EV_ERROR))
+                flags |= REACTOR_HANGUP;
+#endif
+
+            dispatch(reactor, source, flags);
+        }
+
+        /* release all sources that were removed in this round */
+        pthread_mutex_lock(&reactor->lock);
+
+        while (reactor->removed->head)
+            list_remove(reactor->removed, reactor->removed->head);
+
+        pthread_mutex_unlock(&reactor->lock);
+    }
+
+    log_debug("Reactor loop terminated");
+
+    return true;
+}
+
+/**
+ * @brief Stop the reactor's event loop - may be called from any
+ *        thread and from signal handlers
+ * @param reactor reactor instance
+ */
+void
+reactor_stop(reactor_t *reactor)
+{
+    uint8_t value = 0;
+
+    reactor->stopping = true;
+
+    if (write(reactor->wakeup[1], &value, 1) == -1)
+    {
+        /* the pipe is full so the reactor wakes up anyways */
+    }
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
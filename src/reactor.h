@@ -0,0 +1,141 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "list.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* the descriptor is readable */
+#define REACTOR_READ 1
+/* the peer hung up or an error occurred on the descriptor */
+#define REACTOR_HANGUP 2
+/* the descriptor is writable */
+#define REACTOR_WRITE 4
+/* an exceptional condition (i.e. a PSI trigger) occurred (linux only) */
+#define REACTOR_PRIORITY 8
+
+typedef struct reactor_t reactor_t;
+
+typedef void (*reactor_fd_handler_t)(reactor_t *reactor, int32_t fd, uint32_t events, void *data);
+
+typedef void (*reactor_timer_handler_t)(reactor_t *reactor, void *data);
+
+typedef void (*reactor_exit_handler_t)(reactor_t *reactor, pid_t pid, void *data);
+
+typedef void (*reactor_signal_handler_t)(reactor_t *reactor, int32_t signum, void *data);
+
+typedef enum
+{
+    REACTOR_SOURCE_FD,
+    REACTOR_SOURCE_TIMER,
+    REACTOR_SOURCE_EXIT,
+    REACTOR_SOURCE_SIGNAL,
+    REACTOR_SOURCE_WAKEUP
+} reactor_source_e;
+
+typedef struct
+{
+    reactor_source_e type;
+    /** watched descriptor (timerfd and pidfd on linux) */
+    int32_t fd;
+    /** events the descriptor is watched for (REACTOR_READ/REACTOR_WRITE) */
+    uint32_t events;
+    /** watched process */
+    pid_t pid;
+    /** timer identifier */
+    int32_t timer;
+    /** signal number */
+    int32_t signum;
+    /** the timer fires periodically */
+    bool repeat;
+    /** the source was removed and must not be dispatched anymore */
+    bool removed;
+    /** the reactor owns the descriptor and closes it on removal */
+    bool owned;
+    union
+    {
+        reactor_fd_handler_t fd;
+        reactor_timer_handler_t timer;
+        reactor_exit_handler_t exit;
+        reactor_signal_handler_t signal;
+    } handler;
+    void *data;
+} reactor_source_t;
+
+/**
+ * Single event loop multiplexing descriptors, timers, process exits
+ * and signals via epoll (kqueue on OSX). All handlers are invoked on
+ * the thread running reactor_run(). Sources may be added and removed
+ * from any thread.
+ */
+struct reactor_t
+{
+    int32_t poll_fd;
+    int32_t wakeup[2];
+    int32_t next_timer;
+    volatile bool stopping;
+    list_t *sources;
+    list_t *removed;
+    pthread_mutex_t lock;
+};
+
+reactor_t *
+reactor_new(void);
+
+void
+reactor_destroy(reactor_t *reactor);
+
+bool
+reactor_add_fd(reactor_t *reactor, int32_t fd, reactor_fd_handler_t handler, void *data);
+
+bool
+reactor_add_fd_events(reactor_t *reactor, int32_t fd, uint32_t events,
+        reactor_fd_handler_t handler, void *data);
+
+bool
+reactor_modify_fd(reactor_t *reactor, int32_t fd, uint32_t events);
+
+void
+reactor_remove_fd(reactor_t *reactor, int32_t fd);
+
+int32_t
+reactor_add_timer(reactor_t *reactor, uint32_t msecs, bool repeat,
+        reactor_timer_handler_t handler, void *data);
+
+void
+reactor_remove_timer(reactor_t *reactor, int32_t timer);
+
+int32_t
+reactor_add_exit(reactor_t *reactor, pid_t pid, reactor_exit_handler_t handler, void *data);
+
+void
+reactor_remove_exit(reactor_t *reactor, pid_t pid);
+
+bool
+reactor_add_signal(reactor_t *reactor, int32_t signum,
+        reactor_signal_handler_t handler, void *data);
+
+bool
+reactor_run(reactor_t *reactor);
+
+void
+reactor_stop(reactor_t *reactor);
+
+/* vim: set et sw=4 sts=4 tw=80: */
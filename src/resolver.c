@@ -0,0 +1,312 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_PROC
+
+#include "def.h"
+#include "log.h"
+#include "resolver.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/* failed resolutions are retried after this number of seconds */
+#define NYX_RESOLVER_RETRY_SECS 5
+
+static time_t
+monotonic_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec;
+}
+
+/**
+ * @brief Resolve the IPv4 addresses of the given host synchronously.
+ *        Numeric addresses are converted without any lookup.
+ * @param host      host name or IPv4 address
+ * @param addresses array to store the addresses in
+ * @param max       size of the address array
+ * @return number of addresses or RESOLVER_FAILED
+ */
+int32_t
+resolve_host(const char *host, struct sockaddr_in *addresses, int32_t max)
+{
+    int32_t count = 0;
+    struct addrinfo hints, *result = NULL;
+
+    memset(addresses, 0, sizeof(struct sockaddr_in));
+    addresses->sin_family = AF_INET;
+
+    if (inet_pton(AF_INET, host, &addresses->sin_addr) == 1)
+        return 1;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int32_t err = getaddrinfo(host, NULL, &hints, &result);
+    if (err != 0)
+    {
+        log_warn("nyx: getaddrinfo: %s", gai_strerror(err));
+        return RESOLVER_FAILED;
+    }
+
+    for (struct addrinfo *rp = result; rp != NULL && count < max; rp = rp->ai_next)
+    {
+        if (rp->ai_family != AF_INET)
+            continue;
+
+        memcpy(&addresses[count++], rp->ai_addr, sizeof(struct sockaddr_in));
+    }
+
+    freeaddrinfo(result);
+
+    return count > 0 ? count : RESOLVER_FAILED;
+}
+
+static void
+resolver_entry_free(void *data)
+{
+    resolver_entry_t *entry = data;
+
+    xfree((void *)entry->host);
+    xfree(entry);
+}
+
+/* has to be called with the resolver lock being held */
+static resolver_entry_t *
+next_pending(resolver_t *resolver)
+{
+    list_node_t *node = resolver->entries->head;
+
+    while (node)
+    {
+        resolver_entry_t *entry = node->data;
+
+        if (entry->pending)
+            return entry;
+
+        node = node->next;
+    }
+
+    return NULL;
+}
+
+static void *
+resolver_thread(void *data)
+{
+    resolver_t *resolver = data;
+    struct sockaddr_in addresses[RESOLVER_MAX_ADDRESSES];
+
+    pthread_mutex_lock(&resolver->lock);
+
+    while (!resolver->stopping)
+    {
+        resolver_entry_t *entry = next_pending(resolver);
+
+        if (entry == NULL)
+        {
+            pthread_cond_wait(&resolver->wakeup, &resolver->lock);
+            continue;
+        }
+
+        /* entries are never removed while the resolver is
+         * running and their host is immutable */
+        pthread_mutex_unlock(&resolver->lock);
+
+        int32_t count = resolve_host(entry->host, addresses, RESOLVER_MAX_ADDRESSES);
+
+        pthread_mutex_lock(&resolver->lock);
+
+        if (count > 0)
+        {
+            memcpy(entry->addresses, addresses, count * sizeof(struct sockaddr_in));
+            entry->count = count;
+            entry->expires = monotonic_now() + resolver->ttl;
+        }
+        else
+        {
+            /* keep the last known addresses (if any) */
+            if (entry->count == RESOLVER_PENDING)
+                entry->count = RESOLVER_FAILED;
+
+            entry->expires = monotonic_now() + NYX_RESOLVER_RETRY_SECS;
+
+            log_warn("Failed to resolve '%s'%s", entry->host,
+                    entry->count > 0 ? " - using last known addresses" : "");
+        }
+
+        entry->pending = false;
+    }
+
+    pthread_mutex_unlock(&resolver->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Create a new resolver cache. The resolver thread is started
+ *        with the first lookup that needs one.
+ * @param ttl number of seconds resolved addresses are reused for
+ * @return new resolver instance
+ */
+resolver_t *
+resolver_new(uint32_t ttl)
+{
+    resolver_t *resolver = xcalloc1(sizeof(resolver_t));
+
+    resolver->ttl = ttl;
+    resolver->entries = list_new(resolver_entry_free);
+
+    pthread_mutex_init(&resolver->lock, NULL);
+    pthread_cond_init(&resolver->wakeup, NULL);
+
+    return resolver;
+}
+
+/* has to be called with the resolver lock being held */
+static bool
+start_thread(resolver_t *resolver)
+{
+    if (resolver->thread)
+        return true;
+
+    resolver->thread = xcalloc1(sizeof(pthread_t));
+
+    int32_t err = pthread_create(resolver->thread, NULL, resolver_thread, resolver);
+
+    if (err)
+    {
+        errno = err;
+        log_perror("nyx: pthread_create");
+
+        xfree(resolver->thread);
+        resolver->thread = NULL;
+
+        return false;
+    }
+
+    return true;
+}
+
+/* has to be called with the resolver lock being held */
+static resolver_entry_t *
+find_entry(resolver_t *resolver, const char *host)
+{
+    list_node_t *node = resolver->entries->head;
+
+    while (node)
+    {
+        resolver_entry_t *entry = node->data;
+
+        if (strcmp(entry->host, host) == 0)
+            return entry;
+
+        node = node->next;
+    }
+
+    resolver_entry_t *entry = xcalloc1(sizeof(resolver_entry_t));
+
+    entry->host = xstrdup(host);
+    entry->count = RESOLVER_PENDING;
+
+    list_add(resolver->entries, entry);
+
+    return entry;
+}
+
+/**
+ * @brief Look up the cached addresses of the given host without
+ *        blocking. Missing or expired entries are (re)resolved in
+ *        the background.
+ * @param resolver  resolver instance
+ * @param host      host name or IPv4 address
+ * @param addresses array to copy the addresses to
+ * @param max       size of the address array
+ * @return number of addresses, RESOLVER_PENDING if the host was not
+ *         resolved yet or RESOLVER_FAILED if it could not be resolved
+ */
+int32_t
+resolver_lookup(resolver_t *resolver, const char *host,
+        struct sockaddr_in *addresses, int32_t max)
+{
+    /* numeric addresses need no resolution at all */
+    memset(addresses, 0, sizeof(struct sockaddr_in));
+    addresses->sin_family = AF_INET;
+
+    if (inet_pton(AF_INET, host, &addresses->sin_addr) == 1)
+        return 1;
+
+    pthread_mutex_lock(&resolver->lock);
+
+    resolver_entry_t *entry = find_entry(resolver, host);
+    int32_t count = entry->count;
+
+    if (!entry->pending && (count == RESOLVER_PENDING || monotonic_now() >= entry->expires))
+    {
+        if (start_thread(resolver))
+        {
+            entry->pending = true;
+            pthread_cond_signal(&resolver->wakeup);
+        }
+        else if (count == RESOLVER_PENDING)
+            count = RESOLVER_FAILED;
+    }
+
+    if (count > 0)
+    {
+        count = MIN(count, max);
+        memcpy(addresses, entry->addresses, count * sizeof(struct sockaddr_in));
+    }
+
+    pthread_mutex_unlock(&resolver->lock);
+
+    return count;
+}
+
+void
+resolver_destroy(resolver_t *resolver)
+{
+    if (resolver == NULL)
+        return;
+
+    if (resolver->thread)
+    {
+        pthread_mutex_lock(&resolver->lock);
+        resolver->stopping = true;
+        pthread_cond_signal(&resolver->wakeup);
+        pthread_mutex_unlock(&resolver->lock);
+
+        pthread_join(*resolver->thread, NULL);
+        xfree(resolver->thread);
+    }
+
+    list_destroy(resolver->entries);
+
+    pthread_mutex_destroy(&resolver->lock);
+    pthread_cond_destroy(&resolver->wakeup);
+
+    xfree(resolver);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,75 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "list.h"
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* addresses of a host that are tried one after another */
+#define RESOLVER_MAX_ADDRESSES 8
+
+/* the lookup was not answered yet */
+#define RESOLVER_PENDING 0
+/* the host could not be resolved (and never was before) */
+#define RESOLVER_FAILED -1
+
+typedef struct
+{
+    const char *host;
+    struct sockaddr_in addresses[RESOLVER_MAX_ADDRESSES];
+    /** number of addresses, RESOLVER_PENDING or RESOLVER_FAILED */
+    int32_t count;
+    /** monotonic time (in seconds) the entry is resolved again */
+    time_t expires;
+    /** the entry is queued for (or in) resolution */
+    bool pending;
+} resolver_entry_t;
+
+/**
+ * Cache of resolved host addresses. Host names are resolved by a
+ * background thread so lookups never block. Expired entries keep
+ * answering with their last known addresses until they are refreshed.
+ */
+typedef struct
+{
+    /** seconds resolved addresses are reused */
+    uint32_t ttl;
+    list_t *entries;
+    bool stopping;
+    pthread_t *thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+} resolver_t;
+
+int32_t
+resolve_host(const char *host, struct sockaddr_in *addresses, int32_t max);
+
+resolver_t *
+resolver_new(uint32_t ttl);
+
+int32_t
+resolver_lookup(resolver_t *resolver, const char *host,
+        struct sockaddr_in *addresses, int32_t max);
+
+void
+resolver_destroy(resolver_t *resolver);
+
+/* vim: set et sw=4 sts=4 tw=80: */
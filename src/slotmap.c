@@ -0,0 +1,218 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "def.h"
+#include "log.h"
+#include "slotmap.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+size_t
+slotmap_size(const slotmap_layout_t *layout, uint32_t slots)
+{
+    return layout->header_size + slots * layout->slot_size;
+}
+
+/**
+ * @brief Map the table of the given file - the file has to contain the
+ *        header at least
+ * @param map    slot map to initialize
+ * @param layout layout of the table
+ * @param fd     file descriptor of the table (opened read-write)
+ * @return true on success, false otherwise
+ */
+bool
+slotmap_map(slotmap_t *map, const slotmap_layout_t *layout, int32_t fd)
+{
+    size_t size = slotmap_size(layout, layout->max_slots);
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (addr == MAP_FAILED)
+    {
+        log_perror("nyx: mmap");
+        return false;
+    }
+
+    map->layout = layout;
+    map->fd = fd;
+    map->size = size;
+    map->header = addr;
+    map->slots = (char *)addr + layout->header_size;
+    map->count = (uint32_t *)((char *)addr + layout->count_offset);
+
+    return true;
+}
+
+static void *
+slot_at(slotmap_t *map, uint32_t idx)
+{
+    return map->slots + idx * map->layout->slot_size;
+}
+
+static char *
+slot_name(slotmap_t *map, uint32_t idx)
+{
+    return (char *)slot_at(map, idx) + map->layout->name_offset;
+}
+
+static int32_t
+find_slot(slotmap_t *map, const char *name)
+{
+    for (uint32_t idx = 0; idx < *map->count; idx++)
+    {
+        if (strncmp(slot_name(map, idx), name, map->layout->name_size) == 0)
+            return idx;
+    }
+
+    return -1;
+}
+
+static bool
+fits(slotmap_t *map, const char *name)
+{
+    return strlen(name) < map->layout->name_size;
+}
+
+/**
+ * @brief Prepare the table for the given names: the slots of removed
+ *        names are released and the table is grown so every name finds
+ *        a slot
+ * @param map   slot map
+ * @param names names of the configured watches (and their instances)
+ * @return true on success, false otherwise
+ *
+ * This must not be called while the state of a removed watch may still
+ * write to its slot.
+ */
+bool
+slotmap_prepare(slotmap_t *map, hash_t *names)
+{
+    uint32_t needed = 0, available = 0;
+    const slotmap_layout_t *layout = map->layout;
+    const char *name = NULL;
+    void *data = NULL;
+
+    for (uint32_t idx = 0; idx < *map->count; idx++)
+    {
+        char *slot = slot_at(map, idx);
+        const char *name_field = slot + layout->name_offset;
+
+        if (*name_field && hash_get(names, name_field) == NULL)
+        {
+            log_debug("Releasing %s of removed watch '%s'", layout->description, name_field);
+
+            if (map->update)
+                map->update(slot, idx, NULL, map->data);
+            else
+                memset(slot, 0, layout->slot_size);
+        }
+
+        if (*name_field == '\0')
+            available++;
+    }
+
+    hash_iter_t *iter = hash_iter_start(names);
+
+    while (hash_iter(iter, &name, &data))
+    {
+        if (fits(map, name) && find_slot(map, name) < 0)
+            needed++;
+    }
+
+    hash_iter_free(iter);
+
+    if (needed <= available)
+        return true;
+
+    uint32_t slots = *map->count + needed - available;
+
+    if (slots > layout->max_slots)
+    {
+        log_warn("The %s of at most %u watches can be kept", layout->description,
+                layout->max_slots);
+        slots = layout->max_slots;
+    }
+
+    /* the new slots are zero-filled by the kernel - they are
+     * inside the mapping already */
+    if (ftruncate(map->fd, slotmap_size(layout, slots)) != 0)
+    {
+        log_perror("nyx: ftruncate");
+        return false;
+    }
+
+    __atomic_store_n(map->count, slots, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * @brief Find (or allocate) the slot of the given name
+ * @param map  slot map
+ * @param name watch name
+ * @return slot index or -1 if there is no slot for the name
+ */
+int32_t
+slotmap_slot(slotmap_t *map, const char *name)
+{
+    if (!fits(map, name))
+        return -1;
+
+    int32_t idx = find_slot(map, name);
+
+    if (idx >= 0)
+        return idx;
+
+    for (uint32_t free_idx = 0; free_idx < *map->count; free_idx++)
+    {
+        char *name_field = slot_name(map, free_idx);
+
+        if (*name_field == '\0')
+        {
+            if (map->update)
+                map->update(slot_at(map, free_idx), free_idx, name, map->data);
+            else
+                strncpy(name_field, name, map->layout->name_size - 1);
+
+            return free_idx;
+        }
+    }
+
+    return -1;
+}
+
+void *
+slotmap_get(slotmap_t *map, int32_t idx)
+{
+    if (map->header == NULL || idx < 0 || (uint32_t)idx >= *map->count)
+        return NULL;
+
+    return slot_at(map, idx);
+}
+
+void
+slotmap_unmap(slotmap_t *map)
+{
+    if (map->header)
+        munmap(map->header, map->size);
+
+    map->header = NULL;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,79 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "hash.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** layout of a memory-mapped table of fixed-size slots keyed by name */
+typedef struct
+{
+    /** what the table keeps (used in log messages) */
+    const char *description;
+    size_t header_size;
+    /** offset of the (uint32_t) number of slots in the header */
+    size_t count_offset;
+    size_t slot_size;
+    size_t name_offset;
+    /** size of the name field (including '\0') */
+    size_t name_size;
+    /** the mapping is reserved for this many slots up front so the table
+     * can grow without moving the slots that are being written to */
+    uint32_t max_slots;
+} slotmap_layout_t;
+
+/**
+ * Called whenever a slot is assigned to the given name or released
+ * (name is NULL) so the owner can serialize the update with its writers.
+ * Without a callback the name is copied and released slots are zeroed.
+ */
+typedef void (*slotmap_update_t)(void *slot, int32_t idx, const char *name, void *data);
+
+typedef struct
+{
+    const slotmap_layout_t *layout;
+    int32_t fd;
+    /** size of the mapping (not of the file) */
+    size_t size;
+    void *header;
+    char *slots;
+    uint32_t *count;
+    slotmap_update_t update;
+    void *data;
+} slotmap_t;
+
+size_t
+slotmap_size(const slotmap_layout_t *layout, uint32_t slots);
+
+bool
+slotmap_map(slotmap_t *map, const slotmap_layout_t *layout, int32_t fd);
+
+bool
+slotmap_prepare(slotmap_t *map, hash_t *names);
+
+int32_t
+slotmap_slot(slotmap_t *map, const char *name);
+
+void *
+slotmap_get(slotmap_t *map, int32_t idx);
+
+void
+slotmap_unmap(slotmap_t *map);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,156 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define NYX_MEM_TAG MEM_CONNECTOR
+
+#include "def.h"
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Create a new snapshot cache
+ * @param render function that renders the output of a snapshot
+ * @param data   user data passed to the render function
+ * @return new snapshot cache
+ */
+snapshot_t *
+snapshot_new(snapshot_render_t render, void *data)
+{
+    snapshot_t *snapshot = xcalloc1(sizeof(snapshot_t));
+
+    pthread_mutex_init(&snapshot->lock, NULL);
+
+    /* zero is never a valid generation */
+    snapshot->generation = 1;
+    snapshot->epoch = time(NULL);
+    snapshot->render = render;
+    snapshot->data = data;
+
+    return snapshot;
+}
+
+/**
+ * @brief Invalidate all rendered snapshots (callable from any thread)
+ * @param snapshot snapshot cache (may be NULL)
+ */
+void
+snapshot_invalidate(snapshot_t *snapshot)
+{
+    if (snapshot == NULL)
+        return;
+
+    __atomic_add_fetch(&snapshot->generation, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Retrieve the up-to-date output of the given type - the output
+ *        is rendered only if the watches changed in the meantime
+ * @param snapshot snapshot cache
+ * @param type     type of the output
+ * @param format   format of the output
+ * @return referenced snapshot buffer (to be released via snapshot_release)
+ */
+snapshot_buffer_t *
+snapshot_get(snapshot_t *snapshot, snapshot_type_e type, snapshot_format_e format)
+{
+    pthread_mutex_lock(&snapshot->lock);
+
+    uint64_t generation = __atomic_load_n(&snapshot->generation, __ATOMIC_ACQUIRE);
+    snapshot_buffer_t *buffer = snapshot->buffers[type][format];
+
+    if (buffer == NULL || buffer->generation != generation)
+    {
+        strbuf_t *out = strbuf_new();
+
+        snapshot->render(out, type, format, snapshot->data);
+
+        if (buffer)
+            snapshot_release(buffer);
+
+        buffer = xcalloc1(sizeof(snapshot_buffer_t));
+        buffer->refs = 1;
+        buffer->generation = generation;
+        buffer->length = out->length;
+
+        /* take over the rendered string */
+        buffer->data = out->buf;
+        xfree(out);
+
+        snapshot->buffers[type][format] = buffer;
+    }
+
+    __atomic_add_fetch(&buffer->refs, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&snapshot->lock);
+
+    return buffer;
+}
+
+/**
+ * @brief Release a buffer retrieved via snapshot_get
+ * @param buffer snapshot buffer
+ */
+void
+snapshot_release(snapshot_buffer_t *buffer)
+{
+    if (buffer == NULL)
+        return;
+
+    if (__atomic_sub_fetch(&buffer->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    xfree(buffer->data);
+    xfree(buffer);
+}
+
+/**
+ * @brief Format the entity tag of the given generation
+ * @param snapshot   snapshot cache
+ * @param generation generation of a snapshot buffer
+ * @param format     format of the snapshot buffer
+ * @param buffer     output buffer
+ * @param size       size of the output buffer
+ * @return length of the entity tag
+ */
+int32_t
+snapshot_etag(snapshot_t *snapshot, uint64_t generation, snapshot_format_e format,
+        char *buffer, size_t size)
+{
+    /* the representations of a generation differ in their format */
+    return snprintf(buffer, size, "\"%lx-%llx-%x\"",
+            (unsigned long)snapshot->epoch, (unsigned long long)generation,
+            (unsigned)format);
+}
+
+void
+snapshot_destroy(snapshot_t *snapshot)
+{
+    if (snapshot == NULL)
+        return;
+
+    for (uint32_t type = 0; type < SNAPSHOT_SIZE; type++)
+    {
+        for (uint32_t format = 0; format < SNAPSHOT_FORMATS; format++)
+            snapshot_release(snapshot->buffers[type][format]);
+    }
+
+    pthread_mutex_destroy(&snapshot->lock);
+
+    xfree(snapshot);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
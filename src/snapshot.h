@@ -0,0 +1,90 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "strbuf.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef enum
+{
+    SNAPSHOT_STATUS,
+    SNAPSHOT_WATCHES,
+    SNAPSHOT_SIZE
+} snapshot_type_e;
+
+typedef enum
+{
+    /** plain lines (UNIX socket) */
+    SNAPSHOT_TEXT,
+    /** lines prefixed for the HTTP interface */
+    SNAPSHOT_HTTP,
+    /** JSON value */
+    SNAPSHOT_JSON,
+    SNAPSHOT_FORMATS
+} snapshot_format_e;
+
+/** rendered output that is shared by all requests of the same generation */
+typedef struct
+{
+    uint32_t refs;
+    uint64_t generation;
+    size_t length;
+    char *data;
+} snapshot_buffer_t;
+
+/* renders the output of the given type into the buffer */
+typedef void (*snapshot_render_t)(strbuf_t *out, snapshot_type_e type,
+        snapshot_format_e format, void *data);
+
+/**
+ * Cache of the rendered output of the commands that cover all watches.
+ * The generation is bumped on every change of the watches' states so
+ * the output is rendered on the first request after a change only.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint64_t generation;
+    /** creation time (distinguishes the generations of daemon runs) */
+    time_t epoch;
+    snapshot_render_t render;
+    void *data;
+    snapshot_buffer_t *buffers[SNAPSHOT_SIZE][SNAPSHOT_FORMATS];
+} snapshot_t;
+
+snapshot_t *
+snapshot_new(snapshot_render_t render, void *data);
+
+void
+snapshot_invalidate(snapshot_t *snapshot);
+
+snapshot_buffer_t *
+snapshot_get(snapshot_t *snapshot, snapshot_type_e type, snapshot_format_e format);
+
+void
+snapshot_release(snapshot_buffer_t *buffer);
+
+int32_t
+snapshot_etag(snapshot_t *snapshot, uint64_t generation, snapshot_format_e format,
+        char *buffer, size_t size);
+
+void
+snapshot_destroy(snapshot_t *snapshot);
+
+/* vim: set et sw=4 sts=4 tw=80: */
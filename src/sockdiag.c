@@ -0,0 +1,305 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_PROC
+
+#include "def.h"
+#include "log.h"
+#include "sockdiag.h"
+
+/* we want to include sys/socket.h before linux/netlink.h
+ * to avoid some compilation problems with some 2.6 kernels */
+#include <sys/socket.h>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SOCKDIAG_INITIAL_SIZE 64
+
+/* the kernel sends dump messages of up to a page (or 8 kB) each */
+#define SOCKDIAG_BUFFER_SIZE 16384
+
+/**
+ * @brief Open a NETLINK_SOCK_DIAG socket used to query the listening
+ *        TCP sockets of the system
+ * @return new instance or NULL if sock_diag is not available
+ */
+sockdiag_t *
+sockdiag_new(void)
+{
+    int32_t sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+
+    if (sock == -1)
+    {
+        log_perror("nyx: socket");
+        return NULL;
+    }
+
+    sockdiag_t *diag = xcalloc1(sizeof(sockdiag_t));
+
+    diag->sock = sock;
+    diag->size = SOCKDIAG_INITIAL_SIZE;
+    diag->entries = xcalloc(diag->size, sizeof(sockdiag_entry_t));
+    diag->buffer = xcalloc(SOCKDIAG_BUFFER_SIZE, sizeof(char));
+
+    return diag;
+}
+
+/**
+ * @brief Mark the snapshot as outdated so the next lookup dumps the
+ *        listening sockets again
+ * @param diag sockdiag instance
+ */
+void
+sockdiag_invalidate(sockdiag_t *diag)
+{
+    if (diag)
+        diag->valid = false;
+}
+
+static void
+add_entry(sockdiag_t *diag, uint16_t port, uint32_t inode)
+{
+    if (diag->count >= diag->size)
+    {
+        uint32_t size = diag->size * 2;
+
+        diag->entries = xrealloc(diag->entries, size * sizeof(sockdiag_entry_t));
+        diag->size = size;
+    }
+
+    diag->entries[diag->count].port = port;
+    diag->entries[diag->count].inode = inode;
+    diag->count++;
+}
+
+static bool
+request_dump(sockdiag_t *diag, uint8_t family)
+{
+    struct sockaddr_nl addr;
+
+    struct
+    {
+        struct nlmsghdr header;
+        struct inet_diag_req_v2 request;
+    } message;
+
+    memset(&addr, 0, sizeof(struct sockaddr_nl));
+    addr.nl_family = AF_NETLINK;
+
+    memset(&message, 0, sizeof(message));
+    message.header.nlmsg_len = sizeof(message);
+    message.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    message.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    message.header.nlmsg_seq = ++diag->seq;
+    message.request.sdiag_family = family;
+    message.request.sdiag_protocol = IPPROTO_TCP;
+    message.request.idiag_states = 1 << TCP_LISTEN;
+
+    if (sendto(diag->sock, &message, sizeof(message), 0,
+                (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        log_perror("nyx: sendto");
+        return false;
+    }
+
+    return true;
+}
+
+/* receive all messages of the current dump until NLMSG_DONE */
+static bool
+receive_dump(sockdiag_t *diag)
+{
+    while (true)
+    {
+        ssize_t length = recv(diag->sock, diag->buffer, SOCKDIAG_BUFFER_SIZE, 0);
+
+        if (length < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_perror("nyx: recv");
+            return false;
+        }
+
+        struct nlmsghdr *header = (struct nlmsghdr *)diag->buffer;
+
+        for (; NLMSG_OK(header, (size_t)length); header = NLMSG_NEXT(header, length))
+        {
+            /* skip the remainder of previously aborted dumps */
+            if (header->nlmsg_seq != diag->seq)
+                continue;
+
+            if (header->nlmsg_type == NLMSG_DONE)
+                return true;
+
+            if (header->nlmsg_type == NLMSG_ERROR)
+            {
+                struct nlmsgerr *error = NLMSG_DATA(header);
+
+                errno = -error->error;
+                log_perror("nyx: sock_diag");
+                return false;
+            }
+
+            if (header->nlmsg_type != SOCK_DIAG_BY_FAMILY)
+                continue;
+
+            struct inet_diag_msg *msg = NLMSG_DATA(header);
+
+            add_entry(diag, ntohs(msg->id.idiag_sport), msg->idiag_inode);
+        }
+    }
+}
+
+static int
+compare_entries(const void *a, const void *b)
+{
+    const sockdiag_entry_t *x = a;
+    const sockdiag_entry_t *y = b;
+
+    return (int)x->port - (int)y->port;
+}
+
+static bool
+dump_listening(sockdiag_t *diag)
+{
+    diag->count = 0;
+
+    if (!request_dump(diag, AF_INET) || !receive_dump(diag))
+        return false;
+
+    /* IPv6 may be disabled */
+    if (request_dump(diag, AF_INET6))
+        receive_dump(diag);
+
+    qsort(diag->entries, diag->count, sizeof(sockdiag_entry_t), compare_entries);
+
+    diag->valid = true;
+
+    return true;
+}
+
+static sockdiag_entry_t *
+find_port(sockdiag_t *diag, uint16_t port)
+{
+    sockdiag_entry_t key = { port, 0 };
+
+    sockdiag_entry_t *entry = bsearch(&key, diag->entries, diag->count,
+            sizeof(sockdiag_entry_t), compare_entries);
+
+    /* move to the first of possibly multiple sockets on the same port */
+    while (entry && entry > diag->entries && (entry - 1)->port == port)
+        entry--;
+
+    return entry;
+}
+
+/* determine whether the process holds any of the port's sockets */
+static bool
+owns_socket(sockdiag_t *diag, sockdiag_entry_t *first, pid_t pid)
+{
+    char path[64] = {0};
+    char link[64] = {0};
+
+    snprintf(path, LEN(path)-1, "/proc/%d/fd", pid);
+
+    DIR *dir = opendir(path);
+
+    if (dir == NULL)
+        return false;
+
+    bool found = false;
+    struct dirent *entry;
+    sockdiag_entry_t *end = diag->entries + diag->count;
+
+    while (!found && (entry = readdir(dir)) != NULL)
+    {
+        uint32_t inode = 0;
+        ssize_t length = readlinkat(dirfd(dir), entry->d_name, link, LEN(link)-1);
+
+        if (length < 1)
+            continue;
+
+        link[length] = '\0';
+
+        if (sscanf(link, "socket:[%u]", &inode) != 1)
+            continue;
+
+        for (sockdiag_entry_t *e = first; e < end && e->port == first->port; e++)
+        {
+            if (e->inode == inode)
+            {
+                found = true;
+                break;
+            }
+        }
+    }
+
+    closedir(dir);
+
+    return found;
+}
+
+/**
+ * @brief Determine whether a TCP socket is listening on the given port
+ *        (on any local address)
+ * @param diag      sockdiag instance
+ * @param port      port to look up
+ * @param owner     process the listening socket has to belong to
+ *                  (0 for any process)
+ * @param listening result of the lookup
+ * @return true if the listening sockets could be determined
+ */
+bool
+sockdiag_listening(sockdiag_t *diag, uint16_t port, pid_t owner, bool *listening)
+{
+    if (!diag->valid && !dump_listening(diag))
+        return false;
+
+    sockdiag_entry_t *entry = find_port(diag, port);
+
+    *listening = entry != NULL && (owner < 1 || owns_socket(diag, entry, owner));
+
+    return true;
+}
+
+void
+sockdiag_destroy(sockdiag_t *diag)
+{
+    if (diag == NULL)
+        return;
+
+    close(diag->sock);
+
+    xfree(diag->entries);
+    xfree(diag->buffer);
+    xfree(diag);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,59 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct
+{
+    uint16_t port;
+    uint32_t inode;
+} sockdiag_entry_t;
+
+/**
+ * Snapshot of the kernel's table of listening TCP sockets (IPv4 and
+ * IPv6) queried via NETLINK_SOCK_DIAG. The snapshot is taken lazily on
+ * the first lookup after it was invalidated so all port checks of one
+ * proc tick are answered by a single dump.
+ */
+typedef struct
+{
+    int32_t sock;
+    uint32_t seq;
+    /** the entries reflect the current tick */
+    bool valid;
+    /** listening sockets sorted by port */
+    sockdiag_entry_t *entries;
+    uint32_t count;
+    uint32_t size;
+    char *buffer;
+} sockdiag_t;
+
+sockdiag_t *
+sockdiag_new(void);
+
+void
+sockdiag_invalidate(sockdiag_t *diag);
+
+bool
+sockdiag_listening(sockdiag_t *diag, uint16_t port, pid_t owner, bool *listening);
+
+void
+sockdiag_destroy(sockdiag_t *diag);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -13,15 +13,22 @@
  * limitations under the License.
  */
 
+#define NYX_MEM_TAG MEM_CONNECTOR
+
 #include "log.h"
 #include "socket.h"
 #include "def.h"
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <unistd.h>
 
@@ -73,13 +80,13 @@ http_method_to_string(http_method_e method)
     }
 }
 
-static endpoint_t *
+endpoint_t *
 endpoint_new(uint16_t port, const char *host)
 {
     endpoint_t *endpoint = xcalloc1(sizeof(endpoint_t));
 
     endpoint->port = port;
-    endpoint->host = host != NULL ? strdup(host) : NULL;
+    endpoint->host = host != NULL ? xstrdup(host) : NULL;
 
     return endpoint;
 }
@@ -91,9 +98,9 @@ endpoint_free(endpoint_t *endpoint)
         return;
 
     if (endpoint->host)
-        free((void *)endpoint->host);
+        xfree((void *)endpoint->host);
 
-    free(endpoint);
+    xfree(endpoint);
 }
 
 endpoint_t *
@@ -105,7 +112,7 @@ parse_endpoint(const char *input)
     if (input == NULL || *input == '\0')
         return NULL;
 
-    char *copy = strdup(input);
+    char *copy = xstrdup(input);
     char *to_free = copy;
     char *host = strsep(&copy, ":");
 
@@ -131,7 +138,7 @@ parse_endpoint(const char *input)
     }
 
 
-    free(to_free);
+    xfree(to_free);
     return endpoint;
 }
 
@@ -181,13 +188,16 @@ unblock_socket(int32_t sock)
 }
 
 #define REQUEST_TEMPLATE "%s /%s HTTP/1.0\r\nHost: localhost\r\nUser-Agent: nyx\r\n\r\n"
+#define KEEP_ALIVE_TEMPLATE "%s /%s HTTP/1.1\r\nHost: localhost\r\nUser-Agent: nyx\r\n" \
+    "Connection: keep-alive\r\n\r\n"
 
-static char *
-build_request(const char *url, http_method_e method)
+char *
+http_build_request(const char *url, http_method_e method, bool keep_alive)
 {
+    const char *template = keep_alive ? KEEP_ALIVE_TEMPLATE : REQUEST_TEMPLATE;
     const char *mtd = http_method_to_string(method);
     size_t url_len = url ? strlen(url) : 0;
-    size_t length = LEN(REQUEST_TEMPLATE) + url_len + strlen(mtd);
+    size_t length = strlen(template) + url_len + strlen(mtd) + 1;
 
     char *request = xcalloc(length, sizeof(char));
 
@@ -197,13 +207,164 @@ build_request(const char *url, http_method_e method)
     if (*path == '/')
         path = path + 1;
 
-    snprintf(request, length, REQUEST_TEMPLATE, mtd, path);
+    snprintf(request, length, template, mtd, path);
 
     return request;
 }
 
+#undef KEEP_ALIVE_TEMPLATE
 #undef REQUEST_TEMPLATE
 
+/**
+ * @brief Parse the URL of a HTTP check that is either a plain path
+ *        (i.e. '/status') or an absolute URL with the scheme 'http' or
+ *        'https' (i.e. 'https://localhost:8443/status')
+ * @param url    URL to parse
+ * @param parsed parsed URL referencing the path of the given URL
+ * @return true if the URL is valid
+ */
+bool
+http_url_parse(const char *url, http_url_t *parsed)
+{
+    memset(parsed, 0, sizeof(http_url_t));
+
+    const char *path = url ? url : "";
+
+    if (strncasecmp(path, "https://", 8) == 0)
+    {
+        parsed->tls = true;
+        path += 8;
+    }
+    else if (strncasecmp(path, "http://", 7) == 0)
+        path += 7;
+    else
+    {
+        parsed->path = path;
+        return true;
+    }
+
+    /* authority: [host][:port] */
+    const char *end = path + strcspn(path, "/?");
+    const char *colon = memchr(path, ':', end - path);
+    const char *host_end = colon ? colon : end;
+    size_t host_length = host_end - path;
+
+    if (host_length >= LEN(parsed->host))
+        return false;
+
+    memcpy(parsed->host, path, host_length);
+
+    if (colon)
+    {
+        char *port_end = NULL;
+        unsigned long port = strtoul(colon + 1, &port_end, 10);
+
+        if (port_end != end || port < 1 || port > 65535)
+            return false;
+
+        parsed->port = port;
+    }
+
+    parsed->path = end;
+
+    return true;
+}
+
+/**
+ * @brief Get the port a HTTP check connects to
+ * @param url  URL of the check
+ * @param port configured port (0 for the default port of the URL's scheme)
+ * @return port given in the URL, the configured port or the default port
+ */
+uint16_t
+http_url_port(const char *url, uint16_t port)
+{
+    http_url_t parsed;
+
+    if (!http_url_parse(url, &parsed))
+        return port ? port : 80;
+
+    if (parsed.port)
+        return parsed.port;
+
+    if (port)
+        return port;
+
+    return parsed.tls ? 443 : 80;
+}
+
+/**
+ * @brief Parse a list of HTTP status codes separated by commas
+ *        or whitespace (i.e. '200, 204')
+ * @param input string to parse
+ * @return zero-terminated array of status codes or NULL if the
+ *         input does not contain any valid status code
+ */
+uint16_t *
+http_status_parse(const char *input)
+{
+    size_t count = 0;
+
+    if (input == NULL || *input == '\0')
+        return NULL;
+
+    char *copy = xstrdup(input);
+    char *to_free = copy;
+    char *token = NULL;
+
+    /* the codes are part of the watch configuration */
+    uint16_t *codes = nyx_calloc(strlen(input) / 2 + 2, sizeof(uint16_t),
+            MEM_CONFIG);
+
+    while ((token = strsep(&copy, ", \t")) != NULL)
+    {
+        if (*token == '\0')
+            continue;
+
+        int32_t code = atoi(token);
+
+        if (code < 100 || code > 599)
+        {
+            log_warn("Invalid HTTP status code: '%s'", token);
+            continue;
+        }
+
+        codes[count++] = code;
+    }
+
+    xfree(to_free);
+
+    if (count == 0)
+    {
+        nyx_free(codes, MEM_CONFIG);
+        return NULL;
+    }
+
+    return codes;
+}
+
+/**
+ * @brief Determine whether the given status code is expected
+ * @param codes zero-terminated array of status codes or NULL
+ *              to accept '200' only
+ * @param code  status code to check
+ * @return true if the status code is expected, false otherwise
+ */
+bool
+http_status_matches(const uint16_t *codes, uint16_t code)
+{
+    if (codes == NULL)
+        return code == 200;
+
+    while (*codes)
+    {
+        if (*codes++ == code)
+            return true;
+    }
+
+    return false;
+}
+
 bool
 check_http(const char *url, uint16_t port, http_method_e method)
 {
@@ -251,7 +412,7 @@ check_http(const char *url, uint16_t port, http_method_e method)
         goto end;
 
     /* start sending */
-    request = build_request(url, method);
+    request = http_build_request(url, method, false);
     ssize_t length = strlen(request);
 
     while (total < length)
@@ -300,7 +461,7 @@ check_http(const char *url, uint16_t port, http_method_e method)
 
 end:
     if (request)
-        free(request);
+        xfree(request);
     close(sockfd);
 
     return success;
@@ -408,6 +569,192 @@ end:
     return success;
 }
 
+/**
+ * @brief Open a sd_notify compatible datagram socket that services
+ *        may signal their readiness on ('READY=1')
+ * @param path socket path to bind to
+ * @return non-blocking socket or -1 on failure
+ */
+int32_t
+notify_socket_open(const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        log_warn("Notify socket path '%s' is too long", path);
+        return -1;
+    }
+
+    int32_t sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+    if (sock == -1)
+    {
+        log_perror("nyx: socket");
+        return -1;
+    }
+
+    if (fcntl(sock, F_SETFD, FD_CLOEXEC) == -1 || !unblock_socket(sock))
+    {
+        log_perror("nyx: fcntl");
+        close(sock);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+
+    /* remove a stale socket of a previous nyx instance */
+    unlink(path);
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1)
+    {
+        log_perror("nyx: bind");
+        close(sock);
+        return -1;
+    }
+
+    /* the service may run as a different user */
+    chmod(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+
+    return sock;
+}
+
+/* messages consist of newline-separated assignments */
+static bool
+message_contains(char *message, const char *assignment)
+{
+    char *line = message;
+
+    while (line && *line)
+    {
+        char *next = strchr(line, '\n');
+
+        if (next)
+            *next++ = '\0';
+
+        if (strcmp(line, assignment) == 0)
+            return true;
+
+        line = next;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Receive all pending notify messages
+ * @param sock notify socket
+ * @return true if any of the messages contained 'READY=1'
+ */
+bool
+notify_socket_ready(int32_t sock)
+{
+    bool ready = false;
+    ssize_t length = 0;
+    char buffer[4096];
+
+    while ((length = recv(sock, buffer, sizeof(buffer)-1, 0)) > 0)
+    {
+        buffer[length] = '\0';
+
+        if (message_contains(buffer, "READY=1"))
+            ready = true;
+    }
+
+    return ready;
+}
+
+/**
+ * @brief Open the datagram socket the services send their heartbeats
+ *        ('WATCHDOG=1') to - the senders are identified by their
+ *        credentials (linux only)
+ * @param path socket path to bind to
+ * @return non-blocking socket or -1 on failure
+ */
+int32_t
+watchdog_socket_open(const char *path)
+{
+#ifndef OSX
+    int32_t sock = notify_socket_open(path);
+    int32_t enable = 1;
+
+    if (sock < 0)
+        return -1;
+
+    if (setsockopt(sock, SOL_SOCKET, SO_PASSCRED, &enable, sizeof(enable)) == -1)
+    {
+        log_perror("nyx: setsockopt");
+        close(sock);
+        unlink(path);
+        return -1;
+    }
+
+    return sock;
+#else
+    (void)path;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Receive the next message of the watchdog socket
+ * @param sock   watchdog socket
+ * @param sender PID of the sending process
+ * @return 1 if the message contained 'WATCHDOG=1', 0 for any other message
+ *         and -1 if no message is pending
+ */
+int32_t
+watchdog_socket_receive(int32_t sock, pid_t *sender)
+{
+    char buffer[512];
+
+    *sender = 0;
+
+#ifndef OSX
+    union
+    {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(struct ucred))];
+    } control;
+
+    struct iovec iov = { .iov_base = buffer, .iov_len = sizeof(buffer)-1 };
+    struct msghdr msg =
+    {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = &control,
+        .msg_controllen = sizeof(control)
+    };
+
+    ssize_t length = recvmsg(sock, &msg, MSG_DONTWAIT);
+
+    if (length < 0)
+        return -1;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS)
+        {
+            struct ucred credentials;
+
+            memcpy(&credentials, CMSG_DATA(cmsg), sizeof(credentials));
+            *sender = credentials.pid;
+        }
+    }
+#else
+    ssize_t length = recv(sock, buffer, sizeof(buffer)-1, MSG_DONTWAIT);
+
+    if (length < 0)
+        return -1;
+#endif
+
+    buffer[length] = '\0';
+
+    return message_contains(buffer, "WATCHDOG=1") ? 1 : 0;
+}
+
 #ifdef OSX
 bool
 add_epoll_socket(int32_t sock, struct kevent *event, int32_t epoll, int32_t remote)
@@ -15,7 +15,10 @@
 
 #pragma once
 
+#include "strbuf.h"
+
 #include <stdbool.h>
+#include <stdint.h>
 
 /* epoll or kqueue */
 #ifndef OSX
@@ -50,6 +53,19 @@ typedef struct
     char *buffer;
     uint32_t pos;
     uint32_t length;
+    /** control protocol version of a session (0 for single requests) */
+    uint32_t version;
+    /** the connection was handed over to the subscribers */
+    bool detached;
+    /** queued responses of a session (reused for all of its requests) */
+    strbuf_t *output;
+    /** number of bytes of the output that were sent already */
+    uint32_t output_sent;
+    /** the reactor waits for the socket to become writable */
+    bool writing;
+    /** the session is closed as soon as the output was sent */
+    bool closing;
+    void *context;
 } epoll_extra_data_t;
 
 typedef struct
@@ -58,9 +74,25 @@ typedef struct
     const char *host;
 } endpoint_t;
 
+/** URL of a HTTP check - either a plain path or an absolute URL */
+typedef struct
+{
+    /** the URL uses the 'https' scheme */
+    bool tls;
+    /** port given in the URL (0 if none) */
+    uint16_t port;
+    /** host given in the URL (empty if none) */
+    char host[256];
+    /** path including the query */
+    const char *path;
+} http_url_t;
+
 endpoint_t *
 parse_endpoint(const char *input);
 
+endpoint_t *
+endpoint_new(uint16_t port, const char *host);
+
 void
 endpoint_free(endpoint_t *endpoint);
 
@@ -82,12 +114,39 @@ check_local_port(uint16_t port);
 bool
 check_port(const char *host, uint16_t port);
 
+char *
+http_build_request(const char *url, http_method_e method, bool keep_alive);
+
+bool
+http_url_parse(const char *url, http_url_t *parsed);
+
+uint16_t
+http_url_port(const char *url, uint16_t port);
+
+uint16_t *
+http_status_parse(const char *input);
+
+bool
+http_status_matches(const uint16_t *codes, uint16_t code);
+
 bool
 check_http(const char *url, uint16_t port, http_method_e method);
 
 bool
 unblock_socket(int32_t sock);
 
+int32_t
+notify_socket_open(const char *path);
+
+bool
+notify_socket_ready(int32_t sock);
+
+int32_t
+watchdog_socket_open(const char *path);
+
+int32_t
+watchdog_socket_receive(int32_t sock, pid_t *sender);
+
 bool
 add_epoll_socket(int32_t sock, NYX_EV_TYPE *event, int32_t epoll, int32_t remote);
 
@@ -0,0 +1,581 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "def.h"
+#include "log.h"
+#include "spawnattr.h"
+#include "watch.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifndef OSX
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+
+/* see ioprio_set(2) */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_DEFAULT_LEVEL 4
+
+static const char *numa_policies[] =
+{
+    "bind",
+    "preferred"
+};
+
+static const char *sched_policies[] =
+{
+    "default",
+    "other",
+    "batch",
+    "idle",
+    "fifo",
+    "rr"
+};
+
+numa_policy_e
+numa_policy_from_string(const char *str)
+{
+    if (str == NULL || *str == '\0')
+        return NUMA_POLICY_BIND;
+
+    for (uint32_t idx = 0; idx < LEN(numa_policies); idx++)
+    {
+        if (strcasecmp(str, numa_policies[idx]) == 0)
+            return idx;
+    }
+
+    /* numactl's spelling of the bind policy */
+    if (strcasecmp(str, "membind") == 0)
+        return NUMA_POLICY_BIND;
+
+    return NUMA_POLICY_INVALID;
+}
+
+const char *
+numa_policy_to_string(numa_policy_e policy)
+{
+    return policy < NUMA_POLICY_INVALID ? numa_policies[policy] : "invalid";
+}
+
+sched_policy_e
+sched_policy_from_string(const char *str)
+{
+    if (str == NULL || *str == '\0')
+        return SCHED_POLICY_DEFAULT;
+
+    for (uint32_t idx = 0; idx < LEN(sched_policies); idx++)
+    {
+        if (strcasecmp(str, sched_policies[idx]) == 0)
+            return idx;
+    }
+
+    return SCHED_POLICY_INVALID;
+}
+
+const char *
+sched_policy_to_string(sched_policy_e policy)
+{
+    return policy < SCHED_POLICY_INVALID ? sched_policies[policy] : "invalid";
+}
+
+static bool
+parse_index(const char **str, uint32_t *index)
+{
+    char *end = NULL;
+
+    if (**str < '0' || **str > '9')
+        return false;
+
+    unsigned long value = strtoul(*str, &end, 10);
+
+    if (value > UINT32_MAX)
+        return false;
+
+    *index = value;
+    *str = end;
+
+    return true;
+}
+
+/**
+ * @brief Parse a list of indexes like '0-3,8,10-11' (the format of
+ *        'taskset -c' and the cpuset files of cgroups) into a bit mask
+ * @param list input string
+ * @param mask bit mask to fill (bits / 64 words)
+ * @param bits number of bits in the mask
+ * @return true if the list is valid and not empty; false otherwise
+ */
+bool
+parse_index_list(const char *list, uint64_t *mask, uint32_t bits)
+{
+    bool empty = true;
+    const char *str = list;
+
+    memset(mask, 0, bits / 64 * sizeof(uint64_t));
+
+    if (str == NULL)
+        return false;
+
+    while (*str)
+    {
+        uint32_t from = 0, to = 0;
+
+        while (*str == ' ')
+            str++;
+
+        if (!parse_index(&str, &from))
+            return false;
+
+        to = from;
+
+        if (*str == '-')
+        {
+            str++;
+
+            if (!parse_index(&str, &to) || to < from)
+                return false;
+        }
+
+        if (to >= bits)
+            return false;
+
+        for (uint32_t idx = from; idx <= to; idx++)
+            mask[idx / 64] |= 1ULL << (idx % 64);
+
+        empty = false;
+
+        while (*str == ' ')
+            str++;
+
+        if (*str == ',')
+            str++;
+        else if (*str != '\0')
+            return false;
+    }
+
+    return !empty;
+}
+
+/**
+ * @brief Parse an I/O scheduling class and level like 'idle',
+ *        'best-effort:2' or 'realtime:0'
+ * @param value input string
+ * @return encoded I/O priority or -1 if invalid
+ */
+int32_t
+ionice_parse(const char *value)
+{
+    int32_t class = 0;
+    uint32_t level = IOPRIO_DEFAULT_LEVEL;
+    size_t length = 0;
+
+    if (value == NULL)
+        return -1;
+
+    length = strcspn(value, ":");
+
+#define CMP(x, c) if (!class && strlen(x) == length && !strncasecmp(x, value, length)) class = c
+
+    CMP("realtime",    IOPRIO_CLASS_RT);
+    CMP("rt",          IOPRIO_CLASS_RT);
+    CMP("best-effort", IOPRIO_CLASS_BE);
+    CMP("be",          IOPRIO_CLASS_BE);
+    CMP("idle",        IOPRIO_CLASS_IDLE);
+
+#undef CMP
+
+    if (!class)
+        return -1;
+
+    if (value[length] == ':')
+    {
+        const char *str = value + length + 1;
+
+        if (!parse_index(&str, &level) || *str != '\0' || level > 7 ||
+                class == IOPRIO_CLASS_IDLE)
+            return -1;
+    }
+
+    if (class == IOPRIO_CLASS_IDLE)
+        level = 0;
+
+    return (class << IOPRIO_CLASS_SHIFT) | level;
+}
+
+static const struct
+{
+    const char *name;
+    int32_t resource;
+} rlimits[] =
+{
+    { "as", RLIMIT_AS },
+    { "core", RLIMIT_CORE },
+    { "cpu", RLIMIT_CPU },
+    { "data", RLIMIT_DATA },
+    { "fsize", RLIMIT_FSIZE },
+    { "memlock", RLIMIT_MEMLOCK },
+    { "nofile", RLIMIT_NOFILE },
+    { "nproc", RLIMIT_NPROC },
+    { "rss", RLIMIT_RSS },
+    { "stack", RLIMIT_STACK },
+#ifndef OSX
+    { "locks", RLIMIT_LOCKS },
+    { "msgqueue", RLIMIT_MSGQUEUE },
+    { "nice", RLIMIT_NICE },
+    { "rtprio", RLIMIT_RTPRIO },
+    { "sigpending", RLIMIT_SIGPENDING },
+#endif
+};
+
+static bool
+parse_rlimit_value(const char *value, size_t length, rlim_t *limit)
+{
+    char *end = NULL;
+
+    if ((length == 9 && !strncasecmp(value, "unlimited", 9)) ||
+            (length == 8 && !strncasecmp(value, "infinity", 8)))
+    {
+        *limit = RLIM_INFINITY;
+        return true;
+    }
+
+    if (length < 1 || *value < '0' || *value > '9')
+        return false;
+
+    unsigned long long parsed = strtoull(value, &end, 10);
+
+    if (end != value + length)
+        return false;
+
+    *limit = parsed;
+
+    return true;
+}
+
+/**
+ * @brief Parse a resource limit like 'nofile' with the value '65536',
+ *        'unlimited' or '<soft>:<hard>'
+ * @param name   resource name (as in 'ulimit'/'prlimit')
+ * @param value  limit value
+ * @param rlimit resource and limit to fill
+ * @return true if name and value are valid; false otherwise
+ */
+bool
+rlimit_parse(const char *name, const char *value, spawn_rlimit_t *rlimit)
+{
+    rlimit->resource = -1;
+
+    if (name == NULL || value == NULL)
+        return false;
+
+    for (uint32_t idx = 0; idx < LEN(rlimits); idx++)
+    {
+        if (strcasecmp(name, rlimits[idx].name) == 0)
+        {
+            rlimit->resource = rlimits[idx].resource;
+            break;
+        }
+    }
+
+    if (rlimit->resource < 0)
+        return false;
+
+    size_t soft = strcspn(value, ":");
+
+    if (!parse_rlimit_value(value, soft, &rlimit->limit.rlim_cur))
+        return false;
+
+    if (value[soft] != ':')
+    {
+        rlimit->limit.rlim_max = rlimit->limit.rlim_cur;
+        return true;
+    }
+
+    const char *hard = value + soft + 1;
+
+    return parse_rlimit_value(hard, strlen(hard), &rlimit->limit.rlim_max) &&
+        rlimit->limit.rlim_cur <= rlimit->limit.rlim_max;
+}
+
+/**
+ * @brief Resolve the placement and scheduling attributes of the watch
+ * @param attr  attributes to fill (to be released with spawnattr_free)
+ * @param watch watch to resolve the attributes of
+ * @return true if all attributes are valid; false otherwise
+ */
+bool
+spawnattr_resolve(spawnattr_t *attr, const watch_t *watch)
+{
+    bool valid = true;
+
+    memset(attr, 0, sizeof(spawnattr_t));
+
+    if (watch->cpu_affinity)
+    {
+        attr->has_cpus = parse_index_list(watch->cpu_affinity, attr->cpus, SPAWNATTR_MAX_CPUS);
+
+        if (!attr->has_cpus)
+        {
+            log_error("Invalid cpu_affinity '%s' of watch '%s' - expected i.e. '0-3,8'",
+                    watch->cpu_affinity, watch->name);
+            valid = false;
+        }
+    }
+
+    if (watch->numa_node)
+    {
+        attr->has_nodes = parse_index_list(watch->numa_node, attr->nodes, SPAWNATTR_MAX_NODES);
+
+        if (!attr->has_nodes)
+        {
+            log_error("Invalid numa_node '%s' of watch '%s' - expected i.e. '0' or '0-1'",
+                    watch->numa_node, watch->name);
+            valid = false;
+        }
+    }
+
+    attr->numa_policy = watch->numa_policy;
+
+    if (watch->numa_policy == NUMA_POLICY_INVALID)
+    {
+        log_error("Invalid numa policy of watch '%s' - expected 'bind' or 'preferred'",
+                watch->name);
+        valid = false;
+    }
+
+    attr->nice = watch->nice;
+
+    if (watch->nice < -20 || watch->nice > 19)
+    {
+        log_error("Invalid nice value %d of watch '%s' - expected -20 to 19",
+                watch->nice, watch->name);
+        valid = false;
+    }
+
+    attr->sched_policy = watch->sched_policy;
+    attr->sched_priority = watch->sched_priority;
+
+    if (watch->sched_policy == SCHED_POLICY_INVALID)
+    {
+        log_error("Invalid sched_policy of watch '%s' - expected one of "
+                "'other', 'batch', 'idle', 'fifo' or 'rr'", watch->name);
+        valid = false;
+    }
+    else if (watch->sched_policy == SCHED_POLICY_FIFO || watch->sched_policy == SCHED_POLICY_RR)
+    {
+        if (watch->sched_priority < 1 || watch->sched_priority > 99)
+        {
+            log_error("Invalid sched_priority %u of watch '%s' - expected 1 to 99",
+                    watch->sched_priority, watch->name);
+            valid = false;
+        }
+    }
+    else if (watch->sched_priority)
+    {
+        log_warn("sched_priority of watch '%s' applies to the 'fifo' and 'rr' "
+                "policies only", watch->name);
+        attr->sched_priority = 0;
+    }
+
+    if (watch->ionice)
+    {
+        attr->ioprio = ionice_parse(watch->ionice);
+
+        if (attr->ioprio < 0)
+        {
+            log_error("Invalid ionice '%s' of watch '%s' - expected i.e. 'idle' or "
+                    "'best-effort:7'", watch->ionice, watch->name);
+            attr->ioprio = 0;
+            valid = false;
+        }
+    }
+
+    if (watch->rlimits && hash_count(watch->rlimits) > 0)
+    {
+        const char *key = NULL;
+        void *data = NULL;
+        hash_iter_t *iter = hash_iter_start(watch->rlimits);
+
+        attr->rlimits = xcalloc(hash_count(watch->rlimits), sizeof(spawn_rlimit_t));
+
+        while (hash_iter(iter, &key, &data))
+        {
+            spawn_rlimit_t *rlimit = &attr->rlimits[attr->num_rlimits];
+
+            if (rlimit_parse(key, data, rlimit))
+                attr->num_rlimits++;
+            else
+            {
+                log_error("Invalid rlimit '%s: %s' of watch '%s'",
+                        key, (const char *)data, watch->name);
+                valid = false;
+            }
+        }
+
+        hash_iter_free(iter);
+    }
+
+    return valid;
+}
+
+#ifndef OSX
+static void
+apply_cpus(const spawnattr_t *attr, bool *success)
+{
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+
+    for (uint32_t idx = 0; idx < SPAWNATTR_MAX_CPUS && idx < CPU_SETSIZE; idx++)
+    {
+        if (attr->cpus[idx / 64] & (1ULL << (idx % 64)))
+            CPU_SET(idx, &cpus);
+    }
+
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpus) == -1)
+    {
+        log_perror("nyx: sched_setaffinity");
+        *success = false;
+    }
+}
+
+static void
+apply_nodes(const spawnattr_t *attr, bool *success)
+{
+    uint64_t nodes[SPAWNATTR_MAX_NODES / 64];
+    int32_t mode = MPOL_BIND;
+
+    memcpy(nodes, attr->nodes, sizeof(nodes));
+
+    /* the preferred policy takes a single node */
+    if (attr->numa_policy == NUMA_POLICY_PREFERRED)
+    {
+        uint32_t idx = 0;
+
+        while (!(nodes[idx / 64] & (1ULL << (idx % 64))))
+            idx++;
+
+        memset(nodes, 0, sizeof(nodes));
+        nodes[idx / 64] = 1ULL << (idx % 64);
+
+        mode = MPOL_PREFERRED;
+    }
+
+    if (syscall(SYS_set_mempolicy, mode, nodes, SPAWNATTR_MAX_NODES + 1) == -1)
+    {
+        log_perror("nyx: set_mempolicy");
+        *success = false;
+    }
+}
+#endif
+
+static int32_t
+sched_policy_value(sched_policy_e policy)
+{
+    switch (policy)
+    {
+        case SCHED_POLICY_FIFO:
+            return SCHED_FIFO;
+        case SCHED_POLICY_RR:
+            return SCHED_RR;
+#ifndef OSX
+        case SCHED_POLICY_BATCH:
+            return SCHED_BATCH;
+        case SCHED_POLICY_IDLE:
+            return SCHED_IDLE;
+#endif
+        default:
+            return SCHED_OTHER;
+    }
+}
+
+/**
+ * @brief Apply the attributes to the calling process - called in the
+ *        spawned child before the privileges are dropped
+ * @param attr resolved attributes
+ * @return true if all attributes were applied; false otherwise
+ */
+bool
+spawnattr_apply(const spawnattr_t *attr)
+{
+    bool success = true;
+
+#ifndef OSX
+    if (attr->has_cpus)
+        apply_cpus(attr, &success);
+
+    if (attr->has_nodes)
+        apply_nodes(attr, &success);
+
+    if (attr->ioprio && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, attr->ioprio) == -1)
+    {
+        log_perror("nyx: ioprio_set");
+        success = false;
+    }
+#endif
+
+    for (uint32_t idx = 0; idx < attr->num_rlimits; idx++)
+    {
+        if (setrlimit(attr->rlimits[idx].resource, &attr->rlimits[idx].limit) == -1)
+        {
+            log_perror("nyx: setrlimit");
+            success = false;
+        }
+    }
+
+    if (attr->sched_policy != SCHED_POLICY_DEFAULT)
+    {
+        struct sched_param param = { .sched_priority = attr->sched_priority };
+
+        if (sched_setscheduler(0, sched_policy_value(attr->sched_policy), &param) == -1)
+        {
+            log_perror("nyx: sched_setscheduler");
+            success = false;
+        }
+    }
+
+    if (attr->nice && setpriority(PRIO_PROCESS, 0, attr->nice) == -1)
+    {
+        log_perror("nyx: setpriority");
+        success = false;
+    }
+
+    return success;
+}
+
+void
+spawnattr_free(spawnattr_t *attr)
+{
+    xfree(attr->rlimits);
+
+    attr->rlimits = NULL;
+    attr->num_rlimits = 0;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,105 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+/* highest number of CPUs/NUMA nodes that can be addressed */
+#define SPAWNATTR_MAX_CPUS 1024
+#define SPAWNATTR_MAX_NODES 1024
+
+typedef enum
+{
+    /** allocate from the given nodes only (membind) */
+    NUMA_POLICY_BIND,
+    /** prefer the first of the given nodes */
+    NUMA_POLICY_PREFERRED,
+    NUMA_POLICY_INVALID
+} numa_policy_e;
+
+typedef enum
+{
+    /** keep the scheduling policy of nyx */
+    SCHED_POLICY_DEFAULT,
+    SCHED_POLICY_OTHER,
+    SCHED_POLICY_BATCH,
+    SCHED_POLICY_IDLE,
+    SCHED_POLICY_FIFO,
+    SCHED_POLICY_RR,
+    SCHED_POLICY_INVALID
+} sched_policy_e;
+
+typedef struct
+{
+    int32_t resource;
+    struct rlimit limit;
+} spawn_rlimit_t;
+
+/**
+ * Placement and scheduling attributes of a watch resolved into the form
+ * that is applied by the spawned process right before exec
+ */
+typedef struct
+{
+    bool has_cpus;
+    uint64_t cpus[SPAWNATTR_MAX_CPUS / 64];
+    bool has_nodes;
+    uint64_t nodes[SPAWNATTR_MAX_NODES / 64];
+    numa_policy_e numa_policy;
+    int32_t nice;
+    sched_policy_e sched_policy;
+    uint32_t sched_priority;
+    /** encoded I/O priority (0 if unchanged) */
+    int32_t ioprio;
+    spawn_rlimit_t *rlimits;
+    uint32_t num_rlimits;
+} spawnattr_t;
+
+struct watch_t;
+
+numa_policy_e
+numa_policy_from_string(const char *str);
+
+const char *
+numa_policy_to_string(numa_policy_e policy);
+
+sched_policy_e
+sched_policy_from_string(const char *str);
+
+const char *
+sched_policy_to_string(sched_policy_e policy);
+
+bool
+parse_index_list(const char *list, uint64_t *mask, uint32_t bits);
+
+int32_t
+ionice_parse(const char *value);
+
+bool
+rlimit_parse(const char *name, const char *value, spawn_rlimit_t *rlimit);
+
+bool
+spawnattr_resolve(spawnattr_t *attr, const struct watch_t *watch);
+
+bool
+spawnattr_apply(const spawnattr_t *attr);
+
+void
+spawnattr_free(spawnattr_t *attr);
+
+/* vim: set et sw=4 sts=4 tw=80: */
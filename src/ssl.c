@@ -15,6 +15,8 @@
 
 #define _DEFAULT_SOURCE
 
+#define NYX_MEM_TAG MEM_CONNECTOR
+
 #include "def.h"
 #include "log.h"
 #include "ssl.h"
@@ -23,16 +25,50 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+/* client context shared by all asynchronous HTTPS checks */
+static SSL_CTX *context = NULL;
+
 void
 ssl_init(void)
 {
     log_debug("Initializing OpenSSL");
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
     SSL_load_error_strings();
     ERR_load_BIO_strings();
 
     /* according to manpage 'SSL_library_init' always returns 1 ... */
     SSL_library_init();
+#endif
+
+    if (context)
+        return;
+
+    context = SSL_CTX_new(SSLv23_client_method());
+
+    if (context == NULL)
+    {
+        log_error("Failed to create the TLS context: %s",
+                ERR_reason_error_string(ERR_get_error()));
+        return;
+    }
+
+    /* health checks are run against local services that often use
+     * self-signed certificates - the certificates are not verified */
+    SSL_CTX_set_verify(context, SSL_VERIFY_NONE, NULL);
+
+    /* the sessions are cached per watch by the checks themselves */
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+}
+
+/**
+ * @brief Get the TLS client context shared by all HTTPS checks
+ * @return TLS context or NULL if OpenSSL is not initialized
+ */
+SSL_CTX *
+ssl_context(void)
+{
+    return context;
 }
 
 static int32_t
@@ -170,13 +206,21 @@ ssl_connection_destroy(ssl_connection_t *conn)
     if (conn->context)
         SSL_CTX_free(conn->context);
 
-    free(conn);
+    xfree(conn);
 }
 
 void
 ssl_free(void)
 {
+    if (context)
+    {
+        SSL_CTX_free(context);
+        context = NULL;
+    }
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
     ERR_free_strings();
+#endif
 }
 
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -29,6 +29,9 @@ typedef struct
 void
 ssl_init(void);
 
+SSL_CTX *
+ssl_context(void);
+
 ssl_connection_t *
 ssl_connect(uint32_t port);
 
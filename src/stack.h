@@ -19,11 +19,20 @@
 #include <stdint.h>
 #include <string.h>
 
+/* Fixed size ring buffer of the latest samples. The number of samples
+ * reaching the threshold and the sum of all samples are maintained on
+ * every insert so the aggregates are available in O(1). */
 #define DECLARE_STACK(type_, name_) \
     typedef struct  \
     { \
         uint32_t count; \
         uint32_t max; \
+        /** index of the newest element */ \
+        uint32_t head; \
+        /** elements >= threshold are counted (0 disables counting) */ \
+        type_ threshold; \
+        uint32_t over; \
+        type_ sum; \
         type_ *elements; \
     } stack_##name_##_t; \
     \
@@ -37,8 +46,20 @@
     stack_##name_##_add(stack_##name_##_t *stack, type_ value); \
     \
     type_ \
+    stack_##name_##_get(stack_##name_##_t *stack, uint32_t idx); \
+    \
+    type_ \
     stack_##name_##_newest(stack_##name_##_t *stack); \
     \
+    void \
+    stack_##name_##_set_threshold(stack_##name_##_t *stack, type_ threshold); \
+    \
+    uint32_t \
+    stack_##name_##_over(stack_##name_##_t *stack); \
+    \
+    double \
+    stack_##name_##_mean(stack_##name_##_t *stack); \
+    \
     uint32_t \
     stack_##name_##_satisfy(stack_##name_##_t *stack, bool (*predicate)(type_, void *), void *obj);
 
@@ -47,8 +68,8 @@
     stack_##name_##_new(uint32_t size) \
     { \
         stack_##name_##_t *stack = xcalloc1(sizeof(stack_##name_##_t)); \
-        stack->max = size; \
-        stack->elements = xcalloc(size, sizeof(type_)); \
+        stack->max = MAX(size, 1); \
+        stack->elements = xcalloc(stack->max, sizeof(type_)); \
         return stack; \
     } \
     \
@@ -59,22 +80,66 @@
         free(stack); \
     } \
     \
+    static inline bool \
+    stack_##name_##_is_over(stack_##name_##_t *stack, type_ value) \
+    { \
+        return stack->threshold && value >= stack->threshold; \
+    } \
+    \
     void \
     stack_##name_##_add(stack_##name_##_t *stack, type_ value) \
     { \
-        uint32_t size = stack->max; \
-        uint32_t count = stack->count + 1; \
-        stack->count = MIN(size, count); \
-        type_ *start = stack->elements; \
-        type_ *to = start + 1; \
-        memmove(to, start, sizeof(type_) * (size - 1)); \
-        *start = value; \
+        stack->head = (stack->head + 1) % stack->max; \
+        type_ *slot = stack->elements + stack->head; \
+        /* the oldest element is overwritten once the stack is full */ \
+        if (stack->count == stack->max) \
+        { \
+            stack->sum -= *slot; \
+            if (stack_##name_##_is_over(stack, *slot)) \
+                stack->over--; \
+        } \
+        else \
+            stack->count++; \
+        *slot = value; \
+        stack->sum += value; \
+        if (stack_##name_##_is_over(stack, value)) \
+            stack->over++; \
+    } \
+    \
+    type_ \
+    stack_##name_##_get(stack_##name_##_t *stack, uint32_t idx) \
+    { \
+        return stack->elements[(stack->head + stack->max - idx) % stack->max]; \
     } \
     \
     type_ \
     stack_##name_##_newest(stack_##name_##_t *stack) \
     { \
-        return stack->elements[0]; \
+        return stack->elements[stack->head]; \
+    } \
+    \
+    void \
+    stack_##name_##_set_threshold(stack_##name_##_t *stack, type_ threshold) \
+    { \
+        stack->threshold = threshold; \
+        stack->over = 0; \
+        for (uint32_t i = 0; i < stack->count; i++) \
+        { \
+            if (stack_##name_##_is_over(stack, stack_##name_##_get(stack, i))) \
+                stack->over++; \
+        } \
+    } \
+    \
+    uint32_t \
+    stack_##name_##_over(stack_##name_##_t *stack) \
+    { \
+        return stack->over; \
+    } \
+    \
+    double \
+    stack_##name_##_mean(stack_##name_##_t *stack) \
+    { \
+        return stack->count ? (double)stack->sum / stack->count : 0.0; \
     } \
     \
     uint32_t \
@@ -83,7 +148,7 @@
         uint32_t i = 0, count = 0; \
         while (i < stack->count) \
         { \
-            if (predicate(stack->elements[i++], obj)) \
+            if (predicate(stack_##name_##_get(stack, i++), obj)) \
                 count++; \
         } \
         return count; \
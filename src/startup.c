@@ -0,0 +1,531 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_STATE
+
+#include "def.h"
+#include "log.h"
+#include "startup.h"
+#include "utils.h"
+#include "watch.h"
+
+#include <string.h>
+
+enum
+{
+    NODE_UNVISITED,
+    NODE_VISITING,
+    NODE_VISITED
+};
+
+static startup_node_t *
+node_new(void)
+{
+    startup_node_t *node = xcalloc1(sizeof(startup_node_t));
+
+    node->waiting = list_new(NULL);
+    node->up = list_new(NULL);
+    node->active = list_new(NULL);
+    node->restarts = list_new(NULL);
+    node->rolling = list_new(NULL);
+
+    return node;
+}
+
+static void
+node_destroy(void *data)
+{
+    startup_node_t *node = data;
+
+    list_destroy(node->waiting);
+    list_destroy(node->up);
+    list_destroy(node->active);
+    list_destroy(node->restarts);
+    list_destroy(node->rolling);
+
+    strings_free((char **)node->depends_on);
+    xfree(node);
+}
+
+static bool
+contains(list_t *list, void *data)
+{
+    for (list_node_t *node = list->head; node; node = node->next)
+    {
+        if (node->data == data)
+            return true;
+    }
+
+    return false;
+}
+
+/* remove the given instance from the list */
+static bool
+take(list_t *list, void *data)
+{
+    for (list_node_t *node = list->head; node; node = node->next)
+    {
+        if (node->data == data)
+        {
+            list_remove(list, node);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+add_unique(list_t *list, void *data)
+{
+    if (!contains(list, data))
+        list_add(list, data);
+}
+
+/**
+ * @brief Create a new startup scheduler
+ * @param start   function that starts a dispatched instance
+ * @param restart function that restarts an instance
+ * @return new scheduler instance
+ */
+startup_t *
+startup_new(startup_func_t start, startup_func_t restart)
+{
+    startup_t *startup = xcalloc1(sizeof(startup_t));
+
+    pthread_mutex_init(&startup->lock, NULL);
+
+    startup->start = start;
+    startup->restart = restart;
+    startup->nodes = hash_new(node_destroy);
+
+    return startup;
+}
+
+static const char **
+copy_names(const char **names)
+{
+    if (names == NULL)
+        return NULL;
+
+    uint32_t count = count_args(names);
+    const char **copy = xcalloc(count + 1, sizeof(char *));
+
+    for (uint32_t idx = 0; idx < count; idx++)
+        copy[idx] = xstrdup(names[idx]);
+
+    return copy;
+}
+
+/* depth first search marking all watches on a dependency cycle */
+static void
+find_cycles(hash_t *nodes, startup_node_t *node, startup_node_t **stack, uint32_t depth)
+{
+    const char **dep = node->depends_on;
+
+    node->mark = NODE_VISITING;
+    node->depth = depth;
+    stack[depth] = node;
+
+    while (dep && *dep)
+    {
+        startup_node_t *other = hash_get(nodes, *dep++);
+
+        if (other == NULL)
+            continue;
+
+        if (other->mark == NODE_VISITING)
+        {
+            for (uint32_t idx = other->depth; idx <= depth; idx++)
+                stack[idx]->cyclic = true;
+        }
+        else if (other->mark == NODE_UNVISITED)
+            find_cycles(nodes, other, stack, depth + 1);
+    }
+
+    node->mark = NODE_VISITED;
+}
+
+/* the dependencies of cyclic watches are ignored so the remaining
+ * graph is acyclic and the ranks converge */
+static void
+compute_ranks(hash_t *nodes)
+{
+    bool changed = true;
+    uint32_t rounds = hash_count(nodes) + 1;
+
+    while (changed && rounds-- > 0)
+    {
+        const char *key = NULL;
+        void *data = NULL;
+        hash_iter_t *iter = hash_iter_start(nodes);
+
+        changed = false;
+
+        while (hash_iter(iter, &key, &data))
+        {
+            startup_node_t *node = data;
+            const char **dep = node->depends_on;
+
+            if (node->cyclic)
+                continue;
+
+            while (dep && *dep)
+            {
+                startup_node_t *other = hash_get(nodes, *dep++);
+
+                if (other && other->rank < node->rank + 1)
+                {
+                    other->rank = node->rank + 1;
+                    changed = true;
+                }
+            }
+        }
+
+        hash_iter_free(iter);
+    }
+}
+
+/**
+ * @brief Update the dependency graph with the configured watches
+ * @param startup scheduler instance
+ * @param watches hash of all watches
+ * @param limit   maximum number of concurrently starting watches
+ *                (0 meaning unlimited)
+ */
+void
+startup_prepare(startup_t *startup, hash_t *watches, uint32_t limit)
+{
+    const char *key = NULL;
+    void *data = NULL;
+
+    pthread_mutex_lock(&startup->lock);
+
+    startup->limit = limit;
+
+    /* drop the watches that do not exist anymore */
+    list_t *removed = list_new(NULL);
+    hash_iter_t *iter = hash_iter_start(startup->nodes);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        if (hash_get(watches, key) == NULL)
+            list_add(removed, (void *)key);
+    }
+
+    list_node_t *name = removed->head;
+    while (name)
+    {
+        startup_node_t *node = hash_get(startup->nodes, name->data);
+
+        startup->inflight -= MIN(startup->inflight, list_size(node->active));
+
+        hash_remove(startup->nodes, name->data);
+        name = name->next;
+    }
+
+    list_destroy(removed);
+    hash_iter_free(iter);
+
+    iter = hash_iter_start(watches);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        watch_t *watch = data;
+        startup_node_t *node = hash_get(startup->nodes, key);
+
+        if (node == NULL)
+        {
+            node = node_new();
+            hash_add(startup->nodes, key, node);
+        }
+
+        strings_free((char **)node->depends_on);
+        node->depends_on = copy_names(watch->depends_on);
+        node->batch = MAX(watch->restart_batch, 1);
+        node->rank = 0;
+        node->cyclic = false;
+        node->mark = NODE_UNVISITED;
+    }
+
+    hash_iter_free(iter);
+
+    uint32_t count = hash_count(startup->nodes);
+    startup_node_t **stack = xcalloc(count + 1, sizeof(startup_node_t *));
+
+    iter = hash_iter_start(startup->nodes);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        startup_node_t *node = data;
+
+        if (node->mark == NODE_UNVISITED)
+            find_cycles(startup->nodes, node, stack, 0);
+    }
+
+    hash_iter_rewind(iter);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        startup_node_t *node = data;
+
+        if (node->cyclic)
+            log_warn("Watch '%s' is part of a dependency cycle - "
+                     "ignoring its dependencies", key);
+    }
+
+    hash_iter_free(iter);
+    xfree(stack);
+
+    compute_ranks(startup->nodes);
+
+    pthread_mutex_unlock(&startup->lock);
+}
+
+static bool
+dependencies_up(startup_t *startup, startup_node_t *node)
+{
+    const char **dep = node->depends_on;
+
+    if (node->cyclic)
+        return true;
+
+    while (dep && *dep)
+    {
+        startup_node_t *other = hash_get(startup->nodes, *dep++);
+
+        /* unknown dependencies are ignored */
+        if (other && list_size(other->up) < 1)
+            return false;
+    }
+
+    return true;
+}
+
+/* start the waiting watches whose dependencies are running
+ * (highest rank first) as long as the limit permits */
+static void
+dispatch(startup_t *startup)
+{
+    while (startup->limit == 0 || startup->inflight < startup->limit)
+    {
+        const char *key = NULL;
+        void *data = NULL;
+        startup_node_t *next = NULL;
+        hash_iter_t *iter = hash_iter_start(startup->nodes);
+
+        while (hash_iter(iter, &key, &data))
+        {
+            startup_node_t *node = data;
+
+            if (list_size(node->waiting) < 1 || (next && next->rank >= node->rank))
+                continue;
+
+            if (dependencies_up(startup, node))
+                next = node;
+        }
+
+        hash_iter_free(iter);
+
+        if (next == NULL)
+            break;
+
+        void *waiting = NULL;
+
+        list_pop(next->waiting, &waiting);
+        list_add(next->active, waiting);
+        startup->inflight++;
+
+        startup->start(waiting);
+    }
+}
+
+/* restart the next batch of instances */
+static void
+dispatch_rollout(startup_node_t *node, startup_func_t restart)
+{
+    void *data = NULL;
+
+    while (list_size(node->rolling) < node->batch && list_pop(node->restarts, &data))
+    {
+        list_add(node->rolling, data);
+        restart(data);
+    }
+}
+
+/**
+ * @brief Queue the initial start of a watch instance
+ * @param startup scheduler instance
+ * @param name    name of the watch
+ * @param data    data passed to the start function
+ */
+void
+startup_enqueue(startup_t *startup, const char *name, void *data)
+{
+    pthread_mutex_lock(&startup->lock);
+
+    startup_node_t *node = hash_get(startup->nodes, name);
+
+    /* the watch was not prepared - start it right away */
+    if (node == NULL)
+    {
+        pthread_mutex_unlock(&startup->lock);
+        startup->start(data);
+        return;
+    }
+
+    add_unique(node->waiting, data);
+
+    if (!dependencies_up(startup, node))
+    {
+        log_info("Watch '%s' is waiting for its dependencies", name);
+    }
+
+    dispatch(startup);
+
+    pthread_mutex_unlock(&startup->lock);
+}
+
+/**
+ * @brief Notify the scheduler that a watch instance is running
+ * @param startup scheduler instance
+ * @param name    name of the watch
+ * @param data    data of the instance
+ */
+void
+startup_running(startup_t *startup, const char *name, void *data)
+{
+    pthread_mutex_lock(&startup->lock);
+
+    startup_node_t *node = hash_get(startup->nodes, name);
+
+    if (node)
+    {
+        add_unique(node->up, data);
+        take(node->waiting, data);
+
+        if (take(node->active, data))
+            startup->inflight--;
+
+        /* the restarted instance is serving again */
+        if (take(node->rolling, data))
+        {
+            dispatch_rollout(node, startup->restart);
+
+            if (list_size(node->rolling) < 1)
+                log_info("Rolling restart of watch '%s' finished", name);
+        }
+
+        dispatch(startup);
+    }
+
+    pthread_mutex_unlock(&startup->lock);
+}
+
+/**
+ * @brief Notify the scheduler that a watch instance stopped (or is not
+ *        processed anymore at all)
+ * @param startup scheduler instance
+ * @param name    name of the watch
+ * @param data    data of the instance
+ */
+void
+startup_stopped(startup_t *startup, const char *name, void *data)
+{
+    pthread_mutex_lock(&startup->lock);
+
+    startup_node_t *node = hash_get(startup->nodes, name);
+
+    if (node)
+    {
+        take(node->up, data);
+        take(node->waiting, data);
+        take(node->restarts, data);
+
+        /* a failed restart aborts the rollout so the remaining
+         * instances keep serving */
+        if (take(node->rolling, data) && list_size(node->restarts) > 0)
+        {
+            void *pending = NULL;
+
+            log_warn("Aborting rolling restart of watch '%s' - "
+                     "%lu instances were not restarted", name,
+                     (unsigned long)list_size(node->restarts));
+
+            while (list_pop(node->restarts, &pending))
+                ;
+        }
+
+        /* a failed start frees its slot as well */
+        if (take(node->active, data))
+        {
+            startup->inflight--;
+
+            dispatch(startup);
+        }
+    }
+
+    pthread_mutex_unlock(&startup->lock);
+}
+
+/**
+ * @brief Restart the given instances of a watch in batches: the next
+ *        batch is restarted as soon as the previous one is running again
+ * @param startup   scheduler instance
+ * @param name      name of the watch
+ * @param instances instances to restart
+ * @return false if a rolling restart of the watch is in progress already
+ */
+bool
+startup_rollout(startup_t *startup, const char *name, list_t *instances)
+{
+    bool started = false;
+
+    pthread_mutex_lock(&startup->lock);
+
+    startup_node_t *node = hash_get(startup->nodes, name);
+
+    if (node && list_size(node->restarts) < 1 && list_size(node->rolling) < 1)
+    {
+        for (list_node_t *instance = instances->head; instance; instance = instance->next)
+            list_add(node->restarts, instance->data);
+
+        log_info("Rolling restart of watch '%s' (%lu instances, %u at once)",
+                name, (unsigned long)list_size(node->restarts), node->batch);
+
+        dispatch_rollout(node, startup->restart);
+        started = true;
+    }
+
+    pthread_mutex_unlock(&startup->lock);
+
+    return started;
+}
+
+void
+startup_destroy(startup_t *startup)
+{
+    if (startup == NULL)
+        return;
+
+    hash_destroy(startup->nodes);
+    pthread_mutex_destroy(&startup->lock);
+
+    xfree(startup);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,97 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "hash.h"
+#include "list.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* called (with the scheduler locked) to start or restart a dispatched
+ * watch instance */
+typedef void (*startup_func_t)(void *data);
+
+/** scheduling state of a watch - the lists contain its instances */
+typedef struct
+{
+    /** names of the watches this watch depends on */
+    const char **depends_on;
+    /** length of the longest chain of watches depending on this one */
+    uint32_t rank;
+    bool cyclic;
+    /** instances waiting to be started */
+    list_t *waiting;
+    /** running instances */
+    list_t *up;
+    /** instances that were dispatched and are still starting */
+    list_t *active;
+
+    /* rolling restart */
+    uint32_t batch;
+    /** instances waiting to be restarted */
+    list_t *restarts;
+    /** instances that are restarting */
+    list_t *rolling;
+
+    /* dependency graph traversal */
+    uint32_t mark;
+    uint32_t depth;
+} startup_node_t;
+
+/**
+ * Scheduler of the initial start of the watches: a watch is started as
+ * soon as (at least one instance of) all of its dependencies are running
+ * while at most 'limit' instances are starting at the same time. Watches
+ * with the longest chain of dependents are started first.
+ *
+ * The rolling restarts of watches with multiple instances are scheduled
+ * in here as well.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    startup_func_t start;
+    startup_func_t restart;
+    /** maximum number of concurrently starting watches (0 = unlimited) */
+    uint32_t limit;
+    uint32_t inflight;
+    hash_t *nodes;
+} startup_t;
+
+startup_t *
+startup_new(startup_func_t start, startup_func_t restart);
+
+void
+startup_prepare(startup_t *startup, hash_t *watches, uint32_t limit);
+
+void
+startup_enqueue(startup_t *startup, const char *name, void *data);
+
+void
+startup_running(startup_t *startup, const char *name, void *data);
+
+void
+startup_stopped(startup_t *startup, const char *name, void *data);
+
+bool
+startup_rollout(startup_t *startup, const char *name, list_t *instances);
+
+void
+startup_destroy(startup_t *startup);
+
+/* vim: set et sw=4 sts=4 tw=80: */
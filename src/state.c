@@ -15,15 +15,24 @@
 
 #define _GNU_SOURCE
 
+#define NYX_LOG_CATEGORY NYX_LOG_STATE
+#define NYX_MEM_TAG MEM_STATE
+
 #include "def.h"
 #include "log.h"
 #include "forker.h"
 #include "fs.h"
+#include "poll.h"
 #include "process.h"
+#include "prometheus.h"
+#include "socket.h"
 #include "state.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <errno.h>
 #include <math.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -31,19 +40,22 @@
 #include <unistd.h>
 
 #define NYX_STATE_JOIN_TIMEOUT 30
+#define NYX_FLAPPING_DELAY     5
 #define NYX_MAX_FLAPPING_DELAY 600
 #define NYX_FLAPPING_INTERVAL  60
 #define NYX_FLAPPING_COUNT     5
 
-typedef bool (*transition_func_t)(state_t *, state_e, state_e);
+/* flapping parameters of a watch (or their defaults) */
+#define FLAPPING_PARAM(watch_, param_, default_) \
+    ((watch_)->param_ ? (watch_)->param_ : (default_))
 
-typedef struct
-{
-    state_e value;
-    bool is_command;
-} state_entry_t;
+#define FLAPPING_COUNT(w)     FLAPPING_PARAM(w, flapping_count, NYX_FLAPPING_COUNT)
+#define FLAPPING_INTERVAL(w)  FLAPPING_PARAM(w, flapping_interval, NYX_FLAPPING_INTERVAL)
+#define FLAPPING_DELAY(w)     FLAPPING_PARAM(w, flapping_delay, NYX_FLAPPING_DELAY)
+#define MAX_FLAPPING_DELAY(w) FLAPPING_PARAM(w, max_flapping_delay, NYX_MAX_FLAPPING_DELAY)
+
+typedef bool (*transition_func_t)(state_t *, state_e, state_e);
 
-#ifndef NDEBUG
 static const char *state_to_str[] =
 {
     "STATE_INIT",
@@ -63,6 +75,7 @@ state_to_string(state_e state)
     return state_to_str[state];
 }
 
+#ifndef NDEBUG
 static const char *
 state_idx_to_string(int32_t state)
 {
@@ -89,47 +102,175 @@ state_to_human_string(state_e state)
     return state_to_human_str[state];
 }
 
+/**
+ * Find the entry a command may take over in a full queue: the newest
+ * entry that was not requested by a command or the newest one at all for
+ * QUIT which must never be lost.
+ */
 static state_entry_t *
-state_entry_new(state_e value, bool is_command)
+state_queue_replaceable(state_queue_t *queue, state_e value)
 {
-    state_entry_t *entry = xcalloc1(sizeof(state_entry_t));
+    for (uint32_t idx = queue->count; idx > 0; idx--)
+    {
+        state_entry_t *entry =
+            &queue->entries[(queue->head + idx - 1) % NYX_STATE_QUEUE_SIZE];
+
+        if (!entry->is_command)
+            return entry;
+    }
+
+    if (value == STATE_QUIT)
+        return &queue->entries[(queue->head + queue->count - 1) % NYX_STATE_QUEUE_SIZE];
+
+    return NULL;
+}
+
+/**
+ * Put the requested state into the queue. A request that equals the
+ * newest pending one is merged into that entry instead. Commands replace
+ * a pending internal state change if the queue is full.
+ *
+ * Has to be called with the queue lock being held.
+ */
+static bool
+state_queue_push(state_queue_t *queue, state_e value, bool is_command, bool *added)
+{
+    *added = false;
+
+    if (queue->count > 0)
+    {
+        uint32_t newest = (queue->head + queue->count - 1) % NYX_STATE_QUEUE_SIZE;
+        state_entry_t *entry = &queue->entries[newest];
+
+        if (entry->value == value)
+        {
+            if (is_command && !entry->is_command)
+            {
+                entry->is_command = true;
+                __atomic_add_fetch(&queue->commands, 1, __ATOMIC_RELEASE);
+            }
+
+            return true;
+        }
+    }
+
+    if (queue->count >= NYX_STATE_QUEUE_SIZE)
+    {
+        state_entry_t *entry = is_command ? state_queue_replaceable(queue, value) : NULL;
+
+        if (entry == NULL)
+            return false;
+
+        /* the replaced entry was notified already */
+        if (!entry->is_command)
+            __atomic_add_fetch(&queue->commands, 1, __ATOMIC_RELEASE);
+
+        entry->value = value;
+        entry->is_command = true;
+        entry->requested = stats_now();
+
+        return true;
+    }
+
+    state_entry_t *entry =
+        &queue->entries[(queue->head + queue->count) % NYX_STATE_QUEUE_SIZE];
 
     entry->value = value;
     entry->is_command = is_command;
+    entry->requested = stats_now();
+
+    queue->count++;
+
+    if (is_command)
+        __atomic_add_fetch(&queue->commands, 1, __ATOMIC_RELEASE);
 
-    return entry;
+    *added = true;
+
+    return true;
 }
 
 static bool
-set_state_internal(state_t *state, state_e value, bool is_command)
+state_queue_pop(state_queue_t *queue, state_entry_t *entry)
 {
-    if (sem_wait(state->states_sem) != 0)
+    bool popped = false;
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->count > 0)
     {
-        return false;
+        *entry = queue->entries[queue->head];
+
+        queue->head = (queue->head + 1) % NYX_STATE_QUEUE_SIZE;
+        queue->count--;
+
+        if (entry->is_command)
+            __atomic_sub_fetch(&queue->commands, 1, __ATOMIC_RELEASE);
+
+        popped = true;
     }
 
+    pthread_mutex_unlock(&queue->lock);
+
+    if (popped)
+        stats_record_since(STATS_QUEUE_WAIT, entry->requested);
+
+    return popped;
+}
+
+static bool
+has_pending_command(state_t *state)
+{
+    return __atomic_load_n(&state->queue.commands, __ATOMIC_ACQUIRE) > 0;
+}
+
+static void
+state_notify(state_t *state)
+{
+    if (state->engine)
+        engine_schedule(state->engine, &state->task);
+    else
+        sem_post(state->notify_sem);
+}
+
+static bool
+set_state_internal(state_t *state, state_e value, bool is_command)
+{
+    bool added = false, success = false;
+    state_queue_t *queue = &state->queue;
+
+    pthread_mutex_lock(&queue->lock);
+
     /* do not override QUIT signal */
     if (state->state == STATE_QUIT)
     {
         log_debug("state %s is about to quit - skip setting updated state",
-                state->watch->name);
+                state->name);
 
-        sem_post(state->states_sem);
-        sem_post(state->notify_sem);
+        pthread_mutex_unlock(&queue->lock);
+        state_notify(state);
         return false;
     }
 
     /* we don't set the state immediately but rather put
      * the 'requested' state into the states queue for the
      * state-loop to process those one after the other */
-    state_entry_t *entry = state_entry_new(value, is_command);
-    list_add(state->states, entry);
+    success = state_queue_push(queue, value, is_command, &added);
 
-    /* release states semaphore */
-    sem_post(state->states_sem);
+    pthread_mutex_unlock(&queue->lock);
 
-    /* trigger state change notification */
-    sem_post(state->notify_sem);
+    NYX_TRACE4(state__enqueue, state->name, value, is_command, added);
+
+    if (!success)
+    {
+        log_warn("State queue of watch '%s' is full - dropping requested "
+                 "state '%s'", state->name, state_to_human_string(value));
+        return false;
+    }
+
+    /* trigger state change notification
+     * (a merged request does not need another one) */
+    if (added)
+        state_notify(state);
 
     return true;
 }
@@ -137,7 +278,7 @@ set_state_internal(state_t *state, state_e value, bool is_command)
 /**
  * Try to set the state's state to the given value
  *
- * This function is guarded by the state's semaphore
+ * This function is guarded by the state's queue lock
  * meaning this function will wait until the lock
  * is acquired.
  */
@@ -151,7 +292,7 @@ set_state(state_t *state, state_e value)
  * Try to set the state's state to the given value.
  * This state is based on a user's command.
  *
- * This function is guarded by the state's semaphore
+ * This function is guarded by the state's queue lock
  * meaning this function will wait until the lock
  * is acquired.
  */
@@ -161,26 +302,240 @@ set_state_command(state_t *state, state_e value)
     return set_state_internal(state, value, true);
 }
 
+/**
+ * @brief Reload the running process of the given state in place via its
+ *        watch's 'reload' command or 'reload_signal' instead of a restart.
+ *        The process' liveness is verified by its regular checks that are
+ *        run once the watch's startup delay passed.
+ * @param state state to reload
+ * @return true if the reload was triggered; false otherwise
+ */
+bool
+state_reload(state_t *state)
+{
+    nyx_t *nyx = state->nyx;
+    watch_t *watch = state->watch;
+    pid_t pid = state->pid;
+
+    if (state->state != STATE_RUNNING || pid < 1)
+    {
+        log_warn("Watch '%s' is not running - skipping reload", state->name);
+        return false;
+    }
+
+    /* a custom reload command takes precedence over the signal */
+    if (watch->reload)
+    {
+        fork_info_t *info = forker_reload_process(watch->id, state->instance, pid);
+        bool sent = write(nyx->forker_pipe, info, sizeof(fork_info_t)) != -1;
+
+        nyx_free(info, MEM_OTHER);
+
+        if (!sent)
+        {
+            log_perror("nyx: write");
+            return false;
+        }
+    }
+    else if (kill(pid, watch->reload_signal) == -1)
+    {
+        log_perror("nyx: kill");
+        return false;
+    }
+
+    state->reload_time = time(NULL);
+
+    log_info("Watch '%s' (PID %d) is reloading", state->name, pid);
+
+    if (nyx->proc)
+        nyx_proc_reloaded(nyx->proc, pid, watch->startup_delay * 1000ULL);
+
+    return true;
+}
+
 #define DEBUG_LOG_STATE_FUNC \
     log_debug("State transition function of watch '%s'" \
               " from %s to %s",\
-              state->watch->name,\
+              state->name,\
               state_to_string(from),\
               state_to_string(to))
 
+static persist_slot_t *
+persisted(state_t *state)
+{
+    return persist_get(state->nyx->persist, state->persist_slot);
+}
+
+/* restore the failed counter and history of a previous nyx instance */
+static void
+state_restore(state_t *state)
+{
+    persist_slot_t *slot = persisted(state);
+
+    if (slot == NULL)
+        return;
+
+    state->failed_counter = slot->failed_counter;
+
+    for (uint32_t i = 0; i < MIN(slot->history_count, PERSIST_HISTORY); i++)
+        timestack_add_at(state->history, slot->history[i].time, slot->history[i].value);
+}
+
+/* write the state's current values into its persisted slot */
+static void
+state_persist(state_t *state)
+{
+    persist_slot_t *slot = persisted(state);
+
+    if (slot == NULL)
+        return;
+
+    uint32_t count = MIN(state->history->count, PERSIST_HISTORY);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        timestack_elem_t *elem = timestack_get(state->history, count - 1 - i);
+
+        slot->history[i].time = elem->time;
+        slot->history[i].value = elem->value;
+    }
+
+    slot->history_count = count;
+    slot->state = state->state;
+    slot->failed_counter = state->failed_counter;
+}
+
+/* publish the state's current values in the status table */
+static void
+state_publish(state_t *state)
+{
+    status_set_state(state->nyx->status, state->status_slot, state->state, state->pid,
+            state->starts > 0 ? state->starts - 1 : 0, state->failed_counter);
+}
+
+/* the process of a previous nyx instance is adopted if it is
+ * still the very same process (same pid and start time) */
+static pid_t
+persisted_pid(state_t *state)
+{
+    persist_slot_t *slot = persisted(state);
+
+    if (slot == NULL || slot->pid < 1 || slot->start_time == 0)
+        return 0;
+
+    if (process_start_time(slot->pid) != slot->start_time)
+        return 0;
+
+    return slot->pid;
+}
+
+/* keep the kernel-side event filter and the polling manager in sync
+ * with the standby process (called with the queue lock held) */
+static void
+spare_track(state_t *state, pid_t pid, bool track)
+{
+    nyx_t *nyx = state->nyx;
+
+    if (nyx->pids)
+    {
+        if (track)
+            pidmap_add(nyx->pids, pid, state);
+        else
+            pidmap_remove(nyx->pids, pid, state);
+    }
+
+    event_filter_update(nyx);
+
+    if (track)
+        poll_track_pid(pid);
+}
+
+/**
+ * @brief Request a new standby process of a 'spare' watch from the forker
+ *        unless there is one already
+ * @param state state of the watch
+ */
+static void
+spare_spawn(state_t *state)
+{
+    fork_info_t *info = NULL;
+
+    if (!state->watch->spare)
+        return;
+
+    pthread_mutex_lock(&state->queue.lock);
+
+    state->spare_wanted = true;
+
+    if (state->spare_pid < 1 && state->spare_seq == 0)
+    {
+        info = forker_spare(state->watch->id, state->instance);
+        state->spare_seq = info->seq;
+    }
+
+    pthread_mutex_unlock(&state->queue.lock);
+
+    if (info == NULL)
+        return;
+
+    if (write(state->nyx->forker_pipe, info, sizeof(fork_info_t)) == -1)
+        log_perror("nyx: write");
+
+    nyx_free(info, MEM_OTHER);
+}
+
+/**
+ * @brief Terminate the standby process of a 'spare' watch (if any) - a
+ *        standby that is still being spawned is terminated on arrival
+ * @param state state of the watch
+ */
+static void
+spare_stop(state_t *state)
+{
+    pthread_mutex_lock(&state->queue.lock);
+
+    pid_t pid = state->spare_pid;
+
+    state->spare_wanted = false;
+    state->spare_pid = 0;
+
+    if (pid > 0)
+        spare_track(state, pid, false);
+
+    pthread_mutex_unlock(&state->queue.lock);
+
+    if (pid < 1)
+        return;
+
+    log_debug("Terminating standby process %d of watch '%s'", pid, state->name);
+
+    if (kill(pid, SIGTERM) == -1 && errno != ESRCH)
+        log_perror("nyx: kill");
+}
+
 static bool
 to_unmonitored(state_t *state, state_e from, state_e to)
 {
-    bool is_running = false;
-    watch_t *watch = state->watch;
+    bool is_running = false, adopted = false;
     pid_t pid = state->pid;
 
     DEBUG_LOG_STATE_FUNC;
 
+    if (from != STATE_INIT && state->nyx->startup)
+        startup_stopped(state->nyx->startup, state->watch->name, state);
+
+    spare_stop(state);
+
     /* determine if the process is already/still running */
 
     /* no pid yet
      * this should be usually the case on startup */
+    if (pid < 1 && (pid = persisted_pid(state)) > 0)
+    {
+        log_debug("Adopting process %d of watch '%s'", pid, state->name);
+        adopted = true;
+    }
+
     if (pid < 1)
     {
         /* try to read pid from an existing pid file
@@ -188,7 +543,7 @@ to_unmonitored(state_t *state, state_e from, state_e to)
          * in here it might get a little bit risky since
          * we don't know how valid the pid file's contents
          * are (e.g. being old or outdated even) */
-        pid = determine_pid(watch->name, state->nyx);
+        pid = determine_pid(state->name, state->nyx);
     }
 
     /* at least we can check if the pid is not the same
@@ -198,18 +553,68 @@ to_unmonitored(state_t *state, state_e from, state_e to)
 
     if (pid > 0)
     {
-        is_running = check_process_running(pid);
+        is_running = adopted || check_process_running(pid);
 
         if (!is_running)
-            clear_pid(watch->name, state->nyx);
+            clear_pid(state->name, state->nyx);
 
-        state->pid = is_running ? pid : 0;
+        state_set_pid(state, is_running ? pid : 0);
     }
 
     set_state(state, is_running
         ? STATE_RUNNING
         : STATE_STOPPED);
 
+    /* the running process was started with a different definition */
+    if (is_running && state->restart_pending)
+        set_state(state, STATE_RESTARTING);
+
+    state->restart_pending = false;
+
+    return true;
+}
+
+/**
+ * Check if the process that is about to be stopped has terminated
+ * meanwhile. After the configured stop timeout has elapsed the
+ * process is killed via SIGKILL.
+ */
+static bool
+stop_finished(state_t *state, bool exited)
+{
+    nyx_t *nyx = state->nyx;
+    watch_t *watch = state->watch;
+    pid_t pid = state->wait_pid;
+
+    if (exited || (kill(pid, 0) == -1 && errno == ESRCH))
+        goto end;
+
+    if (state->wait_ticks > 0)
+    {
+        state->wait_ticks--;
+        return false;
+    }
+
+    /* the app failed to terminate after several attempts
+     * -> send a SIGKILL now */
+
+    if (kill(pid, SIGKILL) == -1 && errno != ESRCH)
+    {
+        log_perror("nyx: kill");
+    }
+
+    log_warn("Failed to stop watch '%s' after waiting %d seconds - "
+             "sending SIGKILL now",
+             state->name,
+             (watch->stop_timeout ? watch->stop_timeout : nyx->options.def_stop_timeout));
+
+end:
+    stats_record_since(STATS_STOP, state->stop_time);
+
+    /* according to the 'kill -0' above we can safely assume
+     * we successfully terminated this watch */
+    clear_pid(state->name, nyx);
+
     return true;
 }
 
@@ -224,6 +629,9 @@ stop(state_t *state, state_e from, state_e to)
 
     uint32_t times = nyx->options.def_stop_timeout;
 
+    /* the standby must not take over a requested stop */
+    spare_stop(state);
+
     if (watch->stop_timeout)
         times = watch->stop_timeout;
 
@@ -239,15 +647,17 @@ stop(state_t *state, state_e from, state_e to)
         return true;
     }
 
+    state->stop_time = stats_now();
+
     /* in case a custom stop command is specified we use that one */
     if (watch->stop)
     {
-        fork_info_t *stop_info = forker_stop(state->watch->id, pid);
+        fork_info_t *stop_info = forker_stop(state->watch->id, state->instance, pid);
 
         if (write(nyx->forker_pipe, stop_info, sizeof(fork_info_t)) == -1)
             log_perror("nyx: write");
 
-        free(stop_info);
+        nyx_free(stop_info, MEM_OTHER);
     }
     /* otherwise we try SIGTERM */
     else
@@ -264,34 +674,41 @@ stop(state_t *state, state_e from, state_e to)
         }
     }
 
-    while (times-- > 0)
+    state->wait_pid = pid;
+    state->wait_ticks = times;
+
+    /* the state engine waits for the process' termination
+     * in a continuation instead of blocking right here */
+    if (state->engine)
     {
-        if (kill(pid, 0) == -1)
+        state->wait = STATE_WAIT_STOP;
+
+        /* the kernel signals the termination and the SIGKILL
+         * escalation is scheduled as a timer */
+        if (engine_watch_exit(state->engine, &state->task, pid))
         {
-            if (errno == ESRCH)
-                goto end;
+            state->wait_ticks = 0;
+            engine_task_delay(&state->task, times * 1000);
         }
+        /* otherwise we check once every second */
+        else
+            engine_task_delay(&state->task, 0);
 
-        sleep(1);
+        return true;
     }
 
-    /* the app failed to terminate after several attempts
-     * -> send a SIGKILL now */
+    int32_t exited = wait_for_exit(pid, times * 1000);
 
-    if (kill(pid, SIGKILL) == -1 && errno != ESRCH)
+    if (exited >= 0)
     {
-        log_perror("nyx: kill");
+        state->wait_ticks = 0;
+        stop_finished(state, exited > 0);
+        return true;
     }
 
-    log_warn("Failed to stop watch '%s' after waiting %d seconds - "
-             "sending SIGKILL now",
-             watch->name,
-             (watch->stop_timeout ? watch->stop_timeout : nyx->options.def_stop_timeout));
-
-end:
-    /* according to the 'kill -0' above we can safely assume
-     * we successfully terminated this watch */
-    clear_pid(watch->name, nyx);
+    /* fallback to polling the process once every second */
+    while (!stop_finished(state, false))
+        sleep(1);
 
     return true;
 }
@@ -299,29 +716,57 @@ end:
 static bool
 restart(state_t *state, state_e from, state_e to)
 {
-    log_info("Watch '%s' is restarting (PID %d)", state->watch->name, state->pid);
+    log_info("Watch '%s' is restarting (PID %d)", state->name, state->pid);
 
     return stop(state, from, to);
 }
 
 
-static pid_t
+static void
 start_state(state_t *state)
 {
     /* start program via forker */
-    fork_info_t *start_info = forker_start(state->watch->id);
+    fork_info_t *start_info = forker_start(state->watch->id, state->instance);
+
+    pthread_mutex_lock(&state->queue.lock);
+
+    /* replies of previous start requests are ignored */
+    state->spawn_seq = start_info->seq;
+    state->spawn_replied = false;
+    state->spawn_pid = 0;
+    state->spawn_error = 0;
+    state->ready = false;
+    state->start_time = stats_now();
+
+    pthread_mutex_unlock(&state->queue.lock);
+
+    /* discard notifications of a previous instance */
+    if (state->notify_fd >= 0)
+        notify_socket_ready(state->notify_fd);
 
     if (write(state->nyx->forker_pipe, start_info, sizeof(fork_info_t)) == -1)
         log_perror("nyx: write");
 
-    free(start_info);
+    nyx_free(start_info, MEM_OTHER);
+}
+
+static uint32_t
+start_timeout(state_t *state)
+{
+    if (state->watch->start_timeout)
+        return state->watch->start_timeout;
 
-    /* let's check if the process is running at all
-     * we will delay a little bit to give the process some
-     * time to launch 'execvp' */
-    usleep(500000);
+    return state->nyx->options.def_start_timeout;
+}
 
-    pid_t pid = determine_pid(state->watch->name, state->nyx);
+static pid_t
+started_pid(state_t *state)
+{
+    /* prefer the pid reported by the forker over the pid file */
+    pid_t pid = state->spawn_pid;
+
+    if (pid < 1)
+        pid = determine_pid(state->name, state->nyx);
 
     if (!valid_pid(pid, state->nyx))
         pid = 0;
@@ -330,31 +775,226 @@ start_state(state_t *state)
     {
         if (!check_process_running(pid))
         {
-            log_debug("Watch '%s' failed to start", state->watch->name);
+            log_debug("Watch '%s' failed to start", state->name);
             return 0;
         }
 
-        state->pid = pid;
+        state_set_pid(state, pid);
 
-        log_debug("Retrieved PID %d for watch '%s'", pid, state->watch->name);
+        log_debug("Retrieved PID %d for watch '%s'", pid, state->name);
     }
 
     return pid;
 }
 
-static bool
-start(state_t *state, state_e from, state_e to)
+static void
+start_finished(state_t *state)
 {
-    DEBUG_LOG_STATE_FUNC;
+    stats_record_since(STATS_START, state->start_time);
+
+    /* the restart is not in progress anymore */
+    if (state->nyx->limiter)
+        limiter_release(state->nyx->limiter, &state->ticket);
+
+    if (state->spawn_error)
+    {
+        log_error("Failed to start watch '%s': %s",
+                state->name, strerror(state->spawn_error));
+    }
+
+    if (started_pid(state) > 0)
+    {
+        if (state->notify_fd >= 0 && !state->ready)
+        {
+            log_warn("Watch '%s' did not signal readiness within %u seconds",
+                    state->name, start_timeout(state));
+        }
 
-    if (start_state(state) > 0)
         set_state(state, STATE_RUNNING);
+    }
     else
         set_state(state, STATE_STOPPED);
+}
+
+/**
+ * Check whether the forker replied to the start request and the
+ * process signaled its readiness (if requested to).
+ */
+static bool
+start_ready(state_t *state)
+{
+    pthread_mutex_lock(&state->queue.lock);
+    bool replied = state->spawn_replied;
+    pthread_mutex_unlock(&state->queue.lock);
+
+    if (!replied)
+        return false;
+
+    /* the process failed to spawn at all */
+    if (state->spawn_pid < 1 || state->notify_fd < 0)
+        return true;
+
+    if (!state->ready && notify_socket_ready(state->notify_fd))
+        state->ready = true;
+
+    return state->ready;
+}
+
+static void
+start_wait(state_t *state)
+{
+    uint32_t timeout = start_timeout(state);
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout;
+
+    /* wait for the forker to report the spawned pid */
+    pthread_mutex_lock(&state->queue.lock);
+
+    while (!state->spawn_replied)
+    {
+        if (pthread_cond_timedwait(&state->spawn_cond,
+                    &state->queue.lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+
+    pthread_mutex_unlock(&state->queue.lock);
+
+    /* wait for the process to send 'READY=1' */
+    while (!start_ready(state) && state->spawn_replied)
+    {
+        struct timespec now;
+        struct pollfd fds = { .fd = state->notify_fd, .events = POLLIN };
+
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        int64_t remaining = (deadline.tv_sec - now.tv_sec) * 1000 +
+            (deadline.tv_nsec - now.tv_nsec) / 1000000;
+
+        if (remaining <= 0 || has_pending_command(state))
+            break;
+
+        if (poll(&fds, 1, remaining) == -1 && errno != EINTR)
+        {
+            log_perror("nyx: poll");
+            break;
+        }
+    }
+}
+
+/* the restarts of watches that were running before have to be admitted
+ * by the host-wide restart limiter (if configured) */
+static bool
+start_limited(state_t *state)
+{
+    limiter_t *limiter = state->nyx->limiter;
+
+    if (limiter == NULL || state->starts < 1)
+        return false;
+
+    if (limiter_acquire(limiter, &state->ticket, state->watch->restart_priority, state))
+        return false;
+
+    log_info("Watch '%s' is queued for restart (%u restarts waiting)",
+            state->name, limiter_queued(limiter));
+
+    return true;
+}
+
+/* a queued restart is withdrawn in favor of a user-command - the state
+ * falls back to 'stopped' which restarts it again unless it is stopped */
+static void
+start_withdraw(state_t *state)
+{
+    log_debug("Withdrawing queued restart of watch '%s'", state->name);
+
+    limiter_release(state->nyx->limiter, &state->ticket);
+    set_state(state, STATE_STOPPED);
+}
+
+/**
+ * Wait for the admission of a queued restart - the wait is interrupted as
+ * soon as a user-command (i.e. STOPPING or QUIT) is queued
+ */
+static bool
+start_admit_wait(state_t *state)
+{
+    uint32_t wait = 0;
+
+    while ((wait = limiter_poll(state->nyx->limiter, &state->ticket)) > 0)
+    {
+        if (state->state == STATE_QUIT || has_pending_command(state))
+        {
+            start_withdraw(state);
+            return false;
+        }
+
+        usleep(MIN(wait, 100) * 1000);
+    }
+
+    return true;
+}
+
+static bool
+start_spawn(state_t *state)
+{
+    start_state(state);
+
+    /* without the forker's replies we check if the process is
+     * running at all after giving it some time to launch 'execvp' */
+    if (state->nyx->forker_reply_thread == NULL)
+    {
+        if (state->engine)
+        {
+            state->wait = STATE_WAIT_START;
+            engine_task_delay(&state->task, 500);
+            return true;
+        }
+
+        usleep(500000);
+        start_finished(state);
+
+        return true;
+    }
+
+    /* otherwise we wait for the forker's reply and the process'
+     * readiness notification up to the start timeout */
+    if (state->engine)
+    {
+        state->wait = STATE_WAIT_START;
+        engine_task_delay(&state->task, start_timeout(state) * 1000);
+        return true;
+    }
+
+    start_wait(state);
+    start_finished(state);
 
     return true;
 }
 
+static bool
+start(state_t *state, state_e from, state_e to)
+{
+    DEBUG_LOG_STATE_FUNC;
+
+    if (start_limited(state))
+    {
+        /* the state engine is scheduled on the admission */
+        if (state->engine)
+        {
+            state->wait = STATE_WAIT_ADMIT;
+            engine_task_delay(&state->task, limiter_poll(state->nyx->limiter, &state->ticket));
+            return true;
+        }
+
+        if (!start_admit_wait(state))
+            return true;
+    }
+
+    return start_spawn(state);
+}
+
 static bool
 state_is_running(int32_t state)
 {
@@ -385,21 +1025,32 @@ stopped(state_t *state, state_e from, state_e to)
 
     bool is_initializing = from == STATE_UNMONITORED;
 
+    /* the standby could not take over (or was not started yet) */
+    spare_stop(state);
+
     /* restart if the stop wasn't requested via 'STOPPING' */
     if (from != STATE_STOPPING && from != STATE_STOPPED)
     {
+        /* lazy watches are started on their first connection instead */
+        if (is_initializing && state->watch->listen_lazy && state->watch->listen)
+            log_info("Watch '%s' is started on its first connection", state->name);
         /* start after initialization only if we are not in passive mode */
-        if (!is_initializing || !state->nyx->options.passive_mode)
+        else if (is_initializing && state->nyx->startup && !state->nyx->options.passive_mode)
+            startup_enqueue(state->nyx->startup, state->watch->name, state);
+        else if (!is_initializing || !state->nyx->options.passive_mode)
             set_state(state, STATE_STARTING);
     }
 
+    if (!is_initializing && state->nyx->startup)
+        startup_stopped(state->nyx->startup, state->watch->name, state);
+
     /* reset failed counter in case the watch was running
      * for the maximum flapping time */
-    if (was_running_for(state) > (NYX_FLAPPING_INTERVAL / NYX_FLAPPING_COUNT))
+    if (was_running_for(state) > (FLAPPING_INTERVAL(state->watch) / FLAPPING_COUNT(state->watch)))
         state->failed_counter = 0;
 
     if (!is_initializing)
-        log_info("Watch '%s' just stopped", state->watch->name);
+        log_info("Watch '%s' just stopped", state->name);
 
     return true;
 }
@@ -410,15 +1061,21 @@ running(state_t *state, state_e from, state_e to)
     DEBUG_LOG_STATE_FUNC;
 
     if (state->nyx->proc && state->pid)
-        nyx_proc_add(state->nyx->proc, state->pid, state->watch);
+        nyx_proc_add(state->nyx->proc, state->pid, state->name, state->watch);
 
     bool is_init = from == STATE_UNMONITORED || from == STATE_INIT;
 
     log_info("Watch '%s' is %s running (PID %d)",
-            state->watch->name,
+            state->name,
             (is_init ? "still" : "now"),
             state->pid);
 
+    /* the watches depending on this one may be started now */
+    if (state->nyx->startup)
+        startup_running(state->nyx->startup, state->watch->name, state);
+
+    spare_spawn(state);
+
     return true;
 }
 
@@ -444,29 +1101,218 @@ static transition_func_t transition_table[STATE_SIZE][STATE_SIZE] =
     /* RESTARTING to ... */
     { NULL, to_unmonitored, NULL,     running, stop,     start,   NULL },
 
-    /* QUIT to ... */
-    { NULL }
-};
+    /* QUIT to ... */
+    { NULL }
+};
+
+static state_t*
+find_state_by_watch_id(list_t *states, int32_t id, uint32_t instance)
+{
+    if (states == NULL)
+        return NULL;
+
+    list_node_t *node = states->head;
+
+    while (node)
+    {
+        state_t *state = node->data;
+
+        if (state != NULL && state->watch->id == id && state->instance == instance)
+            return state;
+
+        node = node->next;
+    }
+
+    return NULL;
+}
+
+static state_t*
+find_state_by_pid(nyx_t *nyx, pid_t pid)
+{
+    if (nyx->states == NULL || nyx->pids == NULL)
+        return NULL;
+
+    return pidmap_get(nyx->pids, pid);
+}
+
+/**
+ * @brief Set the pid of the given state and keep the pid index of all
+ *        states in sync
+ * @param state state to update
+ * @param pid   new pid (0 if not running)
+ */
+void
+state_set_pid(state_t *state, pid_t pid)
+{
+    pidmap_t *pids = state->nyx->pids;
+    pid_t old_pid = state->pid;
+
+    state->pid = pid;
+
+    if (old_pid != pid)
+        snapshot_invalidate(state->nyx->snapshot);
+
+    persist_slot_t *slot = persisted(state);
+
+    if (slot && slot->pid != pid)
+    {
+        slot->pid = pid;
+        slot->start_time = pid > 0 ? process_start_time(pid) : 0;
+    }
+
+    if (old_pid != pid)
+        state_publish(state);
+
+    if (pids == NULL || old_pid == pid)
+        return;
+
+    if (old_pid > 0)
+        pidmap_remove(pids, old_pid, state);
+
+    if (pid > 0)
+        pidmap_add(pids, pid, state);
+
+    /* the kernel-side event filter (or kqueue) has to know about the new pid */
+    event_filter_update(state->nyx);
+
+    /* the polling manager tracks the new process' exit */
+    poll_track_pid(pid);
+}
+
+/**
+ * @brief Handle the exit of a process of a 'spare' watch: either its
+ *        standby process terminated or the standby takes over the exited
+ *        primary process without any state transition
+ * @param state state of the watch
+ * @param pid   pid of the exited process
+ * @return true if the exit was handled, false if the watch stopped
+ */
+static bool
+spare_exited(state_t *state, pid_t pid)
+{
+    nyx_t *nyx = state->nyx;
+    pid_t spare = 0;
+
+    pthread_mutex_lock(&state->queue.lock);
+
+    /* the standby is replaced on the next start of the watch only
+     * so a failing standby does not respawn over and over again */
+    if (pid == state->spare_pid)
+    {
+        state->spare_pid = 0;
+        spare_track(state, pid, false);
+
+        pthread_mutex_unlock(&state->queue.lock);
+
+        log_warn("Standby process %d of watch '%s' exited", pid, state->name);
+        return true;
+    }
+
+    /* a primary process that is stopped by nyx is not replaced */
+    if (pid == state->pid && state->state == STATE_RUNNING &&
+            state->spare_pid > 0 && check_process_running(state->spare_pid))
+    {
+        spare = state->spare_pid;
+        state->spare_pid = 0;
+
+        state_set_pid(state, spare);
+    }
+
+    pthread_mutex_unlock(&state->queue.lock);
+
+    if (spare < 1)
+        return false;
+
+    write_pid(spare, state->name, nyx);
+
+    if (nyx->proc)
+        nyx_proc_add(nyx->proc, spare, state->name, state->watch);
+
+    log_info("Watch '%s' promoted its standby process (PID %d)", state->name, spare);
+
+    spare_spawn(state);
+
+    return true;
+}
+
+/* the forker started a standby process of a 'spare' watch */
+static bool
+spare_spawned(state_t *state, const fork_reply_t *reply)
+{
+    pid_t pid = reply->pid;
+    bool wanted = false;
+
+    pthread_mutex_lock(&state->queue.lock);
+
+    if (reply->seq != state->spare_seq)
+    {
+        pthread_mutex_unlock(&state->queue.lock);
+        return false;
+    }
+
+    state->spare_seq = 0;
+
+    if (pid > 0 && valid_pid(pid, state->nyx) && state->spare_wanted)
+    {
+        wanted = true;
+        state->spare_pid = pid;
+        spare_track(state, pid, true);
+    }
+
+    pthread_mutex_unlock(&state->queue.lock);
+
+    if (reply->error)
+    {
+        log_error("Failed to start standby process of watch '%s': %s",
+                state->name, strerror(reply->error));
+    }
+    else if (wanted)
+    {
+        log_info("Watch '%s' started its standby process (PID %d)", state->name, pid);
+    }
+    /* the watch was stopped in the meantime */
+    else if (pid > 0 && kill(pid, SIGTERM) == -1 && errno != ESRCH)
+    {
+        log_perror("nyx: kill");
+    }
 
-static state_t*
-find_state_by_pid(list_t *states, pid_t pid)
+    return true;
+}
+
+/* an exit may be reported by multiple sources (e.g. process events and
+ * the forker reaping its children) - only the first one is processed */
+static bool
+claim_exit(state_t *state, pid_t pid)
 {
-    if (states == NULL)
-        return NULL;
+    bool claimed = false;
 
-    list_node_t *node = states->head;
+    pthread_mutex_lock(&state->queue.lock);
 
-    while (node)
+    if (state->pid == pid)
     {
-        state_t *state = node->data;
+        state_set_pid(state, 0);
+        claimed = true;
+    }
 
-        if (state != NULL && state->pid == pid)
-            return state;
+    pthread_mutex_unlock(&state->queue.lock);
 
-        node = node->next;
-    }
+    return claimed;
+}
 
-    return NULL;
+/* the exit code of process events is a wait status */
+static void
+log_exit_status(state_t *state, pid_t pid, int32_t status)
+{
+    if (WIFSIGNALED(status))
+    {
+        log_info("Watch '%s' (PID %d) was terminated by signal %d",
+                state->name, pid, WTERMSIG(status));
+    }
+    else if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+    {
+        log_info("Watch '%s' (PID %d) exited with code %d",
+                state->name, pid, WEXITSTATUS(status));
+    }
 }
 
 bool
@@ -482,42 +1328,82 @@ dispatch_event(pid_t pid, process_event_data_t *event_data, nyx_t *nyx)
             if (nyx->proc)
                 nyx_proc_remove(nyx->proc, pid);
 
-            state = find_state_by_pid(nyx->states, pid);
+            state = find_state_by_pid(nyx, pid);
 
-            if (state != NULL)
+            if (state != NULL && !spare_exited(state, pid) && claim_exit(state, pid))
             {
-                set_state(state, STATE_STOPPED);
+                log_exit_status(state, pid, event_data->data.exit.exit_code);
+                journal_exit(nyx->journal, state->name, pid,
+                        event_data->data.exit.exit_code);
 
-                state->pid = 0;
-                clear_pid(state->watch->name, nyx);
+                clear_pid(state->name, nyx);
+                set_state(state, STATE_STOPPED);
             }
             break;
         case EVENT_FORK:
+            /* new processes (no threads) are accounted to the
+             * process tree of their watched ancestor */
+            if (nyx->proc && event_data->data.fork.child_pid == event_data->data.fork.child_thread_group_id)
+            {
+                nyx_proc_fork(nyx->proc,
+                        event_data->data.fork.parent_thread_group_id,
+                        event_data->data.fork.child_thread_group_id);
+            }
+            break;
         default:
-            /* do nothing for now */
             break;
     }
 
     return true;
 }
 
+/**
+ * @brief Dispatch the exit of a reaped child process like a process event
+ * @param pid    pid of the reaped process
+ * @param status wait status of the process
+ * @param nyx    nyx instance
+ * @return true on success, false otherwise
+ */
+bool
+dispatch_exit(pid_t pid, int32_t status, nyx_t *nyx)
+{
+    process_event_data_t event_data =
+    {
+        .type = EVENT_EXIT,
+        .data.exit =
+        {
+            .pid = pid,
+            .exit_code = status,
+            .exit_signal = SIGCHLD,
+            .thread_group_id = pid
+        }
+    };
+
+    return dispatch_event(pid, &event_data, nyx);
+}
+
 bool
 dispatch_poll_result(pid_t pid, bool is_running, nyx_t *nyx)
 {
     log_debug("Incoming polling data for PID %d: running: %s",
             pid, (is_running ? "true" : "false"));
 
-    state_t *state = find_state_by_pid(nyx->states, pid);
+    state_t *state = find_state_by_pid(nyx, pid);
 
     if (state != NULL)
     {
         state_e next_state = is_running ? STATE_RUNNING : STATE_STOPPED;
 
+        if (!is_running && spare_exited(state, pid))
+            return true;
+
         if (!is_running)
         {
-            /* TODO: secure this one by semaphore as well? */
-            state->pid = 0;
-            clear_pid(state->watch->name, nyx);
+            /* the exit was reported already */
+            if (!claim_exit(state, pid))
+                return true;
+
+            clear_pid(state->name, nyx);
 
             if (nyx->proc)
                 nyx_proc_remove(nyx->proc, pid);
@@ -529,11 +1415,95 @@ dispatch_poll_result(pid_t pid, bool is_running, nyx_t *nyx)
     return true;
 }
 
+bool
+dispatch_spawn_result(const fork_reply_t *reply, nyx_t *nyx)
+{
+    state_t *state = find_state_by_watch_id(nyx->states, reply->id, reply->instance);
+
+    if (state == NULL)
+        return false;
+
+    /* the stop and reload command's process is not tracked any further */
+    if (!reply->start)
+    {
+        if (reply->error)
+        {
+            log_error("Failed to execute %s command of watch '%s': %s",
+                    reply->reload ? "reload" : "stop", state->name, strerror(reply->error));
+        }
+
+        return true;
+    }
+
+    if (reply->spare)
+        return spare_spawned(state, reply);
+
+    pid_t pid = reply->pid;
+
+    pthread_mutex_lock(&state->queue.lock);
+
+    if (reply->seq != state->spawn_seq)
+    {
+        pthread_mutex_unlock(&state->queue.lock);
+        return false;
+    }
+
+    state->spawn_replied = true;
+    state->spawn_pid = pid;
+    state->spawn_error = reply->error;
+
+    /* the pid is known right away so that an early exit event
+     * is dispatched to this state already */
+    if (pid > 0 && valid_pid(pid, nyx))
+        state_set_pid(state, pid);
+
+    pthread_cond_broadcast(&state->spawn_cond);
+
+    pthread_mutex_unlock(&state->queue.lock);
+
+    if (state->engine)
+        engine_schedule(state->engine, &state->task);
+
+    return true;
+}
+
+/**
+ * @brief Start the stopped instances of a lazily started watch whose
+ *        listening socket received its first connection
+ * @param reply activation reply of the forker
+ * @param nyx   nyx instance
+ * @return true if the watch was found; false otherwise
+ */
+bool
+dispatch_activation(const fork_reply_t *reply, nyx_t *nyx)
+{
+    bool found = false;
+
+    for (uint32_t instance = 0; ; instance++)
+    {
+        state_t *state = find_state_by_watch_id(nyx->states, reply->id, instance);
+
+        if (state == NULL)
+            break;
+
+        found = true;
+
+        if (state->state != STATE_STOPPED)
+            continue;
+
+        log_info("Starting watch '%s' on its first connection", state->name);
+
+        set_state_command(state, STATE_STARTING);
+    }
+
+    return found;
+}
+
 #ifdef OSX
 static char *
-named_semaphore_name(watch_t *watch, pid_t nyx_pid, uint32_t idx)
+named_semaphore_name(const char *name, pid_t nyx_pid, uint32_t idx)
 {
-    size_t sem_name_len = strlen(watch->name) + 16;
+    size_t sem_name_len = strlen(name) + 16;
     char *sem_name = xcalloc(sem_name_len, sizeof(char));
 
     /* generate predictable semaphore name: <watch>_<nyx-pid>_<idx>
@@ -541,19 +1511,19 @@ named_semaphore_name(watch_t *watch, pid_t nyx_pid, uint32_t idx)
      * we include nyx's pid in the semaphore name in order to
      * allow multiple nyx instances on the same machine without
      * collisions between semaphore names (e.g. local-mode) */
-    snprintf(sem_name, sem_name_len, "%s_%d_%u", watch->name, nyx_pid, idx);
+    snprintf(sem_name, sem_name_len, "%s_%d_%u", name, nyx_pid, idx);
 
     return sem_name;
 }
 
 static sem_t *
-init_named_semaphore(watch_t *watch, pid_t nyx_pid, uint32_t idx)
+init_named_semaphore(const char *name, pid_t nyx_pid, uint32_t idx)
 {
     sem_t *semaphore = NULL;
-    char *sem_name = named_semaphore_name(watch, nyx_pid, idx);
+    char *sem_name = named_semaphore_name(name, nyx_pid, idx);
 
     log_debug("Trying to create a new named semaphore (%s) for watch %s [%u]",
-            sem_name, watch->name, idx);
+            sem_name, name, idx);
 
     /* initialize a named-semaphore as OSX does not support unnamed ones
      * - chmod of the semaphore (0644)
@@ -581,7 +1551,7 @@ init_named_semaphore(watch_t *watch, pid_t nyx_pid, uint32_t idx)
     if (semaphore == SEM_FAILED)
         log_critical_perror("nyx: sem_open");
 
-    free(sem_name);
+    xfree(sem_name);
 
     return semaphore;
 }
@@ -589,59 +1559,89 @@ init_named_semaphore(watch_t *watch, pid_t nyx_pid, uint32_t idx)
 static void
 remove_named_semaphore(state_t *state, sem_t *sem, uint32_t idx)
 {
-    watch_t *watch = state->watch;
     pid_t pid = state->nyx->pid;
 
-    char *sem_name = named_semaphore_name(watch, pid, idx);
+    char *sem_name = named_semaphore_name(state->name, pid, idx);
 
     sem_close(sem);
     sem_unlink(sem_name);
 
-    free(sem_name);
+    xfree(sem_name);
 }
 #endif
 
 state_t *
-state_new(watch_t *watch, nyx_t *nyx)
+state_new(watch_t *watch, nyx_t *nyx, uint32_t instance)
 {
-    sem_t *states_semaphore = NULL, *notify_semaphore = NULL;
+    bool added = false;
+    sem_t *notify_semaphore = NULL;
     state_t *state = xcalloc1(sizeof(state_t));
 
     state->nyx = nyx;
     state->watch = watch;
+    state->instance = instance;
+    state->name = watch_instance_name(watch, instance);
+    state->labels = prometheus_labels(watch->name, state->name);
     state->state = STATE_UNMONITORED;
+    state->last_state = STATE_INIT;
+    state->engine = nyx->engine;
+    state->task.data = state;
     state->history = timestack_new(MAX(nyx->options.history_size, 20));
 
+    /* continue with the history of the previous nyx instance - the
+     * starts and stops are counted for the flapping detection */
+    state->persist_slot = nyx->persist ? persist_slot(nyx->persist, state->name) : -1;
+    state_restore(state);
+
+    state->status_slot = nyx->status ? status_slot(nyx->status, state->name) : -1;
+    state_publish(state);
+
+    timestack_set_window(state->history, FLAPPING_INTERVAL(watch), STATE_SIZE);
+
+    if (nyx->options.metrics_memory)
+        state->metrics = metrics_new(nyx->options.metrics_memory * 1024);
+
     /* initialize states queue and populate with
      * 'initial' state of UNMONITORED */
-    state->states = list_new(free);
-    list_add(state->states, state_entry_new(STATE_UNMONITORED, false));
+    pthread_mutex_init(&state->queue.lock, NULL);
+    state_queue_push(&state->queue, STATE_UNMONITORED, false, &added);
 
-#ifndef OSX
-    /* initialize unnamed semaphore
-     * - process-local semaphore
-     * - initially unlocked (= 1) */
-    states_semaphore = xcalloc1(sizeof(sem_t));
-    notify_semaphore = xcalloc1(sizeof(sem_t));
+    pthread_cond_init(&state->spawn_cond, NULL);
+    state->notify_fd = -1;
+
+    if (watch->notify)
+    {
+        char *path = get_notify_socket_path(nyx->pid_dir, state->name);
 
-    int32_t init = sem_init(states_semaphore, 0, 1);
+        state->notify_fd = notify_socket_open(path);
 
-    if (init == -1)
-        log_critical_perror("nyx: sem_init");
+        if (state->notify_fd < 0)
+            log_warn("Failed to open notify socket of watch '%s'", state->name);
 
-    init = sem_init(notify_semaphore, 0, 1);
+        nyx_free(path, MEM_OTHER);
+    }
+
+    /* the notify semaphore is needed by the per-state thread only */
+    if (state->engine == NULL)
+    {
+#ifndef OSX
+        /* initialize unnamed semaphore
+         * - process-local semaphore
+         * - initially unlocked (= 1) */
+        notify_semaphore = xcalloc1(sizeof(sem_t));
 
-    if (init == -1)
-        log_critical_perror("nyx: sem_init");
+        int32_t init = sem_init(notify_semaphore, 0, 1);
+
+        if (init == -1)
+            log_critical_perror("nyx: sem_init");
 #else
-    /* on OSX we have to create named semaphores
-     * that's why we create two semaphores with the
-     * names: '<watch-name>_<nyx-pid>_1' and '<watch-name>_<nyx-pid>_2' */
-    states_semaphore = init_named_semaphore(watch, nyx->pid, 1);
-    notify_semaphore = init_named_semaphore(watch, nyx->pid, 2);
+        /* on OSX we have to create a named semaphore
+         * that's why we create a semaphore with the
+         * name: '<watch-name>_<nyx-pid>_2' */
+        notify_semaphore = init_named_semaphore(state->name, nyx->pid, 2);
 #endif
+    }
 
-    state->states_sem = states_semaphore;
     state->notify_sem = notify_semaphore;
 
     return state;
@@ -650,10 +1650,25 @@ state_new(watch_t *watch, nyx_t *nyx)
 void
 state_destroy(state_t *state)
 {
+    if (state->engine != NULL)
+    {
+        uint32_t timeout = MAX(NYX_STATE_JOIN_TIMEOUT, state->watch->stop_timeout);
+
+        log_debug("Waiting for state of watch '%s' to terminate", state->name);
+
+        /* we must not free a state that is still processed by the engine */
+        if (!engine_detach(state->engine, &state->task, timeout))
+        {
+            log_error("State of watch '%s' failed to terminate "
+                      "after waiting %ds", state->name, timeout);
+            return;
+        }
+    }
+
     if (state->thread != NULL)
     {
         int32_t join = 0, join_timeout = MAX(NYX_STATE_JOIN_TIMEOUT, state->watch->stop_timeout);
-        const char *name = state->watch->name;
+        const char *name = state->name;
 
 #ifndef OSX
         time_t now = time(NULL);
@@ -684,10 +1699,10 @@ state_destroy(state_t *state)
             }
 
             log_error("Joining of state thread of watch '%s' failed: %d",
-                    state->watch->name, join);
+                    state->name, join);
         }
 
-        free(state->thread);
+        nyx_free(state->thread, MEM_OTHER);
     }
 
     /* notify semaphore */
@@ -695,39 +1710,55 @@ state_destroy(state_t *state)
     {
 #ifndef OSX
         sem_destroy(state->notify_sem);
-        free(state->notify_sem);
+        xfree(state->notify_sem);
 #else
         remove_named_semaphore(state, state->notify_sem, 2);
 #endif
     }
 
-    /* states semaphore */
-    if (state->states_sem != NULL)
-    {
-#ifndef OSX
-        sem_destroy(state->states_sem);
-        free(state->states_sem);
-#else
-        remove_named_semaphore(state, state->states_sem, 1);
-#endif
-    }
-
     if (state->history)
     {
         timestack_destroy(state->history);
         state->history = NULL;
     }
 
-    list_destroy(state->states);
+    metrics_destroy(state->metrics);
+    state->metrics = NULL;
+
+    if (state->notify_fd >= 0)
+    {
+        char *path = get_notify_socket_path(state->nyx->pid_dir, state->name);
+
+        close(state->notify_fd);
+        unlink(path);
+
+        nyx_free(path, MEM_OTHER);
+    }
+
+    if (state->nyx->pids && state->pid > 0)
+        pidmap_remove(state->nyx->pids, state->pid, state);
+
+    spare_stop(state);
+
+    if (state->nyx->startup)
+        startup_stopped(state->nyx->startup, state->watch->name, state);
+
+    if (state->nyx->limiter)
+        limiter_release(state->nyx->limiter, &state->ticket);
 
-    free(state);
+    pthread_cond_destroy(&state->spawn_cond);
+    pthread_mutex_destroy(&state->queue.lock);
+
+    nyx_free((void *)state->name, MEM_CONFIG);
+    nyx_free(state->labels, MEM_CONNECTOR);
+    xfree(state);
 }
 
 static bool
 process_state(state_t *state, state_e old_state, state_e new_state)
 {
     log_debug("Watch '%s' (PID %d): %s -> %s",
-            state->watch->name,
+            state->name,
             state->pid,
             state_to_string(old_state),
             state_to_string(new_state));
@@ -745,18 +1776,25 @@ process_state(state_t *state, state_e old_state, state_e new_state)
         return false;
     }
 
+    uint64_t started = NYX_TRACE_TIME();
+
+    NYX_TRACE4(state__transition, state->name, state->pid, old_state, new_state);
+
     bool result = func(state, old_state, new_state);
 
+    NYX_TRACE5(state__transition__done, state->name, state->pid, new_state, result,
+            NYX_TRACE_TIME() - started);
+
     if (!result)
     {
         log_warn("Processing state of watch '%s' failed (PID %d)",
-                state->watch->name, state->pid);
+                state->name, state->pid);
     }
 #ifdef USE_PLUGINS
     else
     {
         notify_state_change(state->nyx->plugins,
-                state->watch->name, state->pid, new_state);
+                state->name, state->pid, new_state);
     }
 #endif
 
@@ -764,78 +1802,159 @@ process_state(state_t *state, state_e old_state, state_e new_state)
 }
 
 static bool
-is_flapping(state_t *state, uint32_t changes, int32_t within)
+is_flapping(state_t *state, uint32_t changes)
 {
-    uint32_t i = 0, is_stopped = 0, started = 0;
     timestack_t *hist = state->history;
-    timestack_elem_t *elem = hist->elements;
 
     if (hist->count < (changes * 2))
         return false;
 
-    time_t now_time = time(NULL);
+    /* we are interested in 'starting' and 'stopped' events
+     * of the last 'flapping_interval' seconds only */
+    uint32_t started = timestack_count_within(hist, STATE_STARTING);
+    uint32_t is_stopped = timestack_count_within(hist, STATE_STOPPED);
 
-    while (i++ < hist->count)
-    {
-        state_e value = elem->value;
-
-        /* we are interested in counting 'starting' and 'stopped'
-         * events only */
-        if (value != STATE_STARTING && value != STATE_STOPPED)
-        {
-            elem++;
-            continue;
-        }
+    return started > changes && is_stopped > changes;
+}
 
-        time_t seconds_ago = now_time - elem->time;
+/**
+ * Wait for the given delay to elapse - the delay is interrupted as soon
+ * as a user-command (i.e. STARTING, STOPPING, RESTARTING or QUIT) is queued
+ */
+static void
+delay_state(state_t *state, uint32_t seconds)
+{
+#ifndef OSX
+    uint32_t consumed = 0;
+    struct timespec deadline;
 
-        /* we are interested in events that happened in the
-         * last 'within' seconds only */
-        if (seconds_ago > within)
-            return false;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += seconds;
 
-        if (value == STATE_STARTING)
-            started++;
-        else if (value == STATE_STOPPED)
-            is_stopped++;
+    /* every queued state posts the semaphore so we wake up on
+     * incoming commands right away instead of polling for them */
+    while (state->state != STATE_QUIT && !has_pending_command(state))
+    {
+        if (sem_timedwait(state->notify_sem, &deadline) == 0)
+            consumed++;
+        else if (errno != EINTR)
+            break;
+    }
 
-        if (started > changes && is_stopped > changes)
-            return true;
+    /* the consumed notifications belong to the queued states */
+    while (consumed-- > 0)
+        sem_post(state->notify_sem);
+#else
+    /* there is no sem_timedwait on OSX */
+    while (seconds-- > 0 && state->state != STATE_QUIT)
+    {
+        if (has_pending_command(state))
+            break;
 
-        elem++;
+        sleep(1);
     }
-
-    return false;
+#endif
 }
 
+/**
+ * Process the given state that was popped from the states queue.
+ * Returns false if the state is about to terminate.
+ */
 static bool
-is_command(void *data)
+state_process_entry(state_t *state, state_e current_state)
 {
-    state_entry_t *entry = data;
+    state_e last_state = state->last_state;
 
-    return entry->is_command;
-}
+    /* QUIT is handled immediately */
+    if (current_state == STATE_QUIT)
+    {
+        log_info("Watch '%s' terminating", state->name);
+        return false;
+    }
 
-static void
-safe_sleep(state_t *state, uint32_t seconds)
-{
-    while (seconds-- > 0 && state->state != STATE_QUIT)
+    bool result = process_state(state, last_state, current_state);
+
+    if (result)
     {
-        /* the 'sleep' may be interrupted by a user-command
-         * i.e. STARTING, STOPPING, RESTARTING or QUIT */
+        if (last_state != current_state)
+        {
+            timestack_add(state->history, current_state);
 
-        if (sem_wait(state->states_sem) != 0)
-            break;
+            /* restarts do not pass the 'STARTING' state */
+            if (current_state == STATE_RUNNING)
+                state->starts++;
 
-        void *command_found = list_find(state->states, is_command);
+            snapshot_invalidate(state->nyx->snapshot);
 
-        sem_post(state->states_sem);
+            if (state->nyx->subscribers)
+            {
+                subscribers_publish(state->nyx->subscribers, state->name,
+                        state->watch->name, last_state, current_state, state->pid);
+            }
 
-        if (command_found)
-            break;
+            if (state->nyx->federation)
+            {
+                federation_publish(state->nyx->federation, state->name,
+                        current_state, state->pid);
+            }
 
-        sleep(1);
+            if (state->nyx->bulk)
+                bulk_notify(state->nyx->bulk, state->name, current_state);
+
+            journal_state(state->nyx->journal, state->name,
+                    last_state, current_state, state->pid);
+
+#ifndef NDEBUG
+            timestack_dump(state->history, state_idx_to_string);
+#endif
+        }
+
+        /* the state might have been set to 'QUIT' during our
+         * process_state step - let's quit now instead of waiting
+         * one more iteration */
+        if (state->state == STATE_QUIT)
+        {
+            log_info("Watch '%s' terminating", state->name);
+            return false;
+        }
+
+        /* the state transition succeeded ->
+         * set updated state now */
+        state->state = current_state;
+    }
+
+    /* check for flapping processes
+     * meaning 5 start/stop events within 60 seconds by default */
+    if (current_state == STATE_STOPPED &&
+            is_flapping(state, FLAPPING_COUNT(state->watch)))
+    {
+        /* increase the delayed time from 5 seconds to 10 minutes at max
+         * (by default) */
+        double to_delay_max = FLAPPING_DELAY(state->watch) * pow(2.0, state->failed_counter);
+        uint32_t to_delay = MIN(to_delay_max, MAX_FLAPPING_DELAY(state->watch));
+
+        state->failed_counter = MIN(state->failed_counter + 1, 10);
+
+        log_warn("Watch '%s' appears to be flapping - delay for %u seconds. "
+                 "Probably the start command is not executable or does "
+                 "not exist at all.",
+                 state->name, to_delay);
+
+        /* the state engine delays as soon as a
+         * possibly pending continuation is finished */
+        if (state->engine)
+            state->wait_delay = to_delay;
+        else
+            delay_state(state, to_delay);
     }
+
+    if (result)
+        state->last_state = current_state;
+
+    state_persist(state);
+    state_publish(state);
+
+    return true;
 }
 
 void
@@ -843,108 +1962,157 @@ state_loop(state_t *state)
 {
     int32_t sem_fail = 0;
 
-    watch_t *watch = state->watch;
-    state_e last_state = STATE_INIT;
-
-    log_debug("Starting state loop for watch '%s'", watch->name);
+    log_debug("Starting state loop for watch '%s'", state->name);
 
     /* wait until the event manager triggers this
      * state semaphore */
     while ((sem_fail = sem_wait(state->notify_sem)) == 0)
     {
-        state_e current_state;
+        state_entry_t state_entry;
 
         /* QUIT is handled immediately */
         if (state->state == STATE_QUIT)
         {
-            log_info("Watch '%s' terminating", watch->name);
+            log_info("Watch '%s' terminating", state->name);
             break;
         }
 
-        /* acquire states semaphore */
-        if ((sem_fail = sem_wait(state->states_sem) != 0))
-            break;
-
         /* check if there is a new state in the queue at all */
-        state_entry_t *state_entry = NULL;
-        bool state_exists = list_pop(state->states, (void *)&state_entry);
-
-        /* release states semaphore immediately after popping the
-         * first element (if set) */
-        sem_post(state->states_sem);
-
-        /* no new state found -> continue */
-        if (!state_exists || state_entry == NULL)
+        if (!state_queue_pop(&state->queue, &state_entry))
             continue;
 
-        /* free popped state entry as early as possible */
-        current_state = state_entry->value;
-        free(state_entry);
-        state_entry = NULL;
-
-        /* QUIT is handled immediately */
-        if (current_state == STATE_QUIT)
-        {
-            log_info("Watch '%s' terminating", watch->name);
+        if (!state_process_entry(state, state_entry.value))
             break;
-        }
 
-        bool result = process_state(state, last_state, current_state);
+        log_debug("Waiting on next state update for watch '%s'", state->name);
+    }
+
+    if (sem_fail)
+        log_perror("nyx: sem_wait");
+}
+
+/**
+ * Try to finish the pending continuation of the given state.
+ * Returns false if the state has to wait any longer.
+ */
+static bool
+state_wait_finished(state_t *state)
+{
+    engine_task_t *task = &state->task;
 
-        if (result)
+    switch (state->wait)
+    {
+        case STATE_WAIT_ADMIT:
         {
-            if (last_state != current_state)
-            {
-                timestack_add(state->history, current_state);
+            uint32_t wait = limiter_poll(state->nyx->limiter, &state->ticket);
 
-#ifndef NDEBUG
-                timestack_dump(state->history, state_idx_to_string);
-#endif
+            /* the queued restart is withdrawn on user-commands
+             * i.e. STOPPING or QUIT */
+            if (wait > 0 && has_pending_command(state))
+            {
+                start_withdraw(state);
+                break;
             }
 
-            /* the state might have been set to 'QUIT' during our
-             * process_state step - let's quit now instead of waiting
-             * one more iteration */
-            if (state->state == STATE_QUIT)
+            if (wait > 0)
             {
-                log_info("Watch '%s' terminating", watch->name);
-                break;
+                engine_task_delay(task, wait);
+                return false;
             }
 
-            /* the state transition succeeded ->
-             * set updated state now */
-            state->state = current_state;
+            state->wait = STATE_WAIT_NONE;
+            start_spawn(state);
+
+            /* the start continues as a regular continuation */
+            return state_wait_finished(state);
         }
 
-        /* check for flapping processes
-         * meaning 5 start/stop events within 60 seconds
-         * TODO: configurable */
-        if (current_state == STATE_STOPPED &&
-                is_flapping(state, NYX_FLAPPING_COUNT, NYX_FLAPPING_INTERVAL))
+        case STATE_WAIT_START:
+            if (state->nyx->forker_reply_thread == NULL)
+            {
+                if (!engine_task_expired(task))
+                    return false;
+            }
+            else if (!start_ready(state) && !engine_task_expired(task))
+            {
+                /* get scheduled as soon as the process
+                 * sends its readiness notification */
+                if (state->spawn_replied && state->notify_fd >= 0)
+                    engine_watch_fd(state->engine, task, state->notify_fd);
+                return false;
+            }
+
+            engine_unwatch(state->engine, task);
+            start_finished(state);
+            break;
+
+        case STATE_WAIT_STOP:
         {
-            /* increase the delayed time from 5 seconds to 10 minutes at max */
-            uint32_t to_delay_max = 5.0 * pow(2.0, state->failed_counter);
-            uint32_t to_delay = MIN(to_delay_max, NYX_MAX_FLAPPING_DELAY);
+            bool exited = engine_task_signaled(state->engine, task);
 
-            state->failed_counter = MIN(state->failed_counter + 1, 10);
+            if (!exited && !engine_task_expired(task))
+                return false;
 
-            log_warn("Watch '%s' appears to be flapping - delay for %u seconds. "
-                     "Probably the start command is not executable or does "
-                     "not exist at all.",
-                     watch->name, to_delay);
+            if (!stop_finished(state, exited))
+            {
+                engine_task_delay(task, 1000);
+                return false;
+            }
 
-            /* TODO: use select instead */
-            safe_sleep(state, to_delay);
+            engine_unwatch(state->engine, task);
+            break;
         }
 
-        if (result)
-            last_state = current_state;
+        case STATE_WAIT_DELAY:
+            /* the delay may be interrupted by a user-command
+             * i.e. STARTING, STOPPING, RESTARTING or QUIT */
+            if (!engine_task_expired(task) && !has_pending_command(state))
+                return false;
+            break;
 
-        log_debug("Waiting on next state update for watch '%s'", watch->name);
+        case STATE_WAIT_NONE:
+        default:
+            break;
     }
 
-    if (sem_fail)
-        log_perror("nyx: sem_wait");
+    state->wait = STATE_WAIT_NONE;
+
+    /* a flapping delay is started after the preceding
+     * continuation is finished */
+    if (state->wait_delay > 0)
+    {
+        state->wait = STATE_WAIT_DELAY;
+        engine_task_delay(task, state->wait_delay * 1000);
+        state->wait_delay = 0;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Single step of the state engine: either continue a pending
+ * transition or process the next queued state
+ */
+engine_step_e
+state_step(engine_task_t *task)
+{
+    state_t *state = task->data;
+    state_entry_t state_entry;
+
+    if (!state_wait_finished(state))
+        return ENGINE_WAIT;
+
+    if (!state_queue_pop(&state->queue, &state_entry))
+        return ENGINE_IDLE;
+
+    if (!state_process_entry(state, state_entry.value))
+        return ENGINE_DONE;
+
+    if (!state_wait_finished(state))
+        return ENGINE_WAIT;
+
+    return ENGINE_AGAIN;
 }
 
 void *
@@ -16,14 +16,17 @@
 #pragma once
 
 #include "event.h"
-#include "list.h"
+#include "forker.h"
+#include "metrics.h"
 #include "nyx.h"
 #include "timestack.h"
 #include "watch.h"
 
+#include <pthread.h>
 #include <semaphore.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <time.h>
 
 typedef enum
 {
@@ -38,25 +41,100 @@ typedef enum
     STATE_SIZE
 } state_e;
 
+typedef enum
+{
+    STATE_WAIT_NONE,
+    STATE_WAIT_ADMIT,
+    STATE_WAIT_START,
+    STATE_WAIT_STOP,
+    STATE_WAIT_DELAY
+} state_wait_e;
+
+#define NYX_STATE_QUEUE_SIZE 32
+
+typedef struct
+{
+    state_e value;
+    bool is_command;
+    /** monotonic time (in usec) the state was requested */
+    uint64_t requested;
+} state_entry_t;
+
+/* bounded ring of requested states */
+typedef struct
+{
+    uint32_t head;
+    uint32_t count;
+    uint32_t commands;
+    pthread_mutex_t lock;
+    state_entry_t entries[NYX_STATE_QUEUE_SIZE];
+} state_queue_t;
+
 typedef struct
 {
     pid_t pid;
     state_e state;
-    list_t *states;
+    state_e last_state;
+    state_queue_t queue;
     uint32_t failed_counter;
-    sem_t *states_sem;
+    /** number of successful starts (including the first one) */
+    uint32_t starts;
     sem_t *notify_sem;
     pthread_t *thread;
     watch_t *watch;
+    /** name of the watch's instance (the watch name for the first one) */
+    const char *name;
+    uint32_t instance;
+    /** labels of the exported metrics */
+    char *labels;
     timestack_t *history;
+    /** compressed CPU and memory time series (NULL if disabled) */
+    metrics_t *metrics;
+    /** slot in the persisted state table (-1 if none) */
+    int32_t persist_slot;
+    /** record in the published status table (-1 if none) */
+    int32_t status_slot;
+    /** restart an adopted process (its watch was changed on reload) */
+    bool restart_pending;
+    /** time of the latest in-place reload of the process (0 if none) */
+    time_t reload_time;
     nyx_t *nyx;
+
+    /* continuation of a pending transition */
+    state_wait_e wait;
+    pid_t wait_pid;
+    uint32_t wait_ticks;
+    uint32_t wait_delay;
+    /** monotonic time (in usec) the pending start/stop began */
+    uint64_t start_time;
+    uint64_t stop_time;
+    engine_t *engine;
+    engine_task_t task;
+
+    /* reply of the forker and readiness of a start request
+     * (guarded by the queue lock) */
+    pthread_cond_t spawn_cond;
+    uint32_t spawn_seq;
+    bool spawn_replied;
+    pid_t spawn_pid;
+    int32_t spawn_error;
+    bool ready;
+    int32_t notify_fd;
+
+    /** admission of a restart by the host-wide restart limiter */
+    limiter_ticket_t ticket;
+
+    /* standby process of a 'spare' watch (guarded by the queue lock) */
+    bool spare_wanted;
+    uint32_t spare_seq;
+    pid_t spare_pid;
 } state_t;
 
 const char *
 state_to_human_string(state_e state);
 
 state_t *
-state_new(watch_t *watch, nyx_t *nyx);
+state_new(watch_t *watch, nyx_t *nyx, uint32_t instance);
 
 void
 state_destroy(state_t *state);
@@ -67,16 +145,34 @@ state_loop(state_t *state);
 void *
 state_loop_start(void *state);
 
+engine_step_e
+state_step(engine_task_t *task);
+
 bool
 set_state(state_t *state, state_e value);
 
 bool
 set_state_command(state_t *state, state_e value);
 
+bool
+state_reload(state_t *state);
+
 bool
 dispatch_event(pid_t pid, process_event_data_t *event_data, nyx_t *nyx);
 
+bool
+dispatch_exit(pid_t pid, int32_t status, nyx_t *nyx);
+
 bool
 dispatch_poll_result(pid_t pid, bool is_running, nyx_t *nyx);
 
+bool
+dispatch_spawn_result(const fork_reply_t *reply, nyx_t *nyx);
+
+bool
+dispatch_activation(const fork_reply_t *reply, nyx_t *nyx);
+
+void
+state_set_pid(state_t *state, pid_t pid);
+
 /* vim: set et sw=4 sts=4 tw=80: */
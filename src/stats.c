@@ -0,0 +1,278 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "def.h"
+#include "stats.h"
+
+#include <string.h>
+#include <time.h>
+
+/**
+ * Every recording thread is assigned one of the shards on its first
+ * record so the threads do not contend on the same counters. The values
+ * are updated with relaxed atomics only - threads sharing a shard stay
+ * correct and readers sum up all shards without blocking anyone.
+ */
+typedef struct
+{
+    stats_histogram_t histograms[STATS_HISTOGRAMS];
+    uint64_t counters[STATS_COUNTERS];
+} __attribute__((aligned(64))) stats_shard_t;
+
+static stats_shard_t shards[STATS_SHARDS];
+
+static uint64_t started;
+
+static uint32_t next_shard;
+
+static __thread stats_shard_t *shard;
+
+static const stats_info_t histogram_infos[] =
+{
+    { "start", "nyx_start_duration_seconds",
+        "Duration of starting a watch until it is running" },
+    { "stop", "nyx_stop_duration_seconds",
+        "Duration of stopping a watch until its process exited" },
+    { "queue_wait", "nyx_state_queue_wait_seconds",
+        "Time a requested state waited in the queue of its watch" },
+    { "proc_sweep", "nyx_proc_sweep_duration_seconds",
+        "Duration of one sampling tick of the watched processes" },
+    { "port_check", "nyx_port_check_duration_seconds",
+        "Duration of the port checks" },
+    { "http_check", "nyx_http_check_duration_seconds",
+        "Duration of the HTTP checks" },
+    { "plugin_check", "nyx_plugin_check_duration_seconds",
+        "Duration of the plugin checks" },
+    { "exec_check", "nyx_exec_check_duration_seconds",
+        "Duration of the check commands" },
+    { "request", "nyx_request_duration_seconds",
+        "Duration of the connector requests" },
+    { "plugin_callback", "nyx_plugin_callback_seconds",
+        "Time from a state change until its plugin callback returned" },
+};
+
+static const stats_info_t counter_infos[] =
+{
+    { "proc_events", "nyx_process_events_total",
+        "Process events received from the kernel" },
+    { "proc_events_lost", "nyx_process_events_lost_total",
+        "Overflows of the process events socket (events got lost)" },
+    { "plugin_dropped", "nyx_plugin_events_dropped_total",
+        "State changes or metrics batches dropped by a full plugin queue" },
+    { "tls_handshakes", "nyx_tls_handshakes_total",
+        "Full TLS handshakes of the HTTPS checks" },
+    { "tls_resumed", "nyx_tls_resumed_total",
+        "TLS handshakes of the HTTPS checks that resumed a session" },
+};
+
+/**
+ * @brief Get the monotonic time in microseconds
+ */
+uint64_t
+stats_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+/**
+ * @brief Reset all statistics - values that are recorded concurrently
+ *        may get lost
+ */
+void
+stats_reset(void)
+{
+    memset(shards, 0, sizeof(shards));
+
+    __atomic_store_n(&started, stats_now(), __ATOMIC_RELAXED);
+}
+
+static stats_shard_t *
+thread_shard(void)
+{
+    if (shard == NULL)
+    {
+        uint32_t idx = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED);
+        shard = &shards[idx % STATS_SHARDS];
+    }
+
+    return shard;
+}
+
+/**
+ * @brief Get the bucket of the given value
+ */
+uint32_t
+stats_bucket(uint64_t value)
+{
+    if (value < STATS_SUB_BUCKETS)
+        return value;
+
+    uint32_t exponent = 63 - __builtin_clzll(value);
+
+    if (exponent > STATS_MAX_EXPONENT)
+        return STATS_BUCKETS - 1;
+
+    uint32_t sub = (value >> (exponent - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1);
+
+    return ((exponent - STATS_SUB_BITS + 1) << STATS_SUB_BITS) | sub;
+}
+
+/**
+ * @brief Get the highest value that is counted in the given bucket
+ */
+uint64_t
+stats_bucket_value(uint32_t bucket)
+{
+    if (bucket < STATS_SUB_BUCKETS)
+        return bucket;
+
+    uint32_t exponent = (bucket >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+    uint64_t sub = bucket & (STATS_SUB_BUCKETS - 1);
+    uint32_t shift = exponent - STATS_SUB_BITS;
+
+    return ((STATS_SUB_BUCKETS + sub) << shift) + (1ULL << shift) - 1;
+}
+
+/**
+ * @brief Record a duration
+ * @param histogram histogram to record into
+ * @param usecs     duration in microseconds
+ */
+void
+stats_record(stats_histogram_e histogram, uint64_t usecs)
+{
+    stats_histogram_t *h = &thread_shard()->histograms[histogram];
+    uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&h->buckets[stats_bucket(usecs)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sum, usecs, __ATOMIC_RELAXED);
+
+    while (usecs > max &&
+            !__atomic_compare_exchange_n(&h->max, &max, usecs, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/**
+ * @brief Record the duration since the given time (of stats_now)
+ */
+void
+stats_record_since(stats_histogram_e histogram, uint64_t since)
+{
+    uint64_t now = stats_now();
+
+    stats_record(histogram, now > since ? now - since : 0);
+}
+
+void
+stats_count(stats_counter_e counter, uint64_t value)
+{
+    __atomic_add_fetch(&thread_shard()->counters[counter], value, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Sum up the statistics of all shards
+ * @param snapshot snapshot to fill
+ */
+void
+stats_read(stats_snapshot_t *snapshot)
+{
+    memset(snapshot, 0, sizeof(stats_snapshot_t));
+
+    for (uint32_t i = 0; i < STATS_SHARDS; i++)
+    {
+        stats_shard_t *s = &shards[i];
+
+        for (uint32_t j = 0; j < STATS_HISTOGRAMS; j++)
+        {
+            stats_histogram_t *from = &s->histograms[j];
+            stats_histogram_t *to = &snapshot->histograms[j];
+
+            to->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+            to->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+            uint64_t max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+
+            to->max = MAX(to->max, max);
+
+            for (uint32_t k = 0; k < STATS_BUCKETS; k++)
+                to->buckets[k] += __atomic_load_n(&from->buckets[k], __ATOMIC_RELAXED);
+        }
+
+        for (uint32_t j = 0; j < STATS_COUNTERS; j++)
+            snapshot->counters[j] += __atomic_load_n(&s->counters[j], __ATOMIC_RELAXED);
+    }
+
+    uint64_t since = __atomic_load_n(&started, __ATOMIC_RELAXED);
+    uint64_t now = stats_now();
+
+    snapshot->elapsed = since && now > since ? now - since : 0;
+}
+
+/**
+ * @brief Get the value below which the given percentage of the
+ *        recorded values are
+ * @param histogram  histogram (of a snapshot)
+ * @param percentile percentile between 0 and 100
+ * @return value in microseconds (0 if nothing was recorded)
+ */
+uint64_t
+stats_percentile(const stats_histogram_t *histogram, double percentile)
+{
+    /* the buckets are read one by one so their sum may
+     * differ slightly from the count */
+    uint64_t total = 0;
+
+    for (uint32_t i = 0; i < STATS_BUCKETS; i++)
+        total += histogram->buckets[i];
+
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    uint64_t seen = 0;
+
+    rank = MAX(rank, 1);
+
+    for (uint32_t i = 0; i < STATS_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+
+        if (seen >= rank)
+            return MIN(stats_bucket_value(i), histogram->max);
+    }
+
+    return histogram->max;
+}
+
+const stats_info_t *
+stats_histogram_info(stats_histogram_e histogram)
+{
+    return &histogram_infos[histogram];
+}
+
+const stats_info_t *
+stats_counter_info(stats_counter_e counter)
+{
+    return &counter_infos[counter];
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,132 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * The histograms are HDR-style: values below STATS_SUB_BUCKETS are counted
+ * exactly, larger ones in STATS_SUB_BUCKETS buckets per power of two which
+ * bounds the relative error to 1/STATS_SUB_BUCKETS. All values are in
+ * microseconds, values beyond 2^STATS_MAX_EXPONENT (about 9.5 hours) are
+ * counted in the last bucket.
+ */
+#define STATS_SUB_BITS 3
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_MAX_EXPONENT 35
+#define STATS_BUCKETS ((STATS_MAX_EXPONENT - STATS_SUB_BITS + 2) * STATS_SUB_BUCKETS)
+
+/* number of shards the recording threads are spread over */
+#define STATS_SHARDS 16
+
+typedef enum
+{
+    /** start request until the process is running (or failed) */
+    STATS_START,
+    /** SIGTERM (or stop command) until the process exited */
+    STATS_STOP,
+    /** requested state waiting in the queue of its watch */
+    STATS_QUEUE_WAIT,
+    /** one sampling/check tick of the proc system */
+    STATS_PROC_SWEEP,
+    STATS_PORT_CHECK,
+    STATS_HTTP_CHECK,
+    STATS_PLUGIN_CHECK,
+    STATS_EXEC_CHECK,
+    /** connector request including sending its response */
+    STATS_REQUEST,
+    /** state change queued until its plugin callback returned */
+    STATS_PLUGIN_CALLBACK,
+    STATS_HISTOGRAMS
+} stats_histogram_e;
+
+typedef enum
+{
+    /** process events received via netlink */
+    STATS_PROC_EVENTS,
+    /** overflows of the netlink receive buffer (events got lost) */
+    STATS_PROC_EVENTS_LOST,
+    /** state changes dropped or coalesced by a full plugin queue and
+     *  metrics batches replaced before their delivery */
+    STATS_PLUGIN_DROPPED,
+    /** full TLS handshakes of the HTTPS checks */
+    STATS_TLS_HANDSHAKES,
+    /** TLS handshakes of the HTTPS checks that resumed a session */
+    STATS_TLS_RESUMED,
+    STATS_COUNTERS
+} stats_counter_e;
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[STATS_BUCKETS];
+} stats_histogram_t;
+
+/** summed up values of all shards */
+typedef struct
+{
+    stats_histogram_t histograms[STATS_HISTOGRAMS];
+    uint64_t counters[STATS_COUNTERS];
+    /** microseconds since the statistics were reset */
+    uint64_t elapsed;
+} stats_snapshot_t;
+
+typedef struct
+{
+    const char *name;
+    /** name of the Prometheus metric family */
+    const char *metric;
+    const char *help;
+} stats_info_t;
+
+uint64_t
+stats_now(void);
+
+void
+stats_reset(void);
+
+void
+stats_record(stats_histogram_e histogram, uint64_t usecs);
+
+void
+stats_record_since(stats_histogram_e histogram, uint64_t since);
+
+void
+stats_count(stats_counter_e counter, uint64_t value);
+
+void
+stats_read(stats_snapshot_t *snapshot);
+
+uint64_t
+stats_percentile(const stats_histogram_t *histogram, double percentile);
+
+uint32_t
+stats_bucket(uint64_t value);
+
+uint64_t
+stats_bucket_value(uint32_t bucket);
+
+const stats_info_t *
+stats_histogram_info(stats_histogram_e histogram);
+
+const stats_info_t *
+stats_counter_info(stats_counter_e counter);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,381 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_STATE
+
+#include "def.h"
+#include "log.h"
+#include "status.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const slotmap_layout_t layout =
+{
+    .description = "status",
+    .header_size = sizeof(nyx_status_header_t),
+    .count_offset = offsetof(nyx_status_header_t, records),
+    .slot_size = sizeof(nyx_status_record_t),
+    .name_offset = offsetof(nyx_status_record_t, name),
+    .name_size = NYX_STATUS_NAME_SIZE,
+    .max_slots = STATUS_MAX_RECORDS
+};
+
+static void update_record(void *slot, int32_t idx, const char *name, void *data);
+
+static char *
+status_path(const char *pid_dir)
+{
+    char *path = xcalloc(512, sizeof(char));
+
+    snprintf(path, 511, "%s/" NYX_STATUS_FILE, pid_dir);
+
+    return path;
+}
+
+/**
+ * @brief Create the status table in the given pid directory
+ * @param pid_dir pid directory of the nyx instance
+ * @return status instance or NULL on failure
+ */
+status_t *
+status_open(const char *pid_dir)
+{
+    status_t *status = xcalloc1(sizeof(status_t));
+
+    status->fd = -1;
+
+    for (uint32_t i = 0; i < STATUS_LOCKS; i++)
+        pthread_mutex_init(&status->locks[i], NULL);
+
+    status->path = status_path(pid_dir);
+
+    /* the table of a previous instance is replaced by a new file so
+     * readers still mapping the old one are not affected */
+    if (unlink(status->path) != 0 && errno != ENOENT)
+    {
+        log_perror("nyx: unlink");
+        goto error;
+    }
+
+    status->fd = open(status->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (status->fd < 0)
+    {
+        log_perror("nyx: open");
+        goto error;
+    }
+
+    if (ftruncate(status->fd, slotmap_size(&layout, 0)) != 0)
+    {
+        log_perror("nyx: ftruncate");
+        goto error;
+    }
+
+    if (!slotmap_map(&status->map, &layout, status->fd))
+        goto error;
+
+    /* records are updated under the writers' locks */
+    status->map.update = update_record;
+    status->map.data = status;
+
+    status->header = status->map.header;
+    status->records = (nyx_status_record_t *)status->map.slots;
+
+    status->header->version = NYX_STATUS_VERSION;
+    status->header->record_size = sizeof(nyx_status_record_t);
+    status->header->records = 0;
+    status->header->pid = getpid();
+    status->header->started = time(NULL);
+
+    /* readers check the magic last */
+    __atomic_store_n(&status->header->magic, NYX_STATUS_MAGIC, __ATOMIC_RELEASE);
+
+    return status;
+
+error:
+    status_close(status);
+    return NULL;
+}
+
+static pthread_mutex_t *
+record_lock(status_t *status, int32_t slot)
+{
+    return &status->locks[slot % STATUS_LOCKS];
+}
+
+/* the record is locked for the update as readers are concerned
+ * (has to be called with the record's lock being held) */
+static void
+record_begin(nyx_status_record_t *record)
+{
+    __atomic_store_n(&record->sequence, record->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void
+record_end(nyx_status_record_t *record)
+{
+    __atomic_store_n(&record->sequence, record->sequence + 1, __ATOMIC_RELEASE);
+}
+
+static nyx_status_record_t *
+record_get(status_t *status, int32_t slot)
+{
+    if (status == NULL)
+        return NULL;
+
+    return slotmap_get(&status->map, slot);
+}
+
+/* assign the record to the given name or release it (name is NULL) */
+static void
+update_record(void *slot, int32_t idx, const char *name, void *data)
+{
+    nyx_status_record_t *record = slot;
+    pthread_mutex_t *lock = record_lock(data, idx);
+
+    pthread_mutex_lock(lock);
+    record_begin(record);
+
+    if (name)
+        strncpy(record->name, name, NYX_STATUS_NAME_SIZE - 1);
+    else
+        memset((char *)record + sizeof(record->sequence), 0,
+                sizeof(nyx_status_record_t) - sizeof(record->sequence));
+
+    record_end(record);
+    pthread_mutex_unlock(lock);
+}
+
+/* see slotmap_prepare */
+bool
+status_prepare(status_t *status, hash_t *watches)
+{
+    return slotmap_prepare(&status->map, watches);
+}
+
+/* see slotmap_slot - returns -1 if the watch cannot be published */
+int32_t
+status_slot(status_t *status, const char *name)
+{
+    return slotmap_slot(&status->map, name);
+}
+
+/**
+ * @brief Publish the state of a watch - the sample and check result
+ *        are reset as soon as the process changes
+ * @param status   status instance
+ * @param slot     record of the watch
+ * @param state    current state
+ * @param pid      current process ID
+ * @param restarts number of restarts
+ * @param failures number of consecutive failed starts
+ */
+void
+status_set_state(status_t *status, int32_t slot, int32_t state, pid_t pid,
+        uint32_t restarts, uint32_t failures)
+{
+    nyx_status_record_t *record = record_get(status, slot);
+
+    if (record == NULL)
+        return;
+
+    pthread_mutex_t *lock = record_lock(status, slot);
+
+    pthread_mutex_lock(lock);
+    record_begin(record);
+
+    if (record->state != state || record->changed == 0)
+        record->changed = time(NULL);
+
+    if (record->pid != pid)
+    {
+        record->cpu = 0.0;
+        record->rss = 0;
+        record->sampled = 0;
+        record->check = NYX_STATUS_CHECK_NONE;
+        record->check_type = 0;
+        record->checked = 0;
+    }
+
+    record->state = state;
+    record->pid = pid;
+    record->restarts = restarts;
+    record->failures = failures;
+
+    record_end(record);
+    pthread_mutex_unlock(lock);
+}
+
+/**
+ * @brief Publish the latest statistics sample of a watch's process
+ * @param status status instance
+ * @param slot   record of the watch
+ * @param cpu    CPU usage (in percent)
+ * @param rss    resident memory (in KB)
+ */
+void
+status_set_sample(status_t *status, int32_t slot, double cpu, uint64_t rss)
+{
+    nyx_status_record_t *record = record_get(status, slot);
+
+    if (record == NULL)
+        return;
+
+    pthread_mutex_t *lock = record_lock(status, slot);
+
+    pthread_mutex_lock(lock);
+    record_begin(record);
+
+    record->cpu = cpu;
+    record->rss = rss;
+    record->sampled = time(NULL);
+
+    record_end(record);
+    pthread_mutex_unlock(lock);
+}
+
+/**
+ * @brief Publish the latest check result of a watch's process
+ * @param status  status instance
+ * @param slot    record of the watch
+ * @param type    type of the check (see check_type_e)
+ * @param success whether the check passed
+ */
+void
+status_set_check(status_t *status, int32_t slot, int32_t type, bool success)
+{
+    nyx_status_record_t *record = record_get(status, slot);
+
+    if (record == NULL)
+        return;
+
+    pthread_mutex_t *lock = record_lock(status, slot);
+
+    pthread_mutex_lock(lock);
+    record_begin(record);
+
+    record->check = success ? NYX_STATUS_CHECK_PASSED : NYX_STATUS_CHECK_FAILED;
+    record->check_type = type;
+    record->checked = time(NULL);
+
+    record_end(record);
+    pthread_mutex_unlock(lock);
+}
+
+void
+status_close(status_t *status)
+{
+    if (status == NULL)
+        return;
+
+    slotmap_unmap(&status->map);
+
+    if (status->fd >= 0)
+        close(status->fd);
+
+    for (uint32_t i = 0; i < STATUS_LOCKS; i++)
+        pthread_mutex_destroy(&status->locks[i]);
+
+    xfree(status->path);
+    xfree(status);
+}
+
+/**
+ * @brief Read the status table of a nyx instance
+ * @param pid_dir  pid directory of the nyx instance
+ * @param matcher  selection of the watches (NULL for all)
+ * @param callback function called with a consistent copy of every
+ *                 matching record
+ * @param data     data passed to the callback
+ * @return false if there is no (valid) status table
+ */
+bool
+status_query(const char *pid_dir, matcher_t *matcher, status_callback_t callback, void *data)
+{
+    struct stat st;
+    bool found = false;
+    char *path = status_path(pid_dir);
+    int32_t fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    xfree(path);
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(nyx_status_header_t))
+    {
+        close(fd);
+        return false;
+    }
+
+    const nyx_status_header_t *header =
+        mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (header == MAP_FAILED)
+    {
+        log_perror("nyx: mmap");
+        return false;
+    }
+
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == NYX_STATUS_MAGIC &&
+            header->version == NYX_STATUS_VERSION &&
+            header->record_size == sizeof(nyx_status_record_t))
+    {
+        const nyx_status_record_t *records = (const nyx_status_record_t *)(header + 1);
+
+        /* the table may have grown since the file was mapped */
+        uint32_t count = MIN(__atomic_load_n(&header->records, __ATOMIC_ACQUIRE),
+                (st.st_size - sizeof(nyx_status_header_t)) / sizeof(nyx_status_record_t));
+
+        if (kill(header->pid, 0) != 0 && errno == ESRCH)
+            log_warn("The status table is outdated - nyx (PID %d) is not running",
+                    header->pid);
+
+        for (uint32_t idx = 0; idx < count; idx++)
+        {
+            nyx_status_record_t record;
+
+            if (!nyx_status_read(&records[idx], &record))
+                continue;
+
+            if (matcher && !matcher_match(matcher, record.name))
+                continue;
+
+            callback(&record, data);
+        }
+
+        found = true;
+    }
+
+    munmap((void *)header, st.st_size);
+
+    return found;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
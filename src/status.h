@@ -0,0 +1,81 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "hash.h"
+#include "matcher.h"
+#include "nyxstatus.h"
+#include "slotmap.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* the mapping is reserved for this many records up front so the table
+ * can grow without moving the records the states are writing to */
+#define STATUS_MAX_RECORDS 65536
+
+/* number of locks serializing the writers of the records */
+#define STATUS_LOCKS 16
+
+/**
+ * Status table of all watches that is memory-mapped from a file in the
+ * pid directory and read by local readers without any request to the
+ * daemon (see nyxstatus.h). A record is written by the state of its
+ * watch (on every transition) and the proc system (on every sample and
+ * check result).
+ */
+typedef struct
+{
+    int32_t fd;
+    char *path;
+    slotmap_t map;
+    nyx_status_header_t *header;
+    nyx_status_record_t *records;
+    pthread_mutex_t locks[STATUS_LOCKS];
+} status_t;
+
+/* called for every record of a status table query */
+typedef void (*status_callback_t)(const nyx_status_record_t *record, void *data);
+
+status_t *
+status_open(const char *pid_dir);
+
+bool
+status_prepare(status_t *status, hash_t *watches);
+
+int32_t
+status_slot(status_t *status, const char *name);
+
+void
+status_set_state(status_t *status, int32_t slot, int32_t state, pid_t pid,
+        uint32_t restarts, uint32_t failures);
+
+void
+status_set_sample(status_t *status, int32_t slot, double cpu, uint64_t rss);
+
+void
+status_set_check(status_t *status, int32_t slot, int32_t type, bool success);
+
+void
+status_close(status_t *status);
+
+bool
+status_query(const char *pid_dir, matcher_t *matcher, status_callback_t callback, void *data);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -13,13 +13,20 @@
  * limitations under the License.
  */
 
+#define NYX_MEM_TAG MEM_CONNECTOR
+
 #include "log.h"
 #include "strbuf.h"
 
 #include <stdarg.h>
+#include <string.h>
 
 #define NYX_DEFAULT_STRBUF_SIZE 8
 
+/* free space that is ensured before formatting so most
+ * formatted appends need a single vsnprintf call only */
+#define NYX_STRBUF_HEADROOM 128
+
 strbuf_t *
 strbuf_new(void)
 {
@@ -32,72 +39,161 @@ strbuf_new_size(uint64_t initial_size)
     strbuf_t *str = xcalloc1(sizeof(strbuf_t));
 
     str->size = MAX(NYX_DEFAULT_STRBUF_SIZE, initial_size);
-    str->buf = xcalloc(initial_size, sizeof(char));
+    str->buf = xcalloc(str->size, sizeof(char));
 
     return str;
 }
 
-static uint64_t
-get_new_size(strbuf_t *buf, uint64_t print_length)
+/**
+ * @brief Ensure the buffer has room for the given number of bytes
+ *        (and the terminating NUL) after its current content
+ * @param buf    string buffer
+ * @param length number of bytes to reserve
+ */
+void
+strbuf_reserve(strbuf_t *buf, uint64_t length)
 {
+    uint64_t min_required = buf->length + length + 1;
+
+    if (min_required <= buf->size)
+        return;
+
     uint64_t new_size = buf->size;
-    uint64_t min_required = buf->length + print_length + 1;
 
-    while (new_size <= min_required)
+    while (new_size < min_required)
         new_size *= 2;
 
-    return new_size;
+    buf->buf = xrealloc(buf->buf, new_size * sizeof(char));
+    buf->size = new_size;
 }
 
+/**
+ * @brief Append the formatted string to the buffer
+ * @param buf    string buffer
+ * @param format printf-like format string
+ * @param values format arguments
+ * @return number of appended bytes
+ */
 uint64_t
-strbuf_append(strbuf_t *buf, const char *format, ...)
+strbuf_append_va(strbuf_t *buf, const char *format, va_list values)
 {
     if (buf == NULL)
         return 0;
 
+    va_list copy;
+    va_copy(copy, values);
+
+    strbuf_reserve(buf, NYX_STRBUF_HEADROOM);
+
     uint64_t remaining = buf->size - buf->length;
+    int32_t printed = vsnprintf(buf->buf + buf->length, remaining, format, values);
 
-    /* immediately double size */
-    if (remaining < 1)
+    if (printed < 0)
     {
-        buf->size = 2 * buf->size;
+        buf->buf[buf->length] = '\0';
+        va_end(copy);
+        return 0;
+    }
 
-        void *new_buffer = realloc(buf->buf, buf->size * sizeof(char));
+    /* the output was truncated - format again with the exact size */
+    if ((uint64_t)printed >= remaining)
+    {
+        strbuf_reserve(buf, printed);
+        vsnprintf(buf->buf + buf->length, buf->size - buf->length, format, copy);
+    }
 
-        if (new_buffer == NULL)
-            log_critical_perror("nyx: realloc");
+    va_end(copy);
 
-        buf->buf = new_buffer;
-        remaining = buf->size - buf->length;
-    }
+    buf->length += printed;
 
+    return printed;
+}
+
+uint64_t
+strbuf_append(strbuf_t *buf, const char *format, ...)
+{
     va_list vas;
     va_start(vas, format);
 
-    uint64_t printed = vsnprintf(buf->buf + buf->length, remaining, format, vas);
+    uint64_t printed = strbuf_append_va(buf, format, vas);
 
     va_end(vas);
 
-    /* the output was truncated */
-    if (printed >= remaining)
-    {
-        buf->size = get_new_size(buf, printed);
+    return printed;
+}
 
-        void *new_buffer = realloc(buf->buf, buf->size * sizeof(char));
+/**
+ * @brief Append the given bytes without any format processing
+ * @param buf    string buffer
+ * @param data   data to append
+ * @param length number of bytes to append
+ * @return number of appended bytes
+ */
+uint64_t
+strbuf_append_data(strbuf_t *buf, const char *data, uint64_t length)
+{
+    if (buf == NULL)
+        return 0;
+
+    strbuf_reserve(buf, length);
+
+    memcpy(buf->buf + buf->length, data, length);
+    buf->length += length;
+    buf->buf[buf->length] = '\0';
+
+    return length;
+}
+
+uint64_t
+strbuf_append_string(strbuf_t *buf, const char *str)
+{
+    return strbuf_append_data(buf, str, strlen(str));
+}
 
-        if (new_buffer == NULL)
-            log_critical_perror("nyx: realloc");
+uint64_t
+strbuf_append_char(strbuf_t *buf, char chr)
+{
+    return strbuf_append_data(buf, &chr, 1);
+}
 
-        buf->buf = new_buffer;
+uint64_t
+strbuf_append_uint(strbuf_t *buf, uint64_t value)
+{
+    char digits[24];
+    char *pos = digits + sizeof(digits);
 
-        va_start(vas, format);
-        vsnprintf(buf->buf + buf->length, buf->size - buf->length, format, vas);
-        va_end(vas);
+    do
+    {
+        *--pos = '0' + value % 10;
+        value /= 10;
     }
+    while (value);
 
-    buf->length += printed;
+    return strbuf_append_data(buf, pos, digits + sizeof(digits) - pos);
+}
 
-    return printed;
+uint64_t
+strbuf_append_int(strbuf_t *buf, int64_t value)
+{
+    if (value >= 0)
+        return strbuf_append_uint(buf, value);
+
+    /* negate in unsigned arithmetic so INT64_MIN does not overflow */
+    return strbuf_append_char(buf, '-') +
+        strbuf_append_uint(buf, -(uint64_t)value);
+}
+
+/**
+ * @brief Describe the content of the buffer for writev()/sendmsg()
+ * @param buf string buffer
+ * @return I/O vector referring to the buffer's content
+ */
+struct iovec
+strbuf_iovec(const strbuf_t *buf)
+{
+    struct iovec iov = { buf->buf, buf->length };
+
+    return iov;
 }
 
 void
@@ -106,9 +202,7 @@ strbuf_clear(strbuf_t *buf)
     if (buf == NULL)
         return;
 
-    if (buf->length > 0)
-        memset(buf->buf, 0, buf->size * sizeof(char));
-
+    buf->buf[0] = '\0';
     buf->length = 0;
 }
 
@@ -119,9 +213,9 @@ strbuf_free(strbuf_t *buf)
         return;
 
     if (buf->buf)
-        free(buf->buf);
+        xfree(buf->buf);
 
-    free(buf);
+    xfree(buf);
 }
 
 /* vim: set et sw=4 sts=4 tw=80: */
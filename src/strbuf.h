@@ -17,8 +17,15 @@
 
 #include "def.h"
 
+#include <stdarg.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
+/**
+ * Growing, always NUL-terminated string buffer. Buffers are meant to be
+ * kept and cleared (in O(1)) for the next output instead of being
+ * allocated per response.
+ */
 typedef struct
 {
     char *buf;
@@ -32,10 +39,35 @@ strbuf_new(void);
 strbuf_t *
 strbuf_new_size(uint64_t initial_size);
 
+void
+strbuf_reserve(strbuf_t *buf, uint64_t length);
+
 uint64_t
 strbuf_append(strbuf_t *buf, const char *format, ...)
     __attribute__((format(printf, 2, 3)));
 
+uint64_t
+strbuf_append_va(strbuf_t *buf, const char *format, va_list values)
+    __attribute__((format(printf, 2, 0)));
+
+uint64_t
+strbuf_append_data(strbuf_t *buf, const char *data, uint64_t length);
+
+uint64_t
+strbuf_append_string(strbuf_t *buf, const char *str);
+
+uint64_t
+strbuf_append_char(strbuf_t *buf, char chr);
+
+uint64_t
+strbuf_append_int(strbuf_t *buf, int64_t value);
+
+uint64_t
+strbuf_append_uint(strbuf_t *buf, uint64_t value);
+
+struct iovec
+strbuf_iovec(const strbuf_t *buf);
+
 void
 strbuf_free(strbuf_t *buf);
 
@@ -0,0 +1,491 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_LOG_CATEGORY NYX_LOG_CONNECTOR
+#define NYX_MEM_TAG MEM_CONNECTOR
+
+#include "def.h"
+#include "log.h"
+#include "socket.h"
+#include "state.h"
+#include "subscribe.h"
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* size of the header of a session response frame */
+#define FRAME_HEADER_LEN 9
+
+/* maximum length of a single formatted event */
+#define EVENT_MAX_LEN 512
+
+/* response headers of the HTTP event stream (and its reconnection delay) */
+#define SSE_HANDSHAKE "HTTP/1.1 200 OK\r\n" \
+    "Server: nyx\r\n" \
+    "Content-Type: text/event-stream\r\n" \
+    "Cache-Control: no-cache\r\n" \
+    "Connection: keep-alive\r\n\r\n" \
+    "retry: 3000\n\n"
+
+static int64_t
+timestamp_msecs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static char **
+copy_names(const char **names)
+{
+    uint32_t count = names ? count_args(names) : 0;
+
+    if (count < 1)
+        return NULL;
+
+    char **copy = xcalloc(count + 1, sizeof(char *));
+
+    for (uint32_t idx = 0; idx < count; idx++)
+        copy[idx] = xstrdup(names[idx]);
+
+    return copy;
+}
+
+/**
+ * @brief Create a new list of subscribers
+ * @param reactor reactor the subscribers' sockets are processed on
+ * @return new subscribers instance
+ */
+subscribers_t *
+subscribers_new(reactor_t *reactor)
+{
+    subscribers_t *subscribers = xcalloc1(sizeof(subscribers_t));
+
+    pthread_mutex_init(&subscribers->lock, NULL);
+
+    subscribers->reactor = reactor;
+    subscribers->subscribers = list_new(NULL);
+
+    return subscribers;
+}
+
+static void
+subscriber_free(subscriber_t *subscriber)
+{
+    while (subscriber->count > 0)
+    {
+        xfree(subscriber->events[subscriber->head].name);
+
+        subscriber->head = (subscriber->head + 1) % NYX_SUBSCRIBER_QUEUE;
+        subscriber->count--;
+    }
+
+    strings_free(subscriber->watches);
+    xfree(subscriber->output);
+    xfree(subscriber);
+}
+
+/* has to be called with the lock being held */
+static void
+subscriber_remove(subscriber_t *subscriber)
+{
+    subscribers_t *subscribers = subscriber->owner;
+    list_node_t *node = subscribers->subscribers->head;
+
+    while (node)
+    {
+        if (node->data == subscriber)
+        {
+            list_remove(subscribers->subscribers, node);
+            break;
+        }
+
+        node = node->next;
+    }
+
+    log_debug("Removing subscriber on socket %d", subscriber->fd);
+
+    reactor_remove_fd(subscribers->reactor, subscriber->fd);
+    close(subscriber->fd);
+
+    subscriber_free(subscriber);
+}
+
+static void
+output_append(subscriber_t *subscriber, const char *data, size_t length)
+{
+    if (subscriber->output_length + length > subscriber->output_size)
+    {
+        size_t size = MAX(subscriber->output_size * 2, subscriber->output_length + length);
+
+        subscriber->output = xrealloc(subscriber->output, size);
+        subscriber->output_size = size;
+    }
+
+    memcpy(subscriber->output + subscriber->output_length, data, length);
+    subscriber->output_length += length;
+}
+
+static void
+output_message(subscriber_t *subscriber, const char *message, size_t length)
+{
+    if (subscriber->format == SUBSCRIBER_FRAMED)
+    {
+        char header[FRAME_HEADER_LEN] = {0};
+        uint32_t value = htonl(length);
+
+        memcpy(header, &value, sizeof(uint32_t));
+
+        value = htonl(subscriber->request_id);
+        memcpy(header + 4, &value, sizeof(uint32_t));
+
+        output_append(subscriber, header, FRAME_HEADER_LEN);
+    }
+
+    output_append(subscriber, message, length);
+}
+
+/* server-sent event with the transition as JSON data */
+static int32_t
+format_sse(char *buffer, subscriber_event_t *event)
+{
+    char name[EVENT_MAX_LEN / 2];
+    const char *src = event->name;
+    uint32_t length = 0;
+
+    /* escape the name as a JSON string */
+    while (*src && length < LEN(name) - 2)
+    {
+        if (*src == '"' || *src == '\\')
+            name[length++] = '\\';
+
+        /* control characters would break the event */
+        name[length++] = (unsigned char)*src < 0x20 ? ' ' : *src;
+        src++;
+    }
+
+    name[length] = '\0';
+
+    return snprintf(buffer, EVENT_MAX_LEN,
+            "event: state\n"
+            "data: {\"watch\":\"%s\",\"from\":\"%s\",\"to\":\"%s\","
+            "\"pid\":%d,\"timestamp\":%lld}\n\n",
+            name,
+            state_to_human_string(event->from),
+            state_to_human_string(event->to),
+            event->pid,
+            (long long)event->timestamp);
+}
+
+/* format all queued events into the output buffer */
+static void
+format_events(subscriber_t *subscriber)
+{
+    char buffer[EVENT_MAX_LEN];
+    int32_t length = 0;
+
+    if (subscriber->dropped > 0)
+    {
+        length = snprintf(buffer, EVENT_MAX_LEN,
+                subscriber->format == SUBSCRIBER_SSE
+                    ? "event: dropped\ndata: %llu\n\n"
+                    : "dropped %llu\n",
+                (unsigned long long)subscriber->dropped);
+
+        output_message(subscriber, buffer, length);
+        subscriber->dropped = 0;
+    }
+
+    while (subscriber->count > 0)
+    {
+        subscriber_event_t *event = &subscriber->events[subscriber->head];
+
+        if (subscriber->format == SUBSCRIBER_SSE)
+            length = format_sse(buffer, event);
+        else
+        {
+            length = snprintf(buffer, EVENT_MAX_LEN, "%s %s %s %d %lld\n",
+                    event->name,
+                    state_to_human_string(event->from),
+                    state_to_human_string(event->to),
+                    event->pid,
+                    (long long)event->timestamp);
+        }
+
+        output_message(subscriber, buffer, MIN(length, EVENT_MAX_LEN - 1));
+
+        xfree(event->name);
+        event->name = NULL;
+
+        subscriber->head = (subscriber->head + 1) % NYX_SUBSCRIBER_QUEUE;
+        subscriber->count--;
+    }
+}
+
+/**
+ * Send as much of the queued events as the socket accepts.
+ * Returns false if the subscriber is gone.
+ */
+static bool
+subscriber_flush(subscriber_t *subscriber)
+{
+    while (true)
+    {
+        if (subscriber->output_sent >= subscriber->output_length)
+        {
+            subscriber->output_sent = 0;
+            subscriber->output_length = 0;
+
+            if (subscriber->count < 1 && subscriber->dropped < 1)
+                break;
+
+            format_events(subscriber);
+        }
+
+        ssize_t sent = send_safe(subscriber->fd,
+                subscriber->output + subscriber->output_sent,
+                subscriber->output_length - subscriber->output_sent);
+
+        if (sent > 0)
+        {
+            subscriber->output_sent += sent;
+            continue;
+        }
+
+        if (sent == -1 && errno == EINTR)
+            continue;
+
+        /* the reactor reports when the socket is writable again */
+        if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        return false;
+    }
+
+    /* everything was sent */
+    if (subscriber->writing)
+    {
+        subscriber->writing = false;
+        reactor_modify_fd(subscriber->owner->reactor, subscriber->fd, REACTOR_READ);
+    }
+
+    return true;
+}
+
+static void
+handle_subscriber(UNUSED reactor_t *reactor, UNUSED int32_t fd, uint32_t events, void *data)
+{
+    subscriber_t *subscriber = data;
+    subscribers_t *subscribers = subscriber->owner;
+    bool alive = !(events & REACTOR_HANGUP);
+
+    pthread_mutex_lock(&subscribers->lock);
+
+    /* subscribers are not supposed to send anything */
+    if (alive && (events & REACTOR_READ))
+    {
+        char buffer[256];
+
+        alive = recv(subscriber->fd, buffer, sizeof(buffer), 0) > 0 ||
+            errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    if (alive && (events & REACTOR_WRITE))
+        alive = subscriber_flush(subscriber);
+
+    if (!alive)
+        subscriber_remove(subscriber);
+
+    pthread_mutex_unlock(&subscribers->lock);
+}
+
+/**
+ * @brief Hand over a client connection that is pushed the state
+ *        transitions from now on
+ * @param subscribers subscribers instance
+ * @param fd          socket of the client (owned by the subscribers from now)
+ * @param watches     names of the watches (or their instances) to subscribe
+ *                    to (NULL or empty for all)
+ * @param format      format the events are sent in
+ * @param request_id  request id of the session's subscribe command
+ * @return true on success, false otherwise
+ */
+bool
+subscribers_add(subscribers_t *subscribers, int32_t fd, const char **watches,
+        subscriber_format_e format, uint32_t request_id)
+{
+    subscriber_t *subscriber = xcalloc1(sizeof(subscriber_t));
+    bool framed = format == SUBSCRIBER_FRAMED;
+
+    subscriber->fd = fd;
+    subscriber->owner = subscribers;
+    subscriber->watches = copy_names(watches);
+    subscriber->format = format;
+    subscriber->request_id = request_id;
+
+    /* an empty frame confirms the session's subscribe request - the
+     * response headers open the event stream of an HTTP client */
+    if (framed)
+        output_message(subscriber, "", 0);
+    else if (format == SUBSCRIBER_SSE)
+        output_append(subscriber, SSE_HANDSHAKE, LEN(SSE_HANDSHAKE) - 1);
+
+    subscriber->writing = subscriber->output_length > 0;
+
+    pthread_mutex_lock(&subscribers->lock);
+
+    if (!reactor_add_fd_events(subscribers->reactor, fd,
+                subscriber->writing ? REACTOR_READ | REACTOR_WRITE : REACTOR_READ,
+                handle_subscriber, subscriber))
+    {
+        pthread_mutex_unlock(&subscribers->lock);
+
+        close(fd);
+        subscriber_free(subscriber);
+        return false;
+    }
+
+    list_add(subscribers->subscribers, subscriber);
+
+    pthread_mutex_unlock(&subscribers->lock);
+
+    log_debug("Added subscriber on socket %d", fd);
+
+    return true;
+}
+
+static bool
+subscribed(subscriber_t *subscriber, const char *name, const char *watch)
+{
+    char **subscription = subscriber->watches;
+
+    if (subscription == NULL)
+        return true;
+
+    while (*subscription)
+    {
+        if (!strcmp(*subscription, name) || !strcmp(*subscription, watch))
+            return true;
+
+        subscription++;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Publish a state transition to all interested subscribers
+ * @param subscribers subscribers instance
+ * @param name        name of the watch instance
+ * @param watch       name of the watch
+ * @param from        previous state
+ * @param to          new state
+ * @param pid         pid of the watch's process
+ */
+void
+subscribers_publish(subscribers_t *subscribers, const char *name, const char *watch,
+        int32_t from, int32_t to, pid_t pid)
+{
+    int64_t timestamp = timestamp_msecs();
+
+    pthread_mutex_lock(&subscribers->lock);
+
+    for (list_node_t *node = subscribers->subscribers->head; node; node = node->next)
+    {
+        subscriber_t *subscriber = node->data;
+
+        if (!subscribed(subscriber, name, watch))
+            continue;
+
+        /* the subscriber does not keep up - drop its oldest event */
+        if (subscriber->count >= NYX_SUBSCRIBER_QUEUE)
+        {
+            xfree(subscriber->events[subscriber->head].name);
+
+            subscriber->head = (subscriber->head + 1) % NYX_SUBSCRIBER_QUEUE;
+            subscriber->count--;
+            subscriber->dropped++;
+        }
+
+        uint32_t idx = (subscriber->head + subscriber->count) % NYX_SUBSCRIBER_QUEUE;
+        subscriber_event_t *event = &subscriber->events[idx];
+
+        event->name = xstrdup(name);
+        event->from = from;
+        event->to = to;
+        event->pid = pid;
+        event->timestamp = timestamp;
+
+        subscriber->count++;
+
+        /* the events are sent on the reactor thread as soon
+         * as the socket is writable */
+        if (!subscriber->writing)
+        {
+            subscriber->writing = true;
+            reactor_modify_fd(subscribers->reactor, subscriber->fd,
+                    REACTOR_READ | REACTOR_WRITE);
+        }
+    }
+
+    pthread_mutex_unlock(&subscribers->lock);
+}
+
+/**
+ * @brief Determine the number of subscribers
+ * @param subscribers subscribers instance
+ * @return number of connected subscribers
+ */
+uint32_t
+subscribers_count(subscribers_t *subscribers)
+{
+    pthread_mutex_lock(&subscribers->lock);
+
+    uint32_t count = list_size(subscribers->subscribers);
+
+    pthread_mutex_unlock(&subscribers->lock);
+
+    return count;
+}
+
+void
+subscribers_destroy(subscribers_t *subscribers)
+{
+    if (subscribers == NULL)
+        return;
+
+    pthread_mutex_lock(&subscribers->lock);
+
+    while (subscribers->subscribers->head)
+        subscriber_remove(subscribers->subscribers->head->data);
+
+    pthread_mutex_unlock(&subscribers->lock);
+
+    list_destroy(subscribers->subscribers);
+    pthread_mutex_destroy(&subscribers->lock);
+
+    xfree(subscribers);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
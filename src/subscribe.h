@@ -0,0 +1,107 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "list.h"
+#include "reactor.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* maximum number of events queued per subscriber */
+#define NYX_SUBSCRIBER_QUEUE 256
+
+typedef struct
+{
+    char *name;
+    int32_t from;
+    int32_t to;
+    pid_t pid;
+    int64_t timestamp;
+} subscriber_event_t;
+
+typedef enum
+{
+    /** one line per event */
+    SUBSCRIBER_LINES,
+    /** session response frames of the subscribe request */
+    SUBSCRIBER_FRAMED,
+    /** HTTP server-sent events */
+    SUBSCRIBER_SSE
+} subscriber_format_e;
+
+typedef struct subscribers_t subscribers_t;
+
+typedef struct
+{
+    int32_t fd;
+    subscribers_t *owner;
+    /** names of the subscribed watches (NULL for all) */
+    char **watches;
+    subscriber_format_e format;
+    /** session request the events are sent as response frames of */
+    uint32_t request_id;
+
+    /* ring buffer of the events that were not sent yet */
+    subscriber_event_t events[NYX_SUBSCRIBER_QUEUE];
+    uint32_t head;
+    uint32_t count;
+    /** events that were dropped because the subscriber did not keep up */
+    uint64_t dropped;
+
+    /* formatted output that was not sent completely */
+    char *output;
+    size_t output_size;
+    size_t output_length;
+    size_t output_sent;
+
+    /** the reactor waits for the socket to become writable */
+    bool writing;
+} subscriber_t;
+
+/**
+ * Clients that are pushed the state transitions of (some of) the watches.
+ * Events are published from any thread into bounded per-subscriber queues
+ * and sent on the reactor thread - slow subscribers lose their oldest
+ * events instead of blocking the publishers.
+ */
+struct subscribers_t
+{
+    pthread_mutex_t lock;
+    reactor_t *reactor;
+    list_t *subscribers;
+};
+
+subscribers_t *
+subscribers_new(reactor_t *reactor);
+
+bool
+subscribers_add(subscribers_t *subscribers, int32_t fd, const char **watches,
+        subscriber_format_e format, uint32_t request_id);
+
+void
+subscribers_publish(subscribers_t *subscribers, const char *name, const char *watch,
+        int32_t from, int32_t to, pid_t pid);
+
+uint32_t
+subscribers_count(subscribers_t *subscribers);
+
+void
+subscribers_destroy(subscribers_t *subscribers);
+
+/* vim: set et sw=4 sts=4 tw=80: */
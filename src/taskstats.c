@@ -0,0 +1,599 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_PROC
+
+#include "def.h"
+#include "log.h"
+#include "socket.h"
+#include "taskstats.h"
+
+/* we want to include sys/socket.h before linux/netlink.h
+ * to avoid some compilation problems with some 2.6 kernels */
+#include <sys/socket.h>
+
+#include <errno.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/taskstats.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* every process is requested twice: the thread group's CPU times and
+ * delays and the main thread's I/O and memory accounting */
+#define TASKSTATS_REQUESTS (2 * TASKSTATS_BATCH_SIZE)
+
+/* size of a single reply (struct taskstats is about 400 bytes) */
+#define TASKSTATS_REPLY_SIZE 1024
+
+/* the replies of a whole batch are queued in the receive buffer */
+#define TASKSTATS_RCVBUF (1024 * 1024)
+
+#define NLA_DATA(nla) ((char *)(nla) + NLA_HDRLEN)
+
+typedef struct
+{
+    struct nlmsghdr header;
+    struct genlmsghdr genl;
+    struct nlattr attr;
+    uint32_t id;
+} taskstats_request_t;
+
+typedef struct
+{
+    struct nlmsghdr header;
+    struct genlmsghdr genl;
+    char attrs[64];
+} taskstats_message_t;
+
+static void
+init_message(taskstats_message_t *msg, uint16_t family, uint8_t cmd, uint8_t version)
+{
+    memset(msg, 0, sizeof(taskstats_message_t));
+
+    msg->header.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    msg->header.nlmsg_type = family;
+    msg->header.nlmsg_flags = NLM_F_REQUEST;
+    msg->genl.cmd = cmd;
+    msg->genl.version = version;
+}
+
+static void
+add_attr(taskstats_message_t *msg, uint16_t type, const void *data, uint16_t length)
+{
+    struct nlattr *attr = (struct nlattr *)((char *)msg + NLMSG_ALIGN(msg->header.nlmsg_len));
+
+    attr->nla_type = type;
+    attr->nla_len = NLA_HDRLEN + length;
+    memcpy(NLA_DATA(attr), data, length);
+
+    msg->header.nlmsg_len = NLMSG_ALIGN(msg->header.nlmsg_len) + NLA_ALIGN(attr->nla_len);
+}
+
+static bool
+send_message(int32_t sock, taskstats_message_t *msg)
+{
+    struct sockaddr_nl addr;
+
+    memset(&addr, 0, sizeof(struct sockaddr_nl));
+    addr.nl_family = AF_NETLINK;
+
+    if (sendto(sock, msg, msg->header.nlmsg_len, 0,
+                (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        log_perror("nyx: sendto");
+        return false;
+    }
+
+    return true;
+}
+
+/* receive the reply (or acknowledgement) of a single request */
+static ssize_t
+receive_reply(int32_t sock, char *buffer, size_t size)
+{
+    while (true)
+    {
+        ssize_t length = recv(sock, buffer, size, 0);
+
+        if (length < 0 && errno == EINTR)
+            continue;
+
+        if (length < 0)
+        {
+            log_perror("nyx: recv");
+            return -1;
+        }
+
+        struct nlmsghdr *header = (struct nlmsghdr *)buffer;
+
+        if (!NLMSG_OK(header, (size_t)length))
+            return -1;
+
+        if (header->nlmsg_type == NLMSG_ERROR)
+        {
+            struct nlmsgerr *error = NLMSG_DATA(header);
+
+            /* positive acknowledgement */
+            if (error->error == 0)
+                return 0;
+
+            errno = -error->error;
+            return -1;
+        }
+
+        return length;
+    }
+}
+
+static int32_t
+open_socket(void)
+{
+    int32_t sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+
+    if (sock == -1)
+    {
+        log_perror("nyx: socket");
+        return -1;
+    }
+
+    return sock;
+}
+
+/* the family ID of TASKSTATS is assigned dynamically */
+static bool
+resolve_family(taskstats_t *ts)
+{
+    taskstats_message_t msg;
+    const char *name = TASKSTATS_GENL_NAME;
+
+    init_message(&msg, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 1);
+    add_attr(&msg, CTRL_ATTR_FAMILY_NAME, name, strlen(name) + 1);
+
+    if (!send_message(ts->sock, &msg))
+        return false;
+
+    ssize_t length = receive_reply(ts->sock, ts->buffers, TASKSTATS_REPLY_SIZE);
+
+    if (length < 1)
+        return false;
+
+    struct nlmsghdr *header = (struct nlmsghdr *)ts->buffers;
+    struct nlattr *attr = (struct nlattr *)((char *)NLMSG_DATA(header) + GENL_HDRLEN);
+    int32_t remaining = header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+
+    while (remaining >= NLA_HDRLEN && attr->nla_len >= NLA_HDRLEN)
+    {
+        if (attr->nla_type == CTRL_ATTR_FAMILY_ID)
+        {
+            memcpy(&ts->family, NLA_DATA(attr), sizeof(uint16_t));
+            return true;
+        }
+
+        remaining -= NLA_ALIGN(attr->nla_len);
+        attr = (struct nlattr *)((char *)attr + NLA_ALIGN(attr->nla_len));
+    }
+
+    return false;
+}
+
+/**
+ * @brief Connect to the TASKSTATS generic netlink family. Querying the
+ *        statistics of other users' processes requires CAP_NET_ADMIN.
+ * @return new instance or NULL if taskstats are not available
+ */
+taskstats_t *
+taskstats_new(void)
+{
+    int32_t sock = open_socket();
+
+    if (sock < 0)
+        return NULL;
+
+    taskstats_t *ts = xcalloc1(sizeof(taskstats_t));
+
+    ts->sock = sock;
+    ts->exit_sock = -1;
+    ts->requests = xcalloc(TASKSTATS_REQUESTS, sizeof(taskstats_request_t));
+    ts->buffers = xcalloc(TASKSTATS_REQUESTS, TASKSTATS_REPLY_SIZE);
+
+    if (!resolve_family(ts))
+    {
+        log_warn("nyx: taskstats are not available");
+        taskstats_destroy(ts);
+        return NULL;
+    }
+
+    int32_t size = TASKSTATS_RCVBUF;
+
+    /* the forced size is not limited by rmem_max but privileged */
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    /* the replies of a batch are sent synchronously - never block
+     * indefinitely if any of them got lost */
+    struct timeval timeout = { 1, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    return ts;
+}
+
+static void
+read_stats(const struct nlattr *attr, struct taskstats *stats)
+{
+    size_t length = attr->nla_len - NLA_HDRLEN;
+
+    /* the structure grows with the kernel's TASKSTATS_VERSION */
+    memset(stats, 0, sizeof(struct taskstats));
+    memcpy(stats, NLA_DATA(attr), MIN(length, sizeof(struct taskstats)));
+}
+
+/* parse the ID and statistics of a TASKSTATS_TYPE_AGGR_* attribute */
+static bool
+parse_aggregate(const struct nlattr *aggr, pid_t *id, struct taskstats *stats)
+{
+    bool found = false;
+    const struct nlattr *attr = (const struct nlattr *)NLA_DATA(aggr);
+    int32_t remaining = aggr->nla_len - NLA_HDRLEN;
+
+    while (remaining >= NLA_HDRLEN && attr->nla_len >= NLA_HDRLEN &&
+            attr->nla_len <= remaining)
+    {
+        switch (attr->nla_type)
+        {
+            case TASKSTATS_TYPE_PID:
+            case TASKSTATS_TYPE_TGID:
+                memcpy(id, NLA_DATA(attr), sizeof(uint32_t));
+                break;
+            case TASKSTATS_TYPE_STATS:
+                read_stats(attr, stats);
+                found = true;
+                break;
+            default:
+                break;
+        }
+
+        remaining -= NLA_ALIGN(attr->nla_len);
+        attr = (const struct nlattr *)((const char *)attr + NLA_ALIGN(attr->nla_len));
+    }
+
+    return found;
+}
+
+/**
+ * @brief Parse the attributes of a TASKSTATS reply into the given sample.
+ *        The CPU times and delays of a thread group aggregate take
+ *        precedence over the ones of a single task.
+ * @param buffer attributes following the generic netlink header
+ * @param length length of the attributes
+ * @param sample sample to fill
+ * @return true if any statistics were found
+ */
+bool
+taskstats_parse(const char *buffer, size_t length, taskstats_sample_t *sample)
+{
+    bool found = false;
+    bool group = false;
+    struct taskstats stats;
+    const struct nlattr *attr = (const struct nlattr *)buffer;
+    int32_t remaining = length;
+
+    while (remaining >= NLA_HDRLEN && attr->nla_len >= NLA_HDRLEN &&
+            attr->nla_len <= remaining)
+    {
+        pid_t id = 0;
+
+        if (attr->nla_type == TASKSTATS_TYPE_AGGR_PID &&
+                parse_aggregate(attr, &id, &stats))
+        {
+            sample->read_bytes = stats.read_bytes;
+            sample->write_bytes = stats.write_bytes;
+            sample->hiwater_rss = stats.hiwater_rss;
+
+            if (!group)
+            {
+                sample->tgid = id;
+                sample->cpu_time = stats.ac_utime + stats.ac_stime;
+                sample->cpu_delay = stats.cpu_delay_total;
+                sample->blkio_delay = stats.blkio_delay_total;
+                sample->swapin_delay = stats.swapin_delay_total;
+            }
+
+            found = true;
+        }
+        else if (attr->nla_type == TASKSTATS_TYPE_AGGR_TGID &&
+                parse_aggregate(attr, &id, &stats))
+        {
+            sample->tgid = id;
+            sample->cpu_time = stats.ac_utime + stats.ac_stime;
+            sample->cpu_delay = stats.cpu_delay_total;
+            sample->blkio_delay = stats.blkio_delay_total;
+            sample->swapin_delay = stats.swapin_delay_total;
+
+            group = true;
+            found = true;
+        }
+
+        remaining -= NLA_ALIGN(attr->nla_len);
+        attr = (const struct nlattr *)((const char *)attr + NLA_ALIGN(attr->nla_len));
+    }
+
+    return found;
+}
+
+static void
+init_request(taskstats_request_t *request, uint16_t family, uint32_t seq,
+        uint16_t type, pid_t id)
+{
+    memset(request, 0, sizeof(taskstats_request_t));
+
+    request->header.nlmsg_len = sizeof(taskstats_request_t);
+    request->header.nlmsg_type = family;
+    request->header.nlmsg_flags = NLM_F_REQUEST;
+    request->header.nlmsg_seq = seq;
+    request->genl.cmd = TASKSTATS_CMD_GET;
+    request->genl.version = TASKSTATS_GENL_VERSION;
+    request->attr.nla_type = type;
+    request->attr.nla_len = NLA_HDRLEN + sizeof(uint32_t);
+    request->id = id;
+}
+
+static void
+handle_reply(taskstats_t *ts, uint32_t first, char *buffer, size_t length,
+        taskstats_sample_t *samples, uint32_t count)
+{
+    struct nlmsghdr *header = (struct nlmsghdr *)buffer;
+
+    if (!NLMSG_OK(header, length) || header->nlmsg_seq < first)
+        return;
+
+    uint32_t idx = header->nlmsg_seq - first;
+
+    /* the process terminated in the meantime */
+    if (idx >= count * 2 || header->nlmsg_type != ts->family)
+        return;
+
+    taskstats_sample_t *sample = &samples[idx / 2];
+    taskstats_sample_t current = *sample;
+
+    if (!taskstats_parse((char *)NLMSG_DATA(header) + GENL_HDRLEN,
+                header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), &current))
+        return;
+
+    /* the main thread reply contributes the I/O and memory only */
+    if (idx % 2 == 0)
+    {
+        sample->read_bytes = current.read_bytes;
+        sample->write_bytes = current.write_bytes;
+        sample->hiwater_rss = current.hiwater_rss;
+    }
+    else
+    {
+        *sample = current;
+        sample->valid = true;
+    }
+}
+
+static uint32_t
+query_batch(taskstats_t *ts, taskstats_sample_t *samples, uint32_t count)
+{
+    uint32_t requests = count * 2;
+    uint32_t first = ts->seq + 1;
+    uint32_t received = 0;
+    taskstats_request_t *request = (taskstats_request_t *)ts->requests;
+    struct mmsghdr messages[TASKSTATS_REQUESTS];
+    struct iovec vectors[TASKSTATS_REQUESTS];
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pid_t tgid = samples[i].tgid;
+
+        init_request(request++, ts->family, first + i * 2, TASKSTATS_CMD_ATTR_PID, tgid);
+        init_request(request++, ts->family, first + i * 2 + 1, TASKSTATS_CMD_ATTR_TGID, tgid);
+
+        samples[i].valid = false;
+    }
+
+    ts->seq += requests;
+
+    /* the kernel processes all requests of a single send */
+    if (send(ts->sock, ts->requests, requests * sizeof(taskstats_request_t), 0) < 0)
+    {
+        log_perror("nyx: send");
+        return 0;
+    }
+
+    memset(messages, 0, sizeof(messages));
+
+    for (uint32_t i = 0; i < requests; i++)
+    {
+        vectors[i].iov_base = ts->buffers + i * TASKSTATS_REPLY_SIZE;
+        vectors[i].iov_len = TASKSTATS_REPLY_SIZE;
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* every request is answered by either a reply or an error */
+    while (received < requests)
+    {
+        int32_t length = recvmmsg(ts->sock, messages + received,
+                requests - received, MSG_WAITFORONE, NULL);
+
+        if (length < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log_perror("nyx: recvmmsg");
+            break;
+        }
+
+        for (int32_t i = 0; i < length; i++)
+        {
+            struct mmsghdr *msg = &messages[received + i];
+
+            handle_reply(ts, first, msg->msg_hdr.msg_iov->iov_base, msg->msg_len,
+                    samples, count);
+        }
+
+        received += length;
+    }
+
+    uint32_t valid = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+        valid += samples[i].valid;
+
+    return valid;
+}
+
+/**
+ * @brief Request the statistics of the given processes in bulk: all
+ *        requests of a batch are sent at once and their replies are
+ *        received with as few calls as possible
+ * @param ts      taskstats instance
+ * @param samples samples whose 'tgid' is set - the statistics are filled
+ *                in and 'valid' is set if they were received
+ * @param count   number of samples
+ * @return number of processes whose statistics were received
+ */
+uint32_t
+taskstats_query(taskstats_t *ts, taskstats_sample_t *samples, uint32_t count)
+{
+    uint32_t valid = 0;
+
+    for (uint32_t offset = 0; offset < count; offset += TASKSTATS_BATCH_SIZE)
+        valid += query_batch(ts, samples + offset, MIN(count - offset, TASKSTATS_BATCH_SIZE));
+
+    return valid;
+}
+
+/**
+ * @brief Register for the accounting records of all tasks exiting on
+ *        any CPU - the final statistics of a process come for free
+ * @param ts       taskstats instance
+ * @param num_cpus number of CPUs
+ * @return non-blocking descriptor to read the records from or -1
+ */
+int32_t
+taskstats_listen_exits(taskstats_t *ts, int32_t num_cpus)
+{
+    char cpumask[32] = {0};
+    taskstats_message_t msg;
+
+    if (ts->exit_sock >= 0)
+        return ts->exit_sock;
+
+    int32_t sock = open_socket();
+
+    if (sock < 0)
+        return -1;
+
+    snprintf(cpumask, LEN(cpumask)-1, "0-%d", MAX(num_cpus, 1) - 1);
+
+    init_message(&msg, ts->family, TASKSTATS_CMD_GET, TASKSTATS_GENL_VERSION);
+    msg.header.nlmsg_flags |= NLM_F_ACK;
+    add_attr(&msg, TASKSTATS_CMD_ATTR_REGISTER_CPUMASK, cpumask, strlen(cpumask) + 1);
+
+    if (!send_message(sock, &msg) ||
+            receive_reply(sock, ts->buffers, TASKSTATS_REPLY_SIZE) != 0)
+    {
+        log_perror("nyx: taskstats register cpumask");
+        close(sock);
+        return -1;
+    }
+
+    if (!unblock_socket(sock))
+    {
+        close(sock);
+        return -1;
+    }
+
+    ts->exit_sock = sock;
+
+    return sock;
+}
+
+/**
+ * @brief Read the next accounting record of an exiting task
+ * @param ts     taskstats instance
+ * @param sample sample to fill
+ * @return true if a record was read, false if none is pending
+ */
+bool
+taskstats_read_exit(taskstats_t *ts, taskstats_sample_t *sample)
+{
+    if (ts->exit_sock < 0)
+        return false;
+
+    while (true)
+    {
+        ssize_t length = recv(ts->exit_sock, ts->buffers, TASKSTATS_REPLY_SIZE, 0);
+
+        if (length < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            /* records are dropped if we cannot keep up */
+            if (errno == ENOBUFS)
+            {
+                log_warn("nyx: taskstats exit records were lost");
+                continue;
+            }
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                log_perror("nyx: recv");
+
+            return false;
+        }
+
+        struct nlmsghdr *header = (struct nlmsghdr *)ts->buffers;
+
+        if (!NLMSG_OK(header, (size_t)length) || header->nlmsg_type != ts->family)
+            continue;
+
+        memset(sample, 0, sizeof(taskstats_sample_t));
+
+        if (taskstats_parse((char *)NLMSG_DATA(header) + GENL_HDRLEN,
+                    header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), sample))
+        {
+            sample->valid = true;
+            return true;
+        }
+    }
+}
+
+void
+taskstats_destroy(taskstats_t *ts)
+{
+    if (ts == NULL)
+        return;
+
+    if (ts->exit_sock >= 0)
+        close(ts->exit_sock);
+
+    close(ts->sock);
+
+    xfree(ts->requests);
+    xfree(ts->buffers);
+    xfree(ts);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
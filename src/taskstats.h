@@ -0,0 +1,84 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* processes whose statistics are requested in one exchange - the
+ * replies of one batch have to fit into the socket's receive buffer */
+#define TASKSTATS_BATCH_SIZE 64
+
+typedef struct
+{
+    /** thread group (process) the statistics belong to */
+    pid_t tgid;
+    /** the statistics were received */
+    bool valid;
+    /** user and system CPU time of all threads (in usec) */
+    uint64_t cpu_time;
+    /** time spent waiting for a CPU (in nsec) */
+    uint64_t cpu_delay;
+    /** time spent waiting for block I/O (in nsec) */
+    uint64_t blkio_delay;
+    /** time spent waiting for swap-in (in nsec) */
+    uint64_t swapin_delay;
+    /** bytes read from and written to storage (main thread) */
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    /** high-water mark of the resident set (in kB) */
+    uint64_t hiwater_rss;
+} taskstats_sample_t;
+
+/**
+ * Collector of the TASKSTATS generic netlink family: the statistics of
+ * many processes are requested with a single send and received in bulk.
+ * Optionally the accounting records of exiting tasks are received on a
+ * separate socket.
+ */
+typedef struct
+{
+    int32_t sock;
+    /** socket receiving the records of exiting tasks (-1 if none) */
+    int32_t exit_sock;
+    /** dynamically assigned ID of the family */
+    uint16_t family;
+    uint32_t seq;
+    char *requests;
+    char *buffers;
+} taskstats_t;
+
+taskstats_t *
+taskstats_new(void);
+
+uint32_t
+taskstats_query(taskstats_t *ts, taskstats_sample_t *samples, uint32_t count);
+
+int32_t
+taskstats_listen_exits(taskstats_t *ts, int32_t num_cpus);
+
+bool
+taskstats_read_exit(taskstats_t *ts, taskstats_sample_t *sample);
+
+bool
+taskstats_parse(const char *buffer, size_t length, taskstats_sample_t *sample);
+
+void
+taskstats_destroy(taskstats_t *ts);
+
+/* vim: set et sw=4 sts=4 tw=80: */
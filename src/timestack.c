@@ -13,6 +13,8 @@
  * limitations under the License.
  */
 
+#define NYX_MEM_TAG MEM_HISTORY
+
 #include "def.h"
 #include "log.h"
 #include "timestack.h"
@@ -25,30 +27,132 @@ timestack_new(uint32_t max)
 {
     timestack_t *stack = xcalloc1(sizeof(timestack_t));
 
-    stack->max = max;
-    stack->elements = xcalloc(max, sizeof(timestack_elem_t));
+    stack->max = MAX(max, 1);
+    stack->elements = xcalloc(stack->max, sizeof(timestack_elem_t));
 
     return stack;
 }
 
+/**
+ * @brief Count the occurrences of the values 0 to `values`-1 that
+ *        were added within the last `window` seconds
+ * @param timestack timestack instance
+ * @param window    window length in seconds
+ * @param values    number of distinct values to count
+ */
 void
-timestack_add(timestack_t *timestack, int32_t value)
+timestack_set_window(timestack_t *timestack, time_t window, uint32_t values)
 {
+    xfree(timestack->counts);
+
+    timestack->window = window;
+    timestack->values = values;
+    timestack->counts = xcalloc(values, sizeof(uint32_t));
+    timestack->in_window = 0;
+
     time_t now = time(NULL);
 
-    /* move all elements except the last one
-     * a position further */
-    uint32_t size = timestack->max;
-    uint32_t count = timestack->count + 1;
+    /* count the existing elements that are still inside the window */
+    while (timestack->in_window < timestack->count)
+    {
+        timestack_elem_t *elem = timestack_get(timestack, timestack->in_window);
+
+        if (now - elem->time > window)
+            break;
+
+        if (elem->value >= 0 && (uint32_t)elem->value < values)
+            timestack->counts[elem->value]++;
+
+        timestack->in_window++;
+    }
+}
+
+static void
+window_remove_oldest(timestack_t *timestack)
+{
+    timestack_elem_t *elem = timestack_get(timestack, timestack->in_window - 1);
+
+    if (elem->value >= 0 && (uint32_t)elem->value < timestack->values)
+        timestack->counts[elem->value]--;
+
+    timestack->in_window--;
+}
+
+/* drop all elements that fell out of the window - every element
+ * leaves the window exactly once so this is amortized O(1) */
+static void
+window_expire(timestack_t *timestack, time_t now)
+{
+    while (timestack->in_window > 0)
+    {
+        timestack_elem_t *oldest = timestack_get(timestack, timestack->in_window - 1);
+
+        if (now - oldest->time <= timestack->window)
+            break;
+
+        window_remove_oldest(timestack);
+    }
+}
+
+void
+timestack_add(timestack_t *timestack, int32_t value)
+{
+    timestack_add_at(timestack, time(NULL), value);
+}
+
+/**
+ * @brief Add a value with the given timestamp (e.g. when restoring
+ *        persisted values) - the timestamps have to be ascending
+ * @param timestack timestack instance
+ * @param now       timestamp of the value
+ * @param value     value to add
+ */
+void
+timestack_add_at(timestack_t *timestack, time_t now, int32_t value)
+{
+    /* the oldest element is overwritten once the stack is full */
+    if (timestack->count == timestack->max)
+    {
+        if (timestack->counts && timestack->in_window == timestack->count)
+            window_remove_oldest(timestack);
+    }
+    else
+        timestack->count++;
+
+    timestack->head = (timestack->head + 1) % timestack->max;
+
+    timestack_elem_t *elem = &timestack->elements[timestack->head];
+
+    elem->value = value;
+    elem->time = now;
 
-    timestack->count = MIN(size, count);
-    timestack_elem_t *start = timestack->elements;
-    timestack_elem_t *to = start + 1;
+    if (timestack->counts)
+    {
+        if (value >= 0 && (uint32_t)value < timestack->values)
+            timestack->counts[value]++;
+
+        timestack->in_window++;
+
+        window_expire(timestack, now);
+    }
+}
+
+/**
+ * @brief Number of occurrences of the given value within the window
+ *        configured via timestack_set_window
+ * @param timestack timestack instance
+ * @param value     value to count
+ * @return number of occurrences
+ */
+uint32_t
+timestack_count_within(timestack_t *timestack, int32_t value)
+{
+    if (timestack->counts == NULL || value < 0 || (uint32_t)value >= timestack->values)
+        return 0;
 
-    memmove(to, start, sizeof(timestack_elem_t) * (size - 1));
+    window_expire(timestack, time(NULL));
 
-    start->value = value;
-    start->time = now;
+    return timestack->counts[value];
 }
 
 void
@@ -57,14 +161,37 @@ timestack_clear(timestack_t *timestack)
     uint32_t size = timestack->max;
 
     timestack->count = 0;
+    timestack->head = 0;
+    timestack->in_window = 0;
     memset(timestack->elements, 0, sizeof(timestack_elem_t) * size);
+
+    if (timestack->counts)
+        memset(timestack->counts, 0, sizeof(uint32_t) * timestack->values);
 }
 
 void
 timestack_destroy(timestack_t *timestack)
 {
-    free(timestack->elements);
-    free(timestack);
+    xfree(timestack->counts);
+    xfree(timestack->elements);
+    xfree(timestack);
+}
+
+/**
+ * @brief Get the element at the given position
+ * @param timestack timestack instance
+ * @param idx       position starting with the newest element (0)
+ * @return element or NULL if the position is out of range
+ */
+timestack_elem_t *
+timestack_get(timestack_t *timestack, uint32_t idx)
+{
+    if (idx >= timestack->count)
+        return NULL;
+
+    uint32_t max = timestack->max;
+
+    return &timestack->elements[(timestack->head + max - idx) % max];
 }
 
 int32_t
@@ -73,7 +200,7 @@ timestack_newest(timestack_t *timestack)
     if (timestack->count < 1)
         return 0;
 
-    return timestack->elements[0].value;
+    return timestack_get(timestack, 0)->value;
 }
 
 int32_t
@@ -84,25 +211,20 @@ timestack_oldest(timestack_t *timestack)
     if (idx < 1)
         return 0;
 
-    return timestack->elements[idx-1].value;
+    return timestack_get(timestack, idx-1)->value;
 }
 
 time_t
 timestack_find_latest(timestack_t *timestack, timestack_predicate_t predicate)
 {
-    uint32_t i = 0;
     uint32_t count = timestack->count;
-    timestack_elem_t *elem = timestack->elements;
-
-    if (count < 1)
-        return 0;
 
-    while (i++ < count)
+    for (uint32_t i = 0; i < count; i++)
     {
+        timestack_elem_t *elem = timestack_get(timestack, i);
+
         if (predicate(elem->value))
             return elem->time;
-
-        elem++;
     }
 
     return 0;
@@ -111,15 +233,11 @@ timestack_find_latest(timestack_t *timestack, timestack_predicate_t predicate)
 void
 timestack_dump(timestack_t *timestack, const char* (*writer)(int32_t))
 {
-    uint32_t i = 0;
     uint32_t count = timestack->count;
-    timestack_elem_t *elem = timestack->elements;
-
-    if (count < 1)
-        return;
 
-    while (i++ < count)
+    for (uint32_t i = 0; i < count; i++)
     {
+        timestack_elem_t *elem = timestack_get(timestack, i);
         struct tm *ltime = localtime(&elem->time);
         const char *value = writer(elem->value);
 
@@ -131,8 +249,6 @@ timestack_dump(timestack_t *timestack, const char* (*writer)(int32_t))
                 ltime->tm_min,
                 ltime->tm_sec,
                 value);
-
-        elem++;
     }
 }
 
@@ -25,11 +25,25 @@ typedef struct
     int32_t value;
 } timestack_elem_t;
 
+/**
+ * Ring buffer of timestamped values. Optionally the occurrences of
+ * every value within a sliding time window are counted incrementally
+ * (see timestack_set_window).
+ */
 typedef struct
 {
     uint32_t count;
     uint32_t max;
+    /** index of the newest element */
+    uint32_t head;
     timestack_elem_t *elements;
+    /** length of the counting window in seconds */
+    time_t window;
+    /** number of the newest elements that are inside the window */
+    uint32_t in_window;
+    /** number of counted values (0 to values-1) */
+    uint32_t values;
+    uint32_t *counts;
 } timestack_t;
 
 typedef bool (*timestack_predicate_t)(int32_t value);
@@ -40,9 +54,15 @@ timestack_new(uint32_t max);
 void
 timestack_add(timestack_t *timestack, int32_t value);
 
+void
+timestack_add_at(timestack_t *timestack, time_t now, int32_t value);
+
 void
 timestack_clear(timestack_t *timestack);
 
+timestack_elem_t *
+timestack_get(timestack_t *timestack, uint32_t idx);
+
 int32_t
 timestack_oldest(timestack_t *timestack);
 
@@ -52,6 +72,12 @@ timestack_newest(timestack_t *timestack);
 time_t
 timestack_find_latest(timestack_t *timestack, timestack_predicate_t predicate);
 
+void
+timestack_set_window(timestack_t *timestack, time_t window, uint32_t values);
+
+uint32_t
+timestack_count_within(timestack_t *timestack, int32_t value);
+
 void
 timestack_dump(timestack_t *timestack, const char* (*writer)(int32_t));
 
@@ -0,0 +1,80 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+/*
+ * Static tracepoints (USDT) of the 'nyx' provider, e.g. for bpftrace:
+ *
+ *   bpftrace -e 'usdt:./nyx:nyx:check__done { printf("%s %d\n", str(arg0), arg4); }'
+ *
+ * They are compiled in with 'make USDT=1' only (requires <sys/sdt.h> of
+ * systemtap) - otherwise neither the probes nor their arguments are
+ * evaluated at all. A probe that is not attached costs a single 'nop'.
+ *
+ *   state__enqueue(name, state, is_command, added)
+ *   state__transition(name, pid, from, to)
+ *   state__transition__done(name, pid, to, success, usecs)
+ *   forker__spawn(name, instance, start, pid, error, usecs)
+ *   forker__exit(pid, status, user_ms, system_ms)
+ *   proc__event(pid, type)
+ *   proc__sample(name, pid, cpu_permyriad, memory_kb)
+ *   check__start(name, pid, type)
+ *   check__done(name, pid, type, success, usecs)
+ *   connector__command(command, client)
+ *   connector__command__done(command, client, success, usecs)
+ */
+
+#ifdef USE_USDT
+
+#include "stats.h"
+
+#include <sys/sdt.h>
+
+/* timestamps that are passed to the probes only */
+#define NYX_TRACE_TIME() stats_now()
+
+#define NYX_TRACE2(probe, a, b) \
+    DTRACE_PROBE2(nyx, probe, a, b)
+#define NYX_TRACE3(probe, a, b, c) \
+    DTRACE_PROBE3(nyx, probe, a, b, c)
+#define NYX_TRACE4(probe, a, b, c, d) \
+    DTRACE_PROBE4(nyx, probe, a, b, c, d)
+#define NYX_TRACE5(probe, a, b, c, d, e) \
+    DTRACE_PROBE5(nyx, probe, a, b, c, d, e)
+#define NYX_TRACE6(probe, a, b, c, d, e, f) \
+    DTRACE_PROBE6(nyx, probe, a, b, c, d, e, f)
+
+#else
+
+#define NYX_TRACE_TIME() 0
+
+/* the arguments are referenced without being evaluated so values that
+ * are computed for the probes only do not trigger unused warnings */
+#define NYX_TRACE2(probe, a, b) \
+    do { if (0) { (void)(a); (void)(b); } } while (0)
+#define NYX_TRACE3(probe, a, b, c) \
+    do { if (0) { (void)(a); (void)(b); (void)(c); } } while (0)
+#define NYX_TRACE4(probe, a, b, c, d) \
+    do { if (0) { (void)(a); (void)(b); (void)(c); (void)(d); } } while (0)
+#define NYX_TRACE5(probe, a, b, c, d, e) \
+    do { if (0) { (void)(a); (void)(b); (void)(c); (void)(d); (void)(e); } } while (0)
+#define NYX_TRACE6(probe, a, b, c, d, e, f) \
+    do { if (0) { (void)(a); (void)(b); (void)(c); (void)(d); (void)(e); (void)(f); } } while (0)
+
+#endif
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,294 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_PROC
+
+#include "def.h"
+#include "log.h"
+#include "uring.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(SYS_io_uring_setup) && defined(SYS_io_uring_enter) && defined(SYS_io_uring_register)
+
+static int32_t
+uring_setup(uint32_t entries, struct io_uring_params *params)
+{
+    return syscall(SYS_io_uring_setup, entries, params);
+}
+
+static int32_t
+uring_enter(int32_t fd, uint32_t submit, uint32_t complete, uint32_t flags)
+{
+    return syscall(SYS_io_uring_enter, fd, submit, complete, flags, NULL, 0);
+}
+
+static int32_t
+uring_register(int32_t fd, uint32_t opcode, void *arg, uint32_t args)
+{
+    return syscall(SYS_io_uring_register, fd, opcode, arg, args);
+}
+
+static bool
+map_rings(uring_t *ring, struct io_uring_params *params)
+{
+    ring->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+
+    /* both rings are mapped at once since linux 5.4 */
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+        ring->sq_ring_size = ring->cq_ring_size = MAX(ring->sq_ring_size, ring->cq_ring_size);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        return false;
+    }
+
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+        ring->cq_ring = ring->sq_ring;
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            return false;
+        }
+    }
+
+    ring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        return false;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+
+    ring->sq_tail = (uint32_t *)(sq + params->sq_off.tail);
+    ring->sq_mask = (uint32_t *)(sq + params->sq_off.ring_mask);
+    ring->sq_array = (uint32_t *)(sq + params->sq_off.array);
+
+    ring->cq_head = (uint32_t *)(cq + params->cq_off.head);
+    ring->cq_tail = (uint32_t *)(cq + params->cq_off.tail);
+    ring->cq_mask = (uint32_t *)(cq + params->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+
+    return true;
+}
+
+/* all buffers are registered once so the kernel does not have to map
+ * the user pages of every single read */
+static bool
+register_buffers(uring_t *ring)
+{
+    struct iovec iovecs[URING_BATCH_SIZE];
+
+    for (uint32_t i = 0; i < URING_BATCH_SIZE; i++)
+    {
+        iovecs[i].iov_base = uring_buffer(ring, i);
+        iovecs[i].iov_len = ring->buffer_size;
+    }
+
+    return uring_register(ring->fd, IORING_REGISTER_BUFFERS,
+            iovecs, URING_BATCH_SIZE) == 0;
+}
+
+/**
+ * @brief Create an io_uring instance for batches of up to
+ *        URING_BATCH_SIZE reads
+ * @param buffer_size size of every read's buffer
+ * @return new instance or NULL if io_uring is not available
+ */
+uring_t *
+uring_new(size_t buffer_size)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(struct io_uring_params));
+
+    int32_t fd = uring_setup(URING_BATCH_SIZE, &params);
+
+    if (fd < 0)
+    {
+        log_debug("nyx: io_uring_setup: %s", strerror(errno));
+        return NULL;
+    }
+
+    uring_t *ring = xcalloc1(sizeof(uring_t));
+
+    ring->fd = fd;
+    ring->buffer_size = buffer_size;
+    ring->buffers = xcalloc(URING_BATCH_SIZE, buffer_size);
+
+    if (!map_rings(ring, &params))
+    {
+        log_perror("nyx: mmap");
+        uring_destroy(ring);
+        return NULL;
+    }
+
+    /* the registration is limited by RLIMIT_MEMLOCK on older kernels */
+    if (!register_buffers(ring))
+    {
+        log_debug("nyx: io_uring_register: %s", strerror(errno));
+        uring_destroy(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+/**
+ * @brief Read the given files (at offset 0) into the registered buffers
+ *        with one submission and wait for all reads to complete
+ * @param ring    io_uring instance
+ * @param fds     descriptors to read - the i-th file is read into the
+ *                i-th buffer (of which the last byte is never written)
+ * @param results number of bytes read or negative errno for every file
+ * @param count   number of files (at most URING_BATCH_SIZE)
+ * @return true if all reads completed, false otherwise
+ */
+bool
+uring_read(uring_t *ring, const int32_t *fds, int32_t *results, uint32_t count)
+{
+    if (count > URING_BATCH_SIZE)
+        return false;
+
+    uint32_t tail = *ring->sq_tail;
+    uint32_t mask = *ring->sq_mask;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t idx = (tail + i) & mask;
+        struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+        memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->fd = fds[i];
+        sqe->addr = (uintptr_t)uring_buffer(ring, i);
+        sqe->len = ring->buffer_size - 1;
+        sqe->buf_index = i;
+        sqe->user_data = i;
+
+        ring->sq_array[idx] = idx;
+        results[i] = -ECANCELED;
+    }
+
+    /* the kernel must see the entries before the new tail */
+    __atomic_store_n(ring->sq_tail, tail + count, __ATOMIC_RELEASE);
+
+    uint32_t submit = count;
+    uint32_t completed = 0;
+
+    while (completed < count)
+    {
+        int32_t submitted = uring_enter(ring->fd, submit, count - completed,
+                IORING_ENTER_GETEVENTS);
+
+        if (submitted < 0 && errno != EINTR)
+        {
+            log_perror("nyx: io_uring_enter");
+            break;
+        }
+
+        if (submitted > 0)
+            submit -= MIN((uint32_t)submitted, submit);
+
+        uint32_t head = *ring->cq_head;
+        uint32_t cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != cq_tail)
+        {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+            if (cqe->user_data < count)
+                results[cqe->user_data] = cqe->res;
+
+            head++;
+            completed++;
+        }
+
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return completed == count;
+}
+
+#else
+
+uring_t *
+uring_new(UNUSED size_t buffer_size)
+{
+    return NULL;
+}
+
+bool
+uring_read(UNUSED uring_t *ring, UNUSED const int32_t *fds,
+        UNUSED int32_t *results, UNUSED uint32_t count)
+{
+    return false;
+}
+
+#endif
+
+char *
+uring_buffer(uring_t *ring, uint32_t idx)
+{
+    return ring->buffers + idx * ring->buffer_size;
+}
+
+void
+uring_destroy(uring_t *ring)
+{
+    if (ring == NULL)
+        return;
+
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+
+    if (ring->sq_ring)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+
+    if (ring->fd >= 0)
+        close(ring->fd);
+
+    xfree(ring->buffers);
+    xfree(ring);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,70 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* reads that are submitted with a single io_uring_enter - every read
+ * is done into its own registered buffer */
+#define URING_BATCH_SIZE 256
+
+/**
+ * Minimal io_uring instance (without liburing) for reading many small
+ * files in one submission: every read of a batch targets its own
+ * buffer of a region that is registered with the kernel once.
+ */
+typedef struct
+{
+    int32_t fd;
+
+    /* submission queue */
+    void *sq_ring;
+    size_t sq_ring_size;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    /* completion queue (may share the mapping of the submission queue) */
+    void *cq_ring;
+    size_t cq_ring_size;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /** registered buffers (URING_BATCH_SIZE * buffer_size) */
+    char *buffers;
+    size_t buffer_size;
+} uring_t;
+
+uring_t *
+uring_new(size_t buffer_size);
+
+char *
+uring_buffer(uring_t *ring, uint32_t idx);
+
+bool
+uring_read(uring_t *ring, const int32_t *fds, int32_t *results, uint32_t count);
+
+void
+uring_destroy(uring_t *ring);
+
+/* vim: set et sw=4 sts=4 tw=80: */
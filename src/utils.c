@@ -23,8 +23,11 @@
 
 #include <ctype.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/select.h>
 #include <wordexp.h>
 
@@ -112,6 +115,95 @@ parse_time_unit(const char *input)
     return 0;
 }
 
+/**
+ * @brief Parse a duration into milliseconds - plain numbers are seconds,
+ *        'ms', 's', 'm' and 'h' may be given as units
+ * @param input duration string
+ * @return milliseconds or 0 on invalid input
+ */
+uint32_t
+parse_msecs_unit(const char *input)
+{
+    char unit[3] = {0};
+    int32_t matched = 0;
+    uint32_t value = 0;
+
+    if ((matched = sscanf(input, "%u %2s", &value, unit)) < 1)
+        return 0;
+
+    if (matched == 1 || !strcasecmp(unit, "s"))
+        return value * 1000;
+
+    if (!strcasecmp(unit, "ms"))
+        return value;
+
+    if (!strcasecmp(unit, "m"))
+        return value * 60 * 1000;
+
+    if (!strcasecmp(unit, "h"))
+        return value * 3600 * 1000;
+
+    log_error("Invalid time unit specified: %s", unit);
+    return 0;
+}
+
+static const struct
+{
+    const char *name;
+    int32_t signal;
+} signal_names[] =
+{
+    { "HUP", SIGHUP },
+    { "INT", SIGINT },
+    { "QUIT", SIGQUIT },
+    { "KILL", SIGKILL },
+    { "USR1", SIGUSR1 },
+    { "USR2", SIGUSR2 },
+    { "ALRM", SIGALRM },
+    { "TERM", SIGTERM },
+    { "CONT", SIGCONT },
+    { "STOP", SIGSTOP },
+    { "TSTP", SIGTSTP },
+    { "WINCH", SIGWINCH },
+    { NULL, 0 }
+};
+
+/**
+ * @brief Parse a signal given by its name (with or without the 'SIG'
+ *        prefix) or number
+ * @param input signal string (i.e. 'HUP', 'SIGUSR2' or '1')
+ * @return signal number or -1 on invalid input
+ */
+int32_t
+parse_signal(const char *input)
+{
+    char *end = NULL;
+
+    if (input == NULL || *input == '\0')
+        return -1;
+
+    if (isdigit((unsigned char)*input))
+    {
+        long signal = strtol(input, &end, 10);
+
+        if (*end != '\0' || signal < 1 || signal >= NSIG)
+            return -1;
+
+        return signal;
+    }
+
+    if (!strncasecmp(input, "SIG", 3))
+        input += 3;
+
+    for (int32_t i = 0; signal_names[i].name; i++)
+    {
+        if (!strcasecmp(signal_names[i].name, input))
+            return signal_names[i].signal;
+    }
+
+    return -1;
+}
+
 uint64_t
 parse_size_unit(const char *input)
 {
@@ -190,7 +282,7 @@ wait_interval_fd(int32_t fd, uint32_t seconds)
 }
 
 const char **
-strings_to_null_terminated(list_t *list)
+nyx_strings_to_null_terminated(list_t *list, mem_tag_e tag)
 {
     uint64_t size = list_size(list);
     const char **output = NULL;
@@ -198,7 +290,7 @@ strings_to_null_terminated(list_t *list)
     if (size > 0)
     {
         uint64_t i = 0;
-        output = xcalloc(size + 1, sizeof(char *));
+        output = nyx_calloc(size + 1, sizeof(char *), tag);
 
         list_node_t *node = list->head;
         while (node)
@@ -213,7 +305,7 @@ strings_to_null_terminated(list_t *list)
 }
 
 const char **
-split_string(const char *str, const char *chars)
+nyx_split_string(const char *str, const char *chars, mem_tag_e tag)
 {
     char *string, *token, *to_free;
     const char **output;
@@ -222,29 +314,29 @@ split_string(const char *str, const char *chars)
     if (str == NULL || *str == '\0')
         return NULL;
 
-    string = strdup(str);
+    string = xstrdup(str);
     to_free = string;
     tokens = list_new(NULL);
 
     while ((token = strsep(&string, chars)) != NULL)
     {
         if (!empty_or_whitespace(token))
-            list_add(tokens, strdup(token));
+            list_add(tokens, nyx_strdup(token, tag));
     }
 
-    output = strings_to_null_terminated(tokens);
-    free(to_free);
+    output = nyx_strings_to_null_terminated(tokens, tag);
+    xfree(to_free);
 
     return output;
 }
 
 const char **
-parse_command_string(const char *str)
+nyx_parse_command_string(const char *str, mem_tag_e tag)
 {
     if (str == NULL || *str == '\0')
         return NULL;
 
-    char *string = strdup(str);
+    char *string = xstrdup(str);
     size_t length = strlen(string);
     uint32_t idx = 0;
     char *chr = string, *part = string;
@@ -269,7 +361,7 @@ parse_command_string(const char *str)
             else if (str_delim == '\0')
             {
                 *chr = '\0';
-                list_add(parts, strdup(part));
+                list_add(parts, nyx_strdup(part, tag));
                 part = chr + 1;
             }
 
@@ -297,7 +389,7 @@ parse_command_string(const char *str)
             {
                 *chr = '\0';
                 str_delim = '\0';
-                list_add(parts, strdup(part));
+                list_add(parts, nyx_strdup(part, tag));
                 chr++;
                 part = chr;
                 continue;
@@ -319,9 +411,9 @@ parse_command_string(const char *str)
     }
 
     if (!empty_or_whitespace(part))
-        list_add(parts, strdup(part));
+        list_add(parts, nyx_strdup(part, tag));
 
-    free(string);
+    xfree(string);
 
     if (found_special)
     {
@@ -329,11 +421,11 @@ parse_command_string(const char *str)
                  " YAML's list syntax for more complicated command strings");
     }
 
-    return strings_to_null_terminated(parts);
+    return nyx_strings_to_null_terminated(parts, tag);
 }
 
 static char *
-join_strings(char **parts)
+join_strings(char **parts, mem_tag_e tag)
 {
     char **part = parts;
 
@@ -346,15 +438,15 @@ join_strings(char **parts)
     {
         /* prepend space if necessary */
         if (part != parts)
-            strbuf_append(buffer, " %s", *part);
-        else
-            strbuf_append(buffer, "%s", *part);
+            strbuf_append_char(buffer, ' ');
+
+        strbuf_append_string(buffer, *part);
 
         part++;
     }
 
     char *result = buffer->length > 0
-        ? strdup(buffer->buf)
+        ? nyx_strdup(buffer->buf, tag)
         : NULL;
 
     strbuf_free(buffer);
@@ -362,7 +454,7 @@ join_strings(char **parts)
 }
 
 bool
-substitute_env_string(const char *input, char **output)
+nyx_substitute_env_string(const char *input, char **output, mem_tag_e tag)
 {
     bool success = false;
     wordexp_t subst;
@@ -377,7 +469,7 @@ substitute_env_string(const char *input, char **output)
         // success
         case 0:
             if (subst.we_wordc > 0)
-                *output = join_strings(subst.we_wordv);
+                *output = join_strings(subst.we_wordv, tag);
             wordfree(&subst);
             success = true;
             break;
@@ -421,14 +513,13 @@ count_args(const char **args)
     return count;
 }
 
-const char **
-split_string_whitespace(const char *str)
-{
-    return split_string(str, " \t");
-}
-
+/**
+ * @brief Release a NULL-terminated array of strings (use strings_free)
+ * @param strings array of strings
+ * @param tag     subsystem the array and its strings were allocated for
+ */
 void
-strings_free(char **strings)
+strings_release(char **strings, mem_tag_e tag)
 {
     if (strings == NULL)
         return;
@@ -437,11 +528,74 @@ strings_free(char **strings)
 
     while (*string)
     {
-        free(*string);
+        nyx_free(*string, tag);
         string++;
     }
 
-    free(strings);
+    nyx_free(strings, tag);
+}
+
+/* stack size of the threads created via thread_create (0 for the default) */
+static size_t stack_size = 0;
+
+/**
+ * @brief Set the stack size of the threads that are created afterwards
+ * @param size stack size in bytes (0 for the system's default)
+ */
+void
+thread_set_stack_size(size_t size)
+{
+    if (size > 0 && size < (size_t)PTHREAD_STACK_MIN)
+    {
+        log_warn("Thread stack size of %zu bytes is too small - using %zu bytes",
+                size, (size_t)PTHREAD_STACK_MIN);
+        size = PTHREAD_STACK_MIN;
+    }
+
+    __atomic_store_n(&stack_size, size, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the stack size of the threads created via thread_create
+ */
+size_t
+thread_stack_size(void)
+{
+    size_t size = __atomic_load_n(&stack_size, __ATOMIC_RELAXED);
+    pthread_attr_t attr;
+
+    if (size == 0 && pthread_attr_init(&attr) == 0)
+    {
+        pthread_attr_getstacksize(&attr, &size);
+        pthread_attr_destroy(&attr);
+    }
+
+    return size;
+}
+
+/**
+ * @brief Create a thread with the configured stack size
+ * @return 0 on success, the error number of pthread_create otherwise
+ */
+int32_t
+thread_create(pthread_t *thread, void *(*func)(void *), void *arg)
+{
+    size_t size = __atomic_load_n(&stack_size, __ATOMIC_RELAXED);
+    pthread_attr_t attr;
+
+    if (size == 0)
+        return pthread_create(thread, NULL, func, arg);
+
+    pthread_attr_init(&attr);
+
+    if (pthread_attr_setstacksize(&attr, size) != 0)
+        log_warn("Failed to set the thread stack size to %zu bytes", size);
+
+    int32_t err = pthread_create(thread, &attr, func, arg);
+
+    pthread_attr_destroy(&attr);
+
+    return err;
 }
 
 /* vim: set et sw=4 sts=4 tw=80: */
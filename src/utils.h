@@ -15,15 +15,28 @@
 
 #pragma once
 
+#include "def.h"
 #include "list.h"
 
+#include <pthread.h>
+#include <stddef.h>
 #include <stdint.h>
 
 bool
 empty_or_whitespace(const char *str);
 
+/* the arrays (and strings) are allocated for the subsystem of the
+ * calling file - see strings_free */
+#define strings_to_null_terminated(list) \
+    nyx_strings_to_null_terminated((list), NYX_MEM_TAG)
+#define split_string(str, chars) nyx_split_string((str), (chars), NYX_MEM_TAG)
+#define split_string_whitespace(str) nyx_split_string((str), " \t", NYX_MEM_TAG)
+#define parse_command_string(str) nyx_parse_command_string((str), NYX_MEM_TAG)
+#define substitute_env_string(input, output) \
+    nyx_substitute_env_string((input), (output), NYX_MEM_TAG)
+
 const char **
-strings_to_null_terminated(list_t *list);
+nyx_strings_to_null_terminated(list_t *list, mem_tag_e tag);
 
 char
 get_size_unit(uint64_t kbytes, uint64_t *out_bytes);
@@ -34,23 +47,29 @@ parse_time_unit(const char *input);
 uint64_t
 parse_size_unit(const char *input);
 
-const char **
-split_string(const char *str, const char *chars);
+uint32_t
+parse_msecs_unit(const char *input);
+
+int32_t
+parse_signal(const char *input);
 
 const char **
-split_string_whitespace(const char *str);
+nyx_split_string(const char *str, const char *chars, mem_tag_e tag);
 
 const char **
-parse_command_string(const char *str);
+nyx_parse_command_string(const char *str, mem_tag_e tag);
 
 bool
-substitute_env_string(const char *input, char **output);
+nyx_substitute_env_string(const char *input, char **output, mem_tag_e tag);
 
 uint32_t
 count_args(const char **args);
 
+/* the strings are released from the subsystem of the calling file */
+#define strings_free(strings) strings_release((strings), NYX_MEM_TAG)
+
 void
-strings_free(char **strings);
+strings_release(char **strings, mem_tag_e tag);
 
 void
 wait_interval(uint32_t seconds);
@@ -58,4 +77,13 @@ wait_interval(uint32_t seconds);
 void
 wait_interval_fd(int32_t fd, uint32_t seconds);
 
+void
+thread_set_stack_size(size_t size);
+
+size_t
+thread_stack_size(void);
+
+int32_t
+thread_create(pthread_t *thread, void *(*func)(void *), void *arg);
+
 /* vim: set et sw=4 sts=4 tw=80: */
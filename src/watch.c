@@ -13,16 +13,23 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_CONFIG
+
 #include "def.h"
 #include "fs.h"
 #include "hash.h"
+#include "listen.h"
 #include "log.h"
+#include "pressure.h"
 #include "utils.h"
 #include "watch.h"
 
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 
 bool
@@ -33,6 +40,45 @@ is_all(const char *name)
         strncasecmp(name, "all", 3) == 0;
 }
 
+/**
+ * @brief Determine whether the watch has resource limits which apply
+ *        to the whole process tree of the watched process
+ * @param watch watch to check
+ * @return true if a CPU or memory limit is configured
+ */
+bool
+watch_has_limits(const watch_t *watch)
+{
+    return watch->max_cpu || watch->max_memory;
+}
+
+/**
+ * @brief Determine whether the output files of the watch are rotated
+ *        which requires nyx to capture the process' output
+ * @param watch watch to check
+ * @return true if a maximum size or age of the log files is configured
+ */
+bool
+watch_rotates_output(const watch_t *watch)
+{
+    return (watch->log_file || watch->error_file) &&
+        (watch->log_max_size || watch->log_max_age);
+}
+
+/**
+ * @brief Determine whether the started process of the watch is placed or
+ *        scheduled differently than nyx itself
+ * @param watch watch to check
+ * @return true if any affinity, NUMA, scheduling or rlimit option is set
+ */
+bool
+watch_has_spawn_attributes(const watch_t *watch)
+{
+    return watch->cpu_affinity || watch->numa_node || watch->nice ||
+        watch->sched_policy != SCHED_POLICY_DEFAULT || watch->ionice ||
+        (watch->rlimits && hash_count(watch->rlimits) > 0);
+}
+
 watch_t *
 watch_new(const char *name)
 {
@@ -40,9 +86,6 @@ watch_new(const char *name)
 
     watch->name = name;
 
-    /* default to port 80 for HTTP check */
-    watch->http_check_port = 80;
-
     return watch;
 }
 
@@ -76,28 +119,53 @@ dump_strings(const char *key, const char **values)
     log_info("   ]");
 }
 
-void
-watch_destroy(watch_t *watch)
+static void
+free_strings(watch_t *watch)
 {
     strings_free((char **)watch->start);
     strings_free((char **)watch->stop);
-
-    if (watch->name)       free((void *)watch->name);
-    if (watch->uid)        free((void *)watch->uid);
-    if (watch->gid)        free((void *)watch->gid);
-    if (watch->dir)        free((void *)watch->dir);
-    if (watch->pid_file)   free((void *)watch->pid_file);
-    if (watch->log_file)   free((void *)watch->log_file);
-    if (watch->error_file) free((void *)watch->error_file);
-    if (watch->http_check) free((void *)watch->http_check);
+    strings_free((char **)watch->reload);
+    strings_free((char **)watch->depends_on);
+    strings_free((char **)watch->check_exec);
+    strings_free((char **)watch->listen);
+
+    if (watch->name)       xfree((void *)watch->name);
+    if (watch->uid)        xfree((void *)watch->uid);
+    if (watch->gid)        xfree((void *)watch->gid);
+    if (watch->dir)        xfree((void *)watch->dir);
+    if (watch->pid_file)   xfree((void *)watch->pid_file);
+    if (watch->log_file)   xfree((void *)watch->log_file);
+    if (watch->error_file) xfree((void *)watch->error_file);
+    if (watch->http_check) xfree((void *)watch->http_check);
+    if (watch->plugin_check) xfree((void *)watch->plugin_check);
+    if (watch->plugin_check_argument) xfree((void *)watch->plugin_check_argument);
+    if (watch->memory_pressure) xfree((void *)watch->memory_pressure);
+    if (watch->cpu_affinity) xfree((void *)watch->cpu_affinity);
+    if (watch->numa_node)  xfree((void *)watch->numa_node);
+    if (watch->ionice)     xfree((void *)watch->ionice);
+
+    xfree(watch->http_check_status);
 
     if (watch->port_check)
         endpoint_free(watch->port_check);
+}
+
+void
+watch_destroy(watch_t *watch)
+{
+    /* the strings of sealed watches go with their arena */
+    if (watch->arena)
+        arena_release(watch->arena);
+    else
+        free_strings(watch);
 
     if (watch->env)
         hash_destroy(watch->env);
 
-    free(watch);
+    if (watch->rlimits)
+        hash_destroy(watch->rlimits);
+
+    xfree(watch);
 }
 
 /**
@@ -125,6 +193,12 @@ watch_validate(watch_t *watch)
         result = false;
     }
 
+    if (watch->name && strchr(watch->name, WATCH_INSTANCE_SEPARATOR))
+    {
+        log_error("Watch names must not contain '%c'", WATCH_INSTANCE_SEPARATOR);
+        result = false;
+    }
+
     valid = watch->start != NULL && *watch->start != NULL;
 
     if (!valid)
@@ -231,9 +305,493 @@ watch_validate(watch_t *watch)
         result &= valid;
     }
 
+    if (watch->http_check)
+    {
+        http_url_t url;
+
+        valid = http_url_parse(watch->http_check, &url);
+
+        if (!valid)
+            log_error("Invalid http_check URL '%s'", watch->http_check);
+#ifndef USE_SSL
+        else if (url.tls)
+        {
+            log_error("HTTPS check '%s' requires SSL support (make SSL=1)",
+                    watch->http_check);
+            valid = false;
+        }
+#endif
+
+        result &= valid;
+    }
+
+    if (watch->reload_signal < 0)
+    {
+        log_error("Invalid reload_signal of watch '%s' - expected i.e. 'HUP' or 'USR2'",
+                watch->name);
+        result = false;
+    }
+
+    if (watch->reload && watch->reload[0] == NULL)
+    {
+        log_error("Empty reload command of watch '%s'", watch->name);
+        result = false;
+    }
+
+    if (watch->check_exec && watch->check_exec[0] == NULL)
+    {
+        log_error("Empty check_exec command of watch '%s'", watch->name);
+        result = false;
+    }
+
+#ifndef USE_PLUGINS
+    if (watch->plugin_check)
+    {
+        log_error("Plugin check '%s' requires plugin support (make PLUGINS=1)",
+                watch->plugin_check);
+        result = false;
+    }
+#endif
+
+    if (watch->memory_pressure)
+    {
+#ifndef OSX
+        valid = pressure_trigger_valid(watch->memory_pressure);
+
+        if (!valid)
+        {
+            log_error("Invalid memory_pressure '%s' - expected i.e. 'some 150000 1000000'",
+                    watch->memory_pressure);
+        }
+
+        result &= valid;
+#else
+        log_warn("memory_pressure is not supported on OSX");
+#endif
+    }
+
+#ifdef OSX
+    if (watch->watchdog)
+        log_warn("watchdog is not supported on OSX");
+
+    if (watch->cpu_affinity || watch->numa_node || watch->ionice)
+        log_warn("cpu_affinity, numa_node and ionice are not supported on OSX");
+#endif
+
+    if (watch->listen)
+    {
+        uint32_t count = count_args(watch->listen);
+
+        if (count < 1 || count > LISTEN_MAX_SOCKETS)
+        {
+            log_error("Watch '%s' has to listen on 1 to %u addresses",
+                    watch->name, LISTEN_MAX_SOCKETS);
+            result = false;
+        }
+
+        for (const char **address = watch->listen; *address; address++)
+        {
+            if (!listen_address_valid(*address))
+            {
+                log_error("Invalid listen address '%s' of watch '%s' - expected i.e. "
+                        "'8080', 'localhost:8080' or 'unix:/run/app.sock'",
+                        *address, watch->name);
+                result = false;
+            }
+        }
+    }
+    else if (watch->listen_lazy)
+        log_warn("listen_lazy of watch '%s' has no effect without listen", watch->name);
+
+    if (watch_has_spawn_attributes(watch))
+    {
+        spawnattr_t attr;
+
+        result &= spawnattr_resolve(&attr, watch);
+        spawnattr_free(&attr);
+    }
+
     return result;
 }
 
+static bool
+strings_equal(const char *a, const char *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+
+    return strcmp(a, b) == 0;
+}
+
+static bool
+string_lists_equal(const char **a, const char **b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+
+    while (*a && *b)
+    {
+        if (strcmp(*a++, *b++) != 0)
+            return false;
+    }
+
+    return *a == *b;
+}
+
+static bool
+status_codes_equal(const uint16_t *a, const uint16_t *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+
+    while (*a && *a == *b)
+    {
+        a++;
+        b++;
+    }
+
+    return *a == *b;
+}
+
+static bool
+endpoints_equal(const endpoint_t *a, const endpoint_t *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+
+    return a->port == b->port && strings_equal(a->host, b->host);
+}
+
+static bool
+env_equal(hash_t *a, hash_t *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+
+    if (hash_count(a) != hash_count(b))
+        return false;
+
+    bool equal = true;
+    const char *key = NULL;
+    void *data = NULL;
+    hash_iter_t *iter = hash_iter_start(a);
+
+    while (equal && hash_iter(iter, &key, &data))
+        equal = strings_equal(data, hash_get(b, key));
+
+    hash_iter_free(iter);
+
+    return equal;
+}
+
+/**
+ * @brief Determine whether a running process of the watch has to be
+ *        restarted to apply the other watch's definition, i.e. if the
+ *        way the process is spawned differs
+ * @param watch watch the process was started with
+ * @param other updated watch
+ * @return true if the process has to be restarted
+ */
+bool
+watch_needs_restart(const watch_t *watch, const watch_t *other)
+{
+    return !string_lists_equal(watch->start, other->start) ||
+        !strings_equal(watch->uid, other->uid) ||
+        !strings_equal(watch->gid, other->gid) ||
+        !strings_equal(watch->dir, other->dir) ||
+        !strings_equal(watch->log_file, other->log_file) ||
+        !strings_equal(watch->error_file, other->error_file) ||
+        watch_rotates_output(watch) != watch_rotates_output(other) ||
+        !env_equal(watch->env, other->env) ||
+        watch->notify != other->notify ||
+        watch->watchdog != other->watchdog ||
+        !string_lists_equal(watch->listen, other->listen) ||
+        !strings_equal(watch->cpu_affinity, other->cpu_affinity) ||
+        !strings_equal(watch->numa_node, other->numa_node) ||
+        watch->numa_policy != other->numa_policy ||
+        watch->nice != other->nice ||
+        watch->sched_policy != other->sched_policy ||
+        watch->sched_priority != other->sched_priority ||
+        !strings_equal(watch->ionice, other->ionice) ||
+        !env_equal(watch->rlimits, other->rlimits) ||
+        watch->cgroup_limits != other->cgroup_limits ||
+        (watch->cgroup_limits &&
+         (watch->max_cpu != other->max_cpu || watch->max_memory != other->max_memory));
+}
+
+/**
+ * @brief Compare two watches field by field (ignoring their ID)
+ * @param watch watch to compare
+ * @param other watch to compare with
+ * @return true if both watches are configured identically
+ */
+bool
+watch_equal(const watch_t *watch, const watch_t *other)
+{
+    return strings_equal(watch->name, other->name) &&
+        !watch_needs_restart(watch, other) &&
+        string_lists_equal(watch->stop, other->stop) &&
+        string_lists_equal(watch->reload, other->reload) &&
+        watch->reload_signal == other->reload_signal &&
+        strings_equal(watch->pid_file, other->pid_file) &&
+        watch->log_max_size == other->log_max_size &&
+        watch->log_max_age == other->log_max_age &&
+        watch->log_keep == other->log_keep &&
+        watch->log_compress == other->log_compress &&
+        strings_equal(watch->http_check, other->http_check) &&
+        watch->http_check_port == other->http_check_port &&
+        watch->http_check_method == other->http_check_method &&
+        status_codes_equal(watch->http_check_status, other->http_check_status) &&
+        watch->http_check_keep_alive == other->http_check_keep_alive &&
+        watch->http_check_interval == other->http_check_interval &&
+        strings_equal(watch->plugin_check, other->plugin_check) &&
+        strings_equal(watch->plugin_check_argument, other->plugin_check_argument) &&
+        watch->plugin_check_interval == other->plugin_check_interval &&
+        watch->plugin_check_timeout == other->plugin_check_timeout &&
+        string_lists_equal(watch->check_exec, other->check_exec) &&
+        watch->check_exec_interval == other->check_exec_interval &&
+        watch->check_exec_timeout == other->check_exec_timeout &&
+        endpoints_equal(watch->port_check, other->port_check) &&
+        watch->port_check_owner == other->port_check_owner &&
+        watch->port_check_interval == other->port_check_interval &&
+        watch->check_interval == other->check_interval &&
+        watch->max_check_interval == other->max_check_interval &&
+        watch->start_timeout == other->start_timeout &&
+        watch->stop_timeout == other->stop_timeout &&
+        watch->max_cpu == other->max_cpu &&
+        watch->max_memory == other->max_memory &&
+        strings_equal(watch->memory_pressure, other->memory_pressure) &&
+        watch->startup_delay == other->startup_delay &&
+        string_lists_equal(watch->depends_on, other->depends_on) &&
+        watch->instances == other->instances &&
+        watch->restart_batch == other->restart_batch &&
+        watch->restart_priority == other->restart_priority &&
+        watch->spare == other->spare &&
+        watch->listen_lazy == other->listen_lazy &&
+        watch->flapping_count == other->flapping_count &&
+        watch->flapping_interval == other->flapping_interval &&
+        watch->flapping_delay == other->flapping_delay &&
+        watch->max_flapping_delay == other->max_flapping_delay;
+}
+
+/**
+ * @brief Determine the name of an instance of the given watch
+ * @param watch    watch instance
+ * @param instance index of the instance
+ * @return new string (released via nyx_free as MEM_CONFIG) - the first
+ *         instance is named like the watch itself, all others
+ *         '<name>@<index>'
+ */
+char *
+watch_instance_name(const watch_t *watch, uint32_t instance)
+{
+    if (instance < 1)
+        return xstrdup(watch->name);
+
+    size_t length = strlen(watch->name) + 12;
+    char *name = xcalloc(length, sizeof(char));
+
+    snprintf(name, length, "%s%c%u", watch->name, WATCH_INSTANCE_SEPARATOR, instance);
+
+    return name;
+}
+
+static const char *
+copy_string(const char *str)
+{
+    return str ? xstrdup(str) : NULL;
+}
+
+static const char **
+copy_strings(const char **strings)
+{
+    if (strings == NULL)
+        return NULL;
+
+    uint32_t count = count_args(strings);
+    const char **copy = xcalloc(count + 1, sizeof(char *));
+
+    for (uint32_t idx = 0; idx < count; idx++)
+        copy[idx] = xstrdup(strings[idx]);
+
+    return copy;
+}
+
+static hash_t *
+copy_env(hash_t *env)
+{
+    if (env == NULL)
+        return NULL;
+
+    const char *key = NULL;
+    void *data = NULL;
+    hash_t *copy = hash_new(xfree_data);
+    hash_iter_t *iter = hash_iter_start(env);
+
+    while (hash_iter(iter, &key, &data))
+        hash_add(copy, key, xstrdup(data));
+
+    hash_iter_free(iter);
+
+    return copy;
+}
+
+/**
+ * @brief Create a deep copy of the given watch - sealed watches share
+ *        their arena with the copy
+ * @param watch watch to copy
+ * @return new watch instance
+ */
+watch_t *
+watch_clone(const watch_t *watch)
+{
+    watch_t *copy = xcalloc1(sizeof(watch_t));
+
+    *copy = *watch;
+
+    if (watch->arena)
+    {
+        /* the strings of sealed watches are immutable and shared */
+        arena_retain(watch->arena);
+        copy->env = copy_env(watch->env);
+        copy->rlimits = copy_env(watch->rlimits);
+
+        return copy;
+    }
+
+    copy->name = copy_string(watch->name);
+    copy->uid = copy_string(watch->uid);
+    copy->gid = copy_string(watch->gid);
+    copy->start = copy_strings(watch->start);
+    copy->stop = copy_strings(watch->stop);
+    copy->reload = copy_strings(watch->reload);
+    copy->depends_on = copy_strings(watch->depends_on);
+    copy->dir = copy_string(watch->dir);
+    copy->pid_file = copy_string(watch->pid_file);
+    copy->log_file = copy_string(watch->log_file);
+    copy->error_file = copy_string(watch->error_file);
+    copy->http_check = copy_string(watch->http_check);
+    copy->plugin_check = copy_string(watch->plugin_check);
+    copy->plugin_check_argument = copy_string(watch->plugin_check_argument);
+    copy->check_exec = copy_strings(watch->check_exec);
+    copy->listen = copy_strings(watch->listen);
+    copy->memory_pressure = copy_string(watch->memory_pressure);
+    copy->cpu_affinity = copy_string(watch->cpu_affinity);
+    copy->numa_node = copy_string(watch->numa_node);
+    copy->ionice = copy_string(watch->ionice);
+
+    if (watch->http_check_status)
+    {
+        uint32_t count = 0;
+
+        while (watch->http_check_status[count])
+            count++;
+
+        copy->http_check_status = xcalloc(count + 1, sizeof(uint16_t));
+        memcpy(copy->http_check_status, watch->http_check_status,
+                count * sizeof(uint16_t));
+    }
+
+    if (watch->port_check)
+        copy->port_check = endpoint_new(watch->port_check->port,
+                watch->port_check->host);
+
+    copy->env = copy_env(watch->env);
+    copy->rlimits = copy_env(watch->rlimits);
+
+    return copy;
+}
+
+static const char *
+seal_string(arena_t *arena, const char *str)
+{
+    const char *sealed = arena_strdup(arena, str);
+
+    xfree((void *)str);
+
+    return sealed;
+}
+
+static const char **
+seal_strings(arena_t *arena, const char **strings)
+{
+    if (strings == NULL)
+        return NULL;
+
+    uint32_t count = count_args(strings);
+    const char **sealed = arena_alloc(arena, (count + 1) * sizeof(char *));
+
+    for (uint32_t idx = 0; idx < count; idx++)
+        sealed[idx] = arena_strdup(arena, strings[idx]);
+
+    strings_free((char **)strings);
+
+    return sealed;
+}
+
+/**
+ * @brief Move the strings, argument lists and endpoints of the watch into
+ *        the given arena so they are released at once with the arena
+ *        instead of one by one
+ * @param watch watch to seal (the strings must not be modified afterwards)
+ * @param arena arena of the config generation the watch belongs to
+ */
+void
+watch_seal(watch_t *watch, arena_t *arena)
+{
+    if (watch->arena)
+        return;
+
+    watch->name = seal_string(arena, watch->name);
+    watch->uid = seal_string(arena, watch->uid);
+    watch->gid = seal_string(arena, watch->gid);
+    watch->start = seal_strings(arena, watch->start);
+    watch->stop = seal_strings(arena, watch->stop);
+    watch->reload = seal_strings(arena, watch->reload);
+    watch->depends_on = seal_strings(arena, watch->depends_on);
+    watch->dir = seal_string(arena, watch->dir);
+    watch->pid_file = seal_string(arena, watch->pid_file);
+    watch->log_file = seal_string(arena, watch->log_file);
+    watch->error_file = seal_string(arena, watch->error_file);
+    watch->http_check = seal_string(arena, watch->http_check);
+    watch->plugin_check = seal_string(arena, watch->plugin_check);
+    watch->plugin_check_argument = seal_string(arena, watch->plugin_check_argument);
+    watch->check_exec = seal_strings(arena, watch->check_exec);
+    watch->listen = seal_strings(arena, watch->listen);
+    watch->memory_pressure = seal_string(arena, watch->memory_pressure);
+    watch->cpu_affinity = seal_string(arena, watch->cpu_affinity);
+    watch->numa_node = seal_string(arena, watch->numa_node);
+    watch->ionice = seal_string(arena, watch->ionice);
+
+    if (watch->http_check_status)
+    {
+        uint32_t count = 0;
+
+        while (watch->http_check_status[count])
+            count++;
+
+        uint16_t *codes = arena_alloc(arena, (count + 1) * sizeof(uint16_t));
+
+        memcpy(codes, watch->http_check_status, count * sizeof(uint16_t));
+        xfree(watch->http_check_status);
+
+        watch->http_check_status = codes;
+    }
+
+    if (watch->port_check)
+    {
+        endpoint_t *endpoint = arena_alloc(arena, sizeof(endpoint_t));
+
+        endpoint->port = watch->port_check->port;
+        endpoint->host = arena_strdup(arena, watch->port_check->host);
+
+        endpoint_free(watch->port_check);
+        watch->port_check = endpoint;
+    }
+
+    watch->arena = arena_retain(arena);
+}
+
 void
 watch_dump(watch_t *watch)
 {
@@ -245,6 +803,11 @@ watch_dump(watch_t *watch)
 
     dump_strings("start", watch->start);
     dump_strings("stop", watch->stop);
+    dump_strings("reload", watch->reload);
+
+    if (watch->reload_signal > 0)
+        log_info("  reload_signal: %d", watch->reload_signal);
+    dump_strings("depends_on", watch->depends_on);
 
     dump_not_empty("uid", watch->uid);
     dump_not_empty("gid", watch->gid);
@@ -252,6 +815,19 @@ watch_dump(watch_t *watch)
     dump_not_empty("pid_file", watch->pid_file);
     dump_not_empty("log_file", watch->log_file);
     dump_not_empty("error_file", watch->error_file);
+
+    if (watch->log_max_size)
+        log_info("  log_max_size: %" PRIu64, watch->log_max_size);
+
+    if (watch->log_max_age)
+        log_info("  log_max_age: %u", watch->log_max_age);
+
+    if (watch->log_keep)
+        log_info("  log_keep: %u", watch->log_keep);
+
+    if (watch->log_compress)
+        log_info("  log_compress: true");
+
     dump_not_empty("http_check", watch->http_check);
 
     if (watch->http_check)
@@ -261,6 +837,42 @@ watch_dump(watch_t *watch)
 
         log_info("  http_check_method: %s",
                 http_method_to_string(watch->http_check_method));
+
+        if (watch->http_check_status)
+        {
+            for (uint16_t *code = watch->http_check_status; *code; code++)
+                log_info("  http_check_status: %u", *code);
+        }
+
+        if (watch->http_check_keep_alive)
+            log_info("  http_check_keep_alive: true");
+
+        if (watch->http_check_interval)
+            log_info("  http_check_interval: %u", watch->http_check_interval);
+    }
+
+    dump_not_empty("plugin_check", watch->plugin_check);
+
+    if (watch->plugin_check)
+    {
+        dump_not_empty("plugin_check_argument", watch->plugin_check_argument);
+
+        if (watch->plugin_check_interval)
+            log_info("  plugin_check_interval: %u", watch->plugin_check_interval);
+
+        if (watch->plugin_check_timeout)
+            log_info("  plugin_check_timeout: %u", watch->plugin_check_timeout);
+    }
+
+    dump_strings("check_exec", watch->check_exec);
+
+    if (watch->check_exec)
+    {
+        if (watch->check_exec_interval)
+            log_info("  check_exec_interval: %u", watch->check_exec_interval);
+
+        if (watch->check_exec_timeout)
+            log_info("  check_exec_timeout: %u", watch->check_exec_timeout);
     }
 
     if (watch->max_memory)
@@ -269,9 +881,65 @@ watch_dump(watch_t *watch)
     if (watch->max_cpu)
         log_info("  max_cpu: %u%%", watch->max_cpu);
 
+    if (watch->cgroup_limits)
+        log_info("  cgroup_limits: true");
+
+    if (watch->memory_pressure)
+        log_info("  memory_pressure: %s", watch->memory_pressure);
+
+    dump_not_empty("cpu_affinity", watch->cpu_affinity);
+
+    if (watch->numa_node)
+    {
+        log_info("  numa_node: %s (%s)", watch->numa_node,
+                numa_policy_to_string(watch->numa_policy));
+    }
+
+    if (watch->nice)
+        log_info("  nice: %d", watch->nice);
+
+    if (watch->sched_policy != SCHED_POLICY_DEFAULT)
+    {
+        log_info("  sched_policy: %s", sched_policy_to_string(watch->sched_policy));
+
+        if (watch->sched_priority)
+            log_info("  sched_priority: %u", watch->sched_priority);
+    }
+
+    dump_not_empty("ionice", watch->ionice);
+
+    if (watch->start_timeout)
+        log_info("  start_timeout: %u", watch->start_timeout);
+
     if (watch->stop_timeout)
         log_info("  stop_timeout: %u", watch->stop_timeout);
 
+    if (watch->notify)
+        log_info("  notify: true");
+
+    if (watch->watchdog)
+        log_info("  watchdog: %ums", watch->watchdog);
+
+    dump_strings("listen", watch->listen);
+
+    if (watch->listen_lazy)
+        log_info("  listen_lazy: true");
+
+    if (watch->spare)
+        log_info("  spare: true");
+
+    if (watch->flapping_count)
+        log_info("  flapping_count: %u", watch->flapping_count);
+
+    if (watch->flapping_interval)
+        log_info("  flapping_interval: %u", watch->flapping_interval);
+
+    if (watch->flapping_delay)
+        log_info("  flapping_delay: %u", watch->flapping_delay);
+
+    if (watch->max_flapping_delay)
+        log_info("  max_flapping_delay: %u", watch->max_flapping_delay);
+
     if (watch->port_check)
     {
         if (watch->port_check->host)
@@ -283,10 +951,31 @@ watch_dump(watch_t *watch)
         {
             log_info("  port_check: %u", watch->port_check->port);
         }
+
+        if (watch->port_check_owner)
+            log_info("  port_check_owner: true");
+
+        if (watch->port_check_interval)
+            log_info("  port_check_interval: %u", watch->port_check_interval);
     }
 
     log_info("  startup_delay: %u", watch->startup_delay);
 
+    if (watch->instances > 1)
+    {
+        log_info("  instances: %u", watch->instances);
+        log_info("  restart_batch: %u", watch->restart_batch);
+    }
+
+    if (watch->restart_priority)
+        log_info("  restart_priority: %d", watch->restart_priority);
+
+    if (watch->check_interval)
+        log_info("  check_interval: %u", watch->check_interval);
+
+    if (watch->max_check_interval)
+        log_info("  max_check_interval: %u", watch->max_check_interval);
+
     if (watch->env)
     {
         log_info("  env: [");
@@ -301,7 +990,24 @@ watch_dump(watch_t *watch)
         }
 
         log_info("   ]");
-        free(iter);
+        hash_iter_free(iter);
+    }
+
+    if (watch->rlimits)
+    {
+        log_info("  rlimits: [");
+
+        const char *key = NULL;
+        void *data = NULL;
+        hash_iter_t *iter = hash_iter_start(watch->rlimits);
+
+        while (hash_iter(iter, &key, &data))
+        {
+            log_info("   %s: %s", key, (char *)data);
+        }
+
+        log_info("   ]");
+        hash_iter_free(iter);
     }
 }
 
@@ -15,8 +15,10 @@
 
 #pragma once
 
+#include "arena.h"
 #include "hash.h"
 #include "socket.h"
+#include "spawnattr.h"
 
 typedef struct watch_t
 {
@@ -26,27 +28,114 @@ typedef struct watch_t
     const char *gid;
     const char **start;
     const char **stop;
+    /** command run by the forker to reload the process in place */
+    const char **reload;
+    /** signal sent to reload the process in place (0 if not configured) */
+    int32_t reload_signal;
     const char *dir;
     const char *pid_file;
     const char *log_file;
     const char *error_file;
+    /* rotation of the captured log_file/error_file (0 meaning never) */
+    uint64_t log_max_size;
+    uint32_t log_max_age;
+    /** number of rotated segments that are kept (0 meaning the default) */
+    uint32_t log_keep;
+    bool log_compress;
     const char *http_check;
     uint32_t http_check_port;
     http_method_e http_check_method;
+    uint16_t *http_check_status;
+    bool http_check_keep_alive;
+    uint32_t http_check_interval;
+    /** name of a check registered by a plugin */
+    const char *plugin_check;
+    /** argument passed to the plugin check */
+    const char *plugin_check_argument;
+    uint32_t plugin_check_interval;
+    /** deadline of the plugin check in seconds (0 meaning the default) */
+    uint32_t plugin_check_timeout;
+    /** command run by the forker - healthy if it exits with 0 */
+    const char **check_exec;
+    uint32_t check_exec_interval;
+    /** deadline of the check command in seconds (0 meaning the default) */
+    uint32_t check_exec_timeout;
     endpoint_t *port_check;
+    bool port_check_owner;
+    uint32_t port_check_interval;
+    uint32_t check_interval;
+    uint32_t max_check_interval;
+    uint32_t start_timeout;
     uint32_t stop_timeout;
     uint32_t max_cpu;
     uint64_t max_memory;
+    bool cgroup_limits;
+    const char *memory_pressure;
     uint32_t startup_delay;
+    bool notify;
+    /** heartbeat deadline (in milliseconds, 0 if disabled) */
+    uint32_t watchdog;
+    /** addresses of the sockets passed to the started process */
+    const char **listen;
+    /** defer the first start until a connection arrives */
+    bool listen_lazy;
+    /** names of the watches that have to be running before */
+    const char **depends_on;
+    /** number of processes that are run of this watch */
+    uint32_t instances;
+    /** number of instances that are restarted at once */
+    uint32_t restart_batch;
+    /** restarts of higher priority are admitted first by the restart limiter */
+    int32_t restart_priority;
+    /** keep a started standby process that takes over on exit */
+    bool spare;
+    /* flapping detection and backoff (0 meaning the default) */
+    uint32_t flapping_count;
+    uint32_t flapping_interval;
+    uint32_t flapping_delay;
+    uint32_t max_flapping_delay;
+    /* placement and scheduling of the started process */
+    const char *cpu_affinity;
+    const char *numa_node;
+    numa_policy_e numa_policy;
+    /** niceness (0 meaning unchanged) */
+    int32_t nice;
+    sched_policy_e sched_policy;
+    uint32_t sched_priority;
+    const char *ionice;
+    /** resource limits by name (i.e. 'nofile') */
+    hash_t *rlimits;
     hash_t *env;
+    /** arena holding the strings of the watch (NULL if they are
+     * allocated individually) */
+    arena_t *arena;
 } watch_t;
 
+/* separator of the watch name and the index of an instance */
+#define WATCH_INSTANCE_SEPARATOR '@'
+
+
 bool
 is_all(const char* name);
 
+bool
+watch_has_limits(const watch_t *watch);
+
+bool
+watch_rotates_output(const watch_t *watch);
+
+bool
+watch_has_spawn_attributes(const watch_t *watch);
+
 watch_t *
 watch_new(const char *name);
 
+watch_t *
+watch_clone(const watch_t *watch);
+
+void
+watch_seal(watch_t *watch, arena_t *arena);
+
 void
 watch_dump(watch_t *watch);
 
@@ -59,4 +148,13 @@ _watch_destroy(void *watch);
 bool
 watch_validate(watch_t *watch);
 
+bool
+watch_needs_restart(const watch_t *watch, const watch_t *other);
+
+bool
+watch_equal(const watch_t *watch, const watch_t *other);
+
+char *
+watch_instance_name(const watch_t *watch, uint32_t instance);
+
 /* vim: set et sw=4 sts=4 tw=80: */
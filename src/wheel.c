@@ -0,0 +1,233 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "def.h"
+#include "wheel.h"
+
+#include <time.h>
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+/* maximum number of ticks a timer can be scheduled ahead */
+#define WHEEL_MAX_TICKS ((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+static uint64_t
+monotonic_msecs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Create a new timer wheel starting at the current time
+ * @param resolution milliseconds per tick
+ * @return new wheel instance
+ */
+wheel_t *
+wheel_new(uint32_t resolution)
+{
+    wheel_t *wheel = xcalloc1(sizeof(wheel_t));
+
+    wheel->resolution = MAX(resolution, 1);
+    wheel->start = monotonic_msecs();
+
+    return wheel;
+}
+
+void
+wheel_timer_init(wheel_timer_t *timer, wheel_handler_t handler, void *data)
+{
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->list = NULL;
+    timer->expires = 0;
+    timer->handler = handler;
+    timer->data = data;
+}
+
+static void
+link_timer(wheel_timer_t **list, wheel_timer_t *timer)
+{
+    timer->list = list;
+    timer->prev = NULL;
+    timer->next = *list;
+
+    if (*list)
+        (*list)->prev = timer;
+
+    *list = timer;
+}
+
+/* insert the timer into the level its expiry falls into */
+static void
+insert_timer(wheel_t *wheel, wheel_timer_t *timer)
+{
+    uint64_t delta = timer->expires - wheel->now;
+
+    for (uint32_t level = 0; level < WHEEL_LEVELS; level++)
+    {
+        uint32_t shift = level * WHEEL_BITS;
+
+        if (delta < (1ULL << (shift + WHEEL_BITS)) || level == WHEEL_LEVELS - 1)
+        {
+            uint32_t idx = (timer->expires >> shift) & WHEEL_MASK;
+            link_timer(&wheel->slots[level][idx], timer);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Schedule (or reschedule) the given timer
+ * @param wheel wheel instance
+ * @param timer timer to schedule
+ * @param msecs milliseconds from now the timer should expire in
+ *              (rounded to the wheel's resolution, at least one tick)
+ */
+void
+wheel_add(wheel_t *wheel, wheel_timer_t *timer, uint64_t msecs)
+{
+    uint64_t ticks = MAX((msecs + wheel->resolution / 2) / wheel->resolution, 1);
+
+    wheel_remove(timer);
+
+    timer->expires = wheel->now + MIN(ticks, WHEEL_MAX_TICKS);
+
+    insert_timer(wheel, timer);
+}
+
+/**
+ * @brief Remove the given timer from its wheel (if scheduled)
+ * @param timer timer to remove
+ */
+void
+wheel_remove(wheel_timer_t *timer)
+{
+    if (timer->list == NULL)
+        return;
+
+    if (timer->prev)
+        timer->prev->next = timer->next;
+    else
+        *timer->list = timer->next;
+
+    if (timer->next)
+        timer->next->prev = timer->prev;
+
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->list = NULL;
+}
+
+bool
+wheel_pending(wheel_timer_t *timer)
+{
+    return timer->list != NULL;
+}
+
+/* re-insert all timers of the given slot into the lower levels */
+static void
+cascade(wheel_t *wheel, uint32_t level)
+{
+    uint32_t idx = (wheel->now >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    wheel_timer_t *timer = wheel->slots[level][idx];
+
+    wheel->slots[level][idx] = NULL;
+
+    while (timer)
+    {
+        wheel_timer_t *next = timer->next;
+
+        insert_timer(wheel, timer);
+        timer = next;
+    }
+}
+
+/**
+ * @brief Process the next tick of the wheel and invoke the handlers
+ *        of all timers expiring in it
+ * @param wheel wheel instance
+ */
+void
+wheel_tick(wheel_t *wheel)
+{
+    wheel->now++;
+
+    /* cascade the higher levels whenever a lower level wraps around */
+    for (uint32_t level = 1; level < WHEEL_LEVELS; level++)
+    {
+        if ((wheel->now >> ((level - 1) * WHEEL_BITS)) & WHEEL_MASK)
+            break;
+
+        cascade(wheel, level);
+    }
+
+    uint32_t idx = wheel->now & WHEEL_MASK;
+
+    /* move the expired timers into a separate list so handlers
+     * may reschedule or remove any timer safely */
+    wheel->expired = wheel->slots[0][idx];
+    wheel->slots[0][idx] = NULL;
+
+    for (wheel_timer_t *timer = wheel->expired; timer; timer = timer->next)
+        timer->list = &wheel->expired;
+
+    while (wheel->expired)
+    {
+        wheel_timer_t *timer = wheel->expired;
+
+        wheel_remove(timer);
+        timer->handler(timer, timer->data);
+    }
+}
+
+/**
+ * @brief Process all ticks up to the current time
+ * @param wheel wheel instance
+ */
+void
+wheel_advance(wheel_t *wheel)
+{
+    uint64_t target = (monotonic_msecs() - wheel->start) / wheel->resolution;
+
+    while (wheel->now < target)
+        wheel_tick(wheel);
+}
+
+void
+wheel_destroy(wheel_t *wheel)
+{
+    if (wheel == NULL)
+        return;
+
+    /* detach all remaining timers - they are owned by their users */
+    for (uint32_t level = 0; level < WHEEL_LEVELS; level++)
+    {
+        for (uint32_t idx = 0; idx < WHEEL_SLOTS; idx++)
+        {
+            while (wheel->slots[level][idx])
+                wheel_remove(wheel->slots[level][idx]);
+        }
+    }
+
+    xfree(wheel);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
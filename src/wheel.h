@@ -0,0 +1,89 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 3
+
+typedef struct wheel_timer_t wheel_timer_t;
+
+typedef void (*wheel_handler_t)(wheel_timer_t *timer, void *data);
+
+/**
+ * Timer embedded into its owner. A timer is linked into at most one
+ * slot of the wheel and may be rescheduled from its own handler.
+ */
+struct wheel_timer_t
+{
+    wheel_timer_t *prev;
+    wheel_timer_t *next;
+    /** list the timer is linked into (NULL if not scheduled) */
+    wheel_timer_t **list;
+    /** absolute tick the timer expires at */
+    uint64_t expires;
+    wheel_handler_t handler;
+    void *data;
+};
+
+/**
+ * Hierarchical timer wheel: the first level holds the timers of the
+ * next WHEEL_SLOTS ticks, each further level covers WHEEL_SLOTS times
+ * the range of the previous one. Timers are cascaded down one level
+ * whenever the lower level wraps around so scheduling, removal and
+ * expiry are O(1) regardless of the number of timers.
+ */
+typedef struct
+{
+    /** tick that was processed last */
+    uint64_t now;
+    /** milliseconds per tick */
+    uint32_t resolution;
+    /** monotonic time (in milliseconds) of tick 0 */
+    uint64_t start;
+    wheel_timer_t *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    /** timers of the tick that is being processed */
+    wheel_timer_t *expired;
+} wheel_t;
+
+wheel_t *
+wheel_new(uint32_t resolution);
+
+void
+wheel_timer_init(wheel_timer_t *timer, wheel_handler_t handler, void *data);
+
+void
+wheel_add(wheel_t *wheel, wheel_timer_t *timer, uint64_t msecs);
+
+void
+wheel_remove(wheel_timer_t *timer);
+
+bool
+wheel_pending(wheel_timer_t *timer);
+
+void
+wheel_tick(wheel_t *wheel);
+
+void
+wheel_advance(wheel_t *wheel);
+
+void
+wheel_destroy(wheel_t *wheel);
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,208 @@
+#!/bin/bash
+
+# End-to-end scale benchmark of the nyx daemon
+#
+# For every number of watches (default: 10 100 1000 5000) and both process
+# monitoring modes (netlink process events and polling) a local daemon is
+# started on a generated config of trivial sleepers and the following is
+# measured:
+#
+#  - startup:   time until all watches are running
+#  - restart:   time until all watches are running again after 'restart all'
+#  - exit:      latency of the exit detection (kill -> journal entry) averaged
+#               over a sample of watches
+#  - status:    throughput of 'status all' requests over one session
+#  - idle:      RSS, number of threads and CPU usage of the idle daemon
+#
+# Usage: run-scale.sh [N...]
+#
+# Environment:
+#   SCALE_MODES    modes to measure (default: "events poll")
+#   SCALE_RESULTS  file the results are appended to as tab separated values
+#                  (scale, mode, watches, metric, value, unit)
+#   SCALE_TIMEOUT  seconds to wait for the watches to be running (default: 300)
+#   SCALE_IDLE     seconds the idle CPU usage is measured (default: 10)
+
+cd "$(dirname $0)"
+
+source ./common.sh
+
+NYX_BIN="$(pwd)/../../nyx"
+SIZES=${@:-10 100 1000 5000}
+MODES=${SCALE_MODES:-events poll}
+TIMEOUT=${SCALE_TIMEOUT:-300}
+IDLE=${SCALE_IDLE:-10}
+EXIT_SAMPLES=10
+STATUS_REQUESTS=50
+
+[ -x "$NYX_BIN" ] || die "nyx binary not found - run 'make' first"
+
+WORKDIR=$(mktemp -d /tmp/nyx-scale-XXXXXX) || die "failed to create a working directory"
+
+function cleanup() {
+    [ -n "$DAEMON" ] && kill $DAEMON 2>/dev/null
+    [ -n "$PIDS" ] && kill $PIDS 2>/dev/null
+    rm -rf "$WORKDIR"
+}
+
+trap cleanup EXIT
+
+function nyx_local() {
+    (cd "$WORKDIR" && "$NYX_BIN" -q --local "$@")
+}
+
+function now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+function report() {
+    printf "%-6s %6s  %-16s %12s %s\n" "$1" "$2" "$3" "$4" "$5"
+
+    if [ -n "$SCALE_RESULTS" ]; then
+        printf "scale\t%s\t%s\t%s\t%s\t%s\n" "$1" "$2" "$3" "$4" "$5" >> "$SCALE_RESULTS"
+    fi
+}
+
+function generate_config() {
+    local config="$WORKDIR/nyx.yaml"
+
+    {
+        echo "nyx:"
+        echo "  polling_interval: 5"
+        echo "watches:"
+
+        for i in `seq 1 $1`; do
+            echo "  w$i:"
+            echo "    start: sleep 86400"
+        done
+    } > "$config"
+}
+
+function running_pids() {
+    nyx_local status all | sed -n 's/.*: running (PID \([0-9]*\)).*/\1/p'
+}
+
+# wait until the given number of watches are running (with other PIDs than
+# the ones given as second argument)
+function wait_running() {
+    local deadline=$(( $(date +%s) + TIMEOUT ))
+
+    while [ $(date +%s) -lt $deadline ]; do
+        local pids=$(running_pids)
+
+        if [ $(echo "$pids" | grep -c .) -ge $1 ]; then
+            [ -z "$2" ] && return 0
+            [ -z "$(comm -12 <(echo "$pids" | sort) <(echo "$2" | sort))" ] && return 0
+        fi
+
+        sleep 0.1
+    done
+
+    return 1
+}
+
+# time of the first journal entry of the watch reporting its exit
+function exit_detected_ms() {
+    local line=$(nyx_local journal $1 | grep -E "terminated|exited|-> stopped" | tail -n 1)
+    local timestamp=${line%% *}
+
+    [ -n "$timestamp" ] || return 1
+
+    echo $(( $(date -d "$timestamp" +%s%N) / 1000000 ))
+}
+
+function cpu_ticks() {
+    awk '{ print $14 + $15 }' /proc/$1/stat
+}
+
+function measure() {
+    local watches=$1 mode=$2 flags=""
+
+    [ "$mode" == "poll" ] && flags="--poll"
+
+    generate_config $watches
+    rm -rf "$WORKDIR/.nyx"
+
+    local started=$(now_ms)
+
+    (cd "$WORKDIR" && exec "$NYX_BIN" -q -D --local $flags -c nyx.yaml >/dev/null 2>&1) &
+    DAEMON=$!
+
+    wait_running $watches || die "$watches watches did not start within $TIMEOUT seconds"
+    report $mode $watches startup $(( $(now_ms) - started )) ms
+
+    PIDS=$(running_pids)
+
+    # restart all watches
+    started=$(now_ms)
+    nyx_local restart all >/dev/null
+    wait_running $watches "$PIDS" || die "$watches watches did not restart within $TIMEOUT seconds"
+    report $mode $watches restart $(( $(now_ms) - started )) ms
+
+    PIDS=$(running_pids)
+
+    # exit detection of a sample of the watches
+    local total=0 samples=0
+
+    for i in `seq 1 $(( watches < EXIT_SAMPLES ? watches : EXIT_SAMPLES ))`; do
+        local watch=w$(( (i - 1) * watches / EXIT_SAMPLES + 1 ))
+        local pid=$(nyx_local status $watch | sed -n 's/.*(PID \([0-9]*\)).*/\1/p')
+
+        [ -n "$pid" ] || continue
+
+        local killed=$(now_ms)
+        kill -9 $pid
+
+        for attempt in `seq 1 100`; do
+            local detected=$(exit_detected_ms $watch)
+
+            if [ -n "$detected" ] && [ $detected -ge $killed ]; then
+                total=$(( total + detected - killed ))
+                samples=$(( samples + 1 ))
+                break
+            fi
+
+            sleep 0.1
+        done
+    done
+
+    [ $samples -gt 0 ] && report $mode $watches exit $(( total / samples )) ms
+
+    wait_running $watches
+    PIDS=$(running_pids)
+
+    # status requests over one session
+    started=$(now_ms)
+    yes "status all" | head -n $STATUS_REQUESTS | nyx_local batch >/dev/null
+    local elapsed=$(( $(now_ms) - started ))
+    report $mode $watches status $(( STATUS_REQUESTS * 1000 / (elapsed > 0 ? elapsed : 1) )) req/s
+
+    # resource usage while idle
+    local ticks=$(cpu_ticks $DAEMON)
+    sleep $IDLE
+    ticks=$(( $(cpu_ticks $DAEMON) - ticks ))
+
+    report $mode $watches rss $(awk '/VmRSS/ { print $2 }' /proc/$DAEMON/status) kB
+    report $mode $watches threads $(awk '/Threads/ { print $2 }' /proc/$DAEMON/status)
+    report $mode $watches cpu $(awk -v t=$ticks -v hz=$(getconf CLK_TCK) -v s=$IDLE \
+        'BEGIN { printf "%.2f", t * 100 / hz / s }') %
+
+    nyx_local quit >/dev/null
+    wait $DAEMON 2>/dev/null
+    DAEMON=""
+
+    kill $PIDS 2>/dev/null
+    PIDS=""
+}
+
+log "SCALE BENCHMARK"
+
+printf "%-6s %6s  %-16s %12s %s\n" mode N metric value unit
+
+for watches in $SIZES; do
+    for mode in $MODES; do
+        measure $watches $mode
+    done
+done
+
+# vim: set et sw=4 sts=4 tw=80:
@@ -0,0 +1,94 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_arena.h"
+#include "../src/arena.h"
+#include "../src/socket.h"
+#include "../src/utils.h"
+#include "../src/watch.h"
+
+#include <string.h>
+
+void
+test_arena_alloc(UNUSED void **state)
+{
+    arena_t *arena = arena_new();
+    char *strings[1000];
+
+    for (int idx = 0; idx < 1000; idx++)
+    {
+        char buffer[32];
+
+        snprintf(buffer, sizeof(buffer), "string-%d", idx);
+        strings[idx] = arena_strdup(arena, buffer);
+    }
+
+    /* larger than a chunk */
+    char *large = arena_alloc(arena, ARENA_CHUNK_SIZE * 2);
+
+    memset(large, 'x', ARENA_CHUNK_SIZE * 2);
+
+    for (int idx = 0; idx < 1000; idx++)
+    {
+        char buffer[32];
+
+        snprintf(buffer, sizeof(buffer), "string-%d", idx);
+        assert_string_equal(buffer, strings[idx]);
+        assert_int_equal(0, (uintptr_t)strings[idx] % sizeof(long double));
+    }
+
+    assert_null(arena_strdup(arena, NULL));
+
+    arena_release(arena);
+}
+
+void
+test_arena_seal_watch(UNUSED void **state)
+{
+    arena_t *arena = arena_new();
+    watch_t *watch = watch_new(strdup("app"));
+
+    watch->start = (const char **)split_string("/usr/bin/app --port 8080", " ");
+    watch->dir = strdup("/tmp");
+    watch->port_check = parse_endpoint("localhost:8080");
+
+    watch_seal(watch, arena);
+
+    /* the watches keep the arena alive */
+    arena_release(arena);
+
+    watch_t *copy = watch_clone(watch);
+
+    assert_ptr_equal(watch->arena, copy->arena);
+    assert_ptr_equal(watch->start, copy->start);
+
+    watch_destroy(watch);
+
+    assert_string_equal("app", copy->name);
+    assert_string_equal("/usr/bin/app", copy->start[0]);
+    assert_string_equal("8080", copy->start[2]);
+    assert_null(copy->start[3]);
+    assert_string_equal("/tmp", copy->dir);
+    assert_string_equal("localhost", copy->port_check->host);
+    assert_int_equal(8080, copy->port_check->port);
+
+    watch_destroy(copy);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
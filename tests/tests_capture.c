@@ -0,0 +1,122 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_capture.h"
+#include "../src/capture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static off_t
+file_size(const char *dir, const char *name)
+{
+    struct stat st;
+    char *path = NULL;
+
+    assert_true(asprintf(&path, "%s/%s", dir, name) > 0);
+
+    off_t size = stat(path, &st) == 0 ? st.st_size : -1;
+
+    free(path);
+
+    return size;
+}
+
+static void
+write_lines(capture_t *capture, int32_t fd, uint32_t count)
+{
+    const char line[] = "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopq\n";
+
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        assert_int_equal(sizeof(line) - 1, write(fd, line, sizeof(line) - 1));
+
+        /* move every line on its own */
+        struct pollfd fds[1];
+
+        assert_int_equal(1, capture_poll_fds(capture, fds));
+
+        fds[0].revents = POLLIN;
+        capture_process(capture, fds, 1);
+    }
+}
+
+void
+test_capture_rotate(UNUSED void **state)
+{
+    char dir[] = "/tmp/nyx-capture-XXXXXX";
+    char *path = NULL;
+
+    assert_non_null(mkdtemp(dir));
+    assert_true(asprintf(&path, "%s/out.log", dir) > 0);
+
+    watch_t *watch = watch_new(strdup("app"));
+
+    watch->log_file = strdup(path);
+    watch->log_max_size = 1;
+    watch->log_keep = 2;
+
+    capture_t *capture = capture_new();
+
+    int32_t fd = capture_open(capture, watch, path, -1);
+    assert_true(fd >= 0);
+    assert_int_equal(1, capture_count(capture));
+
+    write_lines(capture, fd, 15);
+    assert_int_equal(960, file_size(dir, "out.log"));
+    assert_int_equal(-1, file_size(dir, "out.log.1"));
+
+    /* the file is rotated as soon as it reached its maximum size */
+    write_lines(capture, fd, 2);
+    assert_int_equal(64, file_size(dir, "out.log"));
+    assert_int_equal(1024, file_size(dir, "out.log.1"));
+
+    /* only 'log_keep' segments are kept */
+    write_lines(capture, fd, 48);
+    assert_int_equal(64, file_size(dir, "out.log"));
+    assert_int_equal(1024, file_size(dir, "out.log.1"));
+    assert_int_equal(1024, file_size(dir, "out.log.2"));
+    assert_int_equal(-1, file_size(dir, "out.log.3"));
+
+    /* the pipe is released as soon as the process closed its end */
+    close(fd);
+
+    struct pollfd fds[1];
+    assert_int_equal(1, capture_poll_fds(capture, fds));
+
+    fds[0].revents = POLLHUP;
+    capture_process(capture, fds, 1);
+
+    assert_int_equal(0, capture_count(capture));
+
+    capture_destroy(capture);
+    watch_destroy(watch);
+
+    char *command = NULL;
+    assert_true(asprintf(&command, "rm -rf %s", dir) > 0);
+    assert_int_equal(0, system(command));
+
+    free(command);
+    free(path);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,89 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_cgroup.h"
+#include "../src/cgroup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifndef OSX
+static void
+write_test_file(const char *dir, const char *file, const char *content)
+{
+    char path[256] = {0};
+
+    snprintf(path, sizeof(path)-1, "%s/%s", dir, file);
+
+    FILE *fp = fopen(path, "w");
+    assert_non_null(fp);
+
+    fputs(content, fp);
+    fclose(fp);
+}
+#endif
+
+void
+test_cgroup_watch_path(UNUSED void **state)
+{
+#ifndef OSX
+    char *path = cgroup_watch_path("nyx.slice", "app");
+    assert_string_equal("/sys/fs/cgroup/nyx.slice/app", path);
+    free(path);
+
+    path = cgroup_watch_path("/tmp/cgroup", "app");
+    assert_string_equal("/tmp/cgroup/app", path);
+    free(path);
+
+    /* the root cgroup contains no watch */
+    assert_false(cgroup_contains("/sys/fs/cgroup/nyx.slice/app", getpid()));
+#endif
+}
+
+void
+test_cgroup_read_stats(UNUSED void **state)
+{
+#ifndef OSX
+    char dir[] = "/tmp/nyx-cgroup-XXXXXX";
+    cgroup_stats_t stats;
+
+    assert_non_null(mkdtemp(dir));
+
+    /* files are missing */
+    assert_false(cgroup_read_stats(dir, &stats));
+
+    write_test_file(dir, "memory.current", "4194304\n");
+    write_test_file(dir, "cpu.stat",
+            "usage_usec 123456\nuser_usec 100000\nsystem_usec 23456\n");
+    write_test_file(dir, "memory.events",
+            "low 0\nhigh 0\nmax 4\noom 2\noom_kill 1\n");
+
+    assert_true(cgroup_read_stats(dir, &stats));
+    assert_int_equal(4096, stats.memory);
+    assert_int_equal(123456, stats.usage_usec);
+    assert_int_equal(1, stats.oom_kills);
+
+    char *command = NULL;
+    assert_true(asprintf(&command, "rm -rf %s", dir) > 0);
+    assert_int_equal(0, system(command));
+    free(command);
+#endif
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,236 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_check.h"
+#include "../src/check.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int32_t
+listen_local(uint16_t *port)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    int32_t sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert_true(sock >= 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    assert_int_equal(0, bind(sock, (struct sockaddr *)&addr, sizeof(addr)));
+    assert_int_equal(0, listen(sock, 4));
+    assert_int_equal(0, getsockname(sock, (struct sockaddr *)&addr, &len));
+
+    *port = ntohs(addr.sin_port);
+
+    return sock;
+}
+
+static void
+store_and_stop(check_t *check, bool success, void *data)
+{
+    int32_t *result = data;
+
+    *result = success;
+
+    reactor_stop(check->reactor);
+}
+
+static int32_t
+run_port_check(uint16_t port)
+{
+    int32_t result = -1;
+    reactor_t *reactor = reactor_new();
+
+    assert_non_null(reactor);
+    assert_non_null(check_port_start(reactor, NULL, port, store_and_stop, &result));
+    assert_true(reactor_run(reactor));
+
+    reactor_destroy(reactor);
+
+    return result;
+}
+
+void
+test_check_port_async(UNUSED void **state)
+{
+    uint16_t port = 0;
+    int32_t sock = listen_local(&port);
+
+    assert_int_equal(1, run_port_check(port));
+
+    /* nobody is listening anymore */
+    close(sock);
+
+    assert_int_equal(0, run_port_check(port));
+}
+
+#define TEST_CHUNKED_RESPONSE \
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nnyx!\r\n0\r\n\r\n"
+#define TEST_SIZED_RESPONSE \
+    "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n"
+
+typedef struct
+{
+    int32_t client;
+    int32_t accepted;
+} test_server_t;
+
+static void
+handle_accept(UNUSED reactor_t *reactor, int32_t fd, UNUSED uint32_t events, void *data)
+{
+    test_server_t *server = data;
+
+    server->client = accept(fd, NULL, NULL);
+    server->accepted++;
+
+    assert_true(server->client >= 0);
+    assert_true(write(server->client, TEST_CHUNKED_RESPONSE,
+                strlen(TEST_CHUNKED_RESPONSE)) > 0);
+}
+
+static int32_t
+run_http_check(int32_t sock, uint16_t port, const uint16_t *expected,
+        int32_t *connection, test_server_t *server)
+{
+    int32_t result = -1;
+    reactor_t *reactor = reactor_new();
+
+    assert_non_null(reactor);
+    assert_true(reactor_add_fd(reactor, sock, handle_accept, server));
+    assert_non_null(check_http_start(reactor, "/", port, HTTP_GET,
+                expected, connection, NULL, store_and_stop, &result));
+    assert_true(reactor_run(reactor));
+
+    reactor_destroy(reactor);
+
+    return result;
+}
+
+void
+test_check_http_keep_alive(UNUSED void **state)
+{
+    uint16_t port = 0;
+    int32_t connection = -1;
+    int32_t sock = listen_local(&port);
+    test_server_t server = { -1, 0 };
+
+    const uint16_t expected[] = { 200, 204, 0 };
+
+    /* the chunked response is read completely and the
+     * connection is kept for the next check */
+    assert_int_equal(1, run_http_check(sock, port, NULL, &connection, &server));
+    assert_int_equal(1, server.accepted);
+    assert_true(connection >= 0);
+
+    /* the next check reuses the connection */
+    assert_true(write(server.client, TEST_SIZED_RESPONSE, strlen(TEST_SIZED_RESPONSE)) > 0);
+
+    assert_int_equal(1, run_http_check(sock, port, expected, &connection, &server));
+    assert_int_equal(1, server.accepted);
+    assert_true(connection >= 0);
+
+    /* '204' is not expected by default */
+    assert_true(write(server.client, TEST_SIZED_RESPONSE, strlen(TEST_SIZED_RESPONSE)) > 0);
+
+    assert_int_equal(0, run_http_check(sock, port, NULL, &connection, &server));
+    assert_int_equal(1, server.accepted);
+
+    /* a connection closed by the server is reestablished */
+    close(server.client);
+
+    assert_int_equal(1, run_http_check(sock, port, NULL, &connection, &server));
+    assert_int_equal(2, server.accepted);
+    assert_true(connection >= 0);
+
+    close(connection);
+    close(server.client);
+    close(sock);
+}
+
+static void *
+complete_check(void *data)
+{
+    int32_t *result_fd = data;
+
+    check_async_complete(*result_fd, true);
+
+    return NULL;
+}
+
+/* run an asynchronous check whose result is reported by the given function
+ * on another thread (or not at all) */
+static int32_t
+run_async_check(uint32_t timeout, void *(*reporter)(void *))
+{
+    int32_t result = -1;
+    int32_t result_fd = -1;
+    pthread_t thread;
+    reactor_t *reactor = reactor_new();
+
+    assert_non_null(reactor);
+    assert_non_null(check_async_start(reactor, CHECK_PLUGIN, timeout, &result_fd,
+                store_and_stop, &result));
+
+    if (reporter)
+        assert_int_equal(0, pthread_create(&thread, NULL, reporter, &result_fd));
+
+    assert_true(reactor_run(reactor));
+
+    if (reporter)
+        assert_int_equal(0, pthread_join(thread, NULL));
+    else
+    {
+        /* the late result is discarded (SIGPIPE is ignored by the daemon) */
+        signal(SIGPIPE, SIG_IGN);
+        check_async_complete(result_fd, true);
+        signal(SIGPIPE, SIG_DFL);
+    }
+
+    reactor_destroy(reactor);
+
+    return result;
+}
+
+static void *
+fail_check(void *data)
+{
+    int32_t *result_fd = data;
+
+    check_async_complete(*result_fd, false);
+
+    return NULL;
+}
+
+void
+test_check_async(UNUSED void **state)
+{
+    assert_int_equal(1, run_async_check(5000, complete_check));
+    assert_int_equal(0, run_async_check(5000, fail_check));
+
+    /* the deadline passes before the result is reported */
+    assert_int_equal(0, run_async_check(10, NULL));
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
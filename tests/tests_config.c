@@ -13,12 +13,21 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+
 #include "tests.h"
+#include "tests_config.h"
 #include "tests_proc.h"
 #include "../src/config.h"
+#include "../src/image.h"
+#include "../src/watch.h"
 
+#include <signal.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 static void
@@ -84,5 +93,300 @@ test_config_parse_files(UNUSED void **state)
     assert_int_equal(0, cmocka_run_group_tests_name("config tests", tests, NULL, NULL));
 }
 
+static void
+write_file(const char *dir, const char *name, const char *content)
+{
+    char path[256] = {0};
+
+    snprintf(path, LEN(path)-1, "%s/%s", dir, name);
+
+    FILE *file = fopen(path, "w");
+
+    assert_non_null(file);
+    assert_true(fputs(content, file) >= 0);
+    assert_int_equal(0, fclose(file));
+}
+
+static void
+write_watch(const char *dir, uint32_t idx, const char *start)
+{
+    char name[32] = {0};
+    char content[256] = {0};
+
+    snprintf(name, LEN(name)-1, "w%u.yaml", idx);
+    snprintf(content, LEN(content)-1,
+            "watches:\n  w%u:\n    start: %s\n", idx, start);
+
+    write_file(dir, name, content);
+}
+
+static bool
+cache_contains(hash_t *cache, void *entry)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    bool found = false;
+    hash_iter_t *iter = hash_iter_start(cache);
+
+    while (!found && hash_iter(iter, &key, &data))
+        found = data == entry;
+
+    hash_iter_free(iter);
+
+    return found;
+}
+
+static void *
+first_entry(hash_t *cache)
+{
+    const char *key = NULL;
+    void *data = NULL;
+    hash_iter_t *iter = hash_iter_start(cache);
+
+    hash_iter(iter, &key, &data);
+    hash_iter_free(iter);
+
+    return data;
+}
+
+static void
+reparse(nyx_t *nyx)
+{
+    hash_destroy(nyx->watches);
+    destroy_options(nyx);
+
+    nyx->watches = hash_new(_free_watch);
+
+    assert_true(parse_config(nyx, true));
+}
+
+void
+test_config_cache(UNUSED void **state)
+{
+    char dir[] = "/tmp/nyx-config-XXXXXX";
+    char include[64] = {0};
+    char main_file[64] = {0};
+
+    assert_non_null(mkdtemp(dir));
+
+    snprintf(include, LEN(include)-1, "%s/conf.d", dir);
+    snprintf(main_file, LEN(main_file)-1, "%s/main.yaml", dir);
+
+    assert_int_equal(0, mkdir(include, 0755));
+
+    write_file(dir, "main.yaml",
+            "nyx:\n  include_dir: conf.d\nwatches:\n  main:\n    start: sleep 10\n");
+
+    for (uint32_t idx = 0; idx < 5; idx++)
+        write_watch(include, idx, "sleep 10");
+
+    nyx_t *nyx = xcalloc1(sizeof(nyx_t));
+    nyx->watches = hash_new(_free_watch);
+    nyx->options.config_file = main_file;
+
+    /* the included files are parsed in parallel */
+    assert_true(parse_config(nyx, true));
+    assert_int_equal(6, hash_count(nyx->watches));
+    assert_string_equal("conf.d", nyx->options.include_dir);
+
+    /* the main file configures global options and is not cached */
+    assert_int_equal(5, hash_count(nyx->config_cache));
+
+    void *entry = first_entry(nyx->config_cache);
+
+    /* unchanged files are taken from the cache */
+    reparse(nyx);
+    assert_int_equal(6, hash_count(nyx->watches));
+    assert_int_equal(5, hash_count(nyx->config_cache));
+    assert_true(cache_contains(nyx->config_cache, entry));
+
+    /* modified files are parsed again */
+    write_watch(include, 2, "sleep 1000");
+    reparse(nyx);
+
+    watch_t *watch = hash_get(nyx->watches, "w2");
+    assert_non_null(watch);
+    assert_string_equal("1000", watch->start[1]);
+    assert_int_equal(5, hash_count(nyx->config_cache));
+
+    /* removed files are dropped from the cache */
+    char removed[128] = {0};
+    snprintf(removed, LEN(removed)-1, "%s/w4.yaml", include);
+    assert_int_equal(0, unlink(removed));
+
+    reparse(nyx);
+    assert_int_equal(5, hash_count(nyx->watches));
+    assert_int_equal(4, hash_count(nyx->config_cache));
+
+    destroy_options(nyx);
+    nyx_destroy(nyx);
+
+    char *command = NULL;
+    assert_true(asprintf(&command, "rm -rf %s", dir) > 0);
+    assert_int_equal(0, system(command));
+    free(command);
+}
+
+static nyx_t *
+parse_image_config(const char *config_file)
+{
+    nyx_t *nyx = xcalloc1(sizeof(nyx_t));
+    nyx->watches = hash_new(_free_watch);
+    nyx->options.config_file = config_file;
+
+    assert_true(parse_config(nyx, true));
+
+    return nyx;
+}
+
+void
+test_config_image(UNUSED void **state)
+{
+    char dir[] = "/tmp/nyx-image-XXXXXX";
+    char config_file[64] = {0};
+
+    assert_non_null(mkdtemp(dir));
+
+    snprintf(config_file, LEN(config_file)-1, "%s/main.yaml", dir);
+
+    write_file(dir, "main.yaml",
+            "nyx:\n"
+            "  check_interval: 15\n"
+            "  cgroup: nyx.slice\n"
+            "  check_exec_concurrency: 4\n"
+            "  restart_rate: 5\n"
+            "  restart_concurrency: 2\n"
+            "  io_uring: true\n"
+            "  federation: agg1:7800, agg2:7800\n"
+            "  federation_node: web-1\n"
+            "  federation_interval: 30\n"
+            "  federation_port: 7800\n"
+            "watches:\n"
+            "  app:\n"
+            "    start: sleep 10\n"
+            "    dir: /tmp\n"
+            "    port_check: localhost:8080\n"
+            "    http_check:\n"
+            "      url: http://localhost/health\n"
+            "      status: [200, 204]\n"
+            "    check_exec: test -f /tmp/healthy\n"
+            "    watchdog: 500ms\n"
+            "    cpu_affinity: 0-1\n"
+            "    nice: -5\n"
+            "    reload_signal: USR2\n"
+            "    rlimits:\n"
+            "      nofile: 4096\n"
+            "    env:\n"
+            "      FOO: bar\n"
+            "  db:\n"
+            "    start: [sleep, '20']\n"
+            "    max_memory: 1G\n"
+            "    flapping_count: 3\n"
+            "    max_flapping_delay: 60\n"
+            "    numa_node:\n"
+            "      nodes: 0\n"
+            "      policy: preferred\n"
+            "    sched_policy: batch\n"
+            "    listen: [5432, 'unix:/tmp/db.sock']\n"
+            "    listen_lazy: true\n"
+            "    reload: pg_ctl reload\n"
+            "    restart_priority: 10\n"
+            "    check_exec:\n"
+            "      command: pg_isready -q\n"
+            "      interval: 10\n"
+            "      timeout: 2\n");
+
+    nyx_t *compiled = xcalloc1(sizeof(nyx_t));
+    compiled->watches = hash_new(_free_watch);
+    compiled->options.config_file = config_file;
+    compiled->options.compile_config = true;
+
+    assert_true(parse_config(compiled, true));
+
+    char *image = image_path(config_file);
+    assert_true(image_write(compiled, image));
+
+    /* the image is used as long as the config did not change */
+    nyx_t *nyx = parse_image_config(config_file);
+
+    assert_null(nyx->config_cache);
+    assert_int_equal(2, hash_count(nyx->watches));
+    assert_int_equal(15, nyx->options.check_interval);
+    assert_string_equal("nyx.slice", nyx->options.cgroup);
+    assert_int_equal(4, nyx->options.check_exec_concurrency);
+    assert_int_equal(5, nyx->options.restart_rate);
+    assert_int_equal(0, nyx->options.restart_burst);
+    assert_int_equal(2, nyx->options.restart_concurrency);
+    assert_true(nyx->options.io_uring);
+    assert_string_equal("agg2:7800", nyx->options.federation[1]);
+    assert_null(nyx->options.federation[2]);
+    assert_string_equal("web-1", nyx->options.federation_node);
+    assert_int_equal(30, nyx->options.federation_interval);
+    assert_int_equal(7800, nyx->options.federation_port);
+
+    watch_t *app = hash_get(nyx->watches, "app");
+    watch_t *db = hash_get(nyx->watches, "db");
+
+    assert_non_null(app);
+    assert_non_null(db);
+    assert_true(watch_equal(hash_get(compiled->watches, "app"), app));
+    assert_true(watch_equal(hash_get(compiled->watches, "db"), db));
+    assert_int_equal(((watch_t *)hash_get(compiled->watches, "db"))->id, db->id);
+
+    assert_non_null(app->check_exec);
+    assert_string_equal("test", app->check_exec[0]);
+    assert_string_equal("/tmp/healthy", app->check_exec[2]);
+    assert_null(app->check_exec[3]);
+    assert_int_equal(500, app->watchdog);
+    assert_string_equal("0-1", app->cpu_affinity);
+    assert_int_equal(-5, app->nice);
+    assert_int_equal(SIGUSR2, app->reload_signal);
+    assert_null(app->reload);
+    assert_string_equal("4096", hash_get(app->rlimits, "nofile"));
+    assert_string_equal("0", db->numa_node);
+    assert_int_equal(NUMA_POLICY_PREFERRED, db->numa_policy);
+    assert_int_equal(SCHED_POLICY_BATCH, db->sched_policy);
+    assert_string_equal("5432", db->listen[0]);
+    assert_string_equal("unix:/tmp/db.sock", db->listen[1]);
+    assert_null(db->listen[2]);
+    assert_true(db->listen_lazy);
+    assert_string_equal("pg_ctl", db->reload[0]);
+    assert_string_equal("reload", db->reload[1]);
+    assert_null(db->reload[2]);
+    assert_int_equal(0, db->reload_signal);
+    assert_int_equal(10, db->restart_priority);
+    assert_int_equal(0, app->restart_priority);
+    assert_string_equal("pg_isready", db->check_exec[0]);
+    assert_int_equal(10, db->check_exec_interval);
+    assert_int_equal(2, db->check_exec_timeout);
+
+    destroy_options(nyx);
+    nyx_destroy(nyx);
+
+    /* outdated images are ignored */
+    struct timespec times[2] = { { 0, UTIME_NOW }, { 1, 0 } };
+    assert_int_equal(0, utimensat(AT_FDCWD, config_file, times, 0));
+
+    nyx = parse_image_config(config_file);
+    assert_non_null(nyx->config_cache);
+    assert_int_equal(2, hash_count(nyx->watches));
+
+    destroy_options(nyx);
+    nyx_destroy(nyx);
+
+    /* invalid images are ignored as well */
+    write_file(dir, "main.yaml.img", "garbage");
+    assert_false(image_load(compiled, image, true));
+
+    free(image);
+    destroy_options(compiled);
+    nyx_destroy(compiled);
+
+    char *command = NULL;
+    assert_true(asprintf(&command, "rm -rf %s", dir) > 0);
+    assert_int_equal(0, system(command));
+    free(command);
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
 
@@ -18,5 +18,11 @@
 void
 test_config_parse_files(UNUSED void **state);
 
+void
+test_config_cache(void **state);
+
+void
+test_config_image(void **state);
+
 /* vim: set et sw=4 sts=4 tw=80: */
 
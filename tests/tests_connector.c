@@ -0,0 +1,132 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_connector.h"
+#include "../src/connector.h"
+#include "../src/socket.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* encode a request as sent by the clients of a session */
+static uint32_t
+frame(char *buffer, uint32_t length, uint32_t id, const char *command)
+{
+    uint32_t value = htonl(length);
+
+    memcpy(buffer, &value, sizeof(uint32_t));
+
+    value = htonl(id);
+    memcpy(buffer + 4, &value, sizeof(uint32_t));
+
+    memcpy(buffer + NYX_REQUEST_HEADER_LEN, command, strlen(command));
+
+    return NYX_REQUEST_HEADER_LEN + strlen(command);
+}
+
+void
+test_connector_parse_frame(UNUSED void **state)
+{
+    frame_t request;
+    char buffer[64] = {0};
+
+    uint32_t first = frame(buffer, 6, 1, "status");
+    uint32_t length = first + frame(buffer + first, 4, 2, "ping");
+
+    assert_int_equal(FRAME_PARSE_OK, connector_parse_frame(buffer, length, &request));
+    assert_int_equal(1, request.id);
+    assert_int_equal(6, request.length);
+    assert_int_equal(0, strncmp("status", request.command, request.length));
+
+    /* pipelined requests are parsed one after another */
+    assert_int_equal(FRAME_PARSE_OK,
+            connector_parse_frame(buffer + first, length - first, &request));
+    assert_int_equal(2, request.id);
+    assert_int_equal(4, request.length);
+    assert_int_equal(0, strncmp("ping", request.command, request.length));
+
+    /* a request split across reads is incomplete until it was received */
+    for (uint32_t received = 0; received < first; received++)
+    {
+        assert_int_equal(FRAME_PARSE_INCOMPLETE,
+                connector_parse_frame(buffer, received, &request));
+    }
+
+    /* the command may be empty */
+    frame(buffer, 0, 3, "");
+
+    assert_int_equal(FRAME_PARSE_OK,
+            connector_parse_frame(buffer, NYX_REQUEST_HEADER_LEN, &request));
+    assert_int_equal(3, request.id);
+    assert_int_equal(0, request.length);
+
+    /* oversized requests are rejected by their header already */
+    frame(buffer, NYX_MAX_FRAME_LEN, 4, "");
+
+    assert_int_equal(FRAME_PARSE_INCOMPLETE,
+            connector_parse_frame(buffer, NYX_REQUEST_HEADER_LEN, &request));
+
+    frame(buffer, NYX_MAX_FRAME_LEN + 1, 5, "");
+
+    assert_int_equal(FRAME_PARSE_INVALID,
+            connector_parse_frame(buffer, NYX_REQUEST_HEADER_LEN, &request));
+    assert_int_equal(5, request.id);
+
+    frame(buffer, UINT32_MAX, 6, "");
+
+    assert_int_equal(FRAME_PARSE_INVALID,
+            connector_parse_frame(buffer, NYX_REQUEST_HEADER_LEN, &request));
+}
+
+static void
+stop_reactor(reactor_t *reactor, UNUSED void *data)
+{
+    reactor_stop(reactor);
+}
+
+void
+test_connector_respond(UNUSED void **state)
+{
+    int32_t fds[2];
+    char buffer[64] = {0};
+    reactor_t *reactor = reactor_new();
+    strbuf_t *output = strbuf_new();
+
+    assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assert_true(unblock_socket(fds[0]));
+
+    strbuf_append_string(output, "app: running\n");
+
+    /* the response is sent on the reactor and the socket closed */
+    connector_respond(reactor, fds[0], output);
+
+    assert_true(reactor_add_timer(reactor, 20, false, stop_reactor, NULL) >= 0);
+    assert_true(reactor_run(reactor));
+
+    assert_int_equal(13, recv(fds[1], buffer, sizeof(buffer), MSG_DONTWAIT));
+    assert_string_equal("app: running\n", buffer);
+    assert_int_equal(0, recv(fds[1], buffer, sizeof(buffer), MSG_DONTWAIT));
+
+    close(fds[1]);
+    reactor_destroy(reactor);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
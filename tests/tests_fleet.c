@@ -0,0 +1,205 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_fleet.h"
+#include "../src/federation.h"
+#include "../src/fleet.h"
+#include "../src/state.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+static bool
+receive(fleet_t *fleet, fleet_peer_t *peer, const char *data)
+{
+    strbuf_clear(peer->output);
+
+    return fleet_receive(fleet, peer, data, strlen(data));
+}
+
+static fleet_watch_t *
+fleet_watch(fleet_t *fleet, const char *node, const char *watch)
+{
+    fleet_node_t *entry = hash_get(fleet->nodes, node);
+
+    return entry ? hash_get(entry->watches, watch) : NULL;
+}
+
+void
+test_fleet_protocol(UNUSED void **state)
+{
+    fleet_t *fleet = fleet_new(NULL, NULL);
+    fleet_peer_t peer = { .fd = -1, .owner = fleet, .output = strbuf_new() };
+    char line[256];
+
+    /* the node has to introduce itself first */
+    assert_false(receive(fleet, &peer, "delta 1 3 42 1000 app\n"));
+
+    /* an unknown node is asked for a snapshot */
+    assert_true(receive(fleet, &peer, "hello 1 100 1 web\n"));
+    assert_string_equal("resync\n", peer.output->buf);
+    assert_true(fleet_contains(fleet, "web"));
+
+    /* changes before the snapshot are covered by it */
+    assert_true(receive(fleet, &peer, "delta 1 3 42 1000 app\n"));
+    assert_string_equal("", peer.output->buf);
+
+    /* lines may be split arbitrarily */
+    assert_true(receive(fleet, &peer, "snapshot 5\nwatch 3 42 1000 app\nwat"));
+    assert_string_equal("", peer.output->buf);
+    assert_true(receive(fleet, &peer, "ch 1 0 1000 db\nend\n"));
+    assert_string_equal("ack 5\n", peer.output->buf);
+
+    assert_true(fleet_contains(fleet, "web/app"));
+    assert_true(fleet_contains(fleet, "web/db"));
+    assert_false(fleet_contains(fleet, "web/cache"));
+    assert_int_equal(STATE_RUNNING, fleet_watch(fleet, "web", "app")->state);
+
+    /* changes in order are applied and acknowledged in one go */
+    assert_true(receive(fleet, &peer, "delta 6 5 0 2000 app\ndelta 7 2 0 2001 app\n"));
+    assert_string_equal("ack 7\n", peer.output->buf);
+    assert_int_equal(STATE_STARTING, fleet_watch(fleet, "web", "app")->state);
+
+    /* duplicates are ignored */
+    assert_true(receive(fleet, &peer, "delta 6 1 0 2000 app\n"));
+    assert_string_equal("", peer.output->buf);
+    assert_int_equal(STATE_STARTING, fleet_watch(fleet, "web", "app")->state);
+
+    assert_true(receive(fleet, &peer, "metrics 12.5 2048 app\n"));
+    assert_true(fleet_watch(fleet, "web", "app")->has_metrics);
+    assert_int_equal(2048, fleet_watch(fleet, "web", "app")->memory);
+
+    /* a gap requires a snapshot - the watches missing in it are removed */
+    assert_true(receive(fleet, &peer, "delta 9 4 43 3000 app\n"));
+    assert_string_equal("resync\n", peer.output->buf);
+    assert_int_equal(STATE_STARTING, fleet_watch(fleet, "web", "app")->state);
+
+    snprintf(line, sizeof(line), "snapshot 9\nwatch %d 43 3000 app\nend\n", STATE_RUNNING);
+    assert_true(receive(fleet, &peer, line));
+    assert_string_equal("ack 9\n", peer.output->buf);
+    assert_int_equal(43, fleet_watch(fleet, "web", "app")->pid);
+    assert_false(fleet_contains(fleet, "web/db"));
+
+    /* removed watches */
+    snprintf(line, sizeof(line), "delta 10 %d 0 4000 app\n", STATE_QUIT);
+    assert_true(receive(fleet, &peer, line));
+    assert_string_equal("ack 10\n", peer.output->buf);
+    assert_false(fleet_contains(fleet, "web/app"));
+
+    /* unsupported protocol versions are refused */
+    fleet_peer_t other = { .fd = -1, .owner = fleet, .output = strbuf_new() };
+    assert_false(receive(fleet, &other, "hello 2 100 1 db\n"));
+    assert_false(fleet_contains(fleet, "db"));
+
+    strbuf_free(other.output);
+    strbuf_free(peer.output);
+
+    fleet_destroy(fleet);
+}
+
+void
+test_fleet_reconnect(UNUSED void **state)
+{
+    fleet_t *fleet = fleet_new(NULL, NULL);
+    fleet_peer_t peer = { .fd = -1, .owner = fleet, .output = strbuf_new() };
+    fleet_peer_t second = { .fd = -1, .owner = fleet, .output = strbuf_new() };
+    fleet_peer_t third = { .fd = -1, .owner = fleet, .output = strbuf_new() };
+
+    assert_true(receive(fleet, &peer, "hello 1 100 1 web\nsnapshot 3\nend\n"));
+    assert_non_null(strstr(peer.output->buf, "ack 3\n"));
+
+    /* the node continues with the unacknowledged changes */
+    assert_true(receive(fleet, &second, "hello 1 100 3 web\ndelta 3 3 1 10 app\n"
+                "delta 4 4 1 11 app\n"));
+    assert_string_equal("ack 4\n", second.output->buf);
+    assert_ptr_equal(&second, ((fleet_node_t *)hash_get(fleet->nodes, "web"))->peer);
+    assert_null(peer.node);
+
+    /* a restarted node (new epoch) is asked for a snapshot */
+    assert_true(receive(fleet, &third, "hello 1 200 1 web\n"));
+    assert_string_equal("resync\n", third.output->buf);
+
+    strbuf_free(peer.output);
+    strbuf_free(second.output);
+    strbuf_free(third.output);
+
+    fleet_destroy(fleet);
+}
+
+static void
+stop_reactor(reactor_t *reactor, UNUSED void *data)
+{
+    reactor_stop(reactor);
+}
+
+/* changes while being connected */
+static void
+publish_changes(UNUSED reactor_t *reactor, void *data)
+{
+    federation_t *federation = data;
+
+    /* the first changes were acknowledged */
+    assert_int_equal(0, federation->upstreams[0]->count);
+
+    federation_publish(federation, "db", STATE_RUNNING, 43);
+    federation_remove(federation, "app");
+}
+
+void
+test_fleet_federation(UNUSED void **state)
+{
+    char upstream[32];
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    reactor_t *reactor = reactor_new();
+    fleet_t *fleet = fleet_new(reactor, NULL);
+
+    assert_true(fleet_listen(fleet, 0));
+    assert_int_equal(0, getsockname(fleet->fd, (struct sockaddr *)&addr, &len));
+
+    snprintf(upstream, sizeof(upstream), "127.0.0.1:%u", ntohs(addr.sin_port));
+
+    const char *upstreams[] = { upstream, NULL };
+    federation_t *federation = federation_new(reactor, upstreams, "node1", 10, NULL);
+
+    assert_non_null(federation);
+
+    /* changes before the connection are part of the snapshot */
+    federation_publish(federation, "app", STATE_STARTING, 0);
+    federation_publish(federation, "app", STATE_RUNNING, 42);
+    federation_publish(federation, "cache", STATE_RUNNING, 41);
+
+    assert_true(reactor_add_timer(reactor, 100, false, publish_changes, federation) >= 0);
+    assert_true(reactor_add_timer(reactor, 200, false, stop_reactor, NULL) >= 0);
+    assert_true(reactor_run(reactor));
+
+    assert_false(fleet_contains(fleet, "node1/app"));
+    assert_true(fleet_contains(fleet, "node1/cache"));
+    assert_int_equal(41, fleet_watch(fleet, "node1", "cache")->pid);
+    assert_int_equal(43, fleet_watch(fleet, "node1", "db")->pid);
+    assert_int_equal(5, ((fleet_node_t *)hash_get(fleet->nodes, "node1"))->seq);
+    assert_int_equal(0, federation->upstreams[0]->count);
+
+    federation_destroy(federation);
+    fleet_destroy(fleet);
+    reactor_destroy(reactor);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
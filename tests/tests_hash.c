@@ -108,5 +108,104 @@ test_hash_remove(UNUSED void **state)
     hash_destroy(hash);
 }
 
+void
+test_hash_take(UNUSED void **state)
+{
+    hash_t *hash = hash_new(free);
+
+    assert_true(hash_add(hash, "key", strdup("value")));
+
+    char *value = hash_take(hash, "key");
+
+    assert_non_null(value);
+    assert_string_equal("value", value);
+    assert_int_equal(0, hash_count(hash));
+    assert_null(hash_take(hash, "key"));
+
+    free(value);
+    hash_destroy(hash);
+}
+
+void
+test_hash_iterate(UNUSED void **state)
+{
+    uint32_t size = 100, idx = 0;
+    char buffer[512] = {0};
+    const char *key = NULL;
+    void *data = NULL;
+
+    hash_t *hash = hash_new(NULL);
+
+    for (uintptr_t i = 0; i < size; i++)
+    {
+        sprintf(buffer, "key%lu", (unsigned long)i);
+        assert_true(hash_add(hash, buffer, (void *)i));
+    }
+
+    /* the keys are iterated in insertion order and removing the
+     * current key does not affect the remaining ones */
+    hash_iter_t *iter = hash_iter_start(hash);
+
+    while (hash_iter(iter, &key, &data))
+    {
+        assert_int_equal(idx, (uintptr_t)data);
+
+        sprintf(buffer, "key%u", idx++);
+        assert_string_equal(buffer, key);
+
+        if ((uintptr_t)data % 2)
+            assert_true(hash_remove(hash, key));
+    }
+
+    assert_int_equal(size, idx);
+    assert_int_equal(size / 2, hash_count(hash));
+
+    /* the remaining keys are found after compacting the holes */
+    for (uintptr_t i = size; i < size * 2; i++)
+    {
+        sprintf(buffer, "key%lu", (unsigned long)i);
+        assert_true(hash_add(hash, buffer, (void *)i));
+    }
+
+    for (uintptr_t i = 0; i < size * 2; i++)
+    {
+        sprintf(buffer, "key%lu", (unsigned long)i);
+
+        if (i < size && i % 2)
+            assert_null(hash_get(hash, buffer));
+        else
+            assert_int_equal(i, (uintptr_t)hash_get(hash, buffer));
+    }
+
+    hash_iter_free(iter);
+    hash_destroy(hash);
+}
+
+void
+test_hash_long_keys(UNUSED void **state)
+{
+    char first[256], second[256];
+
+    hash_t *hash = hash_new(NULL);
+
+    /* keys are not truncated */
+    memset(first, 'a', sizeof(first) - 1);
+    first[sizeof(first) - 1] = '\0';
+
+    memcpy(second, first, sizeof(second));
+    second[200] = 'b';
+
+    assert_true(hash_add(hash, first, first));
+    assert_true(hash_add(hash, second, second));
+
+    assert_ptr_equal(first, hash_get(hash, first));
+    assert_ptr_equal(second, hash_get(hash, second));
+
+    /* prefixes are different keys */
+    first[100] = '\0';
+    assert_null(hash_get(hash, first));
+
+    hash_destroy(hash);
+}
 
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -24,4 +24,13 @@ test_hash_add(void **state);
 void
 test_hash_remove(void **state);
 
+void
+test_hash_take(void **state);
+
+void
+test_hash_iterate(void **state);
+
+void
+test_hash_long_keys(void **state);
+
 /* vim: set et sw=4 sts=4 tw=80: */
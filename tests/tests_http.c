@@ -0,0 +1,191 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_http.h"
+#include "../src/http.h"
+#include "../src/nyx.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static http_parse_e
+parse(const char *input, http_request_t *request)
+{
+    static char buffer[NYX_HTTP_BUFFER_LEN + 1];
+
+    strncpy(buffer, input, NYX_HTTP_BUFFER_LEN);
+
+    return http_parse_request(buffer, strlen(buffer), request);
+}
+
+void
+test_http_parse_request(UNUSED void **state)
+{
+    http_request_t request;
+
+    assert_int_equal(HTTP_PARSE_OK, parse("GET /status/all HTTP/1.1\r\n"
+                "Host: localhost\r\n"
+                "If-None-Match: \"abc-1\"\r\n\r\n", &request));
+    assert_string_equal("/status/all", request.uri);
+    assert_string_equal("\"abc-1\"", request.if_none_match);
+    assert_true(request.keep_alive);
+    assert_int_equal(69, request.length);
+
+    /* HTTP/1.0 closes the connection unless asked otherwise */
+    assert_int_equal(HTTP_PARSE_OK, parse("GET /ping HTTP/1.0\r\n\r\n", &request));
+    assert_false(request.keep_alive);
+
+    assert_int_equal(HTTP_PARSE_OK, parse("GET /ping HTTP/1.0\r\n"
+                "connection: Keep-Alive\r\n\r\n", &request));
+    assert_true(request.keep_alive);
+
+    assert_int_equal(HTTP_PARSE_OK, parse("GET /ping HTTP/1.1\r\n"
+                "Connection: close\r\n\r\n", &request));
+    assert_false(request.keep_alive);
+
+    /* pipelined requests are parsed one after another */
+    assert_int_equal(HTTP_PARSE_OK, parse("GET /ping HTTP/1.1\r\n\r\n"
+                "GET /version HTTP/1.1\r\n\r\n", &request));
+    assert_string_equal("/ping", request.uri);
+    assert_int_equal(22, request.length);
+
+    /* the body is skipped */
+    assert_int_equal(HTTP_PARSE_INCOMPLETE, parse("GET /ping HTTP/1.1\r\n"
+                "Content-Length: 4\r\n\r\nab", &request));
+    assert_int_equal(HTTP_PARSE_OK, parse("GET /ping HTTP/1.1\r\n"
+                "Content-Length: 4\r\n\r\nabcd", &request));
+    assert_int_equal(45, request.length);
+
+    /* body lengths that do not fit into the buffer (or overflow) */
+    assert_int_equal(HTTP_PARSE_INVALID, parse("GET /ping HTTP/1.1\r\n"
+                "Content-Length: 18446744073709551556\r\n\r\n", &request));
+    assert_int_equal(HTTP_PARSE_INVALID, parse("GET /ping HTTP/1.1\r\n"
+                "Content-Length: 99999999999999999999999\r\n\r\n", &request));
+    assert_int_equal(HTTP_PARSE_INVALID, parse("GET /ping HTTP/1.1\r\n"
+                "Content-Length: 8192\r\n\r\n", &request));
+    assert_int_equal(HTTP_PARSE_INVALID, parse("GET /ping HTTP/1.1\r\n"
+                "Content-Length: -1\r\n\r\n", &request));
+    assert_int_equal(HTTP_PARSE_INVALID, parse("GET /ping HTTP/1.1\r\n"
+                "Content-Length: 4x\r\n\r\nabcd", &request));
+
+    assert_int_equal(HTTP_PARSE_INCOMPLETE, parse("GET /ping HTTP/1.1\r\nHost:", &request));
+    assert_int_equal(HTTP_PARSE_INVALID, parse("POST /ping HTTP/1.1\r\n\r\n", &request));
+    assert_int_equal(HTTP_PARSE_INVALID, parse("GET ping HTTP/1.1\r\n\r\n", &request));
+    assert_int_equal(HTTP_PARSE_INVALID, parse("GET /ping HTTP/2\r\n\r\n", &request));
+    assert_int_equal(HTTP_PARSE_INVALID, parse("GET /ping HTTP/1.1\r\n"
+                "Transfer-Encoding: chunked\r\n\r\n", &request));
+}
+
+static void
+stop_reactor(reactor_t *reactor, UNUSED void *data)
+{
+    reactor_stop(reactor);
+}
+
+/* process the reactor for a few milliseconds (repeatedly) */
+static void
+run_reactor(reactor_t *reactor)
+{
+    reactor->stopping = false;
+
+    assert_true(reactor_add_timer(reactor, 20, false, stop_reactor, NULL) >= 0);
+    assert_true(reactor_run(reactor));
+}
+
+static ssize_t
+receive_all(int32_t fd, char *buffer, size_t size)
+{
+    ssize_t received = 0;
+    size_t total = 0;
+
+    while (total < size - 1 &&
+           (received = recv(fd, buffer + total, size - 1 - total, MSG_DONTWAIT)) > 0)
+        total += received;
+
+    buffer[total] = '\0';
+
+    /* the connection was closed by the server */
+    if (received == 0)
+        return -1;
+
+    return total;
+}
+
+void
+test_http_pipelined(UNUSED void **state)
+{
+    char buffer[1024];
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    nyx_t *nyx = xcalloc1(sizeof(nyx_t));
+    reactor_t *reactor = reactor_new();
+    http_server_t *server = http_server_new(reactor, 0, nyx);
+
+    assert_non_null(server);
+    assert_int_equal(0, getsockname(server->fd, (struct sockaddr *)&addr, &len));
+
+    int32_t client = socket(AF_INET, SOCK_STREAM, 0);
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert_int_equal(0, connect(client, (struct sockaddr *)&addr, len));
+
+    const char requests[] = "GET /ping HTTP/1.1\r\n\r\n"
+        "GET /version HTTP/1.1\r\n\r\n";
+
+    assert_int_equal(LEN(requests) - 1, send(client, requests, LEN(requests) - 1, 0));
+
+    run_reactor(reactor);
+
+    /* both responses in order and the connection is kept open */
+    assert_true(receive_all(client, buffer, sizeof(buffer)) > 0);
+    assert_int_equal(1, http_server_connections(server));
+
+    char *ping = strstr(buffer, "\r\n\r\n>>> pong\n");
+
+    assert_int_equal(0, strncmp("HTTP/1.1 200 OK\r\n", buffer, 17));
+    assert_non_null(strstr(buffer, "Connection: keep-alive\r\n"));
+    assert_non_null(ping);
+
+    /* the version response follows the ping response */
+    char *version = strstr(ping + 4, "HTTP/1.1 200 OK\r\n");
+
+    assert_non_null(version);
+    assert_non_null(strstr(version, "\r\n\r\n>>> "));
+    assert_null(strstr(version, "pong"));
+
+    /* the connection is closed after the response on request */
+    const char last[] = "GET /ping HTTP/1.1\r\nConnection: close\r\n\r\n";
+
+    assert_int_equal(LEN(last) - 1, send(client, last, LEN(last) - 1, 0));
+
+    run_reactor(reactor);
+
+    assert_int_equal(-1, receive_all(client, buffer, sizeof(buffer)));
+    assert_non_null(strstr(buffer, "Connection: close\r\n"));
+    assert_non_null(strstr(buffer, "\r\n\r\n>>> pong\n"));
+    assert_int_equal(0, http_server_connections(server));
+
+    close(client);
+    http_server_destroy(server);
+    reactor_destroy(reactor);
+    xfree(nyx);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,204 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_journal.h"
+#include "../src/journal.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+typedef struct
+{
+    uint32_t states;
+    uint32_t exits;
+    uint32_t checks;
+    int64_t first;
+    int64_t last;
+    int64_t previous;
+    bool ordered;
+} journal_counts_t;
+
+static void
+count_record(const journal_record_t *record, const char *name, void *data)
+{
+    journal_counts_t *counts = data;
+
+    assert_non_null(name);
+
+    if (counts->previous > record->time)
+        counts->ordered = false;
+
+    if (counts->first == 0)
+        counts->first = record->time;
+
+    counts->previous = counts->last = record->time;
+
+    switch (record->type)
+    {
+        case JOURNAL_STATE:
+            counts->states++;
+            break;
+        case JOURNAL_EXIT:
+            counts->exits++;
+            assert_int_equal(256, record->data.exit.status);
+            break;
+        case JOURNAL_CHECK:
+            counts->checks++;
+            assert_false(record->data.check.success);
+            assert_int_equal(1500, record->data.check.latency);
+            break;
+    }
+}
+
+static void
+remove_dir(const char *dir)
+{
+    char *command = NULL;
+    assert_true(asprintf(&command, "rm -rf %s", dir) > 0);
+    assert_int_equal(0, system(command));
+    free(command);
+}
+
+static journal_counts_t
+query(const char *dir, const char *pattern, int64_t from, int64_t to)
+{
+    matcher_t matcher;
+    journal_counts_t counts = { .ordered = true };
+
+    assert_true(matcher_init(&matcher, pattern, false));
+    assert_true(journal_query(dir, &matcher, from, to, count_record, &counts));
+
+    matcher_free(&matcher);
+
+    return counts;
+}
+
+void
+test_journal_query(UNUSED void **state)
+{
+    char dir[] = "/tmp/nyx-journal-XXXXXX";
+
+    assert_non_null(mkdtemp(dir));
+
+    journal_t *journal = journal_open(dir, 0);
+    assert_non_null(journal);
+
+    /* spans multiple index blocks */
+    for (int32_t idx = 0; idx < 3000; idx++)
+    {
+        journal_state(journal, "app", 3, 5, 100 + idx);
+
+        if (idx % 10 == 0)
+            journal_exit(journal, "db", 200, 256);
+    }
+
+    journal_check(journal, "web-1", 300, 0, false, 1500);
+    journal_close(journal);
+
+    journal_counts_t all = query(dir, "all", 0, INT64_MAX);
+    assert_int_equal(3000, all.states);
+    assert_int_equal(300, all.exits);
+    assert_int_equal(1, all.checks);
+    assert_true(all.ordered);
+
+    journal_counts_t db = query(dir, "db", 0, INT64_MAX);
+    assert_int_equal(0, db.states);
+    assert_int_equal(300, db.exits);
+
+    journal_counts_t web = query(dir, "web-*", 0, INT64_MAX);
+    assert_int_equal(1, web.checks);
+    assert_int_equal(0, web.states + web.exits);
+
+    /* the time range is inclusive */
+    journal_counts_t last = query(dir, "web-1", web.first, web.first);
+    assert_int_equal(1, last.checks);
+
+    journal_counts_t none = query(dir, "app", all.last + 1, INT64_MAX);
+    assert_int_equal(0, none.states);
+
+    /* the index is rebuilt if missing and the journal is appended to */
+    char *index = NULL;
+    assert_true(asprintf(&index, "%s/" JOURNAL_FILE ".idx", dir) > 0);
+    assert_int_equal(0, unlink(index));
+
+    journal_counts_t rebuilt = query(dir, "db", 0, INT64_MAX);
+    assert_int_equal(300, rebuilt.exits);
+
+    journal = journal_open(dir, 0);
+    assert_non_null(journal);
+    journal_exit(journal, "db", 200, 256);
+    journal_close(journal);
+
+    assert_int_equal(0, access(index, F_OK));
+    assert_int_equal(301, query(dir, "db", 0, INT64_MAX).exits);
+
+    free(index);
+    remove_dir(dir);
+}
+
+void
+test_journal_rotate(UNUSED void **state)
+{
+    char dir[] = "/tmp/nyx-journal-XXXXXX";
+
+    assert_non_null(mkdtemp(dir));
+
+    /* the journals are rotated after 32 records each */
+    journal_t *journal = journal_open(dir, 2 * 33 * sizeof(journal_record_t));
+    assert_non_null(journal);
+
+    for (int32_t idx = 0; idx < 40; idx++)
+        journal_state(journal, "app", 3, 5, idx);
+
+    journal_close(journal);
+
+    /* both the previous and the current journal are read */
+    journal_counts_t counts = query(dir, "app", 0, INT64_MAX);
+    assert_int_equal(40, counts.states);
+    assert_true(counts.ordered);
+
+    remove_dir(dir);
+}
+
+void
+test_journal_parse_time(UNUSED void **state)
+{
+    int64_t time = 0;
+    int64_t now = 1500000000 * 1000000LL;
+
+    assert_true(journal_parse_time("now", now, &time));
+    assert_true(time == now);
+
+    assert_true(journal_parse_time("30m", now, &time));
+    assert_true(time == now - 1800 * 1000000LL);
+
+    assert_true(journal_parse_time("1500000000", now, &time));
+    assert_true(time == now);
+
+    assert_true(journal_parse_time("2019-03-01T12:00:00", now, &time));
+    assert_true(time > 0);
+    assert_true(journal_parse_time("2019-03-01", now, &time));
+    assert_true(time > 0);
+
+    assert_false(journal_parse_time("yesterday", now, &time));
+    assert_false(journal_parse_time("30x", now, &time));
+    assert_false(journal_parse_time("2019-03-01T12", now, &time));
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
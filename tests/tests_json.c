@@ -0,0 +1,81 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tests.h"
+#include "tests_json.h"
+#include "../src/json.h"
+
+#include <math.h>
+
+void
+test_json_writer(UNUSED void **state)
+{
+    json_t json;
+    strbuf_t *buf = strbuf_new();
+    const char *strings[] = { "foo", "bar", NULL };
+
+    json_init(&json, buf);
+
+    json_object_start(&json);
+    json_key(&json, "name");
+    json_string(&json, "app");
+    json_key(&json, "pid");
+    json_int(&json, -1);
+    json_key(&json, "args");
+    json_strings(&json, strings);
+    json_key(&json, "empty");
+    json_array_start(&json);
+    json_array_end(&json);
+    json_key(&json, "nested");
+    json_array_start(&json);
+    json_object_start(&json);
+    json_object_end(&json);
+    json_uint(&json, 42);
+    json_double(&json, 1.5);
+    json_double(&json, NAN);
+    json_bool(&json, true);
+    json_string(&json, NULL);
+    json_array_end(&json);
+    json_object_end(&json);
+
+    assert_string_equal("{\"name\":\"app\",\"pid\":-1,\"args\":[\"foo\",\"bar\"],"
+            "\"empty\":[],\"nested\":[{},42,1.5,null,true,null]}", buf->buf);
+    assert_int_equal(0, json.depth);
+
+    strbuf_free(buf);
+}
+
+void
+test_json_escape(UNUSED void **state)
+{
+    json_t json;
+    strbuf_t *buf = strbuf_new();
+
+    json_init(&json, buf);
+
+    json_array_start(&json);
+    json_string(&json, "a \"quoted\" \\path\\");
+    json_string(&json, "line\nbreak\t\x01");
+    json_raw(&json, "{\"raw\":1}", 9);
+    json_array_end(&json);
+
+    assert_string_equal("[\"a \\\"quoted\\\" \\\\path\\\\\","
+            "\"line\\nbreak\\t\\u0001\",{\"raw\":1}]", buf->buf);
+
+    strbuf_free(buf);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,168 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tests.h"
+#include "tests_limiter.h"
+#include "../src/limiter.h"
+
+static uint32_t woken;
+
+static void
+count_wake(UNUSED void *data)
+{
+    woken++;
+}
+
+void
+test_limiter_unlimited(UNUSED void **state)
+{
+    limiter_ticket_t tickets[8] = {0};
+    limiter_t *limiter = limiter_new(NULL);
+
+    limiter_configure(limiter, 0, 0, 0);
+
+    for (uint32_t i = 0; i < LEN(tickets); i++)
+        assert_true(limiter_acquire(limiter, &tickets[i], 0, NULL));
+
+    assert_int_equal(0, limiter_queued(limiter));
+
+    for (uint32_t i = 0; i < LEN(tickets); i++)
+        limiter_release(limiter, &tickets[i]);
+
+    assert_int_equal(0, limiter->inflight);
+
+    limiter_destroy(limiter);
+}
+
+void
+test_limiter_priority(UNUSED void **state)
+{
+    limiter_ticket_t running = {0}, low = {0}, first = {0}, second = {0}, high = {0};
+    limiter_t *limiter = limiter_new(count_wake);
+
+    woken = 0;
+    limiter_configure(limiter, 0, 0, 1);
+
+    assert_true(limiter_acquire(limiter, &running, 0, NULL));
+    assert_false(limiter_acquire(limiter, &low, -1, NULL));
+    assert_false(limiter_acquire(limiter, &first, 0, NULL));
+    assert_false(limiter_acquire(limiter, &second, 0, NULL));
+    assert_false(limiter_acquire(limiter, &high, 5, NULL));
+    assert_int_equal(4, limiter_queued(limiter));
+
+    /* highest priority first, in request order otherwise */
+    assert_ptr_equal(&high, limiter->head);
+    assert_ptr_equal(&first, high.next);
+    assert_ptr_equal(&second, first.next);
+    assert_ptr_equal(&low, limiter->tail);
+
+    limiter_release(limiter, &running);
+    assert_true(high.admitted);
+    assert_int_equal(1, woken);
+    assert_int_equal(0, limiter_poll(limiter, &high));
+    assert_int_not_equal(0, limiter_poll(limiter, &first));
+
+    /* withdrawing a queued ticket keeps the order of the others */
+    limiter_release(limiter, &first);
+    assert_false(first.queued);
+    assert_int_equal(2, limiter_queued(limiter));
+
+    limiter_release(limiter, &high);
+    assert_true(second.admitted);
+    assert_false(low.admitted);
+
+    limiter_release(limiter, &second);
+    assert_true(low.admitted);
+    assert_int_equal(3, woken);
+
+    limiter_release(limiter, &low);
+    assert_int_equal(0, limiter->inflight);
+    assert_int_equal(0, limiter_queued(limiter));
+
+    limiter_destroy(limiter);
+}
+
+void
+test_limiter_concurrency(UNUSED void **state)
+{
+    limiter_ticket_t tickets[4] = {0};
+    limiter_t *limiter = limiter_new(NULL);
+
+    limiter_configure(limiter, 0, 0, 2);
+
+    assert_true(limiter_acquire(limiter, &tickets[0], 0, NULL));
+    assert_true(limiter_acquire(limiter, &tickets[1], 0, NULL));
+    assert_false(limiter_acquire(limiter, &tickets[2], 0, NULL));
+    assert_false(limiter_acquire(limiter, &tickets[3], 0, NULL));
+
+    /* acquiring a queued ticket again does not requeue it */
+    assert_false(limiter_acquire(limiter, &tickets[2], 0, NULL));
+    assert_int_equal(2, limiter_queued(limiter));
+    assert_int_equal(LIMITER_RETRY_MSECS, limiter_poll(limiter, &tickets[2]));
+
+    limiter_release(limiter, &tickets[1]);
+    assert_int_equal(0, limiter_poll(limiter, &tickets[2]));
+    assert_false(tickets[3].admitted);
+
+    /* raising the limit admits the waiting tickets */
+    limiter_configure(limiter, 0, 0, 3);
+    assert_true(tickets[3].admitted);
+    assert_int_equal(3, limiter->inflight);
+
+    limiter_release(limiter, &tickets[0]);
+    limiter_release(limiter, &tickets[2]);
+    limiter_release(limiter, &tickets[3]);
+    assert_int_equal(0, limiter->inflight);
+
+    limiter_destroy(limiter);
+}
+
+void
+test_limiter_rate(UNUSED void **state)
+{
+    limiter_ticket_t tickets[4] = {0};
+    limiter_t *limiter = limiter_new(NULL);
+
+    /* one restart per second with a burst of two */
+    limiter_configure(limiter, 1, 2, 0);
+
+    assert_true(limiter_acquire(limiter, &tickets[0], 0, NULL));
+    assert_true(limiter_acquire(limiter, &tickets[1], 0, NULL));
+    assert_false(limiter_acquire(limiter, &tickets[2], 0, NULL));
+
+    /* the next token is due within a second */
+    uint32_t wait = limiter_poll(limiter, &tickets[2]);
+    assert_true(wait > 0 && wait <= 1000);
+
+    /* finished restarts do not give back their tokens */
+    limiter_release(limiter, &tickets[0]);
+    limiter_release(limiter, &tickets[1]);
+    assert_false(tickets[2].admitted);
+
+    /* pretend a second has passed */
+    limiter->refilled -= 1000;
+    assert_int_equal(0, limiter_poll(limiter, &tickets[2]));
+    assert_false(limiter_acquire(limiter, &tickets[3], 0, NULL));
+
+    limiter_release(limiter, &tickets[2]);
+    limiter_release(limiter, &tickets[3]);
+    assert_int_equal(0, limiter->inflight);
+    assert_int_equal(0, limiter_queued(limiter));
+
+    limiter_destroy(limiter);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
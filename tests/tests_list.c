@@ -107,4 +107,85 @@ test_list_pop_empty(UNUSED void **state)
     list_destroy(list);
 }
 
+void
+test_list_recycle(UNUSED void **state)
+{
+    void *value = NULL;
+    list_t *list = list_new(NULL);
+
+    list_add(list, "foo");
+    list_add(list, "bar");
+
+    list_node_t *node = list->head;
+
+    assert_true(list_pop(list, &value));
+    assert_string_equal("foo", value);
+
+    /* the removed node is reused */
+    list_add(list, "ham");
+
+    assert_ptr_equal(node, list->tail);
+    assert_string_equal("ham", list->tail->data);
+    assert_string_equal("bar", list->head->data);
+
+    for (uintptr_t i = 0; i < 1000; i++)
+        list_add(list, (void *)i);
+
+    assert_int_equal(1002, list_size(list));
+
+    list_remove(list, list->head);
+    list_remove(list, list->head);
+
+    for (uintptr_t i = 0; i < 1000; i++)
+    {
+        assert_true(list_pop(list, &value));
+        assert_int_equal(i, (uintptr_t)value);
+    }
+
+    assert_int_equal(0, list_size(list));
+    assert_null(list->head);
+    assert_null(list->tail);
+
+    list_destroy(list);
+}
+
+typedef struct
+{
+    int32_t value;
+    list_node_t node;
+} list_element_t;
+
+void
+test_list_intrusive(UNUSED void **state)
+{
+    void *value = NULL;
+    list_element_t elements[3] = { { .value = 1 }, { .value = 2 }, { .value = 3 } };
+
+    list_t *list = list_new_intrusive(NULL);
+
+    for (uint32_t i = 0; i < LEN(elements); i++)
+        list_push(list, &elements[i].node, &elements[i]);
+
+    assert_int_equal(3, list_size(list));
+    assert_ptr_equal(&elements[0].node, list->head);
+    assert_ptr_equal(&elements[2].node, list->tail);
+
+    /* removal is O(1) via the embedded node */
+    list_remove(list, &elements[1].node);
+
+    assert_int_equal(2, list_size(list));
+    assert_ptr_equal(list->head->next, list->tail);
+
+    assert_true(list_pop(list, &value));
+    assert_ptr_equal(&elements[0], value);
+
+    /* the node may be linked again */
+    list_push(list, &elements[0].node, &elements[0]);
+
+    assert_ptr_equal(&elements[2].node, list->head);
+    assert_ptr_equal(&elements[0].node, list->tail);
+
+    list_destroy(list);
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -27,4 +27,10 @@ test_list_pop(void **state);
 void
 test_list_pop_empty(void **state);
 
+void
+test_list_recycle(void **state);
+
+void
+test_list_intrusive(void **state);
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,65 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_listen.h"
+#include "../src/listen.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void
+test_listen_address_valid(UNUSED void **state)
+{
+    assert_true(listen_address_valid("8080"));
+    assert_true(listen_address_valid("localhost:8080"));
+    assert_true(listen_address_valid("0.0.0.0:80"));
+    assert_true(listen_address_valid("[::1]:8080"));
+    assert_true(listen_address_valid("unix:/run/app.sock"));
+    assert_true(listen_address_valid("/run/app.sock"));
+
+    assert_false(listen_address_valid(""));
+    assert_false(listen_address_valid("0"));
+    assert_false(listen_address_valid("65536"));
+    assert_false(listen_address_valid("localhost:"));
+    assert_false(listen_address_valid("localhost:http"));
+    assert_false(listen_address_valid("[::1]"));
+    assert_false(listen_address_valid("unix:"));
+}
+
+void
+test_listen_socket_open(UNUSED void **state)
+{
+    struct stat info;
+    const char *address = "unix:/tmp/nyx-test-listen.sock";
+
+    int32_t fd = listen_socket_open(address);
+
+    assert_true(fd >= 0);
+    assert_int_equal(0, stat("/tmp/nyx-test-listen.sock", &info));
+    assert_true(S_ISSOCK(info.st_mode));
+
+    /* the socket is not leaked into spawned processes */
+    assert_true(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+
+    listen_socket_close(fd, address);
+
+    assert_int_equal(-1, stat("/tmp/nyx-test-listen.sock", &info));
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
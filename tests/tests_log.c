@@ -0,0 +1,73 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tests.h"
+#include "tests_log.h"
+#include "../src/log.h"
+
+#include <string.h>
+
+void
+test_log_parse_level(UNUSED void **state)
+{
+    uint32_t level = 0, categories = 0;
+
+    assert_true(log_parse_level("warn", &level, &categories));
+    assert_int_equal(NYX_LOG_WARN, level);
+    assert_int_equal(0, categories);
+
+    assert_true(log_parse_level("info proc,forker", &level, &categories));
+    assert_int_equal(NYX_LOG_INFO, level);
+    assert_int_equal(NYX_LOG_PROC | NYX_LOG_FORKER, categories);
+
+    assert_true(log_parse_level("error state", &level, &categories));
+    assert_int_equal(NYX_LOG_ERROR, level);
+    assert_int_equal(NYX_LOG_STATE, categories);
+
+    assert_false(log_parse_level("verbose", &level, &categories));
+    assert_false(log_parse_level("info foo", &level, &categories));
+}
+
+void
+test_log_set_level(UNUSED void **state)
+{
+    char buffer[64];
+
+    assert_true(log_set_level("warn connector event"));
+
+    assert_false(log_enabled(NYX_LOG_INFO));
+    assert_true(log_enabled(NYX_LOG_WARN));
+    assert_true(log_enabled(NYX_LOG_CRITICAL));
+    assert_int_equal(NYX_LOG_EVENT | NYX_LOG_CONNECTOR, log_categories);
+
+    log_level_string(buffer, sizeof(buffer));
+    assert_string_equal("warn event connector", buffer);
+
+    /* invalid levels keep the current one */
+    assert_false(log_set_level("foo"));
+    assert_false(log_enabled(NYX_LOG_INFO));
+
+    assert_true(log_set_level("debug"));
+    assert_true(log_enabled(NYX_LOG_DEBUG));
+    assert_true(log_enabled(NYX_LOG_INFO));
+
+    log_level_string(buffer, sizeof(buffer));
+    assert_string_equal("debug", buffer);
+
+    assert_true(log_set_level(NULL));
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
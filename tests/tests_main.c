@@ -14,16 +14,47 @@
  */
 
 #include "tests.h"
+#include "tests_arena.h"
+#include "tests_capture.h"
+#include "tests_cgroup.h"
+#include "tests_check.h"
 #include "tests_config.h"
+#include "tests_connector.h"
+#include "tests_fleet.h"
 #include "tests_fs.h"
 #include "tests_hash.h"
+#include "tests_http.h"
+#include "tests_journal.h"
+#include "tests_json.h"
+#include "tests_limiter.h"
 #include "tests_list.h"
+#include "tests_listen.h"
+#include "tests_log.h"
+#include "tests_matcher.h"
+#include "tests_metrics.h"
+#include "tests_persist.h"
+#include "tests_pidmap.h"
+#include "tests_pressure.h"
+#include "tests_prometheus.h"
+#include "tests_taskstats.h"
 #include "tests_proc.h"
+#include "tests_reactor.h"
+#include "tests_resolver.h"
+#include "tests_sockdiag.h"
+#include "tests_snapshot.h"
 #include "tests_socket.h"
+#include "tests_spawnattr.h"
+#include "tests_startup.h"
+#include "tests_state.h"
+#include "tests_status.h"
+#include "tests_stats.h"
 #include "tests_strbuf.h"
+#include "tests_subscribe.h"
 #include "tests_timestack.h"
+#include "tests_uring.h"
 #include "tests_utils.h"
 #include "tests_watch.h"
+#include "tests_wheel.h"
 
 int
 main(UNUSED int argc, UNUSED char **argv)
@@ -31,15 +62,57 @@ main(UNUSED int argc, UNUSED char **argv)
     const struct CMUnitTest tests[] =
     {
         cmocka_unit_test(test_config_parse_files),
+        cmocka_unit_test(test_config_cache),
+        cmocka_unit_test(test_config_image),
         cmocka_unit_test(test_list_create),
         cmocka_unit_test(test_list_add),
         cmocka_unit_test(test_list_pop),
         cmocka_unit_test(test_list_pop_empty),
+        cmocka_unit_test(test_list_recycle),
+        cmocka_unit_test(test_list_intrusive),
         cmocka_unit_test(test_hash_create),
         cmocka_unit_test(test_hash_add),
         cmocka_unit_test(test_hash_remove),
+        cmocka_unit_test(test_hash_take),
+        cmocka_unit_test(test_hash_iterate),
+        cmocka_unit_test(test_hash_long_keys),
+        cmocka_unit_test(test_arena_alloc),
+        cmocka_unit_test(test_arena_seal_watch),
+        cmocka_unit_test(test_stats_buckets),
+        cmocka_unit_test(test_stats_record),
+        cmocka_unit_test(test_pidmap_add),
+        cmocka_unit_test(test_pidmap_remove),
+        cmocka_unit_test(test_reactor_timer),
+        cmocka_unit_test(test_reactor_fd),
+        cmocka_unit_test(test_wheel_tick),
+        cmocka_unit_test(test_wheel_reschedule),
+        cmocka_unit_test(test_startup_dependencies),
+        cmocka_unit_test(test_startup_concurrency),
+        cmocka_unit_test(test_startup_cycle),
+        cmocka_unit_test(test_startup_rollout),
+        cmocka_unit_test(test_state_queue_full),
+        cmocka_unit_test(test_matcher_select),
+        cmocka_unit_test(test_snapshot_cache),
+        cmocka_unit_test(test_http_parse_request),
+        cmocka_unit_test(test_http_pipelined),
+        cmocka_unit_test(test_connector_parse_frame),
+        cmocka_unit_test(test_connector_respond),
+        cmocka_unit_test(test_prometheus_labels),
+        cmocka_unit_test(test_prometheus_taskstats),
+        cmocka_unit_test(test_subscribe_events),
+        cmocka_unit_test(test_subscribe_overflow),
+        cmocka_unit_test(test_subscribe_sse),
+        cmocka_unit_test(test_subscribe_hangup),
+        cmocka_unit_test(test_fleet_protocol),
+        cmocka_unit_test(test_fleet_reconnect),
+        cmocka_unit_test(test_fleet_federation),
+        cmocka_unit_test(test_resolver_lookup),
+        cmocka_unit_test(test_check_port_async),
+        cmocka_unit_test(test_check_http_keep_alive),
+        cmocka_unit_test(test_check_async),
         cmocka_unit_test(test_timestack_create),
         cmocka_unit_test(test_timestack_add),
+        cmocka_unit_test(test_timestack_window),
         cmocka_unit_test(test_fs_parent_dir),
         cmocka_unit_test(test_fs_find_local_socket_path),
         cmocka_unit_test(test_fs_create_if_not_exists),
@@ -48,14 +121,61 @@ main(UNUSED int argc, UNUSED char **argv)
         cmocka_unit_test(test_proc_stat),
         cmocka_unit_test(test_proc_num_cpus),
         cmocka_unit_test(test_proc_page_size),
+        cmocka_unit_test(test_proc_parse_stat),
+        cmocka_unit_test(test_proc_stack_aggregates),
+        cmocka_unit_test(test_proc_fork_tree),
+        cmocka_unit_test(test_proc_shards),
+        cmocka_unit_test(test_proc_uring),
+        cmocka_unit_test(test_cgroup_watch_path),
+        cmocka_unit_test(test_cgroup_read_stats),
+        cmocka_unit_test(test_pressure_trigger_valid),
+        cmocka_unit_test(test_listen_address_valid),
+        cmocka_unit_test(test_listen_socket_open),
+        cmocka_unit_test(test_parse_index_list),
+        cmocka_unit_test(test_ionice_parse),
+        cmocka_unit_test(test_rlimit_parse),
+        cmocka_unit_test(test_sched_policy_from_string),
+        cmocka_unit_test(test_taskstats_parse),
+        cmocka_unit_test(test_uring_read),
+        cmocka_unit_test(test_metrics_encode),
+        cmocka_unit_test(test_metrics_rollup),
+        cmocka_unit_test(test_metrics_budget),
+        cmocka_unit_test(test_persist_slots),
+        cmocka_unit_test(test_persist_invalid),
+        cmocka_unit_test(test_status_records),
+        cmocka_unit_test(test_status_query),
+        cmocka_unit_test(test_journal_query),
+        cmocka_unit_test(test_journal_rotate),
+        cmocka_unit_test(test_journal_parse_time),
+        cmocka_unit_test(test_limiter_unlimited),
+        cmocka_unit_test(test_limiter_priority),
+        cmocka_unit_test(test_limiter_concurrency),
+        cmocka_unit_test(test_limiter_rate),
+        cmocka_unit_test(test_capture_rotate),
+        cmocka_unit_test(test_process_start_time),
         cmocka_unit_test(test_parse_size_unit),
+        cmocka_unit_test(test_parse_msecs_unit),
+        cmocka_unit_test(test_parse_signal),
         cmocka_unit_test(test_parse_command_string),
         cmocka_unit_test(test_substitute_env_string),
+        cmocka_unit_test(test_mem_usage),
+        cmocka_unit_test(test_thread_stack_size),
         cmocka_unit_test(test_check_http),
         cmocka_unit_test(test_check_port),
         cmocka_unit_test(test_parse_endpoint),
+        cmocka_unit_test(test_http_status_parse),
+        cmocka_unit_test(test_http_url_parse),
+        cmocka_unit_test(test_notify_socket_ready),
+        cmocka_unit_test(test_sockdiag_listening),
         cmocka_unit_test(test_strbuf_append),
-        cmocka_unit_test(test_is_all)
+        cmocka_unit_test(test_strbuf_append_fast),
+        cmocka_unit_test(test_json_writer),
+        cmocka_unit_test(test_json_escape),
+        cmocka_unit_test(test_log_parse_level),
+        cmocka_unit_test(test_log_set_level),
+        cmocka_unit_test(test_is_all),
+        cmocka_unit_test(test_watch_equal),
+        cmocka_unit_test(test_watch_instance_name)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
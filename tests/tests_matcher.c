@@ -0,0 +1,53 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_matcher.h"
+#include "../src/matcher.h"
+
+void
+test_matcher_select(UNUSED void **state)
+{
+    matcher_t matcher;
+
+    assert_true(matcher_init(&matcher, "api", false));
+    assert_false(matcher_is_bulk(&matcher));
+    assert_true(matcher_match(&matcher, "api"));
+    assert_false(matcher_match(&matcher, "api-1"));
+    matcher_free(&matcher);
+
+    assert_true(matcher_init(&matcher, "all", false));
+    assert_true(matcher_is_bulk(&matcher));
+    assert_true(matcher_match(&matcher, "anything"));
+    matcher_free(&matcher);
+
+    assert_true(matcher_init(&matcher, "api-*", false));
+    assert_true(matcher_is_bulk(&matcher));
+    assert_true(matcher_match(&matcher, "api-1"));
+    assert_true(matcher_match(&matcher, "api-"));
+    assert_false(matcher_match(&matcher, "worker-1"));
+    matcher_free(&matcher);
+
+    assert_true(matcher_init(&matcher, "^worker-[0-9]+$", true));
+    assert_true(matcher_is_bulk(&matcher));
+    assert_true(matcher_match(&matcher, "worker-12"));
+    assert_false(matcher_match(&matcher, "worker-"));
+    assert_false(matcher_match(&matcher, "worker-1a"));
+    matcher_free(&matcher);
+
+    assert_false(matcher_init(&matcher, "(", true));
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
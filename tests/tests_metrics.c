@@ -0,0 +1,139 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_metrics.h"
+#include "../src/metrics.h"
+
+void
+test_metrics_encode(UNUSED void **state)
+{
+    metrics_t *metrics = metrics_new(64 * 1024);
+    metrics_iter_t iter;
+    time_t time, start = 1500000000;
+    double value;
+    uint32_t i = 0;
+
+    /* regular and irregular intervals, constant and changing values */
+    for (i = 0; i < 2000; i++)
+    {
+        time_t t = start + i + (i % 7 == 0 ? 3 : 0) + (i == 1000 ? 5000 : 0);
+
+        metrics_add(metrics, t, (i / 10) % 100, 1024 + (i % 13) * 4096.5);
+    }
+
+    metrics_iter_start(&iter, metrics, METRICS_CPU, METRICS_RAW);
+
+    for (i = 0; metrics_iter_next(&iter, &time, &value); i++)
+    {
+        time_t t = start + i + (i % 7 == 0 ? 3 : 0) + (i == 1000 ? 5000 : 0);
+
+        assert_int_equal(t, time);
+        assert_true(value == (i / 10) % 100);
+    }
+
+    assert_int_equal(2000, i);
+
+    metrics_iter_start(&iter, metrics, METRICS_MEMORY, METRICS_RAW);
+
+    for (i = 0; metrics_iter_next(&iter, &time, &value); i++)
+        assert_true(value == 1024 + (i % 13) * 4096.5);
+
+    assert_int_equal(2000, i);
+
+    metrics_destroy(metrics);
+}
+
+void
+test_metrics_rollup(UNUSED void **state)
+{
+    metrics_t *metrics = metrics_new(64 * 1024);
+    metrics_iter_t iter;
+    time_t time, start = 1500000000 - 1500000000 % 3600;
+    double value;
+    uint32_t i = 0;
+
+    /* two and a half hours of samples every 10 seconds */
+    for (i = 0; i < 900; i++)
+        metrics_add(metrics, start + i * 10, (i / 6) % 2 ? 50 : 10, 2048);
+
+    metrics_iter_start(&iter, metrics, METRICS_CPU, METRICS_MINUTE);
+
+    for (i = 0; metrics_iter_next(&iter, &time, &value); i++)
+    {
+        assert_int_equal(start + i * 60, time);
+        assert_true(value == (i % 2 ? 50 : 10));
+    }
+
+    /* the current minute is not finished yet */
+    assert_int_equal(149, i);
+
+    metrics_iter_start(&iter, metrics, METRICS_CPU, METRICS_HOUR);
+
+    for (i = 0; metrics_iter_next(&iter, &time, &value); i++)
+    {
+        assert_int_equal(start + i * 3600, time);
+        assert_true(value == 30);
+    }
+
+    assert_int_equal(2, i);
+
+    metrics_iter_start(&iter, metrics, METRICS_MEMORY, METRICS_HOUR);
+
+    assert_true(metrics_iter_next(&iter, &time, &value));
+    assert_true(value == 2048);
+
+    metrics_destroy(metrics);
+}
+
+void
+test_metrics_budget(UNUSED void **state)
+{
+    metrics_t *metrics = metrics_new(8 * 1024);
+    metrics_iter_t iter;
+    time_t time, first = 0, last = 0;
+    double value;
+    uint32_t i = 0, count = 0;
+
+    assert_true(metrics_size(metrics) <= 8 * 1024 + sizeof(metrics_t));
+
+    /* random values compress badly and exceed the budget */
+    srand(42);
+
+    for (i = 0; i < 100000; i++)
+        metrics_add(metrics, 1500000000 + i, rand() % 1000 / 10.0, rand());
+
+    assert_true(metrics_size(metrics) <= 8 * 1024 + sizeof(metrics_t));
+
+    /* the oldest samples were dropped */
+    metrics_iter_start(&iter, metrics, METRICS_MEMORY, METRICS_RAW);
+
+    while (metrics_iter_next(&iter, &time, &value))
+    {
+        if (count++ == 0)
+            first = time;
+
+        assert_true(time >= last);
+        last = time;
+    }
+
+    assert_true(count > 0);
+    assert_true(first > 1500000000);
+    assert_int_equal(1500000000 + 99999, last);
+
+    metrics_destroy(metrics);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
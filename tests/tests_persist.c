@@ -0,0 +1,157 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_persist.h"
+#include "../src/persist.h"
+#include "../src/process.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+static hash_t *
+watch_names(const char **names)
+{
+    hash_t *hash = hash_new(NULL);
+
+    while (*names)
+    {
+        hash_add(hash, *names, (void *)*names);
+        names++;
+    }
+
+    return hash;
+}
+
+static void
+remove_dir(const char *dir)
+{
+    char *command = NULL;
+    assert_true(asprintf(&command, "rm -rf %s", dir) > 0);
+    assert_int_equal(0, system(command));
+    free(command);
+}
+
+void
+test_persist_slots(UNUSED void **state)
+{
+    char dir[] = "/tmp/nyx-persist-XXXXXX";
+    const char *first[] = { "app", "db", NULL };
+    const char *second[] = { "db", "web", "cache", NULL };
+
+    assert_non_null(mkdtemp(dir));
+
+    persist_t *persist = persist_open(dir);
+    assert_non_null(persist);
+    assert_int_equal(0, persist->header->slots);
+
+    hash_t *watches = watch_names(first);
+    assert_true(persist_prepare(persist, watches));
+    assert_int_equal(2, persist->header->slots);
+
+    int32_t app = persist_slot(persist, "app");
+    int32_t db = persist_slot(persist, "db");
+
+    assert_true(app >= 0 && db >= 0 && app != db);
+    assert_int_equal(db, persist_slot(persist, "db"));
+
+    persist_slot_t *slot = persist_get(persist, db);
+    slot->pid = 1234;
+    slot->start_time = 5678;
+    slot->failed_counter = 3;
+    slot->history_count = 1;
+    slot->history[0].time = 1500000000;
+    slot->history[0].value = 2;
+
+    persist_close(persist);
+    hash_destroy(watches);
+
+    /* the slots survive reopening */
+    persist = persist_open(dir);
+    assert_non_null(persist);
+    assert_int_equal(2, persist->header->slots);
+
+    watches = watch_names(second);
+    assert_true(persist_prepare(persist, watches));
+
+    /* the slot of the removed watch is reused */
+    assert_int_equal(3, persist->header->slots);
+    assert_int_equal(db, persist_slot(persist, "db"));
+    assert_int_equal(-1, persist_slot(persist, "some-watch-with-a-name-that-is-way-too-long-to-be-persisted-at-all"));
+
+    slot = persist_get(persist, persist_slot(persist, "db"));
+    assert_int_equal(1234, slot->pid);
+    assert_int_equal(5678, slot->start_time);
+    assert_int_equal(3, slot->failed_counter);
+    assert_int_equal(1, slot->history_count);
+    assert_int_equal(1500000000, slot->history[0].time);
+    assert_int_equal(2, slot->history[0].value);
+
+    int32_t web = persist_slot(persist, "web");
+    int32_t cache = persist_slot(persist, "cache");
+
+    assert_true(web >= 0 && cache >= 0 && web != cache && web != db && cache != db);
+    assert_int_equal(0, persist_get(persist, web)->pid);
+    assert_null(persist_get(persist, 3));
+
+    persist_close(persist);
+    hash_destroy(watches);
+
+    remove_dir(dir);
+}
+
+void
+test_persist_invalid(UNUSED void **state)
+{
+    char dir[] = "/tmp/nyx-persist-XXXXXX";
+    char *path = NULL;
+
+    assert_non_null(mkdtemp(dir));
+    assert_true(asprintf(&path, "%s/nyx.state", dir) > 0);
+
+    FILE *file = fopen(path, "w");
+    assert_non_null(file);
+    fputs("garbage of an unknown layout", file);
+    fclose(file);
+
+    /* the invalid file is replaced by an empty table */
+    persist_t *persist = persist_open(dir);
+    assert_non_null(persist);
+    assert_int_equal(PERSIST_MAGIC, persist->header->magic);
+    assert_int_equal(0, persist->header->slots);
+    assert_int_equal(-1, persist_slot(persist, "app"));
+
+    persist_close(persist);
+    free(path);
+
+    remove_dir(dir);
+}
+
+void
+test_process_start_time(UNUSED void **state)
+{
+#ifndef OSX
+    uint64_t start = process_start_time(getpid());
+
+    assert_true(start > 0);
+    assert_true(start == process_start_time(getpid()));
+    assert_true(start != process_start_time(1));
+    assert_int_equal(0, process_start_time(-1));
+#endif
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
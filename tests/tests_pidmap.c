@@ -0,0 +1,82 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_pidmap.h"
+#include "../src/pidmap.h"
+
+void
+test_pidmap_add(UNUSED void **state)
+{
+    uint32_t size = 1000;
+    pidmap_t *map = pidmap_new();
+
+    assert_int_equal(0, pidmap_count(map));
+
+    /* invalid pids are rejected */
+    assert_false(pidmap_add(map, 0, map));
+    assert_false(pidmap_add(map, -1, map));
+
+    for (uint32_t i = 1; i <= size; i++)
+        assert_true(pidmap_add(map, i * 7, (void *)(uintptr_t)i));
+
+    assert_int_equal(size, pidmap_count(map));
+
+    for (uint32_t i = 1; i <= size; i++)
+        assert_int_equal(i, (uintptr_t)pidmap_get(map, i * 7));
+
+    assert_null(pidmap_get(map, 8));
+    assert_null(pidmap_get(map, 0));
+
+    /* existing pids are replaced */
+    assert_true(pidmap_add(map, 7, map));
+    assert_int_equal(size, pidmap_count(map));
+    assert_ptr_equal(map, pidmap_get(map, 7));
+
+    pidmap_destroy(map);
+}
+
+void
+test_pidmap_remove(UNUSED void **state)
+{
+    int32_t a = 0, b = 0;
+    pidmap_t *map = pidmap_new();
+
+    assert_true(pidmap_add(map, 100, &a));
+    assert_true(pidmap_add(map, 200, &b));
+
+    /* removal is restricted to the given data */
+    assert_false(pidmap_remove(map, 100, &b));
+    assert_true(pidmap_remove(map, 100, &a));
+    assert_false(pidmap_remove(map, 100, NULL));
+
+    assert_null(pidmap_get(map, 100));
+    assert_ptr_equal(&b, pidmap_get(map, 200));
+    assert_int_equal(1, pidmap_count(map));
+
+    /* tombstones are reused and cleaned up */
+    for (int32_t i = 0; i < 10000; i++)
+    {
+        assert_true(pidmap_add(map, 1000 + i, &a));
+        assert_true(pidmap_remove(map, 1000 + i, NULL));
+    }
+
+    assert_int_equal(1, pidmap_count(map));
+    assert_ptr_equal(&b, pidmap_get(map, 200));
+
+    pidmap_destroy(map);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
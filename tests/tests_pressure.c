@@ -0,0 +1,42 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_pressure.h"
+#include "../src/pressure.h"
+
+void
+test_pressure_trigger_valid(UNUSED void **state)
+{
+#ifndef OSX
+    assert_true(pressure_trigger_valid("some 150000 1000000"));
+    assert_true(pressure_trigger_valid("full 500000 500000"));
+
+    /* unknown type */
+    assert_false(pressure_trigger_valid("any 150000 1000000"));
+
+    /* window out of range */
+    assert_false(pressure_trigger_valid("some 1000 100000"));
+    assert_false(pressure_trigger_valid("some 150000 20000000"));
+
+    /* stall exceeds the window */
+    assert_false(pressure_trigger_valid("some 2000000 1000000"));
+
+    assert_false(pressure_trigger_valid("some 150000"));
+    assert_false(pressure_trigger_valid(""));
+#endif
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
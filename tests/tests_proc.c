@@ -13,12 +13,17 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+
 #include "tests.h"
 #include "tests_proc.h"
 #include "../src/proc.h"
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 void
@@ -79,5 +84,218 @@ test_proc_stat(UNUSED void **state)
     free(stat);
 }
 
+void
+test_proc_parse_stat(UNUSED void **state)
+{
+    sys_info_t info;
+
+    /* process names may contain whitespace and parentheses */
+    const char *stat = "1234 (my (odd) proc) S 1 1234 1234 0 -1 4194560 "
+        "100 0 0 0 42 17 3 -1 20 0 1 0 1000 8192000 512 18446744073709551615";
+
+    assert_true(sys_info_parse(&info, stat, 4096));
+    assert_int_equal(42, info.user_time);
+    assert_int_equal(17, info.system_time);
+    assert_int_equal(3, info.child_user_time);
+    assert_int_equal(-1, info.child_system_time);
+    assert_int_equal(8192000, info.virtual_size);
+    assert_int_equal(512 * 4, info.resident_set_size);
+    assert_int_equal(42 + 17 + 3 - 1, info.total_time);
+
+    assert_false(sys_info_parse(&info, "1234 (truncated", 4096));
+    assert_false(sys_info_parse(&info, "1234 (short) S 1 2 3", 4096));
+}
+
+void
+test_proc_stack_aggregates(UNUSED void **state)
+{
+    stack_long_t *stack = stack_long_new(4);
+
+    stack_long_set_threshold(stack, 10);
+
+    for (uint64_t i = 1; i <= 6; i++)
+        stack_long_add(stack, i * 4);
+
+    /* only the latest 4 samples remain: 12, 16, 20, 24 */
+    assert_int_equal(4, stack->count);
+    assert_int_equal(24, stack_long_newest(stack));
+    assert_int_equal(12, stack_long_get(stack, 3));
+    assert_int_equal(4, stack_long_over(stack));
+    assert_true(stack_long_mean(stack) == 18.0);
+
+    stack_long_add(stack, 1);
+    stack_long_add(stack, 2);
+
+    assert_int_equal(2, stack_long_over(stack));
+    assert_int_equal(47, stack->sum);
+
+    /* changing the threshold recounts the present samples */
+    stack_long_set_threshold(stack, 21);
+    assert_int_equal(1, stack_long_over(stack));
+
+    stack_long_destroy(stack);
+}
+
+void
+test_proc_fork_tree(UNUSED void **state)
+{
+    nyx_proc_t *proc = nyx_proc_new();
+    watch_t *watch = watch_new(strdup("app"));
+
+    watch->max_memory = 1024;
+
+    /* the watched process forked before it was added */
+    nyx_proc_fork(proc, 1000, 1001);
+    nyx_proc_fork(proc, 1001, 1002);
+    nyx_proc_fork(proc, 2000, 2001);
+
+    nyx_proc_add(proc, 1000, watch->name, watch);
+
+    assert_non_null(pidmap_get(proc->children, 1001));
+    assert_non_null(pidmap_get(proc->children, 1002));
+    assert_null(pidmap_get(proc->children, 2001));
+
+    /* forks of tracked processes are added immediately */
+    nyx_proc_fork(proc, 1002, 1003);
+    assert_non_null(pidmap_get(proc->children, 1003));
+
+    nyx_proc_remove(proc, 1002);
+    assert_null(pidmap_get(proc->children, 1002));
+    assert_non_null(pidmap_get(proc->children, 1003));
+
+    /* removing the watched process drops the whole tree */
+    nyx_proc_remove(proc, 1000);
+    assert_null(pidmap_get(proc->children, 1001));
+    assert_null(pidmap_get(proc->children, 1003));
+    assert_int_equal(0, pidmap_count(proc->children));
+
+    nyx_proc_destroy(proc);
+    watch_destroy(watch);
+}
+
+void
+test_proc_shards(UNUSED void **state)
+{
+    pid_t pids[3] = {0};
+    nyx_proc_t *proc = nyx_proc_new();
+    watch_t *watch = watch_new(strdup("app"));
+
+    assert_true(nyx_proc_start_shards(proc, 2));
+
+    for (uint32_t i = 0; i < LEN(pids); i++)
+    {
+        if ((pids[i] = fork()) == 0)
+        {
+            pause();
+            _exit(0);
+        }
+
+        nyx_proc_add(proc, pids[i], watch->name, watch);
+    }
+
+    /* the processes are distributed over the shards */
+    proc_stat_t *first = proc->processes->head->data;
+    proc_stat_t *second = proc->processes->head->next->data;
+    proc_stat_t *third = proc->processes->tail->data;
+
+    assert_ptr_equal(&proc->shards[0], first->shard);
+    assert_ptr_equal(&proc->shards[1], second->shard);
+    assert_ptr_equal(&proc->shards[0], third->shard);
+
+    /* the first samples are due within one interval */
+    usleep(1100000);
+    nyx_proc_check(proc);
+
+    for (list_node_t *node = proc->processes->head; node; node = node->next)
+    {
+        proc_stat_t *stat = node->data;
+
+        assert_int_equal(1, stat->cpu_usage->count);
+        assert_int_equal(1, stat->mem_usage->count);
+    }
+
+    assert_int_equal(0, proc->shards[0].pending.count);
+    assert_int_equal(0, proc->shards[1].pending.count);
+
+    nyx_proc_destroy(proc);
+    watch_destroy(watch);
+
+    for (uint32_t i = 0; i < LEN(pids); i++)
+    {
+        kill(pids[i], SIGTERM);
+        waitpid(pids[i], NULL, 0);
+    }
+}
+
+void
+test_proc_uring(UNUSED void **state)
+{
+#ifndef OSX
+    pid_t pids[2] = {0};
+    nyx_proc_t *proc = nyx_proc_new();
+    watch_t *watch = watch_new(strdup("app"));
+
+    /* the descendants are tracked for watches with limits */
+    watch->max_cpu = 1000;
+
+    /* io_uring may be unavailable (i.e. disabled via seccomp) */
+    if (!nyx_proc_use_uring(proc))
+    {
+        nyx_proc_destroy(proc);
+        watch_destroy(watch);
+        return;
+    }
+
+    for (uint32_t i = 0; i < LEN(pids); i++)
+    {
+        if ((pids[i] = fork()) == 0)
+        {
+            pause();
+            _exit(0);
+        }
+
+        nyx_proc_add(proc, pids[i], watch->name, watch);
+    }
+
+    /* a descendant that terminated without an exit event */
+    pid_t terminated = fork();
+
+    if (terminated == 0)
+        _exit(0);
+
+    waitpid(terminated, NULL, 0);
+    nyx_proc_fork(proc, pids[0], terminated);
+
+    assert_non_null(pidmap_get(proc->children, terminated));
+
+    /* the first samples are due within one interval */
+    usleep(1100000);
+    nyx_proc_check(proc);
+
+    for (list_node_t *node = proc->processes->head; node; node = node->next)
+    {
+        proc_stat_t *stat = node->data;
+
+        assert_int_equal(1, stat->cpu_usage->count);
+        assert_int_equal(1, stat->mem_usage->count);
+        assert_true(stat->stat_fd >= 0);
+    }
+
+    /* /proc/stat was read as part of the sweep */
+    assert_true(proc->sys_proc.total > 0);
+    assert_int_equal(0, proc->pending.count);
+    assert_null(pidmap_get(proc->children, terminated));
+    assert_non_null(proc->uring);
+
+    nyx_proc_destroy(proc);
+    watch_destroy(watch);
+
+    for (uint32_t i = 0; i < LEN(pids); i++)
+    {
+        kill(pids[i], SIGTERM);
+        waitpid(pids[i], NULL, 0);
+    }
+#endif
+}
 
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -30,4 +30,19 @@ test_proc_page_size(void **state);
 void
 test_proc_num_cpus(void **state);
 
+void
+test_proc_parse_stat(void **state);
+
+void
+test_proc_stack_aggregates(void **state);
+
+void
+test_proc_fork_tree(void **state);
+
+void
+test_proc_shards(void **state);
+
+void
+test_proc_uring(void **state);
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,102 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_prometheus.h"
+#include "../src/nyx.h"
+#include "../src/prometheus.h"
+#include "../src/state.h"
+#include "../src/watch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void
+test_prometheus_labels(UNUSED void **state)
+{
+    char *labels = prometheus_labels("app", "app-2");
+
+    assert_string_equal("watch=\"app\",instance=\"app-2\"", labels);
+    free(labels);
+
+    /* quotes, backslashes and newlines are escaped */
+    labels = prometheus_labels("a\"b", "c\\d\n");
+
+    assert_string_equal("watch=\"a\\\"b\",instance=\"c\\\\d\\n\"", labels);
+    free(labels);
+}
+
+void
+test_prometheus_taskstats(UNUSED void **state)
+{
+    nyx_t *nyx = xcalloc1(sizeof(nyx_t));
+    state_t *app = xcalloc1(sizeof(state_t));
+    watch_t *watch = watch_new(strdup("app"));
+    strbuf_t *out = strbuf_new();
+
+    app->pid = 4242;
+    app->state = STATE_STOPPING;
+    app->labels = prometheus_labels("app", "app");
+
+    nyx->states = list_new(NULL);
+    nyx->proc = nyx_proc_new();
+
+    list_add(nyx->states, app);
+    nyx_proc_add(nyx->proc, 4242, "app", watch);
+
+    /* no series before the first taskstats sample */
+    prometheus_render(out, nyx);
+
+    assert_non_null(strstr(out->buf, "# TYPE nyx_watch_io_read_bytes_total counter\n"));
+    assert_null(strstr(out->buf, "nyx_watch_io_read_bytes_total{"));
+
+    proc_stat_t *proc = nyx->proc->processes->head->data;
+
+    proc->stats.valid = true;
+    proc->stats.read_bytes = 8192;
+    proc->stats.write_bytes = 512;
+    proc->stats.cpu_delay = 1500000000;
+    proc->stats.blkio_delay = 250000;
+    proc->stats.swapin_delay = 0;
+    proc->stats.hiwater_rss = 2048;
+
+    strbuf_clear(out);
+    prometheus_render(out, nyx);
+
+    assert_non_null(strstr(out->buf,
+                "nyx_watch_io_read_bytes_total{watch=\"app\",instance=\"app\"} 8192\n"));
+    assert_non_null(strstr(out->buf,
+                "nyx_watch_io_write_bytes_total{watch=\"app\",instance=\"app\"} 512\n"));
+    assert_non_null(strstr(out->buf,
+                "nyx_watch_cpu_delay_seconds_total{watch=\"app\",instance=\"app\"} 1.500000\n"));
+    assert_non_null(strstr(out->buf,
+                "nyx_watch_blkio_delay_seconds_total{watch=\"app\",instance=\"app\"} 0.000250\n"));
+    assert_non_null(strstr(out->buf,
+                "nyx_watch_swapin_delay_seconds_total{watch=\"app\",instance=\"app\"} 0.000000\n"));
+    assert_non_null(strstr(out->buf,
+                "nyx_watch_memory_peak_bytes{watch=\"app\",instance=\"app\"} 2097152\n"));
+
+    nyx_proc_destroy(nyx->proc);
+    watch_destroy(watch);
+    list_destroy(nyx->states);
+    strbuf_free(out);
+    free(app->labels);
+    xfree(app);
+    xfree(nyx);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
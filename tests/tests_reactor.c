@@ -0,0 +1,94 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "tests.h"
+#include "tests_reactor.h"
+#include "../src/reactor.h"
+
+#include <unistd.h>
+
+static void
+count_and_stop(reactor_t *reactor, void *data)
+{
+    int32_t *count = data;
+
+    if (++(*count) >= 3)
+        reactor_stop(reactor);
+}
+
+static void
+never_called(UNUSED reactor_t *reactor, void *data)
+{
+    int32_t *count = data;
+
+    (*count)++;
+}
+
+void
+test_reactor_timer(UNUSED void **state)
+{
+    int32_t repeated = 0, removed = 0;
+    reactor_t *reactor = reactor_new();
+
+    assert_non_null(reactor);
+
+    assert_true(reactor_add_timer(reactor, 5, true, count_and_stop, &repeated) >= 0);
+
+    int32_t timer = reactor_add_timer(reactor, 1, false, never_called, &removed);
+    assert_true(timer >= 0);
+    reactor_remove_timer(reactor, timer);
+
+    assert_true(reactor_run(reactor));
+
+    assert_int_equal(3, repeated);
+    assert_int_equal(0, removed);
+
+    reactor_destroy(reactor);
+}
+
+static void
+read_and_stop(reactor_t *reactor, int32_t fd, uint32_t events, void *data)
+{
+    char *buffer = data;
+
+    assert_true(events & REACTOR_READ);
+    assert_int_equal(1, read(fd, buffer, 1));
+
+    reactor_stop(reactor);
+}
+
+void
+test_reactor_fd(UNUSED void **state)
+{
+    int32_t fds[2];
+    char buffer = 0;
+    reactor_t *reactor = reactor_new();
+
+    assert_non_null(reactor);
+    assert_int_equal(0, pipe(fds));
+
+    assert_true(reactor_add_fd(reactor, fds[0], read_and_stop, &buffer));
+    assert_int_equal(1, write(fds[1], "x", 1));
+
+    assert_true(reactor_run(reactor));
+    assert_int_equal('x', buffer);
+
+    reactor_remove_fd(reactor, fds[0]);
+    reactor_destroy(reactor);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
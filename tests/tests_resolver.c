@@ -0,0 +1,55 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_resolver.h"
+#include "../src/resolver.h"
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+void
+test_resolver_lookup(UNUSED void **state)
+{
+    struct sockaddr_in addresses[RESOLVER_MAX_ADDRESSES];
+
+    resolver_t *resolver = resolver_new(60);
+    assert_non_null(resolver);
+
+    /* numeric addresses are answered immediately */
+    assert_int_equal(1, resolver_lookup(resolver, "127.0.0.1", addresses, RESOLVER_MAX_ADDRESSES));
+    assert_int_equal(htonl(INADDR_LOOPBACK), addresses[0].sin_addr.s_addr);
+    assert_null(resolver->thread);
+
+    /* host names are resolved in the background */
+    int32_t count = resolver_lookup(resolver, "localhost", addresses, RESOLVER_MAX_ADDRESSES);
+    assert_int_equal(RESOLVER_PENDING, count);
+    assert_non_null(resolver->thread);
+
+    for (int32_t i = 0; i < 100 && count == RESOLVER_PENDING; i++)
+    {
+        usleep(10000);
+        count = resolver_lookup(resolver, "localhost", addresses, RESOLVER_MAX_ADDRESSES);
+    }
+
+    assert_true(count > 0);
+    assert_int_equal(AF_INET, addresses[0].sin_family);
+
+    resolver_destroy(resolver);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,76 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_snapshot.h"
+#include "../src/snapshot.h"
+
+#include <string.h>
+
+static void
+render_count(strbuf_t *out, snapshot_type_e type, snapshot_format_e format, void *data)
+{
+    uint32_t *renders = data;
+
+    (*renders)++;
+
+    strbuf_append(out, "%s%u:%u\n", format == SNAPSHOT_HTTP ? ">>> " : "", type, *renders);
+}
+
+void
+test_snapshot_cache(UNUSED void **state)
+{
+    uint32_t renders = 0;
+    snapshot_t *snapshot = snapshot_new(render_count, &renders);
+
+    snapshot_buffer_t *first = snapshot_get(snapshot, SNAPSHOT_STATUS, SNAPSHOT_TEXT);
+    assert_string_equal("0:1\n", first->data);
+    assert_int_equal(4, first->length);
+
+    /* unchanged generation: the output is not rendered again */
+    snapshot_buffer_t *second = snapshot_get(snapshot, SNAPSHOT_STATUS, SNAPSHOT_TEXT);
+    assert_ptr_equal(first, second);
+    assert_int_equal(1, renders);
+
+    snapshot_release(second);
+
+    /* every format is rendered separately */
+    snapshot_buffer_t *http = snapshot_get(snapshot, SNAPSHOT_STATUS, SNAPSHOT_HTTP);
+    assert_string_equal(">>> 0:2\n", http->data);
+    assert_int_equal(first->generation, http->generation);
+    snapshot_release(http);
+
+    snapshot_invalidate(snapshot);
+
+    /* the outdated buffer stays valid as long as it is referenced */
+    second = snapshot_get(snapshot, SNAPSHOT_STATUS, SNAPSHOT_TEXT);
+    assert_string_equal("0:3\n", second->data);
+    assert_string_equal("0:1\n", first->data);
+    assert_true(second->generation > first->generation);
+
+    snapshot_release(first);
+    snapshot_release(second);
+
+    char etag[64], json_etag[64];
+    assert_true(snapshot_etag(snapshot, 16, SNAPSHOT_HTTP, etag, LEN(etag)) > 0);
+    assert_non_null(strstr(etag, "-10-"));
+
+    assert_true(snapshot_etag(snapshot, 16, SNAPSHOT_JSON, json_etag, LEN(json_etag)) > 0);
+    assert_string_not_equal(etag, json_etag);
+
+    snapshot_destroy(snapshot);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,81 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_sockdiag.h"
+#include "../src/sockdiag.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+void
+test_sockdiag_listening(UNUSED void **state)
+{
+#ifndef OSX
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    bool listening = false;
+
+    sockdiag_t *diag = sockdiag_new();
+    assert_non_null(diag);
+
+    int32_t sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert_true(sock >= 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    assert_int_equal(0, bind(sock, (struct sockaddr *)&addr, sizeof(addr)));
+    assert_int_equal(0, getsockname(sock, (struct sockaddr *)&addr, &len));
+
+    uint16_t port = ntohs(addr.sin_port);
+
+    /* bound but not listening yet */
+    assert_true(sockdiag_listening(diag, port, 0, &listening));
+    assert_false(listening);
+
+    assert_int_equal(0, listen(sock, 4));
+
+    /* the snapshot is kept until it is invalidated */
+    assert_true(sockdiag_listening(diag, port, 0, &listening));
+    assert_false(listening);
+
+    sockdiag_invalidate(diag);
+
+    assert_true(sockdiag_listening(diag, port, 0, &listening));
+    assert_true(listening);
+
+    /* the socket belongs to this process */
+    assert_true(sockdiag_listening(diag, port, getpid(), &listening));
+    assert_true(listening);
+
+    assert_true(sockdiag_listening(diag, port, getppid(), &listening));
+    assert_false(listening);
+
+    close(sock);
+    sockdiag_invalidate(diag);
+
+    assert_true(sockdiag_listening(diag, port, 0, &listening));
+    assert_false(listening);
+
+    sockdiag_destroy(diag);
+#endif
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -17,6 +17,12 @@
 #include "tests_socket.h"
 #include "../src/socket.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 void
 test_check_http(UNUSED void **state)
 {
@@ -59,4 +65,102 @@ test_parse_endpoint(UNUSED void **state)
     endpoint_free(e2);
 }
 
+void
+test_http_status_parse(UNUSED void **state)
+{
+    assert_null(http_status_parse(NULL));
+    assert_null(http_status_parse(""));
+    assert_null(http_status_parse("foo"));
+    assert_null(http_status_parse("99, 600"));
+
+    uint16_t *codes = http_status_parse("200, 204 301");
+    assert_non_null(codes);
+    assert_int_equal(codes[0], 200);
+    assert_int_equal(codes[1], 204);
+    assert_int_equal(codes[2], 301);
+    assert_int_equal(codes[3], 0);
+
+    assert_true(http_status_matches(codes, 204));
+    assert_false(http_status_matches(codes, 500));
+
+    /* default to '200' only */
+    assert_true(http_status_matches(NULL, 200));
+    assert_false(http_status_matches(NULL, 204));
+
+    free(codes);
+}
+
+void
+test_http_url_parse(UNUSED void **state)
+{
+    http_url_t url;
+
+    /* plain paths */
+    assert_true(http_url_parse("/status", &url));
+    assert_false(url.tls);
+    assert_int_equal(0, url.port);
+    assert_string_equal("", url.host);
+    assert_string_equal("/status", url.path);
+
+    assert_true(http_url_parse(NULL, &url));
+    assert_string_equal("", url.path);
+
+    /* absolute URLs */
+    assert_true(http_url_parse("https://localhost:8443/health?full=1", &url));
+    assert_true(url.tls);
+    assert_int_equal(8443, url.port);
+    assert_string_equal("localhost", url.host);
+    assert_string_equal("/health?full=1", url.path);
+
+    assert_true(http_url_parse("HTTP://example.com", &url));
+    assert_false(url.tls);
+    assert_int_equal(0, url.port);
+    assert_string_equal("example.com", url.host);
+    assert_string_equal("", url.path);
+
+    assert_false(http_url_parse("https://localhost:0/", &url));
+    assert_false(http_url_parse("https://localhost:foo/", &url));
+    assert_false(http_url_parse("https://localhost:70000/", &url));
+
+    /* port of the URL, the configured port or the scheme's default */
+    assert_int_equal(80, http_url_port("/status", 0));
+    assert_int_equal(8080, http_url_port("/status", 8080));
+    assert_int_equal(443, http_url_port("https://localhost/", 0));
+    assert_int_equal(8443, http_url_port("https://localhost/", 8443));
+    assert_int_equal(9443, http_url_port("https://localhost:9443/", 8443));
+}
+
+void
+test_notify_socket_ready(UNUSED void **state)
+{
+    const char *path = "/tmp/nyx-tests.notify";
+    struct sockaddr_un addr;
+
+    int32_t sock = notify_socket_open(path);
+    assert_true(sock >= 0);
+
+    /* nothing received yet */
+    assert_false(notify_socket_ready(sock));
+
+    int32_t client = socket(AF_UNIX, SOCK_DGRAM, 0);
+    assert_true(client >= 0);
+
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+
+    const char *status = "STATUS=starting";
+    const char *ready = "STATUS=up\nREADY=1";
+
+    sendto(client, status, strlen(status), 0, (struct sockaddr *)&addr, sizeof(addr));
+    assert_false(notify_socket_ready(sock));
+
+    sendto(client, ready, strlen(ready), 0, (struct sockaddr *)&addr, sizeof(addr));
+    assert_true(notify_socket_ready(sock));
+
+    close(client);
+    close(sock);
+    unlink(path);
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
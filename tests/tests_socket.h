@@ -24,4 +24,13 @@ test_check_port(void **state);
 void
 test_parse_endpoint(void **state);
 
+void
+test_http_status_parse(void **state);
+
+void
+test_http_url_parse(void **state);
+
+void
+test_notify_socket_ready(void **state);
+
 /* vim: set et sw=4 sts=4 tw=80: */
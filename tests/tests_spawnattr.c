@@ -0,0 +1,92 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_spawnattr.h"
+#include "../src/spawnattr.h"
+
+#define BIT(mask, idx) ((mask)[(idx) / 64] & (1ULL << ((idx) % 64)))
+
+void
+test_parse_index_list(UNUSED void **state)
+{
+    uint64_t mask[SPAWNATTR_MAX_CPUS / 64];
+
+    assert_true(parse_index_list("0-3,8", mask, SPAWNATTR_MAX_CPUS));
+    assert_true(BIT(mask, 0) && BIT(mask, 3) && BIT(mask, 8));
+    assert_false(BIT(mask, 4) || BIT(mask, 7) || BIT(mask, 9));
+
+    assert_true(parse_index_list("70, 130-131", mask, SPAWNATTR_MAX_CPUS));
+    assert_true(BIT(mask, 70) && BIT(mask, 130) && BIT(mask, 131));
+    assert_false(BIT(mask, 0));
+
+    assert_false(parse_index_list("", mask, SPAWNATTR_MAX_CPUS));
+    assert_false(parse_index_list("3-1", mask, SPAWNATTR_MAX_CPUS));
+    assert_false(parse_index_list("1,a", mask, SPAWNATTR_MAX_CPUS));
+    assert_false(parse_index_list("-1", mask, SPAWNATTR_MAX_CPUS));
+    assert_false(parse_index_list("1024", mask, SPAWNATTR_MAX_CPUS));
+}
+
+void
+test_ionice_parse(UNUSED void **state)
+{
+    assert_int_equal((3 << 13), ionice_parse("idle"));
+    assert_int_equal((2 << 13) | 4, ionice_parse("best-effort"));
+    assert_int_equal((2 << 13) | 7, ionice_parse("be:7"));
+    assert_int_equal((1 << 13) | 0, ionice_parse("realtime:0"));
+
+    assert_int_equal(-1, ionice_parse("best"));
+    assert_int_equal(-1, ionice_parse("be:8"));
+    assert_int_equal(-1, ionice_parse("idle:1"));
+    assert_int_equal(-1, ionice_parse(""));
+}
+
+void
+test_rlimit_parse(UNUSED void **state)
+{
+    spawn_rlimit_t rlimit;
+
+    assert_true(rlimit_parse("nofile", "65536", &rlimit));
+    assert_int_equal(RLIMIT_NOFILE, rlimit.resource);
+    assert_int_equal(65536, rlimit.limit.rlim_cur);
+    assert_int_equal(65536, rlimit.limit.rlim_max);
+
+    assert_true(rlimit_parse("core", "unlimited", &rlimit));
+    assert_true(rlimit.limit.rlim_cur == RLIM_INFINITY);
+
+    assert_true(rlimit_parse("memlock", "1024:infinity", &rlimit));
+    assert_int_equal(1024, rlimit.limit.rlim_cur);
+    assert_true(rlimit.limit.rlim_max == RLIM_INFINITY);
+
+    assert_false(rlimit_parse("files", "1024", &rlimit));
+    assert_false(rlimit_parse("nofile", "many", &rlimit));
+    assert_false(rlimit_parse("nofile", "2048:1024", &rlimit));
+    assert_false(rlimit_parse("nofile", "", &rlimit));
+}
+
+void
+test_sched_policy_from_string(UNUSED void **state)
+{
+    assert_int_equal(SCHED_POLICY_DEFAULT, sched_policy_from_string(""));
+    assert_int_equal(SCHED_POLICY_BATCH, sched_policy_from_string("batch"));
+    assert_int_equal(SCHED_POLICY_RR, sched_policy_from_string("RR"));
+    assert_int_equal(SCHED_POLICY_INVALID, sched_policy_from_string("deadline"));
+
+    assert_int_equal(NUMA_POLICY_BIND, numa_policy_from_string("membind"));
+    assert_int_equal(NUMA_POLICY_PREFERRED, numa_policy_from_string("preferred"));
+    assert_int_equal(NUMA_POLICY_INVALID, numa_policy_from_string("interleave"));
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,192 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_startup.h"
+#include "../src/startup.h"
+#include "../src/utils.h"
+#include "../src/watch.h"
+
+#include <string.h>
+
+/* names of the started watches in order */
+static char started[256];
+
+static void
+record_start(void *data)
+{
+    strcat(started, data);
+}
+
+/* names of the restarted instances in order */
+static char restarted[256];
+
+static void
+record_restart(void *data)
+{
+    strcat(restarted, data);
+}
+
+static void
+add_watch(hash_t *watches, const char *name, const char *depends_on)
+{
+    watch_t *watch = watch_new(strdup(name));
+
+    watch->depends_on = split_string(depends_on, ", ");
+
+    hash_add(watches, name, watch);
+}
+
+void
+test_startup_dependencies(UNUSED void **state)
+{
+    hash_t *watches = hash_new(_watch_destroy);
+    startup_t *startup = startup_new(record_start, record_restart);
+
+    /* a <- b <- c and a <- d */
+    add_watch(watches, "a", NULL);
+    add_watch(watches, "b", "a");
+    add_watch(watches, "c", "b");
+    add_watch(watches, "d", "a, unknown");
+
+    startup_prepare(startup, watches, 0);
+
+    started[0] = '\0';
+
+    startup_enqueue(startup, "d", "d");
+    startup_enqueue(startup, "c", "c");
+    startup_enqueue(startup, "b", "b");
+    assert_string_equal("", started);
+
+    startup_enqueue(startup, "a", "a");
+    assert_string_equal("a", started);
+
+    /* the longer chain is started first */
+    startup_running(startup, "a", "a");
+    assert_string_equal("abd", started);
+
+    startup_running(startup, "b", "b");
+    assert_string_equal("abdc", started);
+
+    startup_destroy(startup);
+    hash_destroy(watches);
+}
+
+void
+test_startup_concurrency(UNUSED void **state)
+{
+    hash_t *watches = hash_new(_watch_destroy);
+    startup_t *startup = startup_new(record_start, record_restart);
+
+    add_watch(watches, "a", NULL);
+    add_watch(watches, "b", NULL);
+    add_watch(watches, "c", NULL);
+
+    startup_prepare(startup, watches, 2);
+
+    started[0] = '\0';
+
+    startup_enqueue(startup, "a", "a");
+    startup_enqueue(startup, "b", "b");
+    startup_enqueue(startup, "c", "c");
+    assert_string_equal("ab", started);
+
+    /* a failed start frees its slot as well */
+    startup_stopped(startup, "b", "b");
+    assert_string_equal("abc", started);
+    assert_int_equal(2, startup->inflight);
+
+    startup_running(startup, "a", "a");
+    startup_running(startup, "c", "c");
+    assert_int_equal(0, startup->inflight);
+
+    startup_destroy(startup);
+    hash_destroy(watches);
+}
+
+void
+test_startup_cycle(UNUSED void **state)
+{
+    hash_t *watches = hash_new(_watch_destroy);
+    startup_t *startup = startup_new(record_start, record_restart);
+
+    add_watch(watches, "a", "b");
+    add_watch(watches, "b", "a");
+    add_watch(watches, "c", "a");
+
+    startup_prepare(startup, watches, 0);
+
+    started[0] = '\0';
+
+    /* the dependencies of the cycle are ignored */
+    startup_enqueue(startup, "c", "c");
+    startup_enqueue(startup, "a", "a");
+    startup_enqueue(startup, "b", "b");
+    assert_string_equal("ab", started);
+
+    startup_running(startup, "a", "a");
+    assert_string_equal("abc", started);
+
+    startup_destroy(startup);
+    hash_destroy(watches);
+}
+
+void
+test_startup_rollout(UNUSED void **state)
+{
+    hash_t *watches = hash_new(_watch_destroy);
+    startup_t *startup = startup_new(record_start, record_restart);
+    list_t *instances = list_new(NULL);
+
+    add_watch(watches, "w", NULL);
+    ((watch_t *)hash_get(watches, "w"))->restart_batch = 2;
+
+    startup_prepare(startup, watches, 0);
+
+    list_add(instances, "1");
+    list_add(instances, "2");
+    list_add(instances, "3");
+    list_add(instances, "4");
+    list_add(instances, "5");
+
+    restarted[0] = '\0';
+
+    assert_true(startup_rollout(startup, "w", instances));
+    assert_string_equal("12", restarted);
+
+    /* only one rollout at a time */
+    assert_false(startup_rollout(startup, "w", instances));
+
+    startup_running(startup, "w", "2");
+    assert_string_equal("123", restarted);
+
+    startup_running(startup, "w", "1");
+    assert_string_equal("1234", restarted);
+
+    /* a failing instance aborts the rollout */
+    startup_stopped(startup, "w", "3");
+    startup_running(startup, "w", "4");
+    assert_string_equal("1234", restarted);
+
+    assert_true(startup_rollout(startup, "w", instances));
+
+    list_destroy(instances);
+    startup_destroy(startup);
+    hash_destroy(watches);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
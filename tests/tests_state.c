@@ -0,0 +1,75 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tests.h"
+#include "tests_state.h"
+#include "../src/state.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+
+static state_entry_t *
+newest(state_t *watch_state)
+{
+    state_queue_t *queue = &watch_state->queue;
+
+    return &queue->entries[(queue->head + queue->count - 1) % NYX_STATE_QUEUE_SIZE];
+}
+
+void
+test_state_queue_full(UNUSED void **state)
+{
+    sem_t notify;
+    state_t watch_state = { .name = "app", .state = STATE_RUNNING, .notify_sem = &notify };
+    state_queue_t *queue = &watch_state.queue;
+
+    sem_init(&notify, 0, 0);
+    pthread_mutex_init(&queue->lock, NULL);
+
+    /* a flapping watch fills its queue with alternating states */
+    for (uint32_t i = 0; i < NYX_STATE_QUEUE_SIZE; i++)
+        assert_true(set_state(&watch_state, i % 2 ? STATE_STOPPED : STATE_STARTING));
+
+    assert_int_equal(NYX_STATE_QUEUE_SIZE, queue->count);
+    assert_false(set_state(&watch_state, STATE_RESTARTING));
+
+    /* commands take over the newest internal request */
+    assert_true(set_state_command(&watch_state, STATE_STOPPING));
+    assert_int_equal(NYX_STATE_QUEUE_SIZE, queue->count);
+    assert_int_equal(1, queue->commands);
+    assert_int_equal(STATE_STOPPING, newest(&watch_state)->value);
+    assert_true(newest(&watch_state)->is_command);
+
+    assert_true(set_state_command(&watch_state, STATE_RESTARTING));
+    assert_int_equal(2, queue->commands);
+    assert_int_equal(STATE_STOPPING, newest(&watch_state)->value);
+
+    /* once there are only commands left QUIT still gets in */
+    for (uint32_t i = 0; i < NYX_STATE_QUEUE_SIZE; i++)
+        queue->entries[i].is_command = true;
+    queue->commands = NYX_STATE_QUEUE_SIZE;
+
+    assert_false(set_state_command(&watch_state, STATE_STARTING));
+    assert_true(set_state_command(&watch_state, STATE_QUIT));
+    assert_int_equal(NYX_STATE_QUEUE_SIZE, queue->count);
+    assert_int_equal(NYX_STATE_QUEUE_SIZE, queue->commands);
+    assert_int_equal(STATE_QUIT, newest(&watch_state)->value);
+
+    pthread_mutex_destroy(&queue->lock);
+    sem_destroy(&notify);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
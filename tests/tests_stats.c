@@ -0,0 +1,84 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tests.h"
+#include "tests_stats.h"
+#include "../src/stats.h"
+
+#include <stdlib.h>
+
+void
+test_stats_buckets(UNUSED void **state)
+{
+    /* small values are counted exactly */
+    for (uint64_t i = 0; i < STATS_SUB_BUCKETS; i++)
+        assert_int_equal(i, stats_bucket_value(stats_bucket(i)));
+
+    uint32_t previous = 0;
+
+    for (uint64_t value = 1; value < (1ULL << STATS_MAX_EXPONENT); value += value / 7 + 1)
+    {
+        uint32_t bucket = stats_bucket(value);
+        uint64_t highest = stats_bucket_value(bucket);
+
+        /* the buckets grow with the values and are accurate to 1/8 */
+        assert_true(bucket >= previous);
+        assert_true(bucket < STATS_BUCKETS);
+        assert_true(highest >= value);
+        assert_true(highest - value <= value / STATS_SUB_BUCKETS);
+
+        previous = bucket;
+    }
+
+    assert_int_equal(STATS_BUCKETS - 1, stats_bucket(UINT64_MAX));
+}
+
+void
+test_stats_record(UNUSED void **state)
+{
+    stats_snapshot_t *stats = calloc(1, sizeof(stats_snapshot_t));
+
+    stats_reset();
+
+    for (uint64_t i = 1; i <= 1000; i++)
+        stats_record(STATS_REQUEST, i * 10);
+
+    stats_count(STATS_PROC_EVENTS, 5);
+    stats_count(STATS_PROC_EVENTS, 2);
+
+    stats_read(stats);
+
+    stats_histogram_t *h = &stats->histograms[STATS_REQUEST];
+
+    assert_int_equal(1000, h->count);
+    assert_int_equal(5005000, h->sum);
+    assert_int_equal(10000, h->max);
+
+    uint64_t p50 = stats_percentile(h, 50.0);
+    uint64_t p99 = stats_percentile(h, 99.0);
+
+    assert_true(p50 >= 5000 && p50 <= 5000 + 5000 / STATS_SUB_BUCKETS);
+    assert_true(p99 >= 9900 && p99 <= 10000);
+    assert_int_equal(10000, stats_percentile(h, 100.0));
+
+    assert_int_equal(0, stats->histograms[STATS_START].count);
+    assert_int_equal(0, stats_percentile(&stats->histograms[STATS_START], 50.0));
+    assert_int_equal(7, stats->counters[STATS_PROC_EVENTS]);
+
+    free(stats);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
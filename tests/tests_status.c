@@ -0,0 +1,200 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_status.h"
+#include "../src/state.h"
+#include "../src/status.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static hash_t *
+watch_names(const char **names)
+{
+    hash_t *hash = hash_new(NULL);
+
+    while (*names)
+    {
+        hash_add(hash, *names, (void *)*names);
+        names++;
+    }
+
+    return hash;
+}
+
+static void
+remove_dir(const char *dir)
+{
+    char *command = NULL;
+    assert_true(asprintf(&command, "rm -rf %s", dir) > 0);
+    assert_int_equal(0, system(command));
+    free(command);
+}
+
+void
+test_status_records(UNUSED void **state)
+{
+    char dir[] = "/tmp/nyx-status-XXXXXX";
+    const char *first[] = { "app", "db", NULL };
+    const char *second[] = { "db", "web", "cache", NULL };
+    nyx_status_record_t record;
+
+    /* the published values follow the daemon's definitions */
+    assert_int_equal(NYX_STATUS_RUNNING, STATE_RUNNING);
+    assert_int_equal(NYX_STATUS_QUIT, STATE_QUIT);
+    assert_int_equal(NYX_STATUS_CHECK_HTTP, CHECK_HTTP);
+    assert_int_equal(NYX_STATUS_CHECK_EXEC, CHECK_EXEC);
+
+    assert_non_null(mkdtemp(dir));
+
+    status_t *status = status_open(dir);
+    assert_non_null(status);
+    assert_int_equal(NYX_STATUS_MAGIC, status->header->magic);
+    assert_int_equal(getpid(), status->header->pid);
+    assert_int_equal(0, status->header->records);
+
+    hash_t *watches = watch_names(first);
+    assert_true(status_prepare(status, watches));
+    assert_int_equal(2, status->header->records);
+
+    int32_t app = status_slot(status, "app");
+    int32_t db = status_slot(status, "db");
+
+    assert_true(app >= 0 && db >= 0 && app != db);
+    assert_int_equal(db, status_slot(status, "db"));
+
+    status_set_state(status, db, STATE_RUNNING, 1234, 2, 0);
+    status_set_sample(status, db, 12.5, 4096);
+    status_set_check(status, db, CHECK_PORT, false);
+
+    assert_true(nyx_status_read(&status->records[db], &record));
+    assert_string_equal("db", record.name);
+    assert_int_equal(STATE_RUNNING, record.state);
+    assert_int_equal(1234, record.pid);
+    assert_int_equal(2, record.restarts);
+    assert_true(record.cpu == 12.5);
+    assert_int_equal(4096, record.rss);
+    assert_int_equal(NYX_STATUS_CHECK_FAILED, record.check);
+    assert_int_equal(CHECK_PORT, record.check_type);
+    assert_true(record.changed > 0 && record.sampled > 0 && record.checked > 0);
+
+    /* every update is a completed write */
+    assert_int_equal(0, record.sequence % 2);
+
+    /* a new process starts without a sample or check result */
+    status_set_state(status, db, STATE_STARTING, 0, 2, 1);
+    assert_true(nyx_status_read(&status->records[db], &record));
+    assert_int_equal(0, record.pid);
+    assert_int_equal(1, record.failures);
+    assert_int_equal(0, record.sampled);
+    assert_int_equal(NYX_STATUS_CHECK_NONE, record.check);
+
+    hash_destroy(watches);
+
+    /* the record of the removed watch is released and reused */
+    watches = watch_names(second);
+    assert_true(status_prepare(status, watches));
+    assert_int_equal(3, status->header->records);
+    assert_false(nyx_status_read(&status->records[app], &record));
+    assert_int_equal(db, status_slot(status, "db"));
+    assert_int_equal(-1, status_slot(status, "some-watch-with-a-name-that-is-way-too-long-to-be-published-at-all"));
+
+    int32_t web = status_slot(status, "web");
+    int32_t cache = status_slot(status, "cache");
+
+    assert_true(web >= 0 && cache >= 0 && web != cache && web != db && cache != db);
+
+    /* updates of unknown records are ignored */
+    status_set_state(status, -1, STATE_RUNNING, 1, 0, 0);
+    status_set_sample(status, 3, 1.0, 1);
+    status_set_sample(NULL, db, 1.0, 1);
+
+    status_close(status);
+    hash_destroy(watches);
+
+    remove_dir(dir);
+}
+
+typedef struct
+{
+    uint32_t count;
+    char names[4][NYX_STATUS_NAME_SIZE];
+} status_result_t;
+
+static void
+collect_record(const nyx_status_record_t *record, void *data)
+{
+    status_result_t *result = data;
+
+    if (result->count < LEN(result->names))
+        strcpy(result->names[result->count], record->name);
+
+    result->count++;
+}
+
+void
+test_status_query(UNUSED void **state)
+{
+    char dir[] = "/tmp/nyx-status-XXXXXX";
+    const char *names[] = { "app", "app@1", "db", NULL };
+    status_result_t result;
+    matcher_t matcher;
+
+    assert_non_null(mkdtemp(dir));
+
+    /* no table at all */
+    memset(&result, 0, sizeof(result));
+    assert_false(status_query(dir, NULL, collect_record, &result));
+
+    status_t *status = status_open(dir);
+    hash_t *watches = watch_names(names);
+
+    assert_non_null(status);
+    assert_true(status_prepare(status, watches));
+
+    for (const char **name = names; *name; name++)
+        status_set_state(status, status_slot(status, *name), STATE_RUNNING, 100, 0, 0);
+
+    assert_true(status_query(dir, NULL, collect_record, &result));
+    assert_int_equal(3, result.count);
+
+    assert_true(matcher_init(&matcher, "app*", false));
+    memset(&result, 0, sizeof(result));
+    assert_true(status_query(dir, &matcher, collect_record, &result));
+    assert_int_equal(2, result.count);
+    assert_string_equal("app", result.names[0]);
+    assert_string_equal("app@1", result.names[1]);
+    matcher_free(&matcher);
+
+    /* a restarted daemon replaces the table */
+    status_close(status);
+    status = status_open(dir);
+    assert_non_null(status);
+
+    memset(&result, 0, sizeof(result));
+    assert_true(status_query(dir, NULL, collect_record, &result));
+    assert_int_equal(0, result.count);
+
+    status_close(status);
+    hash_destroy(watches);
+
+    remove_dir(dir);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -17,6 +17,8 @@
 #include "tests_strbuf.h"
 #include "../src/strbuf.h"
 
+#include <string.h>
+
 void
 test_strbuf_append(UNUSED void **state)
 {
@@ -42,4 +44,48 @@ test_strbuf_append(UNUSED void **state)
     strbuf_free(buf);
 }
 
+void
+test_strbuf_append_fast(UNUSED void **state)
+{
+    strbuf_t *buf = strbuf_new();
+
+    strbuf_append_string(buf, "pid=");
+    strbuf_append_int(buf, -42);
+    strbuf_append_char(buf, ' ');
+    strbuf_append_uint(buf, UINT64_MAX);
+    strbuf_append_char(buf, ' ');
+    strbuf_append_int(buf, INT64_MIN);
+    strbuf_append_data(buf, " 0123", 2);
+    strbuf_append_uint(buf, 0);
+
+    assert_string_equal("pid=-42 18446744073709551615 -9223372036854775808 00", buf->buf);
+    assert_int_equal(strlen(buf->buf), buf->length);
+
+    /* clearing keeps the allocated buffer */
+    uint64_t size = buf->size;
+
+    strbuf_clear(buf);
+
+    assert_int_equal(0, buf->length);
+    assert_int_equal(size, buf->size);
+    assert_string_equal("", buf->buf);
+
+    /* output larger than the reserved headroom */
+    char large[1000];
+
+    memset(large, 'x', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+
+    assert_int_equal(sizeof(large) + 1, strbuf_append(buf, "<%s>", large));
+    assert_int_equal(sizeof(large) + 1, buf->length);
+    assert_int_equal('>', buf->buf[buf->length - 1]);
+
+    struct iovec iov = strbuf_iovec(buf);
+
+    assert_ptr_equal(buf->buf, iov.iov_base);
+    assert_int_equal(buf->length, iov.iov_len);
+
+    strbuf_free(buf);
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -18,4 +18,7 @@
 void
 test_strbuf_append(void **state);
 
+void
+test_strbuf_append_fast(void **state);
+
 /* vim: set et sw=4 sts=4 tw=80: */
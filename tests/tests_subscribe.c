@@ -0,0 +1,178 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_subscribe.h"
+#include "../src/socket.h"
+#include "../src/state.h"
+#include "../src/subscribe.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void
+stop_reactor(reactor_t *reactor, UNUSED void *data)
+{
+    reactor_stop(reactor);
+}
+
+/* process the reactor for a few milliseconds */
+static void
+run_reactor(reactor_t *reactor)
+{
+    assert_true(reactor_add_timer(reactor, 20, false, stop_reactor, NULL) >= 0);
+    assert_true(reactor_run(reactor));
+}
+
+static size_t
+receive_all(int32_t fd, char *buffer, size_t size)
+{
+    ssize_t received = 0;
+    size_t total = 0;
+
+    while (total < size - 1 &&
+           (received = recv(fd, buffer + total, size - 1 - total, MSG_DONTWAIT)) > 0)
+        total += received;
+
+    buffer[total] = '\0';
+
+    return total;
+}
+
+void
+test_subscribe_events(UNUSED void **state)
+{
+    int32_t fds[2];
+    char buffer[1024];
+    const char *watches[] = { "a", NULL };
+    reactor_t *reactor = reactor_new();
+    subscribers_t *subscribers = subscribers_new(reactor);
+
+    assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assert_true(unblock_socket(fds[0]));
+
+    assert_true(subscribers_add(subscribers, fds[0], watches, SUBSCRIBER_LINES, 0));
+    assert_int_equal(1, subscribers_count(subscribers));
+
+    subscribers_publish(subscribers, "a", "a", STATE_STARTING, STATE_RUNNING, 42);
+    subscribers_publish(subscribers, "b", "b", STATE_STARTING, STATE_RUNNING, 43);
+    subscribers_publish(subscribers, "a", "a", STATE_RUNNING, STATE_STOPPING, 42);
+
+    run_reactor(reactor);
+
+    assert_true(receive_all(fds[1], buffer, sizeof(buffer)) > 0);
+
+    assert_int_equal(0, strncmp("a starting running 42 ", buffer, 22));
+    assert_non_null(strstr(buffer, "\na running stopping 42 "));
+    assert_null(strstr(buffer, "b "));
+
+    subscribers_destroy(subscribers);
+    reactor_destroy(reactor);
+
+    close(fds[1]);
+}
+
+void
+test_subscribe_overflow(UNUSED void **state)
+{
+    int32_t fds[2];
+    char buffer[64 * 1024];
+    reactor_t *reactor = reactor_new();
+    subscribers_t *subscribers = subscribers_new(reactor);
+
+    assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assert_true(unblock_socket(fds[0]));
+
+    assert_true(subscribers_add(subscribers, fds[0], NULL, SUBSCRIBER_LINES, 0));
+
+    /* the oldest events are dropped without blocking the publisher */
+    for (uint32_t i = 0; i < NYX_SUBSCRIBER_QUEUE + 10; i++)
+        subscribers_publish(subscribers, "a", "a", STATE_STARTING, STATE_RUNNING, i);
+
+    run_reactor(reactor);
+
+    assert_true(receive_all(fds[1], buffer, sizeof(buffer)) > 0);
+
+    assert_int_equal(0, strncmp("dropped 10\na starting running 10 ", buffer, 33));
+
+    subscribers_destroy(subscribers);
+    reactor_destroy(reactor);
+
+    close(fds[1]);
+}
+
+void
+test_subscribe_sse(UNUSED void **state)
+{
+    int32_t fds[2];
+    char buffer[1024];
+    reactor_t *reactor = reactor_new();
+    subscribers_t *subscribers = subscribers_new(reactor);
+
+    assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assert_true(unblock_socket(fds[0]));
+
+    assert_true(subscribers_add(subscribers, fds[0], NULL, SUBSCRIBER_SSE, 0));
+
+    subscribers_publish(subscribers, "a\"1", "a", STATE_STOPPED, STATE_RUNNING, 42);
+
+    run_reactor(reactor);
+
+    assert_true(receive_all(fds[1], buffer, sizeof(buffer)) > 0);
+
+    /* the response headers precede the events */
+    const char *headers = "HTTP/1.1 200 OK\r\n";
+
+    assert_int_equal(0, strncmp(headers, buffer, strlen(headers)));
+    assert_non_null(strstr(buffer, "Content-Type: text/event-stream\r\n"));
+
+    const char *expected = "\r\n\r\nretry: 3000\n\n"
+        "event: state\ndata: {\"watch\":\"a\\\"1\",\"from\":\"stopped\","
+        "\"to\":\"running\",\"pid\":42,\"timestamp\":";
+
+    assert_non_null(strstr(buffer, expected));
+    assert_non_null(strstr(buffer, "}\n\n"));
+
+    subscribers_destroy(subscribers);
+    reactor_destroy(reactor);
+
+    close(fds[1]);
+}
+
+void
+test_subscribe_hangup(UNUSED void **state)
+{
+    int32_t fds[2];
+    reactor_t *reactor = reactor_new();
+    subscribers_t *subscribers = subscribers_new(reactor);
+
+    assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assert_true(unblock_socket(fds[0]));
+
+    assert_true(subscribers_add(subscribers, fds[0], NULL, SUBSCRIBER_LINES, 0));
+
+    close(fds[1]);
+    run_reactor(reactor);
+
+    assert_int_equal(0, subscribers_count(subscribers));
+
+    subscribers_destroy(subscribers);
+    reactor_destroy(reactor);
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,97 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_taskstats.h"
+#include "../src/taskstats.h"
+
+#ifndef OSX
+#include <linux/netlink.h>
+#include <linux/taskstats.h>
+#include <string.h>
+
+static size_t
+add_aggregate(char *buffer, uint16_t type, uint16_t id_type, uint32_t id,
+        const struct taskstats *stats)
+{
+    struct nlattr *aggr = (struct nlattr *)buffer;
+    struct nlattr *attr = aggr + 1;
+
+    attr->nla_type = id_type;
+    attr->nla_len = NLA_HDRLEN + sizeof(uint32_t);
+    memcpy(attr + 1, &id, sizeof(uint32_t));
+
+    attr = (struct nlattr *)((char *)attr + NLA_ALIGN(attr->nla_len));
+    attr->nla_type = TASKSTATS_TYPE_STATS;
+    attr->nla_len = NLA_HDRLEN + sizeof(struct taskstats);
+    memcpy(attr + 1, stats, sizeof(struct taskstats));
+
+    aggr->nla_type = type;
+    aggr->nla_len = NLA_HDRLEN +
+        NLA_ALIGN(NLA_HDRLEN + sizeof(uint32_t)) +
+        NLA_ALIGN(NLA_HDRLEN + sizeof(struct taskstats));
+
+    return NLA_ALIGN(aggr->nla_len);
+}
+#endif
+
+void
+test_taskstats_parse(UNUSED void **state)
+{
+#ifndef OSX
+    char buffer[2048] = {0};
+    struct taskstats task, group;
+    taskstats_sample_t sample;
+
+    memset(&task, 0, sizeof(struct taskstats));
+    task.ac_utime = 100;
+    task.ac_stime = 50;
+    task.read_bytes = 4096;
+    task.write_bytes = 8192;
+    task.hiwater_rss = 1024;
+
+    memset(&group, 0, sizeof(struct taskstats));
+    group.ac_utime = 300;
+    group.ac_stime = 200;
+    group.cpu_delay_total = 1000000;
+
+    /* single task record */
+    memset(&sample, 0, sizeof(taskstats_sample_t));
+    size_t length = add_aggregate(buffer, TASKSTATS_TYPE_AGGR_PID, TASKSTATS_TYPE_PID, 42, &task);
+
+    assert_true(taskstats_parse(buffer, length, &sample));
+    assert_int_equal(42, sample.tgid);
+    assert_int_equal(150, sample.cpu_time);
+    assert_int_equal(4096, sample.read_bytes);
+    assert_int_equal(8192, sample.write_bytes);
+    assert_int_equal(1024, sample.hiwater_rss);
+
+    /* the thread group aggregate takes precedence */
+    memset(&sample, 0, sizeof(taskstats_sample_t));
+    length += add_aggregate(buffer + length, TASKSTATS_TYPE_AGGR_TGID, TASKSTATS_TYPE_TGID, 40, &group);
+
+    assert_true(taskstats_parse(buffer, length, &sample));
+    assert_int_equal(40, sample.tgid);
+    assert_int_equal(500, sample.cpu_time);
+    assert_int_equal(1000000, sample.cpu_delay);
+    assert_int_equal(4096, sample.read_bytes);
+
+    /* truncated attributes are ignored */
+    memset(&sample, 0, sizeof(taskstats_sample_t));
+    assert_false(taskstats_parse(buffer, NLA_HDRLEN, &sample));
+#endif
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
@@ -51,4 +51,47 @@ test_timestack_add(UNUSED void **state)
     timestack_destroy(timestack);
 }
 
+void
+test_timestack_window(UNUSED void **state)
+{
+    timestack_t *timestack = timestack_new(4);
+
+    timestack_set_window(timestack, 60, 3);
+
+    timestack_add(timestack, 1);
+    timestack_add(timestack, 2);
+    timestack_add(timestack, 1);
+
+    assert_int_equal(2, timestack_count_within(timestack, 1));
+    assert_int_equal(1, timestack_count_within(timestack, 2));
+    assert_int_equal(0, timestack_count_within(timestack, 0));
+
+    /* values that are not counted are ignored */
+    assert_int_equal(0, timestack_count_within(timestack, 5));
+
+    /* the oldest element leaves the window */
+    timestack_get(timestack, 2)->time -= 120;
+
+    assert_int_equal(1, timestack_count_within(timestack, 1));
+    assert_int_equal(1, timestack_count_within(timestack, 2));
+
+    /* elements overwritten by the ring buffer leave the window as well */
+    timestack_add(timestack, 0);
+    timestack_add(timestack, 0);
+    timestack_add(timestack, 0);
+
+    assert_int_equal(4, timestack->count);
+    assert_int_equal(0, timestack_newest(timestack));
+    assert_int_equal(1, timestack_oldest(timestack));
+    assert_int_equal(1, timestack_count_within(timestack, 1));
+    assert_int_equal(0, timestack_count_within(timestack, 2));
+    assert_int_equal(3, timestack_count_within(timestack, 0));
+
+    timestack_clear(timestack);
+
+    assert_int_equal(0, timestack_count_within(timestack, 0));
+
+    timestack_destroy(timestack);
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -21,4 +21,7 @@ test_timestack_create(void **state);
 void
 test_timestack_add(void **state);
 
+void
+test_timestack_window(void **state);
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,82 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "tests.h"
+#include "tests_uring.h"
+
+#ifndef OSX
+#include "../src/uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+void
+test_uring_read(UNUSED void **state)
+{
+#ifndef OSX
+    char path[] = "/tmp/nyx-uring-XXXXXX";
+    int32_t fds[3];
+    int32_t results[3];
+
+    uring_t *ring = uring_new(16);
+
+    /* io_uring may be unavailable (i.e. disabled via seccomp) */
+    if (ring == NULL)
+        return;
+
+    fds[0] = mkstemp(path);
+    assert_true(fds[0] >= 0);
+    assert_int_equal(26, write(fds[0], "abcdefghijklmnopqrstuvwxyz", 26));
+
+    fds[1] = open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+    assert_true(fds[1] >= 0);
+
+    /* a failing read does not affect the others */
+    fds[2] = open(path, O_WRONLY | O_CLOEXEC);
+    assert_true(fds[2] >= 0);
+
+    assert_true(uring_read(ring, fds, results, 3));
+
+    /* every file is read from the start (leaving room for a terminator) */
+    assert_int_equal(15, results[0]);
+    assert_memory_equal("abcdefghijklmno", uring_buffer(ring, 0), 15);
+
+    assert_int_equal(15, results[1]);
+    assert_int_equal(getpid(), atoi(uring_buffer(ring, 1)));
+
+    assert_int_equal(-EBADF, results[2]);
+
+    /* the ring is reused for the following batches */
+    assert_true(uring_read(ring, fds, results, 1));
+    assert_int_equal(15, results[0]);
+
+    assert_false(uring_read(ring, fds, results, URING_BATCH_SIZE + 1));
+
+    for (uint32_t i = 0; i < 3; i++)
+        close(fds[i]);
+
+    unlink(path);
+    uring_destroy(ring);
+#endif
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */
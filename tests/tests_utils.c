@@ -13,10 +13,18 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+
+#define NYX_MEM_TAG MEM_PLUGINS
+
 #include "tests.h"
 #include "tests_utils.h"
+#include "../src/def.h"
 #include "../src/utils.h"
 
+#include <signal.h>
+#include <stdlib.h>
+
 void
 test_parse_size_unit(UNUSED void **state)
 {
@@ -42,6 +50,36 @@ test_parse_size_unit(UNUSED void **state)
     assert_int_equal(0, parse_size_unit("x 226"));
 }
 
+void
+test_parse_msecs_unit(UNUSED void **state)
+{
+    assert_int_equal(5000, parse_msecs_unit("5"));
+    assert_int_equal(5000, parse_msecs_unit(" 5 s"));
+    assert_int_equal(250, parse_msecs_unit("250ms"));
+    assert_int_equal(250, parse_msecs_unit("250 MS"));
+    assert_int_equal(120000, parse_msecs_unit("2m"));
+    assert_int_equal(3600000, parse_msecs_unit("1h"));
+
+    assert_int_equal(0, parse_msecs_unit("10x"));
+    assert_int_equal(0, parse_msecs_unit("ms"));
+}
+
+void
+test_parse_signal(UNUSED void **state)
+{
+    assert_int_equal(SIGHUP, parse_signal("HUP"));
+    assert_int_equal(SIGHUP, parse_signal("sighup"));
+    assert_int_equal(SIGUSR2, parse_signal("SIGUSR2"));
+    assert_int_equal(SIGWINCH, parse_signal("winch"));
+    assert_int_equal(10, parse_signal("10"));
+
+    assert_int_equal(-1, parse_signal(""));
+    assert_int_equal(-1, parse_signal("SIG"));
+    assert_int_equal(-1, parse_signal("FOO"));
+    assert_int_equal(-1, parse_signal("0"));
+    assert_int_equal(-1, parse_signal("1x"));
+}
+
 static void
 test_parse(const char *input, const char **expected)
 {
@@ -147,4 +185,71 @@ test_substitute_env_string(UNUSED void **state)
     test_env("$HOME bar '$HOME' $USER");
 }
 
+void
+test_mem_usage(UNUSED void **state)
+{
+    mem_usage_t before[MEM_TAGS], after[MEM_TAGS];
+
+    mem_usage(before);
+
+    char *buffer = xcalloc(4, 16);
+    char *copy = xstrdup("nyx");
+
+    mem_usage(after);
+
+    /* the allocations are accounted to the tag of this file */
+    assert_int_equal(2, after[MEM_PLUGINS].allocations - before[MEM_PLUGINS].allocations);
+    assert_int_equal(2, after[MEM_PLUGINS].live - before[MEM_PLUGINS].live);
+    assert_true(after[MEM_PLUGINS].bytes - before[MEM_PLUGINS].bytes >= 68);
+    assert_int_equal(before[MEM_CONFIG].allocations, after[MEM_CONFIG].allocations);
+    assert_string_equal("plugins", mem_tag_name(MEM_PLUGINS));
+
+    xfree(buffer);
+    xfree(copy);
+
+    mem_usage(after);
+
+    /* released memory is no longer live */
+    assert_int_equal(2, after[MEM_PLUGINS].allocations - before[MEM_PLUGINS].allocations);
+    assert_int_equal(before[MEM_PLUGINS].live, after[MEM_PLUGINS].live);
+    assert_int_equal(before[MEM_PLUGINS].bytes, after[MEM_PLUGINS].bytes);
+}
+
+static void *
+stack_thread(void *data)
+{
+    size_t *size = data;
+
+#ifndef OSX
+    pthread_attr_t attr;
+
+    pthread_getattr_np(pthread_self(), &attr);
+    pthread_attr_getstacksize(&attr, size);
+    pthread_attr_destroy(&attr);
+#else
+    *size = pthread_get_stacksize_np(pthread_self());
+#endif
+
+    return NULL;
+}
+
+void
+test_thread_stack_size(UNUSED void **state)
+{
+    pthread_t thread;
+    size_t size = 0;
+
+    thread_set_stack_size(256 * 1024);
+
+    assert_int_equal(256 * 1024, thread_stack_size());
+    assert_int_equal(0, thread_create(&thread, stack_thread, &size));
+    pthread_join(thread, NULL);
+    assert_int_equal(256 * 1024, size);
+
+    /* back to the default */
+    thread_set_stack_size(0);
+
+    assert_true(thread_stack_size() > 0);
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -18,10 +18,22 @@
 void
 test_parse_size_unit(void **state);
 
+void
+test_parse_msecs_unit(UNUSED void **state);
+
+void
+test_parse_signal(UNUSED void **state);
+
 void
 test_parse_command_string(UNUSED void **state);
 
 void
 test_substitute_env_string(UNUSED void **state);
 
+void
+test_mem_usage(UNUSED void **state);
+
+void
+test_thread_stack_size(UNUSED void **state);
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -13,8 +13,11 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+
 #include "tests.h"
 #include "tests_watch.h"
+#include "../src/utils.h"
 #include "../src/watch.h"
 
 void
@@ -30,4 +33,76 @@ test_is_all(UNUSED void **state)
     assert_false(is_all("foo"));
 }
 
+static watch_t *
+sample_watch(void)
+{
+    watch_t *watch = watch_new(strdup("sample"));
+
+    watch->start = parse_command_string("sleep 100");
+    watch->dir = strdup("/tmp");
+    watch->max_cpu = 50;
+
+    return watch;
+}
+
+void
+test_watch_equal(UNUSED void **state)
+{
+    watch_t *watch = sample_watch();
+    watch_t *other = sample_watch();
+
+    assert_true(watch_equal(watch, other));
+    assert_false(watch_needs_restart(watch, other));
+
+    /* the ID is not part of the definition */
+    other->id = 42;
+    assert_true(watch_equal(watch, other));
+
+    /* limits are applied without a restart */
+    other->max_cpu = 80;
+    assert_false(watch_equal(watch, other));
+    assert_false(watch_needs_restart(watch, other));
+
+    /* ... unless enforced by the cgroup */
+    other->cgroup_limits = true;
+    assert_true(watch_needs_restart(watch, other));
+    other->cgroup_limits = false;
+
+    /* a standby process is started without touching the running one */
+    other->max_cpu = 50;
+    other->spare = true;
+    assert_false(watch_equal(watch, other));
+    assert_false(watch_needs_restart(watch, other));
+    other->spare = false;
+
+    free((void *)other->dir);
+    other->dir = strdup("/var");
+    assert_true(watch_needs_restart(watch, other));
+
+    watch_destroy(watch);
+    watch_destroy(other);
+}
+
+void
+test_watch_instance_name(UNUSED void **state)
+{
+    watch_t *watch = sample_watch();
+    char *name = NULL;
+
+    watch->instances = 3;
+
+    /* the first instance is named like the watch */
+    name = watch_instance_name(watch, 0);
+    assert_string_equal(watch->name, name);
+    free(name);
+
+    name = watch_instance_name(watch, 2);
+    assert_string_not_equal(watch->name, name);
+    assert_int_equal(0, strncmp(watch->name, name, strlen(watch->name)));
+    assert_string_equal("@2", name + strlen(watch->name));
+    free(name);
+
+    watch_destroy(watch);
+}
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -18,4 +18,10 @@
 void
 test_is_all(void **state);
 
+void
+test_watch_equal(void **state);
+
+void
+test_watch_instance_name(void **state);
+
 /* vim: set et sw=4 sts=4 tw=80: */
@@ -0,0 +1,128 @@
+/* Copyright 2014-2019 Gregor Uhlenheuer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests.h"
+#include "tests_wheel.h"
+#include "../src/wheel.h"
+
+typedef struct
+{
+    uint64_t fired;
+    uint32_t count;
+} wheel_test_t;
+
+static wheel_t *test_wheel = NULL;
+
+static void
+handle_timer(UNUSED wheel_timer_t *timer, void *data)
+{
+    wheel_test_t *test = data;
+
+    test->fired = test_wheel->now;
+    test->count++;
+}
+
+static void
+handle_repeat(wheel_timer_t *timer, void *data)
+{
+    handle_timer(timer, data);
+
+    wheel_add(test_wheel, timer, 5);
+}
+
+static void
+tick_until(wheel_t *wheel, uint64_t tick)
+{
+    while (wheel->now < tick)
+        wheel_tick(wheel);
+}
+
+void
+test_wheel_tick(UNUSED void **state)
+{
+    wheel_test_t near = {0, 0}, middle = {0, 0}, far = {0, 0};
+    wheel_timer_t t1, t2, t3;
+
+    test_wheel = wheel_new(1);
+    assert_non_null(test_wheel);
+
+    wheel_timer_init(&t1, handle_timer, &near);
+    wheel_timer_init(&t2, handle_timer, &middle);
+    wheel_timer_init(&t3, handle_timer, &far);
+
+    /* one timer on every level of the wheel */
+    wheel_add(test_wheel, &t1, 10);
+    wheel_add(test_wheel, &t2, 100);
+    wheel_add(test_wheel, &t3, 5000);
+
+    assert_true(wheel_pending(&t1));
+    assert_true(wheel_pending(&t3));
+
+    tick_until(test_wheel, 6000);
+
+    assert_int_equal(1, near.count);
+    assert_int_equal(10, near.fired);
+    assert_int_equal(1, middle.count);
+    assert_int_equal(100, middle.fired);
+    assert_int_equal(1, far.count);
+    assert_int_equal(5000, far.fired);
+
+    assert_false(wheel_pending(&t1));
+    assert_false(wheel_pending(&t3));
+
+    wheel_destroy(test_wheel);
+    test_wheel = NULL;
+}
+
+void
+test_wheel_reschedule(UNUSED void **state)
+{
+    wheel_test_t repeat = {0, 0}, removed = {0, 0};
+    wheel_timer_t t1, t2;
+
+    test_wheel = wheel_new(1);
+    assert_non_null(test_wheel);
+
+    wheel_timer_init(&t1, handle_repeat, &repeat);
+    wheel_timer_init(&t2, handle_timer, &removed);
+
+    wheel_add(test_wheel, &t1, 5);
+    wheel_add(test_wheel, &t2, 20);
+
+    /* removed timers never fire */
+    wheel_remove(&t2);
+    assert_false(wheel_pending(&t2));
+
+    tick_until(test_wheel, 50);
+
+    /* the timer rescheduled itself from its handler */
+    assert_int_equal(10, repeat.count);
+    assert_int_equal(50, repeat.fired);
+    assert_true(wheel_pending(&t1));
+    assert_int_equal(0, removed.count);
+
+    /* rescheduling moves the timer instead of adding it twice */
+    wheel_add(test_wheel, &t2, 3);
+    wheel_add(test_wheel, &t2, 8);
+    tick_until(test_wheel, 60);
+
+    assert_int_equal(1, removed.count);
+    assert_int_equal(58, removed.fired);
+
+    wheel_destroy(test_wheel);
+    test_wheel = NULL;
+}
+
+/* vim: set et sw=4 sts=4 tw=80: */